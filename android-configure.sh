@@ -894,6 +894,7 @@ fi
 case "$HOST_OS" in
     linux)
         echo "#define CONFIG_SIGNALFD       1" >> $config_h
+        echo "#define CONFIG_EPOLL          1" >> $config_h
         ;;
 esac
 
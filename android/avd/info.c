@@ -1160,6 +1160,22 @@ avdInfo_getCodeProfilePath( AvdInfo*  i, const char*  profileName )
     return ASTRDUP(tmp);
 }
 
+char*
+avdInfo_getTcgCachePath( AvdInfo*  i )
+{
+    char   tmp[MAX_PATH], *p=tmp, *end=p + sizeof(tmp);
+
+    if (i == NULL)
+        return NULL;
+
+    p = bufprint( p, end, "%s" PATH_SEP "tcg-cache.img",
+                  i->inAndroidBuild ? i->androidOut : i->contentPath );
+    if (p >= end)
+        return NULL;
+
+    return ASTRDUP(tmp);
+}
+
 const char*
 avdInfo_getCoreHwIniPath( AvdInfo* i )
 {
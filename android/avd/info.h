@@ -263,6 +263,10 @@ int          avdInfo_initHwConfig( AvdInfo*  i, AndroidHwConfig*  hw );
 /* Returns a *copy* of the path used to store profile 'foo'. result must be freed by caller */
 char*        avdInfo_getCodeProfilePath( AvdInfo*  i, const char*  profileName );
 
+/* Returns a *copy* of the path of the persistent translation cache file.
+ * result must be freed by caller */
+char*        avdInfo_getTcgCachePath( AvdInfo*  i );
+
 /* Returns the path of the hardware.ini where we will write the AVD's
  * complete hardware configuration before launching the corresponding
  * core.
@@ -11,6 +11,7 @@
 
 #include "android/base/async/Looper.h"
 
+#include "android/base/containers/PodVector.h"
 #include "android/base/containers/ScopedPointerSet.h"
 #include "android/base/containers/TailQueueList.h"
 #include "android/base/Log.h"
@@ -27,16 +28,24 @@ namespace base {
 
 namespace {
 
-// Generic looper implementation based on select().
+// Generic looper implementation based on a SocketWaiter (i.e. epoll() on
+// Linux, and select() on other platforms).
+//
+// Active timers are kept in a binary min-heap ordered by deadline, so
+// starting or stopping a timer is O(log n), and fd watches are indexed by
+// file descriptor so that dispatching an i/o event is O(1). Several watches
+// can share a descriptor, in which case the waiter looks for the union of
+// their events.
 class GenLooper : public Looper {
 public:
     GenLooper() :
             Looper(),
             mWaiter(SocketWaiter::create()),
+            mFdWatchesByFd(),
             mFdWatches(),
             mPendingFdWatches(),
-            mTimers(),
             mActiveTimers(),
+            mTimers(),
             mPendingTimers(),
             mForcedExit(false) {}
 
@@ -68,7 +77,8 @@ public:
                         mWantedEvents(0U),
                         mLastEvents(0U),
                         mPending(false),
-                        mPendingLink() {
+                        mPendingLink(),
+                        mNextForFd(NULL) {
             looper->addFdWatch(this);
         }
 
@@ -88,7 +98,7 @@ public:
             unsigned newEvents = mWantedEvents | events;
             if (newEvents != mWantedEvents) {
                 mWantedEvents = newEvents;
-                genLooper()->updateFdWatch(mFd, newEvents);
+                genLooper()->updateFdWatch(mFd);
             }
         }
 
@@ -97,7 +107,7 @@ public:
             unsigned newEvents = mWantedEvents & ~events;
             if (newEvents != mWantedEvents) {
                 mWantedEvents = newEvents;
-                genLooper()->updateFdWatch(mFd, newEvents);
+                genLooper()->updateFdWatch(mFd);
             }
             // These events are no longer desired.
             mLastEvents &= ~events;
@@ -107,6 +117,10 @@ public:
             return mLastEvents;
         }
 
+        unsigned wantedEvents() const {
+            return mWantedEvents;
+        }
+
         // Return true iff this FdWatch is pending execution.
         bool isPending() const {
             return mPending;
@@ -138,21 +152,62 @@ public:
 
         TAIL_QUEUE_LIST_TRAITS(Traits, FdWatch, mPendingLink);
 
+        // Next watch of the same file descriptor, see findFdWatch().
+        FdWatch* nextForFd() const {
+            return mNextForFd;
+        }
+
     private:
+        friend class GenLooper;
+
         unsigned mWantedEvents;
         unsigned mLastEvents;
         bool mPending;
         TailQueueLink<FdWatch> mPendingLink;
+        FdWatch* mNextForFd;
     };
 
     void addFdWatch(FdWatch* watch) {
         mFdWatches.add(watch);
+        int fd = watch->fd();
+        if (fd < 0) {
+            return;
+        }
+        size_t oldSize = mFdWatchesByFd.size();
+        if ((size_t)fd >= oldSize) {
+            mFdWatchesByFd.resize((size_t)fd + 1);
+            for (size_t n = oldSize; n <= (size_t)fd; ++n) {
+                mFdWatchesByFd[n] = NULL;
+            }
+        }
+        watch->mNextForFd = mFdWatchesByFd[fd];
+        mFdWatchesByFd[fd] = watch;
     }
 
     void delFdWatch(FdWatch* watch) {
+        int fd = watch->fd();
+        if (fd >= 0 && (size_t)fd < mFdWatchesByFd.size()) {
+            FdWatch** link = &mFdWatchesByFd[fd];
+            while (*link && *link != watch) {
+                link = &(*link)->mNextForFd;
+            }
+            if (*link) {
+                *link = watch->mNextForFd;
+            }
+            watch->mNextForFd = NULL;
+        }
         mFdWatches.pick(watch);
     }
 
+    // Return the first FdWatch corresponding to |fd|, or NULL if there is
+    // none. The other ones are linked through FdWatch::nextForFd().
+    FdWatch* findFdWatch(int fd) const {
+        if (fd < 0 || (size_t)fd >= mFdWatchesByFd.size()) {
+            return NULL;
+        }
+        return mFdWatchesByFd[fd];
+    }
+
     void addPendingFdWatch(FdWatch* watch) {
         mPendingFdWatches.insertTail(watch);
     }
@@ -161,7 +216,13 @@ public:
         mPendingFdWatches.remove(watch);
     }
 
-    void updateFdWatch(int fd, unsigned wantedEvents) {
+    // Tell the waiter about the events wanted by the watches of |fd|.
+    void updateFdWatch(int fd) {
+        unsigned wantedEvents = 0;
+        for (FdWatch* watch = findFdWatch(fd); watch;
+                watch = watch->nextForFd()) {
+            wantedEvents |= watch->wantedEvents();
+        }
         mWaiter->update(fd, wantedEvents);
     }
 
@@ -181,6 +242,7 @@ public:
         Timer(GenLooper* looper, Callback callback, void* opaque) :
                 Looper::Timer(looper, callback, opaque),
                 mDeadline(kDurationInfinite),
+                mHeapIndex(-1),
                 mPending(false),
                 mPendingLink() {
             DCHECK(mCallback);
@@ -193,13 +255,19 @@ public:
 
         virtual ~Timer() {
             clearPending();
+            if (mHeapIndex >= 0) {
+                genLooper()->disableTimer(this);
+            }
             genLooper()->delTimer(this);
         }
 
-        Timer* next() const { return mPendingLink.next(); }
-
         Duration deadline() const { return mDeadline; }
 
+        // Position of this timer in the looper's active timer heap, or
+        // -1 if it is not active.
+        int heapIndex() const { return mHeapIndex; }
+        void setHeapIndex(int index) { mHeapIndex = index; }
+
         virtual void startRelative(Duration deadlineMs) {
             if (deadlineMs != kDurationInfinite) {
                 deadlineMs += mLooper->nowMs();
@@ -208,7 +276,10 @@ public:
         }
 
         virtual void startAbsolute(Duration deadlineMs) {
-            if (mDeadline != kDurationInfinite) {
+            // Restarting or stopping a timer that already expired, but
+            // whose callback was not called yet, cancels the callback.
+            clearPending();
+            if (mHeapIndex >= 0) {
                 genLooper()->disableTimer(this);
             }
             mDeadline = deadlineMs;
@@ -248,6 +319,7 @@ public:
 
     private:
         Duration mDeadline;
+        int mHeapIndex;
         bool mPending;
         TailQueueLink<Timer> mPendingLink;
     };
@@ -261,21 +333,77 @@ public:
     }
 
     void enableTimer(Timer* timer) {
-        // Find the first timer that expires after this one.
-        Timer* item = mActiveTimers.front();
-        while (item && item->deadline() < timer->deadline()) {
-            item = item->next();
-        }
-        if (item) {
-            mActiveTimers.insertBefore(item, timer);
+        DCHECK(timer->heapIndex() < 0);
+        size_t index = mActiveTimers.size();
+        mActiveTimers.append(timer);
+        timer->setHeapIndex((int)index);
+        siftTimerUp(index);
+    }
+
+    void disableTimer(Timer* timer) {
+        int index = timer->heapIndex();
+        DCHECK(index >= 0);
+        DCHECK(mActiveTimers[index] == timer);
+        size_t last = mActiveTimers.size() - 1U;
+        timer->setHeapIndex(-1);
+        if ((size_t)index != last) {
+            // Move the last heap item into the hole, then restore the
+            // heap property in whichever direction is needed.
+            Timer* moved = mActiveTimers[last];
+            mActiveTimers[index] = moved;
+            moved->setHeapIndex(index);
+            mActiveTimers.resize(last);
+            siftTimerUp(index);
+            siftTimerDown(moved->heapIndex());
         } else {
-            mActiveTimers.insertTail(timer);
+            mActiveTimers.resize(last);
         }
     }
 
-    void disableTimer(Timer* timer) {
-        // Simply remove from the list.
-        mActiveTimers.remove(timer);
+    // Return the active timer with the earliest deadline, or NULL.
+    Timer* firstActiveTimer() const {
+        return mActiveTimers.empty() ? NULL : mActiveTimers[0];
+    }
+
+    void siftTimerUp(size_t index) {
+        Timer* timer = mActiveTimers[index];
+        while (index > 0) {
+            size_t parent = (index - 1U) / 2U;
+            Timer* parentTimer = mActiveTimers[parent];
+            if (parentTimer->deadline() <= timer->deadline()) {
+                break;
+            }
+            mActiveTimers[index] = parentTimer;
+            parentTimer->setHeapIndex((int)index);
+            index = parent;
+        }
+        mActiveTimers[index] = timer;
+        timer->setHeapIndex((int)index);
+    }
+
+    void siftTimerDown(size_t index) {
+        size_t count = mActiveTimers.size();
+        Timer* timer = mActiveTimers[index];
+        for (;;) {
+            size_t child = 2U * index + 1U;
+            if (child >= count) {
+                break;
+            }
+            if (child + 1U < count &&
+                    mActiveTimers[child + 1U]->deadline() <
+                            mActiveTimers[child]->deadline()) {
+                child++;
+            }
+            Timer* childTimer = mActiveTimers[child];
+            if (timer->deadline() <= childTimer->deadline()) {
+                break;
+            }
+            mActiveTimers[index] = childTimer;
+            childTimer->setHeapIndex((int)index);
+            index = child;
+        }
+        mActiveTimers[index] = timer;
+        timer->setHeapIndex((int)index);
     }
 
     void addPendingTimer(Timer* timer) {
@@ -308,7 +436,7 @@ public:
             // Compute next deadline from timers.
             Duration nextDeadline = kDurationInfinite;
 
-            Timer* firstTimer = mActiveTimers.front();
+            Timer* firstTimer = firstActiveTimer();
             if (firstTimer) {
                 nextDeadline = firstTimer->deadline();
             }
@@ -340,14 +468,11 @@ public:
                         break;
                     }
 
-                    // Find the FdWatch for this file descriptor.
-                    // TODO(digit): Improve efficiency with a map?
-                    FdWatchSet::Iterator iter(&mFdWatches);
-                    while (iter.hasNext()) {
-                        FdWatch* watch = iter.next();
-                        if (watch->fd() == fd) {
-                            watch->setPending(events);
-                            break;
+                    for (FdWatch* watch = findFdWatch(fd); watch;
+                            watch = watch->nextForFd()) {
+                        unsigned watchEvents = events & watch->wantedEvents();
+                        if (watchEvents) {
+                            watch->setPending(watchEvents);
                         }
                     }
                 }
@@ -357,16 +482,15 @@ public:
             DCHECK(mPendingTimers.empty());
 
             const Duration kNow = nowMs();
-            Timer* timer = mActiveTimers.front();
-            while (timer) {
-                if (timer->deadline() > kNow) {
+            for (;;) {
+                Timer* timer = firstActiveTimer();
+                if (!timer || timer->deadline() > kNow) {
                     break;
                 }
 
-                // Remove from active list, add to pending list.
-                mActiveTimers.remove(timer);
+                // Remove from active heap, add to pending list.
+                disableTimer(timer);
                 timer->setPending();
-                timer = timer->next();
             }
 
             // Fire the pending timers, this is done in a separate step
@@ -400,18 +524,23 @@ public:
     }
 
     typedef TailQueueList<Timer> TimerList;
+    typedef PodVector<Timer*> TimerHeap;
     typedef ScopedPointerSet<Timer> TimerSet;
 
     typedef TailQueueList<FdWatch> FdWatchList;
+    typedef PodVector<FdWatch*> FdWatchTable;
     typedef ScopedPointerSet<FdWatch> FdWatchSet;
 
 private:
+    // NOTE: The tables below are declared before the sets that own the
+    // FdWatch and Timer instances, since their destructors access them.
     ScopedPtr<SocketWaiter> mWaiter;
-    FdWatchSet mFdWatches;         // Set of all fd watches.
+    FdWatchTable mFdWatchesByFd;    // Fd watches, indexed by fd.
+    FdWatchSet mFdWatches;          // Set of all fd watches.
     FdWatchList mPendingFdWatches;  // Queue of pending fd watches.
 
+    TimerHeap mActiveTimers;  // Min-heap of active timers, by deadline.
     TimerSet  mTimers;        // Set of all timers.
-    TimerList mActiveTimers;  // Sorted list of active timers.
     TimerList mPendingTimers; // Sorted list of pending timers.
 
     bool mForcedExit;
@@ -0,0 +1,202 @@
+// Copyright 2014 The Android Open Source Project
+//
+// This software is licensed under the terms of the GNU General Public
+// License version 2, as published by the Free Software Foundation, and
+// may be copied, distributed, and modified under those terms.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+
+// A small micro-benchmark for android::base::Looper. It measures:
+//
+//   - Timer churn, i.e. the cost of restarting / stopping many active
+//     timers, which is what proxies with per-connection timeouts do.
+//
+//   - FdWatch scaling, i.e. the cost of one loop iteration when only a
+//     small fraction of a large number of watched sockets is active.
+//
+// Usage: emulator_looper_benchmark [<timers> [<watches>]]
+
+#include "android/base/async/Looper.h"
+
+#include "android/base/containers/PodVector.h"
+#include "android/base/memory/ScopedPtr.h"
+#include "android/base/sockets/SocketUtils.h"
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/time.h>
+
+#ifndef _WIN32
+#include <sys/resource.h>
+#endif
+
+using android::base::Looper;
+using android::base::PodVector;
+using android::base::ScopedPtr;
+using android::base::socketClose;
+using android::base::socketCreatePair;
+using android::base::socketRecv;
+using android::base::socketSend;
+using android::base::socketSetNonBlocking;
+
+namespace {
+
+int64_t nowUs() {
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return (int64_t)tv.tv_sec * 1000000LL + tv.tv_usec;
+}
+
+// A trivial linear congruential generator, to get reproducible results
+// across platforms.
+uint32_t nextRandom(uint32_t* state) {
+    *state = *state * 1103515245U + 12345U;
+    return (*state >> 16) & 0x7fff;
+}
+
+int sTimerFired = 0;
+
+void onTimer(void*) {
+    sTimerFired++;
+}
+
+int sFdFired = 0;
+
+void onFdEvent(void*, int fd, unsigned events) {
+    sFdFired++;
+    if (events & Looper::FdWatch::kEventRead) {
+        char buf[16];
+        socketRecv(fd, buf, sizeof(buf));
+    }
+}
+
+void benchTimers(int count) {
+    ScopedPtr<Looper> looper(Looper::create());
+    PodVector<Looper::Timer*> timers;
+    timers.resize(count);
+    for (int n = 0; n < count; ++n) {
+        timers[n] = looper->createTimer(onTimer, NULL);
+    }
+
+    uint32_t seed = 1;
+    const int kRounds = 10;
+
+    // Start all timers with random deadlines far in the future, then
+    // restart each of them several times.
+    int64_t t0 = nowUs();
+    for (int round = 0; round < kRounds; ++round) {
+        for (int n = 0; n < count; ++n) {
+            timers[n]->startRelative(60000 + nextRandom(&seed));
+        }
+    }
+    int64_t t1 = nowUs();
+    for (int n = 0; n < count; ++n) {
+        timers[n]->stop();
+    }
+    int64_t t2 = nowUs();
+
+    // Now make them all expire and measure dispatch.
+    const Looper::Duration past = looper->nowMs() - 1;
+    for (int n = 0; n < count; ++n) {
+        timers[n]->startAbsolute(past - nextRandom(&seed));
+    }
+    sTimerFired = 0;
+    int64_t t3 = nowUs();
+    while (looper->runWithTimeoutMs(0) == ETIMEDOUT && sTimerFired < count) {
+    }
+    int64_t t4 = nowUs();
+
+    const int kStarts = count * kRounds;
+    printf("timers: %d active\n", count);
+    printf("  restart: %8.1f ns/op (%d ops)\n",
+           (t1 - t0) * 1000.0 / kStarts, kStarts);
+    printf("  stop:    %8.1f ns/op (%d ops)\n",
+           (t2 - t1) * 1000.0 / count, count);
+    printf("  expire:  %8.1f ns/op (%d fired)\n",
+           (t4 - t3) * 1000.0 / (sTimerFired ? sTimerFired : 1),
+           sTimerFired);
+
+    for (int n = 0; n < count; ++n) {
+        delete timers[n];
+    }
+}
+
+void benchFdWatches(int count) {
+#ifndef _WIN32
+    // Each socket pair uses two descriptors, both of which are watched.
+    struct rlimit rlim;
+    if (getrlimit(RLIMIT_NOFILE, &rlim) == 0 &&
+            rlim.rlim_cur < (rlim_t)count + 64) {
+        rlim.rlim_cur = rlim.rlim_max;
+        setrlimit(RLIMIT_NOFILE, &rlim);
+    }
+#endif
+    ScopedPtr<Looper> looper(Looper::create());
+    PodVector<int> fds;
+    PodVector<Looper::FdWatch*> watches;
+
+    for (int n = 0; n + 1 < count; n += 2) {
+        int s1, s2;
+        if (socketCreatePair(&s1, &s2) < 0) {
+            break;
+        }
+        socketSetNonBlocking(s1);
+        socketSetNonBlocking(s2);
+        fds.append(s1);
+        fds.append(s2);
+    }
+    const int fdCount = (int)fds.size();
+    for (int n = 0; n < fdCount; ++n) {
+        Looper::FdWatch* watch =
+                looper->createFdWatch(fds[n], onFdEvent, NULL);
+        watch->wantRead();
+        watches.append(watch);
+    }
+
+    // Each iteration, 1% of the sockets receive one byte.
+    const int kIterations = 100;
+    const int kActive = fdCount / 100 > 0 ? fdCount / 100 : 1;
+    uint32_t seed = 1;
+    int64_t total = 0;
+    sFdFired = 0;
+    for (int iter = 0; iter < kIterations; ++iter) {
+        for (int n = 0; n < kActive; ++n) {
+            int index = (int)(nextRandom(&seed) % (uint32_t)fdCount);
+            // Send on the peer so that fds[index] becomes readable.
+            socketSend(fds[index ^ 1], "!", 1);
+        }
+        int64_t t0 = nowUs();
+        looper->runWithTimeoutMs(0);
+        total += nowUs() - t0;
+    }
+
+    printf("fd watches: %d watched, ~%d active per iteration\n",
+           fdCount, kActive);
+    printf("  iteration: %8.1f us (%d events dispatched)\n",
+           (double)total / kIterations, sFdFired);
+
+    for (int n = 0; n < fdCount; ++n) {
+        delete watches[n];
+        socketClose(fds[n]);
+    }
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+    int timerCount = 10000;
+    int watchCount = 10000;
+    if (argc > 1) {
+        timerCount = atoi(argv[1]);
+    }
+    if (argc > 2) {
+        watchCount = atoi(argv[2]);
+    }
+    benchTimers(timerCount);
+    benchFdWatches(watchCount);
+    return 0;
+}
@@ -0,0 +1,299 @@
+// Copyright 2014 The Android Open Source Project
+//
+// This software is licensed under the terms of the GNU General Public
+// License version 2, as published by the Free Software Foundation, and
+// may be copied, distributed, and modified under those terms.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+
+#include "android/base/async/Looper.h"
+
+#include "android/base/memory/ScopedPtr.h"
+#include "android/base/sockets/SocketUtils.h"
+
+#include <gtest/gtest.h>
+
+#include <errno.h>
+
+namespace android {
+namespace base {
+
+namespace {
+
+// A small helper used to record the order in which timers fire.
+struct TimerRecorder {
+    TimerRecorder() : count(0) {}
+
+    enum { kMaxRecords = 16 };
+
+    void record(int id) {
+        if (count < kMaxRecords) {
+            ids[count] = id;
+        }
+        count++;
+    }
+
+    int ids[kMaxRecords];
+    int count;
+};
+
+struct TimerData {
+    TimerRecorder* recorder;
+    int id;
+};
+
+void onTimer(void* opaque) {
+    TimerData* data = static_cast<TimerData*>(opaque);
+    data->recorder->record(data->id);
+}
+
+struct FdData {
+    FdData() : fd(-1), events(0U), count(0) {}
+    int fd;
+    unsigned events;
+    int count;
+};
+
+void onFdEvent(void* opaque, int fd, unsigned events) {
+    FdData* data = static_cast<FdData*>(opaque);
+    data->fd = fd;
+    data->events = events;
+    data->count++;
+    if (events & Looper::FdWatch::kEventRead) {
+        char c;
+        socketRecv(fd, &c, 1);
+    }
+}
+
+// Like onFdEvent(), then stop waiting for the received events, which
+// lets runWithTimeoutMs() return for a socket that stays writable.
+struct FdOnceData {
+    FdOnceData() : data(), watch(NULL) {}
+    FdData data;
+    Looper::FdWatch* watch;
+};
+
+void onFdEventOnce(void* opaque, int fd, unsigned events) {
+    FdOnceData* once = static_cast<FdOnceData*>(opaque);
+    onFdEvent(&once->data, fd, events);
+    once->watch->removeEvents(events);
+}
+
+// Run |looper| until it has no more active timers or watchers. Note that
+// runWithTimeoutMs() returns ETIMEDOUT after each pass when there are no
+// file descriptors to wait on.
+int runUntilIdle(Looper* looper) {
+    int ret;
+    do {
+        ret = looper->runWithTimeoutMs(1000);
+    } while (ret == ETIMEDOUT);
+    return ret;
+}
+
+}  // namespace
+
+TEST(Looper, EmptyLooperReturnsImmediately) {
+    ScopedPtr<Looper> looper(Looper::create());
+    EXPECT_EQ(EWOULDBLOCK, looper->runWithTimeoutMs(1000));
+}
+
+TEST(Looper, TimersFireInDeadlineOrder) {
+    ScopedPtr<Looper> looper(Looper::create());
+    TimerRecorder recorder;
+
+    const int kCount = 8;
+    // Deadlines deliberately out of order.
+    const int kDeadlines[kCount] = { 5, 1, 7, 3, 0, 6, 2, 4 };
+    TimerData data[kCount];
+    ScopedPtr<Looper::Timer> timers[kCount];
+
+    const Looper::Duration now = looper->nowMs();
+    for (int n = 0; n < kCount; ++n) {
+        data[n].recorder = &recorder;
+        data[n].id = kDeadlines[n];
+        timers[n].reset(looper->createTimer(onTimer, &data[n]));
+        timers[n]->startAbsolute(now + kDeadlines[n]);
+        EXPECT_TRUE(timers[n]->isActive());
+    }
+
+    EXPECT_EQ(EWOULDBLOCK, runUntilIdle(looper.get()));
+    ASSERT_EQ(kCount, recorder.count);
+    for (int n = 0; n < kCount; ++n) {
+        EXPECT_EQ(n, recorder.ids[n]) << "index " << n;
+        EXPECT_FALSE(timers[n]->isActive());
+    }
+}
+
+TEST(Looper, AllExpiredTimersFireTogether) {
+    ScopedPtr<Looper> looper(Looper::create());
+    TimerRecorder recorder;
+
+    const int kCount = 4;
+    TimerData data[kCount];
+    ScopedPtr<Looper::Timer> timers[kCount];
+
+    // All timers have already expired.
+    const Looper::Duration deadline = looper->nowMs() - 10;
+    for (int n = 0; n < kCount; ++n) {
+        data[n].recorder = &recorder;
+        data[n].id = n;
+        timers[n].reset(looper->createTimer(onTimer, &data[n]));
+        timers[n]->startAbsolute(deadline);
+    }
+
+    // A single zero-length run must fire all of them.
+    looper->runWithDeadlineMs(0);
+    EXPECT_EQ(kCount, recorder.count);
+}
+
+TEST(Looper, StoppedTimersDoNotFire) {
+    ScopedPtr<Looper> looper(Looper::create());
+    TimerRecorder recorder;
+
+    const int kCount = 6;
+    TimerData data[kCount];
+    ScopedPtr<Looper::Timer> timers[kCount];
+
+    for (int n = 0; n < kCount; ++n) {
+        data[n].recorder = &recorder;
+        data[n].id = n;
+        timers[n].reset(looper->createTimer(onTimer, &data[n]));
+        timers[n]->startRelative(n);
+    }
+
+    // Stop every odd timer, and destroy one active one.
+    for (int n = 1; n < kCount; n += 2) {
+        timers[n]->stop();
+        EXPECT_FALSE(timers[n]->isActive());
+    }
+    timers[4].reset(NULL);
+
+    EXPECT_EQ(EWOULDBLOCK, runUntilIdle(looper.get()));
+    ASSERT_EQ(2, recorder.count);
+    EXPECT_EQ(0, recorder.ids[0]);
+    EXPECT_EQ(2, recorder.ids[1]);
+}
+
+TEST(Looper, RestartedTimerFiresOnce) {
+    ScopedPtr<Looper> looper(Looper::create());
+    TimerRecorder recorder;
+    TimerData data = { &recorder, 42 };
+
+    ScopedPtr<Looper::Timer> timer(looper->createTimer(onTimer, &data));
+    for (int n = 0; n < 10; ++n) {
+        timer->startRelative(100 - n * 10);
+    }
+    EXPECT_EQ(EWOULDBLOCK, runUntilIdle(looper.get()));
+    EXPECT_EQ(1, recorder.count);
+}
+
+TEST(Looper, FdWatchReadEvent) {
+    ScopedPtr<Looper> looper(Looper::create());
+
+    int s1, s2;
+    ASSERT_EQ(0, socketCreatePair(&s1, &s2));
+
+    FdData data;
+    ScopedPtr<Looper::FdWatch> watch(
+            looper->createFdWatch(s1, onFdEvent, &data));
+    watch->wantRead();
+
+    // Nothing to read yet.
+    EXPECT_EQ(ETIMEDOUT, looper->runWithTimeoutMs(0));
+    EXPECT_EQ(0, data.count);
+
+    char c = 'x';
+    ASSERT_EQ(1, socketSend(s2, &c, 1));
+
+    EXPECT_EQ(ETIMEDOUT, looper->runWithTimeoutMs(0));
+    EXPECT_EQ(1, data.count);
+    EXPECT_EQ(s1, data.fd);
+    EXPECT_EQ((unsigned)Looper::FdWatch::kEventRead, data.events);
+
+    watch.reset(NULL);
+    socketClose(s1);
+    socketClose(s2);
+}
+
+TEST(Looper, ManyFdWatches) {
+    ScopedPtr<Looper> looper(Looper::create());
+
+    const int kCount = 64;
+    int fds[kCount][2];
+    FdData data[kCount];
+    ScopedPtr<Looper::FdWatch> watches[kCount];
+
+    for (int n = 0; n < kCount; ++n) {
+        ASSERT_EQ(0, socketCreatePair(&fds[n][0], &fds[n][1]));
+        watches[n].reset(
+                looper->createFdWatch(fds[n][0], onFdEvent, &data[n]));
+        watches[n]->wantRead();
+    }
+
+    // Only signal every third pair.
+    for (int n = 0; n < kCount; n += 3) {
+        char c = 'x';
+        ASSERT_EQ(1, socketSend(fds[n][1], &c, 1));
+    }
+
+    EXPECT_EQ(ETIMEDOUT, looper->runWithTimeoutMs(0));
+    for (int n = 0; n < kCount; ++n) {
+        if ((n % 3) == 0) {
+            EXPECT_EQ(1, data[n].count) << "index " << n;
+            EXPECT_EQ(fds[n][0], data[n].fd);
+        } else {
+            EXPECT_EQ(0, data[n].count) << "index " << n;
+        }
+    }
+
+    for (int n = 0; n < kCount; ++n) {
+        watches[n].reset(NULL);
+        socketClose(fds[n][0]);
+        socketClose(fds[n][1]);
+    }
+}
+
+TEST(Looper, FdWatchesSharingDescriptor) {
+    ScopedPtr<Looper> looper(Looper::create());
+
+    int s1, s2;
+    ASSERT_EQ(0, socketCreatePair(&s1, &s2));
+
+    FdData readData;
+    FdOnceData writeOnce;
+    FdData& writeData = writeOnce.data;
+    ScopedPtr<Looper::FdWatch> readWatch(
+            looper->createFdWatch(s1, onFdEvent, &readData));
+    ScopedPtr<Looper::FdWatch> writeWatch(
+            looper->createFdWatch(s1, onFdEventOnce, &writeOnce));
+    writeOnce.watch = writeWatch.get();
+    readWatch->wantRead();
+    writeWatch->wantWrite();
+
+    char c = 'x';
+    ASSERT_EQ(1, socketSend(s2, &c, 1));
+
+    // Each watch only receives the events it wants.
+    EXPECT_EQ(ETIMEDOUT, looper->runWithTimeoutMs(0));
+    EXPECT_EQ(1, readData.count);
+    EXPECT_EQ((unsigned)Looper::FdWatch::kEventRead, readData.events);
+    EXPECT_EQ(1, writeData.count);
+    EXPECT_EQ((unsigned)Looper::FdWatch::kEventWrite, writeData.events);
+
+    // Deleting one watch doesn't affect the other one.
+    writeWatch.reset(NULL);
+    ASSERT_EQ(1, socketSend(s2, &c, 1));
+    EXPECT_EQ(ETIMEDOUT, looper->runWithTimeoutMs(0));
+    EXPECT_EQ(2, readData.count);
+    EXPECT_EQ(1, writeData.count);
+
+    readWatch.reset(NULL);
+    socketClose(s1);
+    socketClose(s2);
+}
+
+}  // namespace base
+}  // namespace android
@@ -13,6 +13,8 @@
 #include "android/base/Limits.h"
 #include "android/base/sockets/SocketWaiter.h"
 
+#include "android/base/containers/PodVector.h"
+#include "android/base/EintrWrapper.h"
 #include "android/base/Log.h"
 #include "android/base/sockets/SocketErrors.h"
 
@@ -21,10 +23,16 @@
 #else
 #  include <sys/types.h>
 #  include <sys/select.h>
+#  include <unistd.h>
+#endif
+
+#ifdef __linux__
+#  include <sys/epoll.h>
 #endif
 
 
 #include <errno.h>
+#include <limits.h>
 #include <string.h>
 
 namespace android {
@@ -249,11 +257,292 @@ private:
     int mPendingFd;
 };
 
+#ifdef __linux__
+
+// A SocketWaiter implementation based on epoll(). Unlike select(), it is
+// not limited to FD_SETSIZE descriptors, and the cost of wait() only
+// depends on the number of descriptors that actually have pending events,
+// not on the number of registered ones.
+class EpollSocketWaiter : public SocketWaiter {
+public:
+    EpollSocketWaiter() :
+            SocketWaiter(),
+            mEpollFd(-1),
+            mFdCount(0),
+            mWanted(),
+            mPending(),
+            mResults(),
+            mResultCount(0),
+            mPendingIndex(0),
+            mUnpollableFds() {
+        mEpollFd = ::epoll_create1(EPOLL_CLOEXEC);
+        if (mEpollFd < 0) {
+            PLOG(ERROR) << "Could not create epoll instance";
+        }
+    }
+
+    virtual ~EpollSocketWaiter() {
+        if (mEpollFd >= 0) {
+            IGNORE_EINTR(::close(mEpollFd));
+        }
+    }
+
+    virtual void reset() {
+        // Removing all descriptors one by one would be O(n), just
+        // replace the epoll instance instead.
+        if (mEpollFd >= 0) {
+            IGNORE_EINTR(::close(mEpollFd));
+        }
+        mEpollFd = ::epoll_create1(EPOLL_CLOEXEC);
+        for (size_t n = 0; n < mWanted.size(); ++n) {
+            mWanted[n] = 0;
+        }
+        clearPendingEvents();
+        mFdCount = 0;
+        mUnpollableFds.resize(0);
+    }
+
+    virtual unsigned wantedEventsFor(int fd) const {
+        if (fd < 0 || (size_t)fd >= mWanted.size()) {
+            return 0U;
+        }
+        return mWanted[fd];
+    }
+
+    virtual unsigned pendingEventsFor(int fd) const {
+        if (fd < 0 || (size_t)fd >= mPending.size()) {
+            return 0U;
+        }
+        return mPending[fd];
+    }
+
+    virtual bool hasFds() const {
+        return mFdCount > 0;
+    }
+
+    virtual void update(int fd, unsigned events) {
+        DCHECK(fd >= 0) << "fd " << fd;
+        events &= (kEventRead | kEventWrite);
+
+        unsigned oldEvents = wantedEventsFor(fd);
+        if (events == oldEvents && (events == 0 || isUnpollable(fd))) {
+            return;
+        }
+        // Otherwise, always tell the kernel: |fd| may have been closed
+        // since the last call, which removed it from the epoll set, and its
+        // number reused for a new descriptor. EPOLL_CTL_MOD fails with
+        // ENOENT in this case, and is retried with EPOLL_CTL_ADD below.
+
+        if ((size_t)fd >= mWanted.size()) {
+            growTables(fd);
+        }
+
+        struct epoll_event ev;
+        ::memset(&ev, 0, sizeof(ev));
+        ev.data.fd = fd;
+        if (events & kEventRead) {
+            ev.events |= EPOLLIN;
+        }
+        if (events & kEventWrite) {
+            ev.events |= EPOLLOUT;
+        }
+
+        int op;
+        if (oldEvents == 0) {
+            op = EPOLL_CTL_ADD;
+            mFdCount++;
+        } else if (events == 0) {
+            op = EPOLL_CTL_DEL;
+            mFdCount--;
+        } else {
+            op = EPOLL_CTL_MOD;
+        }
+        if (isUnpollable(fd)) {
+            if (events == 0) {
+                removeUnpollable(fd);
+            }
+        } else if (::epoll_ctl(mEpollFd, op, fd, &ev) < 0) {
+            if (op == EPOLL_CTL_MOD && errno == ENOENT) {
+                // The descriptor was closed, which removed it from the
+                // epoll set, then its number was reused.
+                op = EPOLL_CTL_ADD;
+                if (::epoll_ctl(mEpollFd, op, fd, &ev) == 0) {
+                    errno = 0;
+                }
+            }
+            if (errno == 0 || (op == EPOLL_CTL_DEL &&
+                               (errno == EBADF || errno == ENOENT))) {
+                // Nothing to do, closing a descriptor removes it from
+                // the epoll set automatically.
+            } else if (op == EPOLL_CTL_ADD && errno == EPERM) {
+                // Regular files and a few other descriptor types cannot
+                // be used with epoll(). select() always reports them
+                // as ready, so do the same here.
+                mUnpollableFds.append(fd);
+            } else {
+                PLOG(ERROR) << "epoll_ctl() failed for fd " << fd;
+            }
+        }
+        mWanted[fd] = events;
+        // Do not report events that are no longer wanted.
+        mPending[fd] &= events;
+    }
+
+    virtual int wait(int64_t timeout_ms) {
+        clearPendingEvents();
+
+        // Nothing to wait on.
+        if (mFdCount <= 0) {
+            return 0;
+        }
+
+        int timeout;
+        if (timeout_ms < 0 || timeout_ms == INT64_MAX) {
+            timeout = -1;
+        } else if (timeout_ms > INT_MAX) {
+            timeout = INT_MAX;
+        } else {
+            timeout = (int)timeout_ms;
+        }
+
+        // Don't block if some descriptors are always ready.
+        const int unpollableCount = (int)mUnpollableFds.size();
+        if (unpollableCount > 0) {
+            timeout = 0;
+        }
+
+        // There can't be more results than registered descriptors.
+        if (mResults.size() < (size_t)mFdCount) {
+            mResults.resize(mFdCount);
+        }
+
+        const int pollableCount = mFdCount - unpollableCount;
+        int ret = 0;
+        if (pollableCount > 0) {
+            do {
+                ret = ::epoll_wait(mEpollFd,
+                                   mResults.begin(),
+                                   pollableCount,
+                                   timeout);
+            } while (ret < 0 && errno == EINTR);
+        }
+
+        if (ret < 0) {
+            LOG(ERROR) << LogString("Error: %s\n", strerror(errno));
+            return ret;
+        }
+
+        for (int n = 0; n < unpollableCount; ++n) {
+            struct epoll_event& ev = mResults[ret++];
+            ev.data.fd = mUnpollableFds[n];
+            ev.events = EPOLLIN | EPOLLOUT;
+        }
+
+        // Translate epoll events into SocketWaiter ones. Errors and
+        // hang-ups are reported as readable/writable like select() does.
+        int count = 0;
+        for (int n = 0; n < ret; ++n) {
+            const struct epoll_event& ev = mResults[n];
+            int fd = ev.data.fd;
+            unsigned wanted = mWanted[fd];
+            unsigned events = 0;
+            if (ev.events & (EPOLLIN | EPOLLHUP | EPOLLERR)) {
+                events |= kEventRead;
+            }
+            if (ev.events & (EPOLLOUT | EPOLLERR)) {
+                events |= kEventWrite;
+            }
+            events &= wanted;
+            if (!events) {
+                continue;
+            }
+            mPending[fd] = events;
+            mResults[count++] = ev;
+        }
+        mResultCount = count;
+        if (count == 0) {
+            errno = ETIMEDOUT;
+        }
+        return count;
+    }
+
+    virtual int nextPendingFd(unsigned* fdEvents) {
+        while (mPendingIndex < mResultCount) {
+            int fd = mResults[mPendingIndex++].data.fd;
+            unsigned events = mPending[fd];
+            if (events) {
+                *fdEvents = events;
+                return fd;
+            }
+        }
+        *fdEvents = 0;
+        return -1;
+    }
+
+private:
+    // Resize the per-descriptor tables to include |fd|.
+    void growTables(int fd) {
+        size_t oldSize = mWanted.size();
+        size_t newSize = oldSize < 64 ? 64 : oldSize;
+        while (newSize <= (size_t)fd) {
+            newSize *= 2;
+        }
+        mWanted.resize(newSize);
+        mPending.resize(newSize);
+        for (size_t n = oldSize; n < newSize; ++n) {
+            mWanted[n] = 0;
+            mPending[n] = 0;
+        }
+    }
+
+    bool isUnpollable(int fd) const {
+        for (size_t n = 0; n < mUnpollableFds.size(); ++n) {
+            if (mUnpollableFds[n] == fd) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    void removeUnpollable(int fd) {
+        for (size_t n = 0; n < mUnpollableFds.size(); ++n) {
+            if (mUnpollableFds[n] == fd) {
+                mUnpollableFds.remove(n);
+                return;
+            }
+        }
+    }
+
+    // Clear the pending events recorded by the previous wait() call.
+    void clearPendingEvents() {
+        for (int n = 0; n < mResultCount; ++n) {
+            mPending[mResults[n].data.fd] = 0;
+        }
+        mResultCount = 0;
+        mPendingIndex = 0;
+    }
+
+    int mEpollFd;
+    int mFdCount;
+    PodVector<unsigned> mWanted;    // Wanted events, indexed by fd.
+    PodVector<unsigned> mPending;   // Pending events, indexed by fd.
+    PodVector<struct epoll_event> mResults;
+    int mResultCount;
+    int mPendingIndex;
+    PodVector<int> mUnpollableFds;  // Registered fds not supported by epoll.
+};
+
+#endif  // __linux__
+
 }  // namespace
 
 // static
 SocketWaiter* SocketWaiter::create() {
+#ifdef __linux__
+    return new EpollSocketWaiter();
+#else
     return new SelectSocketWaiter();
+#endif
 }
 
 }  // namespace base
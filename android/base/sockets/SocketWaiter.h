@@ -59,6 +59,9 @@ namespace base {
 //
 //        waiter->update(fd2, 0);
 //
+// On Linux, the implementation is based on epoll() and is not limited
+// to FD_SETSIZE descriptors. Other platforms use select().
+//
 class SocketWaiter {
 public:
     enum Event {
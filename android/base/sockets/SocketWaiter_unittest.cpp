@@ -15,6 +15,10 @@
 
 #include <gtest/gtest.h>
 
+#ifndef _WIN32
+#include <unistd.h>
+#endif
+
 namespace android {
 namespace base {
 
@@ -121,6 +125,38 @@ TEST(SocketWaiter, waitOnWriteEvent) {
     socketClose(s1);
 }
 
+#ifndef _WIN32
+// Check that a descriptor closed without calling update(fd, 0) first, then
+// reused for a new socket with the same events, is still waited on.
+TEST(SocketWaiter, waitOnReusedDescriptor) {
+    ScopedPtr<SocketWaiter> waiter(SocketWaiter::create());
+
+    int s1, s2;
+
+    ASSERT_EQ(0, socketCreatePair(&s1, &s2));
+
+    waiter->update(s1, SocketWaiter::kEventRead);
+    EXPECT_EQ(0, waiter->wait(0));
+
+    // Replace |s1| with one end of a new pair, under the same number.
+    int t1, t2;
+    ASSERT_EQ(0, socketCreatePair(&t1, &t2));
+    socketClose(s2);
+    ASSERT_EQ(s1, dup2(t1, s1));
+    socketClose(t1);
+
+    waiter->update(s1, SocketWaiter::kEventRead);
+
+    EXPECT_EQ(1, socketSend(t2, "!", 1));
+    EXPECT_EQ(1, waiter->wait(0));
+    unsigned events = 0;
+    EXPECT_EQ(s1, waiter->nextPendingFd(&events));
+    EXPECT_EQ(SocketWaiter::kEventRead, events);
+
+    socketClose(t2);
+    socketClose(s1);
+}
+#endif  // !_WIN32
 
 }  // namespace base
 }  // namespace android
@@ -145,9 +145,7 @@ typedef struct CameraInfo {
 /* Allocates CameraInfo instance. */
 static __inline__ CameraInfo* _camera_info_alloc(void)
 {
-    CameraInfo* ci;
-    ANEW0(ci);
-    return ci;
+    return (CameraInfo*)android_alloc0(sizeof(CameraInfo));
 }
 
 /* Frees all resources allocated for CameraInfo instance (including the
@@ -24,6 +24,18 @@
 #endif
 #include "android/camera/camera-format-converters.h"
 
+/* See "SIMD fast paths" below. */
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#define CONVERTERS_HAVE_SSE2 1
+#if defined(__clang__) || (__GNUC__ > 4) || (__GNUC__ == 4 && __GNUC_MINOR__ >= 9)
+#include <immintrin.h>
+#include "android/utils/x86_cpuid.h"
+#define CONVERTERS_HAVE_AVX2 1
+#define AVX2_FUNC __attribute__((target("avx2")))
+#endif
+#endif
+
 #define  E(...)    derror(__VA_ARGS__)
 #define  W(...)    dwarning(__VA_ARGS__)
 #define  D(...)    VERBOSE_PRINT(camera,__VA_ARGS__)
@@ -265,6 +277,10 @@ static __inline__ void
 _change_exposure_RGB(uint8_t* r, uint8_t* g, uint8_t* b, float exp_comp)
 {
     uint8_t y, u, v;
+    if (exp_comp == 1.0f) {
+        /* Don't lose precision going through YUV for nothing. */
+        return;
+    }
     R8G8B8ToYUV(*r, *g, *b, &y, &u, &v);
     YUVToRGBPix(_change_exposure(y, exp_comp), u, v, r, g, b);
 }
@@ -274,6 +290,10 @@ static __inline__ void
 _change_exposure_RGB_i(int* r, int* g, int* b, float exp_comp)
 {
     uint8_t y, u, v;
+    if (exp_comp == 1.0f) {
+        /* Don't lose precision going through YUV for nothing. */
+        return;
+    }
     R8G8B8ToYUV(*r, *g, *b, &y, &u, &v);
     y = _change_exposure(y, exp_comp);
     *r = YUV2RO(y,u,v);
@@ -293,6 +313,10 @@ _change_white_balance_YUV(uint8_t* y,
                           float g_scale,
                           float b_scale)
 {
+    if (r_scale == 1.0f && g_scale == 1.0f && b_scale == 1.0f) {
+        /* Don't lose precision going through RGB for nothing. */
+        return;
+    }
     int r = (float)(YUV2R((int)*y, (int)*u, (int)*v)) / r_scale;
     int g = (float)(YUV2G((int)*y, (int)*u, (int)*v)) / g_scale;
     int b = (float)(YUV2B((int)*y, (int)*u, (int)*v)) / b_scale;
@@ -424,6 +448,9 @@ _change_white_balance_RGB_b(uint8_t* r,
  * emulation, making the code super performant is not a priority at all. There
  * will be enough loses in other parts of the emultion to overlook any slight
  * inefficiences in the conversion algorithm as neglectable.
+ * The exception are the few conversions every webcam frame goes through, which
+ * have SIMD fast paths (see "SIMD fast paths" below). The generic converters
+ * remain the reference these fast paths are tested against.
  */
 
 typedef struct RGBDesc RGBDesc;
@@ -1602,6 +1629,745 @@ _get_pixel_format_descriptor(uint32_t pixel_format)
     return NULL;
 }
 
+/********************************************************************************
+ * SIMD fast paths
+ *******************************************************************************/
+
+/*
+ * Specialised converters for the pairs of formats every webcam frame goes
+ * through: YUYV (what most webcams deliver) to NV21 / YV12 (what the guest
+ * asks for), and RGB32 to NV21 / NV21 to RGB32 (the preview window). They are
+ * only used when no white balance or exposure adjustment is requested, which
+ * is the default, and produce exactly the same output as the generic
+ * converters.
+ *
+ * Each of them walks the frame line by line, letting a SIMD kernel process as
+ * many pixels as it can, then finishing the line with plain C. Note that the
+ * generic converters write U/V values for every line, so each U/V line of a
+ * 4:2:0 frame ends up with the values computed for the last (odd) line that
+ * shares it.
+ *
+ * SSE2 kernels are built whenever the compiler targets SSE2 (always the case
+ * for 64-bit hosts). AVX2 kernels need a compiler that supports per-function
+ * target attributes, and are only used after checking the CPU at runtime.
+ */
+
+/* Checks if the given line is the last one to write its U/V line in a 4:2:0
+ * frame, see above. */
+static __inline__ int
+_is_last_chroma_line(int line, int height)
+{
+    return (line & 1) != 0 || line == height - 1;
+}
+
+#ifdef CONVERTERS_HAVE_SSE2
+
+/* Packs two 16-bit coefficients into a 32-bit value, for use with madd. */
+static __inline__ int
+_pair16(int lo, int hi)
+{
+    return (int)((uint32_t)(uint16_t)lo | ((uint32_t)(uint16_t)hi << 16));
+}
+
+/* Extracts 16 Y values from 32 bytes of YUYV. */
+static __inline__ __m128i
+_sse2_yuyv_y(const uint8_t* src)
+{
+    const __m128i mask = _mm_set1_epi16(0x00ff);
+    const __m128i a = _mm_loadu_si128((const __m128i*)src);
+    const __m128i b = _mm_loadu_si128((const __m128i*)(src + 16));
+    return _mm_packus_epi16(_mm_and_si128(a, mask), _mm_and_si128(b, mask));
+}
+
+/* Extracts 8 U/V pairs (as U0 V0 U1 V1...) from 32 bytes of YUYV. */
+static __inline__ __m128i
+_sse2_yuyv_uv(const uint8_t* src)
+{
+    const __m128i a = _mm_loadu_si128((const __m128i*)src);
+    const __m128i b = _mm_loadu_si128((const __m128i*)(src + 16));
+    return _mm_packus_epi16(_mm_srli_epi16(a, 8), _mm_srli_epi16(b, 8));
+}
+
+static int
+_sse2_yuyv_to_y(const uint8_t* src, uint8_t* y, int width)
+{
+    int x;
+    for (x = 0; x + 16 <= width; x += 16) {
+        _mm_storeu_si128((__m128i*)(y + x), _sse2_yuyv_y(src + x * 2));
+    }
+    return x;
+}
+
+static int
+_sse2_yuyv_to_vu(const uint8_t* src, uint8_t* vu, int width)
+{
+    int x;
+    for (x = 0; x + 16 <= width; x += 16) {
+        const __m128i uv = _sse2_yuyv_uv(src + x * 2);
+        _mm_storeu_si128((__m128i*)(vu + x),
+                         _mm_or_si128(_mm_slli_epi16(uv, 8),
+                                      _mm_srli_epi16(uv, 8)));
+    }
+    return x;
+}
+
+static int
+_sse2_yuyv_to_u_v(const uint8_t* src, uint8_t* u, uint8_t* v, int width)
+{
+    const __m128i mask = _mm_set1_epi16(0x00ff);
+    const __m128i zero = _mm_setzero_si128();
+    int x;
+    for (x = 0; x + 16 <= width; x += 16) {
+        const __m128i uv = _sse2_yuyv_uv(src + x * 2);
+        _mm_storel_epi64((__m128i*)(u + x / 2),
+                         _mm_packus_epi16(_mm_and_si128(uv, mask), zero));
+        _mm_storel_epi64((__m128i*)(v + x / 2),
+                         _mm_packus_epi16(_mm_srli_epi16(uv, 8), zero));
+    }
+    return x;
+}
+
+/* Computes coef[0] * r + coef[1] * g + coef[2] * b for 4 RGB32 pixels, as
+ * 32-bit values. */
+static __inline__ __m128i
+_sse2_rgb32_dot(__m128i pixels, __m128i coef)
+{
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i lo = _mm_madd_epi16(_mm_unpacklo_epi8(pixels, zero), coef);
+    const __m128i hi = _mm_madd_epi16(_mm_unpackhi_epi8(pixels, zero), coef);
+    const __m128 rg = _mm_shuffle_ps(_mm_castsi128_ps(lo), _mm_castsi128_ps(hi),
+                                     _MM_SHUFFLE(2, 0, 2, 0));
+    const __m128 b = _mm_shuffle_ps(_mm_castsi128_ps(lo), _mm_castsi128_ps(hi),
+                                    _MM_SHUFFLE(3, 1, 3, 1));
+    return _mm_add_epi32(_mm_castps_si128(rg), _mm_castps_si128(b));
+}
+
+/* Same as RGB2Y, RGB2U and RGB2V, given the result of _sse2_rgb32_dot(). */
+static __inline__ __m128i
+_sse2_dot_to_yuv(__m128i dot, int offset)
+{
+    return _mm_add_epi32(_mm_srai_epi32(_mm_add_epi32(dot, _mm_set1_epi32(128)), 8),
+                         _mm_set1_epi32(offset));
+}
+
+static int
+_sse2_rgb32_to_y(const uint8_t* src, uint8_t* y, int width)
+{
+    const __m128i coef = _mm_setr_epi16(66, 129, 25, 0, 66, 129, 25, 0);
+    int x;
+    for (x = 0; x + 8 <= width; x += 8) {
+        const __m128i p0 = _mm_loadu_si128((const __m128i*)(src + x * 4));
+        const __m128i p1 = _mm_loadu_si128((const __m128i*)(src + x * 4 + 16));
+        const __m128i y0 = _sse2_dot_to_yuv(_sse2_rgb32_dot(p0, coef), 16);
+        const __m128i y1 = _sse2_dot_to_yuv(_sse2_rgb32_dot(p1, coef), 16);
+        const __m128i y16 = _mm_packs_epi32(y0, y1);
+        _mm_storel_epi64((__m128i*)(y + x), _mm_packus_epi16(y16, y16));
+    }
+    return x;
+}
+
+static int
+_sse2_rgb32_to_vu(const uint8_t* src, uint8_t* vu, int width)
+{
+    const __m128i coef_u = _mm_setr_epi16(-38, -74, 112, 0, -38, -74, 112, 0);
+    const __m128i coef_v = _mm_setr_epi16(112, -94, -18, 0, 112, -94, -18, 0);
+    int x;
+    for (x = 0; x + 8 <= width; x += 8) {
+        const __m128 p0 = _mm_loadu_ps((const float*)(src + x * 4));
+        const __m128 p1 = _mm_loadu_ps((const float*)(src + x * 4 + 16));
+        /* U and V come from the first pixel of each pair. */
+        const __m128i even = _mm_castps_si128(
+                _mm_shuffle_ps(p0, p1, _MM_SHUFFLE(2, 0, 2, 0)));
+        const __m128i u = _sse2_dot_to_yuv(_sse2_rgb32_dot(even, coef_u), 128);
+        const __m128i v = _sse2_dot_to_yuv(_sse2_rgb32_dot(even, coef_v), 128);
+        const __m128i vu16 = _mm_packs_epi32(v, u);
+        const __m128i vu8 = _mm_packus_epi16(vu16, vu16);
+        _mm_storel_epi64((__m128i*)(vu + x),
+                         _mm_unpacklo_epi8(vu8, _mm_srli_si128(vu8, 4)));
+    }
+    return x;
+}
+
+/* Converts 8 pixels to R, G and B values (as 16-bit values in the low
+ * 8 bytes of the returned vectors), given the Y values, and the V/U
+ * pairs (as V0 U0 V1 U1...) for them, as 16-bit values. */
+static __inline__ void
+_sse2_yuv_to_rgb(__m128i y, __m128i vu, __m128i* r, __m128i* g, __m128i* b)
+{
+    const __m128i c = _mm_sub_epi16(y, _mm_set1_epi16(16));
+    const __m128i de = _mm_sub_epi16(vu, _mm_set1_epi16(128));
+    /* Replicate D and E for both pixels of each pair. */
+    const __m128i e = _mm_shufflehi_epi16(
+            _mm_shufflelo_epi16(de, _MM_SHUFFLE(2, 2, 0, 0)),
+            _MM_SHUFFLE(2, 2, 0, 0));
+    const __m128i d = _mm_shufflehi_epi16(
+            _mm_shufflelo_epi16(de, _MM_SHUFFLE(3, 3, 1, 1)),
+            _MM_SHUFFLE(3, 3, 1, 1));
+    const __m128i one = _mm_set1_epi16(1);
+    const __m128i round = _mm_set1_epi32(128);
+    const __m128i coef_r = _mm_set1_epi32(_pair16(298, 409));
+    const __m128i coef_g = _mm_set1_epi32(_pair16(298, -100));
+    const __m128i coef_g2 = _mm_set1_epi32(_pair16(-208, 128));
+    const __m128i coef_b = _mm_set1_epi32(_pair16(298, 516));
+    const __m128i ce_lo = _mm_unpacklo_epi16(c, e);
+    const __m128i ce_hi = _mm_unpackhi_epi16(c, e);
+    const __m128i cd_lo = _mm_unpacklo_epi16(c, d);
+    const __m128i cd_hi = _mm_unpackhi_epi16(c, d);
+    const __m128i e1_lo = _mm_unpacklo_epi16(e, one);
+    const __m128i e1_hi = _mm_unpackhi_epi16(e, one);
+
+    *r = _mm_packs_epi32(
+            _mm_srai_epi32(_mm_add_epi32(_mm_madd_epi16(ce_lo, coef_r), round), 8),
+            _mm_srai_epi32(_mm_add_epi32(_mm_madd_epi16(ce_hi, coef_r), round), 8));
+    *g = _mm_packs_epi32(
+            _mm_srai_epi32(_mm_add_epi32(_mm_madd_epi16(cd_lo, coef_g),
+                                         _mm_madd_epi16(e1_lo, coef_g2)), 8),
+            _mm_srai_epi32(_mm_add_epi32(_mm_madd_epi16(cd_hi, coef_g),
+                                         _mm_madd_epi16(e1_hi, coef_g2)), 8));
+    *b = _mm_packs_epi32(
+            _mm_srai_epi32(_mm_add_epi32(_mm_madd_epi16(cd_lo, coef_b), round), 8),
+            _mm_srai_epi32(_mm_add_epi32(_mm_madd_epi16(cd_hi, coef_b), round), 8));
+}
+
+static int
+_sse2_nv21_to_rgb32(const uint8_t* y, const uint8_t* vu, uint8_t* dst, int width)
+{
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i alpha = _mm_set1_epi32((int)0xff000000);
+    int x;
+    for (x = 0; x + 8 <= width; x += 8) {
+        __m128i r, g, b, rg, ba, d0, d1;
+        _sse2_yuv_to_rgb(
+            _mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i*)(y + x)), zero),
+            _mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i*)(vu + x)), zero),
+            &r, &g, &b);
+        /* Saturation to 0..255 is what clamp() does in YUV2RO & co. */
+        r = _mm_packus_epi16(r, r);
+        g = _mm_packus_epi16(g, g);
+        b = _mm_packus_epi16(b, b);
+        rg = _mm_unpacklo_epi8(r, g);
+        ba = _mm_unpacklo_epi8(b, zero);
+        /* The generic converter leaves the fourth byte alone. */
+        d0 = _mm_loadu_si128((const __m128i*)(dst + x * 4));
+        d1 = _mm_loadu_si128((const __m128i*)(dst + x * 4 + 16));
+        _mm_storeu_si128((__m128i*)(dst + x * 4),
+                         _mm_or_si128(_mm_unpacklo_epi16(rg, ba),
+                                      _mm_and_si128(d0, alpha)));
+        _mm_storeu_si128((__m128i*)(dst + x * 4 + 16),
+                         _mm_or_si128(_mm_unpackhi_epi16(rg, ba),
+                                      _mm_and_si128(d1, alpha)));
+    }
+    return x;
+}
+
+#endif  /* CONVERTERS_HAVE_SSE2 */
+
+#ifdef CONVERTERS_HAVE_AVX2
+
+/* The AVX2 kernels are the SSE2 ones on twice as many pixels. Most AVX2
+ * pack / unpack instructions work within 128-bit lanes, hence the extra
+ * permutations. */
+
+static __inline__ AVX2_FUNC __m256i
+_avx2_yuyv_pack(const uint8_t* src, int shift)
+{
+    const __m256i mask = _mm256_set1_epi16(0x00ff);
+    __m256i a = _mm256_loadu_si256((const __m256i*)src);
+    __m256i b = _mm256_loadu_si256((const __m256i*)(src + 32));
+    if (shift) {
+        a = _mm256_srli_epi16(a, 8);
+        b = _mm256_srli_epi16(b, 8);
+    } else {
+        a = _mm256_and_si256(a, mask);
+        b = _mm256_and_si256(b, mask);
+    }
+    return _mm256_permute4x64_epi64(_mm256_packus_epi16(a, b),
+                                    _MM_SHUFFLE(3, 1, 2, 0));
+}
+
+static AVX2_FUNC int
+_avx2_yuyv_to_y(const uint8_t* src, uint8_t* y, int width)
+{
+    int x;
+    for (x = 0; x + 32 <= width; x += 32) {
+        _mm256_storeu_si256((__m256i*)(y + x), _avx2_yuyv_pack(src + x * 2, 0));
+    }
+    return x;
+}
+
+static AVX2_FUNC int
+_avx2_yuyv_to_vu(const uint8_t* src, uint8_t* vu, int width)
+{
+    int x;
+    for (x = 0; x + 32 <= width; x += 32) {
+        const __m256i uv = _avx2_yuyv_pack(src + x * 2, 1);
+        _mm256_storeu_si256((__m256i*)(vu + x),
+                            _mm256_or_si256(_mm256_slli_epi16(uv, 8),
+                                            _mm256_srli_epi16(uv, 8)));
+    }
+    return x;
+}
+
+static AVX2_FUNC int
+_avx2_yuyv_to_u_v(const uint8_t* src, uint8_t* u, uint8_t* v, int width)
+{
+    const __m256i mask = _mm256_set1_epi16(0x00ff);
+    const __m256i zero = _mm256_setzero_si256();
+    int x;
+    for (x = 0; x + 32 <= width; x += 32) {
+        const __m256i uv = _avx2_yuyv_pack(src + x * 2, 1);
+        const __m256i uu = _mm256_permute4x64_epi64(
+                _mm256_packus_epi16(_mm256_and_si256(uv, mask), zero),
+                _MM_SHUFFLE(3, 1, 2, 0));
+        const __m256i vv = _mm256_permute4x64_epi64(
+                _mm256_packus_epi16(_mm256_srli_epi16(uv, 8), zero),
+                _MM_SHUFFLE(3, 1, 2, 0));
+        _mm_storeu_si128((__m128i*)(u + x / 2), _mm256_castsi256_si128(uu));
+        _mm_storeu_si128((__m128i*)(v + x / 2), _mm256_castsi256_si128(vv));
+    }
+    return x;
+}
+
+/* Same as _sse2_rgb32_dot(), for 8 pixels. */
+static __inline__ AVX2_FUNC __m256i
+_avx2_rgb32_dot(__m256i pixels, __m256i coef)
+{
+    const __m256i zero = _mm256_setzero_si256();
+    const __m256i lo = _mm256_madd_epi16(_mm256_unpacklo_epi8(pixels, zero), coef);
+    const __m256i hi = _mm256_madd_epi16(_mm256_unpackhi_epi8(pixels, zero), coef);
+    const __m256 rg = _mm256_shuffle_ps(_mm256_castsi256_ps(lo),
+                                        _mm256_castsi256_ps(hi),
+                                        _MM_SHUFFLE(2, 0, 2, 0));
+    const __m256 b = _mm256_shuffle_ps(_mm256_castsi256_ps(lo),
+                                       _mm256_castsi256_ps(hi),
+                                       _MM_SHUFFLE(3, 1, 3, 1));
+    return _mm256_add_epi32(_mm256_castps_si256(rg), _mm256_castps_si256(b));
+}
+
+static __inline__ AVX2_FUNC __m256i
+_avx2_dot_to_yuv(__m256i dot, int offset)
+{
+    return _mm256_add_epi32(
+            _mm256_srai_epi32(_mm256_add_epi32(dot, _mm256_set1_epi32(128)), 8),
+            _mm256_set1_epi32(offset));
+}
+
+static AVX2_FUNC int
+_avx2_rgb32_to_y(const uint8_t* src, uint8_t* y, int width)
+{
+    const __m256i coef = _mm256_setr_epi16(66, 129, 25, 0, 66, 129, 25, 0,
+                                           66, 129, 25, 0, 66, 129, 25, 0);
+    int x;
+    for (x = 0; x + 16 <= width; x += 16) {
+        const __m256i p0 = _mm256_loadu_si256((const __m256i*)(src + x * 4));
+        const __m256i p1 = _mm256_loadu_si256((const __m256i*)(src + x * 4 + 32));
+        const __m256i y0 = _avx2_dot_to_yuv(_avx2_rgb32_dot(p0, coef), 16);
+        const __m256i y1 = _avx2_dot_to_yuv(_avx2_rgb32_dot(p1, coef), 16);
+        const __m256i y16 = _mm256_permute4x64_epi64(_mm256_packs_epi32(y0, y1),
+                                                     _MM_SHUFFLE(3, 1, 2, 0));
+        _mm_storeu_si128((__m128i*)(y + x),
+                         _mm_packus_epi16(_mm256_castsi256_si128(y16),
+                                          _mm256_extracti128_si256(y16, 1)));
+    }
+    return x;
+}
+
+static AVX2_FUNC int
+_avx2_rgb32_to_vu(const uint8_t* src, uint8_t* vu, int width)
+{
+    const __m256i coef_u = _mm256_setr_epi16(-38, -74, 112, 0, -38, -74, 112, 0,
+                                             -38, -74, 112, 0, -38, -74, 112, 0);
+    const __m256i coef_v = _mm256_setr_epi16(112, -94, -18, 0, 112, -94, -18, 0,
+                                             112, -94, -18, 0, 112, -94, -18, 0);
+    const __m256i evens = _mm256_setr_epi32(0, 2, 4, 6, 1, 3, 5, 7);
+    int x;
+    for (x = 0; x + 16 <= width; x += 16) {
+        const __m256i p0 = _mm256_permutevar8x32_epi32(
+                _mm256_loadu_si256((const __m256i*)(src + x * 4)), evens);
+        const __m256i p1 = _mm256_permutevar8x32_epi32(
+                _mm256_loadu_si256((const __m256i*)(src + x * 4 + 32)), evens);
+        /* U and V come from the first pixel of each pair. */
+        const __m256i even = _mm256_permute2x128_si256(p0, p1, 0x20);
+        const __m256i u = _avx2_dot_to_yuv(_avx2_rgb32_dot(even, coef_u), 128);
+        const __m256i v = _avx2_dot_to_yuv(_avx2_rgb32_dot(even, coef_v), 128);
+        const __m256i vu16 = _mm256_packs_epi32(v, u);
+        const __m256i vu8 = _mm256_packus_epi16(vu16, vu16);
+        const __m256i out = _mm256_permute4x64_epi64(
+                _mm256_unpacklo_epi8(vu8, _mm256_srli_si256(vu8, 4)),
+                _MM_SHUFFLE(3, 1, 2, 0));
+        _mm_storeu_si128((__m128i*)(vu + x), _mm256_castsi256_si128(out));
+    }
+    return x;
+}
+
+/* Same as _sse2_yuv_to_rgb(), for 16 pixels. */
+static __inline__ AVX2_FUNC void
+_avx2_yuv_to_rgb(__m256i y, __m256i vu, __m256i* r, __m256i* g, __m256i* b)
+{
+    const __m256i c = _mm256_sub_epi16(y, _mm256_set1_epi16(16));
+    const __m256i de = _mm256_sub_epi16(vu, _mm256_set1_epi16(128));
+    const __m256i e = _mm256_shufflehi_epi16(
+            _mm256_shufflelo_epi16(de, _MM_SHUFFLE(2, 2, 0, 0)),
+            _MM_SHUFFLE(2, 2, 0, 0));
+    const __m256i d = _mm256_shufflehi_epi16(
+            _mm256_shufflelo_epi16(de, _MM_SHUFFLE(3, 3, 1, 1)),
+            _MM_SHUFFLE(3, 3, 1, 1));
+    const __m256i one = _mm256_set1_epi16(1);
+    const __m256i round = _mm256_set1_epi32(128);
+    const __m256i coef_r = _mm256_set1_epi32(_pair16(298, 409));
+    const __m256i coef_g = _mm256_set1_epi32(_pair16(298, -100));
+    const __m256i coef_g2 = _mm256_set1_epi32(_pair16(-208, 128));
+    const __m256i coef_b = _mm256_set1_epi32(_pair16(298, 516));
+    const __m256i ce_lo = _mm256_unpacklo_epi16(c, e);
+    const __m256i ce_hi = _mm256_unpackhi_epi16(c, e);
+    const __m256i cd_lo = _mm256_unpacklo_epi16(c, d);
+    const __m256i cd_hi = _mm256_unpackhi_epi16(c, d);
+    const __m256i e1_lo = _mm256_unpacklo_epi16(e, one);
+    const __m256i e1_hi = _mm256_unpackhi_epi16(e, one);
+
+    *r = _mm256_packs_epi32(
+            _mm256_srai_epi32(_mm256_add_epi32(_mm256_madd_epi16(ce_lo, coef_r), round), 8),
+            _mm256_srai_epi32(_mm256_add_epi32(_mm256_madd_epi16(ce_hi, coef_r), round), 8));
+    *g = _mm256_packs_epi32(
+            _mm256_srai_epi32(_mm256_add_epi32(_mm256_madd_epi16(cd_lo, coef_g),
+                                               _mm256_madd_epi16(e1_lo, coef_g2)), 8),
+            _mm256_srai_epi32(_mm256_add_epi32(_mm256_madd_epi16(cd_hi, coef_g),
+                                               _mm256_madd_epi16(e1_hi, coef_g2)), 8));
+    *b = _mm256_packs_epi32(
+            _mm256_srai_epi32(_mm256_add_epi32(_mm256_madd_epi16(cd_lo, coef_b), round), 8),
+            _mm256_srai_epi32(_mm256_add_epi32(_mm256_madd_epi16(cd_hi, coef_b), round), 8));
+}
+
+static AVX2_FUNC int
+_avx2_nv21_to_rgb32(const uint8_t* y, const uint8_t* vu, uint8_t* dst, int width)
+{
+    const __m256i zero = _mm256_setzero_si256();
+    const __m256i alpha = _mm256_set1_epi32((int)0xff000000);
+    int x;
+    for (x = 0; x + 16 <= width; x += 16) {
+        __m256i r, g, b, rg, ba, lo, hi, d0, d1;
+        _avx2_yuv_to_rgb(
+            _mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i*)(y + x))),
+            _mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i*)(vu + x))),
+            &r, &g, &b);
+        r = _mm256_packus_epi16(r, r);
+        g = _mm256_packus_epi16(g, g);
+        b = _mm256_packus_epi16(b, b);
+        rg = _mm256_unpacklo_epi8(r, g);
+        ba = _mm256_unpacklo_epi8(b, zero);
+        lo = _mm256_unpacklo_epi16(rg, ba);
+        hi = _mm256_unpackhi_epi16(rg, ba);
+        d0 = _mm256_loadu_si256((const __m256i*)(dst + x * 4));
+        d1 = _mm256_loadu_si256((const __m256i*)(dst + x * 4 + 32));
+        _mm256_storeu_si256((__m256i*)(dst + x * 4),
+                            _mm256_or_si256(_mm256_permute2x128_si256(lo, hi, 0x20),
+                                            _mm256_and_si256(d0, alpha)));
+        _mm256_storeu_si256((__m256i*)(dst + x * 4 + 32),
+                            _mm256_or_si256(_mm256_permute2x128_si256(lo, hi, 0x31),
+                                            _mm256_and_si256(d1, alpha)));
+    }
+    return x;
+}
+
+/* Checks if the host CPU and OS support AVX2. */
+static int
+_cpu_has_avx2(void)
+{
+    uint32_t ebx = 0, ecx = 0, xcr0_lo, xcr0_hi;
+
+    android_get_x86_cpuid(1, 0, NULL, NULL, &ecx, NULL);
+    if ((ecx & (CPUID_ECX_OSXSAVE | CPUID_ECX_AVX)) !=
+            (CPUID_ECX_OSXSAVE | CPUID_ECX_AVX)) {
+        return 0;
+    }
+    /* The OS must save the YMM registers on context switches. */
+    __asm__ __volatile__("xgetbv" : "=a"(xcr0_lo), "=d"(xcr0_hi) : "c"(0));
+    if ((xcr0_lo & 6) != 6) {
+        return 0;
+    }
+    android_get_x86_cpuid(7, 0, NULL, &ebx, NULL, NULL);
+    return (ebx & CPUID_EBX_AVX2) != 0;
+}
+
+#endif  /* CONVERTERS_HAVE_AVX2 */
+
+/* Returns the best SIMD level supported by the host. */
+static ConverterSimdLevel
+_get_host_simd_level(void)
+{
+#if defined(CONVERTERS_HAVE_AVX2)
+    if (_cpu_has_avx2()) {
+        return CONVERTER_SIMD_AVX2;
+    }
+#endif
+#if defined(CONVERTERS_HAVE_SSE2)
+    return CONVERTER_SIMD_SSE2;
+#else
+    return CONVERTER_SIMD_NONE;
+#endif
+}
+
+/* SIMD level used by the fast paths, -1 until first use. */
+static int _simd_level = -1;
+
+static ConverterSimdLevel
+_get_simd_level(void)
+{
+    if (_simd_level < 0) {
+        _simd_level = _get_host_simd_level();
+        D("%s: Using SIMD level %d for frame conversions",
+          __FUNCTION__, _simd_level);
+    }
+    return (ConverterSimdLevel)_simd_level;
+}
+
+/* The kernels below return the number of pixels they processed, which is 0 at
+ * CONVERTER_SIMD_NONE. */
+
+static int
+_yuyv_to_y(ConverterSimdLevel level, const uint8_t* src, uint8_t* y, int width)
+{
+    switch (level) {
+#ifdef CONVERTERS_HAVE_AVX2
+        case CONVERTER_SIMD_AVX2: return _avx2_yuyv_to_y(src, y, width);
+#endif
+#ifdef CONVERTERS_HAVE_SSE2
+        case CONVERTER_SIMD_SSE2: return _sse2_yuyv_to_y(src, y, width);
+#endif
+        default: return 0;
+    }
+}
+
+static int
+_yuyv_to_vu(ConverterSimdLevel level, const uint8_t* src, uint8_t* vu, int width)
+{
+    switch (level) {
+#ifdef CONVERTERS_HAVE_AVX2
+        case CONVERTER_SIMD_AVX2: return _avx2_yuyv_to_vu(src, vu, width);
+#endif
+#ifdef CONVERTERS_HAVE_SSE2
+        case CONVERTER_SIMD_SSE2: return _sse2_yuyv_to_vu(src, vu, width);
+#endif
+        default: return 0;
+    }
+}
+
+static int
+_yuyv_to_u_v(ConverterSimdLevel level,
+             const uint8_t* src,
+             uint8_t* u,
+             uint8_t* v,
+             int width)
+{
+    switch (level) {
+#ifdef CONVERTERS_HAVE_AVX2
+        case CONVERTER_SIMD_AVX2: return _avx2_yuyv_to_u_v(src, u, v, width);
+#endif
+#ifdef CONVERTERS_HAVE_SSE2
+        case CONVERTER_SIMD_SSE2: return _sse2_yuyv_to_u_v(src, u, v, width);
+#endif
+        default: return 0;
+    }
+}
+
+static int
+_rgb32_to_y(ConverterSimdLevel level, const uint8_t* src, uint8_t* y, int width)
+{
+    switch (level) {
+#ifdef CONVERTERS_HAVE_AVX2
+        case CONVERTER_SIMD_AVX2: return _avx2_rgb32_to_y(src, y, width);
+#endif
+#ifdef CONVERTERS_HAVE_SSE2
+        case CONVERTER_SIMD_SSE2: return _sse2_rgb32_to_y(src, y, width);
+#endif
+        default: return 0;
+    }
+}
+
+static int
+_rgb32_to_vu(ConverterSimdLevel level, const uint8_t* src, uint8_t* vu, int width)
+{
+    switch (level) {
+#ifdef CONVERTERS_HAVE_AVX2
+        case CONVERTER_SIMD_AVX2: return _avx2_rgb32_to_vu(src, vu, width);
+#endif
+#ifdef CONVERTERS_HAVE_SSE2
+        case CONVERTER_SIMD_SSE2: return _sse2_rgb32_to_vu(src, vu, width);
+#endif
+        default: return 0;
+    }
+}
+
+static int
+_nv21_to_rgb32(ConverterSimdLevel level,
+               const uint8_t* y,
+               const uint8_t* vu,
+               uint8_t* dst,
+               int width)
+{
+    switch (level) {
+#ifdef CONVERTERS_HAVE_AVX2
+        case CONVERTER_SIMD_AVX2: return _avx2_nv21_to_rgb32(y, vu, dst, width);
+#endif
+#ifdef CONVERTERS_HAVE_SSE2
+        case CONVERTER_SIMD_SSE2: return _sse2_nv21_to_rgb32(y, vu, dst, width);
+#endif
+        default: return 0;
+    }
+}
+
+/* Fast YUYV -> NV21 converter. */
+static void
+_YUYVToNV21_fast(ConverterSimdLevel level,
+                 const uint8_t* src,
+                 uint8_t* dst,
+                 int width,
+                 int height)
+{
+    uint8_t* const vu_pane = dst + width * height;
+    int line, x;
+    for (line = 0; line < height; line++, src += width * 2, dst += width) {
+        for (x = _yuyv_to_y(level, src, dst, width); x < width; x++) {
+            dst[x] = src[x * 2];
+        }
+        if (_is_last_chroma_line(line, height)) {
+            uint8_t* vu = vu_pane + (line / 2) * width;
+            for (x = _yuyv_to_vu(level, src, vu, width); x < width; x += 2) {
+                vu[x] = src[x * 2 + 3];
+                vu[x + 1] = src[x * 2 + 1];
+            }
+        }
+    }
+}
+
+/* Fast YUYV -> YV12 converter. */
+static void
+_YUYVToYV12_fast(ConverterSimdLevel level,
+                 const uint8_t* src,
+                 uint8_t* dst,
+                 int width,
+                 int height)
+{
+    const int y_pane_size = width * height;
+    uint8_t* const v_pane = dst + y_pane_size;
+    uint8_t* const u_pane = dst + y_pane_size + y_pane_size / 4;
+    int line, x;
+    for (line = 0; line < height; line++, src += width * 2, dst += width) {
+        for (x = _yuyv_to_y(level, src, dst, width); x < width; x++) {
+            dst[x] = src[x * 2];
+        }
+        if (_is_last_chroma_line(line, height)) {
+            uint8_t* u = u_pane + (line / 2) * width / 2;
+            uint8_t* v = v_pane + (line / 2) * width / 2;
+            for (x = _yuyv_to_u_v(level, src, u, v, width); x < width; x += 2) {
+                u[x / 2] = src[x * 2 + 1];
+                v[x / 2] = src[x * 2 + 3];
+            }
+        }
+    }
+}
+
+/* Fast RGB32 -> NV21 converter. */
+static void
+_RGB32ToNV21_fast(ConverterSimdLevel level,
+                  const uint8_t* src,
+                  uint8_t* dst,
+                  int width,
+                  int height)
+{
+    uint8_t* const vu_pane = dst + width * height;
+    int line, x;
+    for (line = 0; line < height; line++, src += width * 4, dst += width) {
+        for (x = _rgb32_to_y(level, src, dst, width); x < width; x++) {
+            const uint8_t* p = src + x * 4;
+            dst[x] = RGB2Y((int)p[0], (int)p[1], (int)p[2]);
+        }
+        if (_is_last_chroma_line(line, height)) {
+            uint8_t* vu = vu_pane + (line / 2) * width;
+            for (x = _rgb32_to_vu(level, src, vu, width); x < width; x += 2) {
+                const uint8_t* p = src + x * 4;
+                vu[x] = RGB2V((int)p[0], (int)p[1], (int)p[2]);
+                vu[x + 1] = RGB2U((int)p[0], (int)p[1], (int)p[2]);
+            }
+        }
+    }
+}
+
+/* Fast NV21 -> RGB32 converter. */
+static void
+_NV21ToRGB32_fast(ConverterSimdLevel level,
+                  const uint8_t* src,
+                  uint8_t* dst,
+                  int width,
+                  int height)
+{
+    const uint8_t* const vu_pane = src + width * height;
+    int line, x;
+    for (line = 0; line < height; line++, src += width, dst += width * 4) {
+        const uint8_t* vu = vu_pane + (line / 2) * width;
+        for (x = _nv21_to_rgb32(level, src, vu, dst, width); x < width; x += 2) {
+            uint8_t* p = dst + x * 4;
+            YUVToRGBPix(src[x], vu[x + 1], vu[x], &p[0], &p[1], &p[2]);
+            YUVToRGBPix(src[x + 1], vu[x + 1], vu[x], &p[4], &p[5], &p[6]);
+        }
+    }
+}
+
+/* Converts a frame with a fast path, if there is one for the given formats.
+ * Return:
+ *  1 if the frame has been converted, or 0 if the generic converters must be
+ *  used instead.
+ */
+static int
+_convert_frame_fast(const PIXFormat* src_desc,
+                    const PIXFormat* dst_desc,
+                    const void* src,
+                    void* dst,
+                    int width,
+                    int height,
+                    float r_scale,
+                    float g_scale,
+                    float b_scale,
+                    float exp_comp)
+{
+    const ConverterSimdLevel level = _get_simd_level();
+
+    if (level == CONVERTER_SIMD_NONE ||
+        r_scale != 1.0f || g_scale != 1.0f || b_scale != 1.0f ||
+        exp_comp != 1.0f || (width & 1) != 0) {
+        return 0;
+    }
+
+    if (src_desc->format_sel == PIX_FMT_YUV &&
+        src_desc->desc.yuv_desc == &_YUYV) {
+        if (dst_desc->format_sel == PIX_FMT_YUV &&
+            dst_desc->desc.yuv_desc == &_NV21) {
+            _YUYVToNV21_fast(level, src, dst, width, height);
+            return 1;
+        }
+        if (dst_desc->format_sel == PIX_FMT_YUV &&
+            dst_desc->desc.yuv_desc == &_YV12) {
+            _YUYVToYV12_fast(level, src, dst, width, height);
+            return 1;
+        }
+    } else if (src_desc->format_sel == PIX_FMT_RGB &&
+               src_desc->desc.rgb_desc == &_RGB32) {
+        if (dst_desc->format_sel == PIX_FMT_YUV &&
+            dst_desc->desc.yuv_desc == &_NV21) {
+            _RGB32ToNV21_fast(level, src, dst, width, height);
+            return 1;
+        }
+    } else if (src_desc->format_sel == PIX_FMT_YUV &&
+               src_desc->desc.yuv_desc == &_NV21) {
+        if (dst_desc->format_sel == PIX_FMT_RGB &&
+            dst_desc->desc.rgb_desc == &_RGB32) {
+            _NV21ToRGB32_fast(level, src, dst, width, height);
+            return 1;
+        }
+    }
+    return 0;
+}
+
 /********************************************************************************
  * Public API
  *******************************************************************************/
@@ -1617,6 +2383,14 @@ has_converter(uint32_t from, uint32_t to)
            _get_pixel_format_descriptor(to) != NULL;
 }
 
+ConverterSimdLevel
+set_converter_simd_level(ConverterSimdLevel level)
+{
+    const ConverterSimdLevel host_level = _get_host_simd_level();
+    _simd_level = level < host_level ? level : host_level;
+    return (ConverterSimdLevel)_simd_level;
+}
+
 int
 convert_frame(const void* frame,
               uint32_t pixel_format,
@@ -1650,6 +2424,12 @@ convert_frame(const void* frame,
               __FUNCTION__, (const char*)&framebuffers[n].pixel_format);
             return -1;
         }
+        if (_convert_frame_fast(src_desc, dst_desc,
+                                frame, framebuffers[n].framebuffer,
+                                width, height,
+                                r_scale, g_scale, b_scale, exp_comp)) {
+            continue;
+        }
         switch (src_desc->format_sel) {
             case PIX_FMT_RGB:
                 if (dst_desc->format_sel == PIX_FMT_RGB) {
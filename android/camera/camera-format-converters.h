@@ -25,7 +25,18 @@
  * used by the camera framework for video, and RGB32 for preview window.
  */
 
-#include "camera-common.h"
+#include "android/utils/compiler.h"
+#include "camera-common.h"
+
+ANDROID_BEGIN_HEADER
+
+/* Instruction sets the frame conversion fast paths can use. */
+typedef enum ConverterSimdLevel {
+    /* No fast paths, use the generic converters only. */
+    CONVERTER_SIMD_NONE = 0,
+    CONVERTER_SIMD_SSE2,
+    CONVERTER_SIMD_AVX2
+} ConverterSimdLevel;
 
 /* Checks if conversion between two pixel formats is available.
  * Param:
@@ -70,4 +81,17 @@ extern int convert_frame(const void* frame,
                          float b_scale,
                          float exp_comp);
 
+/* Selects the instruction set used by the frame conversion fast paths. By
+ * default, the best one supported by the host is used. This is mostly useful to
+ * compare the fast paths against the generic converters.
+ * Param:
+ *  level - Desired instruction set. It's lowered to the best one supported
+ *      by the host if necessary.
+ * Return:
+ *  Instruction set that will actually be used.
+ */
+extern ConverterSimdLevel set_converter_simd_level(ConverterSimdLevel level);
+
+ANDROID_END_HEADER
+
 #endif  /* ANDROID_CAMERA_CAMERA_FORMAT_CONVERTERS_H */
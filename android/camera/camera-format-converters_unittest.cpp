@@ -0,0 +1,157 @@
+// Copyright 2015 The Android Open Source Project
+//
+// This software is licensed under the terms of the GNU General Public
+// License version 2, as published by the Free Software Foundation, and
+// may be copied, distributed, and modified under those terms.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+
+#include <gtest/gtest.h>
+
+#include "android/camera/camera-format-converters.h"
+
+#include <stdint.h>
+#include <string.h>
+
+#include <vector>
+
+namespace android {
+namespace camera {
+
+namespace {
+
+// A trivial linear congruential generator, to get reproducible frames.
+class RandomFrame {
+public:
+    RandomFrame() : mState(1) {}
+
+    void fill(std::vector<uint8_t>* buffer) {
+        for (size_t n = 0; n < buffer->size(); ++n) {
+            mState = mState * 1103515245U + 12345U;
+            (*buffer)[n] = (uint8_t)(mState >> 16);
+        }
+    }
+
+private:
+    uint32_t mState;
+};
+
+// Returns the size of a frame in the given pixel format. For 4:2:0 formats
+// with an odd height, the converters write one more U/V line than the usual
+// size accounts for.
+size_t frameSize(uint32_t format, int width, int height) {
+    switch (format) {
+        case V4L2_PIX_FMT_RGB32:
+            return (size_t)width * height * 4;
+        case V4L2_PIX_FMT_YUYV:
+            return (size_t)width * height * 2;
+        default:
+            // 4:2:0 formats.
+            return (size_t)width * height + (size_t)width * ((height + 1) / 2);
+    }
+}
+
+// Converts a random |from| frame to |to| with the generic converters, then
+// with each fast path the host supports, and checks that the outputs are
+// identical, including any byte the converters don't write.
+void checkConversion(uint32_t from, uint32_t to, int width, int height) {
+    RandomFrame random;
+    std::vector<uint8_t> frame(frameSize(from, width, height));
+    random.fill(&frame);
+
+    std::vector<uint8_t> junk(frameSize(to, width, height));
+    random.fill(&junk);
+
+    std::vector<uint8_t> expected(junk);
+    ClientFrameBuffer fb = { to, &expected[0] };
+    set_converter_simd_level(CONVERTER_SIMD_NONE);
+    ASSERT_EQ(0, convert_frame(&frame[0], from, frame.size(), width, height,
+                               &fb, 1, 1.0f, 1.0f, 1.0f, 1.0f));
+
+    for (int level = CONVERTER_SIMD_SSE2; level <= CONVERTER_SIMD_AVX2;
+         ++level) {
+        if (set_converter_simd_level((ConverterSimdLevel)level) != level) {
+            continue;
+        }
+        std::vector<uint8_t> actual(junk);
+        fb.framebuffer = &actual[0];
+        ASSERT_EQ(0, convert_frame(&frame[0], from, frame.size(), width,
+                                   height, &fb, 1, 1.0f, 1.0f, 1.0f, 1.0f));
+        for (size_t n = 0; n < actual.size(); ++n) {
+            ASSERT_EQ(expected[n], actual[n])
+                    << "level " << level << ", " << width << "x" << height
+                    << ", offset " << n;
+        }
+    }
+    set_converter_simd_level(CONVERTER_SIMD_AVX2);
+}
+
+// Frame sizes to test, including some that are not multiples of the SIMD
+// widths, and odd heights.
+const struct {
+    int width;
+    int height;
+} kSizes[] = {
+    { 2, 1 }, { 6, 3 }, { 16, 2 }, { 34, 7 }, { 62, 5 }, { 176, 144 },
+    { 320, 239 }, { 640, 480 },
+};
+
+}  // namespace
+
+TEST(CameraFormatConverters, YUYVToNV21) {
+    for (size_t n = 0; n < sizeof(kSizes) / sizeof(kSizes[0]); ++n) {
+        checkConversion(V4L2_PIX_FMT_YUYV, V4L2_PIX_FMT_NV21,
+                        kSizes[n].width, kSizes[n].height);
+    }
+}
+
+TEST(CameraFormatConverters, YUYVToYV12) {
+    for (size_t n = 0; n < sizeof(kSizes) / sizeof(kSizes[0]); ++n) {
+        checkConversion(V4L2_PIX_FMT_YUYV, V4L2_PIX_FMT_YVU420,
+                        kSizes[n].width, kSizes[n].height);
+    }
+}
+
+TEST(CameraFormatConverters, RGB32ToNV21) {
+    for (size_t n = 0; n < sizeof(kSizes) / sizeof(kSizes[0]); ++n) {
+        checkConversion(V4L2_PIX_FMT_RGB32, V4L2_PIX_FMT_NV21,
+                        kSizes[n].width, kSizes[n].height);
+    }
+}
+
+TEST(CameraFormatConverters, NV21ToRGB32) {
+    for (size_t n = 0; n < sizeof(kSizes) / sizeof(kSizes[0]); ++n) {
+        checkConversion(V4L2_PIX_FMT_NV21, V4L2_PIX_FMT_RGB32,
+                        kSizes[n].width, kSizes[n].height);
+    }
+}
+
+TEST(CameraFormatConverters, AdjustmentsUseGenericPath) {
+    // With white balance or exposure adjustments, the result must not depend
+    // on the SIMD level.
+    const int kWidth = 64, kHeight = 4;
+    RandomFrame random;
+    std::vector<uint8_t> frame(frameSize(V4L2_PIX_FMT_YUYV, kWidth, kHeight));
+    random.fill(&frame);
+
+    std::vector<uint8_t> expected(frameSize(V4L2_PIX_FMT_NV21, kWidth, kHeight));
+    ClientFrameBuffer fb = { V4L2_PIX_FMT_NV21, &expected[0] };
+    set_converter_simd_level(CONVERTER_SIMD_NONE);
+    ASSERT_EQ(0, convert_frame(&frame[0], V4L2_PIX_FMT_YUYV, frame.size(),
+                               kWidth, kHeight, &fb, 1,
+                               1.2f, 1.0f, 0.8f, 1.5f));
+
+    std::vector<uint8_t> actual(expected.size());
+    fb.framebuffer = &actual[0];
+    set_converter_simd_level(CONVERTER_SIMD_AVX2);
+    ASSERT_EQ(0, convert_frame(&frame[0], V4L2_PIX_FMT_YUYV, frame.size(),
+                               kWidth, kHeight, &fb, 1,
+                               1.2f, 1.0f, 0.8f, 1.5f));
+    EXPECT_EQ(0, memcmp(&expected[0], &actual[0], expected.size()));
+}
+
+}  // namespace camera
+}  // namespace android
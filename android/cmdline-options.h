@@ -103,6 +103,7 @@ OPT_PARAM( netdelay, "<delay>", "network latency emulation" )
 OPT_FLAG ( netfast, "disable network shaping" )
 
 OPT_PARAM( code_profile, "<name>", "enable code profiling" )
+OPT_FLAG ( tcg_cache, "keep the translated code across runs" )
 OPT_FLAG ( show_kernel, "display kernel messages" )
 OPT_FLAG ( shell, "enable root shell on current terminal" )
 OPT_FLAG ( no_jni, "disable JNI checks in the Dalvik runtime" )
@@ -15,6 +15,7 @@
 #define CONFIG_LINUX   1
 #define CONFIG_POSIX 1
 #define CONFIG_SIGNALFD 1
+#define CONFIG_EPOLL 1
 #define CONFIG_ANDROID       1
 #define CONFIG_MADVISE 1
 #define MAX_GSM_DEVICES  9
@@ -51,6 +51,7 @@
 #include "android/tcpdump.h"
 #include "net/net.h"
 #include "monitor/monitor.h"
+#include "block/block.h"
 
 #include <stdlib.h>
 #include <stdio.h>
@@ -2667,6 +2668,30 @@ do_avd_name( ControlClient  client, char*  args )
     return 0;
 }
 
+static int
+do_avd_diskcache( ControlClient  client, char*  args )
+{
+    Monitor *out = monitor_fake_new(client, control_write_out_cb);
+    bdrv_info_cache(out);
+    monitor_fake_free(out);
+    return 0;
+}
+
+static int
+do_avd_tlbstats( ControlClient  client, char*  args )
+{
+    Monitor *out;
+
+    if (args && !strcmp(args, "reset")) {
+        tlb_reset_stats();
+        return 0;
+    }
+    out = monitor_fake_new(client, control_write_out_cb);
+    tlb_dump_stats(out);
+    monitor_fake_free(out);
+    return 0;
+}
+
 static const CommandDefRec  vm_commands[] =
 {
     { "stop", "stop the virtual device",
@@ -2689,6 +2714,16 @@ static const CommandDefRec  vm_commands[] =
     "allows you to save and restore the virtual device state in snapshots\r\n",
     NULL, NULL, snapshot_commands },
 
+    { "diskcache", "query disk image metadata cache statistics",
+    "'avd diskcache' will show the size and hit/miss counts of the L2 table and refcount\r\n"
+    "block caches of each qcow2 disk image\r\n",
+    NULL, do_avd_diskcache, NULL },
+
+    { "tlbstats", "query softmmu TLB statistics",
+    "'avd tlbstats' will show the victim hit, fill and flush counts of the software TLB\r\n"
+    "of each virtual CPU, 'avd tlbstats reset' clears them\r\n",
+    NULL, do_avd_tlbstats, NULL },
+
     { NULL, NULL, NULL, NULL, NULL, NULL }
 };
 
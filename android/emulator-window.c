@@ -138,15 +138,19 @@ static void emulator_window_opengles_redraw_window(void) {
 }
 
 // Used as an emugl callback to get each frame of GPU display.
-static void _emulator_window_on_gpu_frame(void* context,
-                                          int width,
-                                          int height,
-                                          const void* pixels) {
+static int _emulator_window_on_gpu_frame(void* context,
+                                         int width,
+                                         int height,
+                                         const void* pixels,
+                                         int dirtyX,
+                                         int dirtyY,
+                                         int dirtyW,
+                                         int dirtyH) {
     EmulatorWindow* emulator = (EmulatorWindow*)context;
-    // This function is called from an EmuGL thread, which cannot
-    // call the skin_ui_update_gpu_frame() function. Create a GpuFrame
-    // instance, and send its address into the pipe.
-    skin_ui_update_gpu_frame(emulator->ui, width, height, pixels);
+    // This function is called from the main loop by the GpuFrameBridge,
+    // which took care of moving the frame out of the EmuGL thread.
+    return skin_ui_update_gpu_frame(emulator->ui, width, height, pixels,
+                                    dirtyX, dirtyY, dirtyW, dirtyH);
 }
 
 static void
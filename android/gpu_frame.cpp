@@ -51,7 +51,7 @@ static void onNewGpuFrame(void* opaque,
 void gpu_frame_set_post_callback(
         Looper* looper,
         void* context,
-        void (*callback)(void*, int, int, const void*)) {
+        int (*callback)(void*, int, int, const void*, int, int, int, int)) {
     DCHECK(!sBridge);
 
     sBridge = android::opengl::GpuFrameBridge::create(
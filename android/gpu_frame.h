@@ -23,14 +23,21 @@ ANDROID_BEGIN_HEADER
 // Initialize state to ensure that new GPU frame data is passed to the caller
 // in the appropriate thread. |looper| is a Looper instance, |context| is an
 // opaque handle passed to |callback| at runtime, which is a function called
-// from the looper's thread whenever a new frame is available.
+// from the looper's thread whenever a new frame is available. The dirty
+// rectangle covers the pixels that changed since the previous call.
+// |callback| returns 0 if it could not use the frame. See GpuFrameBridge.h
+// for details.
 void gpu_frame_set_post_callback(
         Looper* looper,
         void* context,
-        void (*callback)(void* context,
+        int (*callback)(void* context,
                          int width,
                          int height,
-                         const void* pixels));
+                         const void* pixels,
+                         int dirtyX,
+                         int dirtyY,
+                         int dirtyW,
+                         int dirtyH));
 
 ANDROID_END_HEADER
 
@@ -999,6 +999,18 @@ help_code_profile(stralloc_t*  out)
     );
 }
 
+static void
+help_tcg_cache(stralloc_t*  out)
+{
+    PRINTF(
+    "  use '-tcg-cache' to keep the code translated by the CPU emulator in the file\n"
+    "  tcg-cache.img of the virtual device's content directory, and reuse it in the\n"
+    "  next runs. This speeds up booting when no hardware acceleration is used.\n\n"
+    "  The file is reset when the emulator binary or the CPU model change. This\n"
+    "  is only supported on 64-bit Linux hosts.\n\n"
+    );
+}
+
 static void
 help_show_kernel(stralloc_t*  out)
 {
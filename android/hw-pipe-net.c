@@ -64,11 +64,21 @@ enum {
 };
 
 typedef struct {
+    /* Only used by the "opengles" service, see openglesPipe_init() */
+    const GoldfishPipeFuncs*  funcs;
+
     void*           hwpipe;
     int             state;
     int             wakeWanted;
     LoopIo          io[1];
     AsyncConnector  connector[1];
+
+    /* Guest write that is completed asynchronously, see netPipe_sendBuffers */
+    GoldfishPipeTransfer*      pending;
+    const GoldfishPipeBuffer*  pendingBuffers;
+    int                        pendingCount;
+    int                        pendingSize;
+    int                        pendingSent;
 } NetPipe;
 
 static void
@@ -89,7 +99,7 @@ netPipe_free( NetPipe*  pipe )
 static void
 netPipe_resetState( NetPipe* pipe )
 {
-    if ((pipe->wakeWanted & PIPE_WAKE_WRITE) != 0) {
+    if ((pipe->wakeWanted & PIPE_WAKE_WRITE) != 0 || pipe->pending != NULL) {
         loopIo_wantWrite(pipe->io);
     } else {
         loopIo_dontWantWrite(pipe->io);
@@ -119,6 +129,14 @@ netPipe_closeFromSocket( void* opaque )
         return;
     }
 
+    /* Complete any pending write with what was sent so far */
+    if (pipe->pending != NULL) {
+        goldfish_pipe_complete(pipe->pending,
+                               pipe->pendingSent > 0 ? pipe->pendingSent
+                                                     : PIPE_ERROR_IO);
+        pipe->pending = NULL;
+    }
+
     /* Force the closure of the QEMUD channel - if a guest is blocked
      * waiting for a wake signal, it will receive an error. */
     if (pipe->hwpipe != NULL) {
@@ -131,6 +149,9 @@ netPipe_closeFromSocket( void* opaque )
 }
 
 
+/* Forward */
+static void netPipe_sendPending( NetPipe* pipe );
+
 /* This is the function that gets called each time there is an asynchronous
  * event on the network pipe.
  */
@@ -167,6 +188,9 @@ netPipe_io_func( void* opaque, int fd, unsigned events )
     }
 
     if ((events & LOOP_IO_WRITE) != 0) {
+        if (pipe->pending != NULL) {
+            netPipe_sendPending(pipe);
+        }
         if ((pipe->wakeWanted & PIPE_WAKE_WRITE) != 0) {
             wakeFlags |= PIPE_WAKE_WRITE;
         }
@@ -245,24 +269,31 @@ static int netPipeReadySend(NetPipe *pipe)
         return PIPE_ERROR_IO;
 }
 
+/* Sends as much of 'buffers' as possible to the socket, skipping the first
+ * 'offset' bytes. Returns the number of bytes sent, or a PIPE_ERROR_XXX
+ * code if nothing could be sent.
+ */
 static int
-netPipe_sendBuffers( void* opaque, const GoldfishPipeBuffer* buffers, int numBuffers )
+netPipe_sendFrom( NetPipe* pipe, const GoldfishPipeBuffer* buffers,
+                  int numBuffers, int offset )
 {
-    NetPipe*  pipe = opaque;
     int       count = 0;
     int       ret   = 0;
     size_t    buffStart = 0;
     const GoldfishPipeBuffer* buff = buffers;
     const GoldfishPipeBuffer* buffEnd = buff + numBuffers;
 
-    ret = netPipeReadySend(pipe);
-    if (ret != 0)
-        return ret;
-
     for (; buff < buffEnd; buff++)
         count += buff->size;
+    count -= offset;
 
     buff = buffers;
+    while (offset > 0 && offset >= buff->size) {
+        offset -= buff->size;
+        buff++;
+    }
+    buffStart = offset;
+
     while (count > 0) {
         int  avail = buff->size - buffStart;
         int  len = socket_send(pipe->io->fd, buff->data + buffStart, avail);
@@ -303,6 +334,60 @@ netPipe_sendBuffers( void* opaque, const GoldfishPipeBuffer* buffers, int numBuf
     return ret;
 }
 
+/* Called when the socket becomes writable while a guest write is pending */
+static void
+netPipe_sendPending( NetPipe* pipe )
+{
+    int  ret = netPipe_sendFrom(pipe, pipe->pendingBuffers, pipe->pendingCount,
+                                pipe->pendingSent);
+
+    if (ret == PIPE_ERROR_AGAIN) {
+        return;
+    }
+    if (ret > 0) {
+        pipe->pendingSent += ret;
+        if (pipe->pendingSent < pipe->pendingSize) {
+            return;
+        }
+    }
+    goldfish_pipe_complete(pipe->pending,
+                           pipe->pendingSent > 0 ? pipe->pendingSent : ret);
+    pipe->pending = NULL;
+}
+
+static int
+netPipe_sendBuffers( void* opaque, const GoldfishPipeBuffer* buffers, int numBuffers )
+{
+    NetPipe*  pipe = opaque;
+    int       size = 0;
+    int       ret;
+    int       nn;
+
+    ret = netPipeReadySend(pipe);
+    if (ret != 0)
+        return ret;
+
+    ret = netPipe_sendFrom(pipe, buffers, numBuffers, 0);
+
+    /* When the socket is full, keep the guest buffers and finish the write
+     * once it drains, if the guest allows it. This avoids a wake signal and
+     * a new write from the guest, which matters for the GPU pipe. */
+    for (nn = 0; nn < numBuffers; nn++)
+        size += buffers[nn].size;
+
+    if ((ret == PIPE_ERROR_AGAIN || (ret > 0 && ret < size)) &&
+        (pipe->pending = goldfish_pipe_borrow_buffers(pipe->hwpipe)) != NULL) {
+        pipe->pendingBuffers = buffers;
+        pipe->pendingCount   = numBuffers;
+        pipe->pendingSize    = size;
+        pipe->pendingSent    = ret > 0 ? ret : 0;
+        netPipe_resetState(pipe);
+        return PIPE_ERROR_PENDING;
+    }
+
+    return ret;
+}
+
 static int
 netPipe_recvBuffers( void* opaque, GoldfishPipeBuffer*  buffers, int  numBuffers )
 {
@@ -473,6 +558,285 @@ static const GoldfishPipeFuncs  netPipeUnix_funcs = {
 };
 #endif
 
+static const GoldfishPipeFuncs  netPipe_funcs = {
+    NULL,
+    netPipe_closeFromGuest,
+    netPipe_sendBuffers,
+    netPipe_recvBuffers,
+    netPipe_poll,
+    netPipe_wakeOn,
+    NULL,
+    NULL,
+};
+
+/**********************************************************************
+ **********************************************************************
+ *****
+ *****  O P E N G L E S   C H A N N E L   P I P E S
+ *****
+ *****/
+
+/* A ChannelPipe connects the guest to a render thread through an in-process
+ * channel of the GLES emulation library (see android_openOpenglesChannel),
+ * instead of a socket. Data goes straight from the guest buffers to the
+ * channel's shared ring buffers, without system calls.
+ *
+ * The channel reports events from render threads. These are queued on a
+ * lock-free stack of pipes, and the main loop is woken through a socket
+ * pair only when the stack goes from empty to non-empty, so a burst of
+ * events costs a single wake-up.
+ */
+typedef struct ChannelPipe {
+    const GoldfishPipeFuncs*  funcs;    /* must be first, see NetPipe */
+    void*                     hwpipe;
+    void*                     channel;
+    int                       wakeWanted;
+    int                       closed;   /* closed by the renderer */
+    int                       dead;     /* closed by the guest while queued */
+
+    /* Updated from render threads */
+    volatile int              queued;
+    volatile int              events;
+    struct ChannelPipe*       next;
+} ChannelPipe;
+
+static struct {
+    int                    init;
+    int                    fds[2];    /* [0] is read by the main loop */
+    LoopIo                 io[1];
+    ChannelPipe* volatile  queue;
+} _channelPipes;
+
+static void
+channelPipe_onEvents( ChannelPipe* pipe, int events )
+{
+    int  wakeFlags = 0;
+
+    if ((events & OPENGLES_CHANNEL_CAN_READ) != 0 &&
+        (pipe->wakeWanted & PIPE_WAKE_READ) != 0) {
+        wakeFlags |= PIPE_WAKE_READ;
+    }
+    if ((events & OPENGLES_CHANNEL_CAN_WRITE) != 0 &&
+        (pipe->wakeWanted & PIPE_WAKE_WRITE) != 0) {
+        wakeFlags |= PIPE_WAKE_WRITE;
+    }
+    if (wakeFlags != 0) {
+        pipe->wakeWanted &= ~wakeFlags;
+        goldfish_pipe_wake(pipe->hwpipe, wakeFlags);
+    }
+    if ((events & OPENGLES_CHANNEL_CLOSED) != 0 && !pipe->closed) {
+        pipe->closed = 1;
+        goldfish_pipe_close(pipe->hwpipe);
+    }
+}
+
+/* Called from render threads */
+static void
+channelPipe_onChannelEvent( void* opaque, int events )
+{
+    ChannelPipe*  pipe = opaque;
+    ChannelPipe*  head;
+
+    __sync_fetch_and_or(&pipe->events, events);
+    if (!__sync_bool_compare_and_swap(&pipe->queued, 0, 1)) {
+        return;  /* already queued, the main loop will see the events */
+    }
+    do {
+        head = _channelPipes.queue;
+        pipe->next = head;
+    } while (!__sync_bool_compare_and_swap(&_channelPipes.queue, head, pipe));
+
+    if (head == NULL) {
+        char  c = 0;
+        socket_send(_channelPipes.fds[1], &c, 1);
+    }
+}
+
+static void
+channelPipe_free( ChannelPipe* pipe )
+{
+    AFREE(pipe);
+}
+
+/* Called from the main loop when render threads queued events */
+static void
+channelPipe_io_func( void* opaque, int fd, unsigned events )
+{
+    ChannelPipe*  pipe;
+    char          buf[64];
+
+    /* Drain the socket before taking the queue: any pipe queued after this
+     * point finds an empty stack and sends a new byte. */
+    while (socket_recv(fd, buf, sizeof(buf)) > 0) {
+    }
+
+    pipe = __sync_lock_test_and_set(&_channelPipes.queue, NULL);
+    while (pipe != NULL) {
+        ChannelPipe*  next = pipe->next;
+        int           pipeEvents;
+
+        __sync_lock_test_and_set(&pipe->queued, 0);
+        pipeEvents = __sync_lock_test_and_set(&pipe->events, 0);
+        if (pipe->dead) {
+            channelPipe_free(pipe);
+        } else if (pipeEvents != 0) {
+            channelPipe_onEvents(pipe, pipeEvents);
+        }
+        pipe = next;
+    }
+}
+
+static int
+channelPipe_initQueue( Looper* looper )
+{
+    if (_channelPipes.init) {
+        return 0;
+    }
+    if (socket_pair(&_channelPipes.fds[0], &_channelPipes.fds[1]) < 0) {
+        D("%s: Could not create socket pair: %s", __FUNCTION__, errno_str);
+        return -1;
+    }
+    socket_set_nonblock(_channelPipes.fds[0]);
+    socket_set_nonblock(_channelPipes.fds[1]);
+    loopIo_init(_channelPipes.io, looper, _channelPipes.fds[0],
+                channelPipe_io_func, NULL);
+    loopIo_wantRead(_channelPipes.io);
+    _channelPipes.init = 1;
+    return 0;
+}
+
+static void
+channelPipe_closeFromGuest( void* opaque )
+{
+    ChannelPipe*  pipe = opaque;
+
+    /* No event callback can run once this returns */
+    android_closeOpenglesChannel(pipe->channel);
+
+    if (pipe->queued) {
+        pipe->dead = 1;  /* freed by channelPipe_io_func() */
+    } else {
+        channelPipe_free(pipe);
+    }
+}
+
+static int
+channelPipe_sendBuffers( void* opaque, const GoldfishPipeBuffer* buffers, int numBuffers )
+{
+    ChannelPipe*  pipe = opaque;
+    int           ret  = 0;
+    int           nn;
+
+    for (nn = 0; nn < numBuffers; nn++) {
+        int  len = android_writeOpenglesChannel(pipe->channel,
+                                                buffers[nn].data,
+                                                buffers[nn].size);
+        if (len < 0) {
+            return ret > 0 ? ret : PIPE_ERROR_IO;
+        }
+        ret += len;
+        if (len < (int)buffers[nn].size) {
+            break;
+        }
+    }
+    return ret > 0 ? ret : PIPE_ERROR_AGAIN;
+}
+
+static int
+channelPipe_recvBuffers( void* opaque, GoldfishPipeBuffer* buffers, int numBuffers )
+{
+    ChannelPipe*  pipe = opaque;
+    int           ret  = 0;
+    int           nn;
+
+    for (nn = 0; nn < numBuffers; nn++) {
+        int  len = android_readOpenglesChannel(pipe->channel,
+                                               buffers[nn].data,
+                                               buffers[nn].size);
+        if (len < 0) {
+            return ret > 0 ? ret : PIPE_ERROR_IO;
+        }
+        ret += len;
+        if (len < (int)buffers[nn].size) {
+            break;
+        }
+    }
+    return ret > 0 ? ret : PIPE_ERROR_AGAIN;
+}
+
+static unsigned
+channelPipe_poll( void* opaque )
+{
+    ChannelPipe*  pipe   = opaque;
+    int           events = android_pollOpenglesChannel(pipe->channel);
+    unsigned      ret    = 0;
+
+    if (events & OPENGLES_CHANNEL_CAN_READ)
+        ret |= PIPE_POLL_IN;
+    if (events & OPENGLES_CHANNEL_CAN_WRITE)
+        ret |= PIPE_POLL_OUT;
+    if (events & OPENGLES_CHANNEL_CLOSED)
+        ret |= PIPE_POLL_HUP;
+
+    return ret;
+}
+
+static void
+channelPipe_wakeOn( void* opaque, int flags )
+{
+    ChannelPipe*  pipe   = opaque;
+    int           events = OPENGLES_CHANNEL_CLOSED;
+    int           ready;
+
+    DD("%s: flags=%d", __FUNCTION__, flags);
+
+    pipe->wakeWanted |= flags;
+    if (pipe->wakeWanted & PIPE_WAKE_READ)
+        events |= OPENGLES_CHANNEL_CAN_READ;
+    if (pipe->wakeWanted & PIPE_WAKE_WRITE)
+        events |= OPENGLES_CHANNEL_CAN_WRITE;
+
+    /* Conditions already met are not registered, handle them now */
+    ready = android_wantOpenglesChannelEvents(pipe->channel, events);
+    if (ready != 0) {
+        channelPipe_onEvents(pipe, ready);
+    }
+}
+
+static const GoldfishPipeFuncs  channelPipe_funcs = {
+    NULL,
+    channelPipe_closeFromGuest,
+    channelPipe_sendBuffers,
+    channelPipe_recvBuffers,
+    channelPipe_poll,
+    channelPipe_wakeOn,
+    NULL,
+    NULL,
+};
+
+static ChannelPipe*
+channelPipe_init( void* hwpipe, Looper* looper )
+{
+    ChannelPipe*  pipe;
+
+    if (channelPipe_initQueue(looper) < 0) {
+        return NULL;
+    }
+
+    ANEW0(pipe);
+    pipe->funcs  = &channelPipe_funcs;
+    pipe->hwpipe = hwpipe;
+    pipe->channel = android_openOpenglesChannel(channelPipe_onChannelEvent,
+                                                pipe);
+    if (pipe->channel == NULL) {
+        AFREE(pipe);
+        return NULL;
+    }
+    /* Always watch for the render thread exiting */
+    android_wantOpenglesChannelEvents(pipe->channel, OPENGLES_CHANNEL_CLOSED);
+    return pipe;
+}
+
 /* This is set to 1 in android_init_opengles() below, and tested
  * by openglesPipe_init() to refuse a pipe connection if the function
  * was never called.
@@ -491,6 +855,15 @@ openglesPipe_init( void* hwpipe, void* _looper, const char* args )
         return NULL;
     }
 
+    /* Prefer an in-process channel, it skips the sockets altogether */
+    if (android_gles_fast_pipes) {
+        ChannelPipe*  channelPipe = channelPipe_init(hwpipe, _looper);
+        if (channelPipe != NULL) {
+            D("Creating channel OpenGLES pipe for GPU emulation");
+            return channelPipe;
+        }
+    }
+
     char server_addr[PATH_MAX];
     android_gles_server_path(server_addr, sizeof(server_addr));
 #ifndef _WIN32
@@ -506,6 +879,8 @@ openglesPipe_init( void* hwpipe, void* _looper, const char* args )
         D("Creating TCP OpenGLES pipe for GPU emulation!");
     }
     if (pipe != NULL) {
+        pipe->funcs = &netPipe_funcs;
+
         // Disable TCP nagle algorithm to improve throughput of small packets
         socket_set_nodelay(pipe->io->fd);
 
@@ -526,13 +901,47 @@ openglesPipe_init( void* hwpipe, void* _looper, const char* args )
     return pipe;
 }
 
+/* The "opengles" service forwards to the functions of the pipe object,
+ * a NetPipe or a ChannelPipe, which both start with a 'funcs' pointer. */
+#define OPENGLES_PIPE_FUNCS(opaque)  (*(const GoldfishPipeFuncs**)(opaque))
+
+static void
+openglesPipe_close( void* opaque )
+{
+    OPENGLES_PIPE_FUNCS(opaque)->close(opaque);
+}
+
+static int
+openglesPipe_sendBuffers( void* opaque, const GoldfishPipeBuffer* buffers, int numBuffers )
+{
+    return OPENGLES_PIPE_FUNCS(opaque)->sendBuffers(opaque, buffers, numBuffers);
+}
+
+static int
+openglesPipe_recvBuffers( void* opaque, GoldfishPipeBuffer* buffers, int numBuffers )
+{
+    return OPENGLES_PIPE_FUNCS(opaque)->recvBuffers(opaque, buffers, numBuffers);
+}
+
+static unsigned
+openglesPipe_poll( void* opaque )
+{
+    return OPENGLES_PIPE_FUNCS(opaque)->poll(opaque);
+}
+
+static void
+openglesPipe_wakeOn( void* opaque, int flags )
+{
+    OPENGLES_PIPE_FUNCS(opaque)->wakeOn(opaque, flags);
+}
+
 static const GoldfishPipeFuncs  openglesPipe_funcs = {
     openglesPipe_init,
-    netPipe_closeFromGuest,
-    netPipe_sendBuffers,
-    netPipe_recvBuffers,
-    netPipe_poll,
-    netPipe_wakeOn,
+    openglesPipe_close,
+    openglesPipe_sendBuffers,
+    openglesPipe_recvBuffers,
+    openglesPipe_poll,
+    openglesPipe_wakeOn,
     NULL,  /* we can't save these */
     NULL,  /* we can't load these */
 };
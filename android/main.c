@@ -657,6 +657,14 @@ int main(int argc, char **argv) {
         args[n++] = opts->code_profile;
     }
 
+    if (opts->tcg_cache) {
+        char*  cachePath = avdInfo_getTcgCachePath(avd);
+        if (cachePath) {
+            args[n++] = "-tb-cache";
+            args[n++] = cachePath;
+        }
+    }
+
     /* Pass boot properties to the core. First, those from boot.prop,
      * then those from the command-line */
     const FileData* bootProperties = avdInfo_getBootProperties(avd);
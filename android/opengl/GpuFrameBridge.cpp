@@ -18,8 +18,8 @@
 #include "android/base/Log.h"
 #include "android/base/synchronization/Lock.h"
 #include "android/base/sockets/SocketUtils.h"
-#include "android/base/synchronization/MessageChannel.h"
 
+#include <stdint.h>
 #include <stdlib.h>
 #include <string.h>
 
@@ -30,30 +30,165 @@
 namespace android {
 namespace opengl {
 
+using android::base::AutoLock;
+using android::base::Lock;
 using android::base::Looper;
-using android::base::MessageChannel;
 
 namespace {
 
+// A rectangle of pixels, empty if |w| or |h| is 0.
+struct DirtyRect {
+    int x;
+    int y;
+    int w;
+    int h;
+
+    void setEmpty() {
+        x = y = w = h = 0;
+    }
+
+    bool isEmpty() const {
+        return w <= 0 || h <= 0;
+    }
+
+    void unite(const DirtyRect& other) {
+        if (other.isEmpty()) {
+            return;
+        }
+        if (isEmpty()) {
+            *this = other;
+            return;
+        }
+        int x1 = x + w > other.x + other.w ? x + w : other.x + other.w;
+        int y1 = y + h > other.y + other.h ? y + h : other.y + other.h;
+        x = x < other.x ? x : other.x;
+        y = y < other.y ? y : other.y;
+        w = x1 - x;
+        h = y1 - y;
+    }
+
+    void intersect(int width, int height) {
+        int x1 = x + w < width ? x + w : width;
+        int y1 = y + h < height ? y + h : height;
+        x = x > 0 ? x : 0;
+        y = y > 0 ? y : 0;
+        w = x1 - x;
+        h = y1 - y;
+        if (isEmpty()) {
+            setEmpty();
+        }
+    }
+};
+
 // A small structure to model a single frame of the GPU display,
-// as passed between the EmuGL and main loop thread.
+// as passed between the EmuGL and main loop thread. The pixel buffer is
+// kept from one frame to the next.
 struct Frame {
     int width;
     int height;
-    void* pixels;
+    size_t capacity;
+    uint32_t* pixels;
+    DirtyRect dirty;
 
-    Frame(int w, int h, const void* pixels) :
-            width(w), height(h), pixels(NULL) {
-        this->pixels = ::calloc(w * 4, h);
-        ::memcpy(this->pixels, pixels, w * 4 * h);
+    Frame() : width(0), height(0), capacity(0U), pixels(NULL) {
+        dirty.setEmpty();
     }
 
     ~Frame() {
         ::free(pixels);
     }
+
+    // Adds to the dirty rectangle the changes |rect| of a |rectWidth| x
+    // |rectHeight| frame that was not displayed. If its size was different,
+    // the whole frame is dirty.
+    void addDirty(const DirtyRect& rect, int rectWidth, int rectHeight) {
+        if (rectWidth != width || rectHeight != height) {
+            dirty.x = dirty.y = 0;
+            dirty.w = width;
+            dirty.h = height;
+            return;
+        }
+        dirty.unite(rect);
+        dirty.intersect(width, height);
+    }
+
+    bool reserve(size_t size) {
+        if (size > capacity) {
+            void* newPixels = ::realloc(pixels, size);
+            if (!newPixels) {
+                return false;
+            }
+            pixels = static_cast<uint32_t*>(newPixels);
+            capacity = size;
+        }
+        return true;
+    }
 };
 
+// Copies |width| x |height| RGBA pixels from |src| to |dst|, and returns
+// the rectangle where they differ from |prev|, which can be NULL to mark
+// the whole frame as dirty.
+DirtyRect copyFrame(uint32_t* dst,
+                    const uint32_t* src,
+                    const uint32_t* prev,
+                    int width,
+                    int height) {
+    DirtyRect rect;
+    const size_t rowSize = (size_t)width * 4U;
+    ::memcpy(dst, src, rowSize * height);
+    if (!prev) {
+        rect.x = rect.y = 0;
+        rect.w = width;
+        rect.h = height;
+        return rect;
+    }
+    int minX = width, maxX = -1, minY = -1, maxY = -1;
+    for (int y = 0; y < height; ++y, src += width, prev += width) {
+        if (!::memcmp(src, prev, rowSize)) {
+            continue;
+        }
+        if (minY < 0) {
+            minY = y;
+        }
+        maxY = y;
+        int x0 = 0;
+        while (x0 < minX && src[x0] == prev[x0]) {
+            x0++;
+        }
+        minX = x0;
+        int x1 = width - 1;
+        while (x1 > maxX && src[x1] == prev[x1]) {
+            x1--;
+        }
+        maxX = x1;
+    }
+    if (minY < 0) {
+        rect.setEmpty();
+    } else {
+        rect.x = minX;
+        rect.y = minY;
+        rect.w = maxX - minX + 1;
+        rect.h = maxY - minY + 1;
+    }
+    return rect;
+}
+
 // Real implementation of GpuFrameBridge interface.
+//
+// Frames live in a pool of kNumFrames buffers. At any time, one can be
+// read by the callback in the main loop thread (mReading), one holds the
+// latest posted frame, not yet picked up by the main loop (mLatest), and
+// one is the previous posted frame, which new frames are compared to for
+// dirty rectangles (mPrevious, the same as mLatest if it is set). So
+// there is always a buffer that postFrame() can fill without waiting.
+//
+// The socket pair only carries a byte when the main loop has no pending
+// notification already, whatever the number of frames posted meanwhile.
+//
+// The changes of a frame that is dropped, or rejected by the callback, are
+// added to the next frame delivered (mPending holds them when there is no
+// such frame yet), since the frames are compared to each other, not to
+// what the callback last accepted.
 class Bridge : public GpuFrameBridge {
 public:
     // Constructor.
@@ -63,9 +198,16 @@ public:
             mInSocket(-1),
             mOutSocket(-1),
             mFdWatch(NULL),
-            mFrames(),
+            mLock(),
+            mLatest(-1),
+            mReading(-1),
+            mPrevious(-1),
+            mPendingWidth(0),
+            mPendingHeight(0),
+            mWakePending(false),
             mCallback(callback),
             mCallbackOpaque(callbackOpaque) {
+        mPending.setEmpty();
         if (::android::base::socketCreatePair(&mInSocket, &mOutSocket) < 0) {
             PLOG(ERROR) << "Could not create socket pair";
             return;
@@ -81,6 +223,7 @@ public:
             return;
         }
 
+        android::base::socketSetNonBlocking(mOutSocket);
         mFdWatch->wantRead();
     }
 
@@ -97,41 +240,138 @@ public:
         if (mInSocket < 0) {
             return;
         }
-        Frame* frame = new Frame(width, height, pixels);
-        ::memcpy(frame->pixels, pixels, width * 4 * height);
-        mFrames.send(frame);
-        char c = 1;
-        android::base::socketSend(mInSocket, &c, 1);
+
+        int index;
+        int previous;
+        {
+            AutoLock lock(mLock);
+            previous = mPrevious;
+            for (index = 0; index < kNumFrames; ++index) {
+                if (index != mLatest && index != mReading &&
+                    index != mPrevious) {
+                    break;
+                }
+            }
+        }
+        DCHECK(index < kNumFrames);
+
+        // The main loop only reads the frames, so |previous| can be
+        // compared to while it is being displayed.
+        Frame* frame = &mFrames[index];
+        if (!frame->reserve((size_t)width * 4U * height)) {
+            LOG(ERROR) << "Could not allocate GPU frame";
+            return;
+        }
+        const Frame* prev = NULL;
+        if (previous >= 0 && mFrames[previous].width == width &&
+            mFrames[previous].height == height) {
+            prev = &mFrames[previous];
+        }
+        frame->width = width;
+        frame->height = height;
+        frame->dirty = copyFrame(frame->pixels,
+                                 static_cast<const uint32_t*>(pixels),
+                                 prev ? prev->pixels : NULL,
+                                 width,
+                                 height);
+
+        bool wake;
+        {
+            AutoLock lock(mLock);
+            if (mLatest >= 0) {
+                // Drop the frame that was never displayed, but not the
+                // changes it had.
+                const Frame& latest = mFrames[mLatest];
+                frame->addDirty(latest.dirty, latest.width, latest.height);
+            }
+            if (!mPending.isEmpty()) {
+                frame->addDirty(mPending, mPendingWidth, mPendingHeight);
+                mPending.setEmpty();
+            }
+            mLatest = index;
+            mPrevious = index;
+            wake = !mWakePending;
+            mWakePending = true;
+        }
+        if (wake) {
+            char c = 1;
+            android::base::socketSend(mInSocket, &c, 1);
+        }
     }
 
 private:
     enum {
-        kMaxFrames = 16
+        kNumFrames = 3
     };
 
-    // Called from the looper thread when a new Frame instance is available.
+    // Called from the looper thread when a new Frame is available.
     static void onSocketEvent(void* opaque, int fd, unsigned events) {
         Bridge* bridge = reinterpret_cast<Bridge*>(opaque);
         if (events & Looper::FdWatch::kEventRead) {
-            char c = 0;
-            android::base::socketRecv(bridge->mOutSocket, &c, 1);
-            Frame* frame = NULL;
-            bridge->mFrames.receive(&frame);
-            if (frame) {
-                bridge->mCallback(bridge->mCallbackOpaque,
-                                  frame->width,
-                                  frame->height,
-                                  frame->pixels);
-                delete frame;
+            char buf[16];
+            while (android::base::socketRecv(bridge->mOutSocket,
+                                             buf, sizeof(buf)) > 0) {
+            }
+            int index;
+            {
+                AutoLock lock(bridge->mLock);
+                bridge->mWakePending = false;
+                index = bridge->mLatest;
+                bridge->mLatest = -1;
+                bridge->mReading = index;
+            }
+            if (index >= 0) {
+                const Frame& frame = bridge->mFrames[index];
+                int used = bridge->mCallback(bridge->mCallbackOpaque,
+                                             frame.width,
+                                             frame.height,
+                                             frame.pixels,
+                                             frame.dirty.x,
+                                             frame.dirty.y,
+                                             frame.dirty.w,
+                                             frame.dirty.h);
+                AutoLock lock(bridge->mLock);
+                bridge->mReading = -1;
+                if (!used && !frame.dirty.isEmpty()) {
+                    bridge->keepDirty(frame);
+                }
             }
         }
     }
 
+    // Keeps the changes of |frame|, which the callback rejected, for the
+    // next frame delivered. Must be called with |mLock| held.
+    void keepDirty(const Frame& frame) {
+        if (mLatest >= 0) {
+            mFrames[mLatest].addDirty(frame.dirty, frame.width, frame.height);
+        } else if (mPending.isEmpty() || (mPendingWidth == frame.width &&
+                                          mPendingHeight == frame.height)) {
+            mPending.unite(frame.dirty);
+            mPendingWidth = frame.width;
+            mPendingHeight = frame.height;
+        } else {
+            // Changes of frames of different sizes can't be combined.
+            mPending.x = mPending.y = 0;
+            mPending.w = frame.width;
+            mPending.h = frame.height;
+            mPendingWidth = frame.width;
+            mPendingHeight = frame.height;
+        }
+    }
+
     Looper* mLooper;
     int mInSocket;
     int mOutSocket;
     Looper::FdWatch* mFdWatch;
-    MessageChannel<Frame*, kMaxFrames> mFrames;
+    Lock mLock;
+    Frame mFrames[kNumFrames];
+    int mLatest;
+    int mReading;
+    int mPrevious;
+    DirtyRect mPending;
+    int mPendingWidth;
+    int mPendingHeight;
+    bool mWakePending;
     Callback* mCallback;
     void* mCallbackOpaque;
 };
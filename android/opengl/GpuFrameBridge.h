@@ -38,17 +38,36 @@ namespace opengl {
 //  2) In the EmuGL callback, which runs in its own EmuGL thread, call the
 //     postFrame() method.
 //
+// Frames are copied once into a small pool of buffers. If the main loop
+// is slower than EmuGL, only the latest frame is delivered, and the ones
+// it replaces are dropped, their dirty rectangles merged into its own.
+// Likewise, the dirty rectangle of a frame that the callback rejects is
+// merged into the next one.
+//
 class GpuFrameBridge {
 public:
     // Type of function that is called to transfer the content of a new
     // GPU frame to the main thread. |opaque| is a user-provided pointer,
     // |width| and |height| are dimensions in pixels, and |pixels| is
-    // the memory buffer of 32-bit RGBA image data. This buffer is freed
+    // the memory buffer of 32-bit RGBA image data. This buffer is reused
     // when the function returns.
-    typedef void (Callback)(void* opaque,
+    //
+    // |dirtyX|, |dirtyY|, |dirtyW| and |dirtyH| describe the rectangle of
+    // pixels that changed since the previous call, in the row order of
+    // |pixels|. Pixels outside of it are the same as in the previous
+    // frame. It is empty if nothing changed, and covers the whole frame
+    // on the first call or after a size change.
+    //
+    // Returns 1 if the frame was used, or 0 if it was rejected, in which
+    // case its dirty rectangle is reported again with the next frame.
+    typedef int (Callback)(void* opaque,
                             int width,
                             int height,
-                            const void* pixels);
+                            const void* pixels,
+                            int dirtyX,
+                            int dirtyY,
+                            int dirtyW,
+                            int dirtyH);
 
     // Create a new GpuFrameBridge instance. |looper| is a handle to the main
     // loop's Looper instance, and |callback| is a function that will be
@@ -21,6 +21,7 @@
 #include <gtest/gtest.h>
 
 #include <errno.h>
+#include <stdint.h>
 #include <stdlib.h>
 #include <string.h>
 
@@ -33,11 +34,16 @@ using android::base::Looper;
 namespace {
 
 struct Frame {
-    Frame(int w, int h, const void* pixels) {
+    Frame(int w, int h, const void* pixels,
+          int dirtyX, int dirtyY, int dirtyW, int dirtyH) {
         this->width = w;
         this->height = h;
         this->pixels = ::malloc(w * 4 * h);
         ::memcpy(this->pixels, pixels, w * h * 4);
+        this->dirtyX = dirtyX;
+        this->dirtyY = dirtyY;
+        this->dirtyW = dirtyW;
+        this->dirtyH = dirtyH;
     }
 
     ~Frame() {
@@ -47,11 +53,15 @@ struct Frame {
     int width;
     int height;
     void* pixels;
+    int dirtyX;
+    int dirtyY;
+    int dirtyW;
+    int dirtyH;
 };
 
 class FrameList {
 public:
-    FrameList() : mCount(0) {}
+    FrameList() : mCount(0), mReject(false) {}
 
     ~FrameList() {
         for (int n = mCount; n > 0; --n) {
@@ -61,6 +71,9 @@ public:
 
     int count() const { return mCount; }
 
+    // Make add() reject the frames, after recording them.
+    void setReject(bool reject) { mReject = reject; }
+
     Frame* popFront() {
         if (mCount == 0) {
             return NULL;
@@ -80,11 +93,13 @@ public:
         }
     }
 
-    static void add(void* context, int w, int h, const void* pixels) {
+    static int add(void* context, int w, int h, const void* pixels,
+                   int dirtyX, int dirtyY, int dirtyW, int dirtyH) {
         FrameList* list = reinterpret_cast<FrameList*>(context);
         CHECK(list->mCount < kMaxFrames);
-        Frame* frame = new Frame(w, h, pixels);
+        Frame* frame = new Frame(w, h, pixels, dirtyX, dirtyY, dirtyW, dirtyH);
         list->mFrames[list->mCount++] = frame;
+        return list->mReject ? 0 : 1;
     }
 
 private:
@@ -93,6 +108,7 @@ private:
     };
 
     int mCount;
+    bool mReject;
     Frame* mFrames[kMaxFrames];
 };
 
@@ -124,6 +140,145 @@ TEST(GpuFrameBridge, postFrameWithinSingleThread) {
         EXPECT_EQ(kFrame0[n], reinterpret_cast<unsigned char*>(frame->pixels)[n])
                 << "# " << n;
     }
+    EXPECT_EQ(0, frame->dirtyX);
+    EXPECT_EQ(0, frame->dirtyY);
+    EXPECT_EQ(1, frame->dirtyW);
+    EXPECT_EQ(1, frame->dirtyH);
+    delete bridge;
+}
+
+TEST(GpuFrameBridge, latestFrameWins) {
+    ScopedPtr<Looper> looper(Looper::create());
+    ASSERT_TRUE(looper.get());
+
+    FrameList list;
+    GpuFrameBridge* bridge =
+            GpuFrameBridge::create(looper.get(), FrameList::add, &list);
+    EXPECT_TRUE(bridge);
+
+    const int kWidth = 8, kHeight = 6;
+    uint32_t pixels[kWidth * kHeight];
+    ::memset(pixels, 0, sizeof(pixels));
+    bridge->postFrame(kWidth, kHeight, pixels);
+    EXPECT_EQ(ETIMEDOUT, looper->runWithTimeoutMs(100));
+    ASSERT_EQ(1, list.count());
+    delete list.popFront();
+
+    // Post several frames without running the looper: only the last one
+    // must be delivered, with the changes of all of them.
+    pixels[1 * kWidth + 2] = 0x11111111;
+    bridge->postFrame(kWidth, kHeight, pixels);
+    pixels[4 * kWidth + 6] = 0x22222222;
+    bridge->postFrame(kWidth, kHeight, pixels);
+    pixels[3 * kWidth + 4] = 0x33333333;
+    bridge->postFrame(kWidth, kHeight, pixels);
+
+    EXPECT_EQ(ETIMEDOUT, looper->runWithTimeoutMs(100));
+    ASSERT_EQ(1, list.count());
+    ScopedPtr<Frame> frame(list.popFront());
+    EXPECT_EQ(0, ::memcmp(pixels, frame->pixels, sizeof(pixels)));
+    EXPECT_EQ(2, frame->dirtyX);
+    EXPECT_EQ(1, frame->dirtyY);
+    EXPECT_EQ(5, frame->dirtyW);
+    EXPECT_EQ(4, frame->dirtyH);
+
+    // An identical frame has an empty dirty rectangle.
+    bridge->postFrame(kWidth, kHeight, pixels);
+    EXPECT_EQ(ETIMEDOUT, looper->runWithTimeoutMs(100));
+    ASSERT_EQ(1, list.count());
+    frame.reset(list.popFront());
+    EXPECT_EQ(0, frame->dirtyW * frame->dirtyH);
+
+    // A size change dirties the whole frame.
+    bridge->postFrame(kWidth / 2, kHeight, pixels);
+    EXPECT_EQ(ETIMEDOUT, looper->runWithTimeoutMs(100));
+    ASSERT_EQ(1, list.count());
+    frame.reset(list.popFront());
+    EXPECT_EQ(0, frame->dirtyX);
+    EXPECT_EQ(0, frame->dirtyY);
+    EXPECT_EQ(kWidth / 2, frame->dirtyW);
+    EXPECT_EQ(kHeight, frame->dirtyH);
+    delete bridge;
+}
+
+TEST(GpuFrameBridge, droppedFrameOfAnotherSize) {
+    ScopedPtr<Looper> looper(Looper::create());
+    ASSERT_TRUE(looper.get());
+
+    FrameList list;
+    GpuFrameBridge* bridge =
+            GpuFrameBridge::create(looper.get(), FrameList::add, &list);
+    EXPECT_TRUE(bridge);
+
+    const int kWidth = 8, kHeight = 6;
+    uint32_t pixels[kWidth * kHeight];
+    ::memset(pixels, 0, sizeof(pixels));
+    bridge->postFrame(kWidth, kHeight, pixels);
+    EXPECT_EQ(ETIMEDOUT, looper->runWithTimeoutMs(100));
+    ASSERT_EQ(1, list.count());
+    delete list.popFront();
+
+    // A larger frame is dropped for a smaller one: the dirty rectangle
+    // must not extend past the delivered frame.
+    bridge->postFrame(kWidth, kHeight * 2 / 3, pixels);
+    pixels[0] = 0x11111111;
+    bridge->postFrame(kWidth / 2, kHeight / 2, pixels);
+    EXPECT_EQ(ETIMEDOUT, looper->runWithTimeoutMs(100));
+    ASSERT_EQ(1, list.count());
+    ScopedPtr<Frame> frame(list.popFront());
+    EXPECT_EQ(kWidth / 2, frame->width);
+    EXPECT_EQ(kHeight / 2, frame->height);
+    EXPECT_EQ(0, frame->dirtyX);
+    EXPECT_EQ(0, frame->dirtyY);
+    EXPECT_EQ(kWidth / 2, frame->dirtyW);
+    EXPECT_EQ(kHeight / 2, frame->dirtyH);
+    delete bridge;
+}
+
+TEST(GpuFrameBridge, rejectedFrameKeepsItsChanges) {
+    ScopedPtr<Looper> looper(Looper::create());
+    ASSERT_TRUE(looper.get());
+
+    FrameList list;
+    GpuFrameBridge* bridge =
+            GpuFrameBridge::create(looper.get(), FrameList::add, &list);
+    EXPECT_TRUE(bridge);
+
+    const int kWidth = 8, kHeight = 6;
+    uint32_t pixels[kWidth * kHeight];
+    ::memset(pixels, 0, sizeof(pixels));
+    bridge->postFrame(kWidth, kHeight, pixels);
+    EXPECT_EQ(ETIMEDOUT, looper->runWithTimeoutMs(100));
+    ASSERT_EQ(1, list.count());
+    delete list.popFront();
+
+    // The changes of a rejected frame are reported again with the next
+    // one, even though it only differs elsewhere from the rejected one.
+    list.setReject(true);
+    pixels[1 * kWidth + 2] = 0x11111111;
+    bridge->postFrame(kWidth, kHeight, pixels);
+    EXPECT_EQ(ETIMEDOUT, looper->runWithTimeoutMs(100));
+    ASSERT_EQ(1, list.count());
+    delete list.popFront();
+
+    list.setReject(false);
+    pixels[4 * kWidth + 6] = 0x22222222;
+    bridge->postFrame(kWidth, kHeight, pixels);
+    EXPECT_EQ(ETIMEDOUT, looper->runWithTimeoutMs(100));
+    ASSERT_EQ(1, list.count());
+    ScopedPtr<Frame> frame(list.popFront());
+    EXPECT_EQ(2, frame->dirtyX);
+    EXPECT_EQ(1, frame->dirtyY);
+    EXPECT_EQ(5, frame->dirtyW);
+    EXPECT_EQ(4, frame->dirtyH);
+
+    // Once a frame is used, its changes are not reported again.
+    bridge->postFrame(kWidth, kHeight, pixels);
+    EXPECT_EQ(ETIMEDOUT, looper->runWithTimeoutMs(100));
+    ASSERT_EQ(1, list.count());
+    frame.reset(list.popFront());
+    EXPECT_EQ(0, frame->dirtyW * frame->dirtyH);
+    delete bridge;
 }
 
 }  // namespace opengl
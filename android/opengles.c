@@ -58,6 +58,12 @@ typedef void* FBNativeWindowType;
   FUNCTION_(bool, destroyOpenGLSubwindow, (void), ()) \
   FUNCTION_VOID_(setOpenGLDisplayRotation, (float zRot), (zRot)) \
   FUNCTION_VOID_(repaintOpenGLDisplay, (void), ()) \
+  FUNCTION_(void*, openRenderChannel, (OnOpenglesChannelEventFunc onEvent, void* context), (onEvent, context)) \
+  FUNCTION_(int, renderChannelWrite, (void* channel, const void* buf, size_t len), (channel, buf, len)) \
+  FUNCTION_(int, renderChannelRead, (void* channel, void* buf, size_t len), (channel, buf, len)) \
+  FUNCTION_(int, renderChannelPoll, (void* channel), (channel)) \
+  FUNCTION_(int, renderChannelWantEvents, (void* channel, int events), (channel, events)) \
+  FUNCTION_VOID_(closeRenderChannel, (void* channel), (channel)) \
   FUNCTION_(int, stopOpenGLRenderer, (void), ()) \
 
 #include <stdio.h>
@@ -313,6 +319,45 @@ android_redrawOpenglesWindow(void)
     }
 }
 
+void*
+android_openOpenglesChannel(OnOpenglesChannelEventFunc onEvent, void* context)
+{
+    if (!rendererStarted) {
+        return NULL;
+    }
+    return openRenderChannel(onEvent, context);
+}
+
+int
+android_writeOpenglesChannel(void* channel, const void* buf, size_t len)
+{
+    return renderChannelWrite(channel, buf, len);
+}
+
+int
+android_readOpenglesChannel(void* channel, void* buf, size_t len)
+{
+    return renderChannelRead(channel, buf, len);
+}
+
+int
+android_pollOpenglesChannel(void* channel)
+{
+    return renderChannelPoll(channel);
+}
+
+int
+android_wantOpenglesChannelEvents(void* channel, int events)
+{
+    return renderChannelWantEvents(channel, events);
+}
+
+void
+android_closeOpenglesChannel(void* channel)
+{
+    closeRenderChannel(channel);
+}
+
 void
 android_gles_server_path(char* buff, size_t buffsize)
 {
@@ -61,6 +61,37 @@ void android_stopOpenglesRenderer(void);
  */
 extern int  android_gles_fast_pipes;
 
+/* In-process channels to the renderer, see the description of
+ * openRenderChannel() in render_api.entries. They bypass the sockets of
+ * android_gles_server_path(), and are only available while the renderer
+ * is started; android_openOpenglesChannel() returns NULL otherwise.
+ *
+ * The event callback is invoked from a renderer thread, with a mask of
+ * the following values. */
+#define OPENGLES_CHANNEL_CAN_READ   (1 << 0)
+#define OPENGLES_CHANNEL_CAN_WRITE  (1 << 1)
+#define OPENGLES_CHANNEL_CLOSED     (1 << 2)
+
+typedef void (*OnOpenglesChannelEventFunc)(void* context, int events);
+
+void* android_openOpenglesChannel(OnOpenglesChannelEventFunc onEvent,
+                                  void* context);
+
+/* Non-blocking: return the number of bytes transferred, 0 if the channel is
+ * full (resp. empty), or -1 if it was closed by the renderer. */
+int android_writeOpenglesChannel(void* channel, const void* buf, size_t len);
+int android_readOpenglesChannel(void* channel, void* buf, size_t len);
+
+/* Returns the mask of OPENGLES_CHANNEL_XXX conditions currently true */
+int android_pollOpenglesChannel(void* channel);
+
+/* Requests a callback when one of 'events' becomes true. Returns the subset
+ * of 'events' that are already true, for which no callback will happen. */
+int android_wantOpenglesChannelEvents(void* channel, int events);
+
+/* The callback is never invoked once this returns */
+void android_closeOpenglesChannel(void* channel);
+
 /* Get the address of the socket that clients should connect to to access GLES.
  * For TCP this is just the port number (as a string) on the loopback address.
  * For UNIX and Win32 pipes it is the full pathname of the pipe.
@@ -0,0 +1,183 @@
+// Copyright (C) 2015 The Android Open Source Project
+//
+// This software is licensed under the terms of the GNU General Public
+// License version 2, as published by the Free Software Foundation, and
+// may be copied, distributed, and modified under those terms.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+
+#include "android/skin/scaler-workers.h"
+
+#include "android/base/containers/PodVector.h"
+#include "android/base/synchronization/ConditionVariable.h"
+#include "android/base/synchronization/Lock.h"
+#include "android/base/threads/Thread.h"
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <unistd.h>
+#endif
+
+using android::base::AutoLock;
+using android::base::ConditionVariable;
+using android::base::Lock;
+using android::base::PodVector;
+using android::base::Thread;
+
+namespace {
+
+class WorkerThread;
+
+// The state shared by all threads of a pool. Each call to run() is a new
+// job, identified by a generation number. The calls of a job are handed
+// out one at a time, under the lock, to whichever thread asks first.
+struct Pool {
+    Pool() : mFunc(NULL), mOpaque(NULL), mCount(0), mNext(0), mDone(0),
+             mGeneration(0), mQuit(false) {}
+
+    // Runs the remaining calls of the current job, then returns.
+    // Must be called with |mLock| held.
+    void runCalls() {
+        while (mNext < mCount) {
+            int n = mNext++;
+            mLock.unlock();
+            mFunc(mOpaque, n);
+            mLock.lock();
+            if (++mDone == mCount) {
+                mJobDone.signal();
+            }
+        }
+    }
+
+    Lock mLock;
+    ConditionVariable mJobDone;
+    void (*mFunc)(void*, int);
+    void* mOpaque;
+    int mCount;
+    int mNext;
+    int mDone;
+    unsigned mGeneration;
+    bool mQuit;
+    PodVector<WorkerThread*> mThreads;
+};
+
+class WorkerThread : public Thread {
+public:
+    explicit WorkerThread(Pool* pool) : Thread(), mPool(pool) {}
+
+    virtual intptr_t main() {
+        Pool* pool = mPool;
+        AutoLock lock(pool->mLock);
+        unsigned generation = pool->mGeneration;
+        for (;;) {
+            while (!pool->mQuit && pool->mGeneration == generation) {
+                mWakeUp.wait(&pool->mLock);
+            }
+            if (pool->mQuit) {
+                break;
+            }
+            generation = pool->mGeneration;
+            pool->runCalls();
+        }
+        return 0;
+    }
+
+    // Must be called with the pool's lock held.
+    void wakeUp() {
+        mWakeUp.signal();
+    }
+
+private:
+    Pool* mPool;
+    ConditionVariable mWakeUp;
+};
+
+}  // namespace
+
+struct SkinScalerWorkers {
+    Pool pool;
+};
+
+SkinScalerWorkers* skin_scaler_workers_create(int count) {
+    if (count <= 0) {
+        return NULL;
+    }
+    SkinScalerWorkers* workers = new SkinScalerWorkers();
+    for (int n = 0; n < count; ++n) {
+        WorkerThread* thread = new WorkerThread(&workers->pool);
+        if (!thread->start()) {
+            delete thread;
+            break;
+        }
+        workers->pool.mThreads.append(thread);
+    }
+    if (workers->pool.mThreads.empty()) {
+        delete workers;
+        return NULL;
+    }
+    return workers;
+}
+
+int skin_scaler_workers_host_cpus(void) {
+#ifdef _WIN32
+    SYSTEM_INFO info;
+    GetSystemInfo(&info);
+    long count = info.dwNumberOfProcessors;
+#else
+    long count = sysconf(_SC_NPROCESSORS_ONLN);
+#endif
+    return (count < 1) ? 1 : static_cast<int>(count);
+}
+
+void skin_scaler_workers_free(SkinScalerWorkers* workers) {
+    if (!workers) {
+        return;
+    }
+    Pool* pool = &workers->pool;
+    {
+        AutoLock lock(pool->mLock);
+        pool->mQuit = true;
+        for (size_t n = 0; n < pool->mThreads.size(); ++n) {
+            pool->mThreads[n]->wakeUp();
+        }
+    }
+    for (size_t n = 0; n < pool->mThreads.size(); ++n) {
+        pool->mThreads[n]->wait(NULL);
+        delete pool->mThreads[n];
+    }
+    delete workers;
+}
+
+void skin_scaler_workers_run(SkinScalerWorkers* workers,
+                             int count,
+                             void (*func)(void* opaque, int n),
+                             void* opaque) {
+    if (!workers || count <= 1) {
+        for (int n = 0; n < count; ++n) {
+            func(opaque, n);
+        }
+        return;
+    }
+    Pool* pool = &workers->pool;
+    AutoLock lock(pool->mLock);
+    pool->mFunc = func;
+    pool->mOpaque = opaque;
+    pool->mCount = count;
+    pool->mNext = 0;
+    pool->mDone = 0;
+    pool->mGeneration++;
+    // No need to wake up more threads than there are calls left for them.
+    for (size_t n = 0; n < pool->mThreads.size() && (int)n + 1 < count; ++n) {
+        pool->mThreads[n]->wakeUp();
+    }
+    pool->runCalls();
+    while (pool->mDone < pool->mCount) {
+        pool->mJobDone.wait(&pool->mLock);
+    }
+    pool->mFunc = NULL;
+    pool->mOpaque = NULL;
+}
@@ -0,0 +1,45 @@
+/* Copyright (C) 2015 The Android Open Source Project
+**
+** This software is licensed under the terms of the GNU General Public
+** License version 2, as published by the Free Software Foundation, and
+** may be copied, distributed, and modified under those terms.
+**
+** This program is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+** GNU General Public License for more details.
+*/
+#ifndef _ANDROID_SKIN_SCALER_WORKERS_H
+#define _ANDROID_SKIN_SCALER_WORKERS_H
+
+#include "android/utils/compiler.h"
+
+ANDROID_BEGIN_HEADER
+
+/* A small pool of threads used by the skin scaler to process large
+ * rectangles as several bands of rows in parallel. This is a C wrapper
+ * around android::base::Thread and friends. */
+typedef struct SkinScalerWorkers  SkinScalerWorkers;
+
+/* create a pool of |count| worker threads. returns NULL if |count| is
+ * not positive, or if no thread could be started. */
+extern SkinScalerWorkers*  skin_scaler_workers_create( int  count );
+
+/* return the number of CPUs of the host, at least 1. */
+extern int                 skin_scaler_workers_host_cpus( void );
+
+/* stop all worker threads and destroy the pool. */
+extern void                skin_scaler_workers_free( SkinScalerWorkers*  workers );
+
+/* call |func(opaque, n)| for each |n| in 0 .. |count|-1, spreading the calls
+ * over the worker threads and the calling thread. only returns once all
+ * calls have completed. |workers| can be NULL, in which case all calls
+ * happen in the calling thread. */
+extern void                skin_scaler_workers_run( SkinScalerWorkers*  workers,
+                                                    int                 count,
+                                                    void              (*func)(void* opaque, int n),
+                                                    void*               opaque );
+
+ANDROID_END_HEADER
+
+#endif /* _ANDROID_SKIN_SCALER_WORKERS_H */
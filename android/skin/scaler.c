@@ -11,25 +11,49 @@
 */
 #include "android/skin/scaler.h"
 
+#include "android/skin/scaler-workers.h"
+#include "android/utils/system.h"
+
 #include <stdint.h>
 #include <math.h>
+#include <string.h>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#define  SCALER_HAVE_SSE2  1
+#endif
 
 struct SkinScaler {
     double  scale;
     double  xdisp, ydisp;
     double  invscale;
     int     valid;
+    int     use_simd;
+    int     threads;
+    SkinScalerWorkers*  workers;
+    void*   tables;         /* scratch space for the SIMD column tables */
+    size_t  tables_size;
 };
 
+/* more bands than this don't make a window-sized rectangle any faster */
+#define  SCALER_MAX_THREADS  4
+
 static SkinScaler  _scaler0;
 
 SkinScaler*
 skin_scaler_create( void )
 {
+    int  threads = skin_scaler_workers_host_cpus();
+
+    if (threads > SCALER_MAX_THREADS)
+        threads = SCALER_MAX_THREADS;
+
     _scaler0.scale    = 1.0;
     _scaler0.xdisp    = 0.0;
     _scaler0.ydisp    = 0.0;
     _scaler0.invscale = 1.0;
+    skin_scaler_set_simd(&_scaler0, 1);
+    skin_scaler_set_threads(&_scaler0, threads);
     return &_scaler0;
 }
 
@@ -53,10 +77,37 @@ skin_scaler_set( SkinScaler*  scaler, double  scale, double xdisp, double ydisp
     return 0;
 }
 
+void
+skin_scaler_set_threads( SkinScaler*  scaler, int  threads )
+{
+    if (threads < 1)
+        threads = 1;
+
+    if (threads == scaler->threads)
+        return;
+
+    /* the calling thread does its share of the work */
+    skin_scaler_workers_free(scaler->workers);
+    scaler->workers = skin_scaler_workers_create(threads - 1);
+    scaler->threads = threads;
+}
+
+void
+skin_scaler_set_simd( SkinScaler*  scaler, int  enable )
+{
+    scaler->use_simd = enable;
+}
+
 void
 skin_scaler_free( SkinScaler*  scaler )
 {
-    (void)scaler;
+    skin_scaler_workers_free(scaler->workers);
+    scaler->workers = NULL;
+    scaler->threads = 0;
+
+    AFREE(scaler->tables);
+    scaler->tables      = NULL;
+    scaler->tables_size = 0;
 }
 
 typedef struct {
@@ -70,6 +121,11 @@ typedef struct {
     uint8_t*    dst_line;
     uint8_t*    src_line;
     double      scale;
+    /* destination channel layout, the kernels in argb.h produce ARGB */
+    int         swizzle;
+    uint32_t    r_shift, g_shift, b_shift, a_shift, a_mask;
+    /* column tables for the SIMD kernels, shared by all bands */
+    void*       columns;
 } ScaleOp;
 
 
@@ -112,6 +168,368 @@ skin_scaler_get_scaled_rect( SkinScaler*     scaler,
     drect->size.h = (int)(ceil((sy + sh) * scale + scaler->ydisp)) - drect->pos.y;
 }
 
+/* The optimized scale functions in argb.h assume the destination is ARGB.
+ * If that's not the case, reorder the channels of the rows they produced. */
+static void
+swizzle_rows( ScaleOp*  op )
+{
+    uint32_t rshift = op->r_shift;
+    uint32_t gshift = op->g_shift;
+    uint32_t bshift = op->b_shift;
+    uint32_t ashift = op->a_shift;
+    uint32_t amask  = op->a_mask; // may be 0x00
+    int x, y;
+
+    for (y = 0; y < op->rd.size.h; y++)
+    {
+        uint32_t* line = (uint32_t*)(op->dst_line + y*op->dst_pitch);
+        for (x = 0; x < op->rd.size.w; x++) {
+            uint32_t r = (line[x] & 0x00ff0000) >> 16;
+            uint32_t g = (line[x] & 0x0000ff00) >>  8;
+            uint32_t b = (line[x] & 0x000000ff) >>  0;
+            uint32_t a = (line[x] & 0xff000000) >> 24;
+            line[x] = (r << rshift) | (g << gshift) | (b << bshift) |
+                      ((a << ashift) & amask);
+        }
+    }
+}
+
+#ifdef SCALER_HAVE_SSE2
+
+/* SSE2 versions of scale_05_to_10() and scale_up_bilinear(), producing the
+ * exact same pixels. The parts of the computation that only depend on the
+ * destination column are done once per rectangle, into the column tables
+ * below, and the channel reordering is done before storing the pixels.
+ *
+ * Pixels are processed 4 at a time, with their channels unpacked to 16-bit
+ * values, which is enough for all intermediate results. Column tables are
+ * padded to a multiple of 4 columns, by repeating the last one.
+ */
+
+/* box filtering, see scale_05_to_10(). each destination pixel covers up to
+ * 3x3 source pixels, missing ones get a weight of 0. */
+typedef struct {
+    int32_t*   off[3];      /* byte offset of each source column */
+    uint64_t*  weight[3];   /* and its weight, in 16.16 format */
+} BoxColumns;
+
+/* bilinear filtering, see scale_up_bilinear() */
+typedef struct {
+    int32_t*   off1;        /* byte offset of the left source pixel */
+    int32_t*   off2;        /* byte offset of the right source pixel */
+    uint64_t*  alpha;       /* weight of the right one, in each 16-bit word */
+} BilinearColumns;
+
+static void*
+scaler_tables( SkinScaler*  scaler, size_t  size )
+{
+    if (size > scaler->tables_size) {
+        AFREE(scaler->tables);
+        scaler->tables      = android_alloc(size);
+        scaler->tables_size = size;
+    }
+    return scaler->tables;
+}
+
+static BoxColumns*
+box_columns_init( SkinScaler*  scaler, const ScaleOp*  op )
+{
+    int          count = (op->rd.size.w + 3) & ~3;
+    BoxColumns*  cols;
+    uint8_t*     p;
+    int          x, c;
+
+    p = scaler_tables(scaler, sizeof(*cols) + count*3*(sizeof(uint64_t) + sizeof(int32_t)));
+    cols = (BoxColumns*)p;
+    p   += sizeof(*cols);
+    for (c = 0; c < 3; c++, p += count*sizeof(uint64_t))
+        cols->weight[c] = (uint64_t*)p;
+    for (c = 0; c < 3; c++, p += count*sizeof(int32_t))
+        cols->off[c] = (int32_t*)p;
+
+    for (x = 0; x < count; x++) {
+        int  sx  = op->sx + (x < op->rd.size.w ? x : op->rd.size.w - 1)*op->ix;
+        int  sx1 = sx & 0xffff;
+        int  sx2 = sx1 + op->ix;
+        int  off = (sx >> 16)*4;
+        int  fx1 = 65536 - sx1;
+        int  fx2 = sx2 & 0xffff;
+
+        if (fx2 == 0)
+            fx2 = 65536;
+
+        cols->off[0][x]    = off;
+        cols->weight[0][x] = fx1;
+        if (((sx1 >> 16) + 1) < ((sx2-1) >> 16)) {
+            cols->off[1][x]    = off + 4;
+            cols->weight[1][x] = 65536;
+            cols->off[2][x]    = off + 8;
+            cols->weight[2][x] = fx2;
+        } else {
+            cols->off[1][x]    = off + 4;
+            cols->weight[1][x] = fx2;
+            cols->off[2][x]    = off + 4;
+            cols->weight[2][x] = 0;
+        }
+    }
+    return cols;
+}
+
+static BilinearColumns*
+bilinear_columns_init( SkinScaler*  scaler, const ScaleOp*  op )
+{
+    int               count = (op->rd.size.w + 3) & ~3;
+    int               xlimit = op->src_w - 1;
+    BilinearColumns*  cols;
+    uint8_t*          p;
+    int               x;
+
+    p = scaler_tables(scaler, sizeof(*cols) + count*(sizeof(uint64_t) + 2*sizeof(int32_t)));
+    cols        = (BilinearColumns*)p;
+    p          += sizeof(*cols);
+    cols->alpha = (uint64_t*)p;
+    p          += count*sizeof(uint64_t);
+    cols->off1  = (int32_t*)p;
+    p          += count*sizeof(int32_t);
+    cols->off2  = (int32_t*)p;
+
+    for (x = 0; x < count; x++) {
+        int       sx  = op->sx + op->ix/2 - 32768 +
+                        (x < op->rd.size.w ? x : op->rd.size.w - 1)*op->ix;
+        int       ex1 = (sx >> 16);
+        int       ex2 = (sx+65535) >> 16;
+        uint64_t  alpha = (sx >> 8) & 0xff;
+
+        if (ex1 < 0) ex1 = 0; else if (ex1 > xlimit) ex1 = xlimit;
+        if (ex2 < 0) ex2 = 0; else if (ex2 > xlimit) ex2 = xlimit;
+
+        cols->off1[x]  = ex1*4;
+        cols->off2[x]  = ex2*4;
+        cols->alpha[x] = alpha * 0x0001000100010001ULL;
+    }
+    return cols;
+}
+
+/* loads the source pixels at byte offsets off[0] and off[1] from src, with
+ * their channels unpacked to 16-bit values */
+static __inline__ __m128i
+sse2_load2( const uint8_t*  src, const int32_t*  off )
+{
+    __m128i  p0 = _mm_cvtsi32_si128(*(const int*)(src + off[0]));
+    __m128i  p1 = _mm_cvtsi32_si128(*(const int*)(src + off[1]));
+    return _mm_unpacklo_epi8(_mm_unpacklo_epi32(p0, p1), _mm_setzero_si128());
+}
+
+/* returns (x1*(256-alpha) + x2*alpha) >> 8, as ARGB_INTERP255() does */
+static __inline__ __m128i
+sse2_interp255( __m128i  x1, __m128i  x2, __m128i  alpha )
+{
+    __m128i  ialpha = _mm_sub_epi16(_mm_set1_epi16(256), alpha);
+    return _mm_srli_epi16(_mm_add_epi16(_mm_mullo_epi16(x1, ialpha),
+                                        _mm_mullo_epi16(x2, alpha)), 8);
+}
+
+typedef struct {
+    int      swizzle;
+    __m128i  r_shift, g_shift, b_shift, a_shift, a_mask, byte_mask;
+} Sse2Swizzle;
+
+static void
+sse2_swizzle_init( Sse2Swizzle*  sw, const ScaleOp*  op )
+{
+    sw->swizzle   = op->swizzle;
+    sw->r_shift   = _mm_cvtsi32_si128(op->r_shift);
+    sw->g_shift   = _mm_cvtsi32_si128(op->g_shift);
+    sw->b_shift   = _mm_cvtsi32_si128(op->b_shift);
+    sw->a_shift   = _mm_cvtsi32_si128(op->a_shift);
+    sw->a_mask    = _mm_set1_epi32((int)op->a_mask);
+    sw->byte_mask = _mm_set1_epi32(0xff);
+}
+
+/* packs 4 pixels, reorders their channels like swizzle_rows() and stores
+ * the first |count| ones to |dst| */
+static __inline__ void
+sse2_store4( uint8_t*  dst, __m128i  p01, __m128i  p23,
+             const Sse2Swizzle*  sw, int  count )
+{
+    __m128i  p = _mm_packus_epi16(p01, p23);
+
+    if (sw->swizzle) {
+        __m128i  r = _mm_and_si128(_mm_srli_epi32(p, 16), sw->byte_mask);
+        __m128i  g = _mm_and_si128(_mm_srli_epi32(p,  8), sw->byte_mask);
+        __m128i  b = _mm_and_si128(p, sw->byte_mask);
+        __m128i  a = _mm_srli_epi32(p, 24);
+
+        p = _mm_or_si128(_mm_or_si128(_mm_sll_epi32(r, sw->r_shift),
+                                      _mm_sll_epi32(g, sw->g_shift)),
+                         _mm_or_si128(_mm_sll_epi32(b, sw->b_shift),
+                                      _mm_and_si128(_mm_sll_epi32(a, sw->a_shift),
+                                                    sw->a_mask)));
+    }
+
+    if (count >= 4) {
+        _mm_storeu_si128((__m128i*)dst, p);
+    } else {
+        uint32_t  tmp[4];
+        _mm_storeu_si128((__m128i*)tmp, p);
+        memcpy(dst, tmp, count*4);
+    }
+}
+
+/* returns the reduction factors, as ARGB_REDUCE() computes them from
+ * cross(), for the two pixels in |wx| and the row weight |wy|, each
+ * replicated in 4 16-bit words */
+static __inline__ __m128i
+sse2_box_weights( const uint64_t*  wx, __m128i  wy )
+{
+    /* cross(x,y) >> 8 == (x*y) >> 24, even for x == y == 65536 */
+    __m128i  w = _mm_srli_epi64(_mm_mul_epu32(_mm_loadu_si128((const __m128i*)wx), wy), 24);
+    return _mm_shufflehi_epi16(_mm_shufflelo_epi16(w, 0), 0);
+}
+
+static void
+scale_05_to_10_sse2( ScaleOp*   op )
+{
+    const BoxColumns*  cols = op->columns;
+    const __m128i      scale2 = _mm_set1_epi16((short)(int)(op->scale*op->scale*256));
+    Sse2Swizzle        sw;
+    int                y, x;
+
+    sse2_swizzle_init(&sw, op);
+
+    for (y = 0; y < op->rd.size.h; y++) {
+        int            sy  = op->sy + y*op->iy;
+        int            sy1 = sy & 0xffff;
+        int            sy2 = sy1 + op->iy;
+        int            fy2 = sy2 & 0xffff;
+        const uint8_t* src = op->src_line + (sy >> 16)*op->src_pitch;
+        uint8_t*       dst = op->dst_line + y*op->dst_pitch;
+        int            roff[3];
+        __m128i        wy[3];
+        int            r, c;
+
+        if (fy2 == 0)
+            fy2 = 65536;
+
+        /* same rows as in scale_05_to_10(), the third one may be empty */
+        roff[0] = 0;
+        wy[0]   = _mm_set1_epi32(65536 - sy1);
+        if (((sy1 >> 16) + 1) < ((sy2-1) >> 16)) {
+            roff[1] = op->src_pitch;
+            wy[1]   = _mm_set1_epi32(65536);
+            roff[2] = 2*op->src_pitch;
+            wy[2]   = _mm_set1_epi32(fy2);
+        } else {
+            roff[1] = op->src_pitch;
+            wy[1]   = _mm_set1_epi32(fy2);
+            roff[2] = op->src_pitch;
+            wy[2]   = _mm_setzero_si128();
+        }
+
+        for (x = 0; x < op->rd.size.w; x += 4, dst += 16) {
+            __m128i  p01 = _mm_setzero_si128();
+            __m128i  p23 = _mm_setzero_si128();
+
+            for (r = 0; r < 3; r++) {
+                const uint8_t*  s = src + roff[r];
+                for (c = 0; c < 3; c++) {
+                    const int32_t*   off = cols->off[c] + x;
+                    const uint64_t*  wx  = cols->weight[c] + x;
+                    __m128i  s01 = _mm_mullo_epi16(sse2_load2(s, off),
+                                                   sse2_box_weights(wx, wy[r]));
+                    __m128i  s23 = _mm_mullo_epi16(sse2_load2(s, off + 2),
+                                                   sse2_box_weights(wx + 2, wy[r]));
+                    p01 = _mm_add_epi16(p01, _mm_srli_epi16(s01, 8));
+                    p23 = _mm_add_epi16(p23, _mm_srli_epi16(s23, 8));
+                }
+            }
+            p01 = _mm_srli_epi16(_mm_mullo_epi16(p01, scale2), 8);
+            p23 = _mm_srli_epi16(_mm_mullo_epi16(p23, scale2), 8);
+
+            sse2_store4(dst, p01, p23, &sw, op->rd.size.w - x);
+        }
+    }
+}
+
+static void
+scale_up_bilinear_sse2( ScaleOp*  op )
+{
+    const BilinearColumns*  cols = op->columns;
+    int                     ylimit = op->src_h - 1;
+    Sse2Swizzle             sw;
+    int                     y, x;
+
+    sse2_swizzle_init(&sw, op);
+
+    for (y = 0; y < op->rd.size.h; y++) {
+        int             sy  = op->sy + op->iy/2 - 32768 + y*op->iy;
+        int             ey1 = (sy >> 16);
+        int             ey2 = (sy+65535) >> 16;
+        __m128i         alpha = _mm_set1_epi16((sy >> 8) & 0xff);
+        const uint8_t*  src1;
+        const uint8_t*  src2;
+        uint8_t*        dst = op->dst_line + y*op->dst_pitch;
+
+        if (ey1 < 0) ey1 = 0; else if (ey1 > ylimit) ey1 = ylimit;
+        if (ey2 < 0) ey2 = 0; else if (ey2 > ylimit) ey2 = ylimit;
+
+        src1 = op->src_line + ey1*op->src_pitch;
+        src2 = op->src_line + ey2*op->src_pitch;
+
+        for (x = 0; x < op->rd.size.w; x += 4, dst += 16) {
+            __m128i  ax01 = _mm_loadu_si128((const __m128i*)(cols->alpha + x));
+            __m128i  ax23 = _mm_loadu_si128((const __m128i*)(cols->alpha + x + 2));
+            __m128i  top, bottom, p01, p23;
+
+            top    = sse2_interp255(sse2_load2(src1, cols->off1 + x),
+                                    sse2_load2(src1, cols->off2 + x), ax01);
+            bottom = sse2_interp255(sse2_load2(src2, cols->off1 + x),
+                                    sse2_load2(src2, cols->off2 + x), ax01);
+            p01    = sse2_interp255(top, bottom, alpha);
+
+            top    = sse2_interp255(sse2_load2(src1, cols->off1 + x + 2),
+                                    sse2_load2(src1, cols->off2 + x + 2), ax23);
+            bottom = sse2_interp255(sse2_load2(src2, cols->off1 + x + 2),
+                                    sse2_load2(src2, cols->off2 + x + 2), ax23);
+            p23    = sse2_interp255(top, bottom, alpha);
+
+            sse2_store4(dst, p01, p23, &sw, op->rd.size.w - x);
+        }
+    }
+}
+
+#endif /* SCALER_HAVE_SSE2 */
+
+/* Large rectangles are split into bands of rows, which can be scaled in
+ * parallel since each destination row only depends on the source. */
+#define  SCALER_BAND_MIN_PIXELS   (128*1024)
+#define  SCALER_BAND_MIN_ROWS     16
+
+typedef struct {
+    const ScaleOp*  op;
+    void          (*scale)( ScaleOp*  op );
+    int             swizzle;    /* reorder channels after scaling */
+    int             bands;
+} ScaleJob;
+
+static void
+scale_band( void*  opaque, int  band )
+{
+    const ScaleJob*  job = opaque;
+    ScaleOp          op  = job->op[0];
+    int              y0  = op.rd.size.h * band / job->bands;
+    int              y1  = op.rd.size.h * (band + 1) / job->bands;
+
+    op.rd.pos.y  += y0;
+    op.rd.size.h  = y1 - y0;
+    op.sy        += y0 * op.iy;
+    op.dst_line  += y0 * op.dst_pitch;
+
+    job->scale(&op);
+    if (job->swizzle)
+        swizzle_rows(&op);
+}
+
 void
 skin_scaler_scale( SkinScaler*   scaler,
                    const SkinSurfacePixels* dst_pix,
@@ -120,6 +538,7 @@ skin_scaler_scale( SkinScaler*   scaler,
                    const SkinRect* src_rect)
 {
     ScaleOp   op;
+    ScaleJob  job;
 
     if ( !scaler->valid ) {
         return;
@@ -147,38 +566,55 @@ skin_scaler_scale( SkinScaler*   scaler,
 
         op.dst_line += op.rd.pos.x * 4 + op.rd.pos.y * op.dst_pitch;
 
-        if (op.scale >= 0.5 && op.scale <= 1.0)
-            scale_05_to_10( &op );
-        else if (op.scale > 1.0)
-            scale_up_bilinear( &op );
-        else
-            scale_generic( &op );
+        op.swizzle = (dst_format->r_shift != 16 ||
+                      dst_format->g_shift !=  8 ||
+                      dst_format->b_shift !=  0);
+        op.r_shift = dst_format->r_shift;
+        op.g_shift = dst_format->g_shift;
+        op.b_shift = dst_format->b_shift;
+        op.a_shift = dst_format->a_shift;
+        op.a_mask  = dst_format->a_mask;
+        op.columns = NULL;
     }
 
-    // The optimized scale functions in argb.h assume the destination is ARGB.
-    // If that's not the case, do a channel reorder now.
-    if (dst_format->r_shift != 16 ||
-        dst_format->g_shift !=  8 ||
-        dst_format->b_shift !=  0)
-    {
-        uint32_t rshift = dst_format->r_shift;
-        uint32_t gshift = dst_format->g_shift;
-        uint32_t bshift = dst_format->b_shift;
-        uint32_t ashift = dst_format->a_shift;
-        uint32_t amask  = dst_format->a_mask; // may be 0x00
-        int x, y;
-
-        for (y = 0; y < op.rd.size.h; y++)
-        {
-            uint32_t* line = (uint32_t*)(op.dst_line + y*op.dst_pitch);
-            for (x = 0; x < op.rd.size.w; x++) {
-                uint32_t r = (line[x] & 0x00ff0000) >> 16;
-                uint32_t g = (line[x] & 0x0000ff00) >>  8;
-                uint32_t b = (line[x] & 0x000000ff) >>  0;
-                uint32_t a = (line[x] & 0xff000000) >> 24;
-                line[x] = (r << rshift) | (g << gshift) | (b << bshift) |
-                          ((a << ashift) & amask);
-            }
+    if (op.rd.size.w <= 0 || op.rd.size.h <= 0) {
+        return;
+    }
+
+    job.op      = &op;
+    job.swizzle = op.swizzle;
+
+    if (op.scale >= 0.5 && op.scale <= 1.0)
+        job.scale = scale_05_to_10;
+    else if (op.scale > 1.0)
+        job.scale = scale_up_bilinear;
+    else
+        job.scale = scale_generic;
+
+#ifdef SCALER_HAVE_SSE2
+    /* the SSE2 kernels reorder the channels themselves */
+    if (scaler->use_simd) {
+        if (job.scale == scale_05_to_10) {
+            op.columns  = box_columns_init(scaler, &op);
+            job.scale   = scale_05_to_10_sse2;
+            job.swizzle = 0;
+        } else if (job.scale == scale_up_bilinear) {
+            op.columns  = bilinear_columns_init(scaler, &op);
+            job.scale   = scale_up_bilinear_sse2;
+            job.swizzle = 0;
         }
     }
+#endif
+
+    job.bands = 1;
+    if (scaler->workers &&
+        op.rd.size.w * op.rd.size.h >= SCALER_BAND_MIN_PIXELS) {
+        job.bands = scaler->threads;
+        if (job.bands > op.rd.size.h / SCALER_BAND_MIN_ROWS)
+            job.bands = op.rd.size.h / SCALER_BAND_MIN_ROWS;
+        if (job.bands < 1)
+            job.bands = 1;
+    }
+
+    skin_scaler_workers_run(scaler->workers, job.bands, scale_band, &job);
 }
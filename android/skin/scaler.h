@@ -14,6 +14,9 @@
 
 #include "android/skin/image.h"
 #include "android/skin/surface.h"
+#include "android/utils/compiler.h"
+
+ANDROID_BEGIN_HEADER
 
 typedef struct SkinScaler   SkinScaler;
 
@@ -28,6 +31,15 @@ extern int          skin_scaler_set( SkinScaler*  scaler,
                                      double       xDisp,
                                      double       yDisp );
 
+/* set the number of threads used to scale large rectangles, including the
+ * calling one. by default, one per host CPU, up to 4. if |threads| is less
+ * than 2, everything happens in the calling thread. */
+extern void         skin_scaler_set_threads( SkinScaler*  scaler, int  threads );
+
+/* enable or disable the SIMD scaling kernels, which are used by default when
+ * the host supports them. they produce the same pixels as the generic ones. */
+extern void         skin_scaler_set_simd( SkinScaler*  scaler, int  enable );
+
 /* Compute inverse scaled coordinates.
  * On input, |*x| and |*y| contain scaled coordinates in pixels.
  * On output, |*x| and |*y| contain the corresponding unscaled coordinates
@@ -60,4 +72,6 @@ extern void         skin_scaler_scale( SkinScaler* scaler,
                                        const SkinSurfacePixels* src_pix,
                                        const SkinRect* src_rect);
 
+ANDROID_END_HEADER
+
 #endif /* _ANDROID_SKIN_SCALER_H */
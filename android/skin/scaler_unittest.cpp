@@ -0,0 +1,124 @@
+/* Copyright (C) 2015 The Android Open Source Project
+**
+** This software is licensed under the terms of the GNU General Public
+** License version 2, as published by the Free Software Foundation, and
+** may be copied, distributed, and modified under those terms.
+**
+** This program is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+** GNU General Public License for more details.
+*/
+#include "android/skin/scaler.h"
+
+#include <gtest/gtest.h>
+
+#include <vector>
+
+#define ARRAYLEN(x)  (sizeof(x)/sizeof((x)[0]))
+
+namespace android_skin {
+
+namespace {
+
+// The scaler may read slightly past the source rectangle, like the
+// original implementation, so keep some margin around it.
+const int kMargin = 4;
+
+struct Surface {
+    Surface(int w, int h) : pixels((w + kMargin) * (h + kMargin)) {
+        pix.w = w;
+        pix.h = h;
+        pix.pitch = (w + kMargin) * 4;
+        pix.pixels = &pixels[0];
+    }
+
+    std::vector<uint32_t> pixels;
+    SkinSurfacePixels pix;
+};
+
+void fillRandom(std::vector<uint32_t>* pixels) {
+    uint32_t state = 1;
+    for (size_t n = 0; n < pixels->size(); ++n) {
+        state = state * 1103515245U + 12345U;
+        uint32_t hi = state >> 16;
+        state = state * 1103515245U + 12345U;
+        (*pixels)[n] = (hi << 16) | (state >> 16);
+    }
+}
+
+const SkinSurfacePixelFormat kARGB = {
+    16, 0x00ff0000, 8, 0x0000ff00, 0, 0x000000ff, 24, 0xff000000,
+};
+
+const SkinSurfacePixelFormat kABGR = {
+    0, 0x000000ff, 8, 0x0000ff00, 16, 0x00ff0000, 24, 0xff000000,
+};
+
+const SkinSurfacePixelFormat kXBGR = {
+    0, 0x000000ff, 8, 0x0000ff00, 16, 0x00ff0000, 24, 0x00000000,
+};
+
+// Scales |src| into a new destination surface, and returns its pixels.
+std::vector<uint32_t> scale(double factor,
+                            int threads,
+                            bool simd,
+                            const SkinSurfacePixelFormat& format,
+                            Surface* src) {
+    SkinScaler* scaler = skin_scaler_create();
+    skin_scaler_set(scaler, factor, 0., 0.);
+    skin_scaler_set_threads(scaler, threads);
+    skin_scaler_set_simd(scaler, simd ? 1 : 0);
+
+    SkinRect srect = { { 0, 0 }, { src->pix.w, src->pix.h } };
+    SkinRect drect;
+    skin_scaler_get_scaled_rect(scaler, &srect, &drect);
+
+    Surface dst(drect.pos.x + drect.size.w, drect.pos.y + drect.size.h);
+    skin_scaler_scale(scaler, &dst.pix, &format, &src->pix, &srect);
+    skin_scaler_free(scaler);
+    return dst.pixels;
+}
+
+const double kFactors[] = { 0.3, 0.5, 0.6, 0.75, 0.9, 1.0, 1.25, 1.5, 2.0, 2.7 };
+
+}  // namespace
+
+TEST(scaler, SimdMatchesGeneric) {
+    const SkinSurfacePixelFormat* kFormats[] = { &kARGB, &kABGR, &kXBGR };
+    Surface src(61, 37);
+    fillRandom(&src.pixels);
+
+    for (size_t f = 0; f < ARRAYLEN(kFactors); ++f) {
+        for (size_t n = 0; n < ARRAYLEN(kFormats); ++n) {
+            std::vector<uint32_t> expected =
+                    scale(kFactors[f], 1, false, *kFormats[n], &src);
+            std::vector<uint32_t> actual =
+                    scale(kFactors[f], 1, true, *kFormats[n], &src);
+            ASSERT_EQ(expected.size(), actual.size());
+            for (size_t i = 0; i < expected.size(); ++i) {
+                ASSERT_EQ(expected[i], actual[i])
+                        << "factor " << kFactors[f] << " format " << n
+                        << " pixel " << i;
+            }
+        }
+    }
+}
+
+TEST(scaler, BandsMatchSingleThread) {
+    Surface src(500, 400);
+    fillRandom(&src.pixels);
+
+    for (size_t f = 0; f < ARRAYLEN(kFactors); ++f) {
+        for (int simd = 0; simd < 2; ++simd) {
+            std::vector<uint32_t> expected =
+                    scale(kFactors[f], 1, simd != 0, kABGR, &src);
+            std::vector<uint32_t> actual =
+                    scale(kFactors[f], 4, simd != 0, kABGR, &src);
+            EXPECT_TRUE(expected == actual)
+                    << "factor " << kFactors[f] << " simd " << simd;
+        }
+    }
+}
+
+}  // namespace android_skin
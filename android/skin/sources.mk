@@ -19,6 +19,7 @@ ANDROID_SKIN_SOURCES := \
     android/skin/window.c \
     android/skin/resource.c \
     android/skin/scaler.c \
+    android/skin/scaler-workers.cpp \
     android/skin/ui.c \
 
 ifdef EMULATOR_USE_SDL2
@@ -470,10 +470,14 @@ void skin_ui_update_display(SkinUI* ui, int x, int y, int w, int h) {
     }
 }
 
-void skin_ui_update_gpu_frame(SkinUI* ui, int w, int h, const void* pixels) {
-    if (ui->window) {
-        skin_window_update_gpu_frame(ui->window, w, h, pixels);
+int skin_ui_update_gpu_frame(SkinUI* ui, int w, int h, const void* pixels,
+                             int dirty_x, int dirty_y,
+                             int dirty_w, int dirty_h) {
+    if (!ui->window) {
+        return 0;
     }
+    return skin_window_update_gpu_frame(ui->window, w, h, pixels,
+                                        dirty_x, dirty_y, dirty_w, dirty_h);
 }
 
 SkinLayout* skin_ui_get_current_layout(SkinUI* ui) {
@@ -117,7 +117,12 @@ void skin_ui_set_scale(SkinUI* ui, double scale);
 
 void skin_ui_update_display(SkinUI* ui, int x, int y, int w, int h);
 
-void skin_ui_update_gpu_frame(SkinUI* ui, int w, int h, const void* pixels);
+// Update the display with a new frame of |w| x |h| GL_RGBA pixels from the
+// emulated GPU. Only the dirty rectangle is converted and redrawn.
+// Returns 0 if the frame could not be displayed, 1 otherwise.
+int skin_ui_update_gpu_frame(SkinUI* ui, int w, int h, const void* pixels,
+                             int dirty_x, int dirty_y,
+                             int dirty_w, int dirty_h);
 
 // Return the current SkinLayout used by the user interface.
 struct SkinLayout* skin_ui_get_current_layout(SkinUI* ui);
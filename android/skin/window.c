@@ -1743,38 +1743,68 @@ skin_window_update_display( SkinWindow*  window, int  x, int  y, int  w, int  h
 }
 
 
-void skin_window_update_gpu_frame(SkinWindow* window,
-                                  int w,
-                                  int h,
-                                  const void* pixels) {
+int skin_window_update_gpu_frame(SkinWindow* window,
+                                 int w,
+                                 int h,
+                                 const void* pixels,
+                                 int dirty_x,
+                                 int dirty_y,
+                                 int dirty_w,
+                                 int dirty_h) {
     if (!window) {
-        return;
+        return 0;
     }
 
     ADisplay* disp = skin_window_display(window);
     if (!disp || disp->datasize.w != w || disp->datasize.h != h) {
         fprintf(stderr, "%s: bad values!\n", __FUNCTION__);
-        return;
+        return 0;
     }
 
     if (!disp->gpu_frame) {
         disp->gpu_frame = calloc(w * 4, h);
         if (!disp->gpu_frame) {
-            return;
+            return 0;
         }
+        // Nothing was converted yet.
+        dirty_x = dirty_y = 0;
+        dirty_w = w;
+        dirty_h = h;
+    }
+    // Never trust the rectangle to fit in the frame.
+    if (dirty_x < 0) {
+        dirty_w += dirty_x;
+        dirty_x = 0;
     }
-    // Convert from GL_RGBA to 32-bit ARGB.
+    if (dirty_y < 0) {
+        dirty_h += dirty_y;
+        dirty_y = 0;
+    }
+    if (dirty_w > w - dirty_x) {
+        dirty_w = w - dirty_x;
+    }
+    if (dirty_h > h - dirty_y) {
+        dirty_h = h - dirty_y;
+    }
+    if (dirty_w <= 0 || dirty_h <= 0) {
+        return 1;
+    }
+    // Convert the dirty rectangle from GL_RGBA to 32-bit ARGB.
     {
-        const uint8_t* src = pixels;
-        uint32_t* dst = (uint32_t*)disp->gpu_frame;
-        uint32_t* dst_end = dst + w * h;
-        for (; dst < dst_end; src += 4, dst += 1) {
-            dst[0] = ((uint32_t)src[3] << 24) |
-                     ((uint32_t)src[0] << 16) |
-                     ((uint32_t)src[1] << 8) |
-                      (uint32_t)src[2];
+        int y;
+        for (y = dirty_y; y < dirty_y + dirty_h; y++) {
+            const uint8_t* src = (const uint8_t*)pixels + (y * w + dirty_x) * 4;
+            uint32_t* dst = (uint32_t*)disp->gpu_frame + y * w + dirty_x;
+            uint32_t* dst_end = dst + dirty_w;
+            for (; dst < dst_end; src += 4, dst += 1) {
+                dst[0] = ((uint32_t)src[3] << 24) |
+                         ((uint32_t)src[0] << 16) |
+                         ((uint32_t)src[1] << 8) |
+                          (uint32_t)src[2];
+            }
         }
     }
 
-    skin_window_update_display(window, 0, 0, w, h);
+    skin_window_update_display(window, dirty_x, dirty_y, dirty_w, dirty_h);
+    return 1;
 }
@@ -83,6 +83,8 @@ typedef struct {
 extern void             skin_window_get_display( SkinWindow*  window, ADisplayInfo  *info );
 extern void             skin_window_update_display( SkinWindow*  window, int  x, int  y, int  w, int  h );
 
-extern void skin_window_update_gpu_frame(SkinWindow* window, int w, int h, const void* pixels);
+/* returns 0 if the frame does not fit the display, 1 otherwise */
+extern int skin_window_update_gpu_frame(SkinWindow* window, int w, int h, const void* pixels,
+                                        int dirty_x, int dirty_y, int dirty_w, int dirty_h);
 
 #endif /* _SKIN_WINDOW_H */
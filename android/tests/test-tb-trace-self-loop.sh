@@ -0,0 +1,61 @@
+#!/bin/sh
+
+# This test is designed to check that forming traces does not corrupt the
+# translation block jump lists.
+#
+# With '-tb-trace 1', a block is translated again as a trace the first time
+# it is executed again. A block that jumps back to its own start, like the
+# guest kernel's delay loops, is then replaced by a trace while cpu_exec()
+# is about to chain it to its replacement.
+#
+# The code buffer is split into regions of at least 6 MB, which are evicted
+# and reused one at a time once the buffer is full. Below 12 MB there is a
+# single region, and the whole buffer is flushed instead. '-tb-size 48' is
+# the smallest buffer with the maximum of 8 regions, so that they are reused
+# as often as possible. Any stale jump list then crashes or hangs the
+# emulator before the guest boots.
+#
+# This needs a full guest boot because the tree has no harness to run the
+# translator on its own.
+#
+# Usage: test-tb-trace-self-loop.sh <avd-name>
+# Only meaningful for ARM system images. Set EMULATOR to the emulator
+# binary to test, and BOOT_TIMEOUT to the number of seconds to wait for
+# the guest to boot (default 600). Exits with a non-zero status on failure.
+
+die () {
+  echo "ERROR: $@"
+  exit 1
+}
+
+AVD=${1:-$ANDROID_AVD}
+if [ -z "$AVD" ]; then
+  die "Usage: $0 <avd-name>"
+fi
+
+EMULATOR=${EMULATOR:-emulator}
+BOOT_TIMEOUT=${BOOT_TIMEOUT:-600}
+EMULATOR_PORT=5580
+ANDROID_SERIAL=emulator-$EMULATOR_PORT
+export ANDROID_SERIAL
+
+"$EMULATOR" -avd "$AVD" -port $EMULATOR_PORT -no-window -no-audio \
+    -no-snapshot -qemu -tb-trace 1 -tb-size 48 &
+EMULATOR_PID=$!
+trap 'kill $EMULATOR_PID 2>/dev/null' EXIT
+
+ELAPSED=0
+while [ "$(adb shell getprop sys.boot_completed 2>/dev/null | tr -d '\r')" != "1" ]; do
+  if ! kill -0 $EMULATOR_PID 2>/dev/null; then
+    wait $EMULATOR_PID
+    die "Emulator exited with status $? before the guest booted"
+  fi
+  if [ $ELAPSED -ge $BOOT_TIMEOUT ]; then
+    die "Guest did not boot in $BOOT_TIMEOUT seconds"
+  fi
+  sleep 5
+  ELAPSED=$((ELAPSED + 5))
+done
+
+echo "OK"
+exit 0
@@ -31,6 +31,10 @@ ANDROID_BEGIN_HEADER
 #define CPUID_ECX_SSE41    (1 << 19)
 #define CPUID_ECX_SSE42    (1 << 20)
 #define CPUID_ECX_POPCNT   (1 << 23)
+#define CPUID_ECX_OSXSAVE  (1 << 27)
+#define CPUID_ECX_AVX      (1 << 28)
+/* Applicable when calling CPUID with EAX=7 and ECX=0 */
+#define CPUID_EBX_AVX2     (1 << 5)
 
 /*
  * android_get_x86_cpuid: retrieve x86 CPUID for host CPU.
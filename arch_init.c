@@ -43,6 +43,13 @@
 #include "exec/gdbstub.h"
 #include "exec/ram_addr.h"
 #include "hw/i386/smbios.h"
+#include "block/block.h"
+#include "exec/hax.h"
+#include "qemu/error-report.h"
+#include "qemu/thread.h"
+#include "qemu/timer.h"
+
+#include <zlib.h>
 
 #ifdef TARGET_SPARC
 int graphic_width = 1024;
@@ -94,14 +101,44 @@ const uint32_t arch_type = QEMU_ARCH;
 #define RAM_SAVE_FLAG_PAGE     0x08
 #define RAM_SAVE_FLAG_EOS      0x10
 #define RAM_SAVE_FLAG_CONTINUE 0x20
+#define RAM_SAVE_FLAG_BATCH    0x40 /* Since version 5 */
+
+/* Version 5 streams send dirty pages in batches of up to RAM_BATCH_SIZE
+ * bytes of the same RAMBlock. Each batch is encoded as:
+ *
+ *   be64  offset of the first page | flags
+ *   [idstr, if RAM_SAVE_FLAG_CONTINUE is not set]
+ *   be16  page count
+ *   for each page:
+ *     be32  page index relative to the first page
+ *     byte  RAM_BATCH_PAGE_DATA, RAM_BATCH_PAGE_FILL followed by the
+ *           byte value the page is filled with, or RAM_BATCH_PAGE_COPY
+ *           followed by the be16 number of an earlier data page of the
+ *           batch with the same contents
+ *   byte  RAM_BATCH_ENCODING_RAW or RAM_BATCH_ENCODING_ZLIB
+ *   be32  payload length
+ *   payload, i.e. the contents of all data pages, in order
+ *
+ * Batches are scanned and compressed by a pool of worker threads, and
+ * written to (or applied from) the stream in order by the main thread.
+ */
+#define RAM_BATCH_SIZE          (256 * 1024)
+#define RAM_BATCH_PAGES         (RAM_BATCH_SIZE / TARGET_PAGE_SIZE)
+#define RAM_BATCH_PAGE_DATA     0
+#define RAM_BATCH_PAGE_FILL     1
+#define RAM_BATCH_PAGE_COPY     2
+#define RAM_BATCH_ENCODING_RAW  0
+#define RAM_BATCH_ENCODING_ZLIB 1
+
+#define RAM_JOB_MAX_THREADS  16
 
 static int is_dup_page(uint8_t *page, uint8_t ch)
 {
-    uint32_t val = ch << 24 | ch << 16 | ch << 8 | ch;
-    uint32_t *array = (uint32_t *)page;
+    unsigned long val = (unsigned long)-1 / 0xff * ch;
+    unsigned long *array = (unsigned long *)page;
     int i;
 
-    for (i = 0; i < (TARGET_PAGE_SIZE / 4); i++) {
+    for (i = 0; i < (TARGET_PAGE_SIZE / sizeof(val)); i++) {
         if (array[i] != val) {
             return 0;
         }
@@ -110,56 +147,339 @@ static int is_dup_page(uint8_t *page, uint8_t ch)
     return 1;
 }
 
+typedef enum {
+    RAM_JOB_IDLE = 0,
+    RAM_JOB_QUEUED,
+    RAM_JOB_RUNNING,
+    RAM_JOB_DONE,
+} RamJobState;
+
+typedef struct RamJob {
+    RamJobState state;
+    int error;
+    uint8_t *host;                  /* host address of the first page */
+    ram_addr_t offset;              /* offset of the first page in block */
+    RAMBlock *block;
+    int cont;
+    int count;
+    int data_count;
+    uint32_t index[RAM_BATCH_PAGES];
+    uint8_t kind[RAM_BATCH_PAGES];
+    uint8_t fill[RAM_BATCH_PAGES];
+    uint16_t source[RAM_BATCH_PAGES];   /* data page copied by COPY pages */
+    int encoding;
+    uLongf payload_len;
+    uint8_t *raw;                   /* RAM_BATCH_PAGES pages */
+    uint8_t *zbuf;                  /* compressBound() of the above */
+} RamJob;
+
+typedef struct RamJobPool {
+    QemuMutex lock;
+    QemuCond work_cond;
+    QemuCond done_cond;
+    QemuThread *threads;
+    int nb_threads;
+    bool quit;
+    void (*work)(RamJob *job);
+    RamJob *jobs;
+    int nb_jobs;                    /* twice the number of threads */
+    int head;                       /* oldest submitted job */
+    int count;                      /* number of submitted jobs */
+} RamJobPool;
+
+/* One worker thread per host CPU. */
+static int ram_job_threads(void)
+{
+    int n;
+
+#ifdef _WIN32
+    SYSTEM_INFO system_info;
+
+    GetSystemInfo(&system_info);
+    n = system_info.dwNumberOfProcessors;
+#else
+    n = sysconf(_SC_NPROCESSORS_ONLN);
+#endif
+    return MAX(1, MIN(n, RAM_JOB_MAX_THREADS));
+}
+
+static uLong ram_job_zbuf_size(void)
+{
+    return compressBound(RAM_BATCH_PAGES * TARGET_PAGE_SIZE);
+}
+
+static void *ram_job_thread(void *opaque)
+{
+    RamJobPool *pool = opaque;
+
+    qemu_mutex_lock(&pool->lock);
+    for (;;) {
+        RamJob *job = NULL;
+        int n;
+
+        for (n = 0; n < pool->count; n++) {
+            RamJob *candidate = &pool->jobs[(pool->head + n) % pool->nb_jobs];
+            if (candidate->state == RAM_JOB_QUEUED) {
+                job = candidate;
+                break;
+            }
+        }
+        if (!job) {
+            if (pool->quit) {
+                break;
+            }
+            qemu_cond_wait(&pool->work_cond, &pool->lock);
+            continue;
+        }
+        job->state = RAM_JOB_RUNNING;
+        qemu_mutex_unlock(&pool->lock);
+
+        pool->work(job);
+
+        qemu_mutex_lock(&pool->lock);
+        job->state = RAM_JOB_DONE;
+        qemu_cond_broadcast(&pool->done_cond);
+    }
+    qemu_mutex_unlock(&pool->lock);
+    return NULL;
+}
+
+static RamJobPool *ram_job_pool_new(void (*work)(RamJob *job))
+{
+    RamJobPool *pool = g_malloc0(sizeof(*pool));
+    int n;
+
+    qemu_mutex_init(&pool->lock);
+    qemu_cond_init(&pool->work_cond);
+    qemu_cond_init(&pool->done_cond);
+    pool->work = work;
+    pool->nb_threads = ram_job_threads();
+    pool->threads = g_new0(QemuThread, pool->nb_threads);
+    pool->nb_jobs = 2 * pool->nb_threads;
+    pool->jobs = g_new0(RamJob, pool->nb_jobs);
+    for (n = 0; n < pool->nb_jobs; n++) {
+        pool->jobs[n].raw = g_malloc(RAM_BATCH_PAGES * TARGET_PAGE_SIZE);
+        pool->jobs[n].zbuf = g_malloc(ram_job_zbuf_size());
+    }
+    for (n = 0; n < pool->nb_threads; n++) {
+        qemu_thread_create(&pool->threads[n], ram_job_thread, pool,
+                           QEMU_THREAD_JOINABLE);
+    }
+    return pool;
+}
+
+/* Must only be called once all submitted jobs have been popped. */
+static void ram_job_pool_free(RamJobPool *pool)
+{
+    int n;
+
+    if (!pool) {
+        return;
+    }
+    qemu_mutex_lock(&pool->lock);
+    pool->quit = true;
+    qemu_cond_broadcast(&pool->work_cond);
+    qemu_mutex_unlock(&pool->lock);
+    for (n = 0; n < pool->nb_threads; n++) {
+        qemu_thread_join(&pool->threads[n]);
+    }
+    for (n = 0; n < pool->nb_jobs; n++) {
+        g_free(pool->jobs[n].raw);
+        g_free(pool->jobs[n].zbuf);
+    }
+    g_free(pool->jobs);
+    g_free(pool->threads);
+    qemu_cond_destroy(&pool->done_cond);
+    qemu_cond_destroy(&pool->work_cond);
+    qemu_mutex_destroy(&pool->lock);
+    g_free(pool);
+}
+
+static bool ram_job_pool_full(RamJobPool *pool)
+{
+    return pool->count == pool->nb_jobs;
+}
+
+/* Returns the job to fill before calling ram_job_pool_submit() */
+static RamJob *ram_job_pool_next(RamJobPool *pool)
+{
+    RamJob *job = &pool->jobs[(pool->head + pool->count) % pool->nb_jobs];
+
+    job->error = 0;
+    job->count = 0;
+    job->data_count = 0;
+    return job;
+}
+
+static void ram_job_pool_submit(RamJobPool *pool)
+{
+    qemu_mutex_lock(&pool->lock);
+    pool->jobs[(pool->head + pool->count) % pool->nb_jobs].state =
+            RAM_JOB_QUEUED;
+    pool->count++;
+    qemu_cond_signal(&pool->work_cond);
+    qemu_mutex_unlock(&pool->lock);
+}
+
+/* Waits for the oldest submitted job to complete, and returns it. */
+static RamJob *ram_job_pool_oldest(RamJobPool *pool)
+{
+    RamJob *job = &pool->jobs[pool->head];
+
+    qemu_mutex_lock(&pool->lock);
+    while (job->state != RAM_JOB_DONE) {
+        qemu_cond_wait(&pool->done_cond, &pool->lock);
+    }
+    qemu_mutex_unlock(&pool->lock);
+    return job;
+}
+
+static void ram_job_pool_pop(RamJobPool *pool)
+{
+    pool->jobs[pool->head].state = RAM_JOB_IDLE;
+    pool->head = (pool->head + 1) % pool->nb_jobs;
+    pool->count--;
+}
+
+static uint32_t ram_page_hash(const uint8_t *page)
+{
+    const uint32_t *words = (const uint32_t *)page;
+    uint32_t hash = 0;
+    int i;
+
+    for (i = 0; i < TARGET_PAGE_SIZE / sizeof(*words); i++) {
+        hash = (hash * 31) ^ words[i];
+    }
+    return hash;
+}
+
+/* Returns the number of an earlier data page of |job| with the same
+ * contents as |page|, or -1. */
+static int ram_save_job_find_copy(RamJob *job, const uint32_t *hashes,
+                                  uint32_t hash, const uint8_t *page)
+{
+    int n;
+
+    for (n = 0; n < job->data_count; n++) {
+        if (hashes[n] == hash &&
+            !memcmp(job->raw + n * TARGET_PAGE_SIZE, page, TARGET_PAGE_SIZE)) {
+            return n;
+        }
+    }
+    return -1;
+}
+
+/* Worker side of ram_save_live(): classify and compress the pages of a
+ * batch. */
+static void ram_save_job_work(RamJob *job)
+{
+    uint32_t hashes[RAM_BATCH_PAGES];
+    int n;
+
+    for (n = 0; n < job->count; n++) {
+        uint8_t *p = job->host + (ram_addr_t)job->index[n] * TARGET_PAGE_SIZE;
+        uint32_t hash;
+        int copy;
+
+        if (is_dup_page(p, *p)) {
+            job->kind[n] = RAM_BATCH_PAGE_FILL;
+            job->fill[n] = *p;
+            continue;
+        }
+        hash = ram_page_hash(p);
+        copy = ram_save_job_find_copy(job, hashes, hash, p);
+        if (copy >= 0) {
+            job->kind[n] = RAM_BATCH_PAGE_COPY;
+            job->source[n] = copy;
+        } else {
+            job->kind[n] = RAM_BATCH_PAGE_DATA;
+            memcpy(job->raw + job->data_count * TARGET_PAGE_SIZE, p,
+                   TARGET_PAGE_SIZE);
+            hashes[job->data_count++] = hash;
+        }
+    }
+
+    job->encoding = RAM_BATCH_ENCODING_RAW;
+    job->payload_len = job->data_count * TARGET_PAGE_SIZE;
+    if (job->data_count) {
+        uLongf zlen = ram_job_zbuf_size();
+        if (compress2(job->zbuf, &zlen, job->raw, job->payload_len,
+                      Z_BEST_SPEED) == Z_OK && zlen < job->payload_len) {
+            job->encoding = RAM_BATCH_ENCODING_ZLIB;
+            job->payload_len = zlen;
+        }
+    }
+}
+
 static RAMBlock *last_block;
 static ram_addr_t last_offset;
+static uint64_t bytes_transferred;
+static RamJobPool *ram_save_pool;
 
+static void ram_save_job_write(QEMUFile *f, RamJob *job)
+{
+    const uint8_t *payload = (job->encoding == RAM_BATCH_ENCODING_ZLIB) ?
+            job->zbuf : job->raw;
+    uint64_t bytes = 8;
+    int n;
+
+    qemu_put_be64(f, job->offset | job->cont | RAM_SAVE_FLAG_BATCH);
+    if (!job->cont) {
+        qemu_put_byte(f, strlen(job->block->idstr));
+        qemu_put_buffer(f, (uint8_t *)job->block->idstr,
+                        strlen(job->block->idstr));
+        bytes += 1 + strlen(job->block->idstr);
+    }
+    qemu_put_be16(f, job->count);
+    bytes += 2;
+    for (n = 0; n < job->count; n++) {
+        qemu_put_be32(f, job->index[n]);
+        qemu_put_byte(f, job->kind[n]);
+        bytes += 5;
+        if (job->kind[n] == RAM_BATCH_PAGE_FILL) {
+            qemu_put_byte(f, job->fill[n]);
+            bytes++;
+        } else if (job->kind[n] == RAM_BATCH_PAGE_COPY) {
+            qemu_put_be16(f, job->source[n]);
+            bytes += 2;
+        }
+    }
+    qemu_put_byte(f, job->encoding);
+    qemu_put_be32(f, job->payload_len);
+    qemu_put_buffer(f, payload, job->payload_len);
+    bytes += 5 + job->payload_len;
+
+    bytes_transferred += bytes;
+}
+
+/* Writes all pending batches to the stream, in order. */
+static void ram_save_flush(QEMUFile *f)
+{
+    while (ram_save_pool && ram_save_pool->count) {
+        ram_save_job_write(f, ram_job_pool_oldest(ram_save_pool));
+        ram_job_pool_pop(ram_save_pool);
+    }
+}
+
+/* Collects the next batch of dirty pages, and hands it to the worker
+ * threads. Returns the number of pages in the batch, 0 if there are no
+ * more dirty pages. */
 static int ram_save_block(QEMUFile *f)
 {
     RAMBlock *block = last_block;
     ram_addr_t offset = last_offset;
-    ram_addr_t current_addr;
-    int bytes_sent = 0;
+    ram_addr_t current_addr, start_addr;
+    RamJob *job;
 
     if (!block)
         block = QTAILQ_FIRST(&ram_list.blocks);
 
     current_addr = block->offset + offset;
+    start_addr = current_addr;
 
-    do {
-        if (cpu_physical_memory_get_dirty(current_addr, TARGET_PAGE_SIZE,
+    /* Find the first dirty page. */
+    while (!cpu_physical_memory_get_dirty(current_addr, TARGET_PAGE_SIZE,
                                           DIRTY_MEMORY_MIGRATION)) {
-            uint8_t *p;
-            int cont = (block == last_block) ? RAM_SAVE_FLAG_CONTINUE : 0;
-
-            cpu_physical_memory_reset_dirty(current_addr,
-                                            TARGET_PAGE_SIZE,
-                                            DIRTY_MEMORY_MIGRATION);
-
-            p = block->host + offset;
-
-            if (is_dup_page(p, *p)) {
-                qemu_put_be64(f, offset | cont | RAM_SAVE_FLAG_COMPRESS);
-                if (!cont) {
-                    qemu_put_byte(f, strlen(block->idstr));
-                    qemu_put_buffer(f, (uint8_t *)block->idstr,
-                                    strlen(block->idstr));
-                }
-                qemu_put_byte(f, *p);
-                bytes_sent = 1;
-            } else {
-                qemu_put_be64(f, offset | cont | RAM_SAVE_FLAG_PAGE);
-                if (!cont) {
-                    qemu_put_byte(f, strlen(block->idstr));
-                    qemu_put_buffer(f, (uint8_t *)block->idstr,
-                                    strlen(block->idstr));
-                }
-                qemu_put_buffer(f, p, TARGET_PAGE_SIZE);
-                bytes_sent = TARGET_PAGE_SIZE;
-            }
-
-            break;
-        }
-
         offset += TARGET_PAGE_SIZE;
         if (offset >= block->length) {
             offset = 0;
@@ -170,15 +490,54 @@ static int ram_save_block(QEMUFile *f)
 
         current_addr = block->offset + offset;
 
-    } while (current_addr != last_block->offset + last_offset);
+        if (current_addr == start_addr) {
+            return 0;
+        }
+    }
 
+    if (ram_job_pool_full(ram_save_pool)) {
+        ram_save_job_write(f, ram_job_pool_oldest(ram_save_pool));
+        ram_job_pool_pop(ram_save_pool);
+    }
+
+    job = ram_job_pool_next(ram_save_pool);
+    job->block = block;
+    job->host = block->host + offset;
+    job->offset = offset;
+    job->cont = (block == last_block) ? RAM_SAVE_FLAG_CONTINUE : 0;
+
+    /* Collect the following dirty pages of the same block. */
+    for (; offset < block->length && job->count < RAM_BATCH_PAGES;
+         offset += TARGET_PAGE_SIZE) {
+        current_addr = block->offset + offset;
+        if (!cpu_physical_memory_get_dirty(current_addr, TARGET_PAGE_SIZE,
+                                           DIRTY_MEMORY_MIGRATION)) {
+            continue;
+        }
+        cpu_physical_memory_reset_dirty(current_addr, TARGET_PAGE_SIZE,
+                                        DIRTY_MEMORY_MIGRATION);
+        job->index[job->count++] = (offset - job->offset) / TARGET_PAGE_SIZE;
+        last_offset = offset;
+    }
     last_block = block;
-    last_offset = offset;
 
-    return bytes_sent;
+    ram_job_pool_submit(ram_save_pool);
+    return job->count;
 }
 
-static uint64_t bytes_transferred;
+/* Waits for all pending batches and releases the worker threads. */
+static void ram_save_cleanup(void)
+{
+    if (!ram_save_pool) {
+        return;
+    }
+    while (ram_save_pool->count) {
+        ram_job_pool_oldest(ram_save_pool);
+        ram_job_pool_pop(ram_save_pool);
+    }
+    ram_job_pool_free(ram_save_pool);
+    ram_save_pool = NULL;
+}
 
 static ram_addr_t ram_save_remaining(void)
 {
@@ -261,6 +620,7 @@ int ram_save_live(QEMUFile *f, int stage, void *opaque)
     uint64_t expected_time = 0;
 
     if (stage < 0) {
+        ram_save_cleanup();
         cpu_physical_memory_set_dirty_tracking(0);
         return 0;
     }
@@ -276,6 +636,9 @@ int ram_save_live(QEMUFile *f, int stage, void *opaque)
         last_block = NULL;
         last_offset = 0;
         sort_ram_list();
+        if (!ram_save_pool) {
+            ram_save_pool = ram_job_pool_new(ram_save_job_work);
+        }
 
         /* Make sure all dirty bits are set */
         QTAILQ_FOREACH(block, &ram_list.blocks, next) {
@@ -305,14 +668,11 @@ int ram_save_live(QEMUFile *f, int stage, void *opaque)
     bwidth = qemu_clock_get_ns(QEMU_CLOCK_REALTIME);
 
     while (!qemu_file_rate_limit(f)) {
-        int bytes_sent;
-
-        bytes_sent = ram_save_block(f);
-        bytes_transferred += bytes_sent;
-        if (bytes_sent == 0) { /* no more blocks */
+        if (ram_save_block(f) == 0) { /* no more blocks */
             break;
         }
     }
+    ram_save_flush(f);
 
     bwidth = qemu_clock_get_ns(QEMU_CLOCK_REALTIME) - bwidth;
     bwidth = (bytes_transferred - bytes_transferred_last) / bwidth;
@@ -325,12 +685,11 @@ int ram_save_live(QEMUFile *f, int stage, void *opaque)
 
     /* try transferring iterative blocks of memory */
     if (stage == 3) {
-        int bytes_sent;
-
         /* flush all remaining blocks regardless of rate limiting */
-        while ((bytes_sent = ram_save_block(f)) != 0) {
-            bytes_transferred += bytes_sent;
+        while (ram_save_block(f) != 0) {
         }
+        ram_save_flush(f);
+        ram_save_cleanup();
         cpu_physical_memory_set_dirty_tracking(0);
     }
 
@@ -371,14 +730,453 @@ static inline void *host_from_stream_offset(QEMUFile *f,
     return NULL;
 }
 
-int ram_load(QEMUFile *f, void *opaque, int version_id)
+static void ram_load_fill_page(void *host, uint8_t ch)
+{
+    memset(host, ch, TARGET_PAGE_SIZE);
+#ifndef _WIN32
+    if (ch == 0 &&
+        (!kvm_enabled() || kvm_has_sync_mmu())) {
+        qemu_madvise(host, TARGET_PAGE_SIZE, QEMU_MADV_DONTNEED);
+    }
+#endif
+}
+
+static RamJobPool *ram_load_pool;
+
+/* Worker side of ram_load(): decompress the data pages of a batch. */
+static void ram_load_job_work(RamJob *job)
+{
+    const uLongf expected = job->data_count * TARGET_PAGE_SIZE;
+    uLongf len = expected;
+
+    if (job->encoding != RAM_BATCH_ENCODING_ZLIB) {
+        return;
+    }
+    if (uncompress(job->raw, &len, job->zbuf, job->payload_len) != Z_OK ||
+        len != expected) {
+        job->error = -EIO;
+    }
+}
+
+static int ram_load_job_apply(RamJob *job)
+{
+    const uint8_t *src = job->raw;
+    int n;
+
+    if (job->error) {
+        return job->error;
+    }
+    for (n = 0; n < job->count; n++) {
+        uint8_t *host = job->host + (ram_addr_t)job->index[n] * TARGET_PAGE_SIZE;
+
+        if (job->kind[n] == RAM_BATCH_PAGE_FILL) {
+            ram_load_fill_page(host, job->fill[n]);
+        } else if (job->kind[n] == RAM_BATCH_PAGE_COPY) {
+            memcpy(host, job->raw + job->source[n] * TARGET_PAGE_SIZE,
+                   TARGET_PAGE_SIZE);
+        } else {
+            memcpy(host, src, TARGET_PAGE_SIZE);
+            src += TARGET_PAGE_SIZE;
+        }
+    }
+    return 0;
+}
+
+/* Applies all pending batches to guest memory, in order. */
+static int ram_load_flush(void)
+{
+    int ret = 0;
+
+    while (ram_load_pool && ram_load_pool->count) {
+        RamJob *job = ram_job_pool_oldest(ram_load_pool);
+        if (!ret) {
+            ret = ram_load_job_apply(job);
+        }
+        ram_job_pool_pop(ram_load_pool);
+    }
+    return ret;
+}
+
+/* Lazy restore.
+ *
+ * When a version 5 stream is loaded from a snapshot image, the data pages
+ * of each batch are not read. Instead, the position of the batch payload
+ * in the image is recorded, and the payload is only read, decompressed and
+ * copied into guest memory the first time one of its pages is accessed
+ * through qemu_get_ram_ptr(), see ram_lazy_fetch(). A timer prefetches the
+ * remaining batches in the background, so that the whole snapshot is
+ * eventually loaded.
+ *
+ * This relies on all guest memory accesses going through
+ * qemu_get_ram_ptr(), so it is only used with TCG.
+ */
+
+#define RAM_LAZY_PREFETCH_BATCHES  16   /* batches loaded per timer tick */
+#define RAM_LAZY_PREFETCH_MS       1
+
+typedef struct RamLazyBatch {
+    uint8_t *host;              /* host address of the first page */
+    ram_addr_t addr;            /* ram address of the first page */
+    int64_t pos;                /* position of the payload in the image */
+    uint32_t payload_len;
+    uint8_t encoding;
+    int data_count;
+    int page_count;             /* number of data and COPY pages */
+    uint32_t *index;            /* page index of each of these pages, NULL
+                                 * once the batch is loaded */
+    uint16_t *source;           /* data page holding their contents */
+} RamLazyBatch;
+
+typedef struct RamLazyState {
+    BlockDriverState *bs;
+    RamLazyBatch *batches;
+    int nb_batches;
+    int max_batches;
+    int pending;                /* batches not loaded yet */
+    int next_prefetch;
+    uint32_t *owner;            /* for each page, 1 + index of the batch
+                                 * holding its contents, or 0 */
+    ram_addr_t nb_pages;
+    uint8_t *raw;
+    uint8_t *zbuf;
+    QEMUTimer *prefetch_timer;
+    RamJob header;              /* scratch space for batch headers */
+} RamLazyState;
+
+bool ram_lazy_active;
+static RamLazyState *ram_lazy;
+/* Set when a batch could not be loaded. Guest memory is then incomplete,
+ * and the VM cannot run or be saved until another snapshot is loaded. */
+static bool ram_lazy_failed;
+
+static void ram_lazy_free(void)
+{
+    int n;
+
+    if (!ram_lazy) {
+        return;
+    }
+    if (ram_lazy->prefetch_timer) {
+        timer_del(ram_lazy->prefetch_timer);
+        timer_free(ram_lazy->prefetch_timer);
+    }
+    for (n = 0; n < ram_lazy->nb_batches; n++) {
+        g_free(ram_lazy->batches[n].index);
+        g_free(ram_lazy->batches[n].source);
+    }
+    g_free(ram_lazy->batches);
+    g_free(ram_lazy->owner);
+    g_free(ram_lazy->raw);
+    g_free(ram_lazy->zbuf);
+    g_free(ram_lazy);
+    ram_lazy = NULL;
+    ram_lazy_active = false;
+}
+
+/* Starts recording batches from a stream read from |bs|. */
+static void ram_lazy_begin(BlockDriverState *bs)
+{
+    ram_lazy_free();
+    ram_lazy = g_malloc0(sizeof(*ram_lazy));
+    ram_lazy->bs = bs;
+    ram_lazy->nb_pages = last_ram_offset() >> TARGET_PAGE_BITS;
+    ram_lazy->owner = g_malloc0(ram_lazy->nb_pages * sizeof(uint32_t));
+}
+
+/* Records that the page at |host| was written by the stream. */
+static void ram_lazy_forget(void *host)
 {
     ram_addr_t addr;
-    int flags;
 
-    if (version_id < 3 || version_id > 4) {
+    if (ram_lazy && qemu_ram_addr_from_host(host, &addr) == 0 &&
+        (addr >> TARGET_PAGE_BITS) < ram_lazy->nb_pages) {
+        ram_lazy->owner[addr >> TARGET_PAGE_BITS] = 0;
+    }
+}
+
+/* Records a batch whose data pages will be loaded later, and applies its
+ * fill pages. The batch header was read into |job|, and the stream is
+ * positioned at its payload. */
+static int ram_lazy_record(QEMUFile *f, RamJob *job)
+{
+    RamLazyBatch *batch = NULL;
+    ram_addr_t addr;
+    int n, data = 0;
+
+    if (qemu_ram_addr_from_host(job->host, &addr) != 0 ||
+        job->payload_len > ram_job_zbuf_size() ||
+        (job->encoding != RAM_BATCH_ENCODING_RAW &&
+         job->encoding != RAM_BATCH_ENCODING_ZLIB)) {
+        return -EINVAL;
+    }
+    for (n = 0; n < job->count; n++) {
+        if ((addr >> TARGET_PAGE_BITS) + job->index[n] >= ram_lazy->nb_pages) {
+            return -EINVAL;
+        }
+    }
+
+    if (job->data_count == 0) {
+        goto apply_fill;
+    }
+    if (ram_lazy->nb_batches == ram_lazy->max_batches) {
+        ram_lazy->max_batches = ram_lazy->max_batches * 2 + 64;
+        ram_lazy->batches = g_realloc(ram_lazy->batches,
+                ram_lazy->max_batches * sizeof(*ram_lazy->batches));
+    }
+    batch = &ram_lazy->batches[ram_lazy->nb_batches];
+    batch->host = job->host;
+    batch->addr = addr;
+    batch->pos = qemu_file_read_pos(f);
+    batch->payload_len = job->payload_len;
+    batch->encoding = job->encoding;
+    batch->data_count = job->data_count;
+    batch->page_count = 0;
+    batch->index = g_new(uint32_t, job->count);
+    batch->source = g_new(uint16_t, job->count);
+    ram_lazy->nb_batches++;
+    ram_lazy->pending++;
+
+apply_fill:
+    for (n = 0; n < job->count; n++) {
+        ram_addr_t page = (addr >> TARGET_PAGE_BITS) + job->index[n];
+
+        if (job->kind[n] == RAM_BATCH_PAGE_FILL) {
+            ram_load_fill_page(job->host +
+                    (ram_addr_t)job->index[n] * TARGET_PAGE_SIZE,
+                    job->fill[n]);
+            ram_lazy->owner[page] = 0;
+        } else {
+            batch->index[batch->page_count] = job->index[n];
+            batch->source[batch->page_count++] =
+                    (job->kind[n] == RAM_BATCH_PAGE_COPY) ? job->source[n]
+                                                          : data++;
+            ram_lazy->owner[page] = ram_lazy->nb_batches;
+        }
+    }
+
+    qemu_file_skip_bytes(f, job->payload_len);
+    return qemu_file_get_error(f) ? -EIO : 0;
+}
+
+/* Called when batch |id| cannot be loaded. Its pages are lost, so the VM
+ * is stopped, and the remaining batches are dropped. */
+static void ram_lazy_fail(int id, const char *reason)
+{
+    RamLazyBatch *batch = &ram_lazy->batches[id];
+
+    error_report("%s: RAM at " RAM_ADDR_FMT " (%u bytes at offset %" PRId64
+                 " in the snapshot image), stopping the VM",
+                 reason, batch->addr, batch->payload_len, batch->pos);
+    ram_lazy_failed = true;
+    ram_lazy_free();
+    vm_stop(0);
+    /* Leave the translation block that triggered the load. */
+    qemu_notify_event();
+}
+
+/* Reads and applies the pages of batch |id| that were not overwritten by a
+ * later record. Guest memory cannot be recovered if this fails, see
+ * ram_lazy_fail(). */
+static void ram_lazy_load_batch(int id)
+{
+    RamLazyBatch *batch = &ram_lazy->batches[id];
+    const uLongf expected = batch->data_count * TARGET_PAGE_SIZE;
+    uint8_t *buf;
+    int n;
+
+    if (!batch->index) {
+        return;
+    }
+
+    buf = (batch->encoding == RAM_BATCH_ENCODING_ZLIB) ?
+            ram_lazy->zbuf : ram_lazy->raw;
+    if (bdrv_load_vmstate(ram_lazy->bs, buf, batch->pos,
+                          batch->payload_len) != batch->payload_len) {
+        ram_lazy_fail(id, "Could not read RAM from snapshot");
+        return;
+    }
+    if (batch->encoding == RAM_BATCH_ENCODING_ZLIB) {
+        uLongf len = expected;
+        if (uncompress(ram_lazy->raw, &len, buf, batch->payload_len) != Z_OK ||
+            len != expected) {
+            ram_lazy_fail(id, "Corrupted RAM in snapshot");
+            return;
+        }
+    }
+
+    for (n = 0; n < batch->page_count; n++) {
+        ram_addr_t page = (batch->addr >> TARGET_PAGE_BITS) + batch->index[n];
+
+        if (ram_lazy->owner[page] == id + 1) {
+            memcpy(batch->host + (ram_addr_t)batch->index[n] * TARGET_PAGE_SIZE,
+                   ram_lazy->raw + batch->source[n] * TARGET_PAGE_SIZE,
+                   TARGET_PAGE_SIZE);
+            ram_lazy->owner[page] = 0;
+        }
+    }
+    g_free(batch->index);
+    g_free(batch->source);
+    batch->index = NULL;
+    batch->source = NULL;
+
+    if (--ram_lazy->pending == 0) {
+        ram_lazy_free();
+    }
+}
+
+void ram_lazy_fetch_range(ram_addr_t start, ram_addr_t length)
+{
+    ram_addr_t page = start >> TARGET_PAGE_BITS;
+    ram_addr_t end = (start + length + TARGET_PAGE_SIZE - 1) >> TARGET_PAGE_BITS;
+
+    for (; ram_lazy && page < end && page < ram_lazy->nb_pages; page++) {
+        if (ram_lazy->owner[page]) {
+            ram_lazy_load_batch(ram_lazy->owner[page] - 1);
+        }
+    }
+}
+
+int ram_lazy_fetch_all(void)
+{
+    while (ram_lazy && ram_lazy->next_prefetch < ram_lazy->nb_batches) {
+        ram_lazy_load_batch(ram_lazy->next_prefetch++);
+    }
+    ram_lazy_free();
+    return ram_lazy_failed ? -EIO : 0;
+}
+
+bool ram_load_failed(void)
+{
+    return ram_lazy_failed;
+}
+
+static void ram_lazy_prefetch(void *opaque)
+{
+    int n;
+
+    for (n = 0; n < RAM_LAZY_PREFETCH_BATCHES && ram_lazy &&
+                ram_lazy->next_prefetch < ram_lazy->nb_batches; n++) {
+        ram_lazy_load_batch(ram_lazy->next_prefetch++);
+    }
+    if (ram_lazy) {
+        timer_mod(ram_lazy->prefetch_timer,
+                  qemu_clock_get_ms(QEMU_CLOCK_REALTIME) +
+                  RAM_LAZY_PREFETCH_MS);
+    }
+}
+
+/* Called at the end of each RAM section. Makes the recorded batches
+ * visible to ram_lazy_fetch(). */
+static void ram_lazy_activate(void)
+{
+    CPUState *cpu;
+
+    if (!ram_lazy) {
+        return;
+    }
+    if (!ram_lazy->pending) {
+        ram_lazy_free();
+        return;
+    }
+    if (!ram_lazy->raw) {
+        ram_lazy->raw = g_malloc(RAM_BATCH_SIZE);
+        ram_lazy->zbuf = g_malloc(ram_job_zbuf_size());
+        ram_lazy->prefetch_timer = timer_new_ms(QEMU_CLOCK_REALTIME,
+                                                ram_lazy_prefetch, NULL);
+        timer_mod(ram_lazy->prefetch_timer,
+                  qemu_clock_get_ms(QEMU_CLOCK_REALTIME) +
+                  RAM_LAZY_PREFETCH_MS);
+    }
+    /* Cached TLB entries would bypass qemu_get_ram_ptr(). */
+    CPU_FOREACH(cpu) {
+        tlb_flush(cpu->env_ptr, 1);
+    }
+    ram_lazy_active = true;
+}
+
+/* Reads a batch from the stream, and hands it to the worker threads, or
+ * records it for lazy loading. */
+static int ram_load_batch(QEMUFile *f, ram_addr_t addr, int flags)
+{
+    uint8_t *host;
+    RamJob *job;
+    int n;
+
+    host = host_from_stream_offset(f, addr, flags);
+    if (!host) {
+        return -EINVAL;
+    }
+
+    if (ram_lazy) {
+        job = &ram_lazy->header;
+        job->count = 0;
+        job->data_count = 0;
+    } else {
+        if (!ram_load_pool) {
+            ram_load_pool = ram_job_pool_new(ram_load_job_work);
+        }
+        if (ram_job_pool_full(ram_load_pool)) {
+            int ret = ram_load_job_apply(ram_job_pool_oldest(ram_load_pool));
+            ram_job_pool_pop(ram_load_pool);
+            if (ret) {
+                return ret;
+            }
+        }
+        job = ram_job_pool_next(ram_load_pool);
+    }
+
+    job->host = host;
+    job->count = qemu_get_be16(f);
+    if (job->count > RAM_BATCH_PAGES) {
         return -EINVAL;
     }
+    for (n = 0; n < job->count; n++) {
+        job->index[n] = qemu_get_be32(f);
+        job->kind[n] = qemu_get_byte(f);
+        if (job->kind[n] == RAM_BATCH_PAGE_FILL) {
+            job->fill[n] = qemu_get_byte(f);
+        } else if (job->kind[n] == RAM_BATCH_PAGE_DATA) {
+            job->data_count++;
+        } else if (job->kind[n] == RAM_BATCH_PAGE_COPY) {
+            job->source[n] = qemu_get_be16(f);
+            if (job->source[n] >= job->data_count) {
+                return -EINVAL;
+            }
+        } else {
+            return -EINVAL;
+        }
+    }
+
+    job->encoding = qemu_get_byte(f);
+    job->payload_len = qemu_get_be32(f);
+    if (ram_lazy) {
+        return ram_lazy_record(f, job);
+    }
+    if (job->encoding == RAM_BATCH_ENCODING_RAW) {
+        if (job->payload_len != job->data_count * TARGET_PAGE_SIZE) {
+            return -EINVAL;
+        }
+        qemu_get_buffer(f, job->raw, job->payload_len);
+    } else if (job->encoding == RAM_BATCH_ENCODING_ZLIB) {
+        if (job->payload_len > ram_job_zbuf_size()) {
+            return -EINVAL;
+        }
+        qemu_get_buffer(f, job->zbuf, job->payload_len);
+    } else {
+        return -EINVAL;
+    }
+    if (qemu_file_get_error(f)) {
+        return -EIO;
+    }
+
+    ram_job_pool_submit(ram_load_pool);
+    return 0;
+}
+
+static int ram_load_stream(QEMUFile *f, int version_id)
+{
+    ram_addr_t addr;
+    int flags;
 
     do {
         addr = qemu_get_be64(f);
@@ -386,8 +1184,36 @@ int ram_load(QEMUFile *f, void *opaque, int version_id)
         flags = addr & ~TARGET_PAGE_MASK;
         addr &= TARGET_PAGE_MASK;
 
+        if (flags & RAM_SAVE_FLAG_BATCH) {
+            int ret;
+
+            if (version_id < 5) {
+                return -EINVAL;
+            }
+            ret = ram_load_batch(f, addr, flags);
+            if (ret) {
+                return ret;
+            }
+            continue;
+        } else {
+            /* Apply pending batches before anything that follows them. */
+            int ret = ram_load_flush();
+            if (ret) {
+                return ret;
+            }
+        }
+
         if (flags & RAM_SAVE_FLAG_MEM_SIZE) {
-            if (version_id != 3) {
+            /* A new stream replaces whatever was still being lazily
+             * loaded. Only snapshot images support random access. */
+            BlockDriverState *bs = qemu_file_get_bdrv(f);
+            if (version_id >= 5 && bs && !kvm_enabled() && !hax_enabled()) {
+                ram_lazy_begin(bs);
+            } else {
+                ram_lazy_free();
+            }
+
+            if (version_id == 4) {
                 if (addr != ram_bytes_total()) {
                     return -EINVAL;
                 }
@@ -427,7 +1253,7 @@ int ram_load(QEMUFile *f, void *opaque, int version_id)
             void *host;
             uint8_t ch;
 
-            if (version_id != 3)
+            if (version_id == 4)
                 host = qemu_get_ram_ptr(addr);
             else
                 host = host_from_stream_offset(f, addr, flags);
@@ -436,22 +1262,18 @@ int ram_load(QEMUFile *f, void *opaque, int version_id)
             }
 
             ch = qemu_get_byte(f);
-            memset(host, ch, TARGET_PAGE_SIZE);
-#ifndef _WIN32
-            if (ch == 0 &&
-                (!kvm_enabled() || kvm_has_sync_mmu())) {
-                qemu_madvise(host, TARGET_PAGE_SIZE, QEMU_MADV_DONTNEED);
-            }
-#endif
+            ram_load_fill_page(host, ch);
+            ram_lazy_forget(host);
         } else if (flags & RAM_SAVE_FLAG_PAGE) {
             void *host;
 
-            if (version_id != 3)
+            if (version_id == 4)
                 host = qemu_get_ram_ptr(addr);
             else
                 host = host_from_stream_offset(f, addr, flags);
 
             qemu_get_buffer(f, host, TARGET_PAGE_SIZE);
+            ram_lazy_forget(host);
         }
         if (qemu_file_get_error(f)) {
             return -EIO;
@@ -460,6 +1282,29 @@ int ram_load(QEMUFile *f, void *opaque, int version_id)
 
     return 0;
 }
+
+int ram_load(QEMUFile *f, void *opaque, int version_id)
+{
+    int ret, flush_ret;
+
+    if (version_id < 3 || version_id > 5) {
+        return -EINVAL;
+    }
+
+    /* Every page is loaded again, even if a previous lazy load failed. */
+    ram_lazy_failed = false;
+    ret = ram_load_stream(f, version_id);
+    flush_ret = ram_load_flush();
+    ram_job_pool_free(ram_load_pool);
+    ram_load_pool = NULL;
+    if (ret || flush_ret) {
+        ram_lazy_free();
+    } else {
+        ram_lazy_activate();
+    }
+
+    return ret ? ret : flush_ret;
+}
 #endif
 
 #ifdef HAS_AUDIO
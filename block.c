@@ -1705,6 +1705,29 @@ void bdrv_info_stats(Monitor *mon, QObject **ret_data)
     *ret_data = QOBJECT(devices);
 }
 
+void bdrv_info_cache(Monitor *mon)
+{
+    BlockDriverState *bs;
+    BlockDriverInfo bdi;
+
+    QTAILQ_FOREACH(bs, &bdrv_states, list) {
+        if (!bs->drv || bdrv_get_info(bs, &bdi) < 0 ||
+            bdi.l2_cache_size == 0) {
+            continue;
+        }
+        monitor_printf(mon, "%s: file=", bs->device_name);
+        monitor_print_filename(mon, bs->filename);
+        monitor_printf(mon, "\n  l2 tables: size=%d hits=%" PRIu64
+                            " misses=%" PRIu64 " readahead=%" PRIu64 "\n",
+                       bdi.l2_cache_size, bdi.l2_cache_hits,
+                       bdi.l2_cache_misses, bdi.l2_cache_readahead);
+        monitor_printf(mon, "  refcount blocks: size=%d hits=%" PRIu64
+                            " misses=%" PRIu64 "\n",
+                       bdi.refcount_cache_size, bdi.refcount_cache_hits,
+                       bdi.refcount_cache_misses);
+    }
+}
+
 const char *bdrv_get_encrypted_filename(BlockDriverState *bs)
 {
     if (bs->backing_hd && bs->backing_hd->encrypted)
@@ -0,0 +1,280 @@
+/*
+ * L2/refcount table cache for the QCOW2 format
+ *
+ * Copyright (c) 2015 The Android Open Source Project
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2 or later.
+ * See the COPYING file in the top-level directory.
+ */
+
+#include "qemu-common.h"
+#include "block/block_int.h"
+#include "block/qcow2.h"
+
+/*
+ * A Qcow2Cache holds a fixed number of cluster-sized metadata tables,
+ * indexed by their offset in the image file. Entries are found through
+ * a small chained hash table and evicted in least recently used order,
+ * so both lookups and evictions are O(1) regardless of the cache size.
+ *
+ * The cache is write-through: callers write modified tables to the image
+ * themselves, so any entry can be dropped at any time.
+ */
+
+typedef struct Qcow2CacheEntry {
+    uint64_t offset;    /* 0 if the entry is unused */
+    int lru_prev;       /* towards the most recently used entry */
+    int lru_next;       /* towards the least recently used entry */
+    int hash_next;
+} Qcow2CacheEntry;
+
+struct Qcow2Cache {
+    int size;
+    int table_size;
+    uint8_t *tables;
+    Qcow2CacheEntry *entries;
+    int lru_first;
+    int lru_last;
+    int *buckets;
+    int hash_mask;
+    uint64_t hits;
+    uint64_t misses;
+    uint64_t readahead;
+};
+
+static inline int cache_hash(Qcow2Cache *c, uint64_t offset)
+{
+    /* table offsets are cluster aligned, fold the high bits in */
+    offset >>= MIN_CLUSTER_BITS;
+    return (int)((offset ^ (offset >> 16)) & c->hash_mask);
+}
+
+static void cache_lru_unlink(Qcow2Cache *c, int i)
+{
+    Qcow2CacheEntry *e = &c->entries[i];
+
+    if (e->lru_prev >= 0) {
+        c->entries[e->lru_prev].lru_next = e->lru_next;
+    } else {
+        c->lru_first = e->lru_next;
+    }
+    if (e->lru_next >= 0) {
+        c->entries[e->lru_next].lru_prev = e->lru_prev;
+    } else {
+        c->lru_last = e->lru_prev;
+    }
+}
+
+static void cache_lru_push_first(Qcow2Cache *c, int i)
+{
+    Qcow2CacheEntry *e = &c->entries[i];
+
+    e->lru_prev = -1;
+    e->lru_next = c->lru_first;
+    if (c->lru_first >= 0) {
+        c->entries[c->lru_first].lru_prev = i;
+    } else {
+        c->lru_last = i;
+    }
+    c->lru_first = i;
+}
+
+static void cache_lru_push_last(Qcow2Cache *c, int i)
+{
+    Qcow2CacheEntry *e = &c->entries[i];
+
+    e->lru_next = -1;
+    e->lru_prev = c->lru_last;
+    if (c->lru_last >= 0) {
+        c->entries[c->lru_last].lru_next = i;
+    } else {
+        c->lru_first = i;
+    }
+    c->lru_last = i;
+}
+
+static int cache_find(Qcow2Cache *c, uint64_t offset)
+{
+    int i;
+
+    for (i = c->buckets[cache_hash(c, offset)]; i >= 0;
+         i = c->entries[i].hash_next) {
+        if (c->entries[i].offset == offset) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+static void cache_hash_remove(Qcow2Cache *c, int i)
+{
+    int *link = &c->buckets[cache_hash(c, c->entries[i].offset)];
+
+    while (*link != i) {
+        link = &c->entries[*link].hash_next;
+    }
+    *link = c->entries[i].hash_next;
+    c->entries[i].offset = 0;
+}
+
+static void cache_init(Qcow2Cache *c, int size)
+{
+    int i, buckets;
+
+    buckets = 1;
+    while (buckets < size * 2) {
+        buckets <<= 1;
+    }
+
+    c->size = size;
+    c->tables = g_malloc((size_t)size * c->table_size);
+    c->entries = g_malloc(size * sizeof(Qcow2CacheEntry));
+    c->buckets = g_malloc(buckets * sizeof(int));
+    c->hash_mask = buckets - 1;
+    c->lru_first = c->lru_last = -1;
+
+    for (i = 0; i < buckets; i++) {
+        c->buckets[i] = -1;
+    }
+    for (i = 0; i < size; i++) {
+        c->entries[i].offset = 0;
+        c->entries[i].hash_next = -1;
+        cache_lru_push_last(c, i);
+    }
+}
+
+static void cache_fini(Qcow2Cache *c)
+{
+    g_free(c->tables);
+    g_free(c->entries);
+    g_free(c->buckets);
+}
+
+Qcow2Cache *qcow2_cache_create(int size, int table_size)
+{
+    Qcow2Cache *c = g_malloc0(sizeof(*c));
+
+    c->table_size = table_size;
+    cache_init(c, size);
+    return c;
+}
+
+void qcow2_cache_destroy(Qcow2Cache *c)
+{
+    if (c) {
+        cache_fini(c);
+        g_free(c);
+    }
+}
+
+void qcow2_cache_reset(Qcow2Cache *c)
+{
+    int i;
+
+    for (i = 0; i <= c->hash_mask; i++) {
+        c->buckets[i] = -1;
+    }
+    c->lru_first = c->lru_last = -1;
+    for (i = 0; i < c->size; i++) {
+        c->entries[i].offset = 0;
+        c->entries[i].hash_next = -1;
+        cache_lru_push_last(c, i);
+    }
+}
+
+/* Changes the number of entries. The cache contents are dropped. */
+void qcow2_cache_resize(Qcow2Cache *c, int size)
+{
+    if (size == c->size) {
+        return;
+    }
+    cache_fini(c);
+    cache_init(c, size);
+}
+
+int qcow2_cache_size(Qcow2Cache *c)
+{
+    return c->size;
+}
+
+/*
+ * Returns the cached table at the given offset and marks it as the most
+ * recently used one, or NULL if it isn't cached.
+ */
+void *qcow2_cache_lookup(Qcow2Cache *c, uint64_t offset)
+{
+    int i = cache_find(c, offset);
+
+    if (i < 0) {
+        c->misses++;
+        return NULL;
+    }
+    c->hits++;
+    if (c->lru_first != i) {
+        cache_lru_unlink(c, i);
+        cache_lru_push_first(c, i);
+    }
+    return c->tables + (size_t)i * c->table_size;
+}
+
+/* Like qcow2_cache_lookup(), but doesn't touch the LRU order or statistics */
+int qcow2_cache_contains(Qcow2Cache *c, uint64_t offset)
+{
+    return cache_find(c, offset) >= 0;
+}
+
+/*
+ * Evicts the least recently used entry and reassigns it to the given
+ * offset. Returns the (uninitialized) table, which the caller must fill.
+ * A stale entry for the same offset is dropped first.
+ */
+void *qcow2_cache_insert(Qcow2Cache *c, uint64_t offset)
+{
+    int i, bucket;
+
+    qcow2_cache_discard(c, offset);
+
+    i = c->lru_last;
+    if (c->entries[i].offset) {
+        cache_hash_remove(c, i);
+    }
+    cache_lru_unlink(c, i);
+    cache_lru_push_first(c, i);
+
+    bucket = cache_hash(c, offset);
+    c->entries[i].offset = offset;
+    c->entries[i].hash_next = c->buckets[bucket];
+    c->buckets[bucket] = i;
+
+    return c->tables + (size_t)i * c->table_size;
+}
+
+/*
+ * Like qcow2_cache_insert(), but for tables that were read ahead rather
+ * than asked for. Only the statistics differ.
+ */
+void *qcow2_cache_insert_readahead(Qcow2Cache *c, uint64_t offset)
+{
+    c->readahead++;
+    return qcow2_cache_insert(c, offset);
+}
+
+/* Drops the entry for the given offset, e.g. after a failed read */
+void qcow2_cache_discard(Qcow2Cache *c, uint64_t offset)
+{
+    int i = cache_find(c, offset);
+
+    if (i >= 0) {
+        cache_hash_remove(c, i);
+        cache_lru_unlink(c, i);
+        cache_lru_push_last(c, i);
+    }
+}
+
+void qcow2_cache_stats(Qcow2Cache *c, uint64_t *hits, uint64_t *misses,
+                       uint64_t *readahead)
+{
+    *hits = c->hits;
+    *misses = c->misses;
+    *readahead = c->readahead;
+}
@@ -31,7 +31,7 @@
 int qcow2_grow_l1_table(BlockDriverState *bs, int min_size)
 {
     BDRVQcowState *s = bs->opaque;
-    int new_l1_size, new_l1_size2, ret, i;
+    int new_l1_size, new_l1_size2, ret, i, l2_cache_size;
     uint64_t *new_l1_table;
     int64_t new_l1_table_offset;
     uint8_t data[12];
@@ -83,6 +83,13 @@ int qcow2_grow_l1_table(BlockDriverState *bs, int min_size)
     s->l1_table_offset = new_l1_table_offset;
     s->l1_table = new_l1_table;
     s->l1_size = new_l1_size;
+
+    /* let the L2 cache grow with the image */
+    qcow2_cache_sizes(bs, &l2_cache_size, NULL);
+    if (l2_cache_size > qcow2_cache_size(s->l2_cache)) {
+        qcow2_cache_resize(s->l2_cache, l2_cache_size);
+        s->l2_last_l1_index = -1;
+    }
     return 0;
  fail:
     g_free(new_l1_table);
@@ -94,57 +101,8 @@ void qcow2_l2_cache_reset(BlockDriverState *bs)
 {
     BDRVQcowState *s = bs->opaque;
 
-    memset(s->l2_cache, 0, s->l2_size * L2_CACHE_SIZE * sizeof(uint64_t));
-    memset(s->l2_cache_offsets, 0, L2_CACHE_SIZE * sizeof(uint64_t));
-    memset(s->l2_cache_counts, 0, L2_CACHE_SIZE * sizeof(uint32_t));
-}
-
-static inline int l2_cache_new_entry(BlockDriverState *bs)
-{
-    BDRVQcowState *s = bs->opaque;
-    uint32_t min_count;
-    int min_index, i;
-
-    /* find a new entry in the least used one */
-    min_index = 0;
-    min_count = 0xffffffff;
-    for(i = 0; i < L2_CACHE_SIZE; i++) {
-        if (s->l2_cache_counts[i] < min_count) {
-            min_count = s->l2_cache_counts[i];
-            min_index = i;
-        }
-    }
-    return min_index;
-}
-
-/*
- * seek_l2_table
- *
- * seek l2_offset in the l2_cache table
- * if not found, return NULL,
- * if found,
- *   increments the l2 cache hit count of the entry,
- *   if counter overflow, divide by two all counters
- *   return the pointer to the l2 cache entry
- *
- */
-
-static uint64_t *seek_l2_table(BDRVQcowState *s, uint64_t l2_offset)
-{
-    int i, j;
-
-    for(i = 0; i < L2_CACHE_SIZE; i++) {
-        if (l2_offset == s->l2_cache_offsets[i]) {
-            /* increment the hit count */
-            if (++s->l2_cache_counts[i] == 0xffffffff) {
-                for(j = 0; j < L2_CACHE_SIZE; j++) {
-                    s->l2_cache_counts[j] >>= 1;
-                }
-            }
-            return s->l2_cache + (i << s->l2_bits);
-        }
-    }
-    return NULL;
+    qcow2_cache_reset(s->l2_cache);
+    s->l2_last_l1_index = -1;
 }
 
 /*
@@ -153,38 +111,79 @@ static uint64_t *seek_l2_table(BDRVQcowState *s, uint64_t l2_offset)
  * Loads a L2 table into memory. If the table is in the cache, the cache
  * is used; otherwise the L2 table is loaded from the image file.
  *
- * Returns a pointer to the L2 table on success, or NULL if the read from
- * the image file failed.
+ * When the L2 tables are accessed in L1 order and the following tables
+ * are stored right after the requested one in the image file, up to
+ * L2_READAHEAD_MAX of them are read with the same request.
+ *
+ * Returns 0 and a pointer to the L2 table on success, or -errno if the
+ * read from the image file failed.
  */
 
-static int l2_load(BlockDriverState *bs, uint64_t l2_offset,
+static int l2_load(BlockDriverState *bs, int l1_index, uint64_t l2_offset,
     uint64_t **l2_table)
 {
     BDRVQcowState *s = bs->opaque;
-    int min_index;
+    size_t table_size = s->l2_size * sizeof(uint64_t);
+    int sequential, max_readahead, n, i;
+    uint8_t *buf;
     int ret;
 
+    sequential = (l1_index == s->l2_last_l1_index + 1);
+    s->l2_last_l1_index = l1_index;
+
     /* seek if the table for the given offset is in the cache */
 
-    *l2_table = seek_l2_table(s, l2_offset);
+    *l2_table = qcow2_cache_lookup(s->l2_cache, l2_offset);
     if (*l2_table != NULL) {
         return 0;
     }
 
-    /* not found: load a new entry in the least used one */
+    /* find out how many of the following tables can be read along */
 
-    min_index = l2_cache_new_entry(bs);
-    *l2_table = s->l2_cache + (min_index << s->l2_bits);
+    n = 0;
+    if (sequential) {
+        max_readahead = MIN(L2_READAHEAD_MAX,
+                            qcow2_cache_size(s->l2_cache) / 4);
+        while (n < max_readahead && l1_index + n + 1 < s->l1_size) {
+            uint64_t next_offset =
+                s->l1_table[l1_index + n + 1] & ~QCOW_OFLAG_COPIED;
+            if (next_offset != l2_offset + (n + 1) * table_size ||
+                qcow2_cache_contains(s->l2_cache, next_offset)) {
+                break;
+            }
+            n++;
+        }
+    }
 
     BLKDBG_EVENT(bs->file, BLKDBG_L2_LOAD);
-    ret = bdrv_pread(bs->file, l2_offset, *l2_table,
-        s->l2_size * sizeof(uint64_t));
+
+    if (n == 0) {
+        /* not found: load a new entry in the least recently used one */
+        *l2_table = qcow2_cache_insert(s->l2_cache, l2_offset);
+        ret = bdrv_pread(bs->file, l2_offset, *l2_table, table_size);
+        if (ret < 0) {
+            qcow2_cache_discard(s->l2_cache, l2_offset);
+            return ret;
+        }
+        return 0;
+    }
+
+    buf = g_malloc((n + 1) * table_size);
+    ret = bdrv_pread(bs->file, l2_offset, buf, (n + 1) * table_size);
     if (ret < 0) {
+        g_free(buf);
         return ret;
     }
 
-    s->l2_cache_offsets[min_index] = l2_offset;
-    s->l2_cache_counts[min_index] = 1;
+    /* the requested table goes in last, so that it is the most recent */
+    for (i = n; i > 0; i--) {
+        memcpy(qcow2_cache_insert_readahead(s->l2_cache,
+                                            l2_offset + i * table_size),
+               buf + i * table_size, table_size);
+    }
+    *l2_table = qcow2_cache_insert(s->l2_cache, l2_offset);
+    memcpy(*l2_table, buf, table_size);
+    g_free(buf);
 
     return 0;
 }
@@ -229,7 +228,6 @@ static int write_l1_entry(BlockDriverState *bs, int l1_index)
 static int l2_allocate(BlockDriverState *bs, int l1_index, uint64_t **table)
 {
     BDRVQcowState *s = bs->opaque;
-    int min_index;
     uint64_t old_l2_offset;
     uint64_t *l2_table;
     int64_t l2_offset;
@@ -246,8 +244,7 @@ static int l2_allocate(BlockDriverState *bs, int l1_index, uint64_t **table)
 
     /* allocate a new entry in the l2 cache */
 
-    min_index = l2_cache_new_entry(bs);
-    l2_table = s->l2_cache + (min_index << s->l2_bits);
+    l2_table = qcow2_cache_insert(s->l2_cache, l2_offset);
 
     if (old_l2_offset == 0) {
         /* if there was no old l2 table, clear the new table */
@@ -276,11 +273,6 @@ static int l2_allocate(BlockDriverState *bs, int l1_index, uint64_t **table)
         goto fail;
     }
 
-    /* update the l2 cache entry */
-
-    s->l2_cache_offsets[min_index] = l2_offset;
-    s->l2_cache_counts[min_index] = 1;
-
     *table = l2_table;
     return 0;
 
@@ -485,7 +477,7 @@ int qcow2_get_cluster_offset(BlockDriverState *bs, uint64_t offset,
     /* load the l2 table in memory */
 
     l2_offset &= ~QCOW_OFLAG_COPIED;
-    ret = l2_load(bs, l2_offset, &l2_table);
+    ret = l2_load(bs, l1_index, l2_offset, &l2_table);
     if (ret < 0) {
         return ret;
     }
@@ -554,7 +546,7 @@ static int get_cluster_table(BlockDriverState *bs, uint64_t offset,
     if (l2_offset & QCOW_OFLAG_COPIED) {
         /* load the l2 table in memory */
         l2_offset &= ~QCOW_OFLAG_COPIED;
-        ret = l2_load(bs, l2_offset, &l2_table);
+        ret = l2_load(bs, l1_index, l2_offset, &l2_table);
         if (ret < 0) {
             return ret;
         }
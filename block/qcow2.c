@@ -136,10 +136,64 @@ static int qcow_read_extensions(BlockDriverState *bs, uint64_t start_offset,
 }
 
 
+static int64_t qcow2_cache_max_size(void)
+{
+    static int64_t max_size;
+
+    if (max_size == 0) {
+        const char *env = getenv("ANDROID_QCOW2_CACHE_SIZE");
+
+        max_size = QCOW2_CACHE_DEFAULT_MAX;
+        if (env != NULL) {
+            int64_t size = strtosz_suffix(env, NULL, STRTOSZ_DEFSUFFIX_MB);
+            if (size > 0) {
+                max_size = size;
+            } else {
+                fprintf(stderr, "qcow2: invalid ANDROID_QCOW2_CACHE_SIZE "
+                        "value '%s', using default\n", env);
+            }
+        }
+    }
+    return max_size;
+}
+
+/*
+ * Computes how many L2 tables and refcount blocks should be cached for
+ * the image: enough to map the whole virtual disk and VM state area
+ * (one L2 table per L1 entry) and to describe the whole image file,
+ * within a global byte budget of which refcount blocks get at most a
+ * quarter. Either output pointer may be NULL.
+ */
+void qcow2_cache_sizes(BlockDriverState *bs, int *l2_entries,
+                       int *refcount_entries)
+{
+    BDRVQcowState *s = bs->opaque;
+    int64_t max_entries = qcow2_cache_max_size() >> s->cluster_bits;
+    int64_t file_size, l2, refcount;
+
+    file_size = bdrv_getlength(bs->file);
+    if (file_size < 0) {
+        file_size = 0;
+    }
+    refcount = (file_size >> (2 * s->cluster_bits - REFCOUNT_SHIFT)) + 1;
+    refcount = MIN(refcount, max_entries / 4);
+    refcount = MAX(refcount, REFCOUNT_CACHE_MIN_SIZE);
+
+    l2 = MIN((int64_t)s->l1_size, max_entries - refcount);
+    l2 = MAX(l2, L2_CACHE_MIN_SIZE);
+
+    if (l2_entries) {
+        *l2_entries = l2;
+    }
+    if (refcount_entries) {
+        *refcount_entries = refcount;
+    }
+}
+
 static int qcow_open(BlockDriverState *bs, int flags)
 {
     BDRVQcowState *s = bs->opaque;
-    int len, i;
+    int len, i, l2_cache_size;
     QCowHeader header;
     uint64_t ext_end;
 
@@ -204,7 +258,10 @@ static int qcow_open(BlockDriverState *bs, int flags)
         }
     }
     /* alloc L2 cache */
-    s->l2_cache = g_malloc(s->l2_size * L2_CACHE_SIZE * sizeof(uint64_t));
+    qcow2_cache_sizes(bs, &l2_cache_size, NULL);
+    s->l2_cache = qcow2_cache_create(l2_cache_size,
+                                     s->l2_size * sizeof(uint64_t));
+    s->l2_last_l1_index = -1;
     s->cluster_cache = g_malloc(s->cluster_size);
     /* one more sector for decompressed data alignment */
     s->cluster_data = g_malloc(QCOW_MAX_CRYPT_CLUSTERS * s->cluster_size
@@ -245,7 +302,7 @@ static int qcow_open(BlockDriverState *bs, int flags)
     qcow2_free_snapshots(bs);
     qcow2_refcount_close(bs);
     g_free(s->l1_table);
-    g_free(s->l2_cache);
+    qcow2_cache_destroy(s->l2_cache);
     g_free(s->cluster_cache);
     g_free(s->cluster_data);
     return -1;
@@ -662,7 +719,7 @@ static void qcow_close(BlockDriverState *bs)
 {
     BDRVQcowState *s = bs->opaque;
     g_free(s->l1_table);
-    g_free(s->l2_cache);
+    qcow2_cache_destroy(s->l2_cache);
     g_free(s->cluster_cache);
     g_free(s->cluster_data);
     qcow2_refcount_close(bs);
@@ -1233,8 +1290,16 @@ static int64_t qcow_vm_state_offset(BDRVQcowState *s)
 static int qcow_get_info(BlockDriverState *bs, BlockDriverInfo *bdi)
 {
     BDRVQcowState *s = bs->opaque;
+    uint64_t refcount_readahead;
+
     bdi->cluster_size = s->cluster_size;
     bdi->vm_state_offset = qcow_vm_state_offset(s);
+    bdi->l2_cache_size = qcow2_cache_size(s->l2_cache);
+    qcow2_cache_stats(s->l2_cache, &bdi->l2_cache_hits,
+                      &bdi->l2_cache_misses, &bdi->l2_cache_readahead);
+    bdi->refcount_cache_size = qcow2_cache_size(s->refcount_cache);
+    qcow2_cache_stats(s->refcount_cache, &bdi->refcount_cache_hits,
+                      &bdi->refcount_cache_misses, &refcount_readahead);
     return 0;
 }
 
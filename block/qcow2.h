@@ -49,7 +49,17 @@
 #define MIN_CLUSTER_BITS 9
 #define MAX_CLUSTER_BITS 21
 
-#define L2_CACHE_SIZE 16
+/* number of cached L2 tables and refcount blocks; the actual sizes depend
+ * on the image size, see qcow2_cache_sizes() */
+#define L2_CACHE_MIN_SIZE 16
+#define REFCOUNT_CACHE_MIN_SIZE 4
+/* default upper bound in bytes for both caches together, can be changed
+ * with the ANDROID_QCOW2_CACHE_SIZE environment variable */
+#define QCOW2_CACHE_DEFAULT_MAX (4 * 1024 * 1024)
+/* max. number of L2 tables read ahead on sequential access */
+#define L2_READAHEAD_MAX 4
+
+typedef struct Qcow2Cache Qcow2Cache;
 
 typedef struct QCowHeader {
     uint32_t magic;
@@ -92,9 +102,8 @@ typedef struct BDRVQcowState {
     uint64_t cluster_offset_mask;
     uint64_t l1_table_offset;
     uint64_t *l1_table;
-    uint64_t *l2_cache;
-    uint64_t l2_cache_offsets[L2_CACHE_SIZE];
-    uint32_t l2_cache_counts[L2_CACHE_SIZE];
+    Qcow2Cache *l2_cache;
+    int l2_last_l1_index; /* used to detect sequential access */
     uint8_t *cluster_cache;
     uint8_t *cluster_data;
     uint64_t cluster_cache_offset;
@@ -103,6 +112,8 @@ typedef struct BDRVQcowState {
     uint64_t *refcount_table;
     uint64_t refcount_table_offset;
     uint32_t refcount_table_size;
+    Qcow2Cache *refcount_cache;
+    /* the refcount block currently being worked on, in refcount_cache */
     uint64_t refcount_block_cache_offset;
     uint16_t *refcount_block_cache;
     int64_t free_cluster_index;
@@ -169,6 +180,9 @@ static inline int64_t align_offset(int64_t offset, int n)
 int qcow2_backing_read1(BlockDriverState *bs,
                   int64_t sector_num, uint8_t *buf, int nb_sectors);
 
+void qcow2_cache_sizes(BlockDriverState *bs, int *l2_entries,
+                       int *refcount_entries);
+
 /* qcow2-refcount.c functions */
 int qcow2_refcount_init(BlockDriverState *bs);
 void qcow2_refcount_close(BlockDriverState *bs);
@@ -206,6 +220,20 @@ uint64_t qcow2_alloc_compressed_cluster_offset(BlockDriverState *bs,
 
 int qcow2_alloc_cluster_link_l2(BlockDriverState *bs, QCowL2Meta *m);
 
+/* qcow2-cache.c functions */
+Qcow2Cache *qcow2_cache_create(int size, int table_size);
+void qcow2_cache_destroy(Qcow2Cache *c);
+void qcow2_cache_reset(Qcow2Cache *c);
+void qcow2_cache_resize(Qcow2Cache *c, int size);
+int qcow2_cache_size(Qcow2Cache *c);
+void *qcow2_cache_lookup(Qcow2Cache *c, uint64_t offset);
+int qcow2_cache_contains(Qcow2Cache *c, uint64_t offset);
+void *qcow2_cache_insert(Qcow2Cache *c, uint64_t offset);
+void *qcow2_cache_insert_readahead(Qcow2Cache *c, uint64_t offset);
+void qcow2_cache_discard(Qcow2Cache *c, uint64_t offset);
+void qcow2_cache_stats(Qcow2Cache *c, uint64_t *hits, uint64_t *misses,
+                       uint64_t *readahead);
+
 /* qcow2-snapshot.c functions */
 int qcow2_snapshot_create(BlockDriverState *bs, QEMUSnapshotInfo *sn_info);
 int qcow2_snapshot_goto(BlockDriverState *bs, const char *snapshot_id);
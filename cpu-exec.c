@@ -560,6 +560,12 @@ int cpu_exec(CPUOldState *env)
 #endif /* DEBUG_DISAS || CONFIG_DEBUG_EXEC */
                 spin_lock(&tcg_ctx.tb_ctx.tb_lock);
                 tb = tb_find_fast(env);
+                if (unlikely(tb_trace_threshold &&
+                             tb->exec_count >= tb_trace_threshold &&
+                             tb->cflags == 0)) {
+                    tb = tb_gen_trace(env, tb);
+                    env->tb_jmp_cache[tb_jmp_cache_hash_func(tb->pc)] = tb;
+                }
                 /* Note: we do it here to avoid a gcc bug on Mac OS X when
                    doing it in tb_find_slow */
                 if (tcg_ctx.tb_ctx.tb_invalidated_flag) {
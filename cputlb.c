@@ -22,10 +22,24 @@
 #include "exec/exec-all.h"
 #include "exec/cputlb.h"
 #include "exec/ram_addr.h"
+#include "monitor/monitor.h"
 
 /* statistics */
 int tlb_flush_count;
 
+/* Number of entries of the main TLBs, see tlb_set_size() */
+static unsigned int tlb_size = CPU_TLB_DEFAULT_SIZE;
+
+int tlb_set_size(unsigned int size)
+{
+    if (size < (1 << CPU_TLB_MIN_BITS) || size > CPU_TLB_MAX_SIZE ||
+        (size & (size - 1)) != 0) {
+        return -1;
+    }
+    tlb_size = size;
+    return 0;
+}
+
 static const CPUTLBEntry s_cputlb_empty_entry = {
     .addr_read  = -1,
     .addr_write = -1,
@@ -56,18 +70,21 @@ void tlb_flush(CPUArchState *env, int flush_global)
        links while we are modifying them */
     env->current_tb = NULL;
 
-    for (i = 0; i < CPU_TLB_SIZE; i++) {
-        int mmu_idx;
-
-        for (mmu_idx = 0; mmu_idx < NB_MMU_MODES; mmu_idx++) {
-            env->tlb_table[mmu_idx][i] = s_cputlb_empty_entry;
-        }
+    /* This is also where the size is set, since CPU resets clear it.
+       Only the entries in use need to be flushed.  */
+    env->tlb_mask = (uintptr_t)(tlb_size - 1) << CPU_TLB_ENTRY_BITS;
+    for (i = 0; i < NB_MMU_MODES; i++) {
+        /* s_cputlb_empty_entry is all ones.  */
+        memset(env->tlb_table[i], -1, tlb_size * sizeof(CPUTLBEntry));
     }
+    memset(env->tlb_v_table, -1, sizeof(env->tlb_v_table));
+    env->vtlb_index = 0;
 
     memset(env->tb_jmp_cache, 0, TB_JMP_CACHE_SIZE * sizeof (void *));
 
     env->tlb_flush_addr = -1;
     env->tlb_flush_mask = 0;
+    env->tlb_stats.flush++;
     tlb_flush_count++;
 }
 
@@ -83,6 +100,16 @@ static inline void tlb_flush_entry(CPUTLBEntry *tlb_entry, target_ulong addr)
     }
 }
 
+static inline void tlb_flush_vtlb_page(CPUArchState *env, int mmu_idx,
+                                       target_ulong addr)
+{
+    int k;
+
+    for (k = 0; k < CPU_VTLB_SIZE; k++) {
+        tlb_flush_entry(&env->tlb_v_table[mmu_idx][k], addr);
+    }
+}
+
 void tlb_flush_page(CPUArchState *env, target_ulong addr)
 {
     int i;
@@ -106,9 +133,10 @@ void tlb_flush_page(CPUArchState *env, target_ulong addr)
     env->current_tb = NULL;
 
     addr &= TARGET_PAGE_MASK;
-    i = (addr >> TARGET_PAGE_BITS) & (CPU_TLB_SIZE - 1);
+    i = CPU_TLB_INDEX(env, addr);
     for (mmu_idx = 0; mmu_idx < NB_MMU_MODES; mmu_idx++) {
         tlb_flush_entry(&env->tlb_table[mmu_idx][i], addr);
+        tlb_flush_vtlb_page(env, mmu_idx, addr);
     }
 
     tb_flush_jmp_cache(env, addr);
@@ -161,10 +189,14 @@ void cpu_tlb_reset_dirty_all(ram_addr_t start1, ram_addr_t length)
         for (mmu_idx = 0; mmu_idx < NB_MMU_MODES; mmu_idx++) {
             unsigned int i;
 
-            for (i = 0; i < CPU_TLB_SIZE; i++) {
+            for (i = 0; i < tlb_size; i++) {
                 tlb_reset_dirty_range(&env->tlb_table[mmu_idx][i],
                                       start1, length);
             }
+            for (i = 0; i < CPU_VTLB_SIZE; i++) {
+                tlb_reset_dirty_range(&env->tlb_v_table[mmu_idx][i],
+                                      start1, length);
+            }
         }
     }
 }
@@ -184,9 +216,14 @@ void tlb_set_dirty(CPUArchState *env, target_ulong vaddr)
     int mmu_idx;
 
     vaddr &= TARGET_PAGE_MASK;
-    i = (vaddr >> TARGET_PAGE_BITS) & (CPU_TLB_SIZE - 1);
+    i = CPU_TLB_INDEX(env, vaddr);
     for (mmu_idx = 0; mmu_idx < NB_MMU_MODES; mmu_idx++) {
+        int k;
+
         tlb_set_dirty1(&env->tlb_table[mmu_idx][i], vaddr);
+        for (k = 0; k < CPU_VTLB_SIZE; k++) {
+            tlb_set_dirty1(&env->tlb_v_table[mmu_idx][k], vaddr);
+        }
     }
 }
 
@@ -213,6 +250,89 @@ static void tlb_add_large_page(CPUArchState *env, target_ulong vaddr,
     env->tlb_flush_mask = mask;
 }
 
+static inline bool tlb_entry_is_empty(const CPUTLBEntry *te)
+{
+    return te->addr_read == -1 && te->addr_write == -1 &&
+           te->addr_code == -1;
+}
+
+static inline bool tlb_entry_is_page(const CPUTLBEntry *te,
+                                     target_ulong vaddr)
+{
+    const target_ulong mask = TARGET_PAGE_MASK | TLB_INVALID_MASK;
+
+    return (te->addr_read & mask) == vaddr ||
+           (te->addr_write & mask) == vaddr ||
+           (te->addr_code & mask) == vaddr;
+}
+
+/* Look up the victim TLB when the main TLB entry for 'addr' doesn't match,
+   before walking the page tables. 'elt_ofs' is the offset of the field
+   used by the access, i.e. addr_read, addr_write or addr_code. On a hit,
+   the victim entry is swapped with the main entry and true is returned.  */
+bool tlb_victim_hit(CPUArchState *env, int mmu_idx, int index,
+                    size_t elt_ofs, target_ulong addr)
+{
+    int vidx;
+
+    addr &= TARGET_PAGE_MASK;
+    for (vidx = 0; vidx < CPU_VTLB_SIZE; vidx++) {
+        CPUTLBEntry *vte = &env->tlb_v_table[mmu_idx][vidx];
+        target_ulong cmp = *(target_ulong *)((uintptr_t)vte + elt_ofs);
+
+        if ((cmp & (TARGET_PAGE_MASK | TLB_INVALID_MASK)) == addr) {
+            CPUTLBEntry *te = &env->tlb_table[mmu_idx][index];
+            CPUTLBEntry tmptlb = *te;
+            hwaddr tmpiotlb = env->iotlb[mmu_idx][index];
+
+            *te = *vte;
+            *vte = tmptlb;
+            env->iotlb[mmu_idx][index] = env->iotlb_v[mmu_idx][vidx];
+            env->iotlb_v[mmu_idx][vidx] = tmpiotlb;
+            env->tlb_stats.victim_hit++;
+            return true;
+        }
+    }
+    env->tlb_stats.miss++;
+    return false;
+}
+
+void tlb_dump_stats(Monitor *mon)
+{
+    CPUState *cpu;
+
+    CPU_FOREACH(cpu) {
+        CPUArchState *env = cpu->env_ptr;
+        const CPUTLBStats *st = &env->tlb_stats;
+        uint64_t slow = st->victim_hit + st->miss;
+
+        monitor_printf(mon, "CPU #%d: %u entries per MMU mode, "
+                       "%d victim entries\n",
+                       cpu->cpu_index, tlb_size, CPU_VTLB_SIZE);
+#ifdef CONFIG_PROFILER
+        monitor_printf(mon, "  hits         %" PRIu64 " (%.2f%%)\n",
+                       st->hit, st->hit + slow ?
+                       100.0 * st->hit / (st->hit + slow) : 0.0);
+#endif
+        monitor_printf(mon, "  victim hits  %" PRIu64 " (%.2f%% of misses)\n",
+                       st->victim_hit,
+                       slow ? 100.0 * st->victim_hit / slow : 0.0);
+        monitor_printf(mon, "  fills        %" PRIu64 "\n", st->miss);
+        monitor_printf(mon, "  flushes      %" PRIu64 "\n", st->flush);
+    }
+}
+
+void tlb_reset_stats(void)
+{
+    CPUState *cpu;
+
+    CPU_FOREACH(cpu) {
+        CPUArchState *env = cpu->env_ptr;
+
+        memset(&env->tlb_stats, 0, sizeof(env->tlb_stats));
+    }
+}
+
 /* Add a new TLB entry. At most one entry for a given virtual address
    is permitted. Only a single TARGET_PAGE_SIZE region is mapped, the
    supplied size is only used by tlb_flush_page.  */
@@ -286,9 +406,21 @@ void tlb_set_page(CPUArchState *env, target_ulong vaddr,
         }
     }
 
-    index = (vaddr >> TARGET_PAGE_BITS) & (CPU_TLB_SIZE - 1);
-    env->iotlb[mmu_idx][index] = iotlb - vaddr;
+    index = CPU_TLB_INDEX(env, vaddr);
     te = &env->tlb_table[mmu_idx][index];
+
+    /* Don't discard the translation of another page in te, move it to the
+       victim TLB. Also make sure that the victim TLB has no stale entry
+       for this page, e.g. without write access.  */
+    tlb_flush_vtlb_page(env, mmu_idx, vaddr);
+    if (!tlb_entry_is_empty(te) && !tlb_entry_is_page(te, vaddr)) {
+        unsigned int vidx = env->vtlb_index++ % CPU_VTLB_SIZE;
+
+        env->tlb_v_table[mmu_idx][vidx] = *te;
+        env->iotlb_v[mmu_idx][vidx] = env->iotlb[mmu_idx][index];
+    }
+
+    env->iotlb[mmu_idx][index] = iotlb - vaddr;
     te->addend = addend - vaddr;
     if (prot & PAGE_READ) {
         te->addr_read = address;
@@ -325,7 +457,7 @@ tb_page_addr_t get_page_addr_code(CPUArchState *env1, target_ulong addr)
     int mmu_idx, page_index, pd;
     void *p;
 
-    page_index = (addr >> TARGET_PAGE_BITS) & (CPU_TLB_SIZE - 1);
+    page_index = CPU_TLB_INDEX(env1, addr);
     mmu_idx = cpu_mmu_index(env1);
     if (unlikely(env1->tlb_table[mmu_idx][page_index].addr_code !=
                  (addr & TARGET_PAGE_MASK))) {
@@ -228,17 +228,14 @@ bool GLEScmContext::needConvert(GLESConversionArrays& cArrs,GLint first,GLsizei
        (arrType == GL_BYTE   && (array_id != GL_TEXTURE_COORD_ARRAY)) ) return false;
 
 
-    bool byteVBO = (arrType == GL_BYTE) && usingVBO;
-    if(byteVBO){
-        p->redirectPointerData();
-    }
-
-    if(!usingVBO || byteVBO) {
+    if(!usingVBO) {
         if (direct) {
             convertDirect(cArrs,first,count,array_id,p);
         } else {
             convertIndirect(cArrs,count,type,indices,array_id,p);
         }
+    } else if(arrType == GL_BYTE) {
+        convertByteVBO(cArrs,first,count,type,indices,direct,p);
     } else {
         if (direct) {
             convertDirectVBO(cArrs,first,count,array_id,p) ;
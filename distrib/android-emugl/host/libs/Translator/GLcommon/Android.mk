@@ -11,6 +11,8 @@ host_common_SRC_FILES :=     \
      TextureUtils.cpp        \
      PaletteTexture.cpp      \
      etc1.cpp                \
+     Etc1Decoder.cpp         \
+     NameTable.cpp           \
      objectNameManager.cpp   \
      FramebufferData.cpp
 
@@ -54,3 +56,32 @@ $(call emugl-export,C_INCLUDES,$(LOCAL_PATH)/../include $(EMUGL_PATH)/shared)
 $(call emugl-export,STATIC_LIBRARIES, lib64emugl_common)
 
 $(call emugl-end-module)
+
+
+### emugl_name_table_benchmark ##########################
+# Compares the ShareGroup's name lookups with the NameTable and with the
+# std::map it replaced. Not run automatically.
+$(call emugl-begin-host-executable,emugl_name_table_benchmark)
+$(call emugl-import,libGLcommon)
+LOCAL_SRC_FILES := name_table_benchmark.cpp
+$(call emugl-end-module)
+
+
+### emugl_glcommon_host_unittests ######################################
+$(call emugl-begin-host-executable,emugl_glcommon_host_unittests)
+$(call emugl-import,libGLcommon libemugl_gtest)
+LOCAL_SRC_FILES := \
+    etc1_decoder_unittest.cpp \
+    gles_context_unittest.cpp \
+    name_table_unittest.cpp \
+
+$(call emugl-end-module)
+
+$(call emugl-begin-host64-executable,emugl64_glcommon_host_unittests)
+$(call emugl-import,lib64GLcommon lib64emugl_gtest)
+LOCAL_SRC_FILES := \
+    etc1_decoder_unittest.cpp \
+    gles_context_unittest.cpp \
+    name_table_unittest.cpp \
+
+$(call emugl-end-module)
@@ -0,0 +1,303 @@
+/*
+* Copyright (C) 2015 The Android Open Source Project
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+* http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*/
+#include <GLcommon/Etc1Decoder.h>
+
+#include "emugl/common/lazy_instance.h"
+#include "emugl/common/mutex.h"
+#include "emugl/common/thread.h"
+
+#include <list>
+#include <map>
+#include <vector>
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <unistd.h>
+#endif
+
+namespace {
+
+// Images are split so that each thread decodes at least that many pixels,
+// otherwise starting the threads costs more than it saves.
+const etc1_uint32 kMinPixelsPerThread = 64 * 1024;
+
+// Upper bound on the number of threads decoding a single image.
+const int kMaxThreads = 8;
+
+int getNumCpus() {
+#ifdef _WIN32
+    SYSTEM_INFO info;
+    GetSystemInfo(&info);
+    return (int)info.dwNumberOfProcessors;
+#else
+    long n = sysconf(_SC_NPROCESSORS_ONLN);
+    return n > 0 ? (int)n : 1;
+#endif
+}
+
+// Hashes the compressed content of an image, 8 bytes at a time. The
+// cache compares the content of the matching entries anyway, so this only
+// needs to be fast and to spread the keys.
+uint64_t hashData(const etc1_byte *data, size_t size) {
+    const uint64_t kMul = 0x9ddfea08eb382d69ULL;
+    uint64_t h = size * kMul;
+    size_t n = 0;
+    for (; n + 8 <= size; n += 8) {
+        uint64_t w;
+        memcpy(&w, data + n, sizeof(w));
+        h = (h ^ w) * kMul;
+        h ^= h >> 47;
+    }
+    for (; n < size; n++) {
+        h = (h ^ data[n]) * kMul;
+    }
+    return h ^ (h >> 47);
+}
+
+// One band of rows of an image.
+struct Etc1Band {
+    const etc1_byte *data;
+    etc1_byte *pixels;
+    etc1_uint32 width;
+    etc1_uint32 height;
+    etc1_uint32 stride;
+    etc1_uint32 firstRow;
+    etc1_uint32 numRows;
+
+    int decode() const {
+        return etc1_decode_image_rows(data, pixels, width, height, 3, stride,
+                                      firstRow, numRows);
+    }
+};
+
+// Decodes one band in a worker thread.
+class Etc1DecodeThread : public emugl::Thread {
+public:
+    explicit Etc1DecodeThread(const Etc1Band &band) : m_band(band) {}
+
+    virtual intptr_t main() {
+        return m_band.decode();
+    }
+
+private:
+    Etc1Band m_band;
+};
+
+}  // namespace
+
+int decodeEtc1ImageParallel(const etc1_byte *p_data, etc1_byte *p_pixels,
+                            etc1_uint32 p_width, etc1_uint32 p_height,
+                            etc1_uint32 p_stride, int p_numThreads)
+{
+    // Bands must start on a block boundary.
+    etc1_uint32 blockRows = (p_height + 3) / 4;
+    int numThreads = p_numThreads;
+    if ((etc1_uint32)numThreads > blockRows) {
+        numThreads = blockRows;
+    }
+    if (numThreads <= 1) {
+        return etc1_decode_image(p_data, p_pixels, p_width, p_height, 3,
+                                 p_stride);
+    }
+    etc1_uint32 bandRows = 4 * ((blockRows + numThreads - 1) / numThreads);
+
+    std::vector<Etc1Band> bands;
+    for (etc1_uint32 row = 0; row < p_height; row += bandRows) {
+        Etc1Band band = { p_data, p_pixels, p_width, p_height, p_stride, row,
+                          p_height - row < bandRows ? p_height - row
+                                                    : bandRows };
+        bands.push_back(band);
+    }
+    // The calling thread decodes the last band itself.
+    std::vector<Etc1DecodeThread*> threads;
+    std::vector<bool> started;
+    for (size_t n = 0; n + 1 < bands.size(); n++) {
+        threads.push_back(new Etc1DecodeThread(bands[n]));
+        started.push_back(threads[n]->start());
+    }
+    int res = bands.back().decode();
+    for (size_t n = 0; n < threads.size(); n++) {
+        intptr_t threadRes = 0;
+        if (started[n]) {
+            threads[n]->wait(&threadRes);
+        } else {
+            // Couldn't start this thread, do its work here instead.
+            threadRes = bands[n].decode();
+        }
+        if (threadRes) {
+            res = (int)threadRes;
+        }
+        delete threads[n];
+    }
+    return res;
+}
+
+namespace {
+
+// A cache of decoded images, with a maximum total size, that evicts the
+// least recently used images first.
+class Etc1Cache {
+public:
+    Etc1Cache() : m_lock(), m_numCpus(getNumCpus()), m_maxSize(0),
+                  m_size(0), m_entries(), m_index() {
+        const char *env = getenv("ANDROID_EMUGL_ETC1_CACHE");
+        if (env) {
+            m_maxSize = (size_t)atoi(env) * 1024 * 1024;
+        }
+    }
+
+    int numCpus() const { return m_numCpus; }
+
+    bool enabled() {
+        emugl::Mutex::AutoLock lock(m_lock);
+        return m_maxSize > 0;
+    }
+
+    void setMaxSize(size_t maxSize) {
+        emugl::Mutex::AutoLock lock(m_lock);
+        m_maxSize = maxSize;
+        while (m_size > m_maxSize) {
+            removeLocked(--m_entries.end());
+        }
+    }
+
+    Etc1PixelsPtr find(uint64_t key, const etc1_byte *data, size_t dataSize,
+                       etc1_uint32 width, etc1_uint32 height,
+                       etc1_uint32 stride) {
+        emugl::Mutex::AutoLock lock(m_lock);
+        Index::iterator it = m_index.find(key);
+        if (it == m_index.end()) {
+            return Etc1PixelsPtr();
+        }
+        Entries::iterator entry = it->second;
+        if (entry->width != width || entry->height != height ||
+            entry->stride != stride || entry->data.size() != dataSize ||
+            memcmp(&entry->data[0], data, dataSize)) {
+            return Etc1PixelsPtr();
+        }
+        // Move it to the front, as the most recently used.
+        m_entries.splice(m_entries.begin(), m_entries, entry);
+        return entry->pixels;
+    }
+
+    void insert(uint64_t key, const etc1_byte *data, size_t dataSize,
+                etc1_uint32 width, etc1_uint32 height, etc1_uint32 stride,
+                Etc1PixelsPtr pixels) {
+        size_t size = dataSize + pixels->size();
+        emugl::Mutex::AutoLock lock(m_lock);
+        if (size > m_maxSize) {
+            return;
+        }
+        Index::iterator it = m_index.find(key);
+        if (it != m_index.end()) {
+            // Another thread decoded the same image, or this is another
+            // image with the same hash: keep the newest one only.
+            removeLocked(it->second);
+        }
+        while (m_size + size > m_maxSize) {
+            removeLocked(--m_entries.end());
+        }
+        m_entries.push_front(Entry());
+        Entry &entry = m_entries.front();
+        entry.key = key;
+        entry.width = width;
+        entry.height = height;
+        entry.stride = stride;
+        entry.data.assign(data, data + dataSize);
+        entry.pixels = pixels;
+        m_index[key] = m_entries.begin();
+        m_size += size;
+    }
+
+private:
+    struct Entry {
+        uint64_t key;
+        etc1_uint32 width;
+        etc1_uint32 height;
+        etc1_uint32 stride;
+        std::vector<etc1_byte> data;
+        Etc1PixelsPtr pixels;
+    };
+
+    typedef std::list<Entry> Entries;
+    typedef std::map<uint64_t, Entries::iterator> Index;
+
+    void removeLocked(Entries::iterator entry) {
+        m_size -= entry->data.size() + entry->pixels->size();
+        m_index.erase(entry->key);
+        m_entries.erase(entry);
+    }
+
+    emugl::Mutex m_lock;
+    int m_numCpus;
+    size_t m_maxSize;
+    size_t m_size;
+    Entries m_entries;  // most recently used first.
+    Index m_index;
+};
+
+emugl::LazyInstance<Etc1Cache> sCache = LAZY_INSTANCE_INIT;
+
+}  // namespace
+
+void setEtc1CacheSize(size_t p_maxSize)
+{
+    sCache->setMaxSize(p_maxSize);
+}
+
+Etc1PixelsPtr decodeEtc1Image(const etc1_byte *p_data,
+                              etc1_uint32 p_width,
+                              etc1_uint32 p_height,
+                              etc1_uint32 p_stride)
+{
+    Etc1Cache *cache = sCache.ptr();
+    size_t dataSize = etc1_get_encoded_data_size(p_width, p_height);
+    bool useCache = cache->enabled() && dataSize > 0;
+    uint64_t key = 0;
+    if (useCache) {
+        key = hashData(p_data, dataSize);
+        Etc1PixelsPtr cached = cache->find(key, p_data, dataSize,
+                                           p_width, p_height, p_stride);
+        if (cached.Ptr()) {
+            return cached;
+        }
+    }
+
+    int numThreads = cache->numCpus();
+    if (numThreads > kMaxThreads) {
+        numThreads = kMaxThreads;
+    }
+    etc1_uint32 maxThreads = (p_width * p_height) / kMinPixelsPerThread;
+    if ((etc1_uint32)numThreads > maxThreads) {
+        numThreads = maxThreads;
+    }
+
+    Etc1PixelsPtr pixels(new Etc1Pixels(p_stride * p_height));
+    if (p_height && decodeEtc1ImageParallel(p_data, pixels->data(), p_width,
+                                            p_height, p_stride, numThreads)) {
+        return Etc1PixelsPtr();
+    }
+    if (useCache) {
+        cache->insert(key, p_data, dataSize, p_width, p_height, p_stride,
+                      pixels);
+    }
+    return pixels;
+}
@@ -30,6 +30,7 @@ bool  GLESbuffer::setBuffer(GLuint size,GLuint usage,const GLvoid* data) {
         }
         m_conversionManager.clear();
         m_conversionManager.addRange(Range(0,m_size));
+        invalidateConversions();
         return true;
     }
     return false;
@@ -40,6 +41,7 @@ bool  GLESbuffer::setSubBuffer(GLint offset,GLuint size,const GLvoid* data) {
     memcpy(m_data+offset,data,size);
     m_conversionManager.addRange(Range(offset,size));
     m_conversionManager.merge();
+    invalidateConversions();
     return true;
 }
 
@@ -48,8 +50,31 @@ void  GLESbuffer::getConversions(const RangeList& rIn,RangeList& rOut) {
         rOut.merge();
 }
 
+GLESbufferConversion* GLESbuffer::getConversion(int offset,int stride,int size,GLenum type) {
+    for(size_t i = 0; i < m_conversions.size(); i++) {
+        GLESbufferConversion& c = m_conversions[i];
+        if(c.offset == offset && c.stride == stride && c.size == size && c.type == type) {
+            return &c;
+        }
+    }
+    GLESbufferConversion c = { offset, stride, size, type, 0, 0, 0, NULL };
+    m_conversions.push_back(c);
+    return &m_conversions.back();
+}
+
+void GLESbuffer::invalidateConversions() {
+    // Keep the GL_BYTE copies allocated, they are refilled on next use.
+    for(size_t i = 0; i < m_conversions.size(); i++) {
+        m_conversions[i].begin = 0;
+        m_conversions[i].end = 0;
+    }
+}
+
 GLESbuffer::~GLESbuffer() {
     if(m_data) {
         delete [] m_data;
     }
+    for(size_t i = 0; i < m_conversions.size(); i++) {
+        delete [] m_conversions[i].data;
+    }
 }
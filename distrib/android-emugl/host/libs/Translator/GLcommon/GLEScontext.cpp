@@ -24,11 +24,15 @@
 #include <GLcommon/FramebufferData.h>
 #include <strings.h>
 #include <string.h>
+#include <vector>
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
 
 //decleration
-static void convertFixedDirectLoop(const char* dataIn,unsigned int strideIn,void* dataOut,unsigned int nBytes,unsigned int strideOut,int attribSize);
+static void convertFixedDirectLoop(const char* dataIn,unsigned int strideIn,void* dataOut,GLsizei count,unsigned int strideOut,int attribSize);
 static void convertFixedIndirectLoop(const char* dataIn,unsigned int strideIn,void* dataOut,GLsizei count,GLenum indices_type,const GLvoid* indices,unsigned int strideOut,int attribSize);
-static void convertByteDirectLoop(const char* dataIn,unsigned int strideIn,void* dataOut,unsigned int nBytes,unsigned int strideOut,int attribSize);
+static void convertByteDirectLoop(const char* dataIn,unsigned int strideIn,void* dataOut,GLsizei count,unsigned int strideOut,int attribSize);
 static void convertByteIndirectLoop(const char* dataIn,unsigned int strideIn,void* dataOut,GLsizei count,GLenum indices_type,const GLvoid* indices,unsigned int strideOut,int attribSize);
 
 GLESConversionArrays::~GLESConversionArrays() {
@@ -214,15 +218,49 @@ const GLESpointer* GLEScontext::getPointer(GLenum arrType) {
     return NULL;
 }
 
-static void convertFixedDirectLoop(const char* dataIn,unsigned int strideIn,void* dataOut,unsigned int nBytes,unsigned int strideOut,int attribSize) {
+// Converts |n| consecutive GL_FIXED values to GL_FLOAT. Multiplying by
+// 2^-16 is exact, so the results are the same as with X2F().
+static void convertFixedToFloat(const GLfixed* in,GLfloat* out,unsigned int n) {
+    unsigned int i = 0;
+#if defined(__SSE2__)
+    const __m128 scale = _mm_set1_ps(1.0f / 65536.0f);
+    for(; i + 4 <= n; i += 4) {
+        __m128i fixed = _mm_loadu_si128(reinterpret_cast<const __m128i*>(in + i));
+        _mm_storeu_ps(out + i, _mm_mul_ps(_mm_cvtepi32_ps(fixed), scale));
+    }
+#endif
+    for(; i < n; i++) {
+        out[i] = X2F(in[i]);
+    }
+}
 
-    for(unsigned int i = 0; i < nBytes;i+=strideOut) {
-        const GLfixed* fixed_data = (const GLfixed *)dataIn;
-        //filling attrib
-        for(int j=0;j<attribSize;j++) {
-            reinterpret_cast<GLfloat*>(&static_cast<unsigned char*>(dataOut)[i])[j] = X2F(fixed_data[j]);
-        }
+// Converts |n| consecutive GL_BYTE values to GL_SHORT.
+static void convertByteToShort(const GLbyte* in,GLshort* out,unsigned int n) {
+    unsigned int i = 0;
+#if defined(__SSE2__)
+    for(; i + 16 <= n; i += 16) {
+        __m128i bytes = _mm_loadu_si128(reinterpret_cast<const __m128i*>(in + i));
+        __m128i sign = _mm_cmpgt_epi8(_mm_setzero_si128(), bytes);
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(out + i), _mm_unpacklo_epi8(bytes, sign));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(out + i + 8), _mm_unpackhi_epi8(bytes, sign));
+    }
+#endif
+    for(; i < n; i++) {
+        out[i] = B2S(in[i]);
+    }
+}
+
+static void convertFixedDirectLoop(const char* dataIn,unsigned int strideIn,void* dataOut,GLsizei count,unsigned int strideOut,int attribSize) {
+    unsigned char* out = static_cast<unsigned char*>(dataOut);
+    if(strideIn == attribSize*sizeof(GLfixed) && strideOut == attribSize*sizeof(GLfloat)) {
+        // tightly packed attributes are converted in one go.
+        convertFixedToFloat(reinterpret_cast<const GLfixed*>(dataIn),reinterpret_cast<GLfloat*>(out),count*attribSize);
+        return;
+    }
+    for(int i = 0; i < count; i++) {
+        convertFixedToFloat(reinterpret_cast<const GLfixed*>(dataIn),reinterpret_cast<GLfloat*>(out),attribSize);
         dataIn += strideIn;
+        out += strideOut;
     }
 }
 
@@ -232,22 +270,21 @@ static void convertFixedIndirectLoop(const char* dataIn,unsigned int strideIn,vo
                                                              ((GLushort *)indices)[i];
         const GLfixed* fixed_data = (GLfixed *)(dataIn  + index*strideIn);
         GLfloat* float_data = reinterpret_cast<GLfloat*>(static_cast<unsigned char*>(dataOut) + index*strideOut);
-
-        for(int j=0;j<attribSize;j++) {
-            float_data[j] = X2F(fixed_data[j]);
-         }
+        convertFixedToFloat(fixed_data,float_data,attribSize);
     }
 }
 
-static void convertByteDirectLoop(const char* dataIn,unsigned int strideIn,void* dataOut,unsigned int nBytes,unsigned int strideOut,int attribSize) {
-
-    for(unsigned int i = 0; i < nBytes;i+=strideOut) {
-        const GLbyte* byte_data = (const GLbyte *)dataIn;
-        //filling attrib
-        for(int j=0;j<attribSize;j++) {
-            reinterpret_cast<GLshort*>(&static_cast<unsigned char*>(dataOut)[i])[j] = B2S(byte_data[j]);
-        }
+static void convertByteDirectLoop(const char* dataIn,unsigned int strideIn,void* dataOut,GLsizei count,unsigned int strideOut,int attribSize) {
+    unsigned char* out = static_cast<unsigned char*>(dataOut);
+    if(strideIn == attribSize*sizeof(GLbyte) && strideOut == attribSize*sizeof(GLshort)) {
+        // tightly packed attributes are converted in one go.
+        convertByteToShort(reinterpret_cast<const GLbyte*>(dataIn),reinterpret_cast<GLshort*>(out),count*attribSize);
+        return;
+    }
+    for(int i = 0; i < count; i++) {
+        convertByteToShort(reinterpret_cast<const GLbyte*>(dataIn),reinterpret_cast<GLshort*>(out),attribSize);
         dataIn += strideIn;
+        out += strideOut;
     }
 }
 
@@ -257,17 +294,28 @@ static void convertByteIndirectLoop(const char* dataIn,unsigned int strideIn,voi
                                                              ((GLushort *)indices)[i];
         const GLbyte* bytes_data = (GLbyte *)(dataIn  + index*strideIn);
         GLshort* short_data = reinterpret_cast<GLshort*>(static_cast<unsigned char*>(dataOut) + index*strideOut);
+        convertByteToShort(bytes_data,short_data,attribSize);
+    }
+}
 
-        for(int j=0;j<attribSize;j++) {
-            short_data[j] = B2S(bytes_data[j]);
-         }
+static void findIndexRange(GLsizei count,GLenum indices_type,const GLvoid* indices,int* minIndex,int* maxIndex) {
+    int min = count ? 0xffff : 0;
+    int max = 0;
+    for(int i = 0; i < count; i++) {
+        int index = indices_type == GL_UNSIGNED_BYTE? ((const GLubyte *)indices)[i]:
+                                                     ((const GLushort *)indices)[i];
+        if(index < min) min = index;
+        if(index > max) max = index;
     }
+    *minIndex = min;
+    *maxIndex = max;
 }
+
 static void directToBytesRanges(GLint first,GLsizei count,GLESpointer* p,RangeList& list) {
 
     int attribSize = p->getSize()*4; //4 is the sizeof GLfixed or GLfloat in bytes
     int stride = p->getStride()?p->getStride():attribSize;
-    int start  = p->getBufferOffset()+first*attribSize;
+    int start  = p->getBufferOffset()+first*stride;
     if(!p->getStride()) {
         list.addRange(Range(start,count*attribSize));
     } else {
@@ -291,6 +339,34 @@ static void indirectToBytesRanges(const GLvoid* indices,GLenum indices_type,GLsi
     }
 }
 
+// Returns true if |indices| reference every element from |minIndex| to
+// |maxIndex|.
+static bool indicesAreContiguous(GLsizei count,GLenum indices_type,const GLvoid* indices,int minIndex,int maxIndex) {
+    int n = maxIndex - minIndex + 1;
+    if(n > count) return false;
+    std::vector<bool> seen(n,false);
+    for(int i = 0; i < count; i++) {
+        int index = indices_type == GL_UNSIGNED_BYTE? ((const GLubyte *)indices)[i]:
+                                                     ((const GLushort *)indices)[i];
+        if(!seen[index - minIndex]) {
+            seen[index - minIndex] = true;
+            if(--n == 0) return true;
+        }
+    }
+    return false;
+}
+
+// Records that elements [begin, end) of the array described by |conv| are
+// converted, merging them with the range it already covers if they touch.
+static void addConvertedRange(GLESbufferConversion* conv,GLint begin,GLint end) {
+    if(conv->begin < conv->end && begin <= conv->end && conv->begin <= end) {
+        if(begin > conv->begin) begin = conv->begin;
+        if(end < conv->end) end = conv->end;
+    }
+    conv->begin = begin;
+    conv->end = end;
+}
+
 int bytesRangesToIndices(RangeList& ranges,GLESpointer* p,GLushort* indices) {
 
     int attribSize = p->getSize() * 4; //4 is the sizeof GLfixed or GLfloat in bytes
@@ -312,40 +388,49 @@ void GLEScontext::convertDirect(GLESConversionArrays& cArrs,GLint first,GLsizei
 
     GLenum type    = p->getType();
     int attribSize = p->getSize();
-    unsigned int size = attribSize*count + first;
+    unsigned int size = attribSize*(count + first);
     unsigned int bytes = type == GL_FIXED ? sizeof(GLfixed):sizeof(GLbyte);
     cArrs.allocArr(size,type);
     int stride = p->getStride()?p->getStride():bytes*attribSize;
     const char* data = (const char*)p->getArrayData() + (first*stride);
 
+    // elements keep their index in the converted array, since the draw
+    // call starts at |first| too.
     if(type == GL_FIXED) {
-        convertFixedDirectLoop(data,stride,cArrs.getCurrentData(),size*sizeof(GLfloat),attribSize*sizeof(GLfloat),attribSize);
+        GLfloat* out = static_cast<GLfloat*>(cArrs.getCurrentData()) + first*attribSize;
+        convertFixedDirectLoop(data,stride,out,count,attribSize*sizeof(GLfloat),attribSize);
     } else if(type == GL_BYTE) {
-        convertByteDirectLoop(data,stride,cArrs.getCurrentData(),size*sizeof(GLshort),attribSize*sizeof(GLshort),attribSize);
+        GLshort* out = static_cast<GLshort*>(cArrs.getCurrentData()) + first*attribSize;
+        convertByteDirectLoop(data,stride,out,count,attribSize*sizeof(GLshort),attribSize);
     }
 }
 
-void GLEScontext::convertDirectVBO(GLESConversionArrays& cArrs,GLint first,GLsizei count,GLenum array_id,GLESpointer* p) {
+void GLEScontext::convertFixedVBO(GLint begin,GLint end,GLESpointer* p) {
+    if(begin >= end || !p->bufferNeedConversion()) return;
 
-    RangeList ranges;
-    RangeList conversions;
-    GLushort* indices = NULL;
     int attribSize = p->getSize();
     int stride = p->getStride()?p->getStride():sizeof(GLfixed)*attribSize;
-    char* data = (char*)p->getBufferData() + (first*stride);
+    GLESbufferConversion* conv = p->getBuffer()->getConversion(p->getBufferOffset(),stride,attribSize,GL_FIXED);
+    if(conv->begin <= begin && end <= conv->end) return; // already converted
 
-    if(p->bufferNeedConversion()) {
-        directToBytesRanges(first,count,p,ranges); //converting indices range to buffer bytes ranges by offset
-        p->getBufferConversions(ranges,conversions); // getting from the buffer the relevant ranges that still needs to be converted
-
-        if(conversions.size()) { // there are some elements to convert
-           indices = new GLushort[count];
-           int nIndices = bytesRangesToIndices(conversions,p,indices); //converting bytes ranges by offset to indices in this array
-           convertFixedIndirectLoop(data,stride,data,nIndices,GL_UNSIGNED_SHORT,indices,stride,attribSize);
-        }
+    RangeList ranges;
+    RangeList conversions;
+    directToBytesRanges(begin,end - begin,p,ranges); //converting indices range to buffer bytes ranges by offset
+    p->getBufferConversions(ranges,conversions); // getting from the buffer the relevant ranges that still needs to be converted
+
+    if(conversions.size()) { // there are some elements to convert
+        char* data = static_cast<char*>(p->getBufferData());
+        GLushort* indices = new GLushort[end - begin];
+        int nIndices = bytesRangesToIndices(conversions,p,indices); //converting bytes ranges by offset to indices in this array
+        convertFixedIndirectLoop(data,stride,data,nIndices,GL_UNSIGNED_SHORT,indices,stride,attribSize);
+        delete[] indices;
     }
-    if(indices) delete[] indices;
-    cArrs.setArr(data,p->getStride(),GL_FLOAT);
+    addConvertedRange(conv,begin,end);
+}
+
+void GLEScontext::convertDirectVBO(GLESConversionArrays& cArrs,GLint first,GLsizei count,GLenum array_id,GLESpointer* p) {
+    convertFixedVBO(first,first + count,p);
+    cArrs.setArr(p->getBufferData(),p->getStride(),GL_FLOAT);
 }
 
 int GLEScontext::findMaxIndex(GLsizei count,GLenum type,const GLvoid* indices) {
@@ -367,7 +452,7 @@ int GLEScontext::findMaxIndex(GLsizei count,GLenum type,const GLvoid* indices) {
 
 void GLEScontext::convertIndirect(GLESConversionArrays& cArrs,GLsizei count,GLenum indices_type,const GLvoid* indices,GLenum array_id,GLESpointer* p) {
     GLenum type    = p->getType();
-    int maxElements = findMaxIndex(count,type,indices) + 1;
+    int maxElements = findMaxIndex(count,indices_type,indices) + 1;
 
     int attribSize = p->getSize();
     int size = attribSize * maxElements;
@@ -384,25 +469,69 @@ void GLEScontext::convertIndirect(GLESConversionArrays& cArrs,GLsizei count,GLen
 }
 
 void GLEScontext::convertIndirectVBO(GLESConversionArrays& cArrs,GLsizei count,GLenum indices_type,const GLvoid* indices,GLenum array_id,GLESpointer* p) {
-    RangeList ranges;
-    RangeList conversions;
-    GLushort* conversionIndices = NULL;
-    int attribSize = p->getSize();
-    int stride = p->getStride()?p->getStride():sizeof(GLfixed)*attribSize;
     char* data = static_cast<char*>(p->getBufferData());
-    if(p->bufferNeedConversion()) {
-        indirectToBytesRanges(indices,indices_type,count,p,ranges); //converting indices range to buffer bytes ranges by offset
-        p->getBufferConversions(ranges,conversions); // getting from the buffer the relevant ranges that still needs to be converted
-        if(conversions.size()) { // there are some elements to convert
-            conversionIndices = new GLushort[count];
-            int nIndices = bytesRangesToIndices(conversions,p,conversionIndices); //converting bytes ranges by offset to indices in this array
-            convertFixedIndirectLoop(data,stride,data,nIndices,GL_UNSIGNED_SHORT,conversionIndices,stride,attribSize);
+    if(count > 0 && p->bufferNeedConversion()) {
+        int minIndex, maxIndex;
+        findIndexRange(count,indices_type,indices,&minIndex,&maxIndex);
+        int attribSize = p->getSize();
+        int stride = p->getStride()?p->getStride():sizeof(GLfixed)*attribSize;
+        GLESbufferConversion* conv = p->getBuffer()->getConversion(p->getBufferOffset(),stride,attribSize,GL_FIXED);
+        if(conv->begin > minIndex || maxIndex + 1 > conv->end) {
+            // Only the referenced elements are converted: the ones in
+            // between may not be vertices of this array at all, e.g. when
+            // the buffer interleaves several arrays with holes.
+            RangeList ranges;
+            RangeList conversions;
+            indirectToBytesRanges(indices,indices_type,count,p,ranges); //converting indices range to buffer bytes ranges by offset
+            p->getBufferConversions(ranges,conversions); // getting from the buffer the relevant ranges that still needs to be converted
+            if(conversions.size()) { // there are some elements to convert
+                GLushort* conversionIndices = new GLushort[count];
+                int nIndices = bytesRangesToIndices(conversions,p,conversionIndices); //converting bytes ranges by offset to indices in this array
+                convertFixedIndirectLoop(data,stride,data,nIndices,GL_UNSIGNED_SHORT,conversionIndices,stride,attribSize);
+                delete[] conversionIndices;
+            }
+            // The cache only records contiguous ranges of elements.
+            if(indicesAreContiguous(count,indices_type,indices,minIndex,maxIndex)) {
+                addConvertedRange(conv,minIndex,maxIndex + 1);
+            }
         }
     }
-    if(conversionIndices) delete[] conversionIndices;
     cArrs.setArr(data,p->getStride(),GL_FLOAT);
 }
 
+void GLEScontext::convertByteVBO(GLESConversionArrays& cArrs,GLint first,GLsizei count,GLenum indices_type,const GLvoid* indices,bool direct,GLESpointer* p) {
+    // GL_BYTE can't be converted in place, so the converted elements are
+    // kept with the buffer, and reused by the next draws until its content
+    // changes.
+    int attribSize = p->getSize();
+    int stride = p->getStride()?p->getStride():sizeof(GLbyte)*attribSize;
+    int end = direct ? first + count : findMaxIndex(count,indices_type,indices) + 1;
+    GLESbuffer* buffer = p->getBuffer();
+    GLESbufferConversion* conv = buffer->getConversion(p->getBufferOffset(),stride,attribSize,GL_BYTE);
+
+    if(end > conv->end) {
+        if(end > conv->capacity) {
+            delete[] conv->data;
+            conv->data = new GLshort[end*attribSize];
+            conv->capacity = end;
+        }
+        // only read the elements that are inside the buffer.
+        int available = 0;
+        int bufferSize = buffer->getSize();
+        int offset = p->getBufferOffset();
+        if(offset + attribSize <= bufferSize) {
+            available = (bufferSize - offset - attribSize) / stride + 1;
+        }
+        int n = end < available ? end : available;
+        convertByteDirectLoop(static_cast<const char*>(p->getBufferData()),stride,conv->data,n,attribSize*sizeof(GLshort),attribSize);
+        if(n < end) {
+            memset(conv->data + n*attribSize,0,(end - n)*attribSize*sizeof(GLshort));
+        }
+        conv->end = end;
+    }
+    cArrs.setArr(conv->data,0,GL_SHORT);
+}
+
 
 
 void GLEScontext::bindBuffer(GLenum target,GLuint buffer) {
@@ -736,7 +865,8 @@ void GLEScontext::setTextureEnabled(GLenum target, GLenum enable) {
     m_texState[m_activeTexture][pos].enabled = enable;
 }
 
-#define INTERNAL_NAME(x) (x +0x100000000ll);
+// Stored in the NameTable's lock-free pages, like regular names.
+#define INTERNAL_NAME(x) (x + NameTable::kInternalBase);
 
 ObjectLocalName GLEScontext::getDefaultTextureName(GLenum target) {
     ObjectLocalName name = 0;
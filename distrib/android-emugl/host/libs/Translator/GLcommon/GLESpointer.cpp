@@ -52,10 +52,6 @@ const GLvoid* GLESpointer::getData() const{
     return m_isVBO ? getBufferData():getArrayData();
 }
 
-void GLESpointer::redirectPointerData(){
-    m_data = getBufferData();
-}
-
 GLuint GLESpointer::getBufferName() const {
     return m_bufferName;
 }
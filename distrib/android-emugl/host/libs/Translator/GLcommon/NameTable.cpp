@@ -0,0 +1,238 @@
+/*
+* Copyright (C) 2015 The Android Open Source Project
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+* http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*/
+#include <GLcommon/NameTable.h>
+
+// For the definition of ObjectData, needed to release ObjectDataPtr values.
+#include <GLcommon/objectNameManager.h>
+
+#include "emugl/common/atomic.h"
+
+#include <string.h>
+
+using emugl::acquireBarrier;
+using emugl::releaseBarrier;
+
+NameTable::Entry::Entry() : sequence(0), globalName(0), exists(0) {}
+
+NameTable::NameTable() : m_sparse() {
+    memset((void*)m_pages, 0, sizeof(m_pages));
+}
+
+NameTable::~NameTable()
+{
+    for (unsigned int i = 0; i <= kMaxPages; i++) {
+        delete m_pages[i];
+    }
+}
+
+// static
+bool
+NameTable::pageIndex(ObjectLocalName p_localName, unsigned int *p_index)
+{
+    if (p_localName < kDenseLimit) {
+        *p_index = (unsigned int)(p_localName >> kPageBits);
+        return true;
+    }
+    if (p_localName - kInternalBase < kPageSize) {
+        *p_index = kMaxPages;
+        return true;
+    }
+    return false;
+}
+
+// static
+ObjectLocalName
+NameTable::pageBase(unsigned int p_index)
+{
+    return (p_index == kMaxPages) ? kInternalBase
+                                  : (ObjectLocalName)p_index << kPageBits;
+}
+
+bool
+NameTable::lookupDense(ObjectLocalName p_localName,
+                       bool *p_exists,
+                       unsigned int *p_globalName) const
+{
+    unsigned int index;
+    if (!pageIndex(p_localName, &index)) {
+        return false;
+    }
+    const Page *page = m_pages[index];
+    acquireBarrier();
+    if (!page) {
+        *p_exists = false;
+        *p_globalName = 0;
+        return true;
+    }
+    const Entry &entry = page->entries[p_localName & (kPageSize - 1)];
+    unsigned int sequence;
+    bool exists;
+    unsigned int globalName;
+    do {
+        sequence = entry.sequence;
+        acquireBarrier();
+        exists = (entry.exists != 0);
+        globalName = entry.globalName;
+        acquireBarrier();
+    } while ((sequence & 1) || entry.sequence != sequence);
+    *p_exists = exists;
+    *p_globalName = exists ? globalName : 0;
+    return true;
+}
+
+bool
+NameTable::find(ObjectLocalName p_localName, unsigned int *p_globalName) const
+{
+    const Entry *entry = getEntry(p_localName);
+    if (!entry || !entry->exists) {
+        return false;
+    }
+    *p_globalName = entry->globalName;
+    return true;
+}
+
+void
+NameTable::set(ObjectLocalName p_localName, unsigned int p_globalName)
+{
+    updateEntry(getEntry(p_localName, true), p_globalName, true);
+}
+
+bool
+NameTable::remove(ObjectLocalName p_localName, unsigned int *p_globalName)
+{
+    Entry *entry = getEntry(p_localName, false);
+    if (!entry) {
+        return false;
+    }
+    bool existed = (entry->exists != 0);
+    *p_globalName = entry->globalName;
+    updateEntry(entry, 0, false);
+    entry->data = ObjectDataPtr();
+    unsigned int index;
+    if (!pageIndex(p_localName, &index)) {
+        m_sparse.erase(p_localName);
+    }
+    return existed;
+}
+
+ObjectLocalName
+NameTable::findLocalName(unsigned int p_globalName) const
+{
+    for (unsigned int i = 0; i <= kMaxPages; i++) {
+        const Page *page = m_pages[i];
+        if (!page) {
+            continue;
+        }
+        for (unsigned int j = 0; j < kPageSize; j++) {
+            const Entry &entry = page->entries[j];
+            if (entry.exists && entry.globalName == p_globalName) {
+                return pageBase(i) + j;
+            }
+        }
+    }
+    for (SparseMap::const_iterator it = m_sparse.begin();
+         it != m_sparse.end(); ++it) {
+        if (it->second.exists && it->second.globalName == p_globalName) {
+            return it->first;
+        }
+    }
+    return 0;
+}
+
+void
+NameTable::setData(ObjectLocalName p_localName, ObjectDataPtr p_data)
+{
+    Entry *entry = getEntry(p_localName, true);
+    if (!entry->data.Ptr()) {
+        entry->data = p_data;
+    }
+}
+
+ObjectDataPtr
+NameTable::getData(ObjectLocalName p_localName) const
+{
+    const Entry *entry = getEntry(p_localName);
+    return entry ? entry->data : ObjectDataPtr();
+}
+
+void
+NameTable::forEachGlobalName(void (*p_func)(void *p_ctx, unsigned int p_name),
+                             void *p_ctx) const
+{
+    for (unsigned int i = 0; i <= kMaxPages; i++) {
+        const Page *page = m_pages[i];
+        if (!page) {
+            continue;
+        }
+        for (unsigned int j = 0; j < kPageSize; j++) {
+            if (page->entries[j].exists) {
+                p_func(p_ctx, page->entries[j].globalName);
+            }
+        }
+    }
+    for (SparseMap::const_iterator it = m_sparse.begin();
+         it != m_sparse.end(); ++it) {
+        if (it->second.exists) {
+            p_func(p_ctx, it->second.globalName);
+        }
+    }
+}
+
+NameTable::Entry *
+NameTable::getEntry(ObjectLocalName p_localName, bool p_create)
+{
+    unsigned int index;
+    if (!pageIndex(p_localName, &index)) {
+        if (p_create) {
+            return &m_sparse[p_localName];
+        }
+        SparseMap::iterator it = m_sparse.find(p_localName);
+        return (it != m_sparse.end()) ? &it->second : NULL;
+    }
+    Page *page = m_pages[index];
+    if (!page) {
+        if (!p_create) {
+            return NULL;
+        }
+        page = new Page();
+        // Make sure the page's content is visible before the page itself,
+        // for lookupDense().
+        releaseBarrier();
+        m_pages[index] = page;
+    }
+    return &page->entries[p_localName & (kPageSize - 1)];
+}
+
+const NameTable::Entry *
+NameTable::getEntry(ObjectLocalName p_localName) const
+{
+    return const_cast<NameTable*>(this)->getEntry(p_localName, false);
+}
+
+// static
+void
+NameTable::updateEntry(Entry *p_entry, unsigned int p_globalName,
+                       bool p_exists)
+{
+    // Writers are serialized by the owner's lock, see lookupDense() for
+    // the reader side.
+    p_entry->sequence = p_entry->sequence + 1;
+    releaseBarrier();
+    p_entry->globalName = p_globalName;
+    p_entry->exists = p_exists ? 1 : 0;
+    releaseBarrier();
+    p_entry->sequence = p_entry->sequence + 1;
+}
@@ -17,6 +17,7 @@
 #include <GLcommon/GLESmacros.h>
 #include <GLcommon/GLDispatch.h>
 #include <GLcommon/GLESvalidate.h>
+#include <GLcommon/Etc1Decoder.h>
 #include <stdio.h>
 #include <cmath>
 
@@ -61,13 +62,10 @@ void  doCompressedTexImage2D(GLEScontext * ctx, GLenum target, GLint level,
 
                 const int32_t align = ctx->getUnpackAlignment()-1;
                 const int32_t bpr = ((width * 3) + align) & ~align;
-                const size_t size = bpr * height;
 
-                etc1_byte* pOut = new etc1_byte[size];
-                int res = etc1_decode_image((const etc1_byte*)data, pOut, width, height, 3, bpr);
-                SET_ERROR_IF(res!=0, GL_INVALID_VALUE);
-                glTexImage2DPtr(target,level,format,width,height,border,format,type,pOut);
-                delete [] pOut;
+                Etc1PixelsPtr pixels = decodeEtc1Image((const etc1_byte*)data, width, height, bpr);
+                SET_ERROR_IF(!pixels.Ptr(), GL_INVALID_VALUE);
+                glTexImage2DPtr(target,level,format,width,height,border,format,type,pixels->data());
             }
             break;
             
@@ -163,9 +163,19 @@ inline int convertDiff(int base, int diff) {
     return convert5To8((0x1f & base) + kLookup[0x7 & diff]);
 }
 
+// Decode one of the two 2x4 or 4x2 subblocks of a block. Row y of the
+// block starts at pOut + rowStride * y.
 static
-void decode_subblock(etc1_byte* pOut, int r, int g, int b, const int* table,
-        etc1_uint32 low, bool second, bool flipped) {
+void decode_subblock(etc1_byte* pOut, etc1_uint32 rowStride, int r, int g, int b,
+        const int* table, etc1_uint32 low, bool second, bool flipped) {
+    // All the pixels of a subblock use one of only four colors, so clamp
+    // them once instead of once per pixel.
+    etc1_byte colors[4][3];
+    for (int i = 0; i < 4; i++) {
+        colors[i][0] = clamp(r + table[i]);
+        colors[i][1] = clamp(g + table[i]);
+        colors[i][2] = clamp(b + table[i]);
+    }
     int baseX = 0;
     int baseY = 0;
     if (second) {
@@ -186,18 +196,18 @@ void decode_subblock(etc1_byte* pOut, int r, int g, int b, const int* table,
         }
         int k = y + (x * 4);
         int offset = ((low >> k) & 1) | ((low >> (k + 15)) & 2);
-        int delta = table[offset];
-        etc1_byte* q = pOut + 3 * (x + 4 * y);
-        *q++ = clamp(r + delta);
-        *q++ = clamp(g + delta);
-        *q++ = clamp(b + delta);
+        const etc1_byte* color = colors[offset];
+        etc1_byte* q = pOut + 3 * x + rowStride * y;
+        q[0] = color[0];
+        q[1] = color[1];
+        q[2] = color[2];
     }
 }
 
-// Input is an ETC1 compressed version of the data.
-// Output is a 4 x 4 square of 3-byte pixels in form R, G, B
-
-void etc1_decode_block(const etc1_byte* pIn, etc1_byte* pOut) {
+// Decode a block into 3-byte pixels, where row y starts at
+// pOut + rowStride * y.
+static
+void decode_block(const etc1_byte* pIn, etc1_byte* pOut, etc1_uint32 rowStride) {
     etc1_uint32 high = (pIn[0] << 24) | (pIn[1] << 16) | (pIn[2] << 8) | pIn[3];
     etc1_uint32 low = (pIn[4] << 24) | (pIn[5] << 16) | (pIn[6] << 8) | pIn[7];
     int r1, r2, g1, g2, b1, b2;
@@ -226,8 +236,15 @@ void etc1_decode_block(const etc1_byte* pIn, etc1_byte* pOut) {
     const int* tableA = kModifierTable + tableIndexA * 4;
     const int* tableB = kModifierTable + tableIndexB * 4;
     bool flipped = (high & 1) != 0;
-    decode_subblock(pOut, r1, g1, b1, tableA, low, false, flipped);
-    decode_subblock(pOut, r2, g2, b2, tableB, low, true, flipped);
+    decode_subblock(pOut, rowStride, r1, g1, b1, tableA, low, false, flipped);
+    decode_subblock(pOut, rowStride, r2, g2, b2, tableB, low, true, flipped);
+}
+
+// Input is an ETC1 compressed version of the data.
+// Output is a 4 x 4 square of 3-byte pixels in form R, G, B
+
+void etc1_decode_block(const etc1_byte* pIn, etc1_byte* pOut) {
+    decode_block(pIn, pOut, 4 * 3);
 }
 
 typedef struct {
@@ -568,16 +585,26 @@ int etc1_encode_image(const etc1_byte* pIn, etc1_uint32 width, etc1_uint32 heigh
 int etc1_decode_image(const etc1_byte* pIn, etc1_byte* pOut,
         etc1_uint32 width, etc1_uint32 height,
         etc1_uint32 pixelSize, etc1_uint32 stride) {
-    if (pixelSize < 2 || pixelSize > 3) {
+    return etc1_decode_image_rows(pIn, pOut, width, height, pixelSize, stride,
+            0, height);
+}
+
+int etc1_decode_image_rows(const etc1_byte* pIn, etc1_byte* pOut,
+        etc1_uint32 width, etc1_uint32 height,
+        etc1_uint32 pixelSize, etc1_uint32 stride,
+        etc1_uint32 firstRow, etc1_uint32 numRows) {
+    if (pixelSize < 2 || pixelSize > 3 || (firstRow & 3) ||
+            firstRow > height || numRows > height - firstRow) {
         return -1;
     }
     etc1_byte block[ETC1_DECODED_BLOCK_SIZE];
 
     etc1_uint32 encodedWidth = (width + 3) & ~3;
-    etc1_uint32 encodedHeight = (height + 3) & ~3;
+    etc1_uint32 lastRow = firstRow + numRows;
 
-    for (etc1_uint32 y = 0; y < encodedHeight; y += 4) {
-        etc1_uint32 yEnd = height - y;
+    pIn += (firstRow / 4) * (encodedWidth / 4) * ETC1_ENCODED_BLOCK_SIZE;
+    for (etc1_uint32 y = firstRow; y < lastRow; y += 4) {
+        etc1_uint32 yEnd = lastRow - y;
         if (yEnd > 4) {
             yEnd = 4;
         }
@@ -586,6 +613,12 @@ int etc1_decode_image(const etc1_byte* pIn, etc1_byte* pOut,
             if (xEnd > 4) {
                 xEnd = 4;
             }
+            if (pixelSize == 3 && xEnd == 4 && yEnd == 4) {
+                // Whole blocks go straight to the image.
+                decode_block(pIn, pOut + 3 * x + stride * y, stride);
+                pIn += ETC1_ENCODED_BLOCK_SIZE;
+                continue;
+            }
             etc1_decode_block(pIn, block);
             pIn += ETC1_ENCODED_BLOCK_SIZE;
             for (etc1_uint32 cy = 0; cy < yEnd; cy++) {
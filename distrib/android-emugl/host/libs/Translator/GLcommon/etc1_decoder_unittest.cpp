@@ -0,0 +1,188 @@
+// Copyright (C) 2015 The Android Open Source Project
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "GLcommon/Etc1Decoder.h"
+
+#include <gtest/gtest.h>
+
+#include <vector>
+
+#include <string.h>
+
+namespace {
+
+// Value of the bytes of the output buffers that the decoder must not write.
+const etc1_byte kPadding = 0xa5;
+
+// Returns the compressed data of a |width| x |height| image. Any 8 bytes
+// are a valid ETC1 block, so this is pseudo-random data from |seed|.
+std::vector<etc1_byte> makeImage(etc1_uint32 width, etc1_uint32 height,
+                                 uint32_t seed) {
+    std::vector<etc1_byte> data(etc1_get_encoded_data_size(width, height));
+    uint32_t state = seed * 2654435761U + 1;
+    for (size_t n = 0; n < data.size(); ++n) {
+        state = state * 1103515245U + 12345U;
+        data[n] = (etc1_byte)(state >> 16);
+    }
+    return data;
+}
+
+// Rows of 3-byte pixels, with some padding at their end.
+etc1_uint32 strideFor(etc1_uint32 width) {
+    return width * 3 + 5;
+}
+
+// Decodes |data| with the serial decoder.
+std::vector<etc1_byte> decodeSerial(const std::vector<etc1_byte>& data,
+                                    etc1_uint32 width, etc1_uint32 height) {
+    std::vector<etc1_byte> pixels(strideFor(width) * height, kPadding);
+    EXPECT_EQ(0, etc1_decode_image(&data[0], &pixels[0], width, height, 3,
+                                   strideFor(width)));
+    return pixels;
+}
+
+class Etc1DecoderTest : public ::testing::Test {
+protected:
+    virtual void SetUp() { setEtc1CacheSize(0); }
+    virtual void TearDown() { setEtc1CacheSize(0); }
+};
+
+}  // namespace
+
+TEST_F(Etc1DecoderTest, ParallelMatchesSerial) {
+    static const struct {
+        etc1_uint32 width;
+        etc1_uint32 height;
+    } kSizes[] = {
+        { 1, 1 }, { 3, 5 }, { 5, 3 }, { 13, 11 }, { 37, 29 },
+        { 4, 33 }, { 129, 67 }, { 255, 257 },
+    };
+    for (size_t n = 0; n < sizeof(kSizes) / sizeof(kSizes[0]); ++n) {
+        const etc1_uint32 width = kSizes[n].width;
+        const etc1_uint32 height = kSizes[n].height;
+        const std::vector<etc1_byte> data = makeImage(width, height, n);
+        const std::vector<etc1_byte> expected =
+                decodeSerial(data, width, height);
+
+        for (int numThreads = 1; numThreads <= 9; ++numThreads) {
+            std::vector<etc1_byte> pixels(strideFor(width) * height,
+                                          kPadding);
+            EXPECT_EQ(0, decodeEtc1ImageParallel(&data[0], &pixels[0], width,
+                                                 height, strideFor(width),
+                                                 numThreads));
+            EXPECT_TRUE(pixels == expected)
+                    << width << "x" << height << " with " << numThreads
+                    << " threads";
+        }
+    }
+}
+
+TEST_F(Etc1DecoderTest, LargeImage) {
+    // Large enough to be split between threads by decodeEtc1Image().
+    const etc1_uint32 width = 1021;
+    const etc1_uint32 height = 515;
+    const std::vector<etc1_byte> data = makeImage(width, height, 1);
+    const std::vector<etc1_byte> expected = decodeSerial(data, width, height);
+
+    Etc1PixelsPtr pixels = decodeEtc1Image(&data[0], width, height,
+                                           strideFor(width));
+    ASSERT_TRUE(pixels.Ptr() != NULL);
+    ASSERT_EQ(expected.size(), pixels->size());
+    // The padding of the rows is left uninitialized.
+    for (etc1_uint32 y = 0; y < height; ++y) {
+        const size_t offset = y * strideFor(width);
+        ASSERT_EQ(0, memcmp(&expected[offset], pixels->data() + offset,
+                            width * 3)) << "row " << y;
+    }
+}
+
+TEST_F(Etc1DecoderTest, NoCache) {
+    const std::vector<etc1_byte> data = makeImage(13, 11, 1);
+    Etc1PixelsPtr first = decodeEtc1Image(&data[0], 13, 11, strideFor(13));
+    Etc1PixelsPtr second = decodeEtc1Image(&data[0], 13, 11, strideFor(13));
+    ASSERT_TRUE(first.Ptr() != NULL);
+    ASSERT_TRUE(second.Ptr() != NULL);
+    EXPECT_NE(first.Ptr(), second.Ptr());
+}
+
+TEST_F(Etc1DecoderTest, CacheHitAndMiss) {
+    setEtc1CacheSize(1024 * 1024);
+    const etc1_uint32 width = 13;
+    const etc1_uint32 height = 11;
+    const etc1_uint32 stride = strideFor(width);
+    const std::vector<etc1_byte> data1 = makeImage(width, height, 1);
+    const std::vector<etc1_byte> data2 = makeImage(width, height, 2);
+    ASSERT_EQ(data1.size(), data2.size());
+    ASSERT_FALSE(data1 == data2);
+
+    Etc1PixelsPtr first1 = decodeEtc1Image(&data1[0], width, height, stride);
+    // A different image of the same size is a miss.
+    Etc1PixelsPtr first2 = decodeEtc1Image(&data2[0], width, height, stride);
+    ASSERT_TRUE(first1.Ptr() != NULL);
+    ASSERT_TRUE(first2.Ptr() != NULL);
+    EXPECT_NE(first1.Ptr(), first2.Ptr());
+
+    // Both are hits now, and return the pixels of their own image.
+    EXPECT_EQ(first1.Ptr(), decodeEtc1Image(&data1[0], width, height,
+                                            stride).Ptr());
+    EXPECT_EQ(first2.Ptr(), decodeEtc1Image(&data2[0], width, height,
+                                            stride).Ptr());
+    const std::vector<etc1_byte> expected1 = decodeSerial(data1, width, height);
+    const std::vector<etc1_byte> expected2 = decodeSerial(data2, width, height);
+    for (etc1_uint32 y = 0; y < height; ++y) {
+        EXPECT_EQ(0, memcmp(&expected1[y * stride],
+                            first1->data() + y * stride, width * 3));
+        EXPECT_EQ(0, memcmp(&expected2[y * stride],
+                            first2->data() + y * stride, width * 3));
+    }
+
+    // The same data with another layout is a miss.
+    Etc1PixelsPtr otherStride = decodeEtc1Image(&data1[0], width, height,
+                                                stride + 1);
+    ASSERT_TRUE(otherStride.Ptr() != NULL);
+    EXPECT_NE(first1.Ptr(), otherStride.Ptr());
+}
+
+TEST_F(Etc1DecoderTest, CacheEvictsLeastRecentlyUsed) {
+    const etc1_uint32 width = 16;
+    const etc1_uint32 height = 16;
+    const etc1_uint32 stride = width * 3;
+    const size_t entrySize =
+            etc1_get_encoded_data_size(width, height) + stride * height;
+    setEtc1CacheSize(2 * entrySize);
+
+    const std::vector<etc1_byte> data1 = makeImage(width, height, 1);
+    const std::vector<etc1_byte> data2 = makeImage(width, height, 2);
+    const std::vector<etc1_byte> data3 = makeImage(width, height, 3);
+    Etc1PixelsPtr first1 = decodeEtc1Image(&data1[0], width, height, stride);
+    Etc1PixelsPtr first2 = decodeEtc1Image(&data2[0], width, height, stride);
+    // Makes the second image the least recently used.
+    EXPECT_EQ(first1.Ptr(), decodeEtc1Image(&data1[0], width, height,
+                                            stride).Ptr());
+    Etc1PixelsPtr first3 = decodeEtc1Image(&data3[0], width, height, stride);
+
+    EXPECT_EQ(first1.Ptr(), decodeEtc1Image(&data1[0], width, height,
+                                            stride).Ptr());
+    EXPECT_EQ(first3.Ptr(), decodeEtc1Image(&data3[0], width, height,
+                                            stride).Ptr());
+    Etc1PixelsPtr second2 = decodeEtc1Image(&data2[0], width, height, stride);
+    EXPECT_NE(first2.Ptr(), second2.Ptr());
+    EXPECT_EQ(second2.Ptr(), decodeEtc1Image(&data2[0], width, height,
+                                             stride).Ptr());
+
+    // Disabling the cache empties it.
+    setEtc1CacheSize(0);
+    EXPECT_NE(second2.Ptr(), decodeEtc1Image(&data2[0], width, height,
+                                             stride).Ptr());
+}
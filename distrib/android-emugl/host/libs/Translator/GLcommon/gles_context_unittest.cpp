@@ -0,0 +1,136 @@
+// Copyright (C) 2015 The Android Open Source Project
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "GLcommon/GLEScontext.h"
+
+#include <gtest/gtest.h>
+
+#include <string.h>
+
+namespace {
+
+// Only implements what's needed to call the array conversion methods.
+class TestContext : public GLEScontext {
+public:
+    using GLEScontext::convertIndirectVBO;
+
+    virtual void setupArraysPointers(GLESConversionArrays& fArrs,
+                                     GLint first,
+                                     GLsizei count,
+                                     GLenum type,
+                                     const GLvoid* indices,
+                                     bool direct) {}
+    virtual int getMaxTexUnits() { return 1; }
+
+protected:
+    virtual bool needConvert(GLESConversionArrays& fArrs,
+                             GLint first,
+                             GLsizei count,
+                             GLenum type,
+                             const GLvoid* indices,
+                             bool direct,
+                             GLESpointer* p,
+                             GLenum array_id) { return false; }
+    virtual void initExtensionString() {}
+    virtual void setupArr(const GLvoid* arr,
+                          GLenum arrayType,
+                          GLenum dataType,
+                          GLint size,
+                          GLsizei stride,
+                          GLboolean normalized,
+                          int pointsIndex) {}
+};
+
+const int kVertices = 8;
+const GLfixed kOne = 0x10000;
+
+// A GL_FIXED position array of |kVertices| single-component vertices,
+// where vertex |n| holds n + 1.
+void setupBuffer(GLESbuffer* buffer, GLESpointer* p) {
+    GLfixed data[kVertices];
+    for (int n = 0; n < kVertices; ++n) {
+        data[n] = (n + 1) * kOne;
+    }
+    buffer->setBuffer(sizeof(data), GL_STATIC_DRAW, data);
+    p->setBuffer(1, GL_FIXED, 0, buffer, 1, 0);
+}
+
+GLfixed fixedAt(GLESbuffer* buffer, int n) {
+    GLfixed value;
+    memcpy(&value, static_cast<char*>(buffer->getData()) + n * sizeof(value),
+           sizeof(value));
+    return value;
+}
+
+GLfloat floatAt(GLESbuffer* buffer, int n) {
+    GLfloat value;
+    memcpy(&value, static_cast<char*>(buffer->getData()) + n * sizeof(value),
+           sizeof(value));
+    return value;
+}
+
+}  // namespace
+
+TEST(GLEScontext, ConvertIndirectVBOSparseIndices) {
+    TestContext context;
+    GLESbuffer buffer;
+    GLESpointer p;
+    setupBuffer(&buffer, &p);
+
+    // Elements that no draw references must be left alone: they may not
+    // even be GL_FIXED vertices.
+    const GLushort kIndices[] = { 1, 5, 1 };
+    GLESConversionArrays arrays;
+    context.convertIndirectVBO(arrays, 3, GL_UNSIGNED_SHORT, kIndices,
+                               GL_VERTEX_ARRAY, &p);
+    EXPECT_EQ(2.0f, floatAt(&buffer, 1));
+    EXPECT_EQ(6.0f, floatAt(&buffer, 5));
+    for (int n = 0; n < kVertices; ++n) {
+        if (n != 1 && n != 5) {
+            EXPECT_EQ((n + 1) * kOne, fixedAt(&buffer, n)) << "vertex " << n;
+        }
+    }
+
+    // A later draw converts the elements in between, and only once the
+    // ones already converted.
+    const GLubyte kMoreIndices[] = { 2, 3, 4, 5 };
+    context.convertIndirectVBO(arrays, 4, GL_UNSIGNED_BYTE, kMoreIndices,
+                               GL_VERTEX_ARRAY, &p);
+    for (int n = 1; n <= 5; ++n) {
+        EXPECT_EQ((GLfloat)(n + 1), floatAt(&buffer, n)) << "vertex " << n;
+    }
+    EXPECT_EQ(kOne, fixedAt(&buffer, 0));
+    EXPECT_EQ(7 * kOne, fixedAt(&buffer, 6));
+}
+
+TEST(GLEScontext, ConvertIndirectVBOContiguousIndicesAreCached) {
+    TestContext context;
+    GLESbuffer buffer;
+    GLESpointer p;
+    setupBuffer(&buffer, &p);
+
+    const GLushort kIndices[] = { 3, 2, 4, 2 };
+    GLESConversionArrays arrays;
+    context.convertIndirectVBO(arrays, 4, GL_UNSIGNED_SHORT, kIndices,
+                               GL_VERTEX_ARRAY, &p);
+    GLESbufferConversion* conv =
+            buffer.getConversion(0, sizeof(GLfixed), 1, GL_FIXED);
+    EXPECT_EQ(2, conv->begin);
+    EXPECT_EQ(5, conv->end);
+    for (int n = 2; n <= 4; ++n) {
+        EXPECT_EQ((GLfloat)(n + 1), floatAt(&buffer, n)) << "vertex " << n;
+    }
+    EXPECT_EQ(2 * kOne, fixedAt(&buffer, 1));
+    EXPECT_EQ(6 * kOne, fixedAt(&buffer, 5));
+}
@@ -0,0 +1,258 @@
+/*
+* Copyright (C) 2015 The Android Open Source Project
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+* http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*/
+
+// Compares the local to global name lookups of the ShareGroup, as done for
+// nearly every translated GL call that names an object, between:
+//
+//   - map: the previous implementation, a std::map searched with the
+//     ShareGroup's lock held.
+//
+//   - table: the NameTable, whose lookups of small names don't take any
+//     lock.
+//
+// The names follow the distributions seen with real applications:
+//
+//   - sequential: a few hundred objects named 1..N by glGen*(), with a
+//     draw loop that keeps binding a small hot subset of them.
+//
+//   - churn: the same, after many objects have been deleted and created
+//     again, e.g. by an app that streams its textures. Names stay small,
+//     but have holes.
+//
+//   - large: names above the dense range, like the ones made up from
+//     EGLImage handles, which take the slow path of both implementations.
+//
+// Each case runs with 1 thread, then with several threads sharing the same
+// table, like render threads whose contexts are in the same share group.
+//
+// Usage: emugl_name_table_benchmark [<lookups per thread> [<threads>]]
+
+#include "GLcommon/NameTable.h"
+#include "GLcommon/objectNameManager.h"
+
+#include "emugl/common/mutex.h"
+#include "emugl/common/thread.h"
+
+#include <map>
+#include <vector>
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/time.h>
+
+namespace {
+
+int64_t nowUs() {
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return (int64_t)tv.tv_sec * 1000000LL + tv.tv_usec;
+}
+
+// The previous implementation of NameSpace + ShareGroup lookups.
+class MapLookup {
+public:
+    void set(ObjectLocalName localName, unsigned int globalName) {
+        emugl::Mutex::AutoLock lock(mLock);
+        mMap[localName] = globalName;
+    }
+
+    unsigned int get(ObjectLocalName localName) {
+        emugl::Mutex::AutoLock lock(mLock);
+        std::map<ObjectLocalName, unsigned int>::iterator it =
+                mMap.find(localName);
+        return (it != mMap.end()) ? it->second : 0;
+    }
+
+private:
+    emugl::Mutex mLock;
+    std::map<ObjectLocalName, unsigned int> mMap;
+};
+
+// The new one, see ShareGroup::getGlobalName().
+class TableLookup {
+public:
+    void set(ObjectLocalName localName, unsigned int globalName) {
+        emugl::Mutex::AutoLock lock(mLock);
+        mTable.set(localName, globalName);
+    }
+
+    unsigned int get(ObjectLocalName localName) {
+        bool exists;
+        unsigned int globalName;
+        if (mTable.lookupDense(localName, &exists, &globalName)) {
+            return globalName;
+        }
+        emugl::Mutex::AutoLock lock(mLock);
+        return mTable.find(localName, &globalName) ? globalName : 0;
+    }
+
+private:
+    emugl::Mutex mLock;
+    NameTable mTable;
+};
+
+template <class LOOKUP>
+class LookupThread : public emugl::Thread {
+public:
+    LookupThread(LOOKUP* lookup,
+                 const std::vector<ObjectLocalName>* names,
+                 size_t count) :
+            mLookup(lookup), mNames(names), mCount(count), mSum(0) {}
+
+    virtual intptr_t main() {
+        const std::vector<ObjectLocalName>& names = *mNames;
+        size_t n = 0;
+        for (size_t i = 0; i < mCount; ++i) {
+            mSum += mLookup->get(names[n]);
+            if (++n == names.size()) {
+                n = 0;
+            }
+        }
+        return 0;
+    }
+
+    unsigned int sum() const { return mSum; }
+
+private:
+    LOOKUP* mLookup;
+    const std::vector<ObjectLocalName>* mNames;
+    size_t mCount;
+    unsigned int mSum;
+};
+
+// Run |count| lookups of |names| on each of |numThreads| threads, and
+// return the average time per lookup in nanoseconds.
+template <class LOOKUP>
+double runLookups(LOOKUP* lookup,
+                  const std::vector<ObjectLocalName>& names,
+                  size_t count,
+                  int numThreads) {
+    std::vector<LookupThread<LOOKUP>*> threads;
+    for (int i = 0; i < numThreads; ++i) {
+        threads.push_back(new LookupThread<LOOKUP>(lookup, &names, count));
+    }
+    int64_t start = nowUs();
+    for (int i = 0; i < numThreads; ++i) {
+        threads[i]->start();
+    }
+    unsigned int sum = 0;
+    for (int i = 0; i < numThreads; ++i) {
+        threads[i]->wait(NULL);
+        sum += threads[i]->sum();
+        delete threads[i];
+    }
+    int64_t elapsedUs = nowUs() - start;
+    if (sum == 1) {
+        // Never true, prevents the lookups from being optimized out.
+        printf("!");
+    }
+    return elapsedUs * 1000.0 / count;
+}
+
+struct Distribution {
+    const char* name;
+    std::vector<ObjectLocalName> allNames;   // names that exist.
+    std::vector<ObjectLocalName> hotNames;   // names looked up, in order.
+};
+
+void makeDistributions(std::vector<Distribution>* result) {
+    const int kNumObjects = 400;
+    const int kNumHot = 48;
+    srand(1);
+
+    Distribution sequential;
+    sequential.name = "sequential";
+    for (int i = 1; i <= kNumObjects; ++i) {
+        sequential.allNames.push_back(i);
+    }
+
+    Distribution churn;
+    churn.name = "churn";
+    std::vector<bool> used(8 * kNumObjects, false);
+    for (int i = 0; i < kNumObjects; ++i) {
+        int name;
+        do {
+            name = 1 + rand() % (int)(used.size() - 1);
+        } while (used[name]);
+        used[name] = true;
+        churn.allNames.push_back(name);
+    }
+
+    Distribution large;
+    large.name = "large";
+    for (int i = 0; i < kNumObjects; ++i) {
+        large.allNames.push_back(NameTable::kDenseLimit + 4096ULL * i);
+    }
+
+    result->push_back(sequential);
+    result->push_back(churn);
+    result->push_back(large);
+    for (size_t d = 0; d < result->size(); ++d) {
+        Distribution& dist = (*result)[d];
+        for (int i = 0; i < 16 * kNumHot; ++i) {
+            dist.hotNames.push_back(dist.allNames[rand() % kNumHot]);
+        }
+    }
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+    size_t count = 10 * 1000 * 1000;
+    int numThreads = 4;
+    if (argc > 1) {
+        count = (size_t)atol(argv[1]);
+    }
+    if (argc > 2) {
+        numThreads = atoi(argv[2]);
+    }
+    if (!count || numThreads < 1) {
+        fprintf(stderr,
+                "Usage: %s [<lookups per thread> [<threads>]]\n", argv[0]);
+        return 1;
+    }
+
+    std::vector<Distribution> dists;
+    makeDistributions(&dists);
+
+    printf("%-12s %8s %12s %12s %8s\n",
+           "names", "threads", "map ns/op", "table ns/op", "speedup");
+    for (size_t d = 0; d < dists.size(); ++d) {
+        const Distribution& dist = dists[d];
+        MapLookup mapLookup;
+        TableLookup tableLookup;
+        // Fill each one separately, so that their allocations don't
+        // interleave, which would skew the results.
+        for (size_t i = 0; i < dist.allNames.size(); ++i) {
+            mapLookup.set(dist.allNames[i], 1000 + i);
+        }
+        for (size_t i = 0; i < dist.allNames.size(); ++i) {
+            tableLookup.set(dist.allNames[i], 1000 + i);
+        }
+        int threadCounts[2] = { 1, numThreads };
+        for (int t = 0; t < (numThreads > 1 ? 2 : 1); ++t) {
+            double mapNs = runLookups(&mapLookup, dist.hotNames, count,
+                                      threadCounts[t]);
+            double tableNs = runLookups(&tableLookup, dist.hotNames, count,
+                                        threadCounts[t]);
+            printf("%-12s %8d %12.2f %12.2f %7.1fx\n",
+                   dist.name, threadCounts[t], mapNs, tableNs,
+                   tableNs > 0 ? mapNs / tableNs : 0.);
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,173 @@
+// Copyright (C) 2015 The Android Open Source Project
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "GLcommon/NameTable.h"
+#include "GLcommon/objectNameManager.h"
+
+#include "emugl/common/thread.h"
+
+#include <gtest/gtest.h>
+
+#include <set>
+
+namespace {
+
+// Local names of the three kinds stored by a NameTable.
+const ObjectLocalName kDenseName = 42;
+const ObjectLocalName kInternalName = NameTable::kInternalBase + 1;
+const ObjectLocalName kSparseName = NameTable::kDenseLimit + 7;
+
+void collectGlobalName(void* ctx, unsigned int name) {
+    static_cast<std::set<unsigned int>*>(ctx)->insert(name);
+}
+
+// Adds and removes kDenseName repeatedly, with a different non-zero global
+// name each time.
+class SetRemoveThread : public emugl::Thread {
+public:
+    static const unsigned int kIterations = 2000000;
+
+    explicit SetRemoveThread(NameTable* table) : mTable(table) {}
+
+    virtual intptr_t main() {
+        for (unsigned int n = 1; n <= kIterations; ++n) {
+            unsigned int globalName;
+            mTable->set(kDenseName, n);
+            mTable->remove(kDenseName, &globalName);
+        }
+        return 0;
+    }
+
+private:
+    NameTable* mTable;
+};
+
+}  // namespace
+
+TEST(NameTable, Empty) {
+    NameTable table;
+    unsigned int globalName = 1234;
+    bool exists = true;
+    EXPECT_FALSE(table.find(kDenseName, &globalName));
+    EXPECT_TRUE(table.lookupDense(kDenseName, &exists, &globalName));
+    EXPECT_FALSE(exists);
+    EXPECT_EQ(0U, globalName);
+    EXPECT_EQ(0U, table.findLocalName(1));
+}
+
+TEST(NameTable, SetFindRemove) {
+    const ObjectLocalName kNames[] = { kDenseName, kInternalName, kSparseName };
+    NameTable table;
+    for (size_t n = 0; n < sizeof(kNames) / sizeof(kNames[0]); ++n) {
+        const ObjectLocalName name = kNames[n];
+        const unsigned int global = 100 + n;
+        unsigned int globalName = 0;
+
+        table.set(name, global);
+        EXPECT_TRUE(table.find(name, &globalName));
+        EXPECT_EQ(global, globalName);
+        EXPECT_EQ(name, table.findLocalName(global));
+
+        table.set(name, global + 10);
+        EXPECT_TRUE(table.find(name, &globalName));
+        EXPECT_EQ(global + 10, globalName);
+
+        EXPECT_TRUE(table.remove(name, &globalName));
+        EXPECT_EQ(global + 10, globalName);
+        EXPECT_FALSE(table.find(name, &globalName));
+        EXPECT_FALSE(table.remove(name, &globalName));
+    }
+}
+
+TEST(NameTable, LookupDense) {
+    NameTable table;
+    table.set(kDenseName, 1);
+    table.set(kInternalName, 2);
+    table.set(kSparseName, 3);
+
+    bool exists = false;
+    unsigned int globalName = 0;
+    EXPECT_TRUE(table.lookupDense(kDenseName, &exists, &globalName));
+    EXPECT_TRUE(exists);
+    EXPECT_EQ(1U, globalName);
+
+    // Default texture names don't need the lock either.
+    EXPECT_TRUE(table.lookupDense(kInternalName, &exists, &globalName));
+    EXPECT_TRUE(exists);
+    EXPECT_EQ(2U, globalName);
+    EXPECT_TRUE(table.lookupDense(kInternalName + 1, &exists, &globalName));
+    EXPECT_FALSE(exists);
+
+    // Other large names do.
+    EXPECT_FALSE(table.lookupDense(kSparseName, &exists, &globalName));
+    EXPECT_FALSE(table.lookupDense(NameTable::kInternalBase +
+                                   NameTable::kPageSize,
+                                   &exists, &globalName));
+}
+
+TEST(NameTable, ForEachGlobalName) {
+    NameTable table;
+    table.set(1, 10);
+    table.set(NameTable::kPageSize + 1, 11);
+    table.set(kInternalName, 12);
+    table.set(kSparseName, 13);
+    unsigned int globalName;
+    table.set(2, 14);
+    table.remove(2, &globalName);
+
+    std::set<unsigned int> names;
+    table.forEachGlobalName(collectGlobalName, &names);
+    EXPECT_EQ(4U, names.size());
+    for (unsigned int n = 10; n <= 13; ++n) {
+        EXPECT_EQ(1U, names.count(n));
+    }
+}
+
+TEST(NameTable, ObjectData) {
+    NameTable table;
+    EXPECT_FALSE(table.getData(kDenseName).Ptr());
+
+    ObjectDataPtr first(new ObjectData());
+    ObjectDataPtr second(new ObjectData());
+    table.setData(kInternalName, first);
+    // Like std::map::insert(), existing data is kept.
+    table.setData(kInternalName, second);
+    EXPECT_EQ(first.Ptr(), table.getData(kInternalName).Ptr());
+
+    unsigned int globalName;
+    table.remove(kInternalName, &globalName);
+    EXPECT_FALSE(table.getData(kInternalName).Ptr());
+}
+
+TEST(NameTable, LookupDenseDuringUpdates) {
+    NameTable table;
+    // Allocate the page first.
+    table.set(kDenseName + 1, 1);
+    SetRemoveThread thread(&table);
+    ASSERT_TRUE(thread.start());
+    unsigned int lastName = 0;
+    while (!thread.tryWait(NULL)) {
+        bool exists;
+        unsigned int globalName;
+        ASSERT_TRUE(table.lookupDense(kDenseName, &exists, &globalName));
+        if (exists) {
+            // Never a removed name with its cleared global name.
+            ASSERT_NE(0U, globalName);
+            ASSERT_LE(lastName, globalName);
+            lastName = globalName;
+        } else {
+            ASSERT_EQ(0U, globalName);
+        }
+    }
+}
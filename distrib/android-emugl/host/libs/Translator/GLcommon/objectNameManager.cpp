@@ -24,13 +24,25 @@ NameSpace::NameSpace(NamedObjectType p_type,
     m_type(p_type),
     m_globalNameSpace(globalNameSpace) {}
 
+namespace {
+
+struct DeleteGlobalNameContext {
+    GlobalNameSpace *globalNameSpace;
+    NamedObjectType type;
+};
+
+void deleteGlobalName(void *ctx, unsigned int p_name)
+{
+    DeleteGlobalNameContext *context = (DeleteGlobalNameContext *)ctx;
+    context->globalNameSpace->deleteName(context->type, p_name);
+}
+
+}  // namespace
+
 NameSpace::~NameSpace()
 {
-    for (NamesMap::iterator n = m_localToGlobalMap.begin();
-         n != m_localToGlobalMap.end();
-         n++) {
-        m_globalNameSpace->deleteName(m_type, (*n).second);
-    }
+    DeleteGlobalNameContext context = { m_globalNameSpace, m_type };
+    m_localToGlobalMap.forEachGlobalName(deleteGlobalName, &context);
 }
 
 ObjectLocalName
@@ -39,16 +51,16 @@ NameSpace::genName(ObjectLocalName p_localName,
 {
     ObjectLocalName localName = p_localName;
     if (genLocal) {
+        unsigned int globalName;
         do {
             localName = ++m_nextName;
         } while(localName == 0 ||
-                m_localToGlobalMap.find(localName) !=
-                        m_localToGlobalMap.end() );
+                m_localToGlobalMap.find(localName, &globalName));
     }
 
     if (genGlobal) {
         unsigned int globalName = m_globalNameSpace->genName(m_type);
-        m_localToGlobalMap[localName] = globalName;
+        m_localToGlobalMap.set(localName, globalName);
     }
 
     return localName;
@@ -64,56 +76,68 @@ NameSpace::genGlobalName(void)
 unsigned int
 NameSpace::getGlobalName(ObjectLocalName p_localName)
 {
-    NamesMap::iterator n( m_localToGlobalMap.find(p_localName) );
-    if (n != m_localToGlobalMap.end()) {
+    unsigned int globalName;
+    if (m_localToGlobalMap.find(p_localName, &globalName)) {
         // object found - return its global name map
-        return (*n).second;
+        return globalName;
     }
 
     // object does not exist;
     return 0;
 }
 
+bool
+NameSpace::lookupGlobalName(ObjectLocalName p_localName,
+                            bool *p_exists,
+                            unsigned int *p_globalName) const
+{
+    return m_localToGlobalMap.lookupDense(p_localName, p_exists, p_globalName);
+}
+
 ObjectLocalName
 NameSpace::getLocalName(unsigned int p_globalName)
 {
-    for(NamesMap::iterator it = m_localToGlobalMap.begin(); it != m_localToGlobalMap.end();it++){
-        if((*it).second == p_globalName){
-            // object found - return its local name
-            return (*it).first;
-        }
-    }
-
-    // object does not exist;
-    return 0;
+    return m_localToGlobalMap.findLocalName(p_globalName);
 }
 
 void
 NameSpace::deleteName(ObjectLocalName p_localName)
 {
-    NamesMap::iterator n( m_localToGlobalMap.find(p_localName) );
-    if (n != m_localToGlobalMap.end()) {
-        m_globalNameSpace->deleteName(m_type, (*n).second);
-        m_localToGlobalMap.erase(p_localName);
+    unsigned int globalName;
+    if (m_localToGlobalMap.remove(p_localName, &globalName)) {
+        m_globalNameSpace->deleteName(m_type, globalName);
     }
 }
 
 bool
 NameSpace::isObject(ObjectLocalName p_localName)
 {
-    return (m_localToGlobalMap.find(p_localName) != m_localToGlobalMap.end() );
+    unsigned int globalName;
+    return m_localToGlobalMap.find(p_localName, &globalName);
 }
 
 void
 NameSpace::replaceGlobalName(ObjectLocalName p_localName, unsigned int p_globalName)
 {
-    NamesMap::iterator n( m_localToGlobalMap.find(p_localName) );
-    if (n != m_localToGlobalMap.end()) {
-        m_globalNameSpace->deleteName(m_type, (*n).second);
-        (*n).second = p_globalName;
+    unsigned int globalName;
+    if (m_localToGlobalMap.find(p_localName, &globalName)) {
+        m_globalNameSpace->deleteName(m_type, globalName);
+        m_localToGlobalMap.set(p_localName, p_globalName);
     }
 }
 
+void
+NameSpace::setObjectData(ObjectLocalName p_localName, ObjectDataPtr data)
+{
+    m_localToGlobalMap.setData(p_localName, data);
+}
+
+ObjectDataPtr
+NameSpace::getObjectData(ObjectLocalName p_localName)
+{
+    return m_localToGlobalMap.getData(p_localName);
+}
+
 
 GlobalNameSpace::GlobalNameSpace() : m_lock() {}
 
@@ -151,15 +175,10 @@ GlobalNameSpace::deleteName(NamedObjectType p_type, unsigned int p_name)
 {
 }
 
-typedef std::pair<NamedObjectType, ObjectLocalName> ObjectIDPair;
-typedef std::map<ObjectIDPair, ObjectDataPtr> ObjectDataMap;
-
 ShareGroup::ShareGroup(GlobalNameSpace *globalNameSpace) : m_lock() {
     for (int i=0; i < NUM_OBJECT_TYPES; i++) {
         m_nameSpace[i] = new NameSpace((NamedObjectType)i, globalNameSpace);
     }
-
-    m_objectsData = NULL;
 }
 
 ShareGroup::~ShareGroup()
@@ -168,8 +187,6 @@ ShareGroup::~ShareGroup()
     for (int t = 0; t < NUM_OBJECT_TYPES; t++) {
         delete m_nameSpace[t];
     }
-
-    delete (ObjectDataMap *)m_objectsData;
 }
 
 ObjectLocalName
@@ -200,6 +217,12 @@ ShareGroup::getGlobalName(NamedObjectType p_type,
 {
     if (p_type >= NUM_OBJECT_TYPES) return 0;
 
+    bool exists;
+    unsigned int globalName;
+    if (m_nameSpace[p_type]->lookupGlobalName(p_localName, &exists, &globalName)) {
+        return globalName;
+    }
+
     emugl::Mutex::AutoLock _lock(m_lock);
     return m_nameSpace[p_type]->getGlobalName(p_localName);
 }
@@ -221,10 +244,6 @@ ShareGroup::deleteName(NamedObjectType p_type, ObjectLocalName p_localName)
 
     emugl::Mutex::AutoLock _lock(m_lock);
     m_nameSpace[p_type]->deleteName(p_localName);
-    ObjectDataMap *map = (ObjectDataMap *)m_objectsData;
-    if (map) {
-        map->erase( ObjectIDPair(p_type, p_localName) );
-    }
 }
 
 bool
@@ -232,6 +251,12 @@ ShareGroup::isObject(NamedObjectType p_type, ObjectLocalName p_localName)
 {
     if (p_type >= NUM_OBJECT_TYPES) return 0;
 
+    bool exists;
+    unsigned int globalName;
+    if (m_nameSpace[p_type]->lookupGlobalName(p_localName, &exists, &globalName)) {
+        return exists;
+    }
+
     emugl::Mutex::AutoLock _lock(m_lock);
     return m_nameSpace[p_type]->isObject(p_localName);
 }
@@ -255,15 +280,7 @@ ShareGroup::setObjectData(NamedObjectType p_type,
     if (p_type >= NUM_OBJECT_TYPES) return;
 
     emugl::Mutex::AutoLock _lock(m_lock);
-
-    ObjectDataMap *map = (ObjectDataMap *)m_objectsData;
-    if (!map) {
-        map = new ObjectDataMap();
-        m_objectsData = map;
-    }
-
-    ObjectIDPair id( p_type, p_localName );
-    map->insert( std::pair<ObjectIDPair, ObjectDataPtr>(id, data) );
+    m_nameSpace[p_type]->setObjectData(p_localName, data);
 }
 
 ObjectDataPtr
@@ -274,15 +291,10 @@ ShareGroup::getObjectData(NamedObjectType p_type,
 
     if (p_type >= NUM_OBJECT_TYPES) return ret;
 
+    // NOTE: This one keeps the lock, since copying the ObjectDataPtr
+    // would race with its release by a concurrent deleteName().
     emugl::Mutex::AutoLock _lock(m_lock);
-
-    ObjectDataMap *map = (ObjectDataMap *)m_objectsData;
-    if (map) {
-        ObjectDataMap::iterator i =
-                map->find( ObjectIDPair(p_type, p_localName) );
-        if (i != map->end()) ret = (*i).second;
-    }
-    return ret;
+    return m_nameSpace[p_type]->getObjectData(p_localName);
 }
 
 ObjectNameManager::ObjectNameManager(GlobalNameSpace *globalNameSpace) :
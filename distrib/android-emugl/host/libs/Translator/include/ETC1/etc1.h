@@ -79,6 +79,18 @@ int etc1_decode_image(const etc1_byte* pIn, etc1_byte* pOut,
         etc1_uint32 width, etc1_uint32 height,
         etc1_uint32 pixelSize, etc1_uint32 stride);
 
+// Decode the rows [firstRow, firstRow + numRows) of an entire image, e.g. to
+// decode separate parts of it in parallel.
+// pIn, pOut, width, height, pixelSize and stride are the same as for
+// etc1_decode_image(), and describe the entire image.
+// firstRow must be a multiple of 4.
+// returns non-zero if there is an error.
+
+int etc1_decode_image_rows(const etc1_byte* pIn, etc1_byte* pOut,
+        etc1_uint32 width, etc1_uint32 height,
+        etc1_uint32 pixelSize, etc1_uint32 stride,
+        etc1_uint32 firstRow, etc1_uint32 numRows);
+
 // Size of a PKM header, in bytes.
 
 #define ETC_PKM_HEADER_SIZE 16
@@ -0,0 +1,87 @@
+/*
+* Copyright (C) 2015 The Android Open Source Project
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+* http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*/
+#ifndef _ETC1_DECODER_H
+#define _ETC1_DECODER_H
+
+#include "ETC1/etc1.h"
+#include "emugl/common/smart_ptr.h"
+
+#include <stddef.h>
+
+//
+// Class Etc1Pixels - buffer of decoded pixels. Its content is left
+//                    uninitialized, unlike a std::vector's, since the
+//                    decoder overwrites it all anyway.
+//
+class Etc1Pixels
+{
+public:
+    explicit Etc1Pixels(size_t p_size) :
+            m_data(new etc1_byte[p_size]), m_size(p_size) {}
+    ~Etc1Pixels() { delete [] m_data; }
+
+    etc1_byte *data() const { return m_data; }
+    size_t size() const { return m_size; }
+
+private:
+    etc1_byte *m_data;
+    size_t m_size;
+
+    // Not copyable.
+    Etc1Pixels(const Etc1Pixels&);
+    Etc1Pixels& operator=(const Etc1Pixels&);
+};
+
+typedef emugl::SmartPtr<Etc1Pixels> Etc1PixelsPtr;
+
+//
+// decodeEtc1Image - decodes the ETC1 image of |p_width| x |p_height| pixels
+//                   at |p_data|, into 3-byte R, G, B pixels with rows of
+//                   |p_stride| bytes. Returns an empty pointer on error.
+//
+//   Large images are split in bands of rows, decoded in parallel by worker
+//   threads.
+//
+//   If the ANDROID_EMUGL_ETC1_CACHE environment variable is set to a size
+//   in megabytes, the decoded pixels of the most recently used images are
+//   kept in a cache shared by all contexts, keyed by their compressed
+//   content. Uploading the same image again, e.g. when a game reloads a
+//   level, then skips the decoding. The returned pixels are shared with
+//   the cache, and must not be modified.
+//
+Etc1PixelsPtr decodeEtc1Image(const etc1_byte *p_data,
+                              etc1_uint32 p_width,
+                              etc1_uint32 p_height,
+                              etc1_uint32 p_stride);
+
+//
+// decodeEtc1ImageParallel - decodes an image like decodeEtc1Image(), into
+//                           |p_pixels|, with at most |p_numThreads| threads
+//                           and without the cache. Returns non-zero on
+//                           error.
+//
+int decodeEtc1ImageParallel(const etc1_byte *p_data, etc1_byte *p_pixels,
+                            etc1_uint32 p_width, etc1_uint32 p_height,
+                            etc1_uint32 p_stride, int p_numThreads);
+
+//
+// setEtc1CacheSize - sets the maximum size of the cache of decoded images
+//                    in bytes, overriding ANDROID_EMUGL_ETC1_CACHE. 0
+//                    disables the cache and empties it.
+//
+void setEtc1CacheSize(size_t p_maxSize);
+
+#endif
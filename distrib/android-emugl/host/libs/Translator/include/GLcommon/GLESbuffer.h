@@ -17,10 +17,30 @@
 #define GLES_BUFFER_H
 
 #include <stdio.h>
+#include <vector>
 #include <GLES/gl.h>
 #include <GLcommon/objectNameManager.h>
 #include <GLcommon/RangeManip.h>
 
+// Records the conversion of the elements of one vertex attribute stored in
+// a buffer, so that static geometry is converted only once instead of on
+// each draw. The attribute is identified by its layout in the buffer:
+// |offset|, |stride| in bytes, |size| in components, and |type|.
+// Elements [begin, end) have been converted since the buffer's content was
+// last changed. GL_FIXED attributes are converted in place, while GL_BYTE
+// ones are converted into |data|, which holds GL_SHORT components for
+// elements [0, end), and has room for |capacity| elements.
+struct GLESbufferConversion {
+    int      offset;
+    int      stride;
+    int      size;
+    GLenum   type;
+    int      begin;
+    int      end;
+    int      capacity;
+    GLshort* data;
+};
+
 class GLESbuffer: public ObjectData {
 public:
    GLESbuffer():ObjectData(BUFFER_DATA),m_size(0),m_usage(GL_STATIC_DRAW),m_data(NULL),m_wasBound(false){}
@@ -33,6 +53,7 @@ public:
    bool  fullyConverted(){return m_conversionManager.size() == 0;};
    void  setBinded(){m_wasBound = true;};
    bool  wasBinded(){return m_wasBound;};
+   GLESbufferConversion* getConversion(int offset,int stride,int size,GLenum type);
    ~GLESbuffer();
 
 private:
@@ -41,6 +62,9 @@ private:
     unsigned char* m_data;
     RangeList      m_conversionManager;
     bool           m_wasBound;
+    std::vector<GLESbufferConversion> m_conversions;
+
+    void invalidateConversions();
 };
 
 typedef emugl::SmartPtr<GLESbuffer> GLESbufferPtr;
@@ -188,6 +188,8 @@ protected:
     void convertDirectVBO(GLESConversionArrays& fArrs,GLint first,GLsizei count,GLenum array_id,GLESpointer* p);
     void convertIndirect(GLESConversionArrays& fArrs,GLsizei count,GLenum type,const GLvoid* indices,GLenum array_id,GLESpointer* p);
     void convertIndirectVBO(GLESConversionArrays& fArrs,GLsizei count,GLenum indices_type,const GLvoid* indices,GLenum array_id,GLESpointer* p);
+    void convertFixedVBO(GLint begin,GLint end,GLESpointer* p);
+    void convertByteVBO(GLESConversionArrays& fArrs,GLint first,GLsizei count,GLenum indices_type,const GLvoid* indices,bool direct,GLESpointer* p);
     void initCapsLocked(const GLubyte * extensionString);
     virtual void initExtensionString() =0;
 
@@ -33,7 +33,7 @@ public:
     GLboolean     getNormalized() const { return m_normalize ? GL_TRUE : GL_FALSE; }
     const GLvoid* getData() const;
     unsigned int  getBufferOffset() const;
-    void          redirectPointerData();
+    GLESbuffer*   getBuffer() const { return m_buffer; }
     void          getBufferConversions(const RangeList& rl,RangeList& rlOut);
     bool          bufferNeedConversion(){ return !m_buffer->fullyConverted();}
     void          setArray (GLint size,GLenum type,GLsizei stride,const GLvoid* data,bool normalize = false);
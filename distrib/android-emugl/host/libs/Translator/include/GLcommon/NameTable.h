@@ -0,0 +1,156 @@
+/*
+* Copyright (C) 2015 The Android Open Source Project
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+* http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*/
+#ifndef _NAME_TABLE_H
+#define _NAME_TABLE_H
+
+#include "emugl/common/smart_ptr.h"
+
+#include <map>
+
+class ObjectData;
+typedef emugl::SmartPtr<ObjectData> ObjectDataPtr;
+typedef unsigned long long ObjectLocalName;
+
+//
+// Class NameTable - maps the local names of a single NameSpace to their
+//                   global names, and holds the ObjectData attached to them.
+//
+//   GL object names are small integers, that the guest allocates
+//   sequentially. Names below kDenseLimit are thus stored in a two-level
+//   array: a fixed directory of pages, each one holding kPageSize
+//   consecutive names, allocated on first use. One more page holds the
+//   names that start at kInternalBase, which the translator uses for the
+//   default textures, see GLEScontext::getDefaultTextureName(). Other
+//   names are rare, and are kept in a std::map.
+//
+//   NOTE: All methods must be called with the owner's lock held, except
+//         lookupDense(), which doesn't need any lock. This works because
+//         pages are never moved or freed before the table is destroyed,
+//         and entries are updated under a sequence counter, see Entry.
+//
+class NameTable
+{
+public:
+    NameTable();
+    ~NameTable();
+
+    //
+    // lookupDense - lock-free lookup of a local name. Returns false if
+    //               |p_localName| is not stored in a page, and the caller
+    //               must use find() with the lock held instead. Otherwise,
+    //               returns true and sets |*p_exists| and |*p_globalName|.
+    //
+    bool lookupDense(ObjectLocalName p_localName,
+                     bool *p_exists,
+                     unsigned int *p_globalName) const;
+
+    //
+    // find - returns true and sets |*p_globalName| if |p_localName|
+    //        exists in the table.
+    //
+    bool find(ObjectLocalName p_localName, unsigned int *p_globalName) const;
+
+    //
+    // set - adds |p_localName| to the table, or changes its global name
+    //       if it already exists.
+    //
+    void set(ObjectLocalName p_localName, unsigned int p_globalName);
+
+    //
+    // remove - removes |p_localName| and its object data from the table.
+    //          Returns true and sets |*p_globalName| if the name existed.
+    //
+    bool remove(ObjectLocalName p_localName, unsigned int *p_globalName);
+
+    //
+    // findLocalName - returns the local name mapped to |p_globalName|, or
+    //                 0 if there is none. This scans the whole table.
+    //
+    ObjectLocalName findLocalName(unsigned int p_globalName) const;
+
+    //
+    // setData - attaches |p_data| to |p_localName|, unless it already has
+    //           some data attached, like std::map::insert() would.
+    //
+    void setData(ObjectLocalName p_localName, ObjectDataPtr p_data);
+
+    //
+    // getData - returns the object data of |p_localName|, if any.
+    //
+    ObjectDataPtr getData(ObjectLocalName p_localName) const;
+
+    //
+    // forEachGlobalName - calls |p_func| with the global name of each local
+    //                     name in the table.
+    //
+    void forEachGlobalName(void (*p_func)(void *p_ctx, unsigned int p_name),
+                           void *p_ctx) const;
+
+    // Names from 0 to kDenseLimit - 1 are stored in pages.
+    static const unsigned int kPageBits = 10;
+    static const unsigned int kPageSize = 1U << kPageBits;
+    static const unsigned int kMaxPages = 256;
+    static const ObjectLocalName kDenseLimit =
+            (ObjectLocalName)kPageSize * kMaxPages;
+    // Names from kInternalBase to kInternalBase + kPageSize - 1 are stored
+    // in the extra page. This is a multiple of kPageSize.
+    static const ObjectLocalName kInternalBase = 0x100000000ULL;
+
+private:
+    // |sequence| is odd while set() or remove() update |globalName| and
+    // |exists|, and changes with each update, so that lookupDense() can
+    // retry instead of returning a mix of two states, e.g. a name that
+    // exists with a global name of 0.
+    struct Entry {
+        Entry();
+
+        volatile unsigned int sequence;
+        volatile unsigned int globalName;
+        volatile unsigned int exists;
+        ObjectDataPtr data;
+    };
+
+    struct Page {
+        Entry entries[kPageSize];
+    };
+
+    typedef std::map<ObjectLocalName, Entry> SparseMap;
+
+    // Returns true and sets |*p_index| to the page holding |p_localName|,
+    // or returns false if it is not stored in a page.
+    static bool pageIndex(ObjectLocalName p_localName, unsigned int *p_index);
+
+    // Returns the first local name of page |p_index|.
+    static ObjectLocalName pageBase(unsigned int p_index);
+
+    // Returns the entry of |p_localName|, or NULL if there is none.
+    // If |p_create| is true, creates it instead of returning NULL.
+    Entry *getEntry(ObjectLocalName p_localName, bool p_create);
+    const Entry *getEntry(ObjectLocalName p_localName) const;
+
+    // Update the global name and existence of |p_entry|.
+    static void updateEntry(Entry *p_entry, unsigned int p_globalName,
+                            bool p_exists);
+
+    Page * volatile m_pages[kMaxPages + 1];
+    SparseMap m_sparse;
+
+    // Not copyable.
+    NameTable(const NameTable&);
+    NameTable& operator=(const NameTable&);
+};
+
+#endif
@@ -19,6 +19,7 @@
 #include <map>
 #include "emugl/common/mutex.h"
 #include "emugl/common/smart_ptr.h"
+#include "GLcommon/NameTable.h"
 
 enum NamedObjectType {
     VERTEXBUFFER = 0,
@@ -47,9 +48,6 @@ public:
 private:
     ObjectDataType m_dataType;
 };
-typedef emugl::SmartPtr<ObjectData> ObjectDataPtr;
-typedef unsigned long long ObjectLocalName;
-typedef std::map<ObjectLocalName, unsigned int> NamesMap;
 
 //
 // Class NameSpace - this class manages allocations and deletions of objects
@@ -91,6 +89,15 @@ private:
     //
     unsigned int getGlobalName(ObjectLocalName p_localName);
 
+    //
+    // lookupGlobalName - lock-free version of getGlobalName() and isObject().
+    //                    Returns false if the caller must use these with the
+    //                    lock held instead.
+    //
+    bool lookupGlobalName(ObjectLocalName p_localName,
+                          bool *p_exists,
+                          unsigned int *p_globalName) const;
+
     //
     // getLocaalName - returns the local name of an object or 0 if the object
     //                 does not exist.
@@ -113,9 +120,16 @@ private:
     //
     void replaceGlobalName(ObjectLocalName p_localName, unsigned int p_globalName);
 
+    //
+    // setObjectData / getObjectData - attach and retrieve the data of a
+    //                                 named object.
+    //
+    void setObjectData(ObjectLocalName p_localName, ObjectDataPtr data);
+    ObjectDataPtr getObjectData(ObjectLocalName p_localName);
+
 private:
     ObjectLocalName m_nextName;
-    NamesMap m_localToGlobalMap;
+    NameTable m_localToGlobalMap;
     const NamedObjectType m_type;
     GlobalNameSpace *m_globalNameSpace;
 };
@@ -138,7 +152,9 @@ private:
 //   there will be one inctance of ShareGroup for each user OpenGL context
 //   unless the user context share with another user context. In that case they
 //   both will share the same ShareGroup instance.
-//   calls into that class gets serialized through a lock so it is thread safe.
+//   calls into that class gets serialized through a lock so it is thread safe,
+//   except for the lookups of global names and of existing objects, which
+//   are lock-free for the usual small object names (see NameTable).
 //
 class ShareGroup
 {
@@ -206,7 +222,6 @@ private:
 private:
     emugl::Mutex m_lock;
     NameSpace *m_nameSpace[NUM_OBJECT_TYPES];
-    void *m_objectsData;
 };
 
 typedef emugl::SmartPtr<ShareGroup> ShareGroupPtr;
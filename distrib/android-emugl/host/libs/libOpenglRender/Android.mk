@@ -19,6 +19,7 @@ endif
 
 host_common_SRC_FILES := \
     $(host_OS_SRCS) \
+    ChannelStream.cpp \
     ColorBuffer.cpp \
     EGLDispatch.cpp \
     FbConfig.cpp \
@@ -26,12 +27,15 @@ host_common_SRC_FILES := \
     GLESv1Dispatch.cpp \
     GLESv2Dispatch.cpp \
     ReadBuffer.cpp \
+    ReadbackWorker.cpp \
+    RenderChannel.cpp \
     RenderContext.cpp \
     RenderControl.cpp \
     RenderServer.cpp \
     RenderThread.cpp \
     RenderThreadInfo.cpp \
     render_api.cpp \
+    StreamDump.cpp \
     RenderWindow.cpp \
     TextureDraw.cpp \
     WindowSurface.cpp \
@@ -84,3 +88,56 @@ LOCAL_STATIC_LIBRARIES += lib64emugl_common
 $(call emugl-export,CFLAGS,$(host_common_CFLAGS))
 
 $(call emugl-end-module)
+
+
+### emugl_render_channel_benchmark #######################################
+# Compares the RenderServer socket transports with RenderChannel. Not run
+# automatically.
+$(call emugl-begin-host-executable,emugl_render_channel_benchmark)
+$(call emugl-import,libOpenglCodecCommon libemugl_common)
+LOCAL_SRC_FILES := \
+    ChannelStream.cpp \
+    RenderChannel.cpp \
+    render_channel_benchmark.cpp \
+
+LOCAL_C_INCLUDES += $(EMUGL_PATH)/host/libs/Translator/include
+$(call emugl-end-module)
+
+
+### emugl_stream_replay ##################################################
+# Replays command streams captured with RENDERER_DUMP_DIR against an
+# offscreen FrameBuffer, and reports frame and per-call timings. See
+# stream_replay.cpp. Not run automatically.
+$(call emugl-begin-host-executable,emugl_stream_replay)
+$(call emugl-import,libGLESv1_dec libGLESv2_dec lib_renderControl_dec libOpenglCodecCommon)
+
+LOCAL_LDLIBS += $(host_common_LDLIBS)
+
+LOCAL_SRC_FILES := \
+    $(host_common_SRC_FILES) \
+    stream_replay.cpp \
+
+LOCAL_C_INCLUDES += $(EMUGL_PATH)/host/include
+LOCAL_C_INCLUDES += $(EMUGL_PATH)/host/libs/Translator/include
+
+LOCAL_STATIC_LIBRARIES += libemugl_common
+
+$(call emugl-end-module)
+
+
+### emugl_render_host_unittests ##########################################
+$(call emugl-begin-host-executable,emugl_render_host_unittests)
+$(call emugl-import,libemugl_common libemugl_gtest)
+LOCAL_SRC_FILES := \
+    StreamDump.cpp \
+    stream_dump_unittest.cpp \
+
+$(call emugl-end-module)
+
+$(call emugl-begin-host64-executable,emugl64_render_host_unittests)
+$(call emugl-import,lib64emugl_common lib64emugl_gtest)
+LOCAL_SRC_FILES := \
+    StreamDump.cpp \
+    stream_dump_unittest.cpp \
+
+$(call emugl-end-module)
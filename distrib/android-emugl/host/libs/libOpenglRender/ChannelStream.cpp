@@ -0,0 +1,101 @@
+/*
+* Copyright (C) 2015 The Android Open Source Project
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+* http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*/
+#include "ChannelStream.h"
+
+#include "RenderChannel.h"
+
+#include <stdlib.h>
+
+ChannelStream::ChannelStream(RenderChannel* channel, size_t bufSize) :
+    IOStream(bufSize),
+    m_channel(channel),
+    m_bufsize(bufSize),
+    m_buf(NULL)
+{
+}
+
+ChannelStream::~ChannelStream()
+{
+    m_channel->hostClose();
+    m_channel->decRef();
+    free(m_buf);
+}
+
+void *ChannelStream::allocBuffer(size_t minSize)
+{
+    size_t allocSize = (m_bufsize < minSize ? minSize : m_bufsize);
+    if (!m_buf) {
+        m_buf = (unsigned char *)malloc(allocSize);
+    }
+    else if (m_bufsize < allocSize) {
+        unsigned char *p = (unsigned char *)realloc(m_buf, allocSize);
+        if (p != NULL) {
+            m_buf = p;
+            m_bufsize = allocSize;
+        } else {
+            ERR("%s: realloc (%zu) failed\n", __FUNCTION__, allocSize);
+            free(m_buf);
+            m_buf = NULL;
+            m_bufsize = 0;
+        }
+    }
+
+    return m_buf;
+}
+
+int ChannelStream::commitBuffer(size_t size)
+{
+    return writeFully(m_buf, size);
+}
+
+int ChannelStream::writeFully(const void *buf, size_t len)
+{
+    return m_channel->hostWrite(buf, len) ? 0 : -1;
+}
+
+const unsigned char *ChannelStream::readFully(void *buf, size_t len)
+{
+    if (!buf) {
+        return NULL;
+    }
+    size_t res = len;
+    while (res > 0) {
+        size_t stat = m_channel->hostRead((char *)buf + len - res, res);
+        if (stat == 0) {  // guest closed the channel
+            return NULL;
+        }
+        res -= stat;
+    }
+    return (const unsigned char *)buf;
+}
+
+const unsigned char *ChannelStream::read(void *buf, size_t *inout_len)
+{
+    if (!buf) {
+        return NULL;
+    }
+    size_t stat = m_channel->hostRead(buf, *inout_len);
+    if (stat == 0) {
+        return NULL;
+    }
+    *inout_len = stat;
+    return (const unsigned char *)buf;
+}
+
+void ChannelStream::forceStop()
+{
+    m_channel->hostClose();
+}
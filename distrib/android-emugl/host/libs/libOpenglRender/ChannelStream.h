@@ -0,0 +1,44 @@
+/*
+* Copyright (C) 2015 The Android Open Source Project
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+* http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*/
+#ifndef _LIB_OPENGL_RENDER_CHANNEL_STREAM_H
+#define _LIB_OPENGL_RENDER_CHANNEL_STREAM_H
+
+#include "IOStream.h"
+
+class RenderChannel;
+
+// An IOStream used by a RenderThread to talk to its guest client through
+// the host side of a RenderChannel. Takes ownership of one reference to
+// the channel, and closes its host side when destroyed.
+class ChannelStream : public IOStream {
+public:
+    explicit ChannelStream(RenderChannel* channel, size_t bufSize = 10000);
+    virtual ~ChannelStream();
+
+    virtual void *allocBuffer(size_t minSize);
+    virtual int commitBuffer(size_t size);
+    virtual const unsigned char *readFully(void *buf, size_t len);
+    virtual const unsigned char *read(void *buf, size_t *inout_len);
+    virtual int writeFully(const void *buf, size_t len);
+    virtual void forceStop();
+
+private:
+    RenderChannel* m_channel;
+    size_t m_bufsize;
+    unsigned char *m_buf;
+};
+
+#endif  // _LIB_OPENGL_RENDER_CHANNEL_STREAM_H
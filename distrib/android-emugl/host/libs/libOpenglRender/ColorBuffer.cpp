@@ -19,6 +19,7 @@
 #include "GLESv1Dispatch.h"
 #include "GLcommon/GLutils.h"
 #include "GLESv2Dispatch.h"
+#include "ReadbackWorker.h"
 #include "RenderThreadInfo.h"
 #include "TextureDraw.h"
 
@@ -173,6 +174,7 @@ ColorBuffer* ColorBuffer::create(EGLDisplay p_display,
     cb->m_width = p_width;
     cb->m_height = p_height;
     cb->m_internalFormat = texInternalFormat;
+    cb->m_dirtyEnd = p_height;
 
     if (has_eglimage_texture_2d) {
         cb->m_eglImage = s_egl.eglCreateImageKHR(
@@ -200,7 +202,11 @@ ColorBuffer::ColorBuffer(EGLDisplay display, Helper* helper) :
         m_fbo(0),
         m_internalFormat(0),
         m_display(display),
-        m_helper(helper) {}
+        m_helper(helper),
+        m_dirtyLock(),
+        m_dirtyStart(0),
+        m_dirtyEnd(0),
+        m_dirtyUntracked(false) {}
 
 ColorBuffer::~ColorBuffer() {
     ScopedHelperContext context(m_helper);
@@ -254,6 +260,7 @@ void ColorBuffer::subUpdate(int x,
     s_gles2.glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
     s_gles2.glTexSubImage2D(
             GL_TEXTURE_2D, 0, x, y, width, height, p_format, p_type, pixels);
+    markDirtyRows(y, height);
 }
 
 bool ColorBuffer::blitFromCurrentReadBuffer()
@@ -306,6 +313,7 @@ bool ColorBuffer::blitFromCurrentReadBuffer()
 
     // render m_blitTex
     m_helper->getTextureDraw()->draw(m_blitTex, 0.);
+    markDirtyRows(0, m_height);
 
     // Restore previous viewport.
     s_gles2.glViewport(vport[0], vport[1], vport[2], vport[3]);
@@ -318,6 +326,10 @@ bool ColorBuffer::bindToTexture() {
     if (!m_eglImage) {
         return false;
     }
+    {
+        emugl::Mutex::AutoLock lock(m_dirtyLock);
+        m_dirtyUntracked = true;
+    }
     RenderThreadInfo *tInfo = RenderThreadInfo::get();
     if (!tInfo->currContext.Ptr()) {
         return false;
@@ -335,6 +347,10 @@ bool ColorBuffer::bindToRenderbuffer() {
     if (!m_eglImage) {
         return false;
     }
+    {
+        emugl::Mutex::AutoLock lock(m_dirtyLock);
+        m_dirtyUntracked = true;
+    }
     RenderThreadInfo *tInfo = RenderThreadInfo::get();
     if (!tInfo->currContext.Ptr()) {
         return false;
@@ -354,13 +370,59 @@ bool ColorBuffer::post(float rotation) {
 }
 
 void ColorBuffer::readback(unsigned char* img) {
+    readback(img, 0, m_height);
+}
+
+void ColorBuffer::readback(unsigned char* img, int y, int height) {
+    ScopedHelperContext context(m_helper);
+    if (!context.isOk()) {
+        return;
+    }
+    if (bindFbo(&m_fbo, m_tex)) {
+        s_gles2.glReadPixels(0, y, m_width, height, GL_RGBA, GL_UNSIGNED_BYTE,
+                             img + (size_t)y * m_width * 4);
+        unbindFbo();
+    }
+}
+
+void ColorBuffer::readbackAsync(ReadbackWorker* worker, int y, int height) {
     ScopedHelperContext context(m_helper);
     if (!context.isOk()) {
         return;
     }
     if (bindFbo(&m_fbo, m_tex)) {
-        s_gles2.glReadPixels(
-                0, 0, m_width, m_height, GL_RGBA, GL_UNSIGNED_BYTE, img);
+        worker->queueReadback(y, height);
         unbindFbo();
     }
 }
+
+void ColorBuffer::markDirtyRows(int y, int height) {
+    emugl::Mutex::AutoLock lock(m_dirtyLock);
+    if (m_dirtyStart >= m_dirtyEnd) {
+        m_dirtyStart = y;
+        m_dirtyEnd = y + height;
+    } else {
+        if (y < m_dirtyStart) {
+            m_dirtyStart = y;
+        }
+        if (y + height > m_dirtyEnd) {
+            m_dirtyEnd = y + height;
+        }
+    }
+}
+
+bool ColorBuffer::takeDirtyRows(int* y, int* height) {
+    emugl::Mutex::AutoLock lock(m_dirtyLock);
+    if (m_dirtyUntracked) {
+        *y = 0;
+        *height = m_height;
+        return true;
+    }
+    if (m_dirtyStart >= m_dirtyEnd) {
+        return false;
+    }
+    *y = m_dirtyStart < 0 ? 0 : m_dirtyStart;
+    *height = (m_dirtyEnd > (int)m_height ? (int)m_height : m_dirtyEnd) - *y;
+    m_dirtyStart = m_dirtyEnd = 0;
+    return *height > 0;
+}
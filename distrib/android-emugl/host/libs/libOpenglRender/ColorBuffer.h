@@ -19,8 +19,10 @@
 #include <EGL/egl.h>
 #include <EGL/eglext.h>
 #include <GLES/gl.h>
+#include "emugl/common/mutex.h"
 #include "emugl/common/smart_ptr.h"
 
+class ReadbackWorker;
 class TextureDraw;
 
 // A class used to model a guest color buffer, and used to implement several
@@ -133,11 +135,30 @@ public:
     // |img| must be a buffer large enough (i.e. width * height * 4).
     void readback(unsigned char* img);
 
+    // Same as above, but only read rows [y, y + height), into the same rows
+    // of |img|. The other rows of |img| are left untouched.
+    void readback(unsigned char* img, int y, int height);
+
+    // Start an asynchronous readback of rows [y, y + height) through
+    // |worker|, which delivers the pixels once they are available.
+    void readbackAsync(ReadbackWorker* worker, int y, int height);
+
+    // Return the range of rows that may have changed since the previous
+    // call in |*y| and |*height|, and reset it. Returns false if nothing
+    // changed. Only subUpdate() updates are tracked precisely; after
+    // blitFromCurrentReadBuffer(), the whole buffer is reported. Once the
+    // buffer was bound with bindToTexture() or bindToRenderbuffer(), GL
+    // rendering can change it at any time, so the whole buffer is always
+    // reported.
+    bool takeDirtyRows(int* y, int* height);
+
 private:
     ColorBuffer();  // no default constructor.
 
     explicit ColorBuffer(EGLDisplay display, Helper* helper);
 
+    void markDirtyRows(int y, int height);
+
 private:
     GLuint m_tex;
     GLuint m_blitTex;
@@ -149,6 +170,14 @@ private:
     GLenum m_internalFormat;
     EGLDisplay m_display;
     Helper* m_helper;
+
+    // |m_dirtyLock| protects the rows changed since the last call to
+    // takeDirtyRows(), i.e. [m_dirtyStart, m_dirtyEnd), empty when
+    // |m_dirtyStart >= m_dirtyEnd|.
+    emugl::Mutex m_dirtyLock;
+    int m_dirtyStart;
+    int m_dirtyEnd;
+    bool m_dirtyUntracked;
 };
 
 typedef emugl::SmartPtr<ColorBuffer> ColorBufferPtr;
@@ -66,11 +66,11 @@ public:
     ColorBufferHelper(FrameBuffer* fb) : mFb(fb) {}
 
     virtual bool setupContext() {
-        return mFb->bind_locked();
+        return mFb->lockContextAndBind();
     }
 
     virtual void teardownContext() {
-        mFb->unbind_locked();
+        mFb->unbindAndUnlockContext();
     }
 
     virtual TextureDraw* getTextureDraw() const {
@@ -150,6 +150,11 @@ static char* getGLES1ExtensionString(EGLDisplay p_dpy)
 }
 
 void FrameBuffer::finalize(){
+    m_postLock.lock();
+    delete m_readbackWorker;
+    m_readbackWorker = NULL;
+    m_postLock.unlock();
+
     m_colorbuffers.clear();
     if (m_useSubWindow) {
         removeSubWindow();
@@ -437,14 +442,21 @@ FrameBuffer::FrameBuffer(int p_width, int p_height, bool useSubWindow) :
     m_onPost(NULL),
     m_onPostContext(NULL),
     m_fbImage(NULL),
+    m_readbackWorker(NULL),
+    m_asyncReadback(false),
+    m_partialReadback(false),
+    m_lastReadbackColorBuffer(0),
     m_glVendor(NULL),
     m_glRenderer(NULL),
     m_glVersion(NULL)
 {
     m_fpsStats = getenv("SHOW_FPS_STATS") != NULL;
+    m_asyncReadback = getenv("ANDROID_EMUGL_ASYNC_READBACK") != NULL;
+    m_partialReadback = getenv("ANDROID_EMUGL_PARTIAL_READBACK") != NULL;
 }
 
 FrameBuffer::~FrameBuffer() {
+    delete m_readbackWorker;
     delete m_textureDraw;
     delete m_configs;
     delete m_colorBufferHelper;
@@ -453,7 +465,12 @@ FrameBuffer::~FrameBuffer() {
 
 void FrameBuffer::setPostCallback(OnPostFn onPost, void* onPostContext)
 {
-    emugl::Mutex::AutoLock mutex(m_lock);
+    emugl::Mutex::AutoLock mutex(m_postLock);
+    // The worker calls the previous callback, and holds the previous frame.
+    delete m_readbackWorker;
+    m_readbackWorker = NULL;
+    m_lastReadbackColorBuffer = 0;
+
     m_onPost = onPost;
     m_onPostContext = onPostContext;
     if (m_onPost && !m_fbImage) {
@@ -481,7 +498,9 @@ bool FrameBuffer::setupSubWindow(FBNativeWindowType p_window,
         return false;
     }
 
+    m_postLock.lock();
     m_lock.lock();
+    bool needPost = false;
     if (!m_subWin) {
         // create native subwindow for FB display output
         m_subWin = createSubWindow(p_window, p_x, p_y, p_width, p_height);
@@ -506,7 +525,7 @@ bool FrameBuffer::setupSubWindow(FBNativeWindowType p_window,
                     s_gles2.glViewport(0, 0, p_width, p_height);
                     m_zRot = zRot;
                     if (m_lastPostedColorBuffer) {
-                        post(m_lastPostedColorBuffer, false);
+                        needPost = true;
                     } else {
                         s_gles2.glClear(GL_COLOR_BUFFER_BIT |
                                         GL_DEPTH_BUFFER_BIT |
@@ -520,6 +539,11 @@ bool FrameBuffer::setupSubWindow(FBNativeWindowType p_window,
         }
     }
     m_lock.unlock();
+    // post() acquires |m_lock| itself, so must be called after releasing it.
+    if (needPost) {
+        post(m_lastPostedColorBuffer, false);
+    }
+    m_postLock.unlock();
     return success;
 }
 
@@ -530,6 +554,7 @@ bool FrameBuffer::removeSubWindow() {
         return false;
     }
     bool removed = false;
+    m_postLock.lock();
     m_lock.lock();
     if (m_subWin) {
         s_egl.eglMakeCurrent(m_eglDisplay, NULL, NULL, NULL);
@@ -541,27 +566,57 @@ bool FrameBuffer::removeSubWindow() {
         removed = true;
     }
     m_lock.unlock();
+    m_postLock.unlock();
     return removed;
 }
 
+//
+// The objects lock should be held when calling this function !
+//
 HandleType FrameBuffer::genHandle()
 {
     HandleType id;
     do {
         id = ++s_nextHandle;
     } while( id == 0 ||
-             m_contexts.find(id) != m_contexts.end() ||
-             m_windows.find(id) != m_windows.end() );
+             m_contexts.contains(id) ||
+             m_windows.contains(id) ||
+             m_colorbuffers.contains(id) );
 
     return id;
 }
 
+ColorBufferPtr FrameBuffer::findColorBuffer(HandleType p_colorbuffer)
+{
+    ColorBufferRef ref;
+    if (!m_colorbuffers.find(p_colorbuffer, &ref)) {
+        return ColorBufferPtr(NULL);
+    }
+    return ref.cb;
+}
+
+RenderContextPtr FrameBuffer::findRenderContext(HandleType p_context)
+{
+    RenderContextPtr ctx(NULL);
+    m_contexts.find(p_context, &ctx);
+    return ctx;
+}
+
+WindowSurfacePtr FrameBuffer::findWindowSurface(HandleType p_surface)
+{
+    std::pair<WindowSurfacePtr, HandleType> win;
+    if (!m_windows.find(p_surface, &win)) {
+        return WindowSurfacePtr(NULL);
+    }
+    return win.first;
+}
+
 HandleType FrameBuffer::createColorBuffer(int p_width, int p_height,
                                           GLenum p_internalFormat)
 {
-    emugl::Mutex::AutoLock mutex(m_lock);
     HandleType ret = 0;
 
+    // NOTE: ColorBuffer::create() acquires |m_lock| through the helper.
     ColorBufferPtr cb(ColorBuffer::create(
             getDisplay(),
             p_width,
@@ -570,9 +625,12 @@ HandleType FrameBuffer::createColorBuffer(int p_width, int p_height,
             getCaps().has_eglimage_texture_2d,
             m_colorBufferHelper));
     if (cb.Ptr() != NULL) {
+        emugl::Mutex::AutoLock mutex(m_objectsLock);
         ret = genHandle();
-        m_colorbuffers[ret].cb = cb;
-        m_colorbuffers[ret].refcount = 1;
+        ColorBufferRef ref;
+        ref.cb = cb;
+        ref.refcount = 1;
+        m_colorbuffers.set(ret, ref);
     }
     return ret;
 }
@@ -580,7 +638,7 @@ HandleType FrameBuffer::createColorBuffer(int p_width, int p_height,
 HandleType FrameBuffer::createRenderContext(int p_config, HandleType p_share,
                                             bool p_isGL2)
 {
-    emugl::Mutex::AutoLock mutex(m_lock);
+    emugl::Mutex::AutoLock mutex(m_contextCreationLock);
     HandleType ret = 0;
 
     const FbConfig* config = getConfigs()->get(p_config);
@@ -590,11 +648,10 @@ HandleType FrameBuffer::createRenderContext(int p_config, HandleType p_share,
 
     RenderContextPtr share(NULL);
     if (p_share != 0) {
-        RenderContextMap::iterator s(m_contexts.find(p_share));
-        if (s == m_contexts.end()) {
+        share = findRenderContext(p_share);
+        if (!share.Ptr()) {
             return ret;
         }
-        share = (*s).second;
     }
     EGLContext sharedContext =
             share.Ptr() ? share->getEGLContext() : EGL_NO_CONTEXT;
@@ -602,8 +659,9 @@ HandleType FrameBuffer::createRenderContext(int p_config, HandleType p_share,
     RenderContextPtr rctx(RenderContext::create(
         m_eglDisplay, config->getEglConfig(), sharedContext, p_isGL2));
     if (rctx.Ptr() != NULL) {
+        emugl::Mutex::AutoLock objectsMutex(m_objectsLock);
         ret = genHandle();
-        m_contexts[ret] = rctx;
+        m_contexts.set(ret, rctx);
         RenderThreadInfo *tinfo = RenderThreadInfo::get();
         tinfo->m_contextSet.insert(ret);
     }
@@ -612,8 +670,6 @@ HandleType FrameBuffer::createRenderContext(int p_config, HandleType p_share,
 
 HandleType FrameBuffer::createWindowSurface(int p_config, int p_width, int p_height)
 {
-    emugl::Mutex::AutoLock mutex(m_lock);
-
     HandleType ret = 0;
 
     const FbConfig* config = getConfigs()->get(p_config);
@@ -624,8 +680,9 @@ HandleType FrameBuffer::createWindowSurface(int p_config, int p_width, int p_hei
     WindowSurfacePtr win(WindowSurface::create(
             getDisplay(), config->getEglConfig(), p_width, p_height));
     if (win.Ptr() != NULL) {
+        emugl::Mutex::AutoLock mutex(m_objectsLock);
         ret = genHandle();
-        m_windows[ret] = std::pair<WindowSurfacePtr, HandleType>(win,0);
+        m_windows.set(ret, std::pair<WindowSurfacePtr, HandleType>(win,0));
         RenderThreadInfo *tinfo = RenderThreadInfo::get();
         tinfo->m_windowSet.insert(ret);
     }
@@ -635,34 +692,32 @@ HandleType FrameBuffer::createWindowSurface(int p_config, int p_width, int p_hei
 
 void FrameBuffer::drainRenderContext()
 {
-    emugl::Mutex::AutoLock mutex(m_lock);
+    emugl::Mutex::AutoLock mutex(m_objectsLock);
     RenderThreadInfo *tinfo = RenderThreadInfo::get();
     if (tinfo->m_contextSet.empty()) return;
     for (std::set<HandleType>::iterator it = tinfo->m_contextSet.begin();
             it != tinfo->m_contextSet.end(); ++it) {
         HandleType contextHandle = *it;
-        m_contexts.erase(contextHandle);
+        RenderContextPtr removed(NULL);
+        m_contexts.remove(contextHandle, &removed);
     }
     tinfo->m_contextSet.clear();
 }
 
 void FrameBuffer::drainWindowSurface()
 {
-    emugl::Mutex::AutoLock mutex(m_lock);
+    emugl::Mutex::AutoLock mutex(m_objectsLock);
     RenderThreadInfo *tinfo = RenderThreadInfo::get();
     if (tinfo->m_windowSet.empty()) return;
     for (std::set<HandleType>::iterator it = tinfo->m_windowSet.begin();
             it != tinfo->m_windowSet.end(); ++it) {
         HandleType windowHandle = *it;
-        if (m_windows.find(windowHandle) != m_windows.end()) {
-            HandleType oldColorBufferHandle = m_windows[windowHandle].second;
+        std::pair<WindowSurfacePtr, HandleType> removed;
+        if (m_windows.remove(windowHandle, &removed)) {
+            HandleType oldColorBufferHandle = removed.second;
             if (oldColorBufferHandle) {
-                ColorBufferMap::iterator cit(m_colorbuffers.find(oldColorBufferHandle));
-                if (cit != m_colorbuffers.end()) {
-                    if (--(*cit).second.refcount == 0) { m_colorbuffers.erase(cit); }
-                }
+                closeColorBuffer(oldColorBufferHandle);
             }
-            m_windows.erase(windowHandle);
         }
     }
     tinfo->m_windowSet.clear();
@@ -670,8 +725,9 @@ void FrameBuffer::drainWindowSurface()
 
 void FrameBuffer::DestroyRenderContext(HandleType p_context)
 {
-    emugl::Mutex::AutoLock mutex(m_lock);
-    m_contexts.erase(p_context);
+    emugl::Mutex::AutoLock mutex(m_objectsLock);
+    RenderContextPtr removed(NULL);
+    m_contexts.remove(p_context, &removed);
     RenderThreadInfo *tinfo = RenderThreadInfo::get();
     if (tinfo->m_contextSet.empty()) return;
     tinfo->m_contextSet.erase(p_context);
@@ -679,9 +735,9 @@ void FrameBuffer::DestroyRenderContext(HandleType p_context)
 
 void FrameBuffer::DestroyWindowSurface(HandleType p_surface)
 {
-    emugl::Mutex::AutoLock mutex(m_lock);
-    if (m_windows.find(p_surface) != m_windows.end()) {
-        m_windows.erase(p_surface);
+    emugl::Mutex::AutoLock mutex(m_objectsLock);
+    std::pair<WindowSurfacePtr, HandleType> removed;
+    if (m_windows.remove(p_surface, &removed)) {
         RenderThreadInfo *tinfo = RenderThreadInfo::get();
         if (tinfo->m_windowSet.empty()) return;
         tinfo->m_windowSet.erase(p_surface);
@@ -690,45 +746,43 @@ void FrameBuffer::DestroyWindowSurface(HandleType p_surface)
 
 int FrameBuffer::openColorBuffer(HandleType p_colorbuffer)
 {
-    emugl::Mutex::AutoLock mutex(m_lock);
-    ColorBufferMap::iterator c(m_colorbuffers.find(p_colorbuffer));
-    if (c == m_colorbuffers.end()) {
+    ColorBufferTable::Accessor c(&m_colorbuffers, p_colorbuffer);
+    if (!c.ptr()) {
         // bad colorbuffer handle
         ERR("FB: openColorBuffer cb handle %#x not found\n", p_colorbuffer);
         return -1;
     }
-    (*c).second.refcount++;
+    c.ptr()->refcount++;
     return 0;
 }
 
 void FrameBuffer::closeColorBuffer(HandleType p_colorbuffer)
 {
-    emugl::Mutex::AutoLock mutex(m_lock);
-    ColorBufferMap::iterator c(m_colorbuffers.find(p_colorbuffer));
-    if (c == m_colorbuffers.end()) {
+    // Declared first, so that the ColorBuffer is destroyed after the
+    // Accessor releases its lock: its destructor acquires |m_lock|.
+    ColorBufferRef removed;
+    ColorBufferTable::Accessor c(&m_colorbuffers, p_colorbuffer);
+    if (!c.ptr()) {
         // This is harmless: it is normal for guest system to issue
         // closeColorBuffer command when the color buffer is already
         // garbage collected on the host. (we dont have a mechanism
         // to give guest a notice yet)
         return;
     }
-    if (--(*c).second.refcount == 0) {
-        m_colorbuffers.erase(c);
+    if (--c.ptr()->refcount == 0) {
+        c.remove(&removed);
     }
 }
 
 bool FrameBuffer::flushWindowSurfaceColorBuffer(HandleType p_surface)
 {
-    emugl::Mutex::AutoLock mutex(m_lock);
-
-    WindowSurfaceMap::iterator w( m_windows.find(p_surface) );
-    if (w == m_windows.end()) {
+    WindowSurfacePtr surface(findWindowSurface(p_surface));
+    if (!surface.Ptr()) {
         ERR("FB::flushWindowSurfaceColorBuffer: window handle %#x not found\n", p_surface);
         // bad surface handle
         return false;
     }
 
-    WindowSurface* surface = (*w).second.first.Ptr();
     surface->flushColorBuffer();
 
     return true;
@@ -737,24 +791,37 @@ bool FrameBuffer::flushWindowSurfaceColorBuffer(HandleType p_surface)
 bool FrameBuffer::setWindowSurfaceColorBuffer(HandleType p_surface,
                                               HandleType p_colorbuffer)
 {
-    emugl::Mutex::AutoLock mutex(m_lock);
+    // Declared before the lock so that these references are dropped after
+    // releasing it.
+    WindowSurfacePtr surface;
+    ColorBufferPtr cb;
+    {
+        // Serializes the updates of the handle tables only: attaching the
+        // color buffer resizes the surface's Pbuffer, and can drop the last
+        // reference to the previous color buffer, which acquires |m_lock|.
+        emugl::Mutex::AutoLock mutex(m_objectsLock);
+
+        surface = findWindowSurface(p_surface);
+        if (!surface.Ptr()) {
+            // bad surface handle
+            ERR("%s: bad window surface handle %#x\n", __FUNCTION__, p_surface);
+            return false;
+        }
 
-    WindowSurfaceMap::iterator w( m_windows.find(p_surface) );
-    if (w == m_windows.end()) {
-        // bad surface handle
-        ERR("%s: bad window surface handle %#x\n", __FUNCTION__, p_surface);
-        return false;
-    }
+        cb = findColorBuffer(p_colorbuffer);
+        if (!cb.Ptr()) {
+            DBG("%s: bad color buffer handle %#x\n", __FUNCTION__, p_colorbuffer);
+            // bad colorbuffer handle
+            return false;
+        }
 
-    ColorBufferMap::iterator c( m_colorbuffers.find(p_colorbuffer) );
-    if (c == m_colorbuffers.end()) {
-        DBG("%s: bad color buffer handle %#x\n", __FUNCTION__, p_colorbuffer);
-        // bad colorbuffer handle
-        return false;
+        WindowSurfaceTable::Accessor w(&m_windows, p_surface);
+        if (w.ptr()) {
+            w.ptr()->second = p_colorbuffer;
+        }
     }
 
-    (*w).second.first->setColorBuffer((*c).second.cb);
-    (*w).second.second = p_colorbuffer;
+    surface->setColorBuffer(cb);
     return true;
 }
 
@@ -762,66 +829,56 @@ void FrameBuffer::readColorBuffer(HandleType p_colorbuffer,
                                     int x, int y, int width, int height,
                                     GLenum format, GLenum type, void *pixels)
 {
-    emugl::Mutex::AutoLock mutex(m_lock);
-
-    ColorBufferMap::iterator c( m_colorbuffers.find(p_colorbuffer) );
-    if (c == m_colorbuffers.end()) {
+    ColorBufferPtr cb(findColorBuffer(p_colorbuffer));
+    if (!cb.Ptr()) {
         // bad colorbuffer handle
         return;
     }
 
-    (*c).second.cb->readPixels(x, y, width, height, format, type, pixels);
+    cb->readPixels(x, y, width, height, format, type, pixels);
 }
 
 bool FrameBuffer::updateColorBuffer(HandleType p_colorbuffer,
                                     int x, int y, int width, int height,
                                     GLenum format, GLenum type, void *pixels)
 {
-    emugl::Mutex::AutoLock mutex(m_lock);
-
-    ColorBufferMap::iterator c( m_colorbuffers.find(p_colorbuffer) );
-    if (c == m_colorbuffers.end()) {
+    ColorBufferPtr cb(findColorBuffer(p_colorbuffer));
+    if (!cb.Ptr()) {
         // bad colorbuffer handle
         return false;
     }
 
-    (*c).second.cb->subUpdate(x, y, width, height, format, type, pixels);
+    cb->subUpdate(x, y, width, height, format, type, pixels);
 
     return true;
 }
 
 bool FrameBuffer::bindColorBufferToTexture(HandleType p_colorbuffer)
 {
-    emugl::Mutex::AutoLock mutex(m_lock);
-
-    ColorBufferMap::iterator c( m_colorbuffers.find(p_colorbuffer) );
-    if (c == m_colorbuffers.end()) {
+    ColorBufferPtr cb(findColorBuffer(p_colorbuffer));
+    if (!cb.Ptr()) {
         // bad colorbuffer handle
         return false;
     }
 
-    return (*c).second.cb->bindToTexture();
+    return cb->bindToTexture();
 }
 
 bool FrameBuffer::bindColorBufferToRenderbuffer(HandleType p_colorbuffer)
 {
-    emugl::Mutex::AutoLock mutex(m_lock);
-
-    ColorBufferMap::iterator c( m_colorbuffers.find(p_colorbuffer) );
-    if (c == m_colorbuffers.end()) {
+    ColorBufferPtr cb(findColorBuffer(p_colorbuffer));
+    if (!cb.Ptr()) {
         // bad colorbuffer handle
         return false;
     }
 
-    return (*c).second.cb->bindToRenderbuffer();
+    return cb->bindToRenderbuffer();
 }
 
 bool FrameBuffer::bindContext(HandleType p_context,
                               HandleType p_drawSurface,
                               HandleType p_readSurface)
 {
-    emugl::Mutex::AutoLock mutex(m_lock);
-
     WindowSurfacePtr draw(NULL), read(NULL);
     RenderContextPtr ctx(NULL);
 
@@ -829,27 +886,24 @@ bool FrameBuffer::bindContext(HandleType p_context,
     // if this is not an unbind operation - make sure all handles are good
     //
     if (p_context || p_drawSurface || p_readSurface) {
-        RenderContextMap::iterator r( m_contexts.find(p_context) );
-        if (r == m_contexts.end()) {
+        ctx = findRenderContext(p_context);
+        if (!ctx.Ptr()) {
             // bad context handle
             return false;
         }
 
-        ctx = (*r).second;
-        WindowSurfaceMap::iterator w( m_windows.find(p_drawSurface) );
-        if (w == m_windows.end()) {
+        draw = findWindowSurface(p_drawSurface);
+        if (!draw.Ptr()) {
             // bad surface handle
             return false;
         }
-        draw = (*w).second.first;
 
         if (p_readSurface != p_drawSurface) {
-            WindowSurfaceMap::iterator w( m_windows.find(p_readSurface) );
-            if (w == m_windows.end()) {
+            read = findWindowSurface(p_readSurface);
+            if (!read.Ptr()) {
                 // bad surface handle
                 return false;
             }
-            read = (*w).second.first;
         }
         else {
             read = draw;
@@ -905,6 +959,22 @@ bool FrameBuffer::bindContext(HandleType p_context,
     return true;
 }
 
+bool FrameBuffer::lockContextAndBind()
+{
+    m_lock.lock();
+    if (!bind_locked()) {
+        m_lock.unlock();
+        return false;
+    }
+    return true;
+}
+
+void FrameBuffer::unbindAndUnlockContext()
+{
+    unbind_locked();
+    m_lock.unlock();
+}
+
 //
 // The framebuffer lock should be held when calling this function !
 //
@@ -967,12 +1037,12 @@ bool FrameBuffer::unbind_locked()
 bool FrameBuffer::post(HandleType p_colorbuffer, bool needLock)
 {
     if (needLock) {
-        m_lock.lock();
+        m_postLock.lock();
     }
     bool ret = false;
 
-    ColorBufferMap::iterator c( m_colorbuffers.find(p_colorbuffer) );
-    if (c == m_colorbuffers.end()) {
+    ColorBufferPtr cb(findColorBuffer(p_colorbuffer));
+    if (!cb.Ptr()) {
         goto EXIT;
     }
 
@@ -980,8 +1050,10 @@ bool FrameBuffer::post(HandleType p_colorbuffer, bool needLock)
 
     if (m_subWin) {
         // bind the subwindow eglSurface
+        m_lock.lock();
         if (!bindSubwin_locked()) {
             ERR("FrameBuffer::post(): eglMakeCurrent failed\n");
+            m_lock.unlock();
             goto EXIT;
         }
 
@@ -991,13 +1063,14 @@ bool FrameBuffer::post(HandleType p_colorbuffer, bool needLock)
         if (m_zRot != 0.0f) {
             s_gles2.glClear(GL_COLOR_BUFFER_BIT);
         }
-        ret = (*c).second.cb->post(m_zRot);
+        ret = cb->post(m_zRot);
         if (ret) {
             s_egl.eglSwapBuffers(m_eglDisplay, m_eglSurface);
         }
 
         // restore previous binding
         unbind_locked();
+        m_lock.unlock();
     } else {
         // If there is no sub-window, don't display anything, the client will
         // rely on m_onPost to get the pixels instead.
@@ -1022,23 +1095,64 @@ bool FrameBuffer::post(HandleType p_colorbuffer, bool needLock)
     // Send framebuffer (without FPS overlay) to callback
     //
     if (m_onPost) {
-        (*c).second.cb->readback(m_fbImage);
-        m_onPost(m_onPostContext,
-                 m_width,
-                 m_height,
-                 -1,
-                 GL_RGBA,
-                 GL_UNSIGNED_BYTE,
-                 m_fbImage);
+        readbackForPost_locked(cb.Ptr(), p_colorbuffer);
     }
 
 EXIT:
     if (needLock) {
-        m_lock.unlock();
+        m_postLock.unlock();
     }
     return ret;
 }
 
+void FrameBuffer::readbackForPost_locked(ColorBuffer* cb,
+                                         HandleType p_colorbuffer) {
+    // Rows that didn't change since the previous readback of the same
+    // ColorBuffer are still valid in the destination image.
+    int y = 0;
+    int height = cb->getHeight();
+    bool changed = cb->takeDirtyRows(&y, &height);
+    if (!m_partialReadback || p_colorbuffer != m_lastReadbackColorBuffer) {
+        y = 0;
+        height = cb->getHeight();
+    } else if (!changed) {
+        height = 0;
+    }
+    m_lastReadbackColorBuffer = p_colorbuffer;
+
+    if (m_asyncReadback && !m_readbackWorker) {
+        m_readbackWorker = ReadbackWorker::create(m_eglDisplay,
+                                                  m_eglConfig,
+                                                  m_eglContext,
+                                                  m_width,
+                                                  m_height,
+                                                  m_onPost,
+                                                  m_onPostContext);
+        if (!m_readbackWorker) {
+            // Don't try again for each frame.
+            m_asyncReadback = false;
+            y = 0;
+            height = cb->getHeight();
+        }
+    }
+
+    if (m_readbackWorker) {
+        cb->readbackAsync(m_readbackWorker, y, height);
+        return;
+    }
+
+    if (height > 0) {
+        cb->readback(m_fbImage, y, height);
+    }
+    m_onPost(m_onPostContext,
+             m_width,
+             m_height,
+             -1,
+             GL_RGBA,
+             GL_UNSIGNED_BYTE,
+             m_fbImage);
+}
+
 bool FrameBuffer::repost() {
     if (m_lastPostedColorBuffer) {
         return post(m_lastPostedColorBuffer);
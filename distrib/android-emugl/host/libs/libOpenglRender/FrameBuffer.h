@@ -19,6 +19,8 @@
 #include "ColorBuffer.h"
 #include "emugl/common/mutex.h"
 #include "FbConfig.h"
+#include "HandleTable.h"
+#include "ReadbackWorker.h"
 #include "RenderContext.h"
 #include "render_api.h"
 #include "TextureDraw.h"
@@ -26,21 +28,17 @@
 
 #include <EGL/egl.h>
 
-#include <map>
+#include <utility>
 
 #include <stdint.h>
 
-// Type of handles, a.k.a. "object names" in the GL specification.
-// These are integers used to uniquely identify a resource of a given type.
-typedef uint32_t HandleType;
-
 struct ColorBufferRef {
     ColorBufferPtr cb;
     uint32_t refcount;  // number of client-side references
 };
-typedef std::map<HandleType, RenderContextPtr> RenderContextMap;
-typedef std::map<HandleType, std::pair<WindowSurfacePtr, HandleType> > WindowSurfaceMap;
-typedef std::map<HandleType, ColorBufferRef> ColorBufferMap;
+typedef HandleTable<RenderContextPtr> RenderContextTable;
+typedef HandleTable<std::pair<WindowSurfacePtr, HandleType> > WindowSurfaceTable;
+typedef HandleTable<ColorBufferRef> ColorBufferTable;
 
 // A structure used to list the capabilities of the underlying EGL
 // implementation that the FrameBuffer instance depends on.
@@ -116,6 +114,17 @@ public:
     // Set a callback that will be called each time the emulated GPU content
     // is updated. This can be relatively slow with host-based GPU emulation,
     // so only do this when you need to.
+    //
+    // Two environment variables tune how the frames are read back:
+    //
+    //  - ANDROID_EMUGL_ASYNC_READBACK: read the frames back through a
+    //    ReadbackWorker, so post() doesn't wait for the pixels. The callback
+    //    is then called from the worker's thread, slightly after post()
+    //    returns. Ignored if the host GL doesn't support it.
+    //
+    //  - ANDROID_EMUGL_PARTIAL_READBACK: when the same ColorBuffer is posted
+    //    again, only read back the rows that changed since the previous
+    //    frame (see ColorBuffer::takeDirtyRows()).
     void setPostCallback(OnPostFn onPost, void* onPostContext);
 
     // Retrieve the GL strings of the underlying EGL/GLES implementation.
@@ -248,7 +257,7 @@ public:
     // Display the content of a given ColorBuffer into the framebuffer's
     // sub-window. |p_colorbuffer| is a handle value.
     // |needLock| is used to indicate whether the operation requires
-    // acquiring/releasing the FrameBuffer instance's lock. It should be
+    // acquiring/releasing the FrameBuffer instance's post lock. It should be
     // false only when called internally.
     bool post(HandleType p_colorbuffer, bool needLock = true);
 
@@ -274,13 +283,29 @@ public:
     bool bind_locked();
     bool unbind_locked();
 
+    // Used internally by ColorBuffer instances: acquire the context lock
+    // and make the FrameBuffer's pbuffer context current, or undo it.
+    bool lockContextAndBind();
+    void unbindAndUnlockContext();
+
 private:
     FrameBuffer(int p_width, int p_height, bool useSubWindow);
     ~FrameBuffer();
     HandleType genHandle();
 
+    // Return a new reference to the ColorBuffer, RenderContext or
+    // WindowSurface matching a given handle, or an empty pointer if the
+    // handle is invalid. These don't acquire any FrameBuffer lock.
+    ColorBufferPtr findColorBuffer(HandleType p_colorbuffer);
+    RenderContextPtr findRenderContext(HandleType p_context);
+    WindowSurfacePtr findWindowSurface(HandleType p_surface);
+
     bool bindSubwin_locked();
 
+    // Read back the content of |cb| and send it to the post callback.
+    // Must be called with |m_postLock| held.
+    void readbackForPost_locked(ColorBuffer* cb, HandleType p_colorbuffer);
+
 private:
     static FrameBuffer *s_theFrameBuffer;
     static HandleType s_nextHandle;
@@ -289,14 +314,38 @@ private:
     int m_width;
     int m_height;
     bool m_useSubWindow;
+
+    // Render threads decode their command streams concurrently, so the
+    // shared state of this instance is protected by several locks. When
+    // more than one is needed, they must be acquired in this order:
+    //
+    //   m_postLock -> m_contextCreationLock -> m_objectsLock -> m_lock
+    //
+    // |m_postLock| serializes post() and protects the sub-window, the
+    // post callback, |m_fbImage| and the readback worker.
+    // |m_contextCreationLock| serializes the creation of RenderContext
+    // instances, and thus of their share groups.
+    // |m_objectsLock| serializes the creation and destruction of handles,
+    // and the updates that span several handle tables. The tables below
+    // have their own internal locks, so looking up a handle, or changing
+    // the reference count of a ColorBufferRef entry through an Accessor,
+    // doesn't need it. Their locks come last in the order above.
+    // |m_lock| protects the FrameBuffer's own EGL contexts, i.e. every
+    // use of bind_locked(), bindSubwin_locked() and unbind_locked().
+    // ColorBuffer instances acquire it through their helper (including in
+    // their destructor), which means it must not be held when calling
+    // ColorBuffer methods or dropping the last ColorBuffer reference.
+    emugl::Mutex m_postLock;
+    emugl::Mutex m_contextCreationLock;
+    emugl::Mutex m_objectsLock;
     emugl::Mutex m_lock;
     FbConfigList* m_configs;
     FBNativeWindowType m_nativeWindow;
     FrameBufferCaps m_caps;
     EGLDisplay m_eglDisplay;
-    RenderContextMap m_contexts;
-    WindowSurfaceMap m_windows;
-    ColorBufferMap m_colorbuffers;
+    RenderContextTable m_contexts;
+    WindowSurfaceTable m_windows;
+    ColorBufferTable m_colorbuffers;
     ColorBuffer::Helper* m_colorBufferHelper;
 
     EGLSurface m_eglSurface;
@@ -321,6 +370,12 @@ private:
     OnPostFn m_onPost;
     void* m_onPostContext;
     unsigned char* m_fbImage;
+    ReadbackWorker* m_readbackWorker;
+    bool m_asyncReadback;
+    bool m_partialReadback;
+    // The ColorBuffer whose pixels are in the last frame sent to |m_onPost|,
+    // or 0 if unknown.
+    HandleType m_lastReadbackColorBuffer;
 
     const char* m_glVendor;
     const char* m_glRenderer;
@@ -0,0 +1,247 @@
+/*
+* Copyright (C) 2015 The Android Open Source Project
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+* http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*/
+#ifndef _LIB_OPENGL_RENDER_HANDLE_TABLE_H
+#define _LIB_OPENGL_RENDER_HANDLE_TABLE_H
+
+#include "emugl/common/mutex.h"
+
+#include <vector>
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Type of handles, a.k.a. "object names" in the GL specification.
+// These are integers used to uniquely identify a resource of a given type.
+typedef uint32_t HandleType;
+
+// A table of values indexed by handle, that render threads can look up
+// concurrently without any global lock.
+//
+// Handles are hashed into buckets by |handle % mNumBuckets|. The FrameBuffer
+// allocates handles sequentially, so they are spread evenly over buckets.
+// Each bucket is protected by one of kNumLocks striped locks, the one of
+// index |handle % kNumLocks|, which is only held while copying a value in
+// or out, or during an Accessor's lifetime. Lookups of different handles
+// thus almost never contend.
+//
+// The number of buckets doubles whenever there are more than
+// kMaxLoadFactor entries per bucket, so that lookups take constant time
+// however many handles are live. Since mNumBuckets is always a multiple of
+// kNumLocks, all the entries of a bucket are protected by the same lock.
+// Growing the table takes all the locks.
+//
+// |T| is typically a SmartPtr, or a struct holding one: the copy returned
+// by find() keeps the object alive even if another thread removes it from
+// the table at the same time.
+template <class T>
+class HandleTable {
+    struct Entry;
+    typedef std::vector<Entry> Bucket;
+
+public:
+    HandleTable() : mNumBuckets(kInitialBuckets), mBuckets(kInitialBuckets) {
+        for (size_t n = 0; n < kNumLocks; ++n) {
+            mCounts[n] = 0;
+        }
+    }
+
+    // Copy the value of |handle| into |*value| and return true, or return
+    // false if there is no such handle.
+    bool find(HandleType handle, T* value) const {
+        emugl::Mutex::AutoLock lock(lockFor(handle));
+        const T* found = findLocked(handle);
+        if (!found) {
+            return false;
+        }
+        *value = *found;
+        return true;
+    }
+
+    bool contains(HandleType handle) const {
+        emugl::Mutex::AutoLock lock(lockFor(handle));
+        return findLocked(handle) != NULL;
+    }
+
+    // Add |handle| with |value|, or replace its current value.
+    void set(HandleType handle, const T& value) {
+        size_t numBuckets;
+        {
+            emugl::Mutex::AutoLock lock(lockFor(handle));
+            T* found = findLocked(handle);
+            if (found) {
+                *found = value;
+                return;
+            }
+            bucketFor(handle).push_back(Entry(handle, value));
+            numBuckets = mNumBuckets;
+            if (++mCounts[handle % kNumLocks] <=
+                    kMaxLoadFactor * (numBuckets / kNumLocks)) {
+                return;
+            }
+        }
+        grow(numBuckets);
+    }
+
+    // Remove |handle| and return true, or return false if there is no such
+    // handle. If |value| is not NULL, the removed value is moved to it, so
+    // that the caller can release it after the bucket lock is released.
+    bool remove(HandleType handle, T* value) {
+        emugl::Mutex::AutoLock lock(lockFor(handle));
+        return removeLocked(handle, value);
+    }
+
+    // Remove all handles.
+    void clear() {
+        std::vector<Bucket> buckets(kInitialBuckets);
+        lockAll();
+        mBuckets.swap(buckets);
+        mNumBuckets = kInitialBuckets;
+        for (size_t n = 0; n < kNumLocks; ++n) {
+            mCounts[n] = 0;
+        }
+        unlockAll();
+        // The old values are released here, without any lock held.
+    }
+
+    // Scoped access to the value of a handle, with its bucket locked, for
+    // read-modify-write operations such as updating a reference count.
+    // Never use another HandleTable method, or acquire any FrameBuffer lock
+    // during an Accessor's lifetime.
+    class Accessor {
+    public:
+        Accessor(HandleTable* table, HandleType handle) :
+                mTable(table), mHandle(handle) {
+            mTable->lockFor(handle).lock();
+            mValue = mTable->findLocked(handle);
+        }
+
+        ~Accessor() {
+            mTable->lockFor(mHandle).unlock();
+        }
+
+        // The value of the handle, or NULL if there is no such handle.
+        T* ptr() const { return mValue; }
+
+        // Remove the handle from the table, and move its value to |*value|.
+        // ptr() returns NULL after this.
+        void remove(T* value) {
+            mTable->removeLocked(mHandle, value);
+            mValue = NULL;
+        }
+
+    private:
+        HandleTable* mTable;
+        HandleType mHandle;
+        T* mValue;
+    };
+
+private:
+    static const size_t kNumLocks = 64;
+    static const size_t kInitialBuckets = 256;
+    static const size_t kMaxLoadFactor = 2;
+
+    struct Entry {
+        Entry(HandleType h, const T& v) : handle(h), value(v) {}
+
+        HandleType handle;
+        T value;
+    };
+
+    emugl::Mutex& lockFor(HandleType handle) const {
+        return mLocks[handle % kNumLocks];
+    }
+
+    // The following methods must be called with lockFor(handle) held.
+
+    Bucket& bucketFor(HandleType handle) {
+        return mBuckets[handle % mNumBuckets];
+    }
+
+    T* findLocked(HandleType handle) {
+        Bucket& bucket = bucketFor(handle);
+        for (size_t n = 0; n < bucket.size(); ++n) {
+            if (bucket[n].handle == handle) {
+                return &bucket[n].value;
+            }
+        }
+        return NULL;
+    }
+
+    const T* findLocked(HandleType handle) const {
+        return const_cast<HandleTable*>(this)->findLocked(handle);
+    }
+
+    bool removeLocked(HandleType handle, T* value) {
+        Bucket& bucket = bucketFor(handle);
+        for (size_t n = 0; n < bucket.size(); ++n) {
+            if (bucket[n].handle == handle) {
+                if (value) {
+                    *value = bucket[n].value;
+                }
+                bucket[n] = bucket.back();
+                bucket.pop_back();
+                --mCounts[handle % kNumLocks];
+                return true;
+            }
+        }
+        return false;
+    }
+
+    // Double the number of buckets, unless another thread already did it
+    // since the caller saw |numBuckets|.
+    void grow(size_t numBuckets) {
+        lockAll();
+        if (mNumBuckets == numBuckets) {
+            std::vector<Bucket> buckets(numBuckets * 2);
+            for (size_t n = 0; n < mBuckets.size(); ++n) {
+                const Bucket& bucket = mBuckets[n];
+                for (size_t i = 0; i < bucket.size(); ++i) {
+                    buckets[bucket[i].handle % buckets.size()].push_back(
+                            bucket[i]);
+                }
+            }
+            mBuckets.swap(buckets);
+            mNumBuckets = mBuckets.size();
+        }
+        unlockAll();
+    }
+
+    void lockAll() {
+        for (size_t n = 0; n < kNumLocks; ++n) {
+            mLocks[n].lock();
+        }
+    }
+
+    void unlockAll() {
+        for (size_t n = kNumLocks; n > 0; --n) {
+            mLocks[n - 1].unlock();
+        }
+    }
+
+    mutable emugl::Mutex mLocks[kNumLocks];
+    // Number of entries protected by each lock.
+    size_t mCounts[kNumLocks];
+    // Only changed with all locks held, so reading it with any lock held
+    // is safe.
+    size_t mNumBuckets;
+    std::vector<Bucket> mBuckets;
+
+    // Not copyable.
+    HandleTable(const HandleTable&);
+    HandleTable& operator=(const HandleTable&);
+};
+
+#endif  // _LIB_OPENGL_RENDER_HANDLE_TABLE_H
@@ -0,0 +1,332 @@
+/*
+* Copyright (C) 2015 The Android Open Source Project
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+* http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*/
+#include "ReadbackWorker.h"
+
+#include "EGLDispatch.h"
+#include "ErrorLog.h"
+#include "GLESv2Dispatch.h"
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+// GLES 3.0 definitions, not provided by the GLES 1.x / 2.0 headers.
+#ifndef GL_PIXEL_PACK_BUFFER
+#define GL_PIXEL_PACK_BUFFER 0x88EB
+#endif
+#ifndef GL_STREAM_READ
+#define GL_STREAM_READ 0x88E1
+#endif
+#ifndef GL_MAP_READ_BIT
+#define GL_MAP_READ_BIT 0x0001
+#endif
+#ifndef GL_SYNC_GPU_COMMANDS_COMPLETE
+#define GL_SYNC_GPU_COMMANDS_COMPLETE 0x9117
+#endif
+#ifndef GL_SYNC_FLUSH_COMMANDS_BIT
+#define GL_SYNC_FLUSH_COMMANDS_BIT 0x00000001
+#endif
+#ifndef GL_TIMEOUT_IGNORED
+#define GL_TIMEOUT_IGNORED 0xFFFFFFFFFFFFFFFFull
+#endif
+#ifndef GL_WAIT_FAILED
+#define GL_WAIT_FAILED 0x911D
+#endif
+
+namespace {
+
+// The GLES 3.0 entry points used by the worker, which are not part of the
+// GLES 2.0 dispatch table. Sync objects are handled as opaque pointers.
+typedef void* (GL_APIENTRY *MapBufferRangeFn)(GLenum target,
+                                              GLintptr offset,
+                                              GLsizeiptr length,
+                                              GLbitfield access);
+typedef GLboolean (GL_APIENTRY *UnmapBufferFn)(GLenum target);
+typedef void* (GL_APIENTRY *FenceSyncFn)(GLenum condition, GLbitfield flags);
+typedef GLenum (GL_APIENTRY *ClientWaitSyncFn)(void* sync,
+                                               GLbitfield flags,
+                                               uint64_t timeout);
+typedef void (GL_APIENTRY *DeleteSyncFn)(void* sync);
+
+struct Gles3Functions {
+    MapBufferRangeFn glMapBufferRange;
+    UnmapBufferFn glUnmapBuffer;
+    FenceSyncFn glFenceSync;
+    ClientWaitSyncFn glClientWaitSync;
+    DeleteSyncFn glDeleteSync;
+};
+
+// Written by the first worker that initializes successfully, before any
+// call to queueReadback(). All workers resolve the same values.
+Gles3Functions s_gles3;
+
+bool resolveGles3Functions() {
+    Gles3Functions funcs;
+    funcs.glMapBufferRange = reinterpret_cast<MapBufferRangeFn>(
+            s_egl.eglGetProcAddress("glMapBufferRange"));
+    funcs.glUnmapBuffer = reinterpret_cast<UnmapBufferFn>(
+            s_egl.eglGetProcAddress("glUnmapBuffer"));
+    funcs.glFenceSync = reinterpret_cast<FenceSyncFn>(
+            s_egl.eglGetProcAddress("glFenceSync"));
+    funcs.glClientWaitSync = reinterpret_cast<ClientWaitSyncFn>(
+            s_egl.eglGetProcAddress("glClientWaitSync"));
+    funcs.glDeleteSync = reinterpret_cast<DeleteSyncFn>(
+            s_egl.eglGetProcAddress("glDeleteSync"));
+    if (!funcs.glMapBufferRange || !funcs.glUnmapBuffer ||
+        !funcs.glFenceSync || !funcs.glClientWaitSync ||
+        !funcs.glDeleteSync) {
+        return false;
+    }
+    s_gles3 = funcs;
+    return true;
+}
+
+}  // namespace
+
+// static
+ReadbackWorker* ReadbackWorker::create(EGLDisplay display,
+                                       EGLConfig config,
+                                       EGLContext sharedContext,
+                                       int width,
+                                       int height,
+                                       OnPostFn onPost,
+                                       void* onPostContext) {
+    static const EGLint contextAttribs[] = {
+        EGL_CONTEXT_CLIENT_VERSION, 2,
+        EGL_NONE
+    };
+    static const EGLint pbufAttribs[] = {
+        EGL_WIDTH, 1,
+        EGL_HEIGHT, 1,
+        EGL_NONE
+    };
+
+    EGLContext context = s_egl.eglCreateContext(
+            display, config, sharedContext, contextAttribs);
+    if (context == EGL_NO_CONTEXT) {
+        ERR("ReadbackWorker: failed to create context 0x%x\n",
+            s_egl.eglGetError());
+        return NULL;
+    }
+    EGLSurface surface = s_egl.eglCreatePbufferSurface(
+            display, config, pbufAttribs);
+    if (surface == EGL_NO_SURFACE) {
+        ERR("ReadbackWorker: failed to create pbuffer 0x%x\n",
+            s_egl.eglGetError());
+        s_egl.eglDestroyContext(display, context);
+        return NULL;
+    }
+
+    ReadbackWorker* worker = new ReadbackWorker(
+            display, context, surface, width, height, onPost, onPostContext);
+    if (!worker->m_image || !worker->start()) {
+        ERR("ReadbackWorker: failed to start\n");
+        delete worker;
+        return NULL;
+    }
+    worker->m_started = true;
+
+    // The context must be current to check what it supports, so wait for
+    // the thread to do it.
+    worker->m_lock.lock();
+    while (worker->m_initState == 0) {
+        worker->m_slotFreed.wait(&worker->m_lock);
+    }
+    bool ok = (worker->m_initState > 0);
+    worker->m_lock.unlock();
+
+    if (!ok) {
+        delete worker;  // waits for the thread, which already exited.
+        return NULL;
+    }
+    return worker;
+}
+
+ReadbackWorker::ReadbackWorker(EGLDisplay display,
+                               EGLContext context,
+                               EGLSurface surface,
+                               int width,
+                               int height,
+                               OnPostFn onPost,
+                               void* onPostContext) :
+        m_display(display),
+        m_context(context),
+        m_surface(surface),
+        m_width(width),
+        m_height(height),
+        m_onPost(onPost),
+        m_onPostContext(onPostContext),
+        m_image(static_cast<unsigned char*>(::calloc(4 * width * height, 1))),
+        m_lock(),
+        m_slotFreed(),
+        m_frameQueued(),
+        m_nextSlot(0),
+        m_queueHead(0),
+        m_queueCount(0),
+        m_exiting(false),
+        m_initState(0),
+        m_started(false) {
+    memset(m_slots, 0, sizeof(m_slots));
+}
+
+ReadbackWorker::~ReadbackWorker() {
+    if (m_started) {
+        m_lock.lock();
+        m_exiting = true;
+        m_frameQueued.signal();
+        m_lock.unlock();
+        wait(NULL);
+    }
+    s_egl.eglDestroySurface(m_display, m_surface);
+    s_egl.eglDestroyContext(m_display, m_context);
+    ::free(m_image);
+}
+
+bool ReadbackWorker::initContext() {
+    if (!s_egl.eglMakeCurrent(m_display, m_surface, m_surface, m_context)) {
+        ERR("ReadbackWorker: eglMakeCurrent failed 0x%x\n",
+            s_egl.eglGetError());
+        return false;
+    }
+    const char* version =
+            reinterpret_cast<const char*>(s_gles2.glGetString(GL_VERSION));
+    if (!version || strncmp(version, "OpenGL ES 3", 11) != 0 ||
+        !resolveGles3Functions()) {
+        // Not an error, the caller will use synchronous readback.
+        return false;
+    }
+
+    const GLsizeiptr size = (GLsizeiptr)m_width * m_height * 4;
+    for (int n = 0; n < kNumSlots; ++n) {
+        s_gles2.glGenBuffers(1, &m_slots[n].buffer);
+        s_gles2.glBindBuffer(GL_PIXEL_PACK_BUFFER, m_slots[n].buffer);
+        s_gles2.glBufferData(GL_PIXEL_PACK_BUFFER, size, NULL, GL_STREAM_READ);
+    }
+    s_gles2.glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+    // Make sure the buffers exist before other contexts use them.
+    s_gles2.glFinish();
+    return s_gles2.glGetError() == GL_NO_ERROR;
+}
+
+intptr_t ReadbackWorker::main() {
+    bool ok = initContext();
+
+    m_lock.lock();
+    m_initState = ok ? 1 : -1;
+    m_slotFreed.signal();
+
+    while (ok) {
+        while (m_queueCount == 0 && !m_exiting) {
+            m_frameQueued.wait(&m_lock);
+        }
+        if (m_queueCount == 0) {
+            break;  // exiting, and all frames delivered.
+        }
+        Slot slot = m_slots[m_queueHead];
+        m_lock.unlock();
+
+        copySlot(slot);
+
+        m_lock.lock();
+        m_slots[m_queueHead].busy = false;
+        m_queueHead = (m_queueHead + 1) % kNumSlots;
+        m_queueCount--;
+        m_slotFreed.signal();
+        m_lock.unlock();
+
+        // Call the callback without holding the lock, so the render
+        // thread can queue the next frame meanwhile.
+        m_onPost(m_onPostContext,
+                 m_width,
+                 m_height,
+                 -1,
+                 GL_RGBA,
+                 GL_UNSIGNED_BYTE,
+                 m_image);
+
+        m_lock.lock();
+    }
+    m_lock.unlock();
+
+    for (int n = 0; n < kNumSlots; ++n) {
+        if (m_slots[n].buffer) {
+            s_gles2.glDeleteBuffers(1, &m_slots[n].buffer);
+        }
+    }
+    s_egl.eglMakeCurrent(m_display, NULL, NULL, NULL);
+    return 0;
+}
+
+void ReadbackWorker::copySlot(const Slot& slot) {
+    if (!slot.height) {
+        return;
+    }
+    if (s_gles3.glClientWaitSync(slot.sync,
+                                 GL_SYNC_FLUSH_COMMANDS_BIT,
+                                 GL_TIMEOUT_IGNORED) == GL_WAIT_FAILED) {
+        ERR("ReadbackWorker: glClientWaitSync failed 0x%x\n",
+            s_gles2.glGetError());
+    }
+    s_gles3.glDeleteSync(slot.sync);
+
+    const size_t offset = (size_t)slot.y * m_width * 4;
+    const size_t length = (size_t)slot.height * m_width * 4;
+    s_gles2.glBindBuffer(GL_PIXEL_PACK_BUFFER, slot.buffer);
+    void* pixels = s_gles3.glMapBufferRange(
+            GL_PIXEL_PACK_BUFFER, offset, length, GL_MAP_READ_BIT);
+    if (pixels) {
+        memcpy(m_image + offset, pixels, length);
+        s_gles3.glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+    } else {
+        ERR("ReadbackWorker: glMapBufferRange failed 0x%x\n",
+            s_gles2.glGetError());
+    }
+    s_gles2.glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+}
+
+void ReadbackWorker::queueReadback(int y, int height) {
+    m_lock.lock();
+    while (m_slots[m_nextSlot].busy) {
+        m_slotFreed.wait(&m_lock);
+    }
+    // The slot now belongs to this thread until it is queued.
+    Slot* slot = &m_slots[m_nextSlot];
+    slot->busy = true;
+    m_nextSlot = (m_nextSlot + 1) % kNumSlots;
+    m_lock.unlock();
+
+    slot->y = y;
+    slot->height = height;
+    slot->sync = NULL;
+    if (height > 0) {
+        // With a pack buffer bound, the last glReadPixels() parameter is an
+        // offset into it. Rows land at the same place as in the image.
+        s_gles2.glBindBuffer(GL_PIXEL_PACK_BUFFER, slot->buffer);
+        s_gles2.glReadPixels(
+                0, y, m_width, height, GL_RGBA, GL_UNSIGNED_BYTE,
+                reinterpret_cast<void*>((uintptr_t)y * m_width * 4));
+        s_gles2.glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+        slot->sync = s_gles3.glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+        // The fence must be flushed before another context waits on it.
+        s_gles2.glFlush();
+    }
+
+    m_lock.lock();
+    m_queueCount++;
+    m_frameQueued.signal();
+    m_lock.unlock();
+}
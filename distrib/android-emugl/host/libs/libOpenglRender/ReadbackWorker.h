@@ -0,0 +1,126 @@
+/*
+* Copyright (C) 2015 The Android Open Source Project
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+* http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*/
+#ifndef _LIBRENDER_READBACK_WORKER_H
+#define _LIBRENDER_READBACK_WORKER_H
+
+#include "emugl/common/condition_variable.h"
+#include "emugl/common/mutex.h"
+#include "emugl/common/thread.h"
+#include "render_api.h"
+
+#include <EGL/egl.h>
+#include <GLES/gl.h>
+
+// A ReadbackWorker implements asynchronous readback of posted frames for
+// the FrameBuffer's post callback.
+//
+// The synchronous path calls glReadPixels() into client memory, which
+// stalls the render thread until the GPU has finished the frame and the
+// pixels have been copied. Instead, queueReadback() only starts a copy into
+// one of a small ring of pixel buffer objects, and inserts a fence after it.
+// A dedicated thread, with its own EGL context sharing the FrameBuffer's
+// objects, waits for the fence, maps the buffer and hands the pixels to the
+// post callback. This lets the GPU read frame N back while the guest is
+// already rendering frame N+1.
+//
+// This requires pixel buffer objects, fences and glMapBufferRange(), i.e. a
+// GLES 3.0 host implementation. create() returns NULL when they are not
+// available, and callers should fall back to ColorBuffer::readback().
+//
+// NOTE: The post callback is called from the worker thread, not from the
+// render thread that posted the frame.
+class ReadbackWorker : public emugl::Thread {
+public:
+    // Create a new instance and start its thread.
+    // |display|, |config| and |sharedContext| are used to create the
+    // worker's own context, which must share objects with the contexts
+    // calling queueReadback(). |width| and |height| are the frame
+    // dimensions in pixels. |onPost| and |onPostContext| are the callback
+    // that receives the frames, as RGBA pixels.
+    // Returns NULL on failure, or if the host GL lacks the features needed.
+    static ReadbackWorker* create(EGLDisplay display,
+                                  EGLConfig config,
+                                  EGLContext sharedContext,
+                                  int width,
+                                  int height,
+                                  OnPostFn onPost,
+                                  void* onPostContext);
+
+    // Stop the thread, after delivering any pending frame, and release
+    // all resources. Must not be called with a context current that uses
+    // the worker's buffers.
+    ~ReadbackWorker();
+
+    // Start reading back rows [y, y + height) of the framebuffer currently
+    // bound for reading, into the next free buffer of the ring, then queue
+    // the frame for delivery. Rows outside of that range are delivered with
+    // their content from the previous frame, which is how partial readback
+    // is implemented. A |height| of 0 re-delivers the previous frame
+    // unchanged. This blocks only when all buffers are still in flight.
+    // Must be called from a thread with a context sharing objects with
+    // the worker's.
+    void queueReadback(int y, int height);
+
+    virtual intptr_t main();
+
+private:
+    // Number of pixel buffer objects in the ring.
+    static const int kNumSlots = 3;
+
+    struct Slot {
+        GLuint buffer;
+        void* sync;
+        int y;
+        int height;
+        bool busy;
+    };
+
+    ReadbackWorker(EGLDisplay display,
+                   EGLContext context,
+                   EGLSurface surface,
+                   int width,
+                   int height,
+                   OnPostFn onPost,
+                   void* onPostContext);
+
+    bool initContext();
+    void copySlot(const Slot& slot);
+
+    EGLDisplay m_display;
+    EGLContext m_context;
+    EGLSurface m_surface;
+    int m_width;
+    int m_height;
+    OnPostFn m_onPost;
+    void* m_onPostContext;
+    unsigned char* m_image;
+
+    // |m_lock| protects the fields below. |m_slotFreed| is signaled when
+    // the worker releases a slot or completes its initialization, and
+    // |m_frameQueued| when a frame is queued or the worker must exit.
+    emugl::Mutex m_lock;
+    emugl::ConditionVariable m_slotFreed;
+    emugl::ConditionVariable m_frameQueued;
+    Slot m_slots[kNumSlots];
+    int m_nextSlot;     // next slot to fill, by queueReadback().
+    int m_queueHead;    // next slot to deliver, by the worker thread.
+    int m_queueCount;   // number of filled slots waiting for delivery.
+    bool m_exiting;
+    int m_initState;    // 0: pending, 1: ready, -1: failed.
+    bool m_started;
+};
+
+#endif  // _LIBRENDER_READBACK_WORKER_H
@@ -0,0 +1,204 @@
+/*
+* Copyright (C) 2015 The Android Open Source Project
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+* http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*/
+#include "RenderChannel.h"
+
+#include "render_api.h"
+
+#include "emugl/common/atomic.h"
+
+using emugl::Mutex;
+using emugl::RingBuffer;
+using emugl::atomicAddAndFetch;
+using emugl::atomicFetchAndAnd;
+using emugl::atomicFetchAndOr;
+using emugl::fullMemoryBarrier;
+
+RenderChannel::RenderChannel(size_t capacity,
+                             EventCallback callback,
+                             void* context) :
+        mToHost(capacity),
+        mToGuest(capacity),
+        mLock(),
+        mCond(),
+        mCallbackLock(),
+        mCallback(callback),
+        mContext(context),
+        mRefCount(2),
+        mWantedEvents(0),
+        mHostWaiting(0),
+        mHostClosed(0),
+        mGuestClosed(0) {}
+
+RenderChannel::~RenderChannel() {}
+
+void RenderChannel::incRef() {
+    atomicAddAndFetch(&mRefCount, 1);
+}
+
+void RenderChannel::decRef() {
+    if (atomicAddAndFetch(&mRefCount, -1) == 0) {
+        delete this;
+    }
+}
+
+// The render thread sets mHostWaiting, then checks the rings, before
+// sleeping. The guest updates a ring, then checks mHostWaiting. With a
+// full barrier between the two steps on each side, either the guest sees
+// the flag, or the render thread sees the update, so no wakeup is lost.
+// And since the guest signals under mLock, it can't do so between the
+// render thread's last check and its wait.
+void RenderChannel::wakeHost() {
+    fullMemoryBarrier();
+    if (mHostWaiting) {
+        Mutex::AutoLock lock(mLock);
+        mCond.signal();
+    }
+}
+
+// The guest sets mWantedEvents, then polls the rings, see guestWantEvents().
+// The render thread updates a ring, then checks mWantedEvents. With a full
+// barrier between the two steps on each side, either guestWantEvents()
+// reports the event, or the callback fires, or both, never neither. No lock
+// is needed on the guest side, since it polls instead of sleeping.
+void RenderChannel::notifyGuest(int events) {
+    fullMemoryBarrier();
+    if (!(mWantedEvents & events)) {
+        return;
+    }
+    int fired = atomicFetchAndAnd(&mWantedEvents, ~events) & events;
+    if (!fired || !mCallback) {
+        return;
+    }
+    Mutex::AutoLock lock(mCallbackLock);
+    if (!mGuestClosed) {
+        mCallback(mContext, fired);
+    }
+}
+
+int RenderChannel::guestWrite(const void* buf, size_t len) {
+    if (mHostClosed) {
+        return -1;
+    }
+    size_t count = mToHost.write(buf, len);
+    if (count > 0) {
+        wakeHost();
+    }
+    return (int)count;
+}
+
+int RenderChannel::guestRead(void* buf, size_t len) {
+    // Check for closure first: the render thread may write, then close.
+    int closed = mHostClosed;
+    fullMemoryBarrier();
+    size_t count = mToGuest.read(buf, len);
+    if (count > 0) {
+        wakeHost();
+        return (int)count;
+    }
+    return closed ? -1 : 0;
+}
+
+int RenderChannel::guestPoll() const {
+    int events = 0;
+    if (mHostClosed) {
+        events |= RENDER_CHANNEL_EVENT_CLOSED;
+    } else if (mToHost.space() > 0) {
+        events |= RENDER_CHANNEL_EVENT_CAN_WRITE;
+    }
+    if (mToGuest.available() > 0) {
+        events |= RENDER_CHANNEL_EVENT_CAN_READ;
+    }
+    return events;
+}
+
+int RenderChannel::guestWantEvents(int events) {
+    atomicFetchAndOr(&mWantedEvents, events);
+    // Pairs with the barrier in notifyGuest().
+    fullMemoryBarrier();
+    int ready = guestPoll() & events;
+    if (ready) {
+        atomicFetchAndAnd(&mWantedEvents, ~ready);
+    }
+    return ready;
+}
+
+void RenderChannel::guestClose() {
+    {
+        Mutex::AutoLock lock(mCallbackLock);
+        mGuestClosed = 1;
+    }
+    {
+        Mutex::AutoLock lock(mLock);
+        mCond.signal();
+    }
+    decRef();
+}
+
+size_t RenderChannel::hostRead(void* buf, size_t len) {
+    for (;;) {
+        size_t count = mToHost.read(buf, len);
+        if (count > 0) {
+            notifyGuest(RENDER_CHANNEL_EVENT_CAN_WRITE);
+            return count;
+        }
+        Mutex::AutoLock lock(mLock);
+        mHostWaiting = 1;
+        fullMemoryBarrier();
+        while (!mToHost.available() && !mGuestClosed && !mHostClosed) {
+            mCond.wait(&mLock);
+        }
+        mHostWaiting = 0;
+        if (!mToHost.available()) {
+            return 0;
+        }
+    }
+}
+
+bool RenderChannel::hostWrite(const void* buf, size_t len) {
+    const char* data = static_cast<const char*>(buf);
+    while (len > 0) {
+        if (mGuestClosed || mHostClosed) {
+            return false;
+        }
+        size_t count = mToGuest.write(data, len);
+        if (count > 0) {
+            data += count;
+            len -= count;
+            notifyGuest(RENDER_CHANNEL_EVENT_CAN_READ);
+            continue;
+        }
+        Mutex::AutoLock lock(mLock);
+        mHostWaiting = 1;
+        fullMemoryBarrier();
+        while (!mToGuest.space() && !mGuestClosed && !mHostClosed) {
+            mCond.wait(&mLock);
+        }
+        mHostWaiting = 0;
+    }
+    return true;
+}
+
+void RenderChannel::hostClose() {
+    {
+        Mutex::AutoLock lock(mLock);
+        if (mHostClosed) {
+            return;
+        }
+        mHostClosed = 1;
+        mCond.signal();
+    }
+    notifyGuest(RENDER_CHANNEL_EVENT_CLOSED);
+}
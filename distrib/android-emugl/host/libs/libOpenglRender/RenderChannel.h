@@ -0,0 +1,113 @@
+/*
+* Copyright (C) 2015 The Android Open Source Project
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+* http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*/
+#ifndef _LIB_OPENGL_RENDER_RENDER_CHANNEL_H
+#define _LIB_OPENGL_RENDER_RENDER_CHANNEL_H
+
+#include "emugl/common/condition_variable.h"
+#include "emugl/common/mutex.h"
+#include "emugl/common/ring_buffer.h"
+
+#include <stddef.h>
+
+// A RenderChannel connects a guest GLES client, served by the emulator's
+// main loop, to a RenderThread in the same process, through two lock-free
+// ring buffers. It replaces the TCP / Unix socket connection used by the
+// RenderServer, and the system calls and copies that go with it.
+//
+// The guest side never blocks: its methods return 0 when the ring is full
+// or empty, and an optional callback tells it when to retry. The host side
+// is used by the render thread through a ChannelStream, and blocks.
+//
+// Instances are reference-counted: one reference belongs to the guest, and
+// is dropped by guestClose(), the other one to the host stream.
+class RenderChannel {
+public:
+    // Type of the event callback, see render_api.h.
+    typedef void (*EventCallback)(void* context, int events);
+
+    // Create a new channel, with a ring buffer of |capacity| bytes in each
+    // direction. |callback| is called with |context| from the render
+    // thread when events requested by guestWantEvents() happen.
+    RenderChannel(size_t capacity, EventCallback callback, void* context);
+
+    void incRef();
+    void decRef();
+
+    // Guest side, called from a single thread.
+
+    // Write up to |len| bytes for the render thread. Returns the number of
+    // bytes written, 0 if the ring is full, or -1 if the host side is closed.
+    int guestWrite(const void* buf, size_t len);
+
+    // Read up to |len| bytes written by the render thread. Returns the number
+    // of bytes read, 0 if there are none, or -1 if the host side is closed
+    // and there will never be more.
+    int guestRead(void* buf, size_t len);
+
+    // Returns the mask of RENDER_CHANNEL_EVENT_XXX conditions currently true.
+    int guestPoll() const;
+
+    // Ask for a callback when one of |events| becomes true. Returns the
+    // subset of |events| that are already true; those are not registered.
+    int guestWantEvents(int events);
+
+    // Close the guest side, and drop its reference. The callback is never
+    // called once this returns.
+    void guestClose();
+
+    // Host side, called from the render thread, except hostClose().
+
+    // Read at least one byte, and at most |len|, blocking until some are
+    // available. Returns the number of bytes read, or 0 if the channel is
+    // closed.
+    size_t hostRead(void* buf, size_t len);
+
+    // Write |len| bytes, blocking while the ring is full. Returns false if
+    // the channel is closed.
+    bool hostWrite(const void* buf, size_t len);
+
+    // Close the host side, and unblock any hostRead() / hostWrite() call.
+    // Can be called from any thread.
+    void hostClose();
+
+private:
+    ~RenderChannel();
+
+    RenderChannel(const RenderChannel& other);
+    RenderChannel& operator=(const RenderChannel& other);
+
+    void wakeHost();
+    void notifyGuest(int events);
+
+    emugl::RingBuffer mToHost;
+    emugl::RingBuffer mToGuest;
+
+    // Protects host waits and the callback.
+    emugl::Mutex mLock;
+    emugl::ConditionVariable mCond;
+    emugl::Mutex mCallbackLock;
+
+    EventCallback mCallback;
+    void* mContext;
+
+    volatile int mRefCount;
+    volatile int mWantedEvents;
+    volatile int mHostWaiting;
+    volatile int mHostClosed;
+    volatile int mGuestClosed;
+};
+
+#endif  // _LIB_OPENGL_RENDER_RENDER_CHANNEL_H
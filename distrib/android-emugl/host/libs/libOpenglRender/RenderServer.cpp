@@ -34,7 +34,6 @@
 typedef std::set<RenderThread *> RenderThreadsSet;
 
 RenderServer::RenderServer() :
-    m_lock(),
     m_listenSock(NULL),
     m_exiting(false)
 {
@@ -116,7 +115,7 @@ intptr_t RenderServer::main()
             break;
         }
 
-        RenderThread *rt = RenderThread::create(stream, &m_lock);
+        RenderThread *rt = RenderThread::create(stream);
         if (!rt) {
             fprintf(stderr,"Failed to create RenderThread\n");
             delete stream;
@@ -17,7 +17,6 @@
 #define _LIB_OPENGL_RENDER_RENDER_SERVER_H
 
 #include "SocketStream.h"
-#include "emugl/common/mutex.h"
 #include "emugl/common/thread.h"
 
 class RenderServer : public emugl::Thread
@@ -34,7 +33,6 @@ private:
     RenderServer();
 
 private:
-    emugl::Mutex m_lock;
     SocketStream *m_listenSock;
     bool m_exiting;
 };
@@ -22,22 +22,28 @@
 #include "ReadBuffer.h"
 #include "RenderControl.h"
 #include "RenderThreadInfo.h"
+#include "StreamDump.h"
 #include "TimeUtils.h"
 
 #define STREAM_BUFFER_SIZE 4*1024*1024
 
-RenderThread::RenderThread(IOStream *stream, emugl::Mutex *lock) :
+RenderThread::RenderThread(IOStream *stream, bool readClientFlags) :
         emugl::Thread(),
-        m_lock(lock),
-        m_stream(stream) {}
+        m_stream(stream),
+        m_readClientFlags(readClientFlags) {}
 
 RenderThread::~RenderThread() {
     delete m_stream;
 }
 
 // static
-RenderThread* RenderThread::create(IOStream *stream, emugl::Mutex *lock) {
-    return new RenderThread(stream, lock);
+RenderThread* RenderThread::create(IOStream *stream) {
+    return new RenderThread(stream, false);
+}
+
+// static
+RenderThread* RenderThread::createForChannel(IOStream *stream) {
+    return new RenderThread(stream, true);
 }
 
 void RenderThread::forceStop() {
@@ -45,6 +51,15 @@ void RenderThread::forceStop() {
 }
 
 intptr_t RenderThread::main() {
+    if (m_readClientFlags) {
+        // There is no server to exit through a channel, so the flags
+        // are ignored.
+        unsigned int clientFlags;
+        if (!m_stream->readFully(&clientFlags, sizeof(clientFlags))) {
+            return 0;
+        }
+    }
+
     RenderThreadInfo tInfo;
 
     //
@@ -60,19 +75,12 @@ intptr_t RenderThread::main() {
     long long stats_t0 = GetCurrentTimeMS();
 
     //
-    // open dump file if RENDER_DUMP_DIR is defined
+    // open dump file if RENDERER_DUMP_DIR is defined, see StreamDump.h
     //
     const char *dump_dir = getenv("RENDERER_DUMP_DIR");
-    FILE *dumpFP = NULL;
+    StreamDumpWriter *dumpWriter = NULL;
     if (dump_dir) {
-        size_t bsize = strlen(dump_dir) + 32;
-        char *fname = new char[bsize];
-        snprintf(fname,bsize,"%s/stream_%p", dump_dir, this);
-        dumpFP = fopen(fname, "wb");
-        if (!dumpFP) {
-            fprintf(stderr,"Warning: stream dump failed to open file %s\n",fname);
-        }
-        delete [] fname;
+        dumpWriter = StreamDumpWriter::create(dump_dir);
     }
 
     while (1) {
@@ -97,17 +105,15 @@ intptr_t RenderThread::main() {
         //
         // dump stream to file if needed
         //
-        if (dumpFP) {
+        if (dumpWriter) {
             int skip = readBuf.validData() - stat;
-            fwrite(readBuf.buf()+skip, 1, readBuf.validData()-skip, dumpFP);
-            fflush(dumpFP);
+            dumpWriter->write(readBuf.buf()+skip, readBuf.validData()-skip);
         }
 
         bool progress;
         do {
             progress = false;
 
-            m_lock->lock();
             //
             // try to process some of the command buffer using the GLESv1 decoder
             //
@@ -136,15 +142,11 @@ intptr_t RenderThread::main() {
                 progress = true;
             }
 
-            m_lock->unlock();
-
         } while( progress );
 
     }
 
-    if (dumpFP) {
-        fclose(dumpFP);
-    }
+    delete dumpWriter;
 
     //
     // Release references to the current thread's context/surfaces if any
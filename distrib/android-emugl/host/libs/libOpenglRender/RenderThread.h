@@ -18,7 +18,6 @@
 
 #include "IOStream.h"
 
-#include "emugl/common/mutex.h"
 #include "emugl/common/thread.h"
 
 // A class used to model a thread of the RenderServer. Each one of them
@@ -28,11 +27,16 @@ public:
     // Create a new RenderThread instance.
     // |stream| is an input stream that will be read from the thread,
     // and deleted by it when it exits.
-    // |mutex| is a pointer to a shared mutex used to serialize
-    // decoding operations between all threads.
-    // TODO(digit): Why is this needed here? Shouldn't this be handled
-    //              by the decoders themselves or at a lower-level?
-    static RenderThread* create(IOStream* stream, emugl::Mutex* mutex);
+    // Note that decoding is not serialized between render threads: each
+    // thread only operates on its own current context and surfaces, and
+    // the FrameBuffer methods that touch shared state perform their own
+    // locking.
+    static RenderThread* create(IOStream* stream);
+
+    // Create a new RenderThread for a |stream| that did not go through the
+    // RenderServer, and whose first bytes are still the client flags (see
+    // IOStream.h). The thread reads them itself before decoding.
+    static RenderThread* createForChannel(IOStream* stream);
 
     // Destructor.
     virtual ~RenderThread();
@@ -47,12 +51,12 @@ public:
 private:
     RenderThread();  // No default constructor
 
-    RenderThread(IOStream* stream, emugl::Mutex* mutex);
+    RenderThread(IOStream* stream, bool readClientFlags);
 
     virtual intptr_t main();
 
-    emugl::Mutex* m_lock;
     IOStream* m_stream;
+    bool m_readClientFlags;
 };
 
 #endif
@@ -0,0 +1,217 @@
+/*
+* Copyright (C) 2015 The Android Open Source Project
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+* http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*/
+#include "StreamDump.h"
+
+#include "emugl/common/lazy_instance.h"
+#include "emugl/common/mutex.h"
+
+#include <algorithm>
+#include <utility>
+
+#include <stdlib.h>
+#include <string.h>
+
+#include <errno.h>
+#include <fcntl.h>
+
+#ifdef _WIN32
+#include <io.h>
+#include <windows.h>
+#else
+#include <dirent.h>
+#include <unistd.h>
+#endif
+
+#ifndef O_BINARY
+#define O_BINARY 0
+#endif
+
+const char kStreamDumpMagic[8] = { 'E', 'M', 'U', 'G', 'L', 'D', 'M', 'P' };
+
+namespace {
+
+// Counters shared by all render threads.
+struct DumpGlobals {
+    DumpGlobals() : lock(), nextFile(0), nextSequence(0) {}
+
+    emugl::Mutex lock;
+    unsigned int nextFile;
+    uint64_t nextSequence;
+};
+
+emugl::LazyInstance<DumpGlobals> sGlobals = LAZY_INSTANCE_INIT;
+
+}  // namespace
+
+// Create the first stream_<N> file of |dir| that doesn't exist yet, starting
+// from |*index|, and set |*index| to its N. The files are created exclusively,
+// so neither earlier captures nor those of other processes writing to the
+// same directory are overwritten. Returns NULL on failure.
+static FILE* createStreamDumpFile(const char* dir, unsigned int* index) {
+    size_t bsize = strlen(dir) + 32;
+    char* fname = new char[bsize];
+    FILE* file = NULL;
+    for (;; ++*index) {
+        snprintf(fname, bsize, "%s/stream_%04u", dir, *index);
+        int fd = open(fname, O_WRONLY | O_CREAT | O_EXCL | O_BINARY, 0644);
+        if (fd < 0) {
+            if (errno == EEXIST) {
+                continue;
+            }
+            fprintf(stderr, "Warning: stream dump failed to open file %s\n",
+                    fname);
+            break;
+        }
+        file = fdopen(fd, "wb");
+        if (!file) {
+            close(fd);
+        }
+        break;
+    }
+    delete [] fname;
+    return file;
+}
+
+// static
+StreamDumpWriter* StreamDumpWriter::create(const char* dir) {
+    FILE* file;
+    {
+        // Holding the lock keeps the streams of this process in the order
+        // they were opened.
+        emugl::Mutex::AutoLock lock(sGlobals->lock);
+        file = createStreamDumpFile(dir, &sGlobals->nextFile);
+        if (file) {
+            sGlobals->nextFile++;
+        }
+    }
+    if (!file) {
+        return NULL;
+    }
+    if (fwrite(kStreamDumpMagic, sizeof(kStreamDumpMagic), 1, file) != 1) {
+        fclose(file);
+        return NULL;
+    }
+    return new StreamDumpWriter(file);
+}
+
+StreamDumpWriter::StreamDumpWriter(FILE* file) : mFile(file) {}
+
+StreamDumpWriter::~StreamDumpWriter() {
+    fclose(mFile);
+}
+
+void StreamDumpWriter::write(const void* data, size_t size) {
+    uint32_t size32 = (uint32_t)size;
+    // Capturing is only a debugging aid, so a single lock for all streams
+    // is good enough.
+    emugl::Mutex::AutoLock lock(sGlobals->lock);
+    uint64_t sequence = sGlobals->nextSequence++;
+    fwrite(&sequence, sizeof(sequence), 1, mFile);
+    fwrite(&size32, sizeof(size32), 1, mFile);
+    fwrite(data, 1, size, mFile);
+    fflush(mFile);
+}
+
+bool readStreamDump(const char* path, std::vector<StreamDumpChunk>* chunks) {
+    FILE* file = fopen(path, "rb");
+    if (!file) {
+        return false;
+    }
+    char magic[sizeof(kStreamDumpMagic)];
+    if (fread(magic, sizeof(magic), 1, file) != 1 ||
+        memcmp(magic, kStreamDumpMagic, sizeof(magic)) != 0) {
+        fclose(file);
+        return false;
+    }
+    for (;;) {
+        uint64_t sequence;
+        uint32_t size;
+        if (fread(&sequence, sizeof(sequence), 1, file) != 1 ||
+            fread(&size, sizeof(size), 1, file) != 1) {
+            break;
+        }
+        chunks->push_back(StreamDumpChunk());
+        StreamDumpChunk& chunk = chunks->back();
+        chunk.sequence = sequence;
+        chunk.data.resize(size);
+        if (size && fread(&chunk.data[0], 1, size, file) != size) {
+            chunks->pop_back();
+            break;
+        }
+    }
+    fclose(file);
+    return true;
+}
+
+namespace {
+
+// Return true if |name| is a stream_<N> file name, and set |*index| to N.
+bool parseStreamDumpName(const char* name, unsigned long* index) {
+    static const char kPrefix[] = "stream_";
+    const size_t prefixLen = sizeof(kPrefix) - 1;
+    if (strncmp(name, kPrefix, prefixLen) != 0 ||
+        name[prefixLen] < '0' || name[prefixLen] > '9') {
+        return false;
+    }
+    char* end;
+    *index = strtoul(name + prefixLen, &end, 10);
+    return *end == '\0';
+}
+
+}  // namespace
+
+bool listStreamDumps(const char* dir, std::vector<std::string>* paths) {
+    // The file names are zero-padded to 4 digits only, so sort them by
+    // their index rather than by name.
+    std::vector<std::pair<unsigned long, std::string> > files;
+    unsigned long index;
+#ifdef _WIN32
+    std::string pattern = std::string(dir) + "\\stream_*";
+    WIN32_FIND_DATAA data;
+    HANDLE handle = FindFirstFileA(pattern.c_str(), &data);
+    if (handle == INVALID_HANDLE_VALUE) {
+        if (GetLastError() != ERROR_FILE_NOT_FOUND) {
+            return false;
+        }
+    } else {
+        do {
+            if (!(data.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) &&
+                parseStreamDumpName(data.cFileName, &index)) {
+                files.push_back(std::make_pair(index,
+                        std::string(dir) + "\\" + data.cFileName));
+            }
+        } while (FindNextFileA(handle, &data));
+        FindClose(handle);
+    }
+#else
+    DIR* d = opendir(dir);
+    if (!d) {
+        return false;
+    }
+    while (struct dirent* entry = readdir(d)) {
+        if (parseStreamDumpName(entry->d_name, &index)) {
+            files.push_back(std::make_pair(index,
+                    std::string(dir) + "/" + entry->d_name));
+        }
+    }
+    closedir(d);
+#endif
+    std::sort(files.begin(), files.end());
+    for (size_t n = 0; n < files.size(); ++n) {
+        paths->push_back(files[n].second);
+    }
+    return true;
+}
@@ -0,0 +1,81 @@
+/*
+* Copyright (C) 2015 The Android Open Source Project
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+* http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*/
+#ifndef _LIB_OPENGL_RENDER_STREAM_DUMP_H
+#define _LIB_OPENGL_RENDER_STREAM_DUMP_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include <string>
+#include <vector>
+
+// Captures of the command streams received by render threads, written when
+// RENDERER_DUMP_DIR is defined in the environment, and replayed by the
+// emugl_stream_replay tool.
+//
+// Each render thread writes its own file, named stream_<N>, where N is the
+// order in which the streams were opened. N is the first index that isn't
+// used yet in the directory, so existing captures are never overwritten;
+// use an empty directory per session, since the replay tool loads all the
+// streams of a directory as one session. The file starts with the 8 bytes
+// of kStreamDumpMagic, followed by one record per chunk of data received
+// from the guest:
+//
+//    uint64_t sequence;  // order of reception among all streams.
+//    uint32_t size;      // size of the data, in bytes.
+//    uint8_t data[size];
+//
+// Integers are in host byte order. The sequence numbers let the replay
+// tool decode the chunks of all streams in the order the render threads
+// received them. This reproduces the handles of the objects that the
+// streams create and share, e.g. color buffers.
+
+extern const char kStreamDumpMagic[8];
+
+class StreamDumpWriter {
+public:
+    // Create a new capture file in |dir|, see above. Returns NULL on failure.
+    static StreamDumpWriter* create(const char* dir);
+
+    ~StreamDumpWriter();
+
+    // Append a chunk of |size| bytes received from the guest.
+    void write(const void* data, size_t size);
+
+private:
+    explicit StreamDumpWriter(FILE* file);
+
+    FILE* mFile;
+};
+
+// A chunk of a captured stream.
+struct StreamDumpChunk {
+    uint64_t sequence;
+    std::vector<unsigned char> data;
+};
+
+// Read all the chunks of the capture file at |path| into |chunks|.
+// Returns false if it can't be opened or isn't a capture file. A truncated
+// last record, e.g. if the emulator was killed, is ignored.
+bool readStreamDump(const char* path, std::vector<StreamDumpChunk>* chunks);
+
+// Append the paths of the stream_<N> capture files in |dir| to |paths|,
+// in the order the streams were opened. Returns false if |dir| can't be
+// opened as a directory.
+bool listStreamDumps(const char* dir, std::vector<std::string>* paths);
+
+#endif  // _LIB_OPENGL_RENDER_STREAM_DUMP_H
@@ -28,6 +28,7 @@
 WindowSurface::WindowSurface(EGLDisplay display,
                              EGLConfig config) :
         mSurface(NULL),
+        mLock(),
         mAttachedColorBuffer(NULL),
         mReadContext(NULL),
         mDrawContext(NULL),
@@ -62,6 +63,13 @@ WindowSurface *WindowSurface::create(EGLDisplay display,
 
 
 void WindowSurface::setColorBuffer(ColorBufferPtr p_colorBuffer) {
+    // Dropping the last reference to a ColorBuffer acquires the
+    // FrameBuffer's context lock, so the previous one is only released
+    // after |mLock|.
+    ColorBufferPtr previous;
+    emugl::Mutex::AutoLock lock(mLock);
+
+    previous = mAttachedColorBuffer;
     mAttachedColorBuffer = p_colorBuffer;
 
     // resize the window if the attached color buffer is of different
@@ -86,6 +94,8 @@ void WindowSurface::bind(RenderContextPtr p_ctx, BindType p_bindType) {
 }
 
 bool WindowSurface::flushColorBuffer() {
+    emugl::Mutex::AutoLock lock(mLock);
+
     if (!mAttachedColorBuffer.Ptr()) {
         return true;
     }
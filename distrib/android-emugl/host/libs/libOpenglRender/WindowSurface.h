@@ -19,6 +19,7 @@
 #include "ColorBuffer.h"
 #include "RenderContext.h"
 
+#include "emugl/common/mutex.h"
 #include "emugl/common/smart_ptr.h"
 
 #include <EGL/egl.h>
@@ -89,6 +90,11 @@ private:
 
 private:
     EGLSurface mSurface;
+    // Protects |mSurface|, |mAttachedColorBuffer| and the Pbuffer's size,
+    // which setColorBuffer() and flushColorBuffer() can be called for
+    // from different render threads. flushColorBuffer() acquires the
+    // FrameBuffer's |m_lock| while holding it.
+    emugl::Mutex mLock;
     ColorBufferPtr mAttachedColorBuffer;
     RenderContextPtr mReadContext;
     RenderContextPtr mDrawContext;
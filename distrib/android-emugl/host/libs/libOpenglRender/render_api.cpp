@@ -15,8 +15,12 @@
 */
 #include "render_api.h"
 
+#include "ChannelStream.h"
+#include "DecoderProfiler.h"
 #include "IOStream.h"
+#include "RenderChannel.h"
 #include "RenderServer.h"
+#include "RenderThread.h"
 #include "RenderWindow.h"
 #include "TimeUtils.h"
 
@@ -31,11 +35,24 @@
 #include "GLESv1Dispatch.h"
 #include "GLESv2Dispatch.h"
 
+#include <algorithm>
+#include <set>
+#include <string>
+
 #include <string.h>
 
 static RenderServer* s_renderThread = NULL;
 static char s_renderAddr[256];
 
+// Render threads serving a RenderChannel instead of a socket. They are not
+// known to the RenderServer, so are tracked and reaped here.
+typedef std::set<RenderThread*> ChannelThreadsSet;
+static ChannelThreadsSet s_channelThreads;
+
+// Size of each of the two ring buffers of a RenderChannel. Guest GL
+// libraries flush their command buffer in chunks of this order.
+static const size_t kChannelRingSize = 1024 * 1024;
+
 static RenderWindow* s_renderWindow = NULL;
 
 static IOStream *createRenderThread(int p_stream_buffer_size,
@@ -156,6 +173,15 @@ RENDER_APICALL int RENDER_APIENTRY stopOpenGLRenderer(void)
     IOStream *dummy = createRenderThread(8, IOSTREAM_CLIENT_EXIT_SERVER);
     if (!dummy) return false;
 
+    for (ChannelThreadsSet::iterator t = s_channelThreads.begin();
+         t != s_channelThreads.end();
+         t++) {
+        (*t)->forceStop();
+        (*t)->wait(NULL);
+        delete (*t);
+    }
+    s_channelThreads.clear();
+
     if (s_renderThread) {
         // wait for the thread to exit
         ret = s_renderThread->wait(NULL);
@@ -235,6 +261,66 @@ RENDER_APICALL void RENDER_APIENTRY repaintOpenGLDisplay(void)
             __FUNCTION__);
 }
 
+RENDER_APICALL void* RENDER_APIENTRY openRenderChannel(
+        OnChannelEventFn onEvent, void* context)
+{
+    if (!s_renderThread) {
+        return NULL;
+    }
+
+    // remove from the threads list threads which are no longer running
+    for (ChannelThreadsSet::iterator n, t = s_channelThreads.begin();
+         t != s_channelThreads.end();
+         t = n) {
+        n = t;
+        n++;
+        if ((*t)->isFinished()) {
+            delete (*t);
+            s_channelThreads.erase(t);
+        }
+    }
+
+    RenderChannel* channel =
+            new RenderChannel(kChannelRingSize, onEvent, context);
+    RenderThread* rt = RenderThread::createForChannel(
+            new ChannelStream(channel));
+    if (!rt->start()) {
+        ERR("Failed to start channel RenderThread\n");
+        delete rt;  // also closes the host side of the channel
+        channel->guestClose();
+        return NULL;
+    }
+    s_channelThreads.insert(rt);
+    return channel;
+}
+
+RENDER_APICALL int RENDER_APIENTRY renderChannelWrite(
+        void* channel, const void* buf, size_t len)
+{
+    return static_cast<RenderChannel*>(channel)->guestWrite(buf, len);
+}
+
+RENDER_APICALL int RENDER_APIENTRY renderChannelRead(
+        void* channel, void* buf, size_t len)
+{
+    return static_cast<RenderChannel*>(channel)->guestRead(buf, len);
+}
+
+RENDER_APICALL int RENDER_APIENTRY renderChannelPoll(void* channel)
+{
+    return static_cast<RenderChannel*>(channel)->guestPoll();
+}
+
+RENDER_APICALL int RENDER_APIENTRY renderChannelWantEvents(
+        void* channel, int events)
+{
+    return static_cast<RenderChannel*>(channel)->guestWantEvents(events);
+}
+
+RENDER_APICALL void RENDER_APIENTRY closeRenderChannel(void* channel)
+{
+    static_cast<RenderChannel*>(channel)->guestClose();
+}
 
 /* NOTE: For now, always use TCP mode by default, until the emulator
  *        has been updated to support Unix and Win32 pipes
@@ -278,6 +364,32 @@ IOStream *createRenderThread(int p_stream_buffer_size, unsigned int clientFlags)
     return stream;
 }
 
+RENDER_APICALL void RENDER_APIENTRY setDecoderProfiling(bool enabled,
+                                                       bool reset)
+{
+    if (reset) {
+        emugl::DecoderProfiler::resetAll();
+    }
+    emugl::DecoderProfiler::setEnabled(enabled);
+}
+
+RENDER_APICALL size_t RENDER_APIENTRY getDecoderProfile(char* buffer,
+                                                        size_t bufferSize)
+{
+    std::string report = emugl::DecoderProfiler::report();
+    if (buffer && bufferSize > 0) {
+        size_t len = std::min(report.size(), bufferSize - 1);
+        memcpy(buffer, report.c_str(), len);
+        buffer[len] = '\0';
+    }
+    return report.size();
+}
+
+RENDER_APICALL bool RENDER_APIENTRY dumpDecoderProfile(const char* path)
+{
+    return emugl::DecoderProfiler::dumpToFile(path);
+}
+
 RENDER_APICALL int RENDER_APIENTRY setStreamMode(int mode)
 {
     switch (mode) {
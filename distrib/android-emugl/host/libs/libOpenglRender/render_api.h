@@ -45,6 +45,12 @@ extern "C" {
 #define STREAM_MODE_UNIX      2
 #define STREAM_MODE_PIPE      3
 
+/* event bits reported by renderChannelPoll() and the OnChannelEventFn
+ * callback of openRenderChannel() */
+#define RENDER_CHANNEL_EVENT_CAN_READ   (1 << 0)
+#define RENDER_CHANNEL_EVENT_CAN_WRITE  (1 << 1)
+#define RENDER_CHANNEL_EVENT_CLOSED     (1 << 2)
+
 
 #define RENDER_API_DECLARE(return_type, func_name, signature) \
     typedef return_type (RENDER_APIENTRY *func_name ## Fn) signature; \
@@ -10,6 +10,7 @@
 #include <stdint.h>
 typedef void (*OnPostFn)(void* context, int width, int height, int ydir,
                          int format, int type, unsigned char* pixels);
+typedef void (*OnChannelEventFn)(void* context, int events);
 #define LIST_RENDER_API_FUNCTIONS(X) \
   X(int, initLibrary, ()) \
   X(int, setStreamMode, (int mode)) \
@@ -20,6 +21,15 @@ typedef void (*OnPostFn)(void* context, int width, int height, int ydir,
   X(bool, destroyOpenGLSubwindow, ()) \
   X(void, setOpenGLDisplayRotation, (float zRot)) \
   X(void, repaintOpenGLDisplay, ()) \
+  X(void*, openRenderChannel, (OnChannelEventFn onEvent, void* context)) \
+  X(int, renderChannelWrite, (void* channel, const void* buf, size_t len)) \
+  X(int, renderChannelRead, (void* channel, void* buf, size_t len)) \
+  X(int, renderChannelPoll, (void* channel)) \
+  X(int, renderChannelWantEvents, (void* channel, int events)) \
+  X(void, closeRenderChannel, (void* channel)) \
+  X(void, setDecoderProfiling, (bool enabled, bool reset)) \
+  X(size_t, getDecoderProfile, (char* buffer, size_t bufferSize)) \
+  X(bool, dumpDecoderProfile, (const char* path)) \
   X(int, stopOpenGLRenderer, ()) \
 
 
@@ -0,0 +1,334 @@
+/*
+* Copyright (C) 2015 The Android Open Source Project
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+* http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*/
+
+// Compares the transports between the emulator's GLES pipe and a render
+// thread: the TCP and Unix sockets of the RenderServer, and the in-process
+// RenderChannel. The "guest" side is the benchmark's main thread, and the
+// "host" side a thread reading an IOStream, like a RenderThread.
+//
+// Two things are measured:
+//
+//   - throughput: a large command stream sent in chunks, as the guest GL
+//     libraries flush their command buffers.
+//
+//   - round trips: small commands that each wait for a small reply, like
+//     glGetError() or glFinish().
+//
+// Usage: emugl_render_channel_benchmark [<megabytes> [<round trips>]]
+
+#include "ChannelStream.h"
+#include "RenderChannel.h"
+#include "TcpStream.h"
+#include "render_api.h"
+#ifndef _WIN32
+#include "UnixStream.h"
+#endif
+
+#include "emugl/common/condition_variable.h"
+#include "emugl/common/mutex.h"
+#include "emugl/common/thread.h"
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+
+using emugl::ConditionVariable;
+using emugl::Mutex;
+
+namespace {
+
+int64_t nowUs() {
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return (int64_t)tv.tv_sec * 1000000LL + tv.tv_usec;
+}
+
+// Host side: reads requests made of a header with the size of the payload
+// and of the reply, then the payload, then sends the reply. A request with
+// an empty payload and reply stops the thread.
+class HostThread : public emugl::Thread {
+public:
+    explicit HostThread(IOStream* stream) : mStream(stream) {}
+
+    virtual ~HostThread() {
+        delete mStream;
+    }
+
+    virtual intptr_t main() {
+        const size_t kBufferSize = 64 * 1024;
+        char* buf = new char[kBufferSize];
+        for (;;) {
+            uint32_t header[2];
+            if (!mStream->readFully(header, sizeof(header))) {
+                break;
+            }
+            if (!header[0] && !header[1]) {
+                break;
+            }
+            size_t remaining = header[0];
+            while (remaining > 0) {
+                size_t len = remaining < kBufferSize ? remaining : kBufferSize;
+                if (!mStream->read(buf, &len)) {
+                    remaining = 0;
+                    break;
+                }
+                remaining -= len;
+            }
+            memset(buf, 0, header[1]);
+            mStream->writeFully(buf, header[1]);
+        }
+        delete [] buf;
+        return 0;
+    }
+
+private:
+    IOStream* mStream;
+};
+
+// Guest side of a transport.
+class GuestClient {
+public:
+    virtual ~GuestClient() {}
+    virtual bool writeFully(const void* buf, size_t len) = 0;
+    virtual bool readFully(void* buf, size_t len) = 0;
+};
+
+class SocketClient : public GuestClient {
+public:
+    explicit SocketClient(SocketStream* stream) : mStream(stream) {}
+
+    virtual ~SocketClient() {
+        delete mStream;
+    }
+
+    virtual bool writeFully(const void* buf, size_t len) {
+        return mStream->writeFully(buf, len) == 0;
+    }
+
+    virtual bool readFully(void* buf, size_t len) {
+        return mStream->readFully(buf, len) != NULL;
+    }
+
+private:
+    SocketStream* mStream;
+};
+
+// Uses the non-blocking guest API of the channel, and waits for its event
+// callback when it is full or empty, like the emulator's main loop.
+class ChannelClient : public GuestClient {
+public:
+    ChannelClient() : mChannel(NULL), mLock(), mCond(), mEvents(0) {}
+
+    virtual ~ChannelClient() {
+        mChannel->guestClose();
+    }
+
+    void setChannel(RenderChannel* channel) {
+        mChannel = channel;
+    }
+
+    static void onEvent(void* context, int events) {
+        ChannelClient* client = static_cast<ChannelClient*>(context);
+        Mutex::AutoLock lock(client->mLock);
+        client->mEvents |= events;
+        client->mCond.signal();
+    }
+
+    virtual bool writeFully(const void* buf, size_t len) {
+        const char* data = static_cast<const char*>(buf);
+        while (len > 0) {
+            int count = mChannel->guestWrite(data, len);
+            if (count < 0) {
+                return false;
+            }
+            if (count == 0) {
+                waitFor(RENDER_CHANNEL_EVENT_CAN_WRITE);
+                continue;
+            }
+            data += count;
+            len -= count;
+        }
+        return true;
+    }
+
+    virtual bool readFully(void* buf, size_t len) {
+        char* data = static_cast<char*>(buf);
+        while (len > 0) {
+            int count = mChannel->guestRead(data, len);
+            if (count < 0) {
+                return false;
+            }
+            if (count == 0) {
+                waitFor(RENDER_CHANNEL_EVENT_CAN_READ);
+                continue;
+            }
+            data += count;
+            len -= count;
+        }
+        return true;
+    }
+
+private:
+    void waitFor(int event) {
+        event |= RENDER_CHANNEL_EVENT_CLOSED;
+        if (mChannel->guestWantEvents(event)) {
+            return;
+        }
+        Mutex::AutoLock lock(mLock);
+        while (!(mEvents & event)) {
+            mCond.wait(&mLock);
+        }
+        mEvents &= ~event;
+    }
+
+    RenderChannel* mChannel;
+    Mutex mLock;
+    ConditionVariable mCond;
+    int mEvents;
+};
+
+struct Results {
+    double throughputMBs;
+    double roundTripUs;
+};
+
+bool runBenchmark(GuestClient* client,
+                  size_t totalBytes,
+                  int roundTrips,
+                  Results* results) {
+    const size_t kChunkSize = 16 * 1024;
+    char* chunk = new char[kChunkSize];
+    memset(chunk, 0x55, kChunkSize);
+    bool ok = true;
+
+    int64_t t0 = nowUs();
+    uint32_t header[2] = { (uint32_t)totalBytes, 4 };
+    ok = client->writeFully(header, sizeof(header));
+    for (size_t sent = 0; ok && sent < totalBytes; sent += kChunkSize) {
+        size_t len = totalBytes - sent;
+        if (len > kChunkSize) {
+            len = kChunkSize;
+        }
+        ok = client->writeFully(chunk, len);
+    }
+    uint32_t reply;
+    ok = ok && client->readFully(&reply, sizeof(reply));
+    int64_t t1 = nowUs();
+    results->throughputMBs =
+            totalBytes / (double)(t1 - t0 > 0 ? t1 - t0 : 1);
+
+    t0 = nowUs();
+    for (int n = 0; ok && n < roundTrips; ++n) {
+        char request[8 + 16];
+        header[0] = 16;
+        header[1] = 4;
+        memcpy(request, header, sizeof(header));
+        memset(request + 8, 0, 16);
+        ok = client->writeFully(request, sizeof(request)) &&
+             client->readFully(&reply, sizeof(reply));
+    }
+    t1 = nowUs();
+    results->roundTripUs = (t1 - t0) / (double)roundTrips;
+
+    header[0] = header[1] = 0;
+    client->writeFully(header, sizeof(header));
+    delete [] chunk;
+    return ok;
+}
+
+bool benchSocket(SocketStream* listener,
+                 SocketStream* client,
+                 size_t totalBytes,
+                 int roundTrips,
+                 Results* results) {
+    char addr[SocketStream::MAX_ADDRSTR_LEN];
+    if (listener->listen(addr) < 0 || client->connect(addr) < 0) {
+        delete listener;
+        delete client;
+        return false;
+    }
+    SocketStream* server = listener->accept();
+    delete listener;
+    if (!server) {
+        delete client;
+        return false;
+    }
+
+    HostThread* host = new HostThread(server);
+    host->start();
+    SocketClient guest(client);
+    bool ok = runBenchmark(&guest, totalBytes, roundTrips, results);
+    host->wait(NULL);
+    delete host;
+    return ok;
+}
+
+bool benchChannel(size_t totalBytes, int roundTrips, Results* results) {
+    ChannelClient guest;
+    RenderChannel* channel = new RenderChannel(
+            1024 * 1024, ChannelClient::onEvent, &guest);
+    guest.setChannel(channel);
+
+    HostThread* host = new HostThread(new ChannelStream(channel));
+    host->start();
+    bool ok = runBenchmark(&guest, totalBytes, roundTrips, results);
+    host->wait(NULL);
+    delete host;
+    return ok;
+}
+
+void print(const char* name, bool ok, const Results& results) {
+    if (!ok) {
+        printf("%-8s failed\n", name);
+        return;
+    }
+    printf("%-8s %8.1f MB/s %8.2f us/round trip\n",
+           name, results.throughputMBs, results.roundTripUs);
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+    size_t megabytes = 256;
+    int roundTrips = 20000;
+    if (argc > 1) {
+        megabytes = (size_t)atoi(argv[1]);
+    }
+    if (argc > 2) {
+        roundTrips = atoi(argv[2]);
+    }
+    if (megabytes == 0 || roundTrips <= 0) {
+        fprintf(stderr, "Usage: %s [<megabytes> [<round trips>]]\n", argv[0]);
+        return 1;
+    }
+    size_t totalBytes = megabytes * 1024 * 1024;
+    Results results;
+    bool ok;
+
+    ok = benchSocket(new TcpStream(), new TcpStream(),
+                     totalBytes, roundTrips, &results);
+    print("tcp", ok, results);
+#ifndef _WIN32
+    ok = benchSocket(new UnixStream(), new UnixStream(),
+                     totalBytes, roundTrips, &results);
+    print("unix", ok, results);
+#endif
+    ok = benchChannel(totalBytes, roundTrips, &results);
+    print("channel", ok, results);
+    return 0;
+}
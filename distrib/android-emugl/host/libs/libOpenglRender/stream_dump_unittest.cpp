@@ -0,0 +1,301 @@
+// Copyright (C) 2015 The Android Open Source Project
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "StreamDump.h"
+
+#include "emugl/common/thread.h"
+
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <string>
+#include <vector>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <unistd.h>
+#endif
+
+namespace {
+
+// A temporary directory, removed with its files on destruction.
+class TempDir {
+public:
+    TempDir() : mPath() {
+#ifdef _WIN32
+        char dir[MAX_PATH];
+        char path[MAX_PATH];
+        if (GetTempPathA(sizeof(dir), dir) &&
+            GetTempFileNameA(dir, "sdt", 0, path) &&
+            DeleteFileA(path) && CreateDirectoryA(path, NULL)) {
+            mPath = path;
+        }
+#else
+        char path[] = "/tmp/stream_dump_unittest.XXXXXX";
+        if (mkdtemp(path)) {
+            mPath = path;
+        }
+#endif
+    }
+
+    ~TempDir() {
+        if (mPath.empty()) {
+            return;
+        }
+        std::vector<std::string> files;
+        listStreamDumps(mPath.c_str(), &files);
+        for (size_t n = 0; n < files.size(); ++n) {
+            remove(files[n].c_str());
+        }
+#ifdef _WIN32
+        RemoveDirectoryA(mPath.c_str());
+#else
+        rmdir(mPath.c_str());
+#endif
+    }
+
+    const char* path() const { return mPath.c_str(); }
+
+private:
+    std::string mPath;
+};
+
+std::vector<std::string> listDumps(const TempDir& dir) {
+    std::vector<std::string> paths;
+    EXPECT_TRUE(listStreamDumps(dir.path(), &paths));
+    return paths;
+}
+
+std::vector<StreamDumpChunk> readDump(const std::string& path) {
+    std::vector<StreamDumpChunk> chunks;
+    EXPECT_TRUE(readStreamDump(path.c_str(), &chunks)) << path;
+    return chunks;
+}
+
+std::string chunkString(const StreamDumpChunk& chunk) {
+    return std::string(chunk.data.begin(), chunk.data.end());
+}
+
+void writeString(StreamDumpWriter* writer, const std::string& str) {
+    writer->write(str.data(), str.size());
+}
+
+// Writes |kChunkCount| chunks of "<id>:<n>" to its own stream.
+class WriterThread : public emugl::Thread {
+public:
+    static const int kChunkCount = 200;
+
+    WriterThread(StreamDumpWriter* writer, int id)
+            : mWriter(writer), mId(id) {}
+
+    virtual intptr_t main() {
+        for (int n = 0; n < kChunkCount; ++n) {
+            char buffer[32];
+            snprintf(buffer, sizeof(buffer), "%d:%d", mId, n);
+            mWriter->write(buffer, strlen(buffer));
+        }
+        return 0;
+    }
+
+private:
+    StreamDumpWriter* mWriter;
+    int mId;
+};
+
+bool compareSequence(const StreamDumpChunk& a, const StreamDumpChunk& b) {
+    return a.sequence < b.sequence;
+}
+
+}  // namespace
+
+TEST(StreamDump, RoundTrip) {
+    TempDir dir;
+    ASSERT_TRUE(dir.path()[0]);
+    StreamDumpWriter* writer = StreamDumpWriter::create(dir.path());
+    ASSERT_TRUE(writer);
+    writeString(writer, "hello");
+    writer->write(NULL, 0);
+    writeString(writer, "world");
+    delete writer;
+
+    std::vector<std::string> paths = listDumps(dir);
+    ASSERT_EQ(1U, paths.size());
+    std::vector<StreamDumpChunk> chunks = readDump(paths[0]);
+    ASSERT_EQ(3U, chunks.size());
+    EXPECT_EQ("hello", chunkString(chunks[0]));
+    EXPECT_EQ(0U, chunks[1].data.size());
+    EXPECT_EQ("world", chunkString(chunks[2]));
+    EXPECT_LT(chunks[0].sequence, chunks[1].sequence);
+    EXPECT_LT(chunks[1].sequence, chunks[2].sequence);
+}
+
+TEST(StreamDump, TruncatedRecord) {
+    TempDir dir;
+    ASSERT_TRUE(dir.path()[0]);
+    StreamDumpWriter* writer = StreamDumpWriter::create(dir.path());
+    ASSERT_TRUE(writer);
+    writeString(writer, "complete");
+    delete writer;
+
+    std::vector<std::string> paths = listDumps(dir);
+    ASSERT_EQ(1U, paths.size());
+    // Append the header of a record whose data is missing.
+    FILE* file = fopen(paths[0].c_str(), "ab");
+    ASSERT_TRUE(file);
+    uint64_t sequence = 0;
+    uint32_t size = 16;
+    fwrite(&sequence, sizeof(sequence), 1, file);
+    fwrite(&size, sizeof(size), 1, file);
+    fwrite("short", 5, 1, file);
+    fclose(file);
+
+    std::vector<StreamDumpChunk> chunks = readDump(paths[0]);
+    ASSERT_EQ(1U, chunks.size());
+    EXPECT_EQ("complete", chunkString(chunks[0]));
+}
+
+TEST(StreamDump, NotADump) {
+    TempDir dir;
+    ASSERT_TRUE(dir.path()[0]);
+    std::string path = std::string(dir.path()) + "/stream_0000";
+    FILE* file = fopen(path.c_str(), "wb");
+    ASSERT_TRUE(file);
+    fputs("not a capture", file);
+    fclose(file);
+
+    std::vector<StreamDumpChunk> chunks;
+    EXPECT_FALSE(readStreamDump(path.c_str(), &chunks));
+    EXPECT_FALSE(readStreamDump(
+            (std::string(dir.path()) + "/missing").c_str(), &chunks));
+}
+
+TEST(StreamDump, InterleavedStreams) {
+    TempDir dir;
+    ASSERT_TRUE(dir.path()[0]);
+    StreamDumpWriter* first = StreamDumpWriter::create(dir.path());
+    StreamDumpWriter* second = StreamDumpWriter::create(dir.path());
+    ASSERT_TRUE(first);
+    ASSERT_TRUE(second);
+    writeString(first, "a1");
+    writeString(second, "b1");
+    writeString(second, "b2");
+    writeString(first, "a2");
+    delete first;
+    delete second;
+
+    // Listed in the order the streams were opened.
+    std::vector<std::string> paths = listDumps(dir);
+    ASSERT_EQ(2U, paths.size());
+    std::vector<StreamDumpChunk> a = readDump(paths[0]);
+    std::vector<StreamDumpChunk> b = readDump(paths[1]);
+    ASSERT_EQ(2U, a.size());
+    ASSERT_EQ(2U, b.size());
+    EXPECT_EQ("a1", chunkString(a[0]));
+    EXPECT_EQ("a2", chunkString(a[1]));
+    EXPECT_EQ("b1", chunkString(b[0]));
+    EXPECT_EQ("b2", chunkString(b[1]));
+    // The sequence numbers record the order of the writes across streams.
+    EXPECT_LT(a[0].sequence, b[0].sequence);
+    EXPECT_LT(b[0].sequence, b[1].sequence);
+    EXPECT_LT(b[1].sequence, a[1].sequence);
+}
+
+TEST(StreamDump, ConcurrentWriters) {
+    static const int kThreadCount = 8;
+    TempDir dir;
+    ASSERT_TRUE(dir.path()[0]);
+    StreamDumpWriter* writers[kThreadCount];
+    WriterThread* threads[kThreadCount];
+    for (int n = 0; n < kThreadCount; ++n) {
+        writers[n] = StreamDumpWriter::create(dir.path());
+        ASSERT_TRUE(writers[n]);
+        threads[n] = new WriterThread(writers[n], n);
+    }
+    for (int n = 0; n < kThreadCount; ++n) {
+        EXPECT_TRUE(threads[n]->start());
+    }
+    for (int n = 0; n < kThreadCount; ++n) {
+        EXPECT_TRUE(threads[n]->wait(NULL));
+        delete threads[n];
+        delete writers[n];
+    }
+
+    std::vector<std::string> paths = listDumps(dir);
+    ASSERT_EQ((size_t)kThreadCount, paths.size());
+    std::vector<StreamDumpChunk> all;
+    for (int n = 0; n < kThreadCount; ++n) {
+        std::vector<StreamDumpChunk> chunks = readDump(paths[n]);
+        ASSERT_EQ((size_t)WriterThread::kChunkCount, chunks.size());
+        for (int i = 0; i < WriterThread::kChunkCount; ++i) {
+            char expected[32];
+            snprintf(expected, sizeof(expected), "%d:%d", n, i);
+            EXPECT_EQ(expected, chunkString(chunks[i]));
+            if (i > 0) {
+                EXPECT_LT(chunks[i - 1].sequence, chunks[i].sequence);
+            }
+        }
+        all.insert(all.end(), chunks.begin(), chunks.end());
+    }
+    // The sequence numbers of all the streams are distinct and contiguous.
+    std::sort(all.begin(), all.end(), compareSequence);
+    for (size_t n = 1; n < all.size(); ++n) {
+        EXPECT_EQ(all[n - 1].sequence + 1, all[n].sequence);
+    }
+}
+
+TEST(StreamDump, KeepsExistingFiles) {
+    TempDir dir;
+    ASSERT_TRUE(dir.path()[0]);
+    StreamDumpWriter* writer = StreamDumpWriter::create(dir.path());
+    ASSERT_TRUE(writer);
+    writeString(writer, "first");
+    delete writer;
+    std::vector<std::string> paths = listDumps(dir);
+    ASSERT_EQ(1U, paths.size());
+
+    // Simulate the capture of another process, or of an earlier run, at
+    // the index this process would use next.
+    const char* name = strrchr(paths[0].c_str(), '_') + 1;
+    char other[1024];
+    snprintf(other, sizeof(other), "%s/stream_%04lu", dir.path(),
+             strtoul(name, NULL, 10) + 1);
+    FILE* file = fopen(other, "wb");
+    ASSERT_TRUE(file);
+    fputs("other", file);
+    fclose(file);
+
+    writer = StreamDumpWriter::create(dir.path());
+    ASSERT_TRUE(writer);
+    writeString(writer, "second");
+    delete writer;
+
+    paths = listDumps(dir);
+    ASSERT_EQ(3U, paths.size());
+    EXPECT_EQ(other, paths[1]);
+    file = fopen(other, "rb");
+    ASSERT_TRUE(file);
+    char buffer[16] = {};
+    EXPECT_EQ(5U, fread(buffer, 1, sizeof(buffer), file));
+    fclose(file);
+    EXPECT_STREQ("other", buffer);
+
+    std::vector<StreamDumpChunk> chunks = readDump(paths[2]);
+    ASSERT_EQ(1U, chunks.size());
+    EXPECT_EQ("second", chunkString(chunks[0]));
+}
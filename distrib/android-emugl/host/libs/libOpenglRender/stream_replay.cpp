@@ -0,0 +1,441 @@
+/*
+* Copyright (C) 2015 The Android Open Source Project
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+* http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*/
+
+// Replays command streams captured with RENDERER_DUMP_DIR (see
+// StreamDump.h) through the GLESv1, GLESv2 and renderControl decoders,
+// against an offscreen FrameBuffer, and reports the time spent per frame
+// and per call. This measures the host renderer reproducibly, without a
+// guest.
+//
+// Each stream of a capture is replayed by its own thread, like the render
+// thread that received it, but only one chunk is decoded at a time, in
+// the order the chunks were received. The decoders' replies are dropped.
+//
+// A frame ends with each rcFBPost() call, i.e. each time the guest
+// composed the screen, or with -swap, with each rcFlushWindowColorBuffer()
+// call, i.e. each eglSwapBuffers(). Frame times only count decoding, not
+// the switches between threads. They include waiting for the GPU only
+// where the calls themselves do, e.g. glFinish() or readbacks.
+//
+// The GL backend is selected like in the emulator, e.g. ANDROID_EGL_LIB,
+// ANDROID_GLESv1_LIB and ANDROID_GLESv2_LIB can select a software one.
+//
+// Usage: emugl_stream_replay [-width <w>] [-height <h>] [-swap] [-frames]
+//                            <capture dir or file>...
+//
+// A directory stands for all the stream_<N> files in it, i.e. usually the
+// RENDERER_DUMP_DIR of a session. When passing files, pass all those of a
+// capture, otherwise the handles used by the other streams, e.g. to share
+// color buffers, won't be valid.
+
+#include "DecoderProfiler.h"
+#include "EGLDispatch.h"
+#include "FrameBuffer.h"
+#include "GLESv1Dispatch.h"
+#include "GLESv2Dispatch.h"
+#include "IOStream.h"
+#include "RenderControl.h"
+#include "RenderThreadInfo.h"
+#include "StreamDump.h"
+#include "renderControl_opcodes.h"
+
+#include "emugl/common/condition_variable.h"
+#include "emugl/common/mutex.h"
+#include "emugl/common/thread.h"
+
+#include <algorithm>
+#include <string>
+#include <vector>
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+using emugl::ConditionVariable;
+using emugl::DecoderProfiler;
+using emugl::Mutex;
+
+namespace {
+
+// Size of the header of all packets: a 32-bit opcode, then the 32-bit
+// size of the whole packet.
+const size_t kPacketHeaderSize = 8;
+
+// An IOStream that drops the replies of the decoders.
+class NullStream : public IOStream {
+public:
+    NullStream() : IOStream(kBufferSize), mBuf(kBufferSize) {}
+
+    virtual void* allocBuffer(size_t minSize) {
+        if (mBuf.size() < minSize) {
+            mBuf.resize(minSize);
+        }
+        return &mBuf[0];
+    }
+
+    virtual int commitBuffer(size_t size) { return (int)size; }
+
+    virtual const unsigned char* readFully(void* buf, size_t len) {
+        return NULL;
+    }
+
+    virtual const unsigned char* read(void* buf, size_t* inout_len) {
+        return NULL;
+    }
+
+    virtual int writeFully(const void* buf, size_t len) { return (int)len; }
+
+    virtual void forceStop() {}
+
+private:
+    static const size_t kBufferSize = 64 * 1024;
+
+    std::vector<unsigned char> mBuf;
+};
+
+struct Stream {
+    std::string path;
+    std::vector<StreamDumpChunk> chunks;
+};
+
+// A chunk in the global order of reception.
+struct ChunkRef {
+    uint64_t sequence;
+    size_t stream;
+
+    bool operator<(const ChunkRef& other) const {
+        return sequence < other.sequence;
+    }
+};
+
+class Replay {
+public:
+    Replay(std::vector<Stream>* streams, uint32_t frameOpcode) :
+            mStreams(streams), mOrder(), mTurn(0), mLock(),
+            mConditions(streams->size()), mFrameOpcode(frameOpcode),
+            mFrameNs(0), mFrames(), mBytes(0), mSkippedPackets(0) {
+        for (size_t n = 0; n < streams->size(); ++n) {
+            const std::vector<StreamDumpChunk>& chunks = (*streams)[n].chunks;
+            for (size_t c = 0; c < chunks.size(); ++c) {
+                ChunkRef ref = { chunks[c].sequence, n };
+                mOrder.push_back(ref);
+            }
+        }
+        std::stable_sort(mOrder.begin(), mOrder.end());
+        for (size_t n = 0; n < mConditions.size(); ++n) {
+            mConditions[n] = new ConditionVariable();
+        }
+    }
+
+    ~Replay() {
+        for (size_t n = 0; n < mConditions.size(); ++n) {
+            delete mConditions[n];
+        }
+    }
+
+    const Stream& stream(size_t index) const { return (*mStreams)[index]; }
+
+    // Block until the next chunk to decode belongs to stream |index|.
+    void waitTurn(size_t index) {
+        Mutex::AutoLock lock(mLock);
+        while (mOrder[mTurn].stream != index) {
+            mConditions[index]->wait(&mLock);
+        }
+    }
+
+    // Let the stream of the next chunk, if any, decode it.
+    void endTurn() {
+        Mutex::AutoLock lock(mLock);
+        ++mTurn;
+        if (mTurn < mOrder.size()) {
+            mConditions[mOrder[mTurn].stream]->signal();
+        }
+    }
+
+    // Decode the complete packets at the start of the |len| bytes at
+    // |buf|, and return their size. Only call this during a turn.
+    size_t decode(RenderThreadInfo* tInfo, unsigned char* buf, size_t len,
+                  IOStream* stream) {
+        size_t pos = 0;
+        for (;;) {
+            // Find the end of the current frame, or of the last complete
+            // packet.
+            size_t end = pos;
+            bool frameEnd = false;
+            while (end + kPacketHeaderSize <= len) {
+                uint32_t opcode, size;
+                memcpy(&opcode, buf + end, sizeof(opcode));
+                memcpy(&size, buf + end + 4, sizeof(size));
+                if (size < kPacketHeaderSize || size > len - end) {
+                    break;
+                }
+                end += size;
+                if (opcode == mFrameOpcode) {
+                    frameEnd = true;
+                    break;
+                }
+            }
+            if (end == pos) {
+                break;
+            }
+
+            uint64_t start = DecoderProfiler::now();
+            while (pos < end) {
+                size_t last = decodePackets(tInfo, buf + pos, end - pos,
+                                            stream);
+                if (!last) {
+                    // No decoder knows this packet, skip it.
+                    uint32_t size;
+                    memcpy(&size, buf + pos + 4, sizeof(size));
+                    last = size;
+                    mSkippedPackets++;
+                }
+                pos += last;
+            }
+            mFrameNs += DecoderProfiler::now() - start;
+
+            if (frameEnd) {
+                mFrames.push_back(mFrameNs);
+                mFrameNs = 0;
+            }
+        }
+        mBytes += pos;
+        return pos;
+    }
+
+    void printResults(bool printFrames) {
+        uint64_t totalNs = mFrameNs;
+        for (size_t n = 0; n < mFrames.size(); ++n) {
+            totalNs += mFrames[n];
+        }
+        printf("%u streams, %u chunks, %.2f MB, %u frames, "
+               "%.2f ms decoding\n",
+               (unsigned)mStreams->size(), (unsigned)mOrder.size(),
+               mBytes / (1024. * 1024.), (unsigned)mFrames.size(),
+               totalNs / 1e6);
+        if (mSkippedPackets) {
+            printf("WARNING: skipped %u unknown packets\n",
+                   (unsigned)mSkippedPackets);
+        }
+        if (printFrames) {
+            for (size_t n = 0; n < mFrames.size(); ++n) {
+                printf("frame %5u: %8.3f ms\n", (unsigned)n,
+                       mFrames[n] / 1e6);
+            }
+        }
+        if (!mFrames.empty()) {
+            std::vector<uint64_t> sorted(mFrames);
+            std::sort(sorted.begin(), sorted.end());
+            printf("frame time (ms): avg %.3f  min %.3f  median %.3f  "
+                   "90th %.3f  99th %.3f  max %.3f\n",
+                   (totalNs - mFrameNs) / 1e6 / sorted.size(),
+                   sorted.front() / 1e6,
+                   percentile(sorted, 50) / 1e6,
+                   percentile(sorted, 90) / 1e6,
+                   percentile(sorted, 99) / 1e6,
+                   sorted.back() / 1e6);
+        }
+        printf("\n%s", DecoderProfiler::report().c_str());
+    }
+
+private:
+    // Decode as much as possible of |buf| with the three decoders, like a
+    // RenderThread. Returns the number of bytes decoded.
+    static size_t decodePackets(RenderThreadInfo* tInfo, unsigned char* buf,
+                                size_t len, IOStream* stream) {
+        size_t total = 0;
+        bool progress;
+        do {
+            progress = false;
+            size_t last = tInfo->m_glDec.decode(buf + total, len - total,
+                                                stream);
+            if (last > 0) {
+                progress = true;
+                total += last;
+            }
+            last = tInfo->m_gl2Dec.decode(buf + total, len - total, stream);
+            if (last > 0) {
+                progress = true;
+                total += last;
+            }
+            last = tInfo->m_rcDec.decode(buf + total, len - total, stream);
+            if (last > 0) {
+                progress = true;
+                total += last;
+            }
+        } while (progress && total < len);
+        return total;
+    }
+
+    static uint64_t percentile(const std::vector<uint64_t>& sorted, int p) {
+        return sorted[(sorted.size() - 1) * p / 100];
+    }
+
+    std::vector<Stream>* mStreams;
+    std::vector<ChunkRef> mOrder;
+    size_t mTurn;
+    Mutex mLock;
+    // One per stream, signaled when it is its turn.
+    std::vector<ConditionVariable*> mConditions;
+
+    // The following are only used during turns, so need no lock.
+    uint32_t mFrameOpcode;
+    uint64_t mFrameNs;  // decoding time of the current frame so far.
+    std::vector<uint64_t> mFrames;
+    uint64_t mBytes;
+    size_t mSkippedPackets;
+};
+
+class ReplayThread : public emugl::Thread {
+public:
+    ReplayThread(Replay* replay, size_t index) :
+            mReplay(replay), mIndex(index) {}
+
+    virtual intptr_t main() {
+        RenderThreadInfo tInfo;
+        tInfo.m_glDec.initGL(gles1_dispatch_get_proc_func, NULL);
+        tInfo.m_gl2Dec.initGL(gles2_dispatch_get_proc_func, NULL);
+        initRenderControlContext(&tInfo.m_rcDec);
+
+        NullStream stream;
+        std::vector<unsigned char> pending;
+        const std::vector<StreamDumpChunk>& chunks =
+                mReplay->stream(mIndex).chunks;
+        for (size_t n = 0; n < chunks.size(); ++n) {
+            mReplay->waitTurn(mIndex);
+            pending.insert(pending.end(), chunks[n].data.begin(),
+                           chunks[n].data.end());
+            size_t consumed = 0;
+            if (!pending.empty()) {
+                consumed = mReplay->decode(&tInfo, &pending[0],
+                                           pending.size(), &stream);
+            }
+            pending.erase(pending.begin(), pending.begin() + consumed);
+
+            if (n + 1 == chunks.size()) {
+                // The guest closed the stream after its last chunk, so
+                // release its objects like a RenderThread.
+                if (!pending.empty()) {
+                    fprintf(stderr, "WARNING: %s: %u trailing bytes\n",
+                            mReplay->stream(mIndex).path.c_str(),
+                            (unsigned)pending.size());
+                }
+                FrameBuffer::getFB()->bindContext(0, 0, 0);
+                FrameBuffer::getFB()->drainWindowSurface();
+                FrameBuffer::getFB()->drainRenderContext();
+            }
+            mReplay->endTurn();
+        }
+        return 0;
+    }
+
+private:
+    Replay* mReplay;
+    size_t mIndex;
+};
+
+void usage(const char* progName) {
+    fprintf(stderr,
+            "Usage: %s [-width <w>] [-height <h>] [-swap] [-frames] "
+            "<capture dir or file>...\n"
+            "  -width, -height  size of the emulated display "
+            "(default 720x1280)\n"
+            "  -swap            end frames with eglSwapBuffers() "
+            "instead of posts\n"
+            "  -frames          print the time of each frame\n",
+            progName);
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+    int width = 720;
+    int height = 1280;
+    uint32_t frameOpcode = OP_rcFBPost;
+    bool printFrames = false;
+    std::vector<Stream> streams;
+
+    for (int n = 1; n < argc; ++n) {
+        const char* arg = argv[n];
+        if (!strcmp(arg, "-width") && n + 1 < argc) {
+            width = atoi(argv[++n]);
+        } else if (!strcmp(arg, "-height") && n + 1 < argc) {
+            height = atoi(argv[++n]);
+        } else if (!strcmp(arg, "-swap")) {
+            frameOpcode = OP_rcFlushWindowColorBuffer;
+        } else if (!strcmp(arg, "-frames")) {
+            printFrames = true;
+        } else if (arg[0] == '-') {
+            usage(argv[0]);
+            return 1;
+        } else {
+            std::vector<std::string> paths;
+            if (!listStreamDumps(arg, &paths)) {
+                paths.push_back(arg);
+            } else if (paths.empty()) {
+                fprintf(stderr, "No capture files in %s\n", arg);
+                return 1;
+            }
+            for (size_t i = 0; i < paths.size(); ++i) {
+                streams.push_back(Stream());
+                streams.back().path = paths[i];
+                if (!readStreamDump(paths[i].c_str(),
+                                    &streams.back().chunks)) {
+                    fprintf(stderr, "Can't read capture file %s\n",
+                            paths[i].c_str());
+                    return 1;
+                }
+            }
+        }
+    }
+    if (streams.empty() || width <= 0 || height <= 0) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    if (!init_egl_dispatch() || !init_gles1_dispatch() ||
+        !init_gles2_dispatch()) {
+        fprintf(stderr, "Can't load the EGL and GLES libraries\n");
+        return 1;
+    }
+    if (!FrameBuffer::initialize(width, height, false)) {
+        fprintf(stderr, "Can't initialize the FrameBuffer\n");
+        return 1;
+    }
+
+    Replay replay(&streams, frameOpcode);
+    DecoderProfiler::resetAll();
+    DecoderProfiler::setEnabled(true);
+
+    std::vector<ReplayThread*> threads;
+    for (size_t n = 0; n < streams.size(); ++n) {
+        threads.push_back(new ReplayThread(&replay, n));
+        if (!threads.back()->start()) {
+            fprintf(stderr, "Can't start replay thread\n");
+            return 1;
+        }
+    }
+    for (size_t n = 0; n < threads.size(); ++n) {
+        threads[n]->wait(NULL);
+        delete threads[n];
+    }
+
+    DecoderProfiler::setEnabled(false);
+    replay.printResults(printFrames);
+    FrameBuffer::getFB()->finalize();
+    return 0;
+}
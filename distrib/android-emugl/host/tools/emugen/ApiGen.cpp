@@ -350,11 +350,25 @@ int ApiGen::genEncoderHeader(const std::string &filename)
     for (size_t i = 0; i < m_encoderHeaders.size(); i++) {
         fprintf(fp, "#include %s\n", m_encoderHeaders[i].c_str());
     }
+
+    bool hasCacheable = false;
+    for (size_t i = 0; i < size(); i++) {
+        if (!at(i).unsupported() && at(i).cacheable()) {
+            hasCacheable = true;
+        }
+    }
+    if (hasCacheable) {
+        fprintf(fp, "#include \"EncoderResultCache.h\"\n");
+    }
     fprintf(fp, "\n");
 
     fprintf(fp, "struct %s : public %s_%s_context_t {\n\n",
             classname.c_str(), m_basename.c_str(), sideString(CLIENT_SIDE));
-    fprintf(fp, "\tIOStream *m_stream;\n\n");
+    fprintf(fp, "\tIOStream *m_stream;\n");
+    if (hasCacheable) {
+        fprintf(fp, "\tEncoderResultCache m_resultCache;\n");
+    }
+    fprintf(fp, "\n");
 
     fprintf(fp, "\t%s(IOStream *stream);\n", classname.c_str());
     fprintf(fp, "};\n\n");
@@ -444,6 +458,134 @@ static void writeVarEncodingExpression(Var& var, FILE* fp)
     }
 }
 
+// Returns true iff |var| is a pointer whose data is sent back by the host.
+static bool isOutputVar(Var& var)
+{
+    if (!var.isPointer()) {
+        return false;
+    }
+    Var::PointerDir dir = var.pointerDir();
+    return dir == Var::POINTER_INOUT || dir == Var::POINTER_OUT;
+}
+
+// For entry points with the 'cacheable' attribute, write the code that
+// hashes the call's inputs and returns early from the encoder if the
+// context's result cache already holds a reply for them. A reply is made
+// of the output parameters' data, followed by the return value.
+static void writeCacheLookup(EntryPoint* e, FILE* fp)
+{
+    VarsArray& evars = e->vars();
+    const Var& retval = e->retval();
+    bool hasRetval = retval.type()->name() != "void";
+
+    fprintf(fp, "\tconst bool __cacheable = (%s);\n",
+            e->cacheExpression().c_str());
+    fprintf(fp, "\tconst size_t __cacheSize = ");
+    const char* plus = "";
+    for (size_t j = 0; j < evars.size(); j++) {
+        if (isOutputVar(evars[j])) {
+            fprintf(fp, "%s__size_%s", plus, evars[j].name().c_str());
+            plus = " + ";
+        }
+    }
+    if (hasRetval) {
+        fprintf(fp, "%s%u", plus, (unsigned) retval.type()->bytes());
+    }
+    fprintf(fp, ";\n");
+    fprintf(fp, "\tuint64_t __cacheKey = 0;\n");
+    fprintf(fp, "\tif (__cacheable) {\n");
+    fprintf(fp, "\t\t__cacheKey = EncoderResultCache::hashInit(OP_%s);\n",
+            e->name().c_str());
+    for (size_t j = 0; j < evars.size(); j++) {
+        Var& var = evars[j];
+        const char* varname = var.name().c_str();
+        if (!var.isPointer()) {
+            if (!var.isVoid()) {
+                fprintf(fp,
+                        "\t\t__cacheKey = EncoderResultCache::hash(__cacheKey, &%s, %u);\n",
+                        varname, (unsigned) var.type()->bytes());
+            }
+            continue;
+        }
+        fprintf(fp,
+                "\t\t__cacheKey = EncoderResultCache::hash(__cacheKey, &__size_%s, 4);\n",
+                varname);
+        Var::PointerDir dir = var.pointerDir();
+        if (dir == Var::POINTER_INOUT || dir == Var::POINTER_IN) {
+            fprintf(fp, "\t\t");
+            if (var.nullAllowed()) {
+                fprintf(fp, "if (%s != NULL) ", varname);
+            }
+            fprintf(fp,
+                    "__cacheKey = EncoderResultCache::hash(__cacheKey, %s, __size_%s);\n",
+                    varname, varname);
+        }
+    }
+    fprintf(fp, "\t\tconst unsigned char *__cached = "
+                "ctx->m_resultCache.find(__cacheKey, __cacheSize);\n");
+    fprintf(fp, "\t\tif (__cached != NULL) {\n");
+    for (size_t j = 0; j < evars.size(); j++) {
+        if (!isOutputVar(evars[j])) {
+            continue;
+        }
+        const char* varname = evars[j].name().c_str();
+        fprintf(fp, "\t\t\t");
+        if (evars[j].nullAllowed()) {
+            fprintf(fp, "if (%s != NULL) ", varname);
+        }
+        fprintf(fp, "memcpy(%s, __cached, __size_%s);", varname, varname);
+        fprintf(fp, " __cached += __size_%s;\n", varname);
+    }
+    if (hasRetval) {
+        fprintf(fp, "\t\t\t%s retval;\n", retval.type()->name().c_str());
+        fprintf(fp, "\t\t\tmemcpy(&retval, __cached, %u);\n",
+                (unsigned) retval.type()->bytes());
+        fprintf(fp, "\t\t\treturn retval;\n");
+    } else {
+        fprintf(fp, "\t\t\treturn;\n");
+    }
+    fprintf(fp, "\t\t}\n");
+    fprintf(fp, "\t}\n\n");
+}
+
+// Write the code that stores the reply of a cacheable call, once it has
+// been read back from the host, into the context's result cache. Replies
+// for which the 'cachevalid' expression is false, i.e. failures, are not
+// stored.
+static void writeCacheInsert(EntryPoint* e, FILE* fp)
+{
+    VarsArray& evars = e->vars();
+    const Var& retval = e->retval();
+
+    if (e->cacheValidExpression().size() > 0) {
+        fprintf(fp, "\tif (__cacheable && (%s)) {\n",
+                e->cacheValidExpression().c_str());
+    } else {
+        fprintf(fp, "\tif (__cacheable) {\n");
+    }
+    fprintf(fp, "\t\tunsigned char *__cache = "
+                "ctx->m_resultCache.insert(__cacheKey, __cacheSize);\n");
+    fprintf(fp, "\t\tif (__cache != NULL) {\n");
+    for (size_t j = 0; j < evars.size(); j++) {
+        if (!isOutputVar(evars[j])) {
+            continue;
+        }
+        const char* varname = evars[j].name().c_str();
+        fprintf(fp, "\t\t\t");
+        if (evars[j].nullAllowed()) {
+            fprintf(fp, "if (%s != NULL) ", varname);
+        }
+        fprintf(fp, "memcpy(__cache, %s, __size_%s);", varname, varname);
+        fprintf(fp, " __cache += __size_%s;\n", varname);
+    }
+    if (retval.type()->name() != "void") {
+        fprintf(fp, "\t\t\tmemcpy(__cache, &retval, %u);\n",
+                (unsigned) retval.type()->bytes());
+    }
+    fprintf(fp, "\t\t}\n");
+    fprintf(fp, "\t}\n");
+}
+
 #if WITH_LARGE_SUPPORT
 static void writeVarLargeEncodingExpression(Var& var, FILE* fp)
 {
@@ -525,6 +667,24 @@ int ApiGen::genEncoderImpl(const std::string &filename)
             fprintf(fp, "%s;\n", buff);
         }
 
+        // Only calls that get a reply from the host can be cached.
+        bool cacheable = false;
+        if (e->cacheable()) {
+            cacheable = e->retval().type()->name() != "void";
+            for (j = 0; j < maxvars; j++) {
+                cacheable = cacheable || isOutputVar(evars[j]);
+            }
+            if (e->retval().isPointer() || !cacheable) {
+                fprintf(stderr, "WARNING: %s : ignoring 'cacheable' attribute, "
+                        "the call has no result to cache\n", e->name().c_str());
+                cacheable = false;
+            }
+        }
+        if (cacheable) {
+            fprintf(fp, "\n");
+            writeCacheLookup(e, fp);
+        }
+
 #if WITH_LARGE_SUPPORT
         // We need to take care of 'isLarge' variable in a special way
         // Anything before an isLarge variable can be packed into a single
@@ -673,9 +833,17 @@ int ApiGen::genEncoderImpl(const std::string &filename)
         } else if (e->retval().type()->name() != "void") {
             fprintf(fp, "\n\t%s retval;\n", e->retval().type()->name().c_str());
             fprintf(fp, "\tstream->readback(&retval, %u);\n",(unsigned) e->retval().type()->bytes());
+            if (cacheable) {
+                writeCacheInsert(e, fp);
+            }
             fprintf(fp, "\treturn retval;\n");
-        } else if (e->flushOnEncode()) {
-            fprintf(fp, "\tstream->flush();\n");
+        } else {
+            if (cacheable) {
+                writeCacheInsert(e, fp);
+            }
+            if (e->flushOnEncode()) {
+                fprintf(fp, "\tstream->flush();\n");
+            }
         }
         fprintf(fp, "}\n\n");
     }
@@ -789,6 +957,7 @@ int ApiGen::genDecoderImpl(const std::string &filename)
     fprintf(fp, "#include \"%s_opcodes.h\"\n\n", m_basename.c_str());
     fprintf(fp, "#include \"%s_dec.h\"\n\n\n", m_basename.c_str());
     fprintf(fp, "#include \"ProtocolUtils.h\"\n\n");
+    fprintf(fp, "#include \"DecoderProfiler.h\"\n\n");
     fprintf(fp, "#include <stdio.h>\n\n");
     fprintf(fp, "typedef unsigned int tsize_t; // Target \"size_t\", which is 32-bit for now. It may or may not be the same as host's size_t when emugen is compiled.\n\n");
 
@@ -810,6 +979,20 @@ int ApiGen::genDecoderImpl(const std::string &filename)
     // helper templates
     fprintf(fp, "using namespace emugl;\n\n");
 
+    // per-opcode profiling counters, see DecoderProfiler.h
+    fprintf(fp, "namespace {\n\n");
+    fprintf(fp, "const char* const kCallNames[] = {\n");
+    for (size_t f = 0; f < n; f++) {
+        fprintf(fp, "\t\"%s\",\n", at(f).name().c_str());
+    }
+    fprintf(fp, "};\n\n");
+    fprintf(fp,
+            "DecoderProfiler s_profiler(\"%s\", OP_%s, kCallNames,\n"
+            "                           sizeof(kCallNames) / sizeof(kCallNames[0]));\n\n",
+            m_basename.c_str(),
+            n > 0 ? at(0).name().c_str() : "last");
+    fprintf(fp, "}  // namespace\n\n");
+
     // decoder switch;
     fprintf(fp, "size_t %s::decode(void *buf, size_t len, IOStream *stream)\n{\n", classname.c_str());
     fprintf(fp,
@@ -818,6 +1001,7 @@ int ApiGen::genDecoderImpl(const std::string &filename)
 \tif (len < 8) return pos; \n\
 \tunsigned char *ptr = (unsigned char *)buf;\n\
 \tbool unknownOpcode = false;  \n\
+\tconst bool profiling = DecoderProfiler::isEnabled();\n\
 #ifdef CHECK_GL_ERROR \n\
 \tchar lastCall[256] = {0}; \n\
 #endif \n\
@@ -825,6 +1009,8 @@ int ApiGen::genDecoderImpl(const std::string &filename)
 \t\tuint32_t opcode = *(uint32_t *)ptr;   \n\
 \t\tsize_t packetLen = *(uint32_t *)(ptr + 4);\n\
 \t\tif (len - pos < packetLen)  return pos; \n\
+\t\tuint64_t profileStart = profiling ? DecoderProfiler::now() : 0;\n\
+\t\tuint64_t profileDispatch = 0;\n\
 \t\tswitch(opcode) {\n");
 
     for (size_t f = 0; f < n; f++) {
@@ -862,6 +1048,9 @@ int ApiGen::genDecoderImpl(const std::string &filename)
         }
 
         for (int pass = PASS_FIRST; pass < PASS_LAST; pass++) {
+            if (pass == PASS_FunctionCall) {
+                fprintf(fp, "\t\t\tif (profiling) profileDispatch = DecoderProfiler::now();\n");
+            }
             if (pass == PASS_FunctionCall &&
                 !e->retval().isVoid() &&
                 !e->retval().isPointer()) {
@@ -1076,6 +1265,9 @@ int ApiGen::genDecoderImpl(const std::string &filename)
                 pass == PASS_DebugPrint) {
                 fprintf(fp, ");\n");
             }
+            if (pass == PASS_FunctionCall) {
+                fprintf(fp, "\t\t\tif (profiling) profileDispatch = DecoderProfiler::now() - profileDispatch;\n");
+            }
 
             if (pass == PASS_TmpBuffAlloc) {
                 if (!e->retval().isVoid() && !e->retval().isPointer()) {
@@ -1121,6 +1313,9 @@ int ApiGen::genDecoderImpl(const std::string &filename)
     }
 
     fprintf(fp, "\t\tif (!unknownOpcode) {\n");
+    fprintf(fp, "\t\t\tif (profiling) {\n");
+    fprintf(fp, "\t\t\t\ts_profiler.record(opcode, packetLen, DecoderProfiler::now() - profileStart, profileDispatch);\n");
+    fprintf(fp, "\t\t\t}\n");
     fprintf(fp, "\t\t\tpos += packetLen;\n");
     fprintf(fp, "\t\t\tptr += packetLen;\n");
     fprintf(fp, "\t\t}\n");
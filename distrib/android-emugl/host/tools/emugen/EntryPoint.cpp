@@ -39,6 +39,8 @@ void EntryPoint::reset()
     m_customDecoder = false;
     m_notApi = false;
     m_flushOnEncode = false;
+    m_cacheExpression.clear();
+    m_cacheValidExpression.clear();
     m_vars.empty();
 }
 
@@ -322,6 +324,24 @@ int EntryPoint::setAttribute(const std::string &line, size_t lc)
         // set the size expression into var
         pos = last;
         v->setWriteExpression(line.substr(pos));
+    } else if (token == "cacheable") {
+        pos = line.find_first_not_of(WHITESPACE, last);
+        std::string expr = (pos == std::string::npos) ? "" : line.substr(pos);
+        if (expr.size() == 0) {
+            fprintf(stderr, "ERROR: %u: Missing condition in 'cacheable' attribute\n", (unsigned int)lc);
+            return -1;
+        }
+        // set the condition expression into the entry point
+        setCacheExpression(expr);
+    } else if (token == "cachevalid") {
+        pos = line.find_first_not_of(WHITESPACE, last);
+        std::string expr = (pos == std::string::npos) ? "" : line.substr(pos);
+        if (expr.size() == 0) {
+            fprintf(stderr, "ERROR: %u: Missing condition in 'cachevalid' attribute\n", (unsigned int)lc);
+            return -1;
+        }
+        // set the reply condition expression into the entry point
+        setCacheValidExpression(expr);
     } else if (token == "flag") {
         pos = last;
         std::string flag = getNextToken(line, pos, &last, WHITESPACE);
@@ -49,6 +49,11 @@ public:
     void setNotApi(bool state) { m_notApi = state; }
     bool flushOnEncode() const { return m_flushOnEncode; }
     void setFlushOnEncode(bool state) { m_flushOnEncode = state; }
+    bool cacheable() const { return m_cacheExpression.size() > 0; }
+    const std::string & cacheExpression() const { return m_cacheExpression; }
+    void setCacheExpression(const std::string & expr) { m_cacheExpression = expr; }
+    const std::string & cacheValidExpression() const { return m_cacheValidExpression; }
+    void setCacheValidExpression(const std::string & expr) { m_cacheValidExpression = expr; }
     int setAttribute(const std::string &line, size_t lc);
 
 private:
@@ -60,6 +65,8 @@ private:
     bool m_customDecoder;
     bool m_notApi;
     bool m_flushOnEncode;
+    std::string m_cacheExpression;
+    std::string m_cacheValidExpression;
 
     void err(unsigned int lc, const char *msg) {
         fprintf(stderr, "line %d: %s\n", lc, msg);
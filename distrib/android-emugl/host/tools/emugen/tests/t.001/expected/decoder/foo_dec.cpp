@@ -10,6 +10,8 @@
 
 #include "ProtocolUtils.h"
 
+#include "DecoderProfiler.h"
+
 #include <stdio.h>
 
 typedef unsigned int tsize_t; // Target "size_t", which is 32-bit for now. It may or may not be the same as host's size_t when emugen is compiled.
@@ -28,6 +30,21 @@ typedef unsigned int tsize_t; // Target "size_t", which is 32-bit for now. It ma
 
 using namespace emugl;
 
+namespace {
+
+const char* const kCallNames[] = {
+	"fooAlphaFunc",
+	"fooIsBuffer",
+	"fooUnsupported",
+	"fooDoEncoderFlush",
+	"fooTakeConstVoidPtrConstPtr",
+};
+
+DecoderProfiler s_profiler("foo", OP_fooAlphaFunc, kCallNames,
+                           sizeof(kCallNames) / sizeof(kCallNames[0]));
+
+}  // namespace
+
 size_t foo_decoder_context_t::decode(void *buf, size_t len, IOStream *stream)
 {
                            
@@ -35,6 +52,7 @@ size_t foo_decoder_context_t::decode(void *buf, size_t len, IOStream *stream)
 	if (len < 8) return pos; 
 	unsigned char *ptr = (unsigned char *)buf;
 	bool unknownOpcode = false;  
+	const bool profiling = DecoderProfiler::isEnabled();
 #ifdef CHECK_GL_ERROR 
 	char lastCall[256] = {0}; 
 #endif 
@@ -42,12 +60,16 @@ size_t foo_decoder_context_t::decode(void *buf, size_t len, IOStream *stream)
 		uint32_t opcode = *(uint32_t *)ptr;   
 		size_t packetLen = *(uint32_t *)(ptr + 4);
 		if (len - pos < packetLen)  return pos; 
+		uint64_t profileStart = profiling ? DecoderProfiler::now() : 0;
+		uint64_t profileDispatch = 0;
 		switch(opcode) {
 		case OP_fooAlphaFunc: {
 			FooInt var_func = Unpack<FooInt,uint32_t>(ptr + 8);
 			FooFloat var_ref = Unpack<FooFloat,uint32_t>(ptr + 8 + 4);
 			DEBUG("foo(%p): fooAlphaFunc(%d %f )\n", stream,var_func, var_ref);
+			if (profiling) profileDispatch = DecoderProfiler::now();
 			this->fooAlphaFunc(var_func, var_ref);
+			if (profiling) profileDispatch = DecoderProfiler::now() - profileDispatch;
 			SET_LASTCALL("fooAlphaFunc");
 			break;
 		}
@@ -57,7 +79,9 @@ size_t foo_decoder_context_t::decode(void *buf, size_t len, IOStream *stream)
 			size_t totalTmpSize = sizeof(FooBoolean);
 			unsigned char *tmpBuf = stream->alloc(totalTmpSize);
 			DEBUG("foo(%p): fooIsBuffer(%p(%u) )\n", stream,(void*)(inptr_stuff.get()), size_stuff);
+			if (profiling) profileDispatch = DecoderProfiler::now();
 			*(FooBoolean *)(&tmpBuf[0]) = 			this->fooIsBuffer((void*)(inptr_stuff.get()));
+			if (profiling) profileDispatch = DecoderProfiler::now() - profileDispatch;
 			stream->flush();
 			SET_LASTCALL("fooIsBuffer");
 			break;
@@ -66,14 +90,18 @@ size_t foo_decoder_context_t::decode(void *buf, size_t len, IOStream *stream)
 			uint32_t size_params __attribute__((unused)) = Unpack<uint32_t,uint32_t>(ptr + 8);
 			InputBuffer inptr_params(ptr + 8 + 4, size_params);
 			DEBUG("foo(%p): fooUnsupported(%p(%u) )\n", stream,(void*)(inptr_params.get()), size_params);
+			if (profiling) profileDispatch = DecoderProfiler::now();
 			this->fooUnsupported((void*)(inptr_params.get()));
+			if (profiling) profileDispatch = DecoderProfiler::now() - profileDispatch;
 			SET_LASTCALL("fooUnsupported");
 			break;
 		}
 		case OP_fooDoEncoderFlush: {
 			FooInt var_param = Unpack<FooInt,uint32_t>(ptr + 8);
 			DEBUG("foo(%p): fooDoEncoderFlush(%d )\n", stream,var_param);
+			if (profiling) profileDispatch = DecoderProfiler::now();
 			this->fooDoEncoderFlush(var_param);
+			if (profiling) profileDispatch = DecoderProfiler::now() - profileDispatch;
 			SET_LASTCALL("fooDoEncoderFlush");
 			break;
 		}
@@ -81,7 +109,9 @@ size_t foo_decoder_context_t::decode(void *buf, size_t len, IOStream *stream)
 			uint32_t size_param __attribute__((unused)) = Unpack<uint32_t,uint32_t>(ptr + 8);
 			InputBuffer inptr_param(ptr + 8 + 4, size_param);
 			DEBUG("foo(%p): fooTakeConstVoidPtrConstPtr(%p(%u) )\n", stream,(const void* const*)(inptr_param.get()), size_param);
+			if (profiling) profileDispatch = DecoderProfiler::now();
 			this->fooTakeConstVoidPtrConstPtr((const void* const*)(inptr_param.get()));
+			if (profiling) profileDispatch = DecoderProfiler::now() - profileDispatch;
 			SET_LASTCALL("fooTakeConstVoidPtrConstPtr");
 			break;
 		}
@@ -89,6 +119,9 @@ size_t foo_decoder_context_t::decode(void *buf, size_t len, IOStream *stream)
 				unknownOpcode = true;
 		} //switch
 		if (!unknownOpcode) {
+			if (profiling) {
+				s_profiler.record(opcode, packetLen, DecoderProfiler::now() - profileStart, profileDispatch);
+			}
 			pos += packetLen;
 			ptr += packetLen;
 		}
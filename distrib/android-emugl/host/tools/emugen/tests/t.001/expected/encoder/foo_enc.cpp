@@ -40,6 +40,22 @@ FooBoolean fooIsBuffer_enc(void *self , void* stuff)
 	IOStream *stream = ctx->m_stream;
 
 	const unsigned int __size_stuff =  (4 * sizeof(float));
+
+	const bool __cacheable = (true);
+	const size_t __cacheSize = 1;
+	uint64_t __cacheKey = 0;
+	if (__cacheable) {
+		__cacheKey = EncoderResultCache::hashInit(OP_fooIsBuffer);
+		__cacheKey = EncoderResultCache::hash(__cacheKey, &__size_stuff, 4);
+		__cacheKey = EncoderResultCache::hash(__cacheKey, stuff, __size_stuff);
+		const unsigned char *__cached = ctx->m_resultCache.find(__cacheKey, __cacheSize);
+		if (__cached != NULL) {
+			FooBoolean retval;
+			memcpy(&retval, __cached, 1);
+			return retval;
+		}
+	}
+
 	 unsigned char *ptr;
 	 const size_t packetSize = 8 + __size_stuff + 1*4;
 	ptr = stream->alloc(packetSize);
@@ -51,6 +67,12 @@ FooBoolean fooIsBuffer_enc(void *self , void* stuff)
 
 	FooBoolean retval;
 	stream->readback(&retval, 1);
+	if (__cacheable && (retval != 0)) {
+		unsigned char *__cache = ctx->m_resultCache.insert(__cacheKey, __cacheSize);
+		if (__cache != NULL) {
+			memcpy(__cache, &retval, 1);
+		}
+	}
 	return retval;
 }
 
@@ -10,10 +10,12 @@
 
 #include "fooUtils.h"
 #include "fooBase.h"
+#include "EncoderResultCache.h"
 
 struct foo_encoder_context_t : public foo_client_context_t {
 
 	IOStream *m_stream;
+	EncoderResultCache m_resultCache;
 
 	foo_encoder_context_t(IOStream *stream);
 };
@@ -4,6 +4,7 @@
 LOCAL_PATH := $(call my-dir)
 
 commonSources := \
+        DecoderProfiler.cpp \
         GLClientState.cpp \
         GLSharedGroup.cpp \
         glUtils.cpp \
@@ -0,0 +1,164 @@
+/*
+* Copyright (C) 2015 The Android Open Source Project
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+* http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*/
+#include "DecoderProfiler.h"
+
+#include "TimeUtils.h"
+
+#include "emugl/common/atomic.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <algorithm>
+#include <vector>
+
+namespace emugl {
+
+namespace {
+
+struct ReportLine {
+    const char* api;
+    const char* name;
+    uint64_t calls;
+    uint64_t bytes;
+    uint64_t decodeNs;
+    uint64_t dispatchNs;
+
+    bool operator<(const ReportLine& other) const {
+        return decodeNs + dispatchNs > other.decodeNs + other.dispatchNs;
+    }
+};
+
+}  // namespace
+
+DecoderProfiler* DecoderProfiler::sFirst = NULL;
+
+volatile bool DecoderProfiler::sEnabled =
+        getenv("ANDROID_EMUGL_DECODER_PROFILE") != NULL;
+
+DecoderProfiler::DecoderProfiler(const char* api,
+                                 uint32_t firstOpcode,
+                                 const char* const* names,
+                                 size_t count) :
+        mApi(api),
+        mFirstOpcode(firstOpcode),
+        mNames(names),
+        mCount(count),
+        mCounters(new Counters[count]()),
+        mNext(sFirst) {
+    sFirst = this;
+}
+
+// static
+void DecoderProfiler::setEnabled(bool enabled) {
+    sEnabled = enabled;
+}
+
+// static
+uint64_t DecoderProfiler::now() {
+    return static_cast<uint64_t>(GetCurrentTimeNS());
+}
+
+void DecoderProfiler::record(uint32_t opcode,
+                             size_t bytes,
+                             uint64_t totalNs,
+                             uint64_t dispatchNs) {
+    uint32_t index = opcode - mFirstOpcode;
+    if (index >= mCount) {
+        return;
+    }
+    Counters* counters = &mCounters[index];
+    atomicAdd64(&counters->calls, 1);
+    atomicAdd64(&counters->bytes, bytes);
+    atomicAdd64(&counters->decodeNs,
+              totalNs > dispatchNs ? totalNs - dispatchNs : 0);
+    atomicAdd64(&counters->dispatchNs, dispatchNs);
+}
+
+// static
+void DecoderProfiler::resetAll() {
+    for (DecoderProfiler* p = sFirst; p; p = p->mNext) {
+        for (size_t n = 0; n < p->mCount; ++n) {
+            Counters* counters = &p->mCounters[n];
+            counters->calls = 0;
+            counters->bytes = 0;
+            counters->decodeNs = 0;
+            counters->dispatchNs = 0;
+        }
+    }
+}
+
+// static
+std::string DecoderProfiler::report() {
+    std::vector<ReportLine> lines;
+    uint64_t totalCalls = 0;
+    uint64_t totalBytes = 0;
+    uint64_t totalNs = 0;
+    for (DecoderProfiler* p = sFirst; p; p = p->mNext) {
+        for (size_t n = 0; n < p->mCount; ++n) {
+            const Counters& counters = p->mCounters[n];
+            if (!counters.calls) {
+                continue;
+            }
+            ReportLine line = {
+                p->mApi, p->mNames[n], counters.calls, counters.bytes,
+                counters.decodeNs, counters.dispatchNs,
+            };
+            lines.push_back(line);
+            totalCalls += line.calls;
+            totalBytes += line.bytes;
+            totalNs += line.decodeNs + line.dispatchNs;
+        }
+    }
+    std::sort(lines.begin(), lines.end());
+
+    std::string result;
+    char buf[256];
+    snprintf(buf, sizeof(buf), "%-14s %-36s %10s %12s %11s %11s %6s\n",
+             "api", "call", "calls", "bytes", "decode_ms", "dispatch_ms",
+             "time%");
+    result += buf;
+    for (size_t n = 0; n < lines.size(); ++n) {
+        const ReportLine& line = lines[n];
+        double percent = totalNs ?
+                100.0 * (line.decodeNs + line.dispatchNs) / totalNs : 0.;
+        snprintf(buf, sizeof(buf),
+                 "%-14s %-36s %10llu %12llu %11.3f %11.3f %6.2f\n",
+                 line.api, line.name,
+                 (unsigned long long)line.calls,
+                 (unsigned long long)line.bytes,
+                 line.decodeNs / 1e6, line.dispatchNs / 1e6, percent);
+        result += buf;
+    }
+    snprintf(buf, sizeof(buf), "%-14s %-36s %10llu %12llu %23.3f\n",
+             "total", "", (unsigned long long)totalCalls,
+             (unsigned long long)totalBytes, totalNs / 1e6);
+    result += buf;
+    return result;
+}
+
+// static
+bool DecoderProfiler::dumpToFile(const char* path) {
+    FILE* file = fopen(path, "w");
+    if (!file) {
+        return false;
+    }
+    std::string text = report();
+    bool ok = fwrite(text.c_str(), 1, text.size(), file) == text.size();
+    return (fclose(file) == 0) && ok;
+}
+
+}  // namespace emugl
@@ -0,0 +1,105 @@
+/*
+* Copyright (C) 2015 The Android Open Source Project
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+* http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*/
+#ifndef EMUGL_DECODER_PROFILER_H
+#define EMUGL_DECODER_PROFILER_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <string>
+
+namespace emugl {
+
+// Per-opcode statistics for the wire protocol decoders generated by emugen.
+//
+// Each generated decoder defines one static DecoderProfiler instance, and
+// its decode() method calls record() after each packet when profiling is
+// enabled. When it isn't, the only cost is one test of isEnabled() per
+// packet. For each call, the profiler counts:
+//
+//   - the number of packets decoded.
+//   - their total size in bytes, i.e. the wire bandwidth.
+//   - the time spent in the call's implementation, called dispatch time.
+//   - the time spent unpacking the parameters and sending the results
+//     back, called decode time.
+//
+// Counters are updated atomically, since several render threads can use
+// the same decoder concurrently.
+//
+// Profiling is disabled by default. It can be enabled with setEnabled(),
+// or by defining ANDROID_EMUGL_DECODER_PROFILE in the environment.
+class DecoderProfiler {
+public:
+    // Create a new profiler for the decoder of the |api| protocol, whose
+    // opcodes start at |firstOpcode|. |names| is an array of |count| call
+    // names, indexed by opcode - |firstOpcode|. The strings are not copied.
+    //
+    // NOTE: Instances must be static, and are only created during static
+    // initialization, which is why the list of instances needs no lock.
+    DecoderProfiler(const char* api,
+                    uint32_t firstOpcode,
+                    const char* const* names,
+                    size_t count);
+
+    // Return true iff profiling is enabled.
+    static bool isEnabled() { return sEnabled; }
+
+    // Enable or disable profiling. Counters are kept when disabling.
+    static void setEnabled(bool enabled);
+
+    // Return the current time in nanoseconds, to measure calls.
+    static uint64_t now();
+
+    // Record one decoded packet. |opcode| and |bytes| are its opcode and
+    // size. |totalNs| is the whole time spent on it, and |dispatchNs| the
+    // part of it spent in the call's implementation.
+    void record(uint32_t opcode,
+                size_t bytes,
+                uint64_t totalNs,
+                uint64_t dispatchNs);
+
+    // Reset the counters of all decoders.
+    static void resetAll();
+
+    // Return a text report of the counters of all decoders, one line per
+    // call that was decoded at least once, sorted by decreasing total time.
+    static std::string report();
+
+    // Write report() to the file at |path|. Returns true on success.
+    static bool dumpToFile(const char* path);
+
+private:
+    struct Counters {
+        uint64_t calls;
+        uint64_t bytes;
+        uint64_t decodeNs;
+        uint64_t dispatchNs;
+    };
+
+    const char* mApi;
+    uint32_t mFirstOpcode;
+    const char* const* mNames;
+    size_t mCount;
+    Counters* mCounters;
+    DecoderProfiler* mNext;
+
+    static DecoderProfiler* sFirst;
+    static volatile bool sEnabled;
+};
+
+}  // namespace emugl
+
+#endif  // EMUGL_DECODER_PROFILER_H
@@ -0,0 +1,108 @@
+/*
+* Copyright (C) 2015 The Android Open Source Project
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+* http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*/
+#ifndef EMUGL_ENCODER_RESULT_CACHE_H
+#define EMUGL_ENCODER_RESULT_CACHE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+// A small cache of call results, used by the encoders that emugen generates
+// for entry points marked with the 'cacheable' attribute.
+//
+// Each call that returns a value or has output parameters normally costs a
+// round-trip to the host: the encoder flushes its command buffer, then
+// blocks until the reply arrives. For calls whose results never change,
+// like implementation limits, the encoder can instead keep the reply of
+// the first call and answer the following ones locally.
+//
+// Entries are keyed by a 64-bit hash of the opcode and of all the input
+// parameters, computed with hashInit() and hash(). The value is the raw
+// reply, i.e. the output parameters followed by the return value. The table
+// is direct-mapped: an insertion replaces any entry with the same index.
+//
+// Instances are not thread-safe, like the encoder contexts that own them.
+class EncoderResultCache {
+public:
+    EncoderResultCache() {
+        memset(m_entries, 0, sizeof(m_entries));
+    }
+
+    ~EncoderResultCache() {
+        for (size_t n = 0; n < kNumEntries; n++) {
+            free(m_entries[n].data);
+        }
+    }
+
+    // Start the hash of a call's inputs with its |opcode|.
+    static uint64_t hashInit(uint32_t opcode) {
+        return hash(kFnvOffsetBasis, &opcode, sizeof(opcode));
+    }
+
+    // Update |h| with |size| bytes at |data|, which can be NULL if |size|
+    // is 0. Uses 64-bit FNV-1a.
+    static uint64_t hash(uint64_t h, const void* data, size_t size) {
+        const unsigned char* p = static_cast<const unsigned char*>(data);
+        for (size_t n = 0; n < size; n++) {
+            h = (h ^ p[n]) * kFnvPrime;
+        }
+        return h;
+    }
+
+    // Return the cached reply for |key|, or NULL if there is none, or if
+    // its size is not |size|.
+    const unsigned char* find(uint64_t key, size_t size) const {
+        const Entry& entry = m_entries[key % kNumEntries];
+        if (!entry.data || entry.key != key || entry.size != size) {
+            return NULL;
+        }
+        return entry.data;
+    }
+
+    // Make room for a reply of |size| bytes for |key|, and return the
+    // address where to copy it, or NULL on failure.
+    unsigned char* insert(uint64_t key, size_t size) {
+        Entry& entry = m_entries[key % kNumEntries];
+        if (!entry.data || entry.size != size) {
+            free(entry.data);
+            // Always allocate at least one byte, for empty replies.
+            entry.data = static_cast<unsigned char*>(malloc(size ? size : 1));
+            if (!entry.data) {
+                entry.size = 0;
+                return NULL;
+            }
+        }
+        entry.key = key;
+        entry.size = size;
+        return entry.data;
+    }
+
+private:
+    static const size_t kNumEntries = 64;
+    static const uint64_t kFnvOffsetBasis = 14695981039346656037ULL;
+    static const uint64_t kFnvPrime = 1099511628211ULL;
+
+    struct Entry {
+        uint64_t key;
+        size_t size;
+        unsigned char* data;
+    };
+
+    Entry m_entries[kNumEntries];
+};
+
+#endif  // EMUGL_ENCODER_RESULT_CACHE_H
@@ -17,6 +17,9 @@
 #define _TIME_UTILS_H
 
 long long GetCurrentTimeMS();
+
+// Same as above, in nanoseconds, from a monotonic clock when available.
+long long GetCurrentTimeNS();
 void TimeSleepMS(int p_mili);
 
 #endif
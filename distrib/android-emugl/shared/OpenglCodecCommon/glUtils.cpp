@@ -365,6 +365,76 @@ void glUtilsWritePackPointerData(void* _stream, unsigned char *src,
     }
 }
 
+// Implementation limits common to GLES 1.x and 2.0, which don't depend on
+// any context state.
+// NOTE: Framebuffer properties like GL_RED_BITS are not included, since
+// they depend on the currently bound framebuffer.
+static int isCommonImmutableParam(GLenum param)
+{
+    switch(param) {
+    case GL_MAX_TEXTURE_SIZE:
+    case GL_MAX_VIEWPORT_DIMS:
+    case GL_SUBPIXEL_BITS:
+    case GL_ALIASED_POINT_SIZE_RANGE:
+    case GL_ALIASED_LINE_WIDTH_RANGE:
+        return 1;
+    default:
+        return 0;
+    }
+}
+
+int glUtilsIsImmutableParamGLES1(GLenum param)
+{
+    switch(param) {
+    case GL_MAX_LIGHTS:
+    case GL_MAX_CLIP_PLANES:
+    case GL_MAX_MODELVIEW_STACK_DEPTH:
+    case GL_MAX_PROJECTION_STACK_DEPTH:
+    case GL_MAX_TEXTURE_STACK_DEPTH:
+    case GL_MAX_TEXTURE_UNITS:
+        return 1;
+    default:
+        return isCommonImmutableParam(param);
+    }
+}
+
+int glUtilsIsImmutableParamGLES2(GLenum param)
+{
+    switch(param) {
+    case GL_MAX_CUBE_MAP_TEXTURE_SIZE:
+    case GL_MAX_RENDERBUFFER_SIZE:
+    case GL_MAX_VERTEX_ATTRIBS:
+    case GL_MAX_VERTEX_UNIFORM_VECTORS:
+    case GL_MAX_FRAGMENT_UNIFORM_VECTORS:
+    case GL_MAX_VARYING_VECTORS:
+    case GL_MAX_TEXTURE_IMAGE_UNITS:
+    case GL_MAX_VERTEX_TEXTURE_IMAGE_UNITS:
+    case GL_MAX_COMBINED_TEXTURE_IMAGE_UNITS:
+    case GL_NUM_SHADER_BINARY_FORMATS:
+        return 1;
+    default:
+        return isCommonImmutableParam(param);
+    }
+}
+
+int glUtilsIsShaderPrecisionQuery(GLenum shadertype, GLenum precisiontype)
+{
+    if (shadertype != GL_VERTEX_SHADER && shadertype != GL_FRAGMENT_SHADER) {
+        return 0;
+    }
+    switch(precisiontype) {
+    case GL_LOW_FLOAT:
+    case GL_MEDIUM_FLOAT:
+    case GL_HIGH_FLOAT:
+    case GL_LOW_INT:
+    case GL_MEDIUM_INT:
+    case GL_HIGH_INT:
+        return 1;
+    default:
+        return 0;
+    }
+}
+
 int glUtilsPixelBitSize(GLenum format, GLenum type)
 {
     int components = 0;
@@ -54,6 +54,15 @@ extern "C" {
     void glUtilsWritePackPointerData(void* stream, unsigned char *src,
                                     int size, GLenum type, unsigned int stride,
                                     unsigned int datalen);
+    // Return 1 iff |param| is a glGetIntegerv() parameter of the GLES 1.x,
+    // resp. GLES 2.0, API whose value never changes, i.e. an implementation
+    // limit, 0 otherwise. Parameters of the other API are rejected, since
+    // querying them fails with GL_INVALID_ENUM.
+    int glUtilsIsImmutableParamGLES1(GLenum param);
+    int glUtilsIsImmutableParamGLES2(GLenum param);
+    // Returns 1 iff glGetShaderPrecisionFormat() accepts |shadertype| and
+    // |precisiontype|, 0 otherwise.
+    int glUtilsIsShaderPrecisionQuery(GLenum shadertype, GLenum precisiontype);
     int glUtilsPixelBitSize(GLenum format, GLenum type);
     void   glUtilsPackStrings(char *ptr, char **strings, GLint *length, GLsizei count);
     int glUtilsCalcShaderSourceLen(char **strings, GLint *length, GLsizei count);
@@ -10,6 +10,7 @@ commonSources := \
         lazy_instance.cpp \
         message_channel.cpp \
         pod_vector.cpp \
+        ring_buffer.cpp \
         shared_library.cpp \
         smart_ptr.cpp \
         sockets.cpp \
@@ -53,6 +54,7 @@ host_commonSources := \
     pod_vector_unittest.cpp \
     message_channel_unittest.cpp \
     mutex_unittest.cpp \
+    ring_buffer_unittest.cpp \
     shared_library_unittest.cpp \
     smart_ptr_unittest.cpp \
     thread_store_unittest.cpp \
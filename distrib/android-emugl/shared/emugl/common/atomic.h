@@ -0,0 +1,129 @@
+// Copyright (C) 2015 The Android Open Source Project
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef EMUGL_COMMON_ATOMIC_H
+#define EMUGL_COMMON_ATOMIC_H
+
+#ifdef _WIN32
+#  define WIN32_LEAN_AND_MEAN 1
+#  include <windows.h>
+#endif
+
+#include <stdint.h>
+
+// Memory barriers and atomic operations for the few lock-free data
+// structures of emugl. Values shared this way must be naturally aligned
+// and declared volatile, so that the compiler neither caches nor splits
+// their loads and stores.
+
+namespace emugl {
+
+// Prevents the compiler from moving memory accesses across the call.
+inline void compilerBarrier() {
+#if defined(__GNUC__)
+    __asm__ __volatile__ ("" : : : "memory");
+#else
+    ::MemoryBarrier();
+#endif
+}
+
+// Prevents both the compiler and the CPU from moving memory accesses
+// across the call.
+inline void fullMemoryBarrier() {
+#ifdef _WIN32
+    ::MemoryBarrier();
+#else
+    __sync_synchronize();
+#endif
+}
+
+// x86 never reorders loads with older loads, or stores with older stores,
+// so acquire / release semantics only require a compiler barrier there.
+// Other CPUs use a full barrier, which is slower but always correct.
+
+// Keeps the loads that follow the call after the ones that precede it.
+inline void acquireBarrier() {
+#if defined(__i386__) || defined(__x86_64__)
+    compilerBarrier();
+#else
+    fullMemoryBarrier();
+#endif
+}
+
+// Keeps the stores that precede the call before the ones that follow it.
+inline void releaseBarrier() {
+#if defined(__i386__) || defined(__x86_64__)
+    compilerBarrier();
+#else
+    fullMemoryBarrier();
+#endif
+}
+
+// Loads |*ptr|, such that the loads that follow see at least the data
+// stored before the matching storeRelease().
+template <typename T>
+inline T loadAcquire(const volatile T* ptr) {
+    T ret = *ptr;
+    acquireBarrier();
+    return ret;
+}
+
+// Stores |value| into |*ptr|, after all the stores that precede the call.
+template <typename T, typename U>
+inline void storeRelease(volatile T* ptr, U value) {
+    releaseBarrier();
+    *ptr = value;
+}
+
+// All of the following are full memory barriers.
+
+// Sets |*ptr| to |*ptr| | |value|, and returns its previous value.
+inline int atomicFetchAndOr(volatile int* ptr, int value) {
+#ifdef _WIN32
+    return InterlockedOr((volatile LONG*)ptr, value);
+#else
+    return __sync_fetch_and_or(ptr, value);
+#endif
+}
+
+// Sets |*ptr| to |*ptr| & |value|, and returns its previous value.
+inline int atomicFetchAndAnd(volatile int* ptr, int value) {
+#ifdef _WIN32
+    return InterlockedAnd((volatile LONG*)ptr, value);
+#else
+    return __sync_fetch_and_and(ptr, value);
+#endif
+}
+
+// Adds |value| to |*ptr|, and returns the new value.
+inline int atomicAddAndFetch(volatile int* ptr, int value) {
+#ifdef _WIN32
+    return InterlockedExchangeAdd((volatile LONG*)ptr, value) + value;
+#else
+    return __sync_add_and_fetch(ptr, value);
+#endif
+}
+
+// Adds |value| to |*ptr|.
+inline void atomicAdd64(volatile uint64_t* ptr, uint64_t value) {
+#ifdef _WIN32
+    InterlockedExchangeAdd64((volatile LONGLONG*)ptr, (LONGLONG)value);
+#else
+    __sync_fetch_and_add(ptr, value);
+#endif
+}
+
+}  // namespace emugl
+
+#endif  // EMUGL_COMMON_ATOMIC_H
@@ -14,6 +14,8 @@
 
 #include "emugl/common/lazy_instance.h"
 
+#include "emugl/common/atomic.h"
+
 #ifdef _WIN32
 #  define WIN32_LEAN_AND_MEAN 1
 #  include <windows.h>
@@ -26,32 +28,6 @@ namespace internal {
 
 typedef LazyInstanceState::AtomicType AtomicType;
 
-#if defined(__GNUC__)
-static inline void compilerBarrier() {
-    __asm__ __volatile__ ("" : : : "memory");
-}
-#else
-#error "Your compiler is not supported"
-#endif
-
-#if defined(__i386__) || defined(__x86_64__)
-#  define acquireBarrier() compilerBarrier()
-#  define releaseBarrier() compilerBarrier()
-#else
-#  error "Your CPU is not supported"
-#endif
-
-static inline AtomicType loadAcquire(AtomicType volatile* ptr) {
-    AtomicType ret = *ptr;
-    acquireBarrier();
-    return ret;
-}
-
-static inline void storeRelease(AtomicType volatile* ptr, AtomicType value) {
-    releaseBarrier();
-    *ptr = value;
-}
-
 static int atomicCompareAndSwap(AtomicType volatile* ptr,
                                 int expected,
                                 int value) {
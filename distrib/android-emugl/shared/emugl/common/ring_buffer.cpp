@@ -0,0 +1,88 @@
+// Copyright (C) 2015 The Android Open Source Project
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "emugl/common/ring_buffer.h"
+
+#include "emugl/common/atomic.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+namespace emugl {
+
+RingBuffer::RingBuffer(size_t capacity) :
+        mBuffer(NULL), mCapacity(1U), mReadPos(0U), mWritePos(0U) {
+    while (mCapacity < capacity) {
+        mCapacity <<= 1;
+    }
+    mBuffer = static_cast<unsigned char*>(::malloc(mCapacity));
+}
+
+RingBuffer::~RingBuffer() {
+    ::free(mBuffer);
+}
+
+size_t RingBuffer::write(const void* data, size_t len) {
+    size_t writePos = mWritePos;
+    size_t avail = mCapacity - (writePos - loadAcquire(&mReadPos));
+    if (len > avail) {
+        len = avail;
+    }
+    if (!len) {
+        return 0U;
+    }
+    size_t offset = writePos & (mCapacity - 1U);
+    size_t first = mCapacity - offset;
+    if (first > len) {
+        first = len;
+    }
+    const unsigned char* src = static_cast<const unsigned char*>(data);
+    ::memcpy(mBuffer + offset, src, first);
+    ::memcpy(mBuffer, src + first, len - first);
+    storeRelease(&mWritePos, writePos + len);
+    return len;
+}
+
+size_t RingBuffer::read(void* data, size_t len) {
+    size_t readPos = mReadPos;
+    size_t avail = loadAcquire(&mWritePos) - readPos;
+    if (len > avail) {
+        len = avail;
+    }
+    if (!len) {
+        return 0U;
+    }
+    size_t offset = readPos & (mCapacity - 1U);
+    size_t first = mCapacity - offset;
+    if (first > len) {
+        first = len;
+    }
+    unsigned char* dst = static_cast<unsigned char*>(data);
+    ::memcpy(dst, mBuffer + offset, first);
+    ::memcpy(dst + first, mBuffer, len - first);
+    storeRelease(&mReadPos, readPos + len);
+    return len;
+}
+
+size_t RingBuffer::available() const {
+    size_t readPos = loadAcquire(&mReadPos);
+    return loadAcquire(&mWritePos) - readPos;
+}
+
+size_t RingBuffer::space() const {
+    size_t writePos = loadAcquire(&mWritePos);
+    return mCapacity - (writePos - loadAcquire(&mReadPos));
+}
+
+}  // namespace emugl
@@ -0,0 +1,73 @@
+// Copyright (C) 2015 The Android Open Source Project
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef EMUGL_COMMON_RING_BUFFER_H
+#define EMUGL_COMMON_RING_BUFFER_H
+
+#include <stddef.h>
+
+namespace emugl {
+
+// A fixed-capacity byte ring buffer used to pass a byte stream from exactly
+// one producer thread to exactly one consumer thread without any lock.
+//
+// Neither read() nor write() ever blocks. Callers that need to wait for
+// data or space must implement it on top of available() and space(), with
+// waiter flags and emugl::fullMemoryBarrier(). E.g. a consumer sets a
+// 'waiting' flag, then checks available() before sleeping, while the producer
+// calls write() then checks the flag; a barrier on both sides ensures at
+// least one of them sees the other's update.
+class RingBuffer {
+public:
+    // Constructor. |capacity| is rounded up to a power of 2.
+    explicit RingBuffer(size_t capacity);
+
+    // Destructor.
+    ~RingBuffer();
+
+    size_t capacity() const { return mCapacity; }
+
+    // Producer thread only: copy up to |len| bytes from |data| into the
+    // buffer. Returns the number of bytes copied, which is 0 if it is full.
+    size_t write(const void* data, size_t len);
+
+    // Consumer thread only: copy up to |len| bytes from the buffer into
+    // |data|. Returns the number of bytes copied, which is 0 if it is empty.
+    size_t read(void* data, size_t len);
+
+    // Number of bytes that can be read. Exact from the consumer thread.
+    // From the producer thread, an upper bound, since the consumer may be
+    // reading concurrently.
+    size_t available() const;
+
+    // Number of bytes that can be written. Exact from the producer thread.
+    // From the consumer thread, an upper bound, since the producer may be
+    // writing concurrently.
+    size_t space() const;
+
+private:
+    RingBuffer(const RingBuffer& other);
+    RingBuffer& operator=(const RingBuffer& other);
+
+    unsigned char* mBuffer;
+    size_t mCapacity;
+    // Free-running positions, only ever incremented, by the consumer and
+    // the producer respectively. Their difference is the amount of data.
+    volatile size_t mReadPos;
+    volatile size_t mWritePos;
+};
+
+}  // namespace emugl
+
+#endif  // EMUGL_COMMON_RING_BUFFER_H
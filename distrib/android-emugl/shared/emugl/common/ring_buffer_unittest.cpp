@@ -0,0 +1,135 @@
+// Copyright (C) 2015 The Android Open Source Project
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "emugl/common/ring_buffer.h"
+
+#include "emugl/common/thread.h"
+
+#include <gtest/gtest.h>
+
+#include <stdint.h>
+#include <string.h>
+
+namespace emugl {
+
+TEST(RingBuffer, CapacityIsPowerOfTwo) {
+    RingBuffer a(1000);
+    EXPECT_EQ(1024U, a.capacity());
+    RingBuffer b(4096);
+    EXPECT_EQ(4096U, b.capacity());
+}
+
+TEST(RingBuffer, WriteAndReadBack) {
+    RingBuffer ring(16);
+    EXPECT_EQ(0U, ring.available());
+    EXPECT_EQ(16U, ring.space());
+
+    char buf[32];
+    EXPECT_EQ(0U, ring.read(buf, sizeof(buf)));
+
+    EXPECT_EQ(5U, ring.write("hello", 5));
+    EXPECT_EQ(5U, ring.available());
+    EXPECT_EQ(11U, ring.space());
+
+    EXPECT_EQ(5U, ring.read(buf, sizeof(buf)));
+    EXPECT_EQ(0, memcmp(buf, "hello", 5));
+    EXPECT_EQ(0U, ring.available());
+}
+
+TEST(RingBuffer, PartialWriteWhenFull) {
+    RingBuffer ring(8);
+    EXPECT_EQ(8U, ring.write("0123456789", 10));
+    EXPECT_EQ(0U, ring.space());
+    EXPECT_EQ(0U, ring.write("x", 1));
+
+    char buf[4];
+    EXPECT_EQ(4U, ring.read(buf, sizeof(buf)));
+    EXPECT_EQ(0, memcmp(buf, "0123", 4));
+    EXPECT_EQ(4U, ring.space());
+}
+
+TEST(RingBuffer, WrapAround) {
+    RingBuffer ring(8);
+    char buf[8];
+    // Shift the positions so that each write straddles the end of the
+    // storage.
+    for (int n = 0; n < 100; ++n) {
+        EXPECT_EQ(3U, ring.write("abc", 3));
+        EXPECT_EQ(3U, ring.write("def", 3));
+        EXPECT_EQ(6U, ring.read(buf, sizeof(buf)));
+        EXPECT_EQ(0, memcmp(buf, "abcdef", 6)) << "iteration " << n;
+    }
+}
+
+namespace {
+
+const size_t kStreamSize = 256 * 1024;
+
+// Writes a predictable byte stream into a ring buffer, in chunks of
+// varying sizes.
+class ProducerThread : public Thread {
+public:
+    explicit ProducerThread(RingBuffer* ring) : mRing(ring) {}
+
+    virtual intptr_t main() {
+        uint8_t chunk[333];
+        size_t pos = 0;
+        size_t chunkSize = 1;
+        while (pos < kStreamSize) {
+            size_t size = chunkSize;
+            if (size > kStreamSize - pos) {
+                size = kStreamSize - pos;
+            }
+            for (size_t n = 0; n < size; ++n) {
+                chunk[n] = (uint8_t)((pos + n) * 7);
+            }
+            size_t done = 0;
+            while (done < size) {
+                done += mRing->write(chunk + done, size - done);
+            }
+            pos += size;
+            chunkSize = (chunkSize % sizeof(chunk)) + 1;
+        }
+        return 0;
+    }
+
+private:
+    RingBuffer* mRing;
+};
+
+}  // namespace
+
+TEST(RingBuffer, ProducerConsumerThreads) {
+    RingBuffer ring(1024);
+    ProducerThread producer(&ring);
+    EXPECT_TRUE(producer.start());
+
+    uint8_t buf[500];
+    size_t pos = 0;
+    bool ok = true;
+    while (pos < kStreamSize && ok) {
+        size_t size = ring.read(buf, sizeof(buf));
+        for (size_t n = 0; n < size; ++n) {
+            if (buf[n] != (uint8_t)((pos + n) * 7)) {
+                ok = false;
+                break;
+            }
+        }
+        pos += size;
+    }
+    EXPECT_TRUE(ok) << "corrupted stream at offset " << pos;
+    EXPECT_TRUE(producer.wait(NULL));
+}
+
+}  // namespace emugl
@@ -60,6 +60,8 @@ bool Thread::start() {
     if (pthread_create(&mThread, NULL, thread_main, this)) {
         ret = false;
         mIsRunning = false;
+        // There is no thread to join.
+        mJoined = true;
     }
     pthread_mutex_unlock(&mLock);
     return ret;
@@ -584,8 +584,10 @@ void cpu_tlb_update_dirty(CPUArchState *env)
     int i;
     int mmu_idx;
     for (mmu_idx = 0; mmu_idx < NB_MMU_MODES; mmu_idx++) {
-        for(i = 0; i < CPU_TLB_SIZE; i++)
+        for(i = 0; i <= (env->tlb_mask >> CPU_TLB_ENTRY_BITS); i++)
             tlb_update_dirty(&env->tlb_table[mmu_idx][i]);
+        for(i = 0; i < CPU_VTLB_SIZE; i++)
+            tlb_update_dirty(&env->tlb_v_table[mmu_idx][i]);
     }
 }
 
@@ -1280,6 +1282,8 @@ void qemu_ram_remap(ram_addr_t addr, ram_addr_t length)
 void *qemu_get_ram_ptr(ram_addr_t addr)
 {
     RAMBlock *block = qemu_get_ram_block(addr);
+
+    ram_lazy_fetch(addr, 1);
 #if 0
     if (xen_enabled()) {
         /* We need to check if the requested address is in the RAM
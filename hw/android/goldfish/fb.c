@@ -488,6 +488,9 @@ static void goldfish_fb_update_display(void *opaque)
     fbs.src_pixels = src_line;
     fbs.src_pitch  = width*s->ds->surface->pf.bytes_per_pixel;
 
+    /* The framebuffer may not have been restored from a snapshot yet. */
+    ram_lazy_fetch(base, (ram_addr_t)height * fbs.src_pitch);
+
 
 #if STATS
     if (full_update)
@@ -41,6 +41,15 @@
 #  define  llseek  lseek64
 #endif
 
+#ifdef __linux__
+#  include <sys/ioctl.h>
+#  ifndef FICLONE
+#    define FICLONE  _IOW(0x94, 9, int)
+#  endif
+#endif
+
+#include <zlib.h>
+
 #define  XLOG  xlog
 
 static void
@@ -66,6 +75,25 @@ typedef struct {
     uint32_t   erase_size;   /* size of the data buffer mentioned above */
     uint64_t   max_size;     /* Capacity limit for the image. The actual underlying
                               * file may be smaller. */
+    /* Incremental snapshot support. The 'base' of a device is an image file
+     * that is known not to change during the session (the 'initfile' the
+     * device was initialized from, the image itself for read-only devices,
+     * or a copy of a read-write image, see nand_dev_create_base()). Only
+     * the erase blocks that differ from it are saved. */
+    uint32_t   block_count;  /* number of erase blocks in the device */
+    uint32_t*  dirty_bits;   /* bitmap of erase blocks modified since the
+                              * base, or NULL if there is no base */
+    int        dirty_unknown; /* the image may differ from the base outside
+                               * of dirty_bits, see nand_dev_compare_base() */
+    int        base_fd;      /* read-only descriptor for the base, or -1 */
+    char*      base_path;    /* path of the base, NULL for read-only devices */
+    uint64_t   base_size;    /* size of the base image, in bytes */
+    uint32_t   base_crc;     /* CRC-32 of the base image, if base_crc_known */
+    int        base_crc_known; /* see nand_dev_base_crc() */
+    char*      image_path;   /* path of a read-write image that has a copy
+                              * as its base, NULL otherwise */
+    char*      map_path;     /* where dirty_bits is kept between sessions for
+                              * such images, see nand_dev_save_base_maps() */
 } nand_dev;
 
 nand_threshold    android_nand_write_threshold;
@@ -139,10 +167,17 @@ typedef struct {
  * 1: initial version, saving only nand_dev_controller_state fields
  * 2: saving actual disk contents as well
  * 3: use the correct data length and truncate to avoid padding.
+ * 6: only save the erase blocks that differ from the base image, when
+ *    there is one.
  */
-#define  NAND_DEV_STATE_SAVE_VERSION  5
+#define  NAND_DEV_STATE_SAVE_VERSION  6
+#define  NAND_DEV_STATE_SAVE_VERSION_FULL_DISKS  5
 #define  NAND_DEV_STATE_SAVE_VERSION_LEGACY  4
 
+/* Disk state encodings, since NAND_DEV_STATE_SAVE_VERSION 6 */
+#define  NAND_DEV_DISK_STATE_FULL   0  /* the whole image follows */
+#define  NAND_DEV_DISK_STATE_DELTA  1  /* only blocks that differ from base */
+
 #define  QFIELD_STRUCT  nand_dev_controller_state
 QFIELD_BEGIN(nand_dev_controller_state_fields)
     QFIELD_INT32(dev),
@@ -216,12 +251,567 @@ static int  do_ftruncate(int  fd, size_t  size)
 
 #define NAND_DEV_SAVE_DISK_BUF_SIZE 2048
 
+/* Upper bound for the base image path length stored in a snapshot */
+#define NAND_DEV_MAX_BASE_PATH  4096
+
+/* Returns true if erase block |block| was modified since the base image */
+static int  nand_dev_block_is_dirty(const nand_dev *dev, uint64_t block)
+{
+    if (dev->dirty_bits == NULL || block >= dev->block_count)
+        return 0;
+    return (dev->dirty_bits[block >> 5] >> (block & 31)) & 1;
+}
+
+/* Records that [addr, addr + len) is going to be modified */
+static void  nand_dev_mark_dirty(nand_dev *dev, uint64_t addr, uint32_t len)
+{
+    uint64_t block, last;
+
+    if (dev->dirty_bits == NULL || dev->block_count == 0 || len == 0)
+        return;
+    last = (addr + len - 1) / dev->erase_size;
+    if (last >= dev->block_count)
+        last = dev->block_count - 1;
+    for (block = addr / dev->erase_size; block <= last; block++)
+        dev->dirty_bits[block >> 5] |= 1U << (block & 31);
+}
+
+static void  nand_dev_mark_all_dirty(nand_dev *dev)
+{
+    if (dev->dirty_bits != NULL)
+        memset(dev->dirty_bits, 0xff, ((dev->block_count + 31) / 32) * 4);
+}
+
+/* An erase block must be saved in a delta snapshot if it was modified, or
+ * if it is not entirely covered by the base image (file holes past the end
+ * of the base image do not read as erased flash).
+ */
+static int  nand_dev_block_is_saved(const nand_dev *dev, uint64_t block)
+{
+    return nand_dev_block_is_dirty(dev, block) ||
+           (block + 1) * dev->erase_size > dev->base_size;
+}
+
+/* Reads exactly |size| bytes at |offset| from |fd|. Returns 0 on success */
+static int  nand_dev_read_at(int fd, uint64_t offset, uint8_t *buf, size_t size)
+{
+    int ret;
+
+    if (do_lseek(fd, offset, SEEK_SET) == -1)
+        return -1;
+    while (size > 0) {
+        ret = do_read(fd, buf, size);
+        if (ret <= 0)
+            return -1;
+        buf += ret;
+        size -= ret;
+    }
+    return 0;
+}
+
+/* Returns the size of the base image opened as |fd| */
+static int  nand_dev_stat_base(int fd, uint64_t *size)
+{
+    struct stat st;
+
+    if (fstat(fd, &st) < 0)
+        return -1;
+    *size = st.st_size;
+    return 0;
+}
+
+/* Computes the CRC-32 and the size of the contents of |fd|, reading it
+ * entirely through |buf|. Returns 0 on success. */
+static int  nand_dev_crc_file(int fd, uint8_t *buf, size_t buf_size,
+                              uint32_t *crc, uint64_t *size)
+{
+    uint32_t result = crc32(0L, Z_NULL, 0);
+    uint64_t total = 0;
+    int ret;
+
+    if (do_lseek(fd, 0, SEEK_SET) == -1)
+        return -1;
+    while ((ret = do_read(fd, buf, buf_size)) > 0) {
+        result = crc32(result, buf, ret);
+        total += ret;
+    }
+    if (ret < 0)
+        return -1;
+    *crc = result;
+    *size = total;
+    return 0;
+}
+
+/* Identifies the base image of |dev| by its contents rather than by its
+ * modification time, which is coarse and not preserved by all copies. The
+ * CRC-32 is computed on first use, as this reads the whole base, except for
+ * the copies made by nand_dev_create_base(). Returns 0 on success. */
+static int  nand_dev_base_crc(nand_dev *dev, uint32_t *crc)
+{
+    uint64_t size;
+
+    if (!dev->base_crc_known) {
+        if (dev->base_fd < 0 ||
+            nand_dev_crc_file(dev->base_fd, dev->data, dev->erase_size,
+                              &dev->base_crc, &size) < 0)
+            return -1;
+        dev->base_crc_known = 1;
+    }
+    *crc = dev->base_crc;
+    return 0;
+}
+
+/* Read-write images that are not initialized from an 'initfile' use a copy
+ * of themselves as their base, created by the first snapshot. The dirty
+ * bitmap is kept in a second file between sessions. That file is deleted
+ * when it is loaded, so that it's missing after a crash. The image is then
+ * compared with its base by the next snapshot.
+ */
+#define NAND_DEV_BASE_SUFFIX      ".snapbase"
+#define NAND_DEV_BASE_MAP_SUFFIX  ".snapbase.map"
+
+static const char nand_dev_base_map_magic[8] = "NANDMAP2";
+
+/* Header of a base map file, followed by the dirty bitmap. Host byte order.
+ * The image is validated by its size and CRC-32 when the map is loaded. The
+ * base is never modified, only replaced by nand_dev_create_base() while no
+ * map exists, so its CRC-32 is taken from the map instead of being computed
+ * again.
+ */
+typedef struct {
+    char       magic[8];
+    uint64_t   base_size;
+    uint64_t   image_size;
+    uint32_t   base_crc;
+    uint32_t   image_crc;
+    uint32_t   block_count;
+    uint32_t   reserved;
+} nand_dev_base_map;
+
+static char*  nand_dev_path_with_suffix(const char *path, const char *suffix)
+{
+    size_t len = strlen(path) + strlen(suffix) + 1;
+    char *result = malloc(len);
+
+    if (result != NULL)
+        snprintf(result, len, "%s%s", path, suffix);
+    return result;
+}
+
+static size_t  nand_dev_dirty_bits_size(const nand_dev *dev)
+{
+    return ((dev->block_count + 31) / 32 + 1) * sizeof(uint32_t);
+}
+
+/* Computes the CRC-32 and the size of the image file of |dev|. The file is
+ * opened again, as its descriptor may already be closed at exit. */
+static int  nand_dev_crc_image(nand_dev *dev, uint32_t *crc, uint64_t *size)
+{
+    int fd = open(dev->image_path, O_BINARY | O_RDONLY);
+    int ret;
+
+    if (fd < 0)
+        return -1;
+    ret = nand_dev_crc_file(fd, dev->data, dev->erase_size, crc, size);
+    close(fd);
+    return ret;
+}
+
+/* Writes the dirty bitmap of every read-write image that has a copy as its
+ * base, at exit. The image must not be modified after that, or the bitmap
+ * is ignored by the next session. This reads the image entirely, which is
+ * still half of what nand_dev_compare_base() would read without the map.
+ */
+static void  nand_dev_save_base_maps(void)
+{
+    nand_dev_base_map map;
+    uint32_t i;
+
+    for (i = 0; i < nand_dev_count; i++) {
+        nand_dev *dev = nand_devs + i;
+        char *tmp_path;
+        int fd, ok;
+
+        if (dev->map_path == NULL || dev->base_fd < 0 || dev->dirty_unknown)
+            continue;
+        memset(&map, 0, sizeof(map));
+        memcpy(map.magic, nand_dev_base_map_magic, sizeof(map.magic));
+        map.base_size = dev->base_size;
+        map.block_count = dev->block_count;
+        if (nand_dev_base_crc(dev, &map.base_crc) < 0 ||
+            nand_dev_crc_image(dev, &map.image_crc, &map.image_size) < 0)
+            continue;
+        tmp_path = nand_dev_path_with_suffix(dev->map_path, ".tmp");
+        if (tmp_path == NULL)
+            continue;
+        fd = open(tmp_path, O_BINARY | O_CREAT | O_TRUNC | O_WRONLY, 0600);
+        if (fd < 0) {
+            free(tmp_path);
+            continue;
+        }
+        ok = do_write(fd, &map, sizeof(map)) == sizeof(map) &&
+             do_write(fd, dev->dirty_bits, nand_dev_dirty_bits_size(dev)) ==
+                 (int)nand_dev_dirty_bits_size(dev);
+        close(fd);
+        unlink(dev->map_path);
+        if (!ok || rename(tmp_path, dev->map_path) < 0) {
+            XLOG("could not save %s: %s\n", dev->map_path, strerror(errno));
+            unlink(tmp_path);
+        }
+        free(tmp_path);
+    }
+}
+
+/* Loads the dirty bitmap saved by the previous session for a read-write
+ * image that has a copy as its base. Otherwise, the image is considered as
+ * possibly modified anywhere. */
+static void  nand_dev_load_base_map(nand_dev *dev)
+{
+    nand_dev_base_map map;
+    uint64_t image_size;
+    uint32_t image_crc;
+    int fd, ok;
+
+    dev->dirty_unknown = 1;
+    fd = open(dev->map_path, O_BINARY | O_RDONLY);
+    if (fd < 0)
+        return;
+    ok = do_read(fd, &map, sizeof(map)) == sizeof(map) &&
+         !memcmp(map.magic, nand_dev_base_map_magic, sizeof(map.magic)) &&
+         map.base_size == dev->base_size &&
+         map.block_count == dev->block_count &&
+         nand_dev_crc_image(dev, &image_crc, &image_size) == 0 &&
+         map.image_size == image_size && map.image_crc == image_crc &&
+         do_read(fd, dev->dirty_bits, nand_dev_dirty_bits_size(dev)) ==
+             (int)nand_dev_dirty_bits_size(dev);
+    close(fd);
+    unlink(dev->map_path);
+    if (ok) {
+        dev->base_crc = map.base_crc;
+        dev->base_crc_known = 1;
+        dev->dirty_unknown = 0;
+    } else {
+        memset(dev->dirty_bits, 0, nand_dev_dirty_bits_size(dev));
+    }
+}
+
+/* Sets up a copy of the read-write image at |image_path| as the base of
+ * |dev|. If the copy doesn't exist yet, the next snapshot creates it.
+ */
+static void  nand_dev_init_image_base(nand_dev *dev, const char *image_path)
+{
+    static int registered;
+
+    dev->image_path = strdup(image_path);
+    dev->base_path = nand_dev_path_with_suffix(image_path,
+                                               NAND_DEV_BASE_SUFFIX);
+    dev->map_path = nand_dev_path_with_suffix(image_path,
+                                              NAND_DEV_BASE_MAP_SUFFIX);
+    if (dev->image_path == NULL || dev->base_path == NULL ||
+        dev->map_path == NULL) {
+        free(dev->image_path);
+        free(dev->base_path);
+        free(dev->map_path);
+        dev->image_path = dev->base_path = dev->map_path = NULL;
+        return;
+    }
+    if (!registered) {
+        atexit(nand_dev_save_base_maps);
+        registered = 1;
+    }
+    dev->base_fd = open(dev->base_path, O_BINARY | O_RDONLY);
+}
+
+/* Shares the data of the image with |fd| when the file system supports it
+ * (Linux FICLONE, e.g. btrfs or XFS), so the base takes no disk space until
+ * the image is modified. Returns 0 on success. */
+static int  nand_dev_clone_image(nand_dev *dev, int fd)
+{
+#ifdef __linux__
+    return ioctl(fd, FICLONE, dev->fd) < 0 ? -1 : 0;
+#else
+    return -1;
+#endif
+}
+
+/* Copies the image to |fd|, leaving holes for the erase blocks that only
+ * contain zeroes, i.e. the unused part of most images. Returns 0 on success.
+ */
+static int  nand_dev_copy_image(nand_dev *dev, int fd)
+{
+    uint64_t offset = 0;
+    int read_size;
+    int i;
+
+    if (do_lseek(dev->fd, 0, SEEK_SET) == -1)
+        return -1;
+    for (;;) {
+        read_size = do_read(dev->fd, dev->data, dev->erase_size);
+        if (read_size <= 0)
+            break;
+        for (i = 0; i < read_size && dev->data[i] == 0; i++)
+            ;
+        if (i < read_size &&
+            (do_lseek(fd, offset, SEEK_SET) == -1 ||
+             do_write(fd, dev->data, read_size) != read_size))
+            return -1;
+        offset += read_size;
+        if (read_size < (int)dev->erase_size)
+            break;
+    }
+    if (read_size < 0 || do_ftruncate(fd, offset) < 0)
+        return -1;
+    return 0;
+}
+
+/**
+ * Creates the base of a read-write image, see nand_dev_init_image_base(),
+ * as a clone of the image if possible, or as a sparse copy. A copy costs
+ * about as much as a full snapshot of the disk, once. Also replaces the
+ * current base, if any, see nand_dev_should_rebase(). Returns 0 on success.
+ * The current base is kept if the new one can't be written.
+ */
+static int  nand_dev_create_base(nand_dev *dev)
+{
+    char *tmp_path = nand_dev_path_with_suffix(dev->base_path, ".tmp");
+    uint32_t crc;
+    int fd, ret = -1;
+
+    if (tmp_path == NULL)
+        return -1;
+    fd = open(tmp_path, O_BINARY | O_CREAT | O_TRUNC | O_WRONLY, 0600);
+    if (fd < 0) {
+        XLOG("could not create %s: %s\n", tmp_path, strerror(errno));
+        free(tmp_path);
+        return -1;
+    }
+    if (nand_dev_clone_image(dev, fd) < 0 &&
+        nand_dev_copy_image(dev, fd) < 0) {
+        XLOG("could not copy %s: %s\n", dev->image_path, strerror(errno));
+        goto out;
+    }
+    close(fd);
+    fd = -1;
+    if (dev->base_fd >= 0) {
+        /* Windows can't replace a file that is open. */
+        close(dev->base_fd);
+        dev->base_fd = -1;
+        unlink(dev->base_path);
+    }
+    dev->base_crc_known = 0;
+    if (rename(tmp_path, dev->base_path) < 0) {
+        XLOG("could not create %s: %s\n", dev->base_path, strerror(errno));
+        goto out;
+    }
+    dev->base_fd = open(dev->base_path, O_BINARY | O_RDONLY);
+    if (dev->base_fd < 0)
+        goto out;
+    if (nand_dev_stat_base(dev->base_fd, &dev->base_size) < 0 ||
+        nand_dev_base_crc(dev, &crc) < 0) {
+        close(dev->base_fd);
+        dev->base_fd = -1;
+        goto out;
+    }
+    memset(dev->dirty_bits, 0, nand_dev_dirty_bits_size(dev));
+    dev->dirty_unknown = 0;
+    ret = 0;
+
+out:
+    if (fd >= 0)
+        close(fd);
+    if (ret < 0)
+        unlink(tmp_path);
+    free(tmp_path);
+    return ret;
+}
+
+/**
+ * Marks the erase blocks of the image that differ from the base as dirty,
+ * when dirty_bits is not known to be complete, e.g. after a crash. This
+ * reads both files entirely, but only once per session.
+ */
+static void  nand_dev_compare_base(nand_dev *dev)
+{
+    uint8_t *base_data = malloc(dev->erase_size);
+    uint64_t block;
+
+    if (base_data == NULL) {
+        nand_dev_mark_all_dirty(dev);
+        dev->dirty_unknown = 0;
+        return;
+    }
+    for (block = 0; block < dev->block_count; block++) {
+        const uint64_t offset = block * dev->erase_size;
+
+        if (nand_dev_block_is_saved(dev, block))
+            continue;
+        if (nand_dev_read_at(dev->fd, offset, dev->data,
+                             dev->erase_size) < 0 ||
+            nand_dev_read_at(dev->base_fd, offset, base_data,
+                             dev->erase_size) < 0 ||
+            memcmp(dev->data, base_data, dev->erase_size) != 0) {
+            dev->dirty_bits[block >> 5] |= 1U << (block & 31);
+        }
+    }
+    free(base_data);
+    dev->dirty_unknown = 0;
+}
+
+/* Returns the size of the image file, or -1 and sets the error on |f| */
+static int64_t  nand_dev_image_size(QEMUFile *f, nand_dev *dev)
+{
+    off_t lseek_ret = do_lseek(dev->fd, 0, SEEK_END);
+    if (lseek_ret == -1) {
+        qemu_file_set_error(f, -errno);
+        XLOG("%s EOF seek failed: %s\n", __FUNCTION__, strerror(errno));
+        return -1;
+    }
+    return lseek_ret;
+}
+
+/* Returns the part of |path| that follows its last directory separator */
+static const char*  nand_dev_path_basename(const char *path)
+{
+    const char *name = path;
+
+    for (; *path; path++) {
+        if (*path == '/' || *path == PATH_SEP_C)
+            name = path + 1;
+    }
+    return name;
+}
+
+/* Returns the path of the base of |dev| as recorded in snapshots. A base in
+ * the directory of the image, i.e. in the AVD, is recorded relative to it,
+ * so that the AVD can be moved or copied along with its snapshots.
+ */
+static const char*  nand_dev_snapshot_base_path(const nand_dev *dev)
+{
+    const char *name;
+    size_t dir_len;
+
+    if (dev->base_path == NULL || dev->image_path == NULL)
+        return dev->base_path;
+    name = nand_dev_path_basename(dev->base_path);
+    dir_len = nand_dev_path_basename(dev->image_path) - dev->image_path;
+    if ((size_t)(name - dev->base_path) == dir_len &&
+        !memcmp(dev->base_path, dev->image_path, dir_len))
+        return name;
+    return dev->base_path;
+}
+
+/* Returns the path of a base image recorded as |path| in a snapshot, see
+ * nand_dev_snapshot_base_path(). The result must be freed by the caller.
+ */
+static char*  nand_dev_resolve_base_path(const nand_dev *dev, const char *path)
+{
+    size_t dir_len;
+    char *result;
+
+    if (path_is_absolute(path) || dev->image_path == NULL)
+        return strdup(path);
+    dir_len = nand_dev_path_basename(dev->image_path) - dev->image_path;
+    result = malloc(dir_len + strlen(path) + 1);
+    if (result != NULL) {
+        memcpy(result, dev->image_path, dir_len);
+        strcpy(result + dir_len, path);
+    }
+    return result;
+}
+
+/**
+ * Saves only the erase blocks of a disk image that differ from its base
+ * image, along with enough information to find and validate the base when
+ * the snapshot is restored.
+ */
+static void  nand_dev_save_disk_delta(QEMUFile *f, nand_dev *dev)
+{
+    const char *path = nand_dev_snapshot_base_path(dev);
+    const uint32_t path_len = path ? strlen(path) : 0;
+    uint64_t block, block_count;
+    uint32_t saved_count = 0;
+    uint32_t base_crc;
+
+    const int64_t total_size = nand_dev_image_size(f, dev);
+    if (total_size < 0)
+        return;
+    if (nand_dev_base_crc(dev, &base_crc) < 0) {
+        qemu_file_set_error(f, -EIO);
+        XLOG("%s base image read failed: %s\n", __FUNCTION__,
+             strerror(errno));
+        return;
+    }
+    block_count = (total_size + dev->erase_size - 1) / dev->erase_size;
+
+    qemu_put_be64(f, total_size);
+    qemu_put_byte(f, NAND_DEV_DISK_STATE_DELTA);
+    qemu_put_be64(f, dev->base_size);
+    qemu_put_be32(f, base_crc);
+    qemu_put_be32(f, path_len);
+    qemu_put_buffer(f, (const uint8_t*)path, path_len);
+    qemu_put_be32(f, dev->erase_size);
+
+    for (block = 0; block < block_count; block++) {
+        if (nand_dev_block_is_saved(dev, block))
+            saved_count++;
+    }
+    qemu_put_be32(f, saved_count);
+
+    for (block = 0; block < block_count; block++) {
+        const uint64_t offset = block * dev->erase_size;
+        uint64_t len = total_size - offset;
+
+        if (!nand_dev_block_is_saved(dev, block))
+            continue;
+        if (len > dev->erase_size)
+            len = dev->erase_size;
+        if (nand_dev_read_at(dev->fd, offset, dev->data, len) < 0) {
+            qemu_file_set_error(f, -EIO);
+            XLOG("%s read failed: %s\n", __FUNCTION__, strerror(errno));
+            return;
+        }
+        qemu_put_be32(f, block);
+        qemu_put_buffer(f, dev->data, len);
+    }
+}
+
+/* The copy that is the base of a read-write image is replaced by the next
+ * snapshot once more than 1/NAND_DEV_REBASE_RATIO of the image differs from
+ * it, so that the deltas saved by later snapshots don't keep growing up to
+ * the size of the image. Snapshots taken against the previous copy can't be
+ * restored after that.
+ */
+#define NAND_DEV_REBASE_RATIO  2
+
+static int  nand_dev_should_rebase(const nand_dev *dev)
+{
+    uint64_t block, block_count, saved_count = 0;
+    size_t image_len;
+    off_t image_size;
+
+    if (dev->map_path == NULL || dev->base_fd < 0)
+        return 0;
+    /* Not if a snapshot made another image the base, see
+     * nand_dev_load_disk_delta(). */
+    image_len = strlen(dev->image_path);
+    if (strncmp(dev->base_path, dev->image_path, image_len) != 0 ||
+        strcmp(dev->base_path + image_len, NAND_DEV_BASE_SUFFIX) != 0)
+        return 0;
+    image_size = do_lseek(dev->fd, 0, SEEK_END);
+    if (image_size <= 0)
+        return 0;
+    block_count = (image_size + dev->erase_size - 1) / dev->erase_size;
+    for (block = 0; block < block_count; block++) {
+        if (nand_dev_block_is_saved(dev, block))
+            saved_count++;
+    }
+    return saved_count * NAND_DEV_REBASE_RATIO > block_count;
+}
 
 /**
  * Copies the current contents of a disk image into the snapshot file.
- *
- * TODO optimize this using some kind of copy-on-write mechanism for
- *      unchanged disk sections.
+ * Disks that have a base image only save the blocks that were modified,
+ * see nand_dev_save_disk_delta().
  */
 static void  nand_dev_save_disk_state(QEMUFile *f, nand_dev *dev)
 {
@@ -231,17 +821,30 @@ static void  nand_dev_save_disk_state(QEMUFile *f, nand_dev *dev)
     int ret;
     uint64_t total_copied = 0;
 
-    /* Size of file to restore, hence size of data block following.
-     * TODO Work out whether to use lseek64 here. */
-
-    lseek_ret = do_lseek(dev->fd, 0, SEEK_END);
-    if (lseek_ret == -1) {
-      qemu_file_set_error(f, -errno);
-      XLOG("%s EOF seek failed: %s\n", __FUNCTION__, strerror(errno));
-      return;
+    if (dev->map_path != NULL && dev->base_fd < 0) {
+        if (nand_dev_create_base(dev) < 0) {
+            /* Don't try again, save the full image instead. */
+            free(dev->map_path);
+            dev->map_path = NULL;
+        }
+    }
+    if (dev->base_fd >= 0) {
+        if (dev->dirty_unknown)
+            nand_dev_compare_base(dev);
+        if (nand_dev_should_rebase(dev))
+            nand_dev_create_base(dev);
     }
-    const uint64_t total_size = lseek_ret;
+    if (dev->base_fd >= 0) {
+        nand_dev_save_disk_delta(f, dev);
+        return;
+    }
+
+    /* Size of file to restore, hence size of data block following. */
+    const int64_t total_size = nand_dev_image_size(f, dev);
+    if (total_size < 0)
+        return;
     qemu_put_be64(f, total_size);
+    qemu_put_byte(f, NAND_DEV_DISK_STATE_FULL);
 
     /* copy all data from the stream to the stored image */
     lseek_ret = do_lseek(dev->fd, 0, SEEK_SET);
@@ -278,11 +881,194 @@ static void nand_dev_save_disks(QEMUFile *f)
     }
 }
 
+/* Returns true if the base image of |dev| is the one a snapshot refers to */
+static int  nand_dev_base_matches(nand_dev *dev, const char *path,
+                                  uint64_t base_size, uint32_t base_crc)
+{
+    uint32_t crc;
+
+    if (dev->base_fd < 0 || dev->base_size != base_size)
+        return 0;
+    if (path == NULL || dev->base_path == NULL) {
+        if (path != dev->base_path)
+            return 0;
+    } else if (strcmp(path, dev->base_path) != 0) {
+        return 0;
+    }
+    /* Last, as this may read the whole base. */
+    return nand_dev_base_crc(dev, &crc) == 0 && crc == base_crc;
+}
+
+/**
+ * Restores a disk image from a delta snapshot, see nand_dev_save_disk_delta().
+ *
+ * When the device was initialized from the same base image, only the blocks
+ * that are modified either in the snapshot or in the current image are
+ * rewritten. Otherwise, the base image recorded in the snapshot is opened,
+ * validated and used to rebuild the whole image, then becomes the new base.
+ *
+ * The restore is done eagerly, before the guest resumes: the snapshot is
+ * read as a stream, so the blocks can't be fetched on first access instead.
+ */
+static int  nand_dev_load_disk_delta(QEMUFile *f, nand_dev *dev,
+                                     uint64_t total_size)
+{
+    const uint64_t base_size = qemu_get_be64(f);
+    const uint32_t base_crc = qemu_get_be32(f);
+    const uint32_t path_len = qemu_get_be32(f);
+    char *path = NULL;
+    char *resolved;
+    uint32_t *saved_bits = NULL;
+    uint32_t erase_size, saved_count, next_saved;
+    uint64_t block, block_count;
+    int base_fd = -1, restore_all = 0;
+    int ret = -EIO;
+
+    if (path_len > NAND_DEV_MAX_BASE_PATH) {
+        XLOG("%s invalid base path length %u\n", __FUNCTION__, path_len);
+        return -EIO;
+    }
+    if (path_len > 0) {
+        path = malloc(path_len + 1);
+        if (path == NULL ||
+            qemu_get_buffer(f, (uint8_t*)path, path_len) != path_len) {
+            goto out;
+        }
+        path[path_len] = '\0';
+        resolved = nand_dev_resolve_base_path(dev, path);
+        free(path);
+        path = resolved;
+        if (path == NULL)
+            goto out;
+    }
+    erase_size = qemu_get_be32(f);
+    saved_count = qemu_get_be32(f);
+    if (erase_size != dev->erase_size) {
+        XLOG("%s erase size mismatch: %u != %u\n", __FUNCTION__,
+             erase_size, dev->erase_size);
+        goto out;
+    }
+
+    if (nand_dev_base_matches(dev, path, base_size, base_crc)) {
+        base_fd = dev->base_fd;
+    } else if (path != NULL && !(dev->flags & NAND_DEV_FLAG_READ_ONLY)) {
+        uint64_t size;
+        uint32_t crc;
+
+        base_fd = open(path, O_BINARY | O_RDONLY);
+        if (base_fd < 0) {
+            XLOG("%s could not open base image %s: %s\n", __FUNCTION__,
+                 path, strerror(errno));
+            goto out;
+        }
+        if (nand_dev_stat_base(base_fd, &size) < 0 || size != base_size ||
+            nand_dev_crc_file(base_fd, dev->data, dev->erase_size,
+                              &crc, &size) < 0 || crc != base_crc) {
+            XLOG("%s base image %s changed since the snapshot was taken\n",
+                 __FUNCTION__, path);
+            goto out;
+        }
+        restore_all = 1;
+    } else {
+        XLOG("%s image for %.*s changed since the snapshot was taken\n",
+             __FUNCTION__, dev->devname_len, dev->devname);
+        goto out;
+    }
+
+    if (dev->flags & NAND_DEV_FLAG_READ_ONLY) {
+        /* Nothing can have changed, and nothing can be written. */
+        ret = (saved_count == 0 && total_size == base_size) ? 0 : -EIO;
+        goto out;
+    }
+
+    saved_bits = calloc((dev->block_count + 31) / 32 + 1, sizeof(uint32_t));
+    if (saved_bits == NULL)
+        goto out;
+
+    block_count = (total_size + erase_size - 1) / erase_size;
+    next_saved = saved_count ? qemu_get_be32(f) : UINT32_MAX;
+    for (block = 0; block < block_count; block++) {
+        const uint64_t offset = block * erase_size;
+        uint64_t len = total_size - offset;
+
+        if (len > erase_size)
+            len = erase_size;
+        if (block == next_saved) {
+            if (qemu_get_buffer(f, dev->data, len) != len) {
+                XLOG("%s snapshot read failed\n", __FUNCTION__);
+                goto out;
+            }
+            if (block < dev->block_count)
+                saved_bits[block >> 5] |= 1U << (block & 31);
+            next_saved = --saved_count ? qemu_get_be32(f) : UINT32_MAX;
+            if (next_saved <= block) {
+                XLOG("%s corrupted block list\n", __FUNCTION__);
+                goto out;
+            }
+        } else if (restore_all || dev->dirty_unknown ||
+                   nand_dev_block_is_dirty(dev, block)) {
+            if (nand_dev_read_at(base_fd, offset, dev->data, len) < 0) {
+                XLOG("%s base image read failed: %s\n", __FUNCTION__,
+                     strerror(errno));
+                goto out;
+            }
+        } else {
+            continue;
+        }
+        if (do_lseek(dev->fd, offset, SEEK_SET) == -1 ||
+            do_write(dev->fd, dev->data, len) != len) {
+            XLOG("%s, write failed: %s\n", __FUNCTION__, strerror(errno));
+            goto out;
+        }
+    }
+    if (next_saved != UINT32_MAX) {
+        XLOG("%s block %u is out of range\n", __FUNCTION__, next_saved);
+        goto out;
+    }
+
+    if (do_ftruncate(dev->fd, total_size) < 0) {
+        XLOG("%s ftruncate failed: %s\n", __FUNCTION__, strerror(errno));
+        goto out;
+    }
+
+    /* Blocks truncated away no longer match the base image either. */
+    for (block = total_size / erase_size; block < dev->block_count; block++) {
+        if (block * erase_size >= base_size)
+            break;
+        saved_bits[block >> 5] |= 1U << (block & 31);
+    }
+
+    if (restore_all) {
+        /* Adopt the snapshot's base image for this session. */
+        if (dev->base_fd >= 0 && dev->base_fd != dev->fd)
+            close(dev->base_fd);
+        free(dev->base_path);
+        dev->base_fd = base_fd;
+        dev->base_path = path;
+        dev->base_size = base_size;
+        dev->base_crc = base_crc;
+        dev->base_crc_known = 1;
+        path = NULL;
+    }
+    free(dev->dirty_bits);
+    dev->dirty_bits = saved_bits;
+    dev->dirty_unknown = 0;
+    saved_bits = NULL;
+    ret = 0;
+
+out:
+    if (base_fd >= 0 && base_fd != dev->base_fd)
+        close(base_fd);
+    free(saved_bits);
+    free(path);
+    return ret;
+}
+
 /**
  * Overwrites the contents of the disk image managed by this device with the
  * contents as they were at the point the snapshot was made.
  */
-static int  nand_dev_load_disk_state(QEMUFile *f, nand_dev *dev)
+static int  nand_dev_load_disk_state(QEMUFile *f, nand_dev *dev, int version_id)
 {
     int buf_size = NAND_DEV_SAVE_DISK_BUF_SIZE;
     uint8_t buffer[NAND_DEV_SAVE_DISK_BUF_SIZE] = {0};
@@ -297,6 +1083,17 @@ static int  nand_dev_load_disk_state(QEMUFile *f, nand_dev *dev)
         return -EIO;
     }
 
+    if (version_id >= NAND_DEV_STATE_SAVE_VERSION) {
+        int mode = qemu_get_byte(f);
+        if (mode == NAND_DEV_DISK_STATE_DELTA) {
+            return nand_dev_load_disk_delta(f, dev, total_size);
+        }
+        if (mode != NAND_DEV_DISK_STATE_FULL) {
+            XLOG("%s unknown disk state encoding %d\n", __FUNCTION__, mode);
+            return -EIO;
+        }
+    }
+
     /* overwrite disk contents with snapshot contents */
     uint64_t next_offset = 0;
     lseek_ret = do_lseek(dev->fd, 0, SEEK_SET);
@@ -332,17 +1129,21 @@ static int  nand_dev_load_disk_state(QEMUFile *f, nand_dev *dev)
         return -EIO;
     }
 
+    /* Nothing is known about which blocks still match the base image. */
+    nand_dev_mark_all_dirty(dev);
+    dev->dirty_unknown = 0;
+
     return 0;
 }
 
 /**
  * Restores the state of all disks managed by this driver from a snapshot file.
  */
-static int nand_dev_load_disks(QEMUFile *f)
+static int nand_dev_load_disks(QEMUFile *f, int version_id)
 {
     int i, ret;
     for (i = 0; i < nand_dev_count; i++) {
-        ret = nand_dev_load_disk_state(f, nand_devs + i);
+        ret = nand_dev_load_disk_state(f, nand_devs + i, version_id);
         if (ret)
             return ret; // abort on error
     }
@@ -368,7 +1169,8 @@ static int   nand_dev_controller_state_load(QEMUFile *f, void  *opaque, int  ver
     nand_dev_controller_state*  s = opaque;
     int ret;
 
-    if (version_id == NAND_DEV_STATE_SAVE_VERSION) {
+    if (version_id == NAND_DEV_STATE_SAVE_VERSION ||
+        version_id == NAND_DEV_STATE_SAVE_VERSION_FULL_DISKS) {
         ret = qemu_get_struct(f, nand_dev_controller_state_fields, s);
     } else if (version_id == NAND_DEV_STATE_SAVE_VERSION_LEGACY) {
         ret = qemu_get_struct(f, nand_dev_controller_state_legacy_1_fields, s);
@@ -382,7 +1184,7 @@ static int   nand_dev_controller_state_load(QEMUFile *f, void  *opaque, int  ver
         // Invalid encoding.
         ret = -1;
     }
-    return ret ? ret : nand_dev_load_disks(f);
+    return ret ? ret : nand_dev_load_disks(f, version_id);
 }
 
 static uint32_t nand_dev_read_file(nand_dev *dev, target_ulong data, uint64_t addr, uint32_t total_len)
@@ -420,6 +1222,7 @@ static uint32_t nand_dev_write_file(nand_dev *dev, target_ulong data, uint64_t a
 
     NAND_UPDATE_WRITE_THRESHOLD(total_len);
 
+    nand_dev_mark_dirty(dev, addr, total_len);
     do_lseek(dev->fd, addr, SEEK_SET);
     while(len > 0) {
         if(len < write_len)
@@ -442,6 +1245,7 @@ static uint32_t nand_dev_erase_file(nand_dev *dev, uint64_t addr, uint32_t total
     size_t write_len = dev->erase_size;
     int ret;
 
+    nand_dev_mark_dirty(dev, addr, total_len);
     do_lseek(dev->fd, addr, SEEK_SET);
     memset(dev->data, 0xff, dev->erase_size);
     while(len > 0) {
@@ -726,6 +1530,7 @@ void nand_add_dev(const char *arg)
     size_t devname_len = 0;
     char *initfilename = NULL;
     char *rwfilename = NULL;
+    int rw_is_temp = 0;
     int initfd = -1;
     int rwfd = -1;
     int read_only = 0;
@@ -837,6 +1642,7 @@ void nand_add_dev(const char *arg)
             exit(1);
         }
         rwfilename = (char*) tempfile_path(tmp);
+        rw_is_temp = 1;
         if (VERBOSE_CHECK(init))
             dprint( "mapping '%.*s' NAND image to %s", devname_len, devname, rwfilename);
     }
@@ -898,6 +1704,16 @@ void nand_add_dev(const char *arg)
     if(dev->data == NULL)
         goto out_of_memory;
     dev->flags = read_only ? NAND_DEV_FLAG_READ_ONLY : 0;
+    dev->block_count = dev_size / dev->erase_size;
+    dev->dirty_bits = NULL;
+    dev->dirty_unknown = 0;
+    dev->base_fd = -1;
+    dev->base_path = NULL;
+    dev->base_size = 0;
+    dev->base_crc = 0;
+    dev->base_crc_known = 0;
+    dev->image_path = NULL;
+    dev->map_path = NULL;
 #ifdef TARGET_I386
     dev->flags |= NAND_DEV_FLAG_BATCH_CAP;
 #endif
@@ -914,10 +1730,32 @@ void nand_add_dev(const char *arg)
                 exit(1);
             }
         } while(read_size == dev->erase_size);
-        close(initfd);
+        /* Keep the initial image around as the base for snapshots. */
+        dev->base_fd = initfd;
+        dev->base_path = initfilename;
+    } else if (read_only) {
+        /* A read-only image is its own base. */
+        dev->base_fd = rwfd;
+    } else if (!rw_is_temp) {
+        nand_dev_init_image_base(dev, rwfilename);
     }
     dev->fd = rwfd;
 
+    if (dev->base_fd >= 0 || dev->map_path != NULL) {
+        if (dev->base_fd >= 0 &&
+            nand_dev_stat_base(dev->base_fd, &dev->base_size) < 0) {
+            XLOG("could not stat base image for %.*s, %s\n",
+                 devname_len, devname, strerror(errno));
+            exit(1);
+        }
+        dev->dirty_bits = calloc((dev->block_count + 31) / 32 + 1,
+                                 sizeof(uint32_t));
+        if (dev->dirty_bits == NULL)
+            goto out_of_memory;
+        if (dev->base_fd >= 0 && dev->map_path != NULL)
+            nand_dev_load_base_map(dev);
+    }
+
     nand_dev_count++;
 
     return;
@@ -12,6 +12,7 @@
 #include "android/utils/panic.h"
 #include "android/utils/system.h"
 #include "hw/android/goldfish/pipe.h"
+#include "hw/android/goldfish/pipe_table.h"
 #include "hw/android/goldfish/device.h"
 #include "hw/android/goldfish/vmem.h"
 #include "exec/ram_addr.h"
@@ -54,7 +55,10 @@
 /* Maximum length of pipe service name, in characters (excluding final 0) */
 #define MAX_PIPE_SERVICE_NAME_SIZE  255
 
-#define GOLDFISH_PIPE_SAVE_VERSION  3
+#define GOLDFISH_PIPE_SAVE_VERSION  4
+
+// Up to this version, pending transfers were not saved.
+#define GOLDFISH_PIPE_SAVE_VERSION_NO_TRANSFERS  3
 
 // Up to Tools r22.6, the emulator saved with this version number.
 #define GOLDFISH_PIPE_SAVE_VERSION_LEGACY  2
@@ -128,21 +132,45 @@ goldfish_pipe_find_type(const char*  pipeName)
 
 typedef struct PipeDevice  PipeDevice;
 
+/* Maximum number of contiguous runs a single guest buffer is split into.
+ * Larger buffers are partially transferred, which the guest handles. */
+#define PIPE_MAX_BUFFERS  32
+
+enum {
+    TRANSFER_IDLE = 0,   /* no guest buffer mapped */
+    TRANSFER_ACTIVE,     /* inside sendBuffers() / recvBuffers() */
+    TRANSFER_BORROWED,   /* borrowed by the service until completion */
+    TRANSFER_COMPLETED,  /* completed before the callback returned */
+};
+
+/* A guest read or write operation, and the guest pages it maps */
+struct GoldfishPipeTransfer {
+    struct Pipe*        pipe;
+    int                 state;
+    int                 isRead;     /* 1 if the data goes to the guest */
+    int                 canBorrow;
+    int                 inCall;
+    int                 status;     /* for TRANSFER_COMPLETED */
+    hwaddr              resultAddr; /* guest address of the result, or 0 */
+    int                 numBuffers;
+    GoldfishPipeBuffer  buffers[PIPE_MAX_BUFFERS];
+};
+
 typedef struct Pipe {
-    struct Pipe*              next;
-    struct Pipe*              next_waked;
+    PipeTableEntry             entry;   /* channel index and wake queue */
     PipeDevice*                device;
-    uint64_t                   channel;
     void*                      opaque;
     const GoldfishPipeFuncs*   funcs;
     const PipeService*         service;
     char*                      args;
     unsigned char              wanted;
     char                       closed;
+    GoldfishPipeTransfer       transfer;
 } Pipe;
 
 /* Forward */
 static void*  pipeConnector_new(Pipe*  pipe);
+static PipeTable*  pipeDevice_pipes(PipeDevice*  dev);
 
 static Pipe*
 pipe_new0(PipeDevice* dev)
@@ -150,6 +178,7 @@ pipe_new0(PipeDevice* dev)
     Pipe*  pipe;
     ANEW0(pipe);
     pipe->device = dev;
+    pipe->transfer.pipe = pipe;
     return pipe;
 }
 
@@ -157,66 +186,15 @@ static Pipe*
 pipe_new(uint64_t channel, PipeDevice* dev)
 {
     Pipe*  pipe = pipe_new0(dev);
-    pipe->channel = channel;
+    pipe->entry.channel = channel;
     pipe->opaque  = pipeConnector_new(pipe);
     return pipe;
 }
 
-static Pipe**
-pipe_list_findp_channel( Pipe** list, uint64_t channel )
-{
-    Pipe** pnode = list;
-    for (;;) {
-        Pipe* node = *pnode;
-        if (node == NULL || node->channel == channel) {
-            break;
-        }
-        pnode = &node->next;
-    }
-    return pnode;
-}
-
-#if 0
-static Pipe**
-pipe_list_findp_opaque( Pipe** list, void* opaque )
-{
-    Pipe** pnode = list;
-    for (;;) {
-        Pipe* node = *pnode;
-        if (node == NULL || node->opaque == opaque) {
-            break;
-        }
-        pnode = &node->next;
-    }
-    return pnode;
-}
-#endif
-
-static Pipe**
-pipe_list_findp_waked( Pipe** list, Pipe* pipe )
-{
-    Pipe** pnode = list;
-    for (;;) {
-        Pipe* node = *pnode;
-        if (node == NULL || node == pipe) {
-            break;
-        }
-        pnode = &node->next_waked;
-    }
-    return pnode;
-}
-
-
-static void
-pipe_list_remove_waked( Pipe** list, Pipe*  pipe )
+static Pipe*
+pipe_from_entry( PipeTableEntry* entry )
 {
-    Pipe** lookup = pipe_list_findp_waked(list, pipe);
-    Pipe*  node   = *lookup;
-
-    if (node != NULL) {
-        (*lookup) = node->next_waked;
-        node->next_waked = NULL;
-    }
+    return entry ? container_of(entry, Pipe, entry) : NULL;
 }
 
 static void
@@ -233,7 +211,7 @@ pipe_save( Pipe* pipe, QEMUFile* file )
     }
 
     /* Now save other common data */
-    qemu_put_be64(file, pipe->channel);
+    qemu_put_be64(file, pipe->entry.channel);
     qemu_put_byte(file, (int)pipe->wanted);
     qemu_put_byte(file, (int)pipe->closed);
 
@@ -245,19 +223,31 @@ pipe_save( Pipe* pipe, QEMUFile* file )
         qemu_put_byte(file, 0);
     }
 
+    /* Borrowed guest buffers can't be saved, only remember where to report
+     * the failure of a pending operation on load. */
+    if (pipe->transfer.state == TRANSFER_BORROWED) {
+        qemu_put_byte(file, 1);
+        qemu_put_be64(file, pipe->transfer.resultAddr);
+    } else {
+        qemu_put_byte(file, 0);
+    }
+
     if (pipe->funcs->save) {
         pipe->funcs->save(pipe->opaque, file);
     }
 }
 
 static Pipe*
-pipe_load( PipeDevice* dev, QEMUFile* file, int version_id )
+pipe_load( PipeDevice* dev, QEMUFile* file, int version_id,
+           uint64_t* pendingResultAddr )
 {
     Pipe*              pipe;
     const PipeService* service = NULL;
     int   state = qemu_get_byte(file);
     uint64_t channel;
 
+    *pendingResultAddr = 0;
+
     if (state != 0) {
         /* Pipe is associated with a service. */
         char* name = qemu_get_string(file);
@@ -283,15 +273,24 @@ pipe_load( PipeDevice* dev, QEMUFile* file, int version_id )
     if (qemu_get_byte(file) != 0) {
         pipe->args = qemu_get_string(file);
     }
+    if (version_id > GOLDFISH_PIPE_SAVE_VERSION_NO_TRANSFERS &&
+        qemu_get_byte(file) != 0) {
+        *pendingResultAddr = qemu_get_be64(file);
+    }
 
     pipe->service = service;
     if (service != NULL) {
         pipe->funcs = &service->funcs;
     }
 
+    /* Added before the service's load callback, which may wake the pipe */
+    pipe_table_add(pipeDevice_pipes(dev), &pipe->entry);
+
     if (pipe->funcs->load) {
         pipe->opaque = pipe->funcs->load(pipe, service ? service->opaque : NULL, pipe->args, file);
         if (pipe->opaque == NULL) {
+            pipe_table_remove(pipeDevice_pipes(dev), &pipe->entry);
+            AFREE(pipe->args);
             AFREE(pipe);
             return NULL;
         }
@@ -302,9 +301,18 @@ pipe_load( PipeDevice* dev, QEMUFile* file, int version_id )
     return pipe;
 }
 
+/* Forward */
+static void pipeTransfer_unmap( GoldfishPipeTransfer* t, int status );
+
 static void
 pipe_free( Pipe* pipe )
 {
+    /* Fail any pending operation without reporting it to the guest. This
+     * is done first, so that goldfish_pipe_complete() ignores a completion
+     * from the close callback, which would wake a pipe being freed. */
+    if (pipe->transfer.state != TRANSFER_IDLE) {
+        pipeTransfer_unmap(&pipe->transfer, PIPE_ERROR_IO);
+    }
     /* Call close callback */
     if (pipe->funcs->close) {
         pipe->funcs->close(pipe->opaque);
@@ -359,7 +367,7 @@ pipeConnector_sendBuffers( void* opaque, const GoldfishPipeBuffer* buffers, int
     int ret = 0;
 
     DD("%s: channel=0x%llx numBuffers=%d", __FUNCTION__,
-       (unsigned long long)pcon->pipe->channel,
+       (unsigned long long)pcon->pipe->entry.channel,
        numBuffers);
 
     while (buffers < buffers_limit) {
@@ -954,11 +962,8 @@ static const GoldfishPipeFuncs  throttlePipe_funcs = {
 struct PipeDevice {
     struct goldfish_device dev;
 
-    /* the list of all pipes */
-    Pipe*  pipes;
-
-    /* the list of signalled pipes */
-    Pipe*  signaled_pipes;
+    /* all pipes, indexed by channel, and the queue of signaled pipes */
+    PipeTable  pipes;
 
     /* i/o registers */
     uint64_t  address;
@@ -967,14 +972,142 @@ struct PipeDevice {
     uint64_t  channel;
     uint32_t  wakes;
     uint64_t  params_addr;
+
+    /* set while running an access_params entry */
+    uint32_t  access_flags;
+    hwaddr    result_addr;
 };
 
+static PipeTable*
+pipeDevice_pipes(PipeDevice*  dev)
+{
+    return &dev->pipes;
+}
+
+/* Maps the guest buffer at virtual address 'address' into t->buffers, one
+ * descriptor per host-contiguous run. Stops early if the buffer doesn't fit
+ * in PIPE_MAX_BUFFERS descriptors. Returns the number of bytes mapped, or 0
+ * if the start of the buffer cannot be mapped.
+ */
+static size_t
+pipeTransfer_map( GoldfishPipeTransfer* t, CPUState* cpu,
+                  target_ulong address, size_t size )
+{
+    size_t  mapped = 0;
+
+    t->numBuffers = 0;
+    while (size > 0) {
+        target_ulong  page = address & TARGET_PAGE_MASK;
+        hwaddr        phys = safe_get_phys_page_debug(cpu, page);
+        hwaddr        len;
+        uint8_t*      ptr;
+
+        if (phys == -1) {
+            break;
+        }
+#ifdef TARGET_X86_64
+        phys = phys & TARGET_PTE_MASK;
+#endif
+        len = page + TARGET_PAGE_SIZE - address;
+        if (len > size) {
+            len = size;
+        }
+        ptr = cpu_physical_memory_map(phys + (address - page), &len,
+                                      t->isRead);
+        if (ptr == NULL || len == 0) {
+            break;
+        }
+        if (t->numBuffers > 0 &&
+            t->buffers[t->numBuffers - 1].data +
+                    t->buffers[t->numBuffers - 1].size == ptr) {
+            /* Physically contiguous with the previous page */
+            t->buffers[t->numBuffers - 1].size += len;
+        } else if (t->numBuffers < PIPE_MAX_BUFFERS) {
+            t->buffers[t->numBuffers].data = ptr;
+            t->buffers[t->numBuffers].size = len;
+            t->numBuffers++;
+        } else {
+            cpu_physical_memory_unmap(ptr, len, t->isRead, 0);
+            break;
+        }
+        address += len;
+        size    -= len;
+        mapped  += len;
+    }
+    return mapped;
+}
+
+/* Releases the guest pages of a transfer. 'status' is the operation's
+ * result, used to mark the pages written by a read as dirty. */
+static void
+pipeTransfer_unmap( GoldfishPipeTransfer* t, int status )
+{
+    size_t  done = (t->isRead && status > 0) ? (size_t)status : 0;
+    int     nn;
+
+    for (nn = 0; nn < t->numBuffers; nn++) {
+        size_t  len    = t->buffers[nn].size;
+        size_t  access = done < len ? done : len;
+
+        cpu_physical_memory_unmap(t->buffers[nn].data, len, t->isRead, access);
+        done -= access;
+    }
+    t->numBuffers = 0;
+    t->state = TRANSFER_IDLE;
+}
+
+/* Runs a PIPE_CMD_READ_BUFFER or PIPE_CMD_WRITE_BUFFER command, passing the
+ * guest buffer to the service without copying it. Returns the status. */
+static int
+pipeDevice_doTransfer( PipeDevice* dev, Pipe* pipe, int isRead )
+{
+    GoldfishPipeTransfer*  t = &pipe->transfer;
+    int                    status;
+
+    /* Only one operation at a time per pipe */
+    if (t->state != TRANSFER_IDLE) {
+        return PIPE_ERROR_AGAIN;
+    }
+
+    t->isRead = isRead;
+    if (pipeTransfer_map(t, ENV_GET_CPU(cpu_single_env),
+                         dev->address, dev->size) == 0 && dev->size > 0) {
+        pipeTransfer_unmap(t, 0);
+        return PIPE_ERROR_INVAL;
+    }
+    t->state      = TRANSFER_ACTIVE;
+    t->canBorrow  = (dev->access_flags & PIPE_ACCESS_FLAG_ASYNC) != 0 &&
+                    dev->result_addr != 0;
+    t->resultAddr = dev->result_addr;
+
+    t->inCall     = 1;
+    if (isRead) {
+        status = pipe->funcs->recvBuffers(pipe->opaque, t->buffers,
+                                          t->numBuffers);
+    } else {
+        status = pipe->funcs->sendBuffers(pipe->opaque, t->buffers,
+                                          t->numBuffers);
+    }
+    t->inCall     = 0;
+
+    if (t->state == TRANSFER_BORROWED && status == PIPE_ERROR_PENDING) {
+        /* Keep the pages mapped until goldfish_pipe_complete() */
+        return status;
+    }
+    if (t->state == TRANSFER_COMPLETED) {
+        status = t->status;
+    } else if (status == PIPE_ERROR_PENDING) {
+        /* Service bug, the operation can't be completed */
+        status = PIPE_ERROR_IO;
+    }
+    pipeTransfer_unmap(t, status);
+    return status;
+}
+
 static void
 pipeDevice_doCommand( PipeDevice* dev, uint32_t command )
 {
-    Pipe** lookup = pipe_list_findp_channel(&dev->pipes, dev->channel);
-    Pipe*  pipe   = *lookup;
-    CPUOldState* env = cpu_single_env;
+    Pipe*  pipe = pipe_from_entry(pipe_table_find(&dev->pipes, dev->channel));
 
     /* Check that we're referring a known pipe channel */
     if (command != PIPE_CMD_OPEN && pipe == NULL) {
@@ -996,17 +1129,14 @@ pipeDevice_doCommand( PipeDevice* dev, uint32_t command )
             break;
         }
         pipe = pipe_new(dev->channel, dev);
-        pipe->next = dev->pipes;
-        dev->pipes = pipe;
+        pipe_table_add(&dev->pipes, &pipe->entry);
         dev->status = 0;
         break;
 
     case PIPE_CMD_CLOSE:
         DD("%s: CMD_CLOSE channel=0x%llx", __FUNCTION__, (unsigned long long)dev->channel);
-        /* Remove from device's lists */
-        *lookup = pipe->next;
-        pipe->next = NULL;
-        pipe_list_remove_waked(&dev->signaled_pipes, pipe);
+        /* Remove from device's table and wake queue */
+        pipe_table_remove(&dev->pipes, &pipe->entry);
         pipe_free(pipe);
         break;
 
@@ -1015,43 +1145,19 @@ pipeDevice_doCommand( PipeDevice* dev, uint32_t command )
         DD("%s: CMD_POLL > status=%d", __FUNCTION__, dev->status);
         break;
 
-    case PIPE_CMD_READ_BUFFER: {
-        /* Translate virtual address into physical one, into emulator memory. */
-        GoldfishPipeBuffer  buffer;
-        target_ulong        address = dev->address;
-        target_ulong        page    = address & TARGET_PAGE_MASK;
-        hwaddr  phys;
-        phys = safe_get_phys_page_debug(ENV_GET_CPU(env), page);
-#ifdef TARGET_X86_64
-        phys = phys & TARGET_PTE_MASK;
-#endif
-        buffer.data = qemu_get_ram_ptr(phys) + (address - page);
-        buffer.size = dev->size;
-        dev->status = pipe->funcs->recvBuffers(pipe->opaque, &buffer, 1);
+    case PIPE_CMD_READ_BUFFER:
+        dev->status = pipeDevice_doTransfer(dev, pipe, 1);
         DD("%s: CMD_READ_BUFFER channel=0x%llx address=0x%16llx size=%d > status=%d",
            __FUNCTION__, (unsigned long long)dev->channel, (unsigned long long)dev->address,
            dev->size, dev->status);
         break;
-    }
 
-    case PIPE_CMD_WRITE_BUFFER: {
-        /* Translate virtual address into physical one, into emulator memory. */
-        GoldfishPipeBuffer  buffer;
-        target_ulong        address = dev->address;
-        target_ulong        page    = address & TARGET_PAGE_MASK;
-        hwaddr  phys;
-        phys = safe_get_phys_page_debug(ENV_GET_CPU(env), page);
-#ifdef TARGET_X86_64
-        phys = phys & TARGET_PTE_MASK;
-#endif
-        buffer.data = qemu_get_ram_ptr(phys) + (address - page);
-        buffer.size = dev->size;
-        dev->status = pipe->funcs->sendBuffers(pipe->opaque, &buffer, 1);
+    case PIPE_CMD_WRITE_BUFFER:
+        dev->status = pipeDevice_doTransfer(dev, pipe, 0);
         DD("%s: CMD_WRITE_BUFFER channel=0x%llx address=0x%16llx size=%d > status=%d",
            __FUNCTION__, (unsigned long long)dev->channel, (unsigned long long)dev->address,
            dev->size, dev->status);
         break;
-    }
 
     case PIPE_CMD_WAKE_ON_READ:
         DD("%s: CMD_WAKE_ON_READ channel=0x%llx", __FUNCTION__, (unsigned long long)dev->channel);
@@ -1076,6 +1182,80 @@ pipeDevice_doCommand( PipeDevice* dev, uint32_t command )
     }
 }
 
+/* Runs the access_params entry at 'entry', which was read from guest
+ * address 'addr', and writes its result back to the guest right away, so
+ * that a later completion of a pending operation isn't overwritten. Only
+ * read and write commands are accepted. Returns 0 if the entry was ignored
+ * and its result left untouched.
+ */
+static int
+pipeDevice_doAccessParams( PipeDevice* dev, const void* entry, hwaddr addr )
+{
+    uint32_t cmd;
+    uint32_t result;
+
+    /* sync pipe device state from the parameter buffer */
+    if (goldfish_guest_is_64bit()) {
+        const struct access_params_64* aps64 = entry;
+        dev->channel = aps64->channel;
+        dev->size = aps64->size;
+        dev->address = aps64->address;
+        dev->access_flags = aps64->flags;
+        dev->result_addr = addr + offsetof(struct access_params_64, result);
+        cmd = aps64->cmd;
+    } else {
+        const struct access_params* aps = entry;
+        dev->channel = aps->channel;
+        dev->size = aps->size;
+        dev->address = aps->address;
+        dev->access_flags = aps->flags;
+        dev->result_addr = addr + offsetof(struct access_params, result);
+        cmd = aps->cmd;
+    }
+    if ((cmd != PIPE_CMD_READ_BUFFER) && (cmd != PIPE_CMD_WRITE_BUFFER)) {
+        dev->access_flags = 0;
+        dev->result_addr = 0;
+        return 0;
+    }
+
+    pipeDevice_doCommand(dev, cmd);
+    result = dev->status;
+    cpu_physical_memory_write(dev->result_addr, (void*)&result,
+                              sizeof(result));
+    dev->access_flags = 0;
+    dev->result_addr = 0;
+    return 1;
+}
+
+/* Runs 'count' consecutive access_params entries from the parameter buffer,
+ * with a single guest exit. The entries are read at once.
+ */
+static void
+pipeDevice_doBatch( PipeDevice* dev, uint32_t count )
+{
+    union {
+        struct access_params     aps[PIPE_BATCH_MAX];
+        struct access_params_64  aps64[PIPE_BATCH_MAX];
+    } entries;
+    size_t    entry_size = goldfish_guest_is_64bit() ?
+            sizeof(entries.aps64[0]) : sizeof(entries.aps[0]);
+    uint8_t*  entry = (uint8_t*)&entries;
+    uint32_t  nn;
+
+    if (dev->params_addr == 0)
+        return;
+
+    if (count > PIPE_BATCH_MAX)
+        count = PIPE_BATCH_MAX;
+
+    cpu_physical_memory_read(dev->params_addr, entry, count * entry_size);
+    for (nn = 0; nn < count; nn++) {
+        pipeDevice_doAccessParams(dev, entry + nn * entry_size,
+                                  dev->params_addr + nn * entry_size);
+    }
+    dev->status = count;
+}
+
 static void pipe_dev_write(void *opaque, hwaddr offset, uint32_t value)
 {
     PipeDevice *s = (PipeDevice *)opaque;
@@ -1122,49 +1302,31 @@ static void pipe_dev_write(void *opaque, hwaddr offset, uint32_t value)
 
     case PIPE_REG_ACCESS_PARAMS:
     {
-        struct access_params aps;
-        struct access_params_64 aps64;
-        uint32_t cmd;
+        union {
+            struct access_params     aps;
+            struct access_params_64  aps64;
+        } entry;
+        size_t entry_size = goldfish_guest_is_64bit() ?
+                sizeof(entry.aps64) : sizeof(entry.aps);
 
         /* Don't touch aps.result if anything wrong */
         if (s->params_addr == 0)
             break;
 
-        if (goldfish_guest_is_64bit()) {
-            cpu_physical_memory_read(s->params_addr, (void*)&aps64,
-                                     sizeof(aps64));
-        } else {
-            cpu_physical_memory_read(s->params_addr, (void*)&aps,
-                                     sizeof(aps));
-        }
-        /* sync pipe device state from batch buffer */
-        if (goldfish_guest_is_64bit()) {
-            s->channel = aps64.channel;
-            s->size = aps64.size;
-            s->address = aps64.address;
-            cmd = aps64.cmd;
-        } else {
-            s->channel = aps.channel;
-            s->size = aps.size;
-            s->address = aps.address;
-            cmd = aps.cmd;
-        }
-        if ((cmd != PIPE_CMD_READ_BUFFER) && (cmd != PIPE_CMD_WRITE_BUFFER))
-            break;
-
-        pipeDevice_doCommand(s, cmd);
-        if (goldfish_guest_is_64bit()) {
-            aps64.result = s->status;
-            cpu_physical_memory_write(s->params_addr, (void*)&aps64,
-                                      sizeof(aps64));
-        } else {
-            aps.result = s->status;
-            cpu_physical_memory_write(s->params_addr, (void*)&aps,
-                                      sizeof(aps));
-        }
+        cpu_physical_memory_read(s->params_addr, (void*)&entry, entry_size);
+        pipeDevice_doAccessParams(s, &entry, s->params_addr);
     }
     break;
 
+    case PIPE_REG_VERSION:
+        DR("%s: ignoring guest version %d", __FUNCTION__, value);
+        break;
+
+    case PIPE_REG_ACCESS_PARAMS_BATCH:
+        DR("%s: batch count=%d", __FUNCTION__, value);
+        pipeDevice_doBatch(s, value);
+        break;
+
     default:
         D("%s: offset=%d (0x%x) value=%d (0x%x)\n", __FUNCTION__, offset,
             offset, value, value);
@@ -1183,29 +1345,28 @@ static uint32_t pipe_dev_read(void *opaque, hwaddr offset)
         return dev->status;
 
     case PIPE_REG_CHANNEL:
-        if (dev->signaled_pipes != NULL) {
-            Pipe* pipe = dev->signaled_pipes;
+        if (pipe_table_first_signaled(&dev->pipes) != NULL) {
+            Pipe* pipe = pipe_from_entry(pipe_table_first_signaled(&dev->pipes));
             DR("%s: channel=0x%llx wanted=%d", __FUNCTION__,
-               (unsigned long long)pipe->channel, pipe->wanted);
+               (unsigned long long)pipe->entry.channel, pipe->wanted);
             dev->wakes = pipe->wanted;
             pipe->wanted = 0;
-            dev->signaled_pipes = pipe->next_waked;
-            pipe->next_waked = NULL;
-            if (dev->signaled_pipes == NULL) {
+            pipe_table_unsignal(&dev->pipes, &pipe->entry);
+            if (pipe_table_first_signaled(&dev->pipes) == NULL) {
                 goldfish_device_set_irq(&dev->dev, 0, 0);
                 DD("%s: lowering IRQ", __FUNCTION__);
             }
-            return (uint32_t)(pipe->channel & 0xFFFFFFFFUL);
+            return (uint32_t)(pipe->entry.channel & 0xFFFFFFFFUL);
         }
         DR("%s: no signaled channels", __FUNCTION__);
         return 0;
 
     case PIPE_REG_CHANNEL_HIGH:
-        if (dev->signaled_pipes != NULL) {
-            Pipe* pipe = dev->signaled_pipes;
+        if (pipe_table_first_signaled(&dev->pipes) != NULL) {
+            Pipe* pipe = pipe_from_entry(pipe_table_first_signaled(&dev->pipes));
             DR("%s: channel_high=0x%llx wanted=%d", __FUNCTION__,
-               (unsigned long long)pipe->channel, pipe->wanted);
-            return (uint32_t)(pipe->channel >> 32);
+               (unsigned long long)pipe->entry.channel, pipe->wanted);
+            return (uint32_t)(pipe->entry.channel >> 32);
         }
         DR("%s: no signaled channels", __FUNCTION__);
         return 0;
@@ -1220,6 +1381,13 @@ static uint32_t pipe_dev_read(void *opaque, hwaddr offset)
     case PIPE_REG_PARAMS_ADDR_LOW:
         return (uint32_t)(dev->params_addr & 0xFFFFFFFFUL);
 
+    case PIPE_REG_VERSION:
+        /* Not a version 2 device */
+        return 0;
+
+    case PIPE_REG_ACCESS_PARAMS_BATCH:
+        return PIPE_BATCH_MAX;
+
     default:
         D("%s: offset=%d (0x%x)\n", __FUNCTION__, offset, offset);
     }
@@ -1242,7 +1410,7 @@ static void
 goldfish_pipe_save( QEMUFile* file, void* opaque )
 {
     PipeDevice* dev = opaque;
-    Pipe* pipe;
+    PipeTableEntry* entry;
 
     qemu_put_be64(file, dev->address);
     qemu_put_be32(file, dev->size);
@@ -1251,16 +1419,26 @@ goldfish_pipe_save( QEMUFile* file, void* opaque )
     qemu_put_be32(file, dev->wakes);
     qemu_put_be64(file, dev->params_addr);
 
-    /* Count the number of pipe connections */
-    int count = 0;
-    for ( pipe = dev->pipes; pipe; pipe = pipe->next )
-        count++;
-
-    qemu_put_sbe32(file, count);
+    qemu_put_sbe32(file, pipe_table_count(&dev->pipes));
 
     /* Now save each pipe one after the other */
-    for ( pipe = dev->pipes; pipe; pipe = pipe->next ) {
-        pipe_save(pipe, file);
+    for ( entry = pipe_table_next(&dev->pipes, NULL); entry;
+          entry = pipe_table_next(&dev->pipes, entry) ) {
+        pipe_save(pipe_from_entry(entry), file);
+    }
+}
+
+/* Closes all pipes, before loading a saved state. Their pending operations
+ * are failed without writing their result to guest memory, which is being
+ * replaced by the saved one, and their services won't wake them anymore. */
+static void
+pipeDevice_closeAll( PipeDevice* dev )
+{
+    PipeTableEntry* entry;
+
+    while ((entry = pipe_table_next(&dev->pipes, NULL)) != NULL) {
+        pipe_table_remove(&dev->pipes, entry);
+        pipe_free(pipe_from_entry(entry));
     }
 }
 
@@ -1269,11 +1447,15 @@ goldfish_pipe_load( QEMUFile* file, void* opaque, int version_id )
 {
     PipeDevice* dev = opaque;
     Pipe*       pipe;
+    PipeTableEntry* entry;
 
     if ((version_id != GOLDFISH_PIPE_SAVE_VERSION) &&
+        (version_id != GOLDFISH_PIPE_SAVE_VERSION_NO_TRANSFERS) &&
         (version_id != GOLDFISH_PIPE_SAVE_VERSION_LEGACY)) {
         return -EINVAL;
     }
+
+    pipeDevice_closeAll(dev);
     if (version_id == GOLDFISH_PIPE_SAVE_VERSION_LEGACY) {
         dev->address = (uint64_t)qemu_get_be32(file);
     } else {
@@ -1294,16 +1476,26 @@ goldfish_pipe_load( QEMUFile* file, void* opaque, int version_id )
 
     /* Load all pipe connections */
     for ( ; count > 0; count-- ) {
-        pipe = pipe_load(dev, file, version_id);
+        uint64_t pendingResultAddr;
+
+        pipe = pipe_load(dev, file, version_id, &pendingResultAddr);
         if (pipe == NULL) {
             return -EIO;
         }
-        pipe->next = dev->pipes;
-        dev->pipes = pipe;
+
+        /* A pending operation can't be resumed, fail it */
+        if (pendingResultAddr != 0) {
+            int32_t status = PIPE_ERROR_IO;
+            cpu_physical_memory_write(pendingResultAddr, (void*)&status,
+                                      sizeof(status));
+            pipe->wanted |= PIPE_WAKE_COMPLETE;
+        }
     }
 
     /* Now we need to wake/close all relevant pipes */
-    for ( pipe = dev->pipes; pipe; pipe = pipe->next ) {
+    for ( entry = pipe_table_next(&dev->pipes, NULL); entry;
+          entry = pipe_table_next(&dev->pipes, entry) ) {
+        pipe = pipe_from_entry(entry);
         if (pipe->wanted != 0)
             goldfish_pipe_wake(pipe, pipe->wanted);
         if (pipe->closed != 0)
@@ -1318,6 +1510,7 @@ void pipe_dev_init(bool newDeviceNaming)
     PipeDevice *s;
 
     s = (PipeDevice *) g_malloc0(sizeof(*s));
+    pipe_table_init(&s->pipes);
 
     s->dev.name = newDeviceNaming ? "goldfish_pipe" : "qemu_pipe";
     s->dev.id = -1;
@@ -1351,17 +1544,12 @@ void
 goldfish_pipe_wake( void* hwpipe, unsigned flags )
 {
     Pipe*  pipe = hwpipe;
-    Pipe** lookup;
     PipeDevice*  dev = pipe->device;
 
-    DD("%s: channel=0x%llx flags=%d", __FUNCTION__, (unsigned long long)pipe->channel, flags);
+    DD("%s: channel=0x%llx flags=%d", __FUNCTION__, (unsigned long long)pipe->entry.channel, flags);
 
-    /* If not already there, add to the list of signaled pipes */
-    lookup = pipe_list_findp_waked(&dev->signaled_pipes, pipe);
-    if (!*lookup) {
-        pipe->next_waked = dev->signaled_pipes;
-        dev->signaled_pipes = pipe;
-    }
+    /* If not already there, add to the queue of signaled pipes */
+    pipe_table_signal(&dev->pipes, &pipe->entry);
     pipe->wanted |= (unsigned)flags;
 
     /* Raise IRQ to indicate there are items on our list ! */
@@ -1369,12 +1557,55 @@ goldfish_pipe_wake( void* hwpipe, unsigned flags )
     DD("%s: raising IRQ", __FUNCTION__);
 }
 
+GoldfishPipeTransfer*
+goldfish_pipe_borrow_buffers( void* hwpipe )
+{
+    Pipe*                  pipe = hwpipe;
+    GoldfishPipeTransfer*  t    = &pipe->transfer;
+
+    if (t->state != TRANSFER_ACTIVE || !t->canBorrow) {
+        return NULL;
+    }
+    DD("%s: channel=0x%llx", __FUNCTION__, (unsigned long long)pipe->entry.channel);
+    t->state = TRANSFER_BORROWED;
+    return t;
+}
+
+void
+goldfish_pipe_complete( GoldfishPipeTransfer* t, int status )
+{
+    Pipe*  pipe = t->pipe;
+
+    DD("%s: channel=0x%llx status=%d", __FUNCTION__,
+       (unsigned long long)pipe->entry.channel, status);
+
+    if (t->state != TRANSFER_BORROWED) {
+        return;
+    }
+    if (status == PIPE_ERROR_PENDING) {
+        status = PIPE_ERROR_IO;
+    }
+    /* Still inside the service callback, let it return the status */
+    if (t->inCall) {
+        t->state  = TRANSFER_COMPLETED;
+        t->status = status;
+        return;
+    }
+    pipeTransfer_unmap(t, status);
+    {
+        int32_t  result = status;
+        cpu_physical_memory_write(t->resultAddr, (void*)&result,
+                                  sizeof(result));
+    }
+    goldfish_pipe_wake(pipe, PIPE_WAKE_COMPLETE);
+}
+
 void
 goldfish_pipe_close( void* hwpipe )
 {
     Pipe* pipe = hwpipe;
 
-    D("%s: channel=0x%llx (closed=%d)", __FUNCTION__, (unsigned long long)pipe->channel, pipe->closed);
+    D("%s: channel=0x%llx (closed=%d)", __FUNCTION__, (unsigned long long)pipe->entry.channel, pipe->closed);
 
     if (!pipe->closed) {
         pipe->closed = 1;
@@ -0,0 +1,189 @@
+/* Copyright (C) 2015 The Android Open Source Project
+**
+** This software is licensed under the terms of the GNU General Public
+** License version 2, as published by the Free Software Foundation, and
+** may be copied, distributed, and modified under those terms.
+**
+** This program is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+** GNU General Public License for more details.
+*/
+#include "hw/android/goldfish/pipe_table.h"
+
+#include "android/utils/system.h"
+
+#include <stddef.h>
+
+/* Initial number of hash buckets, must be a power of 2 */
+#define PIPE_TABLE_MIN_BUCKETS_SHIFT  4
+
+static int
+pipe_table_bucket( const PipeTable* table, uint64_t channel )
+{
+    /* Channels are usually guest kernel pointers, so their low bits are
+     * mostly zeroes. A multiplicative hash mixes all bits into the top
+     * ones, which are used as the bucket index. */
+    return (int)((channel * 0x9E3779B97F4A7C15ULL) >> table->bucket_shift);
+}
+
+static void
+pipe_table_alloc_buckets( PipeTable* table, int log2_buckets )
+{
+    AARRAY_NEW0(table->buckets, 1 << log2_buckets);
+    table->bucket_shift = 64 - log2_buckets;
+}
+
+void
+pipe_table_init( PipeTable* table )
+{
+    AZERO(table);
+    pipe_table_alloc_buckets(table, PIPE_TABLE_MIN_BUCKETS_SHIFT);
+}
+
+void
+pipe_table_done( PipeTable* table )
+{
+    AFREE(table->buckets);
+    AZERO(table);
+}
+
+int
+pipe_table_count( const PipeTable* table )
+{
+    return table->count;
+}
+
+PipeTableEntry*
+pipe_table_find( const PipeTable* table, uint64_t channel )
+{
+    PipeTableEntry* entry = table->buckets[pipe_table_bucket(table, channel)];
+
+    while (entry != NULL && entry->channel != channel) {
+        entry = entry->hash_next;
+    }
+    return entry;
+}
+
+/* Doubles the number of buckets, keeping the load factor below 1 */
+static void
+pipe_table_grow( PipeTable* table )
+{
+    PipeTableEntry**  old_buckets = table->buckets;
+    int               old_count   = 1 << (64 - table->bucket_shift);
+    int               nn;
+
+    pipe_table_alloc_buckets(table, 64 - table->bucket_shift + 1);
+    for (nn = 0; nn < old_count; nn++) {
+        PipeTableEntry* entry = old_buckets[nn];
+        while (entry != NULL) {
+            PipeTableEntry*  next   = entry->hash_next;
+            int              bucket = pipe_table_bucket(table, entry->channel);
+
+            entry->hash_next = table->buckets[bucket];
+            table->buckets[bucket] = entry;
+            entry = next;
+        }
+    }
+    AFREE(old_buckets);
+}
+
+void
+pipe_table_add( PipeTable* table, PipeTableEntry* entry )
+{
+    int  bucket;
+
+    if (table->count >= (1 << (64 - table->bucket_shift))) {
+        pipe_table_grow(table);
+    }
+    bucket = pipe_table_bucket(table, entry->channel);
+    entry->hash_next = table->buckets[bucket];
+    entry->wake_prev = entry->wake_next = NULL;
+    entry->signaled  = 0;
+    table->buckets[bucket] = entry;
+    table->count++;
+}
+
+void
+pipe_table_remove( PipeTable* table, PipeTableEntry* entry )
+{
+    PipeTableEntry** pnode =
+            &table->buckets[pipe_table_bucket(table, entry->channel)];
+
+    while (*pnode != NULL && *pnode != entry) {
+        pnode = &(*pnode)->hash_next;
+    }
+    if (*pnode == NULL) {
+        return;
+    }
+    *pnode = entry->hash_next;
+    entry->hash_next = NULL;
+    table->count--;
+
+    pipe_table_unsignal(table, entry);
+}
+
+PipeTableEntry*
+pipe_table_next( const PipeTable* table, const PipeTableEntry* entry )
+{
+    int  bucket_count = 1 << (64 - table->bucket_shift);
+    int  bucket;
+
+    if (entry != NULL) {
+        if (entry->hash_next != NULL) {
+            return entry->hash_next;
+        }
+        bucket = pipe_table_bucket(table, entry->channel) + 1;
+    } else {
+        bucket = 0;
+    }
+    for (; bucket < bucket_count; bucket++) {
+        if (table->buckets[bucket] != NULL) {
+            return table->buckets[bucket];
+        }
+    }
+    return NULL;
+}
+
+void
+pipe_table_signal( PipeTable* table, PipeTableEntry* entry )
+{
+    if (entry->signaled) {
+        return;
+    }
+    entry->signaled  = 1;
+    entry->wake_next = NULL;
+    entry->wake_prev = table->wake_last;
+    if (table->wake_last != NULL) {
+        table->wake_last->wake_next = entry;
+    } else {
+        table->wake_first = entry;
+    }
+    table->wake_last = entry;
+}
+
+PipeTableEntry*
+pipe_table_first_signaled( const PipeTable* table )
+{
+    return table->wake_first;
+}
+
+void
+pipe_table_unsignal( PipeTable* table, PipeTableEntry* entry )
+{
+    if (!entry->signaled) {
+        return;
+    }
+    if (entry->wake_prev != NULL) {
+        entry->wake_prev->wake_next = entry->wake_next;
+    } else {
+        table->wake_first = entry->wake_next;
+    }
+    if (entry->wake_next != NULL) {
+        entry->wake_next->wake_prev = entry->wake_prev;
+    } else {
+        table->wake_last = entry->wake_prev;
+    }
+    entry->wake_prev = entry->wake_next = NULL;
+    entry->signaled  = 0;
+}
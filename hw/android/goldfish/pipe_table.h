@@ -0,0 +1,81 @@
+/* Copyright (C) 2015 The Android Open Source Project
+**
+** This software is licensed under the terms of the GNU General Public
+** License version 2, as published by the Free Software Foundation, and
+** may be copied, distributed, and modified under those terms.
+**
+** This program is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+** GNU General Public License for more details.
+*/
+#ifndef _HW_GOLDFISH_PIPE_TABLE_H
+#define _HW_GOLDFISH_PIPE_TABLE_H
+
+#include "android/utils/compiler.h"
+
+#include <stdint.h>
+
+ANDROID_BEGIN_HEADER
+
+/* A PipeTable indexes the pipes of the goldfish pipe device by channel, and
+ * holds the queue of signaled pipes that the guest reads through
+ * PIPE_REG_CHANNEL. Lookups, insertions, removals and wake queue operations
+ * all take constant time, whatever the number of open pipes.
+ *
+ * Entries are intrusive: embed a PipeTableEntry in each pipe object, and
+ * use container_of() to get back to it.
+ */
+
+typedef struct PipeTableEntry {
+    uint64_t                 channel;
+    struct PipeTableEntry*   hash_next;
+    struct PipeTableEntry*   wake_prev;
+    struct PipeTableEntry*   wake_next;
+    char                     signaled;
+} PipeTableEntry;
+
+typedef struct {
+    PipeTableEntry**  buckets;
+    int               bucket_shift;   /* 64 - log2(number of buckets) */
+    int               count;
+    PipeTableEntry*   wake_first;
+    PipeTableEntry*   wake_last;
+} PipeTable;
+
+void pipe_table_init( PipeTable* table );
+
+/* Releases the table's memory, not the entries */
+void pipe_table_done( PipeTable* table );
+
+/* Returns the number of entries in the table */
+int pipe_table_count( const PipeTable* table );
+
+/* Returns the entry for 'channel', or NULL */
+PipeTableEntry* pipe_table_find( const PipeTable* table, uint64_t channel );
+
+/* Adds 'entry', whose 'channel' must be set and not already in the table.
+ * This clears its wake queue links, so it must be added before it can be
+ * signaled. */
+void pipe_table_add( PipeTable* table, PipeTableEntry* entry );
+
+/* Removes 'entry' from the table, and from the wake queue if needed */
+void pipe_table_remove( PipeTable* table, PipeTableEntry* entry );
+
+/* Iterates over all entries, in no particular order. Pass NULL to get the
+ * first entry. The table must not be modified during the iteration. */
+PipeTableEntry* pipe_table_next( const PipeTable* table,
+                                 const PipeTableEntry* entry );
+
+/* Appends 'entry' to the wake queue, unless it is already there */
+void pipe_table_signal( PipeTable* table, PipeTableEntry* entry );
+
+/* Removes 'entry' from the wake queue, if it is there */
+void pipe_table_unsignal( PipeTable* table, PipeTableEntry* entry );
+
+/* Returns the first entry of the wake queue, or NULL if it is empty */
+PipeTableEntry* pipe_table_first_signaled( const PipeTable* table );
+
+ANDROID_END_HEADER
+
+#endif /* _HW_GOLDFISH_PIPE_TABLE_H */
@@ -0,0 +1,251 @@
+// Copyright 2015 The Android Open Source Project
+//
+// This software is licensed under the terms of the GNU General Public
+// License version 2, as published by the Free Software Foundation, and
+// may be copied, distributed, and modified under those terms.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+
+// A small micro-benchmark for the goldfish pipe device's PipeTable. With
+// thousands of open pipes (sensors, qemud, GL, adb...), it measures the
+// per-command bookkeeping cost of the device:
+//
+//   - lookup: finding the pipe of a channel, done by every command.
+//
+//   - wake: signaling a pipe, then having the guest fetch it through
+//     PIPE_REG_CHANNEL, as happens for every blocking read/write.
+//
+//   - open/close: adding and removing pipes.
+//
+// For reference, the same operations are also measured with the linked
+// lists the device used before.
+//
+// Usage: emulator_pipe_benchmark [<pipes>...]
+
+#include "hw/android/goldfish/pipe_table.h"
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/time.h>
+
+#include <vector>
+
+namespace {
+
+int64_t nowUs() {
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return (int64_t)tv.tv_sec * 1000000LL + tv.tv_usec;
+}
+
+// A trivial linear congruential generator, to get reproducible results
+// across platforms.
+uint32_t nextRandom(uint32_t* state) {
+    *state = *state * 1103515245U + 12345U;
+    return (*state >> 16) & 0x7fff;
+}
+
+// Guest drivers use the address of their per-pipe kernel structure as the
+// channel, so mimic slab-allocated kernel pointers.
+uint64_t channelFor(int n) {
+    return 0xffff880012340000ULL + (uint64_t)n * 0xc0;
+}
+
+// The previous implementation: singly-linked lists for all pipes and for
+// signaled pipes, scanned linearly.
+struct ListPipe {
+    ListPipe* next;
+    ListPipe* next_waked;
+    uint64_t channel;
+};
+
+struct ListDevice {
+    ListPipe* pipes;
+    ListPipe* signaled_pipes;
+};
+
+ListPipe** listFindChannel(ListPipe** list, uint64_t channel) {
+    ListPipe** pnode = list;
+    while (*pnode != NULL && (*pnode)->channel != channel) {
+        pnode = &(*pnode)->next;
+    }
+    return pnode;
+}
+
+void listWake(ListDevice* dev, ListPipe* pipe) {
+    ListPipe** pnode = &dev->signaled_pipes;
+    while (*pnode != NULL && *pnode != pipe) {
+        pnode = &(*pnode)->next_waked;
+    }
+    if (*pnode == NULL) {
+        pipe->next_waked = dev->signaled_pipes;
+        dev->signaled_pipes = pipe;
+    }
+}
+
+ListPipe* listFetchSignaled(ListDevice* dev) {
+    ListPipe* pipe = dev->signaled_pipes;
+    if (pipe != NULL) {
+        dev->signaled_pipes = pipe->next_waked;
+        pipe->next_waked = NULL;
+    }
+    return pipe;
+}
+
+void listRemove(ListDevice* dev, ListPipe* pipe) {
+    ListPipe** pnode = listFindChannel(&dev->pipes, pipe->channel);
+    *pnode = pipe->next;
+    pnode = &dev->signaled_pipes;
+    while (*pnode != NULL && *pnode != pipe) {
+        pnode = &(*pnode)->next_waked;
+    }
+    if (*pnode != NULL) {
+        *pnode = pipe->next_waked;
+    }
+}
+
+struct Results {
+    double lookupNs;
+    double wakeNs;
+    double openCloseNs;
+};
+
+// Number of pipes signaled at once, e.g. by a burst of sensor events.
+const int kWakeBurst = 64;
+
+Results benchTable(int count, int lookups) {
+    Results r;
+    std::vector<PipeTableEntry> entries(count);
+    PipeTable table;
+    pipe_table_init(&table);
+    for (int n = 0; n < count; ++n) {
+        entries[n].channel = channelFor(n);
+        pipe_table_add(&table, &entries[n]);
+    }
+
+    uint32_t seed = 1;
+    int64_t t0 = nowUs();
+    for (int n = 0; n < lookups; ++n) {
+        uint64_t channel = channelFor(nextRandom(&seed) % count);
+        if (pipe_table_find(&table, channel) == NULL) {
+            fprintf(stderr, "ERROR: missing channel\n");
+            exit(1);
+        }
+    }
+    int64_t t1 = nowUs();
+    r.lookupNs = (t1 - t0) * 1000.0 / lookups;
+
+    const int rounds = lookups / kWakeBurst;
+    t0 = nowUs();
+    for (int round = 0; round < rounds; ++round) {
+        for (int n = 0; n < kWakeBurst; ++n) {
+            pipe_table_signal(&table, &entries[nextRandom(&seed) % count]);
+        }
+        PipeTableEntry* entry;
+        while ((entry = pipe_table_first_signaled(&table)) != NULL) {
+            pipe_table_unsignal(&table, entry);
+        }
+    }
+    t1 = nowUs();
+    r.wakeNs = (t1 - t0) * 1000.0 / (rounds * kWakeBurst);
+
+    t0 = nowUs();
+    for (int n = 0; n < lookups; ++n) {
+        PipeTableEntry* entry = &entries[nextRandom(&seed) % count];
+        pipe_table_remove(&table, entry);
+        pipe_table_add(&table, entry);
+    }
+    t1 = nowUs();
+    r.openCloseNs = (t1 - t0) * 1000.0 / lookups;
+
+    if (pipe_table_count(&table) != count) {
+        fprintf(stderr, "ERROR: wrong pipe count\n");
+        exit(1);
+    }
+    pipe_table_done(&table);
+    return r;
+}
+
+Results benchLists(int count, int lookups) {
+    Results r;
+    std::vector<ListPipe> pipes(count);
+    ListDevice dev = { NULL, NULL };
+    for (int n = 0; n < count; ++n) {
+        pipes[n].channel = channelFor(n);
+        pipes[n].next_waked = NULL;
+        pipes[n].next = dev.pipes;
+        dev.pipes = &pipes[n];
+    }
+
+    uint32_t seed = 1;
+    int64_t t0 = nowUs();
+    for (int n = 0; n < lookups; ++n) {
+        uint64_t channel = channelFor(nextRandom(&seed) % count);
+        if (*listFindChannel(&dev.pipes, channel) == NULL) {
+            fprintf(stderr, "ERROR: missing channel\n");
+            exit(1);
+        }
+    }
+    int64_t t1 = nowUs();
+    r.lookupNs = (t1 - t0) * 1000.0 / lookups;
+
+    const int rounds = lookups / kWakeBurst;
+    t0 = nowUs();
+    for (int round = 0; round < rounds; ++round) {
+        for (int n = 0; n < kWakeBurst; ++n) {
+            listWake(&dev, &pipes[nextRandom(&seed) % count]);
+        }
+        while (listFetchSignaled(&dev) != NULL) {
+        }
+    }
+    t1 = nowUs();
+    r.wakeNs = (t1 - t0) * 1000.0 / (rounds * kWakeBurst);
+
+    t0 = nowUs();
+    for (int n = 0; n < lookups; ++n) {
+        ListPipe* pipe = &pipes[nextRandom(&seed) % count];
+        listRemove(&dev, pipe);
+        pipe->next = dev.pipes;
+        dev.pipes = pipe;
+    }
+    t1 = nowUs();
+    r.openCloseNs = (t1 - t0) * 1000.0 / lookups;
+    return r;
+}
+
+void bench(int count) {
+    const int kLookups = 200000;
+    Results table = benchTable(count, kLookups);
+    Results lists = benchLists(count, kLookups);
+
+    printf("pipes: %d open\n", count);
+    printf("  lookup:     %8.1f ns/op (lists: %8.1f ns/op)\n",
+           table.lookupNs, lists.lookupNs);
+    printf("  wake:       %8.1f ns/op (lists: %8.1f ns/op)\n",
+           table.wakeNs, lists.wakeNs);
+    printf("  open/close: %8.1f ns/op (lists: %8.1f ns/op)\n",
+           table.openCloseNs, lists.openCloseNs);
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+    if (argc > 1) {
+        for (int n = 1; n < argc; ++n) {
+            int count = atoi(argv[n]);
+            if (count > 0) {
+                bench(count);
+            }
+        }
+        return 0;
+    }
+    const int kCounts[] = { 16, 256, 1024, 4096, 16384 };
+    for (size_t n = 0; n < sizeof(kCounts) / sizeof(kCounts[0]); ++n) {
+        bench(kCounts[n]);
+    }
+    return 0;
+}
@@ -0,0 +1,145 @@
+// Copyright (C) 2015 The Android Open Source Project
+//
+// This software is licensed under the terms of the GNU General Public
+// License version 2, as published by the Free Software Foundation, and
+// may be copied, distributed, and modified under those terms.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+
+#include "hw/android/goldfish/pipe_table.h"
+
+#include <gtest/gtest.h>
+
+#include <set>
+#include <vector>
+
+namespace {
+
+// Same shape as the channels used by guest kernels: slab pointers.
+uint64_t channelFor(int n) {
+    return 0xffff880012340000ULL + (uint64_t)n * 0xc0;
+}
+
+class PipeTableTest : public ::testing::Test {
+protected:
+    virtual void SetUp() { pipe_table_init(&mTable); }
+    virtual void TearDown() { pipe_table_done(&mTable); }
+
+    PipeTableEntry* makeEntry(PipeTableEntry* entry, uint64_t channel) {
+        entry->channel = channel;
+        pipe_table_add(&mTable, entry);
+        return entry;
+    }
+
+    PipeTable mTable;
+};
+
+}  // namespace
+
+TEST_F(PipeTableTest, Empty) {
+    EXPECT_EQ(0, pipe_table_count(&mTable));
+    EXPECT_EQ(NULL, pipe_table_find(&mTable, channelFor(0)));
+    EXPECT_EQ(NULL, pipe_table_next(&mTable, NULL));
+    EXPECT_EQ(NULL, pipe_table_first_signaled(&mTable));
+}
+
+TEST_F(PipeTableTest, AddAndFind) {
+    PipeTableEntry entries[3];
+    for (int n = 0; n < 3; ++n) {
+        makeEntry(&entries[n], channelFor(n));
+    }
+    EXPECT_EQ(3, pipe_table_count(&mTable));
+    for (int n = 0; n < 3; ++n) {
+        EXPECT_EQ(&entries[n], pipe_table_find(&mTable, channelFor(n)));
+    }
+    EXPECT_EQ(NULL, pipe_table_find(&mTable, channelFor(3)));
+}
+
+TEST_F(PipeTableTest, Remove) {
+    PipeTableEntry entries[3];
+    for (int n = 0; n < 3; ++n) {
+        makeEntry(&entries[n], channelFor(n));
+    }
+    pipe_table_remove(&mTable, &entries[1]);
+    EXPECT_EQ(2, pipe_table_count(&mTable));
+    EXPECT_EQ(&entries[0], pipe_table_find(&mTable, channelFor(0)));
+    EXPECT_EQ(NULL, pipe_table_find(&mTable, channelFor(1)));
+    EXPECT_EQ(&entries[2], pipe_table_find(&mTable, channelFor(2)));
+
+    // Removing an entry that is not in the table does nothing.
+    pipe_table_remove(&mTable, &entries[1]);
+    EXPECT_EQ(2, pipe_table_count(&mTable));
+}
+
+TEST_F(PipeTableTest, SlotReuse) {
+    // The guest reuses the channel of a closed pipe for the next one, and
+    // the device reuses pipe objects for new channels.
+    PipeTableEntry first, second;
+    makeEntry(&first, channelFor(7));
+    pipe_table_signal(&mTable, &first);
+    pipe_table_remove(&mTable, &first);
+
+    makeEntry(&second, channelFor(7));
+    EXPECT_EQ(1, pipe_table_count(&mTable));
+    EXPECT_EQ(&second, pipe_table_find(&mTable, channelFor(7)));
+    EXPECT_EQ(NULL, pipe_table_first_signaled(&mTable));
+
+    makeEntry(&first, channelFor(8));
+    EXPECT_EQ(2, pipe_table_count(&mTable));
+    EXPECT_EQ(&first, pipe_table_find(&mTable, channelFor(8)));
+    EXPECT_EQ(&second, pipe_table_find(&mTable, channelFor(7)));
+    EXPECT_FALSE(first.signaled);
+}
+
+TEST_F(PipeTableTest, GrowAndIterate) {
+    const int kCount = 1000;
+    std::vector<PipeTableEntry> entries(kCount);
+    for (int n = 0; n < kCount; ++n) {
+        makeEntry(&entries[n], channelFor(n));
+    }
+    EXPECT_EQ(kCount, pipe_table_count(&mTable));
+    for (int n = 0; n < kCount; ++n) {
+        EXPECT_EQ(&entries[n], pipe_table_find(&mTable, channelFor(n)));
+    }
+
+    // Remove every other entry, then check that iteration visits each of
+    // the remaining ones exactly once.
+    for (int n = 0; n < kCount; n += 2) {
+        pipe_table_remove(&mTable, &entries[n]);
+    }
+    std::set<const PipeTableEntry*> seen;
+    for (PipeTableEntry* entry = pipe_table_next(&mTable, NULL);
+         entry != NULL;
+         entry = pipe_table_next(&mTable, entry)) {
+        EXPECT_TRUE(seen.insert(entry).second);
+    }
+    EXPECT_EQ((size_t)kCount / 2, seen.size());
+    for (int n = 1; n < kCount; n += 2) {
+        EXPECT_EQ(1U, seen.count(&entries[n]));
+    }
+}
+
+TEST_F(PipeTableTest, WakeQueue) {
+    PipeTableEntry entries[3];
+    for (int n = 0; n < 3; ++n) {
+        makeEntry(&entries[n], channelFor(n));
+    }
+    pipe_table_signal(&mTable, &entries[2]);
+    pipe_table_signal(&mTable, &entries[0]);
+    pipe_table_signal(&mTable, &entries[1]);
+    // Signaling twice doesn't queue twice.
+    pipe_table_signal(&mTable, &entries[2]);
+
+    EXPECT_EQ(&entries[2], pipe_table_first_signaled(&mTable));
+    pipe_table_unsignal(&mTable, &entries[2]);
+    EXPECT_FALSE(entries[2].signaled);
+
+    // Removing a signaled entry takes it out of the queue.
+    pipe_table_remove(&mTable, &entries[0]);
+    EXPECT_EQ(&entries[1], pipe_table_first_signaled(&mTable));
+    pipe_table_unsignal(&mTable, &entries[1]);
+    EXPECT_EQ(NULL, pipe_table_first_signaled(&mTable));
+}
@@ -0,0 +1,537 @@
+// Copyright (C) 2015 The Android Open Source Project
+//
+// This software is licensed under the terms of the GNU General Public
+// License version 2, as published by the Free Software Foundation, and
+// may be copied, distributed, and modified under those terms.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+
+#include "hw/android/goldfish/testing/pipe_test_env.h"
+
+extern "C" {
+#include "hw/android/goldfish/pipe.h"
+}
+
+#include <gtest/gtest.h>
+
+#include <string>
+#include <vector>
+
+#include <stddef.h>
+#include <string.h>
+
+namespace {
+
+// Guest addresses used by the tests, in the fake guest RAM.
+const hwaddr kParamsAddr = 0x1000;
+const hwaddr kNameAddr = 0x2000;
+const hwaddr kDataAddr = 0x3000;
+const uint32_t kDataSize = 3 * 4096;
+
+const uint32_t kResultSentinel = 0x5a5a5a5a;
+
+// A service which borrows the guest buffers of every asynchronous write,
+// until the test calls goldfish_pipe_complete(). Its close callback
+// completes any write still pending, which the device must ignore.
+// Synchronous writes are accepted entirely. With the "wake-on-load"
+// argument, its load callback wakes the pipe for reading.
+struct PendingPipe {
+    void* hwpipe;
+    GoldfishPipeTransfer* pending;
+    std::vector<GoldfishPipeBuffer> lastBuffers;
+};
+
+int sClosedCount = 0;
+PendingPipe* sLastPipe = NULL;
+// Called at the start of every write, if not NULL.
+void (*sOnSend)(PendingPipe* pipe) = NULL;
+
+void* pendingPipe_init(void* hwpipe, void* svcOpaque, const char* args) {
+    PendingPipe* pipe = new PendingPipe();
+    pipe->hwpipe = hwpipe;
+    pipe->pending = NULL;
+    sLastPipe = pipe;
+    return pipe;
+}
+
+void pendingPipe_close(void* opaque) {
+    PendingPipe* pipe = static_cast<PendingPipe*>(opaque);
+    if (pipe->pending) {
+        goldfish_pipe_complete(pipe->pending, 1);
+    }
+    if (sLastPipe == pipe) {
+        sLastPipe = NULL;
+    }
+    sClosedCount++;
+    delete pipe;
+}
+
+int pendingPipe_sendBuffers(void* opaque, const GoldfishPipeBuffer* buffers,
+                            int numBuffers) {
+    PendingPipe* pipe = static_cast<PendingPipe*>(opaque);
+    if (sOnSend) {
+        sOnSend(pipe);
+    }
+    pipe->lastBuffers.assign(buffers, buffers + numBuffers);
+    pipe->pending = goldfish_pipe_borrow_buffers(pipe->hwpipe);
+    if (pipe->pending) {
+        return PIPE_ERROR_PENDING;
+    }
+    int total = 0;
+    for (int n = 0; n < numBuffers; ++n) {
+        total += buffers[n].size;
+    }
+    return total;
+}
+
+int pendingPipe_recvBuffers(void* opaque, GoldfishPipeBuffer* buffers,
+                            int numBuffers) {
+    return PIPE_ERROR_AGAIN;
+}
+
+unsigned pendingPipe_poll(void* opaque) {
+    return PIPE_POLL_OUT;
+}
+
+void pendingPipe_wakeOn(void* opaque, int flags) {}
+
+void pendingPipe_save(void* opaque, QEMUFile* file) {}
+
+void* pendingPipe_load(void* hwpipe, void* svcOpaque, const char* args,
+                       QEMUFile* file) {
+    if (args && !strcmp(args, "wake-on-load")) {
+        goldfish_pipe_wake(hwpipe, PIPE_WAKE_READ);
+    }
+    return pendingPipe_init(hwpipe, svcOpaque, args);
+}
+
+const GoldfishPipeFuncs kPendingPipeFuncs = {
+    pendingPipe_init,
+    pendingPipe_close,
+    pendingPipe_sendBuffers,
+    pendingPipe_recvBuffers,
+    pendingPipe_poll,
+    pendingPipe_wakeOn,
+    pendingPipe_save,
+    pendingPipe_load,
+};
+
+class GoldfishPipeTest : public ::testing::Test {
+protected:
+    virtual void SetUp() {
+        static bool sRegistered = false;
+        mEnv = pipe_test_env();
+        pipe_test_reset();
+        if (!sRegistered) {
+            goldfish_pipe_add_type("pending", NULL, &kPendingPipeFuncs);
+            sRegistered = true;
+        }
+        sClosedCount = 0;
+        sOnSend = NULL;
+        pipe_test_write_reg(PIPE_REG_PARAMS_ADDR_HIGH, 0);
+        pipe_test_write_reg(PIPE_REG_PARAMS_ADDR_LOW, kParamsAddr);
+    }
+
+    virtual void TearDown() {
+        sOnSend = NULL;
+        // Load an empty state to close all the pipes.
+        QEMUFile* file = saveEmptyState();
+        EXPECT_EQ(0, pipe_test_load(file));
+        pipe_test_file_free(file);
+        EXPECT_EQ(0, mEnv->mappedBytes);
+    }
+
+    static QEMUFile* saveEmptyState() {
+        QEMUFile* file = pipe_test_file_new();
+        qemu_put_be64(file, 0);   // address
+        qemu_put_be32(file, 0);   // size
+        qemu_put_be32(file, 0);   // status
+        qemu_put_be64(file, 0);   // channel
+        qemu_put_be32(file, 0);   // wakes
+        qemu_put_be64(file, kParamsAddr);
+        qemu_put_sbe32(file, 0);  // pipe count
+        return file;
+    }
+
+    // Size of an access_params entry in the current guest layout.
+    size_t entrySize() const {
+        return mEnv->guest64 ? sizeof(struct access_params_64)
+                             : sizeof(struct access_params);
+    }
+
+    // Stores an access_params entry at index |n| of the parameter buffer,
+    // in the current guest layout, with a sentinel result.
+    void putEntry(int n, uint64_t channel, uint32_t cmd, hwaddr address,
+                  uint32_t size, uint32_t flags) {
+        uint8_t* dst = mEnv->ram + kParamsAddr + n * entrySize();
+        if (mEnv->guest64) {
+            struct access_params_64 aps;
+            memset(&aps, 0, sizeof(aps));
+            aps.channel = channel;
+            aps.size = size;
+            aps.address = address;
+            aps.cmd = cmd;
+            aps.result = kResultSentinel;
+            aps.flags = flags;
+            memcpy(dst, &aps, sizeof(aps));
+        } else {
+            struct access_params aps;
+            memset(&aps, 0, sizeof(aps));
+            aps.channel = channel;
+            aps.size = size;
+            aps.address = address;
+            aps.cmd = cmd;
+            aps.result = kResultSentinel;
+            aps.flags = flags;
+            memcpy(dst, &aps, sizeof(aps));
+        }
+    }
+
+    // Returns the result of the entry at index |n| of the parameter buffer.
+    uint32_t readResult(int n = 0) {
+        uint32_t result;
+        size_t offset = mEnv->guest64
+                ? offsetof(struct access_params_64, result)
+                : offsetof(struct access_params, result);
+        memcpy(&result, mEnv->ram + kParamsAddr + n * entrySize() + offset,
+               sizeof(result));
+        return result;
+    }
+
+    // Runs |cmd| on |channel| through the access_params entry, and returns
+    // its result.
+    uint32_t accessParams(uint64_t channel, uint32_t cmd, hwaddr address,
+                          uint32_t size, uint32_t flags) {
+        putEntry(0, channel, cmd, address, size, flags);
+        pipe_test_write_reg(PIPE_REG_ACCESS_PARAMS, 0);
+        return readResult();
+    }
+
+    void runCommand(uint32_t channel, uint32_t cmd) {
+        pipe_test_write_reg(PIPE_REG_CHANNEL_HIGH, 0);
+        pipe_test_write_reg(PIPE_REG_CHANNEL, channel);
+        pipe_test_write_reg(PIPE_REG_COMMAND, cmd);
+    }
+
+    // Opens a pipe to the service |name| on |channel|.
+    void openPipe(uint32_t channel, const char* name) {
+        std::string connect = std::string("pipe:") + name;
+        runCommand(channel, PIPE_CMD_OPEN);
+        ASSERT_EQ(0U, pipe_test_read_reg(PIPE_REG_STATUS));
+        memcpy(mEnv->ram + kNameAddr, connect.c_str(), connect.size() + 1);
+        ASSERT_EQ(connect.size() + 1,
+                  accessParams(channel, PIPE_CMD_WRITE_BUFFER, kNameAddr,
+                               connect.size() + 1, 0));
+    }
+
+    // Opens a pipe to the 'pending' service on |channel|.
+    void openPendingPipe(uint32_t channel) {
+        openPipe(channel, "pending");
+        ASSERT_TRUE(sLastPipe != NULL);
+    }
+
+    // Starts an asynchronous write on |channel|, which stays pending.
+    void startPendingWrite(uint32_t channel) {
+        ASSERT_EQ((uint32_t)PIPE_ERROR_PENDING,
+                  accessParams(channel, PIPE_CMD_WRITE_BUFFER, kDataAddr,
+                               kDataSize, PIPE_ACCESS_FLAG_ASYNC));
+        ASSERT_TRUE(sLastPipe->pending != NULL);
+        ASSERT_GT(mEnv->mappedBytes, 0);
+    }
+
+    // Runs a batch of the first |count| entries of the parameter buffer.
+    void runBatch(uint32_t count) {
+        pipe_test_write_reg(PIPE_REG_ACCESS_PARAMS_BATCH, count);
+    }
+
+    void testBatch();
+    void testBatchCompletion();
+
+    PipeTestEnv* mEnv;
+};
+
+// Runs reads and writes on two 'pingpong' pipes in a single batch, with an
+// entry that isn't a read or a write in the middle.
+void GoldfishPipeTest::testBatch() {
+    static const char kHello[] = "hello";
+    static const char kWorld[] = "world!";
+    const hwaddr kHelloAddr = kDataAddr;
+    const hwaddr kWorldAddr = kDataAddr + 0x100;
+    const hwaddr kReadAddr1 = kDataAddr + 0x200;
+    const hwaddr kReadAddr2 = kDataAddr + 0x300;
+
+    openPipe(1, "pingpong");
+    openPipe(2, "pingpong");
+    memcpy(mEnv->ram + kHelloAddr, kHello, sizeof(kHello));
+    memcpy(mEnv->ram + kWorldAddr, kWorld, sizeof(kWorld));
+
+    putEntry(0, 1, PIPE_CMD_WRITE_BUFFER, kHelloAddr, sizeof(kHello), 0);
+    putEntry(1, 2, PIPE_CMD_WRITE_BUFFER, kWorldAddr, sizeof(kWorld), 0);
+    putEntry(2, 3, PIPE_CMD_OPEN, 0, 0, 0);
+    putEntry(3, 1, PIPE_CMD_READ_BUFFER, kReadAddr1, 0x100, 0);
+    putEntry(4, 2, PIPE_CMD_READ_BUFFER, kReadAddr2, 0x100, 0);
+    runBatch(5);
+
+    EXPECT_EQ(5U, pipe_test_read_reg(PIPE_REG_STATUS));
+    EXPECT_EQ(sizeof(kHello), readResult(0));
+    EXPECT_EQ(sizeof(kWorld), readResult(1));
+    // Only reads and writes run in a batch.
+    EXPECT_EQ(kResultSentinel, readResult(2));
+    EXPECT_EQ(sizeof(kHello), readResult(3));
+    EXPECT_EQ(sizeof(kWorld), readResult(4));
+    EXPECT_STREQ(kHello, (const char*)mEnv->ram + kReadAddr1);
+    EXPECT_STREQ(kWorld, (const char*)mEnv->ram + kReadAddr2);
+
+    runCommand(3, PIPE_CMD_POLL);
+    EXPECT_EQ((uint32_t)PIPE_ERROR_INVAL, pipe_test_read_reg(PIPE_REG_STATUS));
+}
+
+// Completes a pending write of a batch while a later entry of the same
+// batch runs. The result of the completion must not be overwritten.
+void GoldfishPipeTest::testBatchCompletion() {
+    openPendingPipe(1);
+    PendingPipe* first = sLastPipe;
+    openPendingPipe(2);
+    PendingPipe* second = sLastPipe;
+
+    struct Completer {
+        static PendingPipe*& first() {
+            static PendingPipe* sFirst = NULL;
+            return sFirst;
+        }
+        static void onSend(PendingPipe* pipe) {
+            if (pipe != first() && first()->pending) {
+                goldfish_pipe_complete(first()->pending, kDataSize);
+                first()->pending = NULL;
+            }
+        }
+    };
+    Completer::first() = first;
+    sOnSend = Completer::onSend;
+
+    putEntry(0, 1, PIPE_CMD_WRITE_BUFFER, kDataAddr, kDataSize,
+             PIPE_ACCESS_FLAG_ASYNC);
+    putEntry(1, 2, PIPE_CMD_WRITE_BUFFER, kDataAddr, 16, 0);
+    runBatch(2);
+    sOnSend = NULL;
+
+    EXPECT_EQ(kDataSize, readResult(0));
+    EXPECT_EQ(16U, readResult(1));
+    EXPECT_TRUE(first->pending == NULL);
+    EXPECT_TRUE(second->pending == NULL);
+    EXPECT_EQ(1, mEnv->irqLevel);
+    EXPECT_EQ(1U, pipe_test_read_reg(PIPE_REG_CHANNEL));
+    EXPECT_EQ((uint32_t)PIPE_WAKE_COMPLETE, pipe_test_read_reg(PIPE_REG_WAKES));
+}
+
+}  // namespace
+
+TEST_F(GoldfishPipeTest, CompletePendingWrite) {
+    openPendingPipe(1);
+    startPendingWrite(1);
+
+    goldfish_pipe_complete(sLastPipe->pending, kDataSize);
+    sLastPipe->pending = NULL;
+
+    EXPECT_EQ(0, mEnv->mappedBytes);
+    EXPECT_EQ(kDataSize, readResult());
+    EXPECT_EQ(1, mEnv->irqLevel);
+    EXPECT_EQ(1U, pipe_test_read_reg(PIPE_REG_CHANNEL));
+    EXPECT_EQ((uint32_t)PIPE_WAKE_COMPLETE, pipe_test_read_reg(PIPE_REG_WAKES));
+    EXPECT_EQ(0, mEnv->irqLevel);
+}
+
+TEST_F(GoldfishPipeTest, LoadWithPendingWrite) {
+    // Save while no operation is pending.
+    openPendingPipe(1);
+    QEMUFile* file = pipe_test_file_new();
+    pipe_test_save(file);
+
+    startPendingWrite(1);
+
+    // The restored guest RAM has no pending operation in its entry.
+    memset(mEnv->ram + kParamsAddr, 0xa5, sizeof(struct access_params));
+    const int memoryWrites = mEnv->memoryWrites;
+
+    EXPECT_EQ(0, pipe_test_load(file));
+    pipe_test_file_free(file);
+
+    // The old pipe was closed, and its write failed, without touching guest
+    // memory or waking the guest, even though the service completed it from
+    // its close callback.
+    EXPECT_EQ(1, sClosedCount);
+    EXPECT_EQ(0, mEnv->mappedBytes);
+    EXPECT_EQ(memoryWrites, mEnv->memoryWrites);
+    for (size_t n = 0; n < sizeof(struct access_params); ++n) {
+        EXPECT_EQ(0xa5, mEnv->ram[kParamsAddr + n]);
+    }
+    EXPECT_EQ(0, mEnv->irqLevel);
+    EXPECT_EQ(0U, pipe_test_read_reg(PIPE_REG_CHANNEL));
+
+    // The saved pipe is back, and usable.
+    ASSERT_TRUE(sLastPipe != NULL);
+    startPendingWrite(1);
+    goldfish_pipe_complete(sLastPipe->pending, 1);
+    sLastPipe->pending = NULL;
+    EXPECT_EQ(1U, readResult());
+}
+
+TEST_F(GoldfishPipeTest, LoadSavedPendingWrite) {
+    openPendingPipe(1);
+    startPendingWrite(1);
+
+    // Save while the write is pending, then complete it.
+    QEMUFile* file = pipe_test_file_new();
+    pipe_test_save(file);
+    goldfish_pipe_complete(sLastPipe->pending, kDataSize);
+    sLastPipe->pending = NULL;
+    pipe_test_read_reg(PIPE_REG_CHANNEL);
+
+    EXPECT_EQ(0, pipe_test_load(file));
+    pipe_test_file_free(file);
+
+    // The write that was pending in the saved state is failed.
+    EXPECT_EQ((uint32_t)PIPE_ERROR_IO, readResult());
+    EXPECT_EQ(1, mEnv->irqLevel);
+    EXPECT_EQ(1U, pipe_test_read_reg(PIPE_REG_CHANNEL));
+    EXPECT_EQ((uint32_t)PIPE_WAKE_COMPLETE, pipe_test_read_reg(PIPE_REG_WAKES));
+}
+
+TEST_F(GoldfishPipeTest, VersionRegister) {
+    openPipe(1, "pingpong");
+
+    // A version 2 guest driver writes its version, then checks the device's.
+    putEntry(0, 1, PIPE_CMD_WRITE_BUFFER, kDataAddr, 16, 0);
+    pipe_test_write_reg(PIPE_REG_VERSION, 2);
+    EXPECT_EQ(kResultSentinel, readResult());
+    EXPECT_EQ(0U, pipe_test_read_reg(PIPE_REG_VERSION));
+
+    EXPECT_EQ((uint32_t)PIPE_BATCH_MAX,
+              pipe_test_read_reg(PIPE_REG_ACCESS_PARAMS_BATCH));
+}
+
+TEST_F(GoldfishPipeTest, Batch32) {
+    testBatch();
+}
+
+TEST_F(GoldfishPipeTest, Batch64) {
+    mEnv->guest64 = 1;
+    testBatch();
+}
+
+TEST_F(GoldfishPipeTest, BatchCompletion32) {
+    testBatchCompletion();
+}
+
+TEST_F(GoldfishPipeTest, BatchCompletion64) {
+    mEnv->guest64 = 1;
+    testBatchCompletion();
+}
+
+TEST_F(GoldfishPipeTest, ScatterGather) {
+    // A buffer across 3 virtual pages, backed by physical pages in another
+    // order, is passed as one run per physically contiguous part.
+    const int kFirstPage = 16;
+    const hwaddr kBufferAddr = kFirstPage * TARGET_PAGE_SIZE + 0x800;
+    const uint32_t kBufferSize = 2 * TARGET_PAGE_SIZE;
+    mEnv->pageMap[kFirstPage] = 40;
+    mEnv->pageMap[kFirstPage + 1] = 30;
+    mEnv->pageMap[kFirstPage + 2] = 31;
+
+    openPendingPipe(1);
+    EXPECT_EQ(kBufferSize, accessParams(1, PIPE_CMD_WRITE_BUFFER, kBufferAddr,
+                                        kBufferSize, 0));
+    ASSERT_EQ(2U, sLastPipe->lastBuffers.size());
+    EXPECT_EQ(mEnv->ram + 40 * TARGET_PAGE_SIZE + 0x800,
+              sLastPipe->lastBuffers[0].data);
+    EXPECT_EQ(0x800U, sLastPipe->lastBuffers[0].size);
+    EXPECT_EQ(mEnv->ram + 30 * TARGET_PAGE_SIZE,
+              sLastPipe->lastBuffers[1].data);
+    EXPECT_EQ(0x1800U, sLastPipe->lastBuffers[1].size);
+    EXPECT_EQ(0, mEnv->mappedBytes);
+}
+
+TEST_F(GoldfishPipeTest, ScatterGatherPingPong) {
+    // Data written from and read to scattered pages goes through intact.
+    const int kWritePage = 8;
+    const int kReadPage = 12;
+    const uint32_t kSize = 3 * TARGET_PAGE_SIZE;
+    for (int n = 0; n < 3; ++n) {
+        mEnv->pageMap[kWritePage + n] = 50 - 2 * n;
+        mEnv->pageMap[kReadPage + n] = 20 + 2 * n;
+    }
+    for (uint32_t n = 0; n < kSize; ++n) {
+        const int page = kWritePage + n / TARGET_PAGE_SIZE;
+        mEnv->ram[mEnv->pageMap[page] * TARGET_PAGE_SIZE +
+                  n % TARGET_PAGE_SIZE] = (uint8_t)(n * 7 + n / 251);
+    }
+
+    openPipe(1, "pingpong");
+    EXPECT_EQ(kSize, accessParams(1, PIPE_CMD_WRITE_BUFFER,
+                                  kWritePage * TARGET_PAGE_SIZE, kSize, 0));
+    EXPECT_EQ(kSize, accessParams(1, PIPE_CMD_READ_BUFFER,
+                                  kReadPage * TARGET_PAGE_SIZE, kSize, 0));
+    for (uint32_t n = 0; n < kSize; ++n) {
+        const int page = kReadPage + n / TARGET_PAGE_SIZE;
+        ASSERT_EQ((uint8_t)(n * 7 + n / 251),
+                  mEnv->ram[mEnv->pageMap[page] * TARGET_PAGE_SIZE +
+                            n % TARGET_PAGE_SIZE]) << "at offset " << n;
+    }
+}
+
+TEST_F(GoldfishPipeTest, ScatterGatherTooManyRuns) {
+    // A buffer that needs more than 32 runs is partially transferred.
+    const int kFirstPage = 16;
+    const int kPages = 40;
+    for (int n = 0; n < kPages; ++n) {
+        mEnv->pageMap[kFirstPage + n] = kFirstPage + kPages - 1 - n;
+    }
+
+    openPendingPipe(1);
+    EXPECT_EQ(32U * TARGET_PAGE_SIZE,
+              accessParams(1, PIPE_CMD_WRITE_BUFFER,
+                           kFirstPage * TARGET_PAGE_SIZE,
+                           kPages * TARGET_PAGE_SIZE, 0));
+    EXPECT_EQ(32U, sLastPipe->lastBuffers.size());
+    EXPECT_EQ(0, mEnv->mappedBytes);
+}
+
+TEST_F(GoldfishPipeTest, UnmappedBuffer) {
+    mEnv->pageMap[16] = -1;
+
+    openPendingPipe(1);
+    EXPECT_EQ((uint32_t)PIPE_ERROR_INVAL,
+              accessParams(1, PIPE_CMD_WRITE_BUFFER, 16 * TARGET_PAGE_SIZE,
+                           16, 0));
+    // Stops at the first page that isn't mapped.
+    mEnv->pageMap[16] = 16;
+    mEnv->pageMap[17] = -1;
+    EXPECT_EQ((uint32_t)TARGET_PAGE_SIZE,
+              accessParams(1, PIPE_CMD_WRITE_BUFFER, 16 * TARGET_PAGE_SIZE,
+                           2 * TARGET_PAGE_SIZE, 0));
+    EXPECT_EQ(0, mEnv->mappedBytes);
+}
+
+TEST_F(GoldfishPipeTest, WakeDuringLoad) {
+    openPipe(1, "pending:wake-on-load");
+    openPendingPipe(2);
+    QEMUFile* file = pipe_test_file_new();
+    pipe_test_save(file);
+
+    EXPECT_EQ(0, pipe_test_load(file));
+    pipe_test_file_free(file);
+
+    // The pipe woken by its service while it was loaded is signaled once.
+    EXPECT_EQ(1, mEnv->irqLevel);
+    EXPECT_EQ(1U, pipe_test_read_reg(PIPE_REG_CHANNEL));
+    EXPECT_EQ((uint32_t)PIPE_WAKE_READ, pipe_test_read_reg(PIPE_REG_WAKES));
+    EXPECT_EQ(0, mEnv->irqLevel);
+    EXPECT_EQ(0U, pipe_test_read_reg(PIPE_REG_CHANNEL));
+
+    // And can be closed.
+    runCommand(1, PIPE_CMD_CLOSE);
+    EXPECT_EQ(0U, pipe_test_read_reg(PIPE_REG_CHANNEL));
+}
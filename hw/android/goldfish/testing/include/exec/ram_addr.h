@@ -0,0 +1,18 @@
+/* Copyright (C) 2015 The Android Open Source Project
+**
+** This software is licensed under the terms of the GNU General Public
+** License version 2, as published by the Free Software Foundation, and
+** may be copied, distributed, and modified under those terms.
+**
+** This program is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+** GNU General Public License for more details.
+*/
+#ifndef PIPE_TESTING_EXEC_RAM_ADDR_H
+#define PIPE_TESTING_EXEC_RAM_ADDR_H
+
+/* Everything pipe.c needs is in the testing "hw/hw.h". */
+#include "hw/hw.h"
+
+#endif  /* PIPE_TESTING_EXEC_RAM_ADDR_H */
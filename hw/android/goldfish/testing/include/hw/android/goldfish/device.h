@@ -0,0 +1,48 @@
+/* Copyright (C) 2015 The Android Open Source Project
+**
+** This software is licensed under the terms of the GNU General Public
+** License version 2, as published by the Free Software Foundation, and
+** may be copied, distributed, and modified under those terms.
+**
+** This program is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+** GNU General Public License for more details.
+*/
+#ifndef PIPE_TESTING_GOLDFISH_DEVICE_H
+#define PIPE_TESTING_GOLDFISH_DEVICE_H
+
+#include "android/utils/compiler.h"
+#include "hw/hw.h"
+
+ANDROID_BEGIN_HEADER
+
+struct goldfish_device {
+    const char *name;
+    uint32_t id;
+    uint32_t base;
+    uint32_t size;
+    uint32_t irq;
+    uint32_t irq_count;
+};
+
+void goldfish_device_set_irq(struct goldfish_device *dev, int irq, int level);
+int goldfish_device_add(struct goldfish_device *dev,
+                       CPUReadMemoryFunc **mem_read,
+                       CPUWriteMemoryFunc **mem_write,
+                       void *opaque);
+int goldfish_guest_is_64bit(void);
+
+static inline void uint64_set_low(uint64_t *addr, uint32 value)
+{
+    *addr = (*addr & ~(0xFFFFFFFFULL)) | value;
+}
+
+static inline void uint64_set_high(uint64_t *addr, uint32 value)
+{
+    *addr = (*addr & 0xFFFFFFFFULL) | ((uint64_t)value << 32);
+}
+
+ANDROID_END_HEADER
+
+#endif  /* PIPE_TESTING_GOLDFISH_DEVICE_H */
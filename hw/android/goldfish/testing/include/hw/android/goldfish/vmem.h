@@ -0,0 +1,25 @@
+/* Copyright (C) 2015 The Android Open Source Project
+**
+** This software is licensed under the terms of the GNU General Public
+** License version 2, as published by the Free Software Foundation, and
+** may be copied, distributed, and modified under those terms.
+**
+** This program is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+** GNU General Public License for more details.
+*/
+#ifndef PIPE_TESTING_GOLDFISH_VMEM_H
+#define PIPE_TESTING_GOLDFISH_VMEM_H
+
+#include "android/utils/compiler.h"
+#include "hw/hw.h"
+
+ANDROID_BEGIN_HEADER
+
+/* Translates with PipeTestEnv::pageMap in the tests. */
+hwaddr safe_get_phys_page_debug(CPUState* cpu, target_ulong addr);
+
+ANDROID_END_HEADER
+
+#endif  /* PIPE_TESTING_GOLDFISH_VMEM_H */
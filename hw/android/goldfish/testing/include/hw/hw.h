@@ -0,0 +1,81 @@
+/* Copyright (C) 2015 The Android Open Source Project
+**
+** This software is licensed under the terms of the GNU General Public
+** License version 2, as published by the Free Software Foundation, and
+** may be copied, distributed, and modified under those terms.
+**
+** This program is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+** GNU General Public License for more details.
+*/
+#ifndef PIPE_TESTING_HW_HW_H
+#define PIPE_TESTING_HW_HW_H
+
+/* Replaces "hw/hw.h" when building hw/android/goldfish/pipe.c for its unit
+ * tests, with only what pipe.c uses. Implemented by pipe_test_env.c. */
+
+/* The standard headers that the real one includes through qemu-common.h */
+#include "android/utils/compiler.h"
+#include <errno.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <glib.h>
+
+ANDROID_BEGIN_HEADER
+
+typedef uint64_t  hwaddr;
+/* A 64-bit target, so that the guest can use either access_params layout */
+typedef uint64_t  target_ulong;
+typedef uint32_t  uint32;
+
+typedef struct QEMUFile  QEMUFile;
+typedef struct CPUState  CPUState;
+typedef struct CPUArchState  CPUArchState;
+
+#define container_of(ptr, type, member) \
+    ((type*)((char*)(ptr) - offsetof(type, member)))
+
+#define TARGET_PAGE_BITS  12
+#define TARGET_PAGE_SIZE  (1 << TARGET_PAGE_BITS)
+#define TARGET_PAGE_MASK  ~(TARGET_PAGE_SIZE - 1)
+
+extern CPUArchState*  cpu_single_env;
+#define ENV_GET_CPU(e)  ((CPUState*)(e))
+
+typedef void      CPUWriteMemoryFunc(void* opaque, hwaddr addr, uint32_t value);
+typedef uint32_t  CPUReadMemoryFunc(void* opaque, hwaddr addr);
+
+void*  cpu_physical_memory_map(hwaddr addr, hwaddr* plen, int is_write);
+void   cpu_physical_memory_unmap(void* buffer, hwaddr len, int is_write,
+                                 hwaddr access_len);
+void   cpu_physical_memory_read(hwaddr addr, void* buf, int len);
+void   cpu_physical_memory_write(hwaddr addr, const void* buf, int len);
+
+void      qemu_put_byte(QEMUFile* f, int v);
+void      qemu_put_be32(QEMUFile* f, unsigned int v);
+void      qemu_put_be64(QEMUFile* f, uint64_t v);
+void      qemu_put_sbe32(QEMUFile* f, int32_t v);
+void      qemu_put_sbuffer(QEMUFile* f, const int8_t* buf, int size);
+void      qemu_put_string(QEMUFile* f, const char* str);
+int       qemu_get_byte(QEMUFile* f);
+unsigned  qemu_get_be32(QEMUFile* f);
+uint64_t  qemu_get_be64(QEMUFile* f);
+int32_t   qemu_get_sbe32(QEMUFile* f);
+int       qemu_get_buffer(QEMUFile* f, uint8_t* buf, int size);
+char*     qemu_get_string(QEMUFile* f);
+
+typedef void  SaveStateHandler(QEMUFile* f, void* opaque);
+typedef int   LoadStateHandler(QEMUFile* f, void* opaque, int version_id);
+
+int register_savevm(void* dev, const char* idstr, int instance_id,
+                    int version_id, SaveStateHandler* save_state,
+                    LoadStateHandler* load_state, void* opaque);
+
+ANDROID_END_HEADER
+
+#endif  /* PIPE_TESTING_HW_HW_H */
@@ -0,0 +1,40 @@
+/* Copyright (C) 2015 The Android Open Source Project
+**
+** This software is licensed under the terms of the GNU General Public
+** License version 2, as published by the Free Software Foundation, and
+** may be copied, distributed, and modified under those terms.
+**
+** This program is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+** GNU General Public License for more details.
+*/
+#ifndef PIPE_TESTING_QEMU_TIMER_H
+#define PIPE_TESTING_QEMU_TIMER_H
+
+#include "android/utils/compiler.h"
+#include <stdint.h>
+
+ANDROID_BEGIN_HEADER
+
+/* Timers never fire in the tests. */
+
+typedef enum {
+    QEMU_CLOCK_VIRTUAL,
+} QEMUClockType;
+
+#define SCALE_NS  1
+
+typedef struct QEMUTimer  QEMUTimer;
+typedef void  QEMUTimerCB(void* opaque);
+
+QEMUTimer*  timer_new(QEMUClockType type, int scale, QEMUTimerCB* cb,
+                      void* opaque);
+void        timer_free(QEMUTimer* ts);
+void        timer_del(QEMUTimer* ts);
+void        timer_mod(QEMUTimer* ts, int64_t expire_time);
+int64_t     qemu_clock_get_ns(QEMUClockType type);
+
+ANDROID_END_HEADER
+
+#endif  /* PIPE_TESTING_QEMU_TIMER_H */
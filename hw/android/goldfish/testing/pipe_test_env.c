@@ -0,0 +1,342 @@
+/* Copyright (C) 2015 The Android Open Source Project
+**
+** This software is licensed under the terms of the GNU General Public
+** License version 2, as published by the Free Software Foundation, and
+** may be copied, distributed, and modified under those terms.
+**
+** This program is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+** GNU General Public License for more details.
+*/
+#include "hw/android/goldfish/testing/pipe_test_env.h"
+
+#include "android/utils/panic.h"
+#include "android/utils/system.h"
+#include "hw/android/goldfish/device.h"
+#include "hw/android/goldfish/pipe.h"
+#include "hw/android/goldfish/vmem.h"
+#include "qemu/timer.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+static PipeTestEnv  _env[1];
+static int          _envInitialized;
+
+static CPUReadMemoryFunc*   _readFn;
+static CPUWriteMemoryFunc*  _writeFn;
+static void*                _devOpaque;
+static SaveStateHandler*    _saveFn;
+static LoadStateHandler*    _loadFn;
+static void*                _saveOpaque;
+static int                  _saveVersion;
+
+CPUArchState*  cpu_single_env;
+
+PipeTestEnv*
+pipe_test_env(void)
+{
+    if (!_envInitialized) {
+        _envInitialized = 1;
+        pipe_test_reset();
+        pipe_dev_init(true);
+        if (!_writeFn || !_loadFn) {
+            APANIC("The pipe device was not registered");
+        }
+    }
+    return _env;
+}
+
+void
+pipe_test_reset(void)
+{
+    int  nn;
+
+    memset(_env->ram, 0, sizeof(_env->ram));
+    for (nn = 0; nn < PIPE_TEST_RAM_PAGES; nn++) {
+        _env->pageMap[nn] = nn;
+    }
+    _env->guest64 = 0;
+}
+
+void
+pipe_test_write_reg(hwaddr offset, uint32_t value)
+{
+    _writeFn(_devOpaque, offset, value);
+}
+
+uint32_t
+pipe_test_read_reg(hwaddr offset)
+{
+    return _readFn(_devOpaque, offset);
+}
+
+void
+pipe_test_save(QEMUFile* file)
+{
+    _saveFn(file, _saveOpaque);
+}
+
+int
+pipe_test_load(QEMUFile* file)
+{
+    return _loadFn(file, _saveOpaque, _saveVersion);
+}
+
+/* Device registration */
+
+int
+goldfish_device_add(struct goldfish_device *dev,
+                    CPUReadMemoryFunc **mem_read,
+                    CPUWriteMemoryFunc **mem_write,
+                    void *opaque)
+{
+    _readFn    = mem_read[0];
+    _writeFn   = mem_write[0];
+    _devOpaque = opaque;
+    return 0;
+}
+
+void
+goldfish_device_set_irq(struct goldfish_device *dev, int irq, int level)
+{
+    _env->irqLevel = level;
+}
+
+int
+goldfish_guest_is_64bit(void)
+{
+    return _env->guest64;
+}
+
+int
+register_savevm(void* dev, const char* idstr, int instance_id,
+                int version_id, SaveStateHandler* save_state,
+                LoadStateHandler* load_state, void* opaque)
+{
+    _saveFn      = save_state;
+    _loadFn      = load_state;
+    _saveOpaque  = opaque;
+    _saveVersion = version_id;
+    return 0;
+}
+
+/* Guest memory */
+
+static int
+ram_check(hwaddr addr, hwaddr len)
+{
+    return addr <= PIPE_TEST_RAM_SIZE && len <= PIPE_TEST_RAM_SIZE - addr;
+}
+
+hwaddr
+safe_get_phys_page_debug(CPUState* cpu, target_ulong addr)
+{
+    target_ulong  page = addr / TARGET_PAGE_SIZE;
+
+    if (page >= PIPE_TEST_RAM_PAGES || _env->pageMap[page] < 0) {
+        return (hwaddr)-1;
+    }
+    return (hwaddr)_env->pageMap[page] * TARGET_PAGE_SIZE;
+}
+
+void*
+cpu_physical_memory_map(hwaddr addr, hwaddr* plen, int is_write)
+{
+    if (!ram_check(addr, *plen)) {
+        *plen = 0;
+        return NULL;
+    }
+    _env->mappedBytes += *plen;
+    return _env->ram + addr;
+}
+
+void
+cpu_physical_memory_unmap(void* buffer, hwaddr len, int is_write,
+                          hwaddr access_len)
+{
+    _env->mappedBytes -= len;
+}
+
+void
+cpu_physical_memory_read(hwaddr addr, void* buf, int len)
+{
+    if (!ram_check(addr, len)) {
+        APANIC("Guest memory read out of bounds");
+    }
+    memcpy(buf, _env->ram + addr, len);
+}
+
+void
+cpu_physical_memory_write(hwaddr addr, const void* buf, int len)
+{
+    if (!ram_check(addr, len)) {
+        APANIC("Guest memory write out of bounds");
+    }
+    memcpy(_env->ram + addr, buf, len);
+    _env->memoryWrites++;
+}
+
+/* Timers */
+
+struct QEMUTimer {
+    int  unused;
+};
+
+QEMUTimer*
+timer_new(QEMUClockType type, int scale, QEMUTimerCB* cb, void* opaque)
+{
+    QEMUTimer*  ts;
+    ANEW0(ts);
+    return ts;
+}
+
+void
+timer_free(QEMUTimer* ts)
+{
+    AFREE(ts);
+}
+
+void
+timer_del(QEMUTimer* ts)
+{
+}
+
+void
+timer_mod(QEMUTimer* ts, int64_t expire_time)
+{
+}
+
+int64_t
+qemu_clock_get_ns(QEMUClockType type)
+{
+    return 0;
+}
+
+/* Saved state */
+
+struct QEMUFile {
+    uint8_t*  data;
+    int       size;
+    int       capacity;
+    int       pos;
+};
+
+QEMUFile*
+pipe_test_file_new(void)
+{
+    QEMUFile*  f;
+    ANEW0(f);
+    return f;
+}
+
+void
+pipe_test_file_free(QEMUFile* f)
+{
+    AFREE(f->data);
+    AFREE(f);
+}
+
+void
+qemu_put_byte(QEMUFile* f, int v)
+{
+    if (f->size == f->capacity) {
+        f->capacity = f->capacity * 2 + 64;
+        AARRAY_RENEW(f->data, f->capacity);
+    }
+    f->data[f->size++] = (uint8_t)v;
+}
+
+void
+qemu_put_be32(QEMUFile* f, unsigned int v)
+{
+    qemu_put_byte(f, v >> 24);
+    qemu_put_byte(f, v >> 16);
+    qemu_put_byte(f, v >> 8);
+    qemu_put_byte(f, v);
+}
+
+void
+qemu_put_be64(QEMUFile* f, uint64_t v)
+{
+    qemu_put_be32(f, v >> 32);
+    qemu_put_be32(f, v);
+}
+
+void
+qemu_put_sbe32(QEMUFile* f, int32_t v)
+{
+    qemu_put_be32(f, (unsigned int)v);
+}
+
+void
+qemu_put_sbuffer(QEMUFile* f, const int8_t* buf, int size)
+{
+    int  nn;
+    for (nn = 0; nn < size; nn++) {
+        qemu_put_byte(f, buf[nn]);
+    }
+}
+
+void
+qemu_put_string(QEMUFile* f, const char* str)
+{
+    int  len = strlen(str);
+    qemu_put_be32(f, len);
+    qemu_put_sbuffer(f, (const int8_t*)str, len);
+}
+
+int
+qemu_get_byte(QEMUFile* f)
+{
+    return (f->pos < f->size) ? f->data[f->pos++] : 0;
+}
+
+unsigned
+qemu_get_be32(QEMUFile* f)
+{
+    unsigned  v = qemu_get_byte(f) << 24;
+    v |= qemu_get_byte(f) << 16;
+    v |= qemu_get_byte(f) << 8;
+    v |= qemu_get_byte(f);
+    return v;
+}
+
+uint64_t
+qemu_get_be64(QEMUFile* f)
+{
+    uint64_t  v = (uint64_t)qemu_get_be32(f) << 32;
+    return v | qemu_get_be32(f);
+}
+
+int32_t
+qemu_get_sbe32(QEMUFile* f)
+{
+    return (int32_t)qemu_get_be32(f);
+}
+
+int
+qemu_get_buffer(QEMUFile* f, uint8_t* buf, int size)
+{
+    int  nn;
+    for (nn = 0; nn < size && f->pos < f->size; nn++) {
+        buf[nn] = f->data[f->pos++];
+    }
+    return nn;
+}
+
+char*
+qemu_get_string(QEMUFile* f)
+{
+    int    len = qemu_get_be32(f);
+    char*  str;
+
+    if (len <= 0 || len > f->size - f->pos) {
+        return NULL;
+    }
+    str = malloc(len + 1);
+    qemu_get_buffer(f, (uint8_t*)str, len);
+    str[len] = '\0';
+    return str;
+}
@@ -0,0 +1,69 @@
+/* Copyright (C) 2015 The Android Open Source Project
+**
+** This software is licensed under the terms of the GNU General Public
+** License version 2, as published by the Free Software Foundation, and
+** may be copied, distributed, and modified under those terms.
+**
+** This program is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+** GNU General Public License for more details.
+*/
+#ifndef HW_ANDROID_GOLDFISH_TESTING_PIPE_TEST_ENV_H
+#define HW_ANDROID_GOLDFISH_TESTING_PIPE_TEST_ENV_H
+
+/* A fake machine to run hw/android/goldfish/pipe.c in unit tests.
+ *
+ * pipe.c is built against the headers of testing/include, which replace
+ * the QEMU ones with the few declarations it uses. This file implements
+ * them: a small guest RAM with a page table, an in-memory QEMUFile, and a
+ * record of the device registration and of its IRQ.
+ */
+
+#include "android/utils/compiler.h"
+
+#include "hw/hw.h"
+
+ANDROID_BEGIN_HEADER
+
+/* Size of the fake guest RAM, which starts at address 0. */
+#define PIPE_TEST_RAM_PAGES  64
+#define PIPE_TEST_RAM_SIZE   (PIPE_TEST_RAM_PAGES * TARGET_PAGE_SIZE)
+
+typedef struct PipeTestEnv {
+    uint8_t  ram[PIPE_TEST_RAM_SIZE];
+    /* Physical page of each guest virtual page, or -1 if it isn't mapped */
+    int      pageMap[PIPE_TEST_RAM_PAGES];
+    /* Value of goldfish_guest_is_64bit() */
+    int      guest64;
+    /* Number of bytes of guest memory mapped and not unmapped yet */
+    int      mappedBytes;
+    /* Number of cpu_physical_memory_write() calls */
+    int      memoryWrites;
+    /* Current level of the device IRQ */
+    int      irqLevel;
+} PipeTestEnv;
+
+/* Returns the fake machine, after creating the pipe device the first time,
+ * with pipe_dev_init(). */
+PipeTestEnv* pipe_test_env(void);
+
+/* Clears the guest RAM, maps every virtual page to the physical page at the
+ * same address, and selects a 32-bit guest. Doesn't change the device. */
+void  pipe_test_reset(void);
+
+/* Accesses the registers of the pipe device. */
+void      pipe_test_write_reg(hwaddr offset, uint32_t value);
+uint32_t  pipe_test_read_reg(hwaddr offset);
+
+/* Saves or loads the state of the pipe device. */
+void  pipe_test_save(QEMUFile* file);
+int   pipe_test_load(QEMUFile* file);
+
+/* An in-memory QEMUFile, which reads from the start of what was written. */
+QEMUFile*  pipe_test_file_new(void);
+void       pipe_test_file_free(QEMUFile* file);
+
+ANDROID_END_HEADER
+
+#endif  /* HW_ANDROID_GOLDFISH_TESTING_PIPE_TEST_ENV_H */
@@ -14,6 +14,14 @@ typedef struct BlockDriverInfo {
     int cluster_size;
     /* offset at which the VM state can be saved (0 if not possible) */
     int64_t vm_state_offset;
+    /* metadata cache statistics, 0 if irrelevant */
+    int l2_cache_size;
+    uint64_t l2_cache_hits;
+    uint64_t l2_cache_misses;
+    uint64_t l2_cache_readahead;
+    int refcount_cache_size;
+    uint64_t refcount_cache_hits;
+    uint64_t refcount_cache_misses;
 } BlockDriverInfo;
 
 typedef struct QEMUSnapshotInfo {
@@ -56,6 +64,7 @@ void bdrv_info_print(Monitor *mon, const QObject *data);
 void bdrv_info(Monitor *mon, QObject **ret_data);
 void bdrv_stats_print(Monitor *mon, const QObject *data);
 void bdrv_info_stats(Monitor *mon, QObject **ret_data);
+void bdrv_info_cache(Monitor *mon);
 
 void bdrv_init(void);
 void bdrv_init_with_whitelist(void);
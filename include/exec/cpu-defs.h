@@ -74,8 +74,17 @@ typedef uint64_t target_ulong;
 #define TB_JMP_PAGE_MASK (TB_JMP_CACHE_SIZE - TB_JMP_PAGE_SIZE)
 
 #if !defined(CONFIG_USER_ONLY)
-#define CPU_TLB_BITS 8
-#define CPU_TLB_SIZE (1 << CPU_TLB_BITS)
+/* The main TLB of each MMU mode is direct-mapped. Its number of entries is
+   selected at startup (see tlb_set_size()), up to CPU_TLB_MAX_SIZE, and
+   defaults to CPU_TLB_DEFAULT_SIZE.  */
+#define CPU_TLB_MIN_BITS 6
+#define CPU_TLB_MAX_BITS 12
+#define CPU_TLB_DEFAULT_BITS 10
+#define CPU_TLB_MAX_SIZE (1 << CPU_TLB_MAX_BITS)
+#define CPU_TLB_DEFAULT_SIZE (1 << CPU_TLB_DEFAULT_BITS)
+/* Entries evicted from the main TLB are kept in a small fully associative
+   victim TLB, checked before calling tlb_fill().  */
+#define CPU_VTLB_SIZE 8
 
 #if HOST_LONG_BITS == 32 && TARGET_LONG_BITS == 32
 #define CPU_TLB_ENTRY_BITS 4
@@ -105,10 +114,28 @@ typedef struct CPUTLBEntry {
 
 QEMU_BUILD_BUG_ON(sizeof(CPUTLBEntry) != (1 << CPU_TLB_ENTRY_BITS));
 
+/* Index in the main TLB of the entry for the virtual address 'addr'.  */
+#define CPU_TLB_INDEX(env, addr) \
+    (((addr) >> TARGET_PAGE_BITS) & ((env)->tlb_mask >> CPU_TLB_ENTRY_BITS))
+
+typedef struct CPUTLBStats {
+    uint64_t hit;           /* main TLB hits, counted with CONFIG_PROFILER */
+    uint64_t victim_hit;    /* main TLB misses found in the victim TLB */
+    uint64_t miss;          /* calls to tlb_fill() */
+    uint64_t flush;         /* full flushes */
+} CPUTLBStats;
+
 #define CPU_COMMON_TLB \
     /* The meaning of the MMU modes is defined in the target code. */   \
-    CPUTLBEntry tlb_table[NB_MMU_MODES][CPU_TLB_SIZE];                  \
-    hwaddr iotlb[NB_MMU_MODES][CPU_TLB_SIZE];                           \
+    CPUTLBEntry tlb_table[NB_MMU_MODES][CPU_TLB_MAX_SIZE];              \
+    CPUTLBEntry tlb_v_table[NB_MMU_MODES][CPU_VTLB_SIZE];               \
+    hwaddr iotlb[NB_MMU_MODES][CPU_TLB_MAX_SIZE];                       \
+    hwaddr iotlb_v[NB_MMU_MODES][CPU_VTLB_SIZE];                        \
+    /* (number of entries - 1) << CPU_TLB_ENTRY_BITS, so that the       \
+       generated code can mask the byte offset of an entry directly. */ \
+    uintptr_t tlb_mask;                                                 \
+    unsigned int vtlb_index; /* next victim TLB entry to replace */     \
+    CPUTLBStats tlb_stats;                                              \
     target_ulong tlb_flush_addr;                                        \
     target_ulong tlb_flush_mask;
 
@@ -91,6 +91,7 @@ void QEMU_NORETURN cpu_io_recompile(CPUArchState *env, uintptr_t retaddr);
 TranslationBlock *tb_gen_code(CPUArchState *env, 
                               target_ulong pc, target_ulong cs_base, int flags,
                               int cflags);
+TranslationBlock *tb_gen_trace(CPUArchState *env, TranslationBlock *tb);
 void cpu_exec_init(CPUArchState *env);
 void QEMU_NORETURN cpu_loop_exit(CPUArchState *env1);
 int page_unprotect(target_ulong address, uintptr_t pc, void *puc);
@@ -105,6 +106,8 @@ void tlb_flush(CPUArchState *env, int flush_global);
 void tlb_set_page(CPUArchState *env, target_ulong vaddr,
                   hwaddr paddr, int prot,
                   int mmu_idx, target_ulong size);
+bool tlb_victim_hit(CPUArchState *env, int mmu_idx, int index,
+                    size_t elt_ofs, target_ulong addr);
 void tb_invalidate_phys_addr(hwaddr addr);
 #else
 static inline void tlb_flush_page(CPUArchState *env, target_ulong addr)
@@ -154,9 +157,10 @@ struct TranslationBlock {
     uint64_t flags; /* flags defining in which context the code was generated */
     uint16_t size;      /* size of target code for this block (1 <=
                            size <= TARGET_PAGE_SIZE) */
-    uint16_t cflags;    /* compile flags */
+    uint32_t cflags;    /* compile flags */
 #define CF_COUNT_MASK  0x7fff
 #define CF_LAST_IO     0x8000 /* Last insn may be an IO access.  */
+#define CF_TRACE      0x10000 /* Follow the branches, see tb_gen_trace().  */
 
     uint8_t *tc_ptr;    /* pointer to the translated code */
     /* next matching tb for physical address. */
@@ -181,9 +185,25 @@ struct TranslationBlock {
     struct TranslationBlock *jmp_next[2];
     struct TranslationBlock *jmp_first;
     uint32_t icount;
+    /* number of executions, counted by the generated code until the TB
+       becomes hot, see tb_trace_threshold */
+    uint32_t exec_count;
 };
 
 #include "exec/spinlock.h"
+#include "qemu/bitops.h"
+
+/* The translated code buffer is split into regions that are filled in
+   turn. When the current region is full, the next one is evicted, i.e.
+   only its TBs are invalidated, instead of flushing the whole buffer. */
+#define TB_MAX_REGIONS 8
+
+typedef struct TBRegion {
+    uint8_t *code_start;
+    uint8_t *code_ptr;       /* end of the generated code */
+    TranslationBlock *tbs;   /* sorted by tc_ptr, for tb_find_pc() */
+    int nb_tbs;
+} TBRegion;
 
 typedef struct TBContext TBContext;
 
@@ -195,9 +215,21 @@ struct TBContext {
     /* any access to the tbs or the page table must use this lock */
     spinlock_t tb_lock;
 
+    TBRegion regions[TB_MAX_REGIONS];
+    int nb_regions;
+    int cur_region;
+    size_t region_size;
+    int region_max_blocks;
+
     /* statistics */
     int tb_flush_count;
     int tb_phys_invalidate_count;
+    int tb_region_evict_count;
+    int tb_evicted_count;
+    int tb_retranslate_count;
+    int tb_trace_count;
+    /* physical PCs of the evicted TBs, by tb_phys_hash_func() */
+    unsigned long tb_evicted_map[BITS_TO_LONGS(CODE_GEN_PHYS_HASH_SIZE)];
 
     int tb_invalidated_flag;
 };
@@ -231,6 +263,9 @@ void tb_invalidate_phys_page_fast0(hwaddr start, int len);
 
 extern uint8_t *code_gen_ptr;
 extern int code_gen_max_blocks;
+/* number of executions after which a TB is translated again as a trace,
+   0 if disabled (the default), see tb_set_trace_threshold() */
+extern unsigned int tb_trace_threshold;
 
 #if defined(USE_DIRECT_JUMP)
 
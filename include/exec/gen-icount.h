@@ -48,6 +48,33 @@ static void gen_icount_end(TranslationBlock *tb, int num_insns)
     }
 }
 
+/* Count the executions of 'tb' until cpu_exec() finds it hot. Nothing is
+   generated unless traces are enabled with -tb-trace. Must follow
+   gen_icount_start().
+
+   A TB that is chained to itself or to other TBs may never go back to
+   cpu_exec(), so the TB exits through exitreq_label, before its first
+   instruction, when it becomes hot. cpu_exec() then restores the PC and
+   looks the TB up again, which replaces it with a trace.  */
+static inline void gen_tb_count(TranslationBlock *tb)
+{
+    TCGv_ptr ptr;
+    TCGv_i32 count;
+
+    if (!tb_trace_threshold || tb->cflags || use_icount) {
+        return;
+    }
+    ptr = tcg_const_ptr(&tb->exec_count);
+    count = tcg_temp_new_i32();
+    tcg_gen_ld_i32(count, ptr, 0);
+    tcg_gen_addi_i32(count, count, 1);
+    tcg_gen_st_i32(count, ptr, 0);
+    tcg_temp_free_ptr(ptr);
+    tcg_gen_brcondi_i32(TCG_COND_EQ, count, tb_trace_threshold,
+                        exitreq_label);
+    tcg_temp_free_i32(count);
+}
+
 static inline void gen_io_start(void)
 {
     TCGv_i32 tmp = tcg_const_i32(1);
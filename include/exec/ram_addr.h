@@ -39,6 +39,21 @@ int qemu_ram_addr_from_host(void *ptr, ram_addr_t *ram_addr);
 void qemu_ram_free(ram_addr_t addr);
 void qemu_ram_remap(ram_addr_t addr, ram_addr_t length);
 ram_addr_t qemu_ram_addr_from_host_nofail(void *ptr);
+ram_addr_t last_ram_offset(void);
+
+/* Lazy snapshot restore, see arch_init.c. While ram_lazy_active is true,
+ * some guest pages have not been loaded yet, and must be fetched before
+ * their host memory is accessed. qemu_get_ram_ptr() does this for the
+ * page it returns. */
+extern bool ram_lazy_active;
+void ram_lazy_fetch_range(ram_addr_t start, ram_addr_t length);
+
+static inline void ram_lazy_fetch(ram_addr_t start, ram_addr_t length)
+{
+    if (unlikely(ram_lazy_active)) {
+        ram_lazy_fetch_range(start, length);
+    }
+}
 
 static inline int cpu_physical_memory_get_dirty(ram_addr_t start,
                                                 ram_addr_t length,
@@ -51,14 +51,27 @@
  *
  * 4/ Call goldfish_pipe_signal() to signal a change of state to the pipe.
  *
+ * 5/ Optionally, call goldfish_pipe_borrow_buffers() from sendBuffers() or
+ *    recvBuffers() to complete a guest operation asynchronously, then call
+ *    goldfish_pipe_complete() once done.
+ *
  */
 
-/* Buffer descriptor for sendBuffers() and recvBuffers() callbacks */
+/* Buffer descriptor for sendBuffers() and recvBuffers() callbacks.
+ *
+ * The descriptors point directly into guest memory, with one descriptor per
+ * contiguous run of the guest buffer, so services should not need to copy
+ * the data before using it. The guest pages are only mapped for the duration
+ * of the callback, unless the service borrows them, see below.
+ */
 typedef struct GoldfishPipeBuffer {
     uint8_t*  data;
     size_t    size;
 } GoldfishPipeBuffer;
 
+/* Opaque handle to a guest operation borrowed by a pipe service */
+typedef struct GoldfishPipeTransfer  GoldfishPipeTransfer;
+
 /* Pipe handler funcs */
 typedef struct {
     /* Create new client connection, 'hwpipe' must be passed to other
@@ -138,6 +151,25 @@ extern void goldfish_pipe_close( void* hwpipe );
  */
 extern void goldfish_pipe_wake( void* hwpipe, unsigned flags );
 
+/* Call this from sendBuffers() or recvBuffers() to keep using the guest
+ * buffers after the callback returns, which must then return
+ * PIPE_ERROR_PENDING. The 'buffers' array passed to the callback, and the
+ * guest pages it points to, remain valid until goldfish_pipe_complete() is
+ * called or the pipe's 'close' callback runs, whichever comes first.
+ *
+ * Returns NULL if the operation cannot complete asynchronously, i.e. the
+ * guest didn't submit it with PIPE_ACCESS_FLAG_ASYNC. In this case, the
+ * callback must return a final status as usual.
+ */
+extern GoldfishPipeTransfer* goldfish_pipe_borrow_buffers( void* hwpipe );
+
+/* Completes a borrowed operation. 'status' is what sendBuffers() or
+ * recvBuffers() would have returned. This writes the result to the guest and
+ * wakes it up with PIPE_WAKE_COMPLETE. Must not be called after the pipe's
+ * 'close' callback.
+ */
+extern void goldfish_pipe_complete( GoldfishPipeTransfer* transfer, int status );
+
 /* The following definitions must match those under:
  *
  *    $KERNEL/drivers/misc/qemupipe/qemu_pipe.c
@@ -162,6 +194,29 @@ extern void goldfish_pipe_wake( void* hwpipe, unsigned flags );
 #define PIPE_REG_CHANNEL_HIGH        0x30 /* read/write: high 32 bit channel id */
 #define PIPE_REG_ADDRESS_HIGH        0x34 /* write: high 32 bit physical address */
 
+/* Used by the version 2 protocol of the upstream goldfish_pipe driver, which
+ * writes its version there and reads back the device's. This device only
+ * implements the protocol above, so reads return 0 and writes are ignored.
+ */
+#define PIPE_REG_VERSION             0x24
+
+/* The following are emulator extensions, which guest drivers can probe for
+ * by reading PIPE_REG_ACCESS_PARAMS_BATCH, which returns 0 on emulators
+ * that don't support them.
+ */
+
+/* write: run a batch of 'value' access_params entries, stored consecutively
+ * at the parameter buffer address. Only PIPE_CMD_READ_BUFFER and
+ * PIPE_CMD_WRITE_BUFFER entries are run, the others are skipped and their
+ * result left untouched. Each result is written back as soon as its entry
+ * has run. PIPE_REG_STATUS is then set to the number of entries that were
+ * processed.
+ * read: maximum number of entries per batch.
+ */
+#define PIPE_REG_ACCESS_PARAMS_BATCH 0x38
+
+#define PIPE_BATCH_MAX               64
+
 /* list of commands for PIPE_REG_COMMAND */
 #define PIPE_CMD_OPEN               1  /* open new channel */
 #define PIPE_CMD_CLOSE              2  /* close channel (from guest) */
@@ -189,11 +244,18 @@ extern void goldfish_pipe_wake( void* hwpipe, unsigned flags );
 #define PIPE_ERROR_AGAIN       -2
 #define PIPE_ERROR_NOMEM       -3
 #define PIPE_ERROR_IO          -4
+/* Emulator extension: the operation will complete asynchronously, its result
+ * is written to the access_params entry before PIPE_WAKE_COMPLETE is sent */
+#define PIPE_ERROR_PENDING     -5
 
 /* Bit-flags used to signal events from the emulator */
 #define PIPE_WAKE_CLOSED       (1 << 0)  /* emulator closed pipe */
 #define PIPE_WAKE_READ         (1 << 1)  /* pipe can now be read from */
 #define PIPE_WAKE_WRITE        (1 << 2)  /* pipe can now be written to */
+#define PIPE_WAKE_COMPLETE     (1 << 3)  /* pending operation completed */
+
+/* Bit-flags for the 'flags' field of access_params entries */
+#define PIPE_ACCESS_FLAG_ASYNC (1 << 0)  /* may return PIPE_ERROR_PENDING */
 
 void pipe_dev_init(bool newDeviceNaming);
 
@@ -203,7 +265,7 @@ struct access_params{
     uint32_t address;
     uint32_t cmd;
     uint32_t result;
-    /* reserved for future extension */
+    /* PIPE_ACCESS_FLAG_XXX */
     uint32_t flags;
 };
 
@@ -213,7 +275,7 @@ struct access_params_64 {
     uint64_t address;
     uint32_t cmd;
     uint32_t result;
-    /* reserved for future extension */
+    /* PIPE_ACCESS_FLAG_XXX */
     uint32_t flags;
 };
 
@@ -109,4 +109,13 @@ uint64_t ram_bytes_total(void);
 int ram_save_live(QEMUFile *f, int stage, void *opaque);
 int ram_load(QEMUFile *f, void *opaque, int version_id);
 
+/* Loads all guest pages that a lazy snapshot restore has not loaded yet.
+ * Must be called before the snapshot image is modified. Returns -EIO if
+ * some pages could not be loaded, now or earlier, see ram_load_failed(). */
+int ram_lazy_fetch_all(void);
+
+/* Returns true if a lazy snapshot restore could not load some guest pages.
+ * Guest memory is then incomplete until another snapshot is loaded. */
+bool ram_load_failed(void);
+
 #endif
@@ -116,6 +116,9 @@ QEMUFile *qemu_popen_cmd(const char *command, const char *mode);
 int qemu_get_fd(QEMUFile *f);
 int qemu_fclose(QEMUFile *f);
 int64_t qemu_ftell(QEMUFile *f);
+int64_t qemu_file_read_pos(QEMUFile *f);
+void qemu_file_skip_bytes(QEMUFile *f, int64_t size);
+BlockDriverState *qemu_file_get_bdrv(QEMUFile *f);
 void qemu_put_buffer(QEMUFile *f, const uint8_t *buf, int size);
 void qemu_put_byte(QEMUFile *f, int v);
 
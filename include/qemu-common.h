@@ -308,6 +308,20 @@ typedef struct PCIHostDeviceAddress {
 
 void cpu_exec_init_all(unsigned long tb_size);
 
+/* Set the number of entries of the softmmu TLBs, a power of 2 between
+   1 << CPU_TLB_MIN_BITS and CPU_TLB_MAX_SIZE. Must be called before the
+   CPUs are created. Returns 0 on success, -1 if 'size' is invalid.  */
+int tlb_set_size(unsigned int size);
+/* Print the TLB statistics of each CPU, which tlb_reset_stats() clears.  */
+void tlb_dump_stats(Monitor *mon);
+void tlb_reset_stats(void);
+/* Keep the translated code in the file at 'path' across runs. Must be
+   called after the CPUs are created. Returns 0 on success, -1 on error.  */
+int tb_cache_open(const char *path, const char *cpu_model);
+/* Translate again as a trace a TB executed 'count' times, 0 disables it.
+   Only supported by the ARM translator.  */
+void tb_set_trace_threshold(unsigned int count);
+
 /* CPU save/load.  */
 void cpu_save(QEMUFile *f, void *opaque);
 int cpu_load(QEMUFile *f, void *opaque, int version_id);
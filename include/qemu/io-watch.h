@@ -0,0 +1,71 @@
+/*
+ * QEMU persistent file descriptor watches
+ *
+ * Copyright (c) 2015 The Android Open Source Project
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2 or later.
+ * See the COPYING file in the top-level directory.
+ */
+#ifndef QEMU_IO_WATCH_H
+#define QEMU_IO_WATCH_H
+
+/* With select(), main_loop_wait() rebuilds its fd_sets from all the I/O
+ * handlers and slirp sockets on every iteration, then scans them all again
+ * to find the ready ones. Where the host supports it (CONFIG_EPOLL), the
+ * main loop instead keeps a persistent set of watches in the kernel: a
+ * watch is only updated when the events of interest for its descriptor
+ * change, and only the descriptors that are ready are dispatched. The
+ * events of interest are still recomputed by qemu_iohandler_fill() and
+ * slirp_select_fill(), which walk all the handlers and sockets, but that
+ * walk no longer makes any system call unless a watch changes.
+ *
+ * Descriptors that are still added to the fd_sets by qemu_iohandler_fill()
+ * and slirp_select_fill() callers are select()ed as before, together with
+ * the watch set itself.
+ */
+
+#define IO_WATCH_READ   1   /* like the select() readfds */
+#define IO_WATCH_WRITE  2   /* like the select() writefds */
+#define IO_WATCH_PRI    4   /* like the select() exceptfds, urgent data */
+
+/* Called from qemu_io_watch_dispatch() with the ready events of 'fd'. */
+typedef void IOWatchHandler(void *opaque, int fd, int events);
+
+/* Create the watch set. Returns 0 on success, or -1 if the host doesn't
+ * support it, in which case main_loop_wait() keeps using select(). */
+int qemu_io_watch_init(void);
+
+/* Returns 1 if the watch set is in use. */
+int qemu_io_watch_enabled(void);
+
+/* Watch 'fd' for 'events' (IO_WATCH_xxx flags) on behalf of 'opaque',
+ * replacing any previous watch of 'fd'. Only issues a system call when the
+ * events or the owner changed, so this can be called on every main loop
+ * iteration. An empty 'events' disables the watch until the next call.
+ * Returns 0 on success, or -1 if the caller must select() 'fd' instead,
+ * because the watch set isn't in use or can't watch it, e.g. a regular
+ * file. */
+int qemu_io_watch_set(int fd, int events, IOWatchHandler *handler,
+                      void *opaque);
+
+/* Remove the watch of 'fd', if it's still owned by 'opaque'. Must be
+ * called before closing 'fd'. */
+void qemu_io_watch_remove(int fd, void *opaque);
+
+/* Drop the 'events' of 'fd' that are pending dispatch in the current main
+ * loop iteration, like FD_CLR() on the select() result sets. */
+void qemu_io_watch_cancel(int fd, int events);
+
+/* Returns the descriptor of the watch set, which becomes readable when a
+ * watched descriptor is ready. */
+int qemu_io_watch_fd(void);
+
+/* Wait up to 'timeout' milliseconds for watched descriptors to become
+ * ready, and return their number, or -1 on error. */
+int qemu_io_watch_wait(int timeout);
+
+/* Call the handlers of the descriptors returned by the last
+ * qemu_io_watch_wait(). */
+void qemu_io_watch_dispatch(void);
+
+#endif /* QEMU_IO_WATCH_H */
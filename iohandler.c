@@ -25,6 +25,7 @@
 #include "config-host.h"
 #include "qemu-common.h"
 #include "sysemu/char.h"
+#include "qemu/io-watch.h"
 #include "qemu/queue.h"
 
 #ifndef _WIN32
@@ -59,6 +60,7 @@ int qemu_set_fd_handler2(int fd,
         QLIST_FOREACH(ioh, &io_handlers, next) {
             if (ioh->fd == fd) {
                 ioh->deleted = 1;
+                qemu_io_watch_remove(fd, ioh);
                 break;
             }
         }
@@ -88,25 +90,47 @@ int qemu_set_fd_handler(int fd,
     return qemu_set_fd_handler2(fd, NULL, fd_read, fd_write, opaque);
 }
 
+static void qemu_iohandler_event(void *opaque, int fd, int events)
+{
+    IOHandlerRecord *ioh = opaque;
+
+    if (!ioh->deleted && ioh->fd_read && (events & IO_WATCH_READ)) {
+        ioh->fd_read(ioh->opaque);
+    }
+    if (!ioh->deleted && ioh->fd_write && (events & IO_WATCH_WRITE)) {
+        ioh->fd_write(ioh->opaque);
+    }
+}
+
 void qemu_iohandler_fill(int *pnfds, fd_set *readfds, fd_set *writefds, fd_set *xfds)
 {
     IOHandlerRecord *ioh;
 
     QLIST_FOREACH(ioh, &io_handlers, next) {
+        int events = 0;
+
         if (ioh->deleted)
             continue;
         if (ioh->fd_read &&
             (!ioh->fd_read_poll ||
              ioh->fd_read_poll(ioh->opaque) != 0)) {
-            FD_SET(ioh->fd, readfds);
-            if (ioh->fd > *pnfds)
-                *pnfds = ioh->fd;
+            events |= IO_WATCH_READ;
         }
         if (ioh->fd_write) {
+            events |= IO_WATCH_WRITE;
+        }
+        if (qemu_io_watch_set(ioh->fd, events,
+                              qemu_iohandler_event, ioh) == 0) {
+            continue;
+        }
+        if (events & IO_WATCH_READ) {
+            FD_SET(ioh->fd, readfds);
+        }
+        if (events & IO_WATCH_WRITE) {
             FD_SET(ioh->fd, writefds);
-            if (ioh->fd > *pnfds)
-                *pnfds = ioh->fd;
         }
+        if (events && ioh->fd > *pnfds)
+            *pnfds = ioh->fd;
     }
 }
 
@@ -31,6 +31,7 @@
 #include "monitor/monitor.h"
 #include "net/net.h"
 #include "qemu-common.h"
+#include "qemu/io-watch.h"
 #include "qemu/sockets.h"
 #include "qemu/timer.h"
 #include "slirp-android/libslirp.h"
@@ -121,6 +122,8 @@ static int qemu_main_loop_event_init(void)
 
 int qemu_init_main_loop(void)
 {
+    /* Falls back to select() if not available. */
+    qemu_io_watch_init();
     return qemu_main_loop_event_init();
 }
 
@@ -259,19 +262,46 @@ void os_host_main_loop_wait(int *timeout)
 
 static void qemu_run_alarm_timer(void);  // forward
 
+/* Wait for the descriptors of the fd_sets, and for the watched ones. */
+static int main_loop_select(int nfds, fd_set *rfds, fd_set *wfds,
+                            fd_set *xfds, int timeout)
+{
+    struct timeval tv;
+    int ret, watch_fd;
+
+    if (qemu_io_watch_enabled() && nfds < 0) {
+        /* Everything is watched, the common case. */
+        return qemu_io_watch_wait(timeout);
+    }
+
+    tv.tv_sec = timeout / 1000;
+    tv.tv_usec = (timeout % 1000) * 1000;
+
+    if (!qemu_io_watch_enabled()) {
+        return select(nfds + 1, rfds, wfds, xfds, &tv);
+    }
+
+    watch_fd = qemu_io_watch_fd();
+    FD_SET(watch_fd, rfds);
+    ret = select(MAX(nfds, watch_fd) + 1, rfds, wfds, xfds, &tv);
+    if (ret > 0 && FD_ISSET(watch_fd, rfds)) {
+        int n = qemu_io_watch_wait(0);
+
+        FD_CLR(watch_fd, rfds);
+        ret += (n > 0 ? n : 0) - 1;
+    }
+    return ret;
+}
+
 void main_loop_wait(int timeout)
 {
     fd_set rfds, wfds, xfds;
     int ret, nfds;
-    struct timeval tv;
 
     qemu_bh_update_timeout(&timeout);
 
     os_host_main_loop_wait(&timeout);
 
-    tv.tv_sec = timeout / 1000;
-    tv.tv_usec = (timeout % 1000) * 1000;
-
     /* poll any events */
 
     /* XXX: separate device handlers from system ones */
@@ -285,8 +315,9 @@ void main_loop_wait(int timeout)
     }
 
     qemu_mutex_unlock_iothread();
-    ret = select(nfds + 1, &rfds, &wfds, &xfds, &tv);
+    ret = main_loop_select(nfds, &rfds, &wfds, &xfds, timeout);
     qemu_mutex_lock_iothread();
+    qemu_io_watch_dispatch();
     qemu_iohandler_poll(&rfds, &wfds, &xfds, ret);
     if (slirp_is_inited()) {
         if (ret < 0) {
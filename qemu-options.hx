@@ -1635,6 +1635,37 @@ DEF("tb-size", HAS_ARG, QEMU_OPTION_tb_size, \
 STEXI
 ETEXI
 
+DEF("tb-cache", HAS_ARG, QEMU_OPTION_tb_cache, \
+    "-tb-cache file  keep the translated code in file across runs\n")
+STEXI
+@item -tb-cache @var{file}
+Store the code translated by TCG in @var{file}, a memory-mapped file of
+64 MB, and reuse it in the next runs instead of translating the same guest
+code again. The file is reset when the emulator or the CPU model change.
+Only supported on x86_64 Linux hosts.
+ETEXI
+
+DEF("tb-trace", HAS_ARG, QEMU_OPTION_tb_trace, \
+    "-tb-trace n     translate again as a trace a TB executed n times\n" \
+    "                (0 to disable, the default)\n")
+STEXI
+@item -tb-trace @var{n}
+Translate again the blocks of guest code executed @var{n} times as traces,
+which follow the forward branches of the code so that TCG optimizes the
+following blocks together. Traces are disabled by default, or with 0; 1000
+is a reasonable value to try. Only supported for ARM guests.
+ETEXI
+
+DEF("tlb-size", HAS_ARG, QEMU_OPTION_tlb_size, \
+    "-tlb-size n     set the number of softmmu TLB entries per MMU mode\n" \
+    "                (a power of 2, 64 to 4096, default 1024)\n")
+STEXI
+@item -tlb-size @var{n}
+Set the number of entries of the direct-mapped software TLB of each MMU
+mode of the emulated CPUs. Larger TLBs miss less often with large guest
+working sets, but are slower to flush.
+ETEXI
+
 DEF("incoming", HAS_ARG, QEMU_OPTION_incoming, \
     "-incoming p     prepare for incoming migration, listen on port p\n")
 STEXI
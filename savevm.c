@@ -615,6 +615,13 @@ static const QEMUFileOps bdrv_write_ops = {
     .close          = bdrv_fclose
 };
 
+/* Returns the block device a file reads its data from, if the file was
+ * opened with qemu_fopen_bdrv() for reading, or NULL. */
+BlockDriverState *qemu_file_get_bdrv(QEMUFile *f)
+{
+    return (f->ops == &bdrv_read_ops) ? f->opaque : NULL;
+}
+
 static QEMUFile *qemu_fopen_bdrv(BlockDriverState *bs, int is_writable)
 {
     if (is_writable)
@@ -904,6 +911,27 @@ static void qemu_file_skip(QEMUFile *f, int size)
     }
 }
 
+/* Returns the stream position of the next byte to be read from |f| */
+int64_t qemu_file_read_pos(QEMUFile *f)
+{
+    return f->pos - (f->buf_size - f->buf_index);
+}
+
+/* Skips |size| bytes of a file opened with qemu_fopen_bdrv() for reading,
+ * without reading them. */
+void qemu_file_skip_bytes(QEMUFile *f, int64_t size)
+{
+    int pending = f->buf_size - f->buf_index;
+
+    if (size <= pending) {
+        f->buf_index += size;
+        return;
+    }
+    f->pos += size - pending;
+    f->buf_index = 0;
+    f->buf_size = 0;
+}
+
 static int qemu_peek_buffer(QEMUFile *f, uint8_t *buf, int size, size_t offset)
 {
     int pending;
@@ -2061,6 +2089,13 @@ int qemu_savevm_state_begin(QEMUFile *f)
 {
     SaveStateEntry *se;
 
+    /* Saving reads all of guest RAM, and may overwrite the image that a
+     * lazy restore is still reading from. */
+    if (ram_lazy_fetch_all() < 0) {
+        qemu_file_set_error(f, -EIO);
+        return -EIO;
+    }
+
     qemu_put_be32(f, QEMU_VM_FILE_MAGIC);
     qemu_put_be32(f, QEMU_VM_FILE_VERSION);
 
@@ -2600,6 +2635,10 @@ void do_loadvm(Monitor *err, const char *name)
     saved_vm_running = vm_running;
     vm_stop(0);
 
+    /* Activating another snapshot changes the VM state that a lazy restore
+     * is still reading from. */
+    ram_lazy_fetch_all();
+
     bs1 = bs;
     do {
         if (bdrv_can_snapshot(bs1)) {
@@ -34,7 +34,6 @@ extern int slirp_restrict;
 extern char *slirp_tty;
 extern char *exec_shell;
 extern u_int curtime;
-extern fd_set *global_readfds, *global_writefds, *global_xfds;
 extern uint32_t ctl_addr_ip;
 extern uint32_t special_addr_ip;
 extern uint32_t alias_addr_ip;
@@ -58,3 +57,4 @@ extern int slirp_restrict;
 
 void if_encap(const uint8_t *ip_data, int ip_data_len);
 ssize_t slirp_send(struct socket *so, const void *buf, size_t len, int flags);
+void slirp_socket_event(struct socket *so, int events);
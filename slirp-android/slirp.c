@@ -26,6 +26,7 @@
 #include "slirp.h"
 #include "proxy_common.h"
 #include "hw/hw.h"
+#include "qemu/io-watch.h"
 
 #include "android/utils/debug.h"  /* for dprint */
 #include "android/utils/bufprint.h"
@@ -74,8 +75,8 @@ struct timeval tt;
 FILE *lfd;
 struct ex_list *exec_list;
 
-/* XXX: suppress those select globals */
-fd_set *global_readfds, *global_writefds, *global_xfds;
+/* number of sockets added to the fd_sets by the last slirp_select_fill() */
+static int selected_sockets;
 
 char slirp_hostname[33];
 
@@ -271,7 +272,6 @@ void slirp_init(int restricted, const char *special_ip)
 
 #define CONN_CANFSEND(so) (((so)->so_state & (SS_FCANTSENDMORE|SS_ISFCONNECTED)) == SS_ISFCONNECTED)
 #define CONN_CANFRCV(so) (((so)->so_state & (SS_FCANTRCVMORE|SS_ISFCONNECTED)) == SS_ISFCONNECTED)
-#define UPD_NFDS(x) if (nfds < (x)) nfds = (x)
 
 /*
  * curtime kept to an accuracy of 1ms
@@ -298,6 +298,28 @@ static void updtime(void)
 }
 #endif
 
+/*
+ * Watch the 'events' (IO_WATCH_*) of the host socket of 'so', or add
+ * it to the fd_sets if it can't be watched.
+ */
+static void
+slirp_select_socket(struct socket *so, int events, int *pnfds,
+                    fd_set *readfds, fd_set *writefds, fd_set *xfds)
+{
+	if (sowatch(so, events) == 0 || events == 0)
+		return;
+
+	if (events & IO_WATCH_READ)
+		FD_SET(so->s, readfds);
+	if (events & IO_WATCH_WRITE)
+		FD_SET(so->s, writefds);
+	if (events & IO_WATCH_PRI)
+		FD_SET(so->s, xfds);
+	if (*pnfds < so->s)
+		*pnfds = so->s;
+	selected_sockets++;
+}
+
 void slirp_select_fill(int *pnfds,
                        fd_set *readfds, fd_set *writefds, fd_set *xfds)
 {
@@ -306,10 +328,7 @@ void slirp_select_fill(int *pnfds,
     int nfds;
     int tmp_time;
 
-    /* fail safe */
-    global_readfds = NULL;
-    global_writefds = NULL;
-    global_xfds = NULL;
+    selected_sockets = 0;
 
     nfds = *pnfds;
 	/*
@@ -325,6 +344,8 @@ void slirp_select_fill(int *pnfds,
                 (&ipq.ip_link != ipq.ip_link.next));
 
 		for (so = tcb.so_next; so != &tcb; so = so_next) {
+			int events = 0;
+
 			so_next = so->so_next;
 
 			/*
@@ -336,67 +357,53 @@ void slirp_select_fill(int *pnfds,
 			/*
 			 * NOFDREF can include still connecting to local-host,
 			 * newly socreated() sockets etc. Don't want to select these.
+			 * Don't register proxified socket connections here either.
 	 		 */
-			if (so->so_state & SS_NOFDREF || so->s == -1)
-			   continue;
-
-            /*
-             * don't register proxified socked connections here
-             */
-            if ((so->so_state & SS_PROXIFIED) != 0)
-	            continue;
+			if (so->so_state & (SS_NOFDREF|SS_PROXIFIED) || so->s == -1)
+			   events = 0;
 
 			/*
 			 * Set for reading sockets which are accepting
 			 */
-			if (so->so_state & SS_FACCEPTCONN) {
-                                FD_SET(so->s, readfds);
-				UPD_NFDS(so->s);
-				continue;
-			}
+			else if (so->so_state & SS_FACCEPTCONN)
+			   events = IO_WATCH_READ;
 
 			/*
 			 * Set for writing sockets which are connecting
 			 */
-			if (so->so_state & SS_ISFCONNECTING) {
-				FD_SET(so->s, writefds);
-				UPD_NFDS(so->s);
-				continue;
-			}
+			else if (so->so_state & SS_ISFCONNECTING)
+			   events = IO_WATCH_WRITE;
 
-			/*
-			 * Set for writing if we are connected, can send more, and
-			 * we have something to send
-			 */
-			if (CONN_CANFSEND(so) && so->so_rcv.sb_cc) {
-				FD_SET(so->s, writefds);
-				UPD_NFDS(so->s);
-			}
+			else {
+				/*
+				 * Set for writing if we are connected, can send more, and
+				 * we have something to send
+				 */
+				if (CONN_CANFSEND(so) && so->so_rcv.sb_cc)
+				   events |= IO_WATCH_WRITE;
 
-			/*
-			 * Set for reading (and urgent data) if we are connected, can
-			 * receive more, and we have room for it XXX /2 ?
-			 */
-			if (CONN_CANFRCV(so) && (so->so_snd.sb_cc < (so->so_snd.sb_datalen/2))) {
-				FD_SET(so->s, readfds);
-				FD_SET(so->s, xfds);
-				UPD_NFDS(so->s);
+				/*
+				 * Set for reading (and urgent data) if we are connected, can
+				 * receive more, and we have room for it XXX /2 ?
+				 */
+				if (CONN_CANFRCV(so) && (so->so_snd.sb_cc < (so->so_snd.sb_datalen/2)))
+				   events |= IO_WATCH_READ|IO_WATCH_PRI;
 			}
+			slirp_select_socket(so, events, &nfds, readfds, writefds, xfds);
 		}
 
 		/*
 		 * UDP sockets
 		 */
 		for (so = udb.so_next; so != &udb; so = so_next) {
-			so_next = so->so_next;
+			int events = 0;
 
-            if ((so->so_state & SS_PROXIFIED) != 0)
-                continue;
+			so_next = so->so_next;
 
 			/*
 			 * See if it's timed out
 			 */
-			if (so->so_expire) {
+			if (so->so_expire && !(so->so_state & SS_PROXIFIED)) {
 				if (so->so_expire <= curtime) {
 					udp_detach(so);
 					continue;
@@ -414,11 +421,20 @@ void slirp_select_fill(int *pnfds,
 			 * if the packets needed to be fragmented
 			 * (XXX <= 4 ?)
 			 */
-			if ((so->so_state & SS_ISFCONNECTED) && so->so_queued <= 4) {
-				FD_SET(so->s, readfds);
-				UPD_NFDS(so->s);
-			}
+			if ((so->so_state & SS_ISFCONNECTED) && so->so_queued <= 4 &&
+			    !(so->so_state & SS_PROXIFIED))
+				events = IO_WATCH_READ;
+
+			slirp_select_socket(so, events, &nfds, readfds, writefds, xfds);
 		}
+	} else {
+		/*
+		 * Don't leave the watches of the sockets active
+		 */
+		for (so = tcb.so_next; so != &tcb; so = so->so_next)
+			sowatch(so, 0);
+		for (so = udb.so_next; so != &udb; so = so->so_next)
+			sowatch(so, 0);
 	}
 
 	/*
@@ -462,14 +478,134 @@ void slirp_select_fill(int *pnfds,
         *pnfds = nfds;
 }
 
+/*
+ * Process the ready events of a TCP socket, in so->so_revents
+ */
+static void
+slirp_poll_tcp(struct socket *so)
+{
+	int ret;
+
+	/*
+	 * Check for URG data
+	 * This will soread as well, so no need to
+	 * test for readfds below if this succeeds
+	 */
+	if (so->so_revents & IO_WATCH_PRI)
+	   sorecvoob(so);
+	/*
+	 * Check sockets for reading
+	 */
+	else if (so->so_revents & IO_WATCH_READ) {
+		/*
+		 * Check for incoming connections
+		 */
+		if (so->so_state & SS_FACCEPTCONN) {
+			tcp_connect(so);
+			return;
+		} /* else */
+		ret = soread(so);
+
+		/* Output it if we read something */
+		if (ret > 0)
+		   tcp_output(sototcpcb(so));
+	}
+
+	/*
+	 * Check sockets for writing
+	 */
+	if (so->so_revents & IO_WATCH_WRITE) {
+	  /*
+	   * Check for non-blocking, still-connecting sockets
+	   */
+	  if (so->so_state & SS_ISFCONNECTING) {
+	    /* Connected */
+	    so->so_state &= ~SS_ISFCONNECTING;
+
+	    ret = socket_send(so->s, (const void *)&ret, 0);
+	    if (ret < 0) {
+	      /* XXXXX Must fix, zero bytes is a NOP */
+	      if (errno == EAGAIN || errno == EWOULDBLOCK ||
+		  errno == EINPROGRESS || errno == ENOTCONN)
+		return;
+
+	      /* else failed */
+	      so->so_state = SS_NOFDREF;
+	    }
+	    /* else so->so_state &= ~SS_ISFCONNECTING; */
+
+	    /*
+	     * Continue tcp_input
+	     */
+	    tcp_input((struct mbuf *)NULL, sizeof(struct ip), so);
+	    /* continue; */
+	  } else
+	    ret = sowrite(so);
+	  /*
+	   * XXXXX If we wrote something (a lot), there
+	   * could be a need for a window update.
+	   * In the worst case, the remote will send
+	   * a window probe to get things going again
+	   */
+	}
+
+	/*
+	 * Probe a still-connecting, non-blocking socket
+	 * to check if it's still alive
+	 */
+#ifdef PROBE_CONN
+	if (so->so_state & SS_ISFCONNECTING) {
+	  ret = socket_recv(so->s, (char *)&ret, 0);
+
+	  if (ret < 0) {
+	    /* XXX */
+	    if (errno == EAGAIN || errno == EWOULDBLOCK ||
+		errno == EINPROGRESS || errno == ENOTCONN)
+	      return; /* Still connecting, continue */
+
+	    /* else failed */
+	    so->so_state = SS_NOFDREF;
+
+	    /* tcp_input will take care of it */
+	  } else {
+	    ret = socket_send(so->s, &ret, 0);
+	    if (ret < 0) {
+	      /* XXX */
+	      if (errno == EAGAIN || errno == EWOULDBLOCK ||
+		  errno == EINPROGRESS || errno == ENOTCONN)
+		return;
+	      /* else failed */
+	      so->so_state = SS_NOFDREF;
+	    } else
+	      so->so_state &= ~SS_ISFCONNECTING;
+
+	  }
+	  tcp_input((struct mbuf *)NULL, sizeof(struct ip),so);
+	} /* SS_ISFCONNECTING */
+#endif
+}
+
+/*
+ * Called by the main loop when a watched socket is ready, see sowatch()
+ */
+void
+slirp_socket_event(struct socket *so, int events)
+{
+	if (!link_up)
+		return;
+
+	updtime();
+	so->so_revents = events;
+	if (so->so_tcpcb) {
+		slirp_poll_tcp(so);
+	} else if (events & IO_WATCH_READ) {
+		sorecvfrom(so);
+	}
+}
+
 void slirp_select_poll(fd_set *readfds, fd_set *writefds, fd_set *xfds)
 {
     struct socket *so, *so_next;
-    int ret;
-
-    global_readfds = readfds;
-    global_writefds = writefds;
-    global_xfds = xfds;
 
 	/* Update time */
 	updtime();
@@ -490,9 +626,10 @@ void slirp_select_poll(fd_set *readfds, fd_set *writefds, fd_set *xfds)
 	}
 
 	/*
-	 * Check sockets
+	 * Check sockets. Only those that were select()ed, the watched ones
+	 * are processed by slirp_socket_event() as soon as they are ready.
 	 */
-	if (link_up) {
+	if (link_up && selected_sockets) {
 		/*
 		 * Check TCP sockets
 		 */
@@ -513,103 +650,14 @@ void slirp_select_poll(fd_set *readfds, fd_set *writefds, fd_set *xfds)
             if ((so->so_state & SS_PROXIFIED) != 0)
                 continue;
 
-			/*
-			 * Check for URG data
-			 * This will soread as well, so no need to
-			 * test for readfds below if this succeeds
-			 */
+			so->so_revents = 0;
 			if (FD_ISSET(so->s, xfds))
-			   sorecvoob(so);
-			/*
-			 * Check sockets for reading
-			 */
-			else if (FD_ISSET(so->s, readfds)) {
-				/*
-				 * Check for incoming connections
-				 */
-				if (so->so_state & SS_FACCEPTCONN) {
-					tcp_connect(so);
-					continue;
-				} /* else */
-				ret = soread(so);
-
-				/* Output it if we read something */
-				if (ret > 0)
-				   tcp_output(sototcpcb(so));
-			}
-
-			/*
-			 * Check sockets for writing
-			 */
-			if (FD_ISSET(so->s, writefds)) {
-			  /*
-			   * Check for non-blocking, still-connecting sockets
-			   */
-			  if (so->so_state & SS_ISFCONNECTING) {
-			    /* Connected */
-			    so->so_state &= ~SS_ISFCONNECTING;
-
-			    ret = socket_send(so->s, (const void *)&ret, 0);
-			    if (ret < 0) {
-			      /* XXXXX Must fix, zero bytes is a NOP */
-			      if (errno == EAGAIN || errno == EWOULDBLOCK ||
-				  errno == EINPROGRESS || errno == ENOTCONN)
-				continue;
-
-			      /* else failed */
-			      so->so_state = SS_NOFDREF;
-			    }
-			    /* else so->so_state &= ~SS_ISFCONNECTING; */
-
-			    /*
-			     * Continue tcp_input
-			     */
-			    tcp_input((struct mbuf *)NULL, sizeof(struct ip), so);
-			    /* continue; */
-			  } else
-			    ret = sowrite(so);
-			  /*
-			   * XXXXX If we wrote something (a lot), there
-			   * could be a need for a window update.
-			   * In the worst case, the remote will send
-			   * a window probe to get things going again
-			   */
-			}
-
-			/*
-			 * Probe a still-connecting, non-blocking socket
-			 * to check if it's still alive
-	 	 	 */
-#ifdef PROBE_CONN
-			if (so->so_state & SS_ISFCONNECTING) {
-			  ret = socket_recv(so->s, (char *)&ret, 0);
-
-			  if (ret < 0) {
-			    /* XXX */
-			    if (errno == EAGAIN || errno == EWOULDBLOCK ||
-				errno == EINPROGRESS || errno == ENOTCONN)
-			      continue; /* Still connecting, continue */
-
-			    /* else failed */
-			    so->so_state = SS_NOFDREF;
-
-			    /* tcp_input will take care of it */
-			  } else {
-			    ret = socket_send(so->s, &ret, 0);
-			    if (ret < 0) {
-			      /* XXX */
-			      if (errno == EAGAIN || errno == EWOULDBLOCK ||
-				  errno == EINPROGRESS || errno == ENOTCONN)
-				continue;
-			      /* else failed */
-			      so->so_state = SS_NOFDREF;
-			    } else
-			      so->so_state &= ~SS_ISFCONNECTING;
-
-			  }
-			  tcp_input((struct mbuf *)NULL, sizeof(struct ip),so);
-			} /* SS_ISFCONNECTING */
-#endif
+			   so->so_revents |= IO_WATCH_PRI;
+			if (FD_ISSET(so->s, readfds))
+			   so->so_revents |= IO_WATCH_READ;
+			if (FD_ISSET(so->s, writefds))
+			   so->so_revents |= IO_WATCH_WRITE;
+			slirp_poll_tcp(so);
 		}
 
 		/*
@@ -639,15 +687,6 @@ void slirp_select_poll(fd_set *readfds, fd_set *writefds, fd_set *xfds)
 	 */
 	if (if_queued && link_up)
 	   if_start();
-
-	/* clear global file descriptor sets.
-	 * these reside on the stack in vl.c
-	 * so they're unusable if we're not in
-	 * slirp_select_fill or slirp_select_poll.
-	 */
-	 global_readfds = NULL;
-	 global_writefds = NULL;
-	 global_xfds = NULL;
 }
 
 #define ETH_ALEN 6
@@ -1166,6 +1205,7 @@ int slirp_redir_rm(int is_udp, int host_port)
  loop_again:
     for (so = head->so_next; so != head; so = so->so_next) {
         if (so->so_faddr_port == host_port) {
+            sounwatch(so);
             close(so->s);
             sofree(so);
             n++;
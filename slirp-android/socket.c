@@ -16,6 +16,7 @@
 #define  SLIRP_COMPILATION 1
 #include "android/sockets.h"
 #include "proxy_common.h"
+#include "qemu/io-watch.h"
 
 static void sofcantrcvmore(struct socket *so);
 static void sofcantsendmore(struct socket *so);
@@ -63,10 +64,45 @@ socreate(void)
     memset(so, 0, sizeof(struct socket));
     so->so_state = SS_NOFDREF;
     so->s = -1;
+    so->so_watch_fd = -1;
   }
   return(so);
 }
 
+static void
+so_watch_event(void *opaque, int fd, int events)
+{
+  slirp_socket_event((struct socket *)opaque, events);
+}
+
+/*
+ * Set the events the main loop watches on the socket, see
+ * slirp_select_fill(). Returns 0 on success, or -1 if the socket
+ * must be select()ed instead.
+ */
+int
+sowatch(struct socket *so, int events)
+{
+  if (so->so_watch_fd != so->s)	/* e.g. replaced by tcp_connect() */
+    sounwatch(so);
+  if (so->s < 0)
+    return 0;
+  so->so_watch_fd = so->s;
+  return qemu_io_watch_set(so->s, events, so_watch_event, so);
+}
+
+/*
+ * Stop watching the socket. Must be called before closing it.
+ */
+void
+sounwatch(struct socket *so)
+{
+  if (so->so_watch_fd >= 0) {
+    qemu_io_watch_remove(so->so_watch_fd, so);
+    so->so_watch_fd = -1;
+  }
+}
+
 /*
  * remque and free a socket, clobber cache
  */
@@ -76,6 +112,8 @@ sofree(struct socket *so)
   if (so->so_state & SS_PROXIFIED)
     proxy_manager_del(so);
 
+  sounwatch(so);
+
   if (so->so_emu==EMU_RSH && so->extra) {
 	sofree(so->extra);
 	so->extra=NULL;
@@ -688,6 +726,7 @@ sounlisten(u_int  port)
 
     sofcantrcvmore( so );
     sofcantsendmore( so );
+    sounwatch( so );
     close( so->s );
     so->s = -1;
     sofree( so );
@@ -748,9 +787,8 @@ sofcantrcvmore(struct socket *so)
 {
 	if ((so->so_state & SS_NOFDREF) == 0) {
 		shutdown(so->s,0);
-		if(global_writefds) {
-		  FD_CLR(so->s,global_writefds);
-		}
+		so->so_revents &= ~IO_WATCH_WRITE;
+		qemu_io_watch_cancel(so->s, IO_WATCH_WRITE);
 	}
 	so->so_state &= ~(SS_ISFCONNECTING);
 	if (so->so_state & SS_FCANTSENDMORE)
@@ -764,12 +802,8 @@ sofcantsendmore(struct socket *so)
 {
 	if ((so->so_state & SS_NOFDREF) == 0) {
             shutdown(so->s,1);           /* send FIN to fhost */
-            if (global_readfds) {
-                FD_CLR(so->s,global_readfds);
-            }
-            if (global_xfds) {
-                FD_CLR(so->s,global_xfds);
-            }
+            so->so_revents &= ~(IO_WATCH_READ|IO_WATCH_PRI);
+            qemu_io_watch_cancel(so->s, IO_WATCH_READ|IO_WATCH_PRI);
 	}
 	so->so_state &= ~(SS_ISFCONNECTING);
 	if (so->so_state & SS_FCANTRCVMORE)
@@ -52,6 +52,9 @@ struct socket {
   struct sbuf so_rcv;		/* Receive buffer */
   struct sbuf so_snd;		/* Send buffer */
   void * extra;			/* Extra pointer */
+
+  int	so_watch_fd;		/* Socket watched by the main loop, or -1 */
+  int	so_revents;		/* IO_WATCH_* events being processed */
 };
 
 
@@ -80,6 +83,8 @@ void so_init _P((void));
 struct socket * solookup _P((struct socket *, uint32_t, u_int, uint32_t, u_int));
 struct socket * socreate _P((void));
 void sofree _P((struct socket *));
+int sowatch _P((struct socket *, int));
+void sounwatch _P((struct socket *));
 int soread _P((struct socket *));
 void sorecvoob _P((struct socket *));
 int sosendoob _P((struct socket *));
@@ -280,6 +280,7 @@ tcp_close(struct tcpcb *tp)
 	/* clobber input socket cache if we're closing the cached connection */
 	if (so == tcp_last_so)
 		tcp_last_so = &tcb;
+	sounwatch(so);
 	socket_close(so->s);
 	sbfree(&so->so_rcv);
 	sbfree(&so->so_snd);
@@ -638,6 +639,7 @@ tcp_connect(struct socket *inso)
 
 	/* Close the accept() socket, set right state */
 	if (inso->so_state & SS_FACCEPTONCE) {
+		sounwatch(so);
 		socket_close(so->s); /* If we only accept once, close the accept() socket */
 		so->so_state = SS_NOFDREF; /* Don't select it yet, even though we have an FD */
 					   /* if it's not FACCEPTONCE, it's already NOFDREF */
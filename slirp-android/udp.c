@@ -406,6 +406,7 @@ udp_attach(struct socket *so)
 void
 udp_detach(struct socket *so)
 {
+	sounwatch(so);
 	socket_close(so->s);
 	/* if (so->so_m) m_free(so->so_m);    done by sofree */
 
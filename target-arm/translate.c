@@ -67,6 +67,10 @@ typedef struct DisasContext {
     int vfp_enabled;
     int vec_len;
     int vec_stride;
+    /* Nonzero when translating a trace, see gen_jmp().  */
+    int trace;
+    /* The goto_tb jump slots already used.  */
+    int goto_tb_mask;
 } DisasContext;
 
 static uint32_t gen_opc_condexec_bits[OPC_BUF_SIZE];
@@ -3508,7 +3512,13 @@ static inline void gen_goto_tb(DisasContext *s, int n, uint32_t dest)
     TranslationBlock *tb;
 
     tb = s->tb;
-    if ((tb->pc & TARGET_PAGE_MASK) == (dest & TARGET_PAGE_MASK)) {
+    /* A trace can have more exits than the TB has jump slots.  */
+    if (s->goto_tb_mask & (1 << n)) {
+        n ^= 1;
+    }
+    if ((tb->pc & TARGET_PAGE_MASK) == (dest & TARGET_PAGE_MASK) &&
+        !(s->goto_tb_mask & (1 << n))) {
+        s->goto_tb_mask |= 1 << n;
         tcg_gen_goto_tb(n);
         gen_set_pc_im(dest);
         tcg_gen_exit_tb((tcg_target_long)tb + n);
@@ -3525,6 +3535,19 @@ static inline void gen_jmp (DisasContext *s, uint32_t dest)
         if (s->thumb)
             dest |= 1;
         gen_bx_im(s, dest);
+    } else if (s->trace && dest > s->pc &&
+               (dest & TARGET_PAGE_MASK) == (s->tb->pc & TARGET_PAGE_MASK) &&
+               (s->condexec_mask & 0xf) == 0) {
+        /* Only forward branches within the page are followed, so that
+           the trace still covers [tb->pc, tb->pc + tb->size[ and has no
+           loop. Backward branches are likely to be loops and end it.  */
+        if (s->condjmp) {
+            /* Assume the branch is not taken: the taken path is a side
+               exit, and the translation goes on with the next insn.  */
+            gen_goto_tb(s, 0, dest);
+        } else {
+            s->pc = dest;
+        }
     } else {
         gen_goto_tb(s, 0, dest);
         s->is_jmp = DISAS_TB_JUMP;
@@ -9740,6 +9763,8 @@ static inline void gen_intermediate_code_internal(CPUARMState *env,
     dc->vfp_enabled = ARM_TBFLAG_VFPEN(tb->flags);
     dc->vec_len = ARM_TBFLAG_VECLEN(tb->flags);
     dc->vec_stride = ARM_TBFLAG_VECSTRIDE(tb->flags);
+    dc->trace = (tb->cflags & CF_TRACE) != 0;
+    dc->goto_tb_mask = 0;
     cpu_F0s = tcg_temp_new_i32();
     cpu_F1s = tcg_temp_new_i32();
     cpu_F0d = tcg_temp_new_i64();
@@ -9756,6 +9781,7 @@ static inline void gen_intermediate_code_internal(CPUARMState *env,
         max_insns = CF_COUNT_MASK;
 
     gen_icount_start();
+    gen_tb_count(tb);
 
     if (code_profile_record_func != NULL && code_profile_dirname != NULL)
         gen_profileBB(tb);
@@ -1946,7 +1946,7 @@ static uintptr_t v2p_mmu(CPUMIPSState *env, target_ulong addr, int is_user)
     uintptr_t physaddr;
     uintptr_t retaddr;
 
-    index = (addr >> TARGET_PAGE_BITS) & (CPU_TLB_SIZE - 1);
+    index = CPU_TLB_INDEX(env, addr);
 redo:
     tlb_addr = env->tlb_table[is_user][index].addr_read;
     if ((addr & TARGET_PAGE_MASK) == (tlb_addr & (TARGET_PAGE_MASK | TLB_INVALID_MASK))) {
@@ -1974,7 +1974,7 @@ uintptr_t v2p(target_ulong ptr, int is_user)
 
     env = cpu_single_env;
     addr = ptr;
-    index = (addr >> TARGET_PAGE_BITS) & (CPU_TLB_SIZE - 1);
+    index = CPU_TLB_INDEX(env, addr);
     if (__builtin_expect(env->tlb_table[is_user][index].addr_read !=
                 (addr & TARGET_PAGE_MASK), 0)) {
         physaddr = v2p_mmu(env, addr, is_user);
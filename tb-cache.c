@@ -0,0 +1,483 @@
+/*
+ * QEMU persistent translation cache
+ *
+ * Copyright (c) 2015 The Android Open Source Project
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2 or later.
+ * See the COPYING file in the top-level directory.
+ */
+
+/* Every boot translates the same kernel and framework code again. With
+ * -tb-cache, the host code of the translated blocks is also appended to a
+ * memory-mapped file, and tb_gen_code() looks there before translating a
+ * block, so that the blocks of a previous run are reused as they are first
+ * executed.
+ *
+ * An entry is keyed by the pc, cs_base and flags of its TB, and holds a
+ * copy of the guest code, which must match the current contents of the
+ * guest page, so that a page that was modified, or another process mapped
+ * at the same address, never reuses stale code. TBs that span two pages,
+ * or that are generated with special cflags, breakpoints or single
+ * stepping, are never cached.
+ *
+ * The generated code contains host addresses: calls to helpers, jumps to
+ * the prologue, the address of the TB itself and return addresses in its
+ * own code. The backend records them as TCGExtRefs, and they are stored
+ * relative to the emulator image, the TB, its code or the prologue, then
+ * relocated on load by tcg_patch_ext_ref(). An entry is only used if the
+ * backend would have generated exactly the same instructions at the new
+ * address, because cpu_restore_state() translates the TB again in place.
+ *
+ * The file depends on the emulator binary, on the emulated CPU and on the
+ * features of the host CPU, and is silently reset when any of them changes,
+ * or when the previous emulator didn't close it properly. Only one emulator
+ * can use it at a time: the others run without a cache.
+ */
+
+#include "config.h"
+#include "qemu-common.h"
+#include "cpu.h"
+#include "exec/exec-all.h"
+#include "exec/ram_addr.h"
+#include "tcg.h"
+#include "translate-all.h"
+
+#if defined(TCG_TARGET_HAS_EXT_REFS) && defined(USE_DIRECT_JUMP) && \
+    defined(CONFIG_LINUX) && !defined(CONFIG_USER_ONLY)
+#define USE_TB_CACHE
+#endif
+
+#ifdef USE_TB_CACHE
+
+#include <sys/file.h>
+#include <sys/mman.h>
+
+#define TB_CACHE_MAGIC      "QEMUTBC1"
+#define TB_CACHE_SIZE       (64 * 1024 * 1024)
+#define TB_CACHE_BUCKETS    (1 << 16)
+/* maximum number of entries compared in a bucket */
+#define TB_CACHE_MAX_CHAIN  16
+
+/* see tcg_ctx.code_gen_prologue */
+#define PROLOGUE_SIZE       1024
+
+/* Start and end of the emulator image, defined by the linker.  */
+extern char __executable_start[], _end[];
+
+typedef struct TBCacheHeader {
+    char magic[8];
+    uint64_t config;        /* see tb_cache_config() */
+    uint32_t dirty;         /* set while an emulator uses the file */
+    uint32_t used;          /* end of the last entry */
+    uint32_t buckets[TB_CACHE_BUCKETS];  /* offsets of the first entries */
+} TBCacheHeader;
+
+/* Base of the value of a TBCacheReloc.  */
+enum {
+    TB_REF_CONST,           /* absolute */
+    TB_REF_IMAGE,           /* __executable_start */
+    TB_REF_TB,              /* the TranslationBlock */
+    TB_REF_CODE,            /* tc_ptr */
+    TB_REF_PROLOGUE,        /* tcg_ctx.code_gen_prologue */
+};
+
+typedef struct TBCacheReloc {
+    uint32_t offset;        /* of the field in the host code */
+    uint8_t type;           /* TCGExtRef type */
+    int8_t pc_ofs;
+    uint8_t kind;           /* TB_REF_xxx */
+    uint8_t pad;
+    int64_t value;
+} TBCacheReloc;
+
+/* followed by the relocations, the guest code and the host code */
+typedef struct TBCacheEntry {
+    uint32_t next;          /* next entry of the bucket, or 0 */
+    uint32_t code_size;
+    uint64_t pc;
+    uint64_t cs_base;
+    uint64_t flags;
+    uint32_t icount;
+    uint16_t size;
+    uint16_t nb_relocs;
+    uint16_t tb_next_offset[2];
+    uint16_t tb_jmp_offset[4];
+} TBCacheEntry;
+
+typedef struct TBCache {
+    int fd;
+    uint8_t *base;
+    TBCacheHeader *header;
+
+    /* statistics */
+    int64_t lookup_count;
+    int64_t hit_count;
+    int64_t store_count;
+    int64_t reject_count;   /* TBs that can't be relocated */
+    int64_t full_count;     /* TBs not stored because the file is full */
+} TBCache;
+
+static TBCache tb_cache;
+
+static uint64_t tb_cache_hash(uint64_t h, const void *data, size_t size)
+{
+    const uint8_t *p = data;
+
+    while (size--) {
+        h = (h ^ *p++) * 0x100000001b3ull;
+    }
+    return h;
+}
+
+/* Hash of everything that the generated code depends on, besides the
+   guest code and the TB flags.  */
+static uint64_t tb_cache_config(const char *cpu_model)
+{
+    uint64_t h = 0xcbf29ce484222325ull;
+    uint64_t v[8];
+    struct stat st;
+
+    memset(&st, 0, sizeof(st));
+    stat("/proc/self/exe", &st);
+    v[0] = _end - __executable_start;
+    v[1] = (uintptr_t)tb_gen_code - (uintptr_t)__executable_start;
+    v[2] = st.st_size;
+    v[3] = st.st_mtime;
+    v[4] = sizeof(CPUArchState);
+    v[5] = use_icount;
+    /* e.g. movbe or andn, for a cache copied from another host */
+    v[6] = tcg_host_features();
+    /* the TBs count their executions only if traces are enabled */
+    v[7] = tb_trace_threshold;
+    h = tb_cache_hash(h, v, sizeof(v));
+    h = tb_cache_hash(h, QEMU_VERSION, strlen(QEMU_VERSION));
+    if (cpu_model) {
+        h = tb_cache_hash(h, cpu_model, strlen(cpu_model));
+    }
+    return h;
+}
+
+static inline unsigned int tb_cache_bucket(target_ulong pc,
+                                           target_ulong cs_base,
+                                           uint64_t flags)
+{
+    uint64_t h = 0xcbf29ce484222325ull;
+    uint64_t v[3] = { pc, cs_base, flags };
+
+    h = tb_cache_hash(h, v, sizeof(v));
+    return (h ^ (h >> 32)) & (TB_CACHE_BUCKETS - 1);
+}
+
+static inline TBCacheEntry *tb_cache_entry(uint32_t offset)
+{
+    TBCacheHeader *h = tb_cache.header;
+
+    if (offset < sizeof(*h) || offset + sizeof(TBCacheEntry) > h->used) {
+        return NULL;
+    }
+    return (TBCacheEntry *)(tb_cache.base + offset);
+}
+
+static void tb_cache_close(void)
+{
+    if (!tb_cache.header) {
+        return;
+    }
+    tb_cache.header->dirty = 0;
+    msync(tb_cache.base, TB_CACHE_SIZE, MS_SYNC);
+    munmap(tb_cache.base, TB_CACHE_SIZE);
+    close(tb_cache.fd);
+    tb_cache.header = NULL;
+}
+
+int tb_cache_open(const char *path, const char *cpu_model)
+{
+    TBCacheHeader *h;
+    uint64_t config = tb_cache_config(cpu_model);
+    void *base;
+    int fd;
+
+    fd = open(path, O_RDWR | O_CREAT, 0644);
+    if (fd < 0) {
+        fprintf(stderr, "Could not open translation cache %s: %s\n",
+                path, strerror(errno));
+        return -1;
+    }
+    /* Entries are appended without any synchronization, so another
+       emulator must not write to the file at the same time. The lock is
+       released when the file is closed, including when we crash.  */
+    if (flock(fd, LOCK_EX | LOCK_NB) < 0) {
+        fprintf(stderr, "Translation cache %s is used by another emulator, "
+                "running without it\n", path);
+        close(fd);
+        return -1;
+    }
+    if (ftruncate(fd, TB_CACHE_SIZE) < 0) {
+        fprintf(stderr, "Could not resize translation cache %s: %s\n",
+                path, strerror(errno));
+        close(fd);
+        return -1;
+    }
+    base = mmap(NULL, TB_CACHE_SIZE, PROT_READ | PROT_WRITE, MAP_SHARED,
+                fd, 0);
+    if (base == MAP_FAILED) {
+        fprintf(stderr, "Could not map translation cache %s: %s\n",
+                path, strerror(errno));
+        close(fd);
+        return -1;
+    }
+
+    h = base;
+    if (memcmp(h->magic, TB_CACHE_MAGIC, sizeof(h->magic)) != 0 ||
+        h->config != config || h->dirty ||
+        h->used < sizeof(*h) || h->used > TB_CACHE_SIZE) {
+        memset(h, 0, sizeof(*h));
+        memcpy(h->magic, TB_CACHE_MAGIC, sizeof(h->magic));
+        h->config = config;
+        h->used = sizeof(*h);
+    }
+    /* Entries are only valid if the file is closed properly.  */
+    h->dirty = 1;
+    msync(base, sizeof(*h), MS_SYNC);
+
+    tb_cache.fd = fd;
+    tb_cache.base = base;
+    tb_cache.header = h;
+    atexit(tb_cache_close);
+    return 0;
+}
+
+static bool tb_cache_enabled(CPUArchState *env, TranslationBlock *tb)
+{
+    return tb_cache.header && tb->cflags == 0 &&
+           !ENV_GET_CPU(env)->singlestep_enabled &&
+           QTAILQ_EMPTY(&env->breakpoints);
+}
+
+int tb_cache_load(CPUArchState *env, TranslationBlock *tb,
+                  tb_page_addr_t phys_pc, int *code_size)
+{
+    TCGContext *s = &tcg_ctx;
+    TBCacheHeader *h = tb_cache.header;
+    const uint8_t *guest_code;
+    const TBCacheReloc *r;
+    TBCacheEntry *e;
+    uintptr_t base;
+    size_t avail;
+    uint32_t offset;
+    int i, n;
+
+    s->ext_refs_enabled = 0;
+    if (!tb_cache_enabled(env, tb)) {
+        return -1;
+    }
+    tb_cache.lookup_count++;
+
+    guest_code = qemu_get_ram_ptr(phys_pc);
+    avail = TARGET_PAGE_SIZE - (tb->pc & ~TARGET_PAGE_MASK);
+    offset = h->buckets[tb_cache_bucket(tb->pc, tb->cs_base, tb->flags)];
+    for (n = 0; n < TB_CACHE_MAX_CHAIN; n++, offset = e->next) {
+        e = tb_cache_entry(offset);
+        if (!e) {
+            break;
+        }
+        r = (const TBCacheReloc *)(e + 1);
+        if (e->pc != tb->pc || e->cs_base != tb->cs_base ||
+            e->flags != tb->flags || e->size > avail ||
+            (uint8_t *)(r + e->nb_relocs) + e->size + e->code_size >
+                    tb_cache.base + h->used ||
+            memcmp(r + e->nb_relocs, guest_code, e->size) != 0) {
+            continue;
+        }
+        if (e->code_size > TCG_MAX_OP_SIZE * OPC_BUF_SIZE) {
+            break;
+        }
+
+        memcpy(tb->tc_ptr, (uint8_t *)(r + e->nb_relocs) + e->size,
+               e->code_size);
+        for (i = 0; i < e->nb_relocs; i++, r++) {
+            TCGExtRef ref;
+
+            switch (r->kind) {
+            case TB_REF_IMAGE:
+                base = (uintptr_t)__executable_start;
+                break;
+            case TB_REF_TB:
+                base = (uintptr_t)tb;
+                break;
+            case TB_REF_CODE:
+                base = (uintptr_t)tb->tc_ptr;
+                break;
+            case TB_REF_PROLOGUE:
+                base = (uintptr_t)s->code_gen_prologue;
+                break;
+            default:
+                base = 0;
+                break;
+            }
+            ref.type = r->type;
+            ref.pc_ofs = r->pc_ofs;
+            if (r->offset >= e->code_size ||
+                !tcg_patch_ext_ref(&ref, tb->tc_ptr + r->offset,
+                                   base + r->value)) {
+                /* Generate it again, but don't store it twice.  */
+                tb_cache.reject_count++;
+                return -1;
+            }
+        }
+        flush_icache_range((uintptr_t)tb->tc_ptr,
+                           (uintptr_t)tb->tc_ptr + e->code_size);
+
+        tb->size = e->size;
+        tb->icount = e->icount;
+        tb->tb_next_offset[0] = e->tb_next_offset[0];
+        tb->tb_next_offset[1] = e->tb_next_offset[1];
+        for (i = 0; i < 4; i++) {
+            tb->tb_jmp_offset[i] = e->tb_jmp_offset[i];
+        }
+        *code_size = e->code_size;
+        tb_cache.hit_count++;
+        return 0;
+    }
+
+    /* Record the references of the code that is about to be generated
+       for tb_cache_store().  */
+    s->nb_ext_refs = 0;
+    s->ext_refs_enabled = 1;
+    return -1;
+}
+
+void tb_cache_store(CPUArchState *env, TranslationBlock *tb,
+                    tb_page_addr_t phys_pc, int code_size)
+{
+    TCGContext *s = &tcg_ctx;
+    TBCacheHeader *h = tb_cache.header;
+    uintptr_t tc_ptr = (uintptr_t)tb->tc_ptr;
+    uintptr_t buffer = (uintptr_t)s->code_gen_buffer;
+    uintptr_t prologue = (uintptr_t)s->code_gen_prologue;
+    TBCacheReloc relocs[TCG_MAX_EXT_REFS], *r;
+    TBCacheEntry *e;
+    unsigned int bucket;
+    size_t total;
+    int i, n;
+
+    if (!s->ext_refs_enabled) {
+        return;
+    }
+    s->ext_refs_enabled = 0;
+    if (tb->size == 0 ||
+        (tb->pc & ~TARGET_PAGE_MASK) + tb->size > TARGET_PAGE_SIZE) {
+        return;
+    }
+    if (s->nb_ext_refs > TCG_MAX_EXT_REFS) {
+        tb_cache.reject_count++;
+        return;
+    }
+
+    for (i = 0, n = 0; i < s->nb_ext_refs; i++) {
+        const TCGExtRef *ref = &s->ext_refs[i];
+        uintptr_t v = ref->value;
+
+        r = &relocs[n];
+        r->offset = ref->ptr - tb->tc_ptr;
+        r->type = ref->type;
+        r->pc_ofs = ref->pc_ofs;
+        r->pad = 0;
+        if (v >= (uintptr_t)tb && v < (uintptr_t)(tb + 1)) {
+            r->kind = TB_REF_TB;
+            r->value = v - (uintptr_t)tb;
+        } else if (v >= tc_ptr && v < tc_ptr + code_size) {
+            r->kind = TB_REF_CODE;
+            r->value = v - tc_ptr;
+        } else if (v >= prologue && v < prologue + PROLOGUE_SIZE) {
+            r->kind = TB_REF_PROLOGUE;
+            r->value = v - prologue;
+        } else if (v >= buffer && v < prologue) {
+            /* code of another TB */
+            tb_cache.reject_count++;
+            return;
+        } else if (v >= (uintptr_t)__executable_start &&
+                   v < (uintptr_t)_end) {
+            r->kind = TB_REF_IMAGE;
+            r->value = v - (uintptr_t)__executable_start;
+        } else if (ref->type & TCG_EXT_REF_ADDR) {
+            /* e.g. a call to a shared library */
+            tb_cache.reject_count++;
+            return;
+        } else {
+            r->kind = TB_REF_CONST;
+            r->value = v;
+        }
+        n++;
+    }
+
+    total = sizeof(*e) + n * sizeof(*relocs) + tb->size + code_size;
+    total = (total + 7) & ~(size_t)7;
+    if (h->used + total > TB_CACHE_SIZE) {
+        tb_cache.full_count++;
+        return;
+    }
+    e = (TBCacheEntry *)(tb_cache.base + h->used);
+    e->code_size = code_size;
+    e->pc = tb->pc;
+    e->cs_base = tb->cs_base;
+    e->flags = tb->flags;
+    e->icount = tb->icount;
+    e->size = tb->size;
+    e->nb_relocs = n;
+    e->tb_next_offset[0] = tb->tb_next_offset[0];
+    e->tb_next_offset[1] = tb->tb_next_offset[1];
+    for (i = 0; i < 4; i++) {
+        e->tb_jmp_offset[i] = tb->tb_jmp_offset[i];
+    }
+    memcpy(e + 1, relocs, n * sizeof(*relocs));
+    memcpy((TBCacheReloc *)(e + 1) + n, qemu_get_ram_ptr(phys_pc), tb->size);
+    memcpy((uint8_t *)((TBCacheReloc *)(e + 1) + n) + tb->size, tb->tc_ptr,
+           code_size);
+
+    bucket = tb_cache_bucket(tb->pc, tb->cs_base, tb->flags);
+    e->next = h->buckets[bucket];
+    h->buckets[bucket] = h->used;
+    h->used += total;
+    tb_cache.store_count++;
+}
+
+void tb_cache_dump_info(FILE *f, fprintf_function cpu_fprintf)
+{
+    if (!tb_cache.header) {
+        return;
+    }
+    cpu_fprintf(f, "TB cache size       %u/%u bytes\n",
+                tb_cache.header->used, TB_CACHE_SIZE);
+    cpu_fprintf(f, "TB cache lookups    %" PRId64 " (%" PRId64 " hits)\n",
+                tb_cache.lookup_count, tb_cache.hit_count);
+    cpu_fprintf(f, "TB cache stores     %" PRId64 " (%" PRId64
+                " rejected, %" PRId64 " full)\n",
+                tb_cache.store_count, tb_cache.reject_count,
+                tb_cache.full_count);
+}
+
+#else /* !USE_TB_CACHE */
+
+int tb_cache_open(const char *path, const char *cpu_model)
+{
+    fprintf(stderr, "The translation cache isn't supported on this host\n");
+    return -1;
+}
+
+int tb_cache_load(CPUArchState *env, TranslationBlock *tb,
+                  tb_page_addr_t phys_pc, int *code_size)
+{
+    return -1;
+}
+
+void tb_cache_store(CPUArchState *env, TranslationBlock *tb,
+                    tb_page_addr_t phys_pc, int code_size)
+{
+}
+
+void tb_cache_dump_info(FILE *f, fprintf_function cpu_fprintf)
+{
+}
+
+#endif /* !USE_TB_CACHE */
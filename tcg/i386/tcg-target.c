@@ -146,6 +146,18 @@ static bool have_bmi2;
 
 static uint8_t *tb_ret_addr;
 
+/* Types of TCGExtRef, by instruction form.  */
+enum {
+    EXT_REF_MOVI32U,    /* movl $imm32, reg */
+    EXT_REF_MOVI32S,    /* movq $simm32, reg */
+    EXT_REF_MOVI_LEA,   /* leaq disp32(%rip), reg */
+    EXT_REF_MOVI64,     /* movabsq $imm64, reg */
+    EXT_REF_JMP32,      /* call/jmp disp32 */
+    EXT_REF_JMP64,      /* movabsq $imm64, %r10; call/jmp *%r10 */
+    EXT_REF_RIPREL,     /* disp32(%rip) operand */
+    EXT_REF_ABS32,      /* absolute disp32 operand */
+};
+
 static void patch_reloc(uint8_t *code_ptr, int type,
                         intptr_t value, intptr_t addend)
 {
@@ -170,6 +182,75 @@ static void patch_reloc(uint8_t *code_ptr, int type,
     }
 }
 
+#ifdef TCG_TARGET_HAS_EXT_REFS
+/* Each form is only valid if tcg_out_movi(), tcg_out_branch() or
+   tcg_out_modrm_sib_offset() would still choose it for 'value' at 'ptr',
+   so that the code is the same as if it had been generated there.  */
+static bool patch_ext_ref(const TCGExtRef *ref, uint8_t *ptr,
+                          uintptr_t value)
+{
+    intptr_t disp = value - ((intptr_t)ptr + ref->pc_ofs);
+    bool u32 = value == (uint32_t)value;
+    bool s32 = (intptr_t)value == (int32_t)value;
+    bool rel32 = disp == (int32_t)disp;
+
+    switch (ref->type & ~TCG_EXT_REF_ADDR) {
+    case EXT_REF_MOVI32U:
+        if (!u32) {
+            return false;
+        }
+        *(uint32_t *)ptr = value;
+        return true;
+    case EXT_REF_MOVI32S:
+        if (u32 || !s32) {
+            return false;
+        }
+        *(uint32_t *)ptr = value;
+        return true;
+    case EXT_REF_MOVI_LEA:
+        if (u32 || s32 || !rel32) {
+            return false;
+        }
+        *(uint32_t *)ptr = disp;
+        return true;
+    case EXT_REF_MOVI64:
+        if (u32 || s32 || rel32) {
+            return false;
+        }
+        *(uint64_t *)ptr = value;
+        return true;
+    case EXT_REF_JMP32:
+    case EXT_REF_RIPREL:
+        if (!rel32) {
+            return false;
+        }
+        *(uint32_t *)ptr = disp;
+        return true;
+    case EXT_REF_JMP64:
+        if (rel32) {
+            return false;
+        }
+        *(uint64_t *)ptr = value;
+        return true;
+    case EXT_REF_ABS32:
+        if (rel32 || !s32) {
+            return false;
+        }
+        *(uint32_t *)ptr = value;
+        return true;
+    default:
+        return false;
+    }
+}
+
+/* The optional host instructions that the generated code may use.  */
+static uint32_t ext_refs_host_features(void)
+{
+    return (have_cmov ? 1 : 0) | (have_movbe ? 2 : 0) |
+           (have_bmi1 ? 4 : 0) | (have_bmi2 ? 8 : 0);
+}
+#endif
+
 /* parse target specific constraints */
 static int target_parse_constraint(TCGArgConstraint *ct, const char **pct_str)
 {
@@ -549,6 +630,7 @@ static void tcg_out_modrm_sib_offset(TCGContext *s, int opc, int r, int rm,
             if (disp == (int32_t)disp) {
                 tcg_out_opc(s, opc, r, 0, 0);
                 tcg_out8(s, (LOWREGMASK(r) << 3) | 5);
+                tcg_out_ext_ref(s, s->code_ptr, EXT_REF_RIPREL, pc, offset);
                 tcg_out32(s, disp);
                 return;
             }
@@ -560,6 +642,7 @@ static void tcg_out_modrm_sib_offset(TCGContext *s, int opc, int r, int rm,
                 tcg_out_opc(s, opc, r, 0, 0);
                 tcg_out8(s, (LOWREGMASK(r) << 3) | 4);
                 tcg_out8(s, (4 << 3) | 5);
+                tcg_out_ext_ref(s, s->code_ptr, EXT_REF_ABS32, pc, offset);
                 tcg_out32(s, offset);
                 return;
             }
@@ -654,11 +737,17 @@ static void tcg_out_movi(TCGContext *s, TCGType type,
     }
     if (arg == (uint32_t)arg || type == TCG_TYPE_I32) {
         tcg_out_opc(s, OPC_MOVL_Iv + LOWREGMASK(ret), 0, ret, 0);
+        if (type != TCG_TYPE_I32) {
+            tcg_out_ext_ref(s, s->code_ptr, EXT_REF_MOVI32U,
+                            (intptr_t)s->code_ptr, arg);
+        }
         tcg_out32(s, arg);
         return;
     }
     if (arg == (int32_t)arg) {
         tcg_out_modrm(s, OPC_MOVL_EvIz + P_REXW, 0, ret);
+        tcg_out_ext_ref(s, s->code_ptr, EXT_REF_MOVI32S,
+                        (intptr_t)s->code_ptr, arg);
         tcg_out32(s, arg);
         return;
     }
@@ -668,11 +757,16 @@ static void tcg_out_movi(TCGContext *s, TCGType type,
     if (diff == (int32_t)diff) {
         tcg_out_opc(s, OPC_LEA | P_REXW, ret, 0, 0);
         tcg_out8(s, (LOWREGMASK(ret) << 3) | 5);
+        tcg_out_ext_ref(s, s->code_ptr, EXT_REF_MOVI_LEA,
+                        (intptr_t)s->code_ptr + 4, arg);
         tcg_out32(s, diff);
         return;
     }
 
     tcg_out_opc(s, OPC_MOVL_Iv + P_REXW + LOWREGMASK(ret), 0, ret, 0);
+    /* the lea above was tried at the start of the instruction */
+    tcg_out_ext_ref(s, s->code_ptr, EXT_REF_MOVI64,
+                    (intptr_t)s->code_ptr + 5, arg);
     tcg_out64(s, arg);
 }
 
@@ -1108,9 +1202,17 @@ static void tcg_out_branch(TCGContext *s, int call, uintptr_t dest)
 
     if (disp == (int32_t)disp) {
         tcg_out_opc(s, call ? OPC_CALL_Jz : OPC_JMP_long, 0, 0, 0);
+        tcg_out_ext_ref(s, s->code_ptr, EXT_REF_JMP32 | TCG_EXT_REF_ADDR,
+                        (intptr_t)s->code_ptr + 4, dest);
         tcg_out32(s, disp);
     } else {
-        tcg_out_movi(s, TCG_TYPE_PTR, TCG_REG_R10, dest);
+        /* Always use movq, so that the form of the code only depends on
+           the displacement above, see patch_ext_ref().  */
+        tcg_out_opc(s, OPC_MOVL_Iv + P_REXW + LOWREGMASK(TCG_REG_R10),
+                    0, TCG_REG_R10, 0);
+        tcg_out_ext_ref(s, s->code_ptr, EXT_REF_JMP64 | TCG_EXT_REF_ADDR,
+                        (intptr_t)s->code_ptr + 3, dest);
+        tcg_out64(s, dest);
         tcg_out_modrm(s, OPC_GRP5,
                       call ? EXT5_CALLN_Ev : EXT5_JMPN_Ev, TCG_REG_R10);
     }
@@ -1203,8 +1305,9 @@ static inline void tcg_out_tlb_load(TCGContext *s, TCGReg addrlo, TCGReg addrhi,
 
     tgen_arithi(s, ARITH_AND + trexw, r1,
                 TARGET_PAGE_MASK | ((1 << s_bits) - 1), 0);
-    tgen_arithi(s, ARITH_AND + hrexw, r0,
-                (CPU_TLB_SIZE - 1) << CPU_TLB_ENTRY_BITS, 0);
+    /* and tlb_mask(env), r0: the TLB size is selected at runtime.  */
+    tcg_out_modrm_offset(s, OPC_ARITH_GvEv + (ARITH_AND << 3) + hrexw, r0,
+                         TCG_AREG0, offsetof(CPUArchState, tlb_mask));
 
     tcg_out_modrm_sib_offset(s, OPC_LEA + hrexw, r0, TCG_AREG0, r0, 0,
                              offsetof(CPUArchState, tlb_table[mem_index][0])
@@ -1238,6 +1341,18 @@ static inline void tcg_out_tlb_load(TCGContext *s, TCGReg addrlo, TCGReg addrhi,
 
     /* TLB Hit.  */
 
+#ifdef CONFIG_PROFILER
+    /* Count it in env->tlb_stats.hit.  */
+    tcg_out_modrm_offset(s, OPC_ARITH_EvIb + P_REXW, ARITH_ADD, TCG_AREG0,
+                         offsetof(CPUArchState, tlb_stats.hit));
+    tcg_out8(s, 1);
+    if (TCG_TARGET_REG_BITS == 32) {
+        tcg_out_modrm_offset(s, OPC_ARITH_EvIb, ARITH_ADC, TCG_AREG0,
+                             offsetof(CPUArchState, tlb_stats.hit) + 4);
+        tcg_out8(s, 0);
+    }
+#endif
+
     /* add addend(r0), r1 */
     tcg_out_modrm_offset(s, OPC_ADD_GvEv + hrexw, r1, r0,
                          offsetof(CPUTLBEntry, addend) - which);
@@ -131,6 +131,11 @@ extern bool have_bmi1;
 
 #define TCG_TARGET_HAS_new_ldst         1
 
+#if TCG_TARGET_REG_BITS == 64
+/* the host addresses in the code are recorded as TCGExtRefs */
+#define TCG_TARGET_HAS_EXT_REFS
+#endif
+
 #define TCG_TARGET_deposit_i32_valid(ofs, len) \
     (((ofs) == 0 && (len) == 8) || ((ofs) == 8 && (len) == 8) || \
      ((ofs) == 0 && (len) == 16))
@@ -105,6 +105,11 @@ static int tcg_target_const_match(tcg_target_long val,
                                   const TCGArgConstraint *arg_ct);
 static void tcg_out_tb_init(TCGContext *s);
 static void tcg_out_tb_finalize(TCGContext *s);
+#ifdef TCG_TARGET_HAS_EXT_REFS
+static bool patch_ext_ref(const TCGExtRef *ref, uint8_t *ptr,
+                          uintptr_t value);
+static uint32_t ext_refs_host_features(void);
+#endif
 
 
 TCGOpDef tcg_op_defs[] = {
@@ -143,6 +148,25 @@ static inline void tcg_out64(TCGContext *s, uint64_t v)
     s->code_ptr = p + 8;
 }
 
+/* record a field of the generated code that depends on its address */
+static inline void tcg_out_ext_ref(TCGContext *s, uint8_t *ptr, int type,
+                                   intptr_t pc, uintptr_t value)
+{
+    TCGExtRef *r;
+
+    if (!s->ext_refs_enabled) {
+        return;
+    }
+    if (s->nb_ext_refs < TCG_MAX_EXT_REFS) {
+        r = &s->ext_refs[s->nb_ext_refs];
+        r->ptr = ptr;
+        r->type = type;
+        r->pc_ofs = pc - (intptr_t)ptr;
+        r->value = value;
+    }
+    s->nb_ext_refs++;
+}
+
 /* label relocation processing */
 
 static void tcg_out_reloc(TCGContext *s, uint8_t *code_ptr, int type,
@@ -204,6 +228,18 @@ int gen_new_label(void)
 
 #include "tcg-target.c"
 
+#ifdef TCG_TARGET_HAS_EXT_REFS
+bool tcg_patch_ext_ref(const TCGExtRef *ref, uint8_t *ptr, uintptr_t value)
+{
+    return patch_ext_ref(ref, ptr, value);
+}
+
+uint32_t tcg_host_features(void)
+{
+    return ext_refs_host_features();
+}
+#endif
+
 /* pool based memory allocation */
 void *tcg_malloc_internal(TCGContext *s, int size)
 {
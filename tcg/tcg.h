@@ -146,6 +146,23 @@ typedef struct TCGRelocation {
     intptr_t addend;
 } TCGRelocation; 
 
+/* A host address or constant stored in the generated code, whose encoding
+   depends on where the code is placed. Backends that define
+   TCG_TARGET_HAS_EXT_REFS record them while ext_refs_enabled is set, so
+   that the persistent translation cache can move the code of a TB to
+   another address, possibly in another run. */
+typedef struct TCGExtRef {
+    uint8_t *ptr;       /* field in the generated code */
+    uint8_t type;       /* backend specific encoding */
+    int8_t pc_ofs;      /* for pc-relative fields, offset of the base */
+    uintptr_t value;    /* absolute value, or target address */
+} TCGExtRef;
+
+/* flag of TCGExtRef.type: the value is known to be a host address */
+#define TCG_EXT_REF_ADDR 0x80
+
+#define TCG_MAX_EXT_REFS 128
+
 typedef struct TCGLabel {
     int has_value;
     union {
@@ -484,6 +501,12 @@ struct TCGContext {
 
     GHashTable *helpers;
 
+    /* external references of the code being generated, see TCGExtRef.
+       nb_ext_refs keeps counting past TCG_MAX_EXT_REFS. */
+    int ext_refs_enabled;
+    int nb_ext_refs;
+    TCGExtRef ext_refs[TCG_MAX_EXT_REFS];
+
 #ifdef CONFIG_PROFILER
     /* profiling info */
     int64_t tb_count1;
@@ -561,6 +584,15 @@ void tcg_func_start(TCGContext *s);
 
 int tcg_gen_code(TCGContext *s, uint8_t *gen_code_buf);
 int tcg_gen_code_search_pc(TCGContext *s, uint8_t *gen_code_buf, long offset);
+#ifdef TCG_TARGET_HAS_EXT_REFS
+/* Store 'value' in the field of 'ref', moved to 'ptr'. Returns false if
+   the backend would use another encoding for 'value' at this address, in
+   which case the code must be generated again. */
+bool tcg_patch_ext_ref(const TCGExtRef *ref, uint8_t *ptr, uintptr_t value);
+/* Backend specific mask of the optional host instructions detected by
+   tcg_context_init(), which the generated code may use. */
+uint32_t tcg_host_features(void);
+#endif
 
 void tcg_set_frame(TCGContext *s, int reg, intptr_t start, intptr_t size);
 
@@ -103,6 +103,16 @@ static void* l1_phys_map[V_L1_SIZE];
 /* code generation context */
 TCGContext tcg_ctx;
 
+/* Traces are off unless -tb-trace is given.  */
+#define TB_TRACE_DEFAULT_THRESHOLD 0
+
+unsigned int tb_trace_threshold = TB_TRACE_DEFAULT_THRESHOLD;
+
+void tb_set_trace_threshold(unsigned int count)
+{
+    tb_trace_threshold = count;
+}
+
 /* XXX: suppress that */
 unsigned long code_gen_max_block_size(void)
 {
@@ -602,6 +612,43 @@ static inline void *alloc_code_gen_buffer(void)
 }
 #endif /* USE_STATIC_CODE_GEN_BUFFER, USE_MMAP */
 
+/* Maximum size a TB can expand to in the code buffer, which is left free
+   at the end of each region. Regions are made large enough for this to be
+   a small fraction of them. */
+#define TB_MAX_CODE_SIZE    (TCG_MAX_OP_SIZE * OPC_BUF_SIZE)
+#define TB_REGION_MIN_SIZE  (16 * TB_MAX_CODE_SIZE)
+
+static void tb_regions_init(void)
+{
+    TBContext *ctx = &tcg_ctx.tb_ctx;
+    int i, n;
+
+    n = tcg_ctx.code_gen_buffer_size / TB_REGION_MIN_SIZE;
+    n = MAX(1, MIN(n, TB_MAX_REGIONS));
+    ctx->nb_regions = n;
+    ctx->region_size = (tcg_ctx.code_gen_buffer_size / n) &
+            ~(size_t)(CODE_GEN_ALIGN - 1);
+    ctx->region_max_blocks = tcg_ctx.code_gen_max_blocks / n;
+    for (i = 0; i < n; i++) {
+        TBRegion *r = &ctx->regions[i];
+
+        r->code_start = tcg_ctx.code_gen_buffer + i * ctx->region_size;
+        r->code_ptr = r->code_start;
+        r->tbs = ctx->tbs + i * ctx->region_max_blocks;
+        r->nb_tbs = 0;
+    }
+    ctx->cur_region = 0;
+}
+
+/* End of the code generated in region 'i'. */
+static inline uint8_t *tb_region_code_ptr(int i)
+{
+    if (i == tcg_ctx.tb_ctx.cur_region) {
+        return tcg_ctx.code_gen_ptr;
+    }
+    return tcg_ctx.tb_ctx.regions[i].code_ptr;
+}
+
 static inline void code_gen_alloc(size_t tb_size)
 {
     tcg_ctx.code_gen_buffer_size = size_code_gen_buffer(tb_size);
@@ -629,6 +676,7 @@ static inline void code_gen_alloc(size_t tb_size)
             CODE_GEN_AVG_BLOCK_SIZE;
     tcg_ctx.tb_ctx.tbs =
             g_malloc(tcg_ctx.code_gen_max_blocks * sizeof(TranslationBlock));
+    tb_regions_init();
 }
 
 /* Must be called before using the QEMU cpus. 'tb_size' is the size
@@ -652,32 +700,42 @@ bool tcg_enabled(void)
     return tcg_ctx.code_gen_buffer != NULL;
 }
 
-/* Allocate a new translation block. Flush the translation buffer if
-   too many translation blocks or too much generated code. */
+/* Allocate a new translation block in the current region. Returns NULL
+   if it has too many translation blocks or too much generated code, in
+   which case the next region must be evicted. */
 static TranslationBlock *tb_alloc(target_ulong pc)
 {
+    TBContext *ctx = &tcg_ctx.tb_ctx;
+    TBRegion *r = &ctx->regions[ctx->cur_region];
     TranslationBlock *tb;
 
-    if (tcg_ctx.tb_ctx.nb_tbs >= tcg_ctx.code_gen_max_blocks ||
-        (tcg_ctx.code_gen_ptr - tcg_ctx.code_gen_buffer) >=
-         tcg_ctx.code_gen_buffer_max_size) {
+    if (r->nb_tbs >= ctx->region_max_blocks ||
+        (tcg_ctx.code_gen_ptr - r->code_start) >=
+         ctx->region_size - TB_MAX_CODE_SIZE) {
         return NULL;
     }
-    tb = &tcg_ctx.tb_ctx.tbs[tcg_ctx.tb_ctx.nb_tbs++];
+    tb = &r->tbs[r->nb_tbs++];
+    ctx->nb_tbs++;
     tb->pc = pc;
     tb->cflags = 0;
+    tb->exec_count = 0;
+    /* not linked to the physical page tables yet */
+    tb->page_addr[0] = -1;
     return tb;
 }
 
 void tb_free(TranslationBlock *tb)
 {
+    TBContext *ctx = &tcg_ctx.tb_ctx;
+    TBRegion *r = &ctx->regions[ctx->cur_region];
+
     /* In practice this is mostly used for single use temporary TB
        Ignore the hard cases and just back up if this TB happens to
        be the last one generated.  */
-    if (tcg_ctx.tb_ctx.nb_tbs > 0 &&
-            tb == &tcg_ctx.tb_ctx.tbs[tcg_ctx.tb_ctx.nb_tbs - 1]) {
+    if (r->nb_tbs > 0 && tb == &r->tbs[r->nb_tbs - 1]) {
         tcg_ctx.code_gen_ptr = tb->tc_ptr;
-        tcg_ctx.tb_ctx.nb_tbs--;
+        r->nb_tbs--;
+        ctx->nb_tbs--;
     }
 }
 
@@ -740,6 +798,9 @@ void tb_flush(CPUArchState *env1)
         cpu_abort(env1, "Internal error: code buffer overflow\n");
     }
     tcg_ctx.tb_ctx.nb_tbs = 0;
+    tb_regions_init();
+    memset(tcg_ctx.tb_ctx.tb_evicted_map, 0,
+           sizeof(tcg_ctx.tb_ctx.tb_evicted_map));
 
     CPU_FOREACH(cpu) {
         CPUArchState *env = cpu->env_ptr;
@@ -756,6 +817,46 @@ void tb_flush(CPUArchState *env1)
     tcg_ctx.tb_ctx.tb_flush_count++;
 }
 
+/* Continue code generation at the start of the next region, after
+   invalidating the TBs it still holds. Unlike tb_flush(), the TBs of the
+   other regions stay in the hash tables, the page lists and the jump
+   caches, and only the jumps to and from the evicted TBs are reset. The
+   regions are reused in the order they were filled, so the evicted TBs
+   are the oldest ones. */
+static void tb_evict_region(CPUArchState *env)
+{
+    TBContext *ctx = &tcg_ctx.tb_ctx;
+    TranslationBlock *tb;
+    TBRegion *r;
+    int i;
+
+    if (ctx->nb_regions == 1) {
+        tb_flush(env);
+        return;
+    }
+    ctx->regions[ctx->cur_region].code_ptr = tcg_ctx.code_gen_ptr;
+    ctx->cur_region = (ctx->cur_region + 1) % ctx->nb_regions;
+    r = &ctx->regions[ctx->cur_region];
+
+    for (i = 0; i < r->nb_tbs; i++) {
+        tb = &r->tbs[i];
+        /* skip the TBs that were already invalidated */
+        if (tb->page_addr[0] == -1) {
+            continue;
+        }
+        set_bit(tb_phys_hash_func(tb->page_addr[0] +
+                                  (tb->pc & ~TARGET_PAGE_MASK)),
+                ctx->tb_evicted_map);
+        tb_phys_invalidate(tb, -1);
+        ctx->tb_evicted_count++;
+    }
+    ctx->nb_tbs -= r->nb_tbs;
+    r->nb_tbs = 0;
+    r->code_ptr = r->code_start;
+    tcg_ctx.code_gen_ptr = r->code_start;
+    ctx->tb_region_evict_count++;
+}
+
 #ifdef DEBUG_TB_CHECK
 
 static void tb_invalidate_check(target_ulong address)
@@ -873,6 +974,12 @@ void tb_phys_invalidate(TranslationBlock *tb, tb_page_addr_t page_addr)
     tb_page_addr_t phys_pc;
     TranslationBlock *tb1, *tb2;
 
+    /* Already invalidated, or never linked by tb_link_page(): it is in
+       none of the lists, and page_addr[0] can't be looked up. */
+    if (tb->page_addr[0] == -1) {
+        return;
+    }
+
     /* remove the TB from the hash list */
     phys_pc = tb->page_addr[0] + (tb->pc & ~TARGET_PAGE_MASK);
     h = tb_phys_hash_func(phys_pc);
@@ -919,6 +1026,8 @@ void tb_phys_invalidate(TranslationBlock *tb, tb_page_addr_t page_addr)
         tb1 = tb2;
     }
     tb->jmp_first = (TranslationBlock *)((uintptr_t)tb | 2); /* fail safe */
+    /* mark it as invalidated, see above and tb_evict_region() */
+    tb->page_addr[0] = -1;
 
     tcg_ctx.tb_ctx.tb_phys_invalidate_count++;
 }
@@ -992,19 +1101,28 @@ TranslationBlock *tb_gen_code(CPUArchState *env,
     phys_pc = get_page_addr_code(env, pc);
     tb = tb_alloc(pc);
     if (!tb) {
-        /* flush must be done */
-        tb_flush(env);
+        /* make room in the next region */
+        tb_evict_region(env);
         /* cannot fail at this point */
         tb = tb_alloc(pc);
         /* Don't forget to invalidate previous TB info.  */
         tcg_ctx.tb_ctx.tb_invalidated_flag = 1;
     }
+    /* Approximate count of the evicted TBs translated again: the map
+       only records the hash of their physical PC. */
+    if (test_and_clear_bit(tb_phys_hash_func(phys_pc),
+                           tcg_ctx.tb_ctx.tb_evicted_map)) {
+        tcg_ctx.tb_ctx.tb_retranslate_count++;
+    }
     tc_ptr = tcg_ctx.code_gen_ptr;
     tb->tc_ptr = tc_ptr;
     tb->cs_base = cs_base;
     tb->flags = flags;
     tb->cflags = cflags;
-    cpu_gen_code(env, tb, &code_gen_size);
+    if (tb_cache_load(env, tb, phys_pc, &code_gen_size) < 0) {
+        cpu_gen_code(env, tb, &code_gen_size);
+        tb_cache_store(env, tb, phys_pc, code_gen_size);
+    }
     tcg_ctx.code_gen_ptr = (void *)(((uintptr_t)tcg_ctx.code_gen_ptr +
             code_gen_size + CODE_GEN_ALIGN - 1) & ~(CODE_GEN_ALIGN - 1));
 
@@ -1018,6 +1136,24 @@ TranslationBlock *tb_gen_code(CPUArchState *env,
     return tb;
 }
 
+/* Replace the hot 'tb' with a trace: a TB which follows the forward
+   branches of its guest code instead of ending at the first one, so that
+   the code of the following blocks is optimized together with it. The
+   branches that are not followed become side exits of the trace.  */
+TranslationBlock *tb_gen_trace(CPUArchState *env, TranslationBlock *tb)
+{
+    target_ulong pc = tb->pc;
+    target_ulong cs_base = tb->cs_base;
+    int flags = tb->flags;
+
+    tb_phys_invalidate(tb, -1);
+    /* The TB that cpu_exec() is about to chain to the trace may be the one
+       just invalidated, e.g. when it jumped to its own pc. */
+    tcg_ctx.tb_ctx.tb_invalidated_flag = 1;
+    tcg_ctx.tb_ctx.tb_trace_count++;
+    return tb_gen_code(env, pc, cs_base, flags, CF_TRACE);
+}
+
 /*
  * Invalidate all TBs which intersect with the target physical address range
  * [start;end[. NOTE: start and end may refer to *different* physical pages.
@@ -1358,23 +1494,29 @@ static void tb_link_page(TranslationBlock *tb, tb_page_addr_t phys_pc,
    tb[1].tc_ptr. Return NULL if not found */
 TranslationBlock *tb_find_pc(uintptr_t tc_ptr)
 {
-    int m_min, m_max, m;
+    int m_min, m_max, m, i;
     uintptr_t v;
     TranslationBlock *tb;
+    TBRegion *r;
 
-    if (tcg_ctx.tb_ctx.nb_tbs <= 0) {
+    if (tc_ptr < (uintptr_t)tcg_ctx.code_gen_buffer) {
         return NULL;
     }
-    if (tc_ptr < (uintptr_t)tcg_ctx.code_gen_buffer ||
-        tc_ptr >= (uintptr_t)tcg_ctx.code_gen_ptr) {
+    i = (tc_ptr - (uintptr_t)tcg_ctx.code_gen_buffer) /
+            tcg_ctx.tb_ctx.region_size;
+    if (i >= tcg_ctx.tb_ctx.nb_regions) {
+        return NULL;
+    }
+    r = &tcg_ctx.tb_ctx.regions[i];
+    if (r->nb_tbs <= 0 || tc_ptr >= (uintptr_t)tb_region_code_ptr(i)) {
         return NULL;
     }
     /* binary search (cf Knuth) */
     m_min = 0;
-    m_max = tcg_ctx.tb_ctx.nb_tbs - 1;
+    m_max = r->nb_tbs - 1;
     while (m_min <= m_max) {
         m = (m_min + m_max) >> 1;
-        tb = &tcg_ctx.tb_ctx.tbs[m];
+        tb = &r->tbs[m];
         v = (uintptr_t)tb->tc_ptr;
         if (v == tc_ptr) {
             return tb;
@@ -1384,7 +1526,7 @@ TranslationBlock *tb_find_pc(uintptr_t tc_ptr)
             m_min = m + 1;
         }
     }
-    return &tcg_ctx.tb_ctx.tbs[m_max];
+    return &r->tbs[m_max];
 }
 
 #ifndef CONFIG_ANDROID
@@ -1527,64 +1669,84 @@ void tb_flush_jmp_cache(CPUArchState *env, target_ulong addr)
 
 void dump_exec_info(FILE *f, fprintf_function cpu_fprintf)
 {
-    int i, target_code_size, max_target_code_size;
+    TBContext *ctx = &tcg_ctx.tb_ctx;
+    int i, j, target_code_size, max_target_code_size;
     int direct_jmp_count, direct_jmp2_count, cross_page;
+    size_t code_size;
     TranslationBlock *tb;
+    TBRegion *r;
 
     target_code_size = 0;
     max_target_code_size = 0;
     cross_page = 0;
     direct_jmp_count = 0;
     direct_jmp2_count = 0;
-    for (i = 0; i < tcg_ctx.tb_ctx.nb_tbs; i++) {
-        tb = &tcg_ctx.tb_ctx.tbs[i];
-        target_code_size += tb->size;
-        if (tb->size > max_target_code_size) {
-            max_target_code_size = tb->size;
-        }
-        if (tb->page_addr[1] != -1) {
-            cross_page++;
-        }
-        if (tb->tb_next_offset[0] != 0xffff) {
-            direct_jmp_count++;
-            if (tb->tb_next_offset[1] != 0xffff) {
-                direct_jmp2_count++;
+    code_size = 0;
+    for (j = 0; j < ctx->nb_regions; j++) {
+        r = &ctx->regions[j];
+        code_size += tb_region_code_ptr(j) - r->code_start;
+        for (i = 0; i < r->nb_tbs; i++) {
+            tb = &r->tbs[i];
+            target_code_size += tb->size;
+            if (tb->size > max_target_code_size) {
+                max_target_code_size = tb->size;
+            }
+            if (tb->page_addr[1] != -1) {
+                cross_page++;
+            }
+            if (tb->tb_next_offset[0] != 0xffff) {
+                direct_jmp_count++;
+                if (tb->tb_next_offset[1] != 0xffff) {
+                    direct_jmp2_count++;
+                }
             }
         }
     }
     /* XXX: avoid using doubles ? */
     cpu_fprintf(f, "Translation buffer state:\n");
-    cpu_fprintf(f, "gen code size       %td/%zd\n",
-                tcg_ctx.code_gen_ptr - tcg_ctx.code_gen_buffer,
-                tcg_ctx.code_gen_buffer_max_size);
+    cpu_fprintf(f, "gen code size       %zd/%zd\n",
+                code_size, tcg_ctx.code_gen_buffer_max_size);
     cpu_fprintf(f, "TB count            %d/%d\n",
-            tcg_ctx.tb_ctx.nb_tbs, tcg_ctx.code_gen_max_blocks);
+            ctx->nb_tbs, tcg_ctx.code_gen_max_blocks);
     cpu_fprintf(f, "TB avg target size  %d max=%d bytes\n",
-            tcg_ctx.tb_ctx.nb_tbs ? target_code_size /
-                    tcg_ctx.tb_ctx.nb_tbs : 0,
+            ctx->nb_tbs ? target_code_size / ctx->nb_tbs : 0,
             max_target_code_size);
-    cpu_fprintf(f, "TB avg host size    %td bytes (expansion ratio: %0.1f)\n",
-            tcg_ctx.tb_ctx.nb_tbs ? (tcg_ctx.code_gen_ptr -
-                                     tcg_ctx.code_gen_buffer) /
-                                     tcg_ctx.tb_ctx.nb_tbs : 0,
-                target_code_size ? (double) (tcg_ctx.code_gen_ptr -
-                                             tcg_ctx.code_gen_buffer) /
-                                             target_code_size : 0);
+    cpu_fprintf(f, "TB avg host size    %zd bytes (expansion ratio: %0.1f)\n",
+            ctx->nb_tbs ? code_size / ctx->nb_tbs : 0,
+            target_code_size ? (double) code_size / target_code_size : 0);
     cpu_fprintf(f, "cross page TB count %d (%d%%)\n", cross_page,
-            tcg_ctx.tb_ctx.nb_tbs ? (cross_page * 100) /
-                                    tcg_ctx.tb_ctx.nb_tbs : 0);
+            ctx->nb_tbs ? (cross_page * 100) / ctx->nb_tbs : 0);
     cpu_fprintf(f, "direct jump count   %d (%d%%) (2 jumps=%d %d%%)\n",
                 direct_jmp_count,
-                tcg_ctx.tb_ctx.nb_tbs ? (direct_jmp_count * 100) /
-                        tcg_ctx.tb_ctx.nb_tbs : 0,
+                ctx->nb_tbs ? (direct_jmp_count * 100) / ctx->nb_tbs : 0,
                 direct_jmp2_count,
-                tcg_ctx.tb_ctx.nb_tbs ? (direct_jmp2_count * 100) /
-                        tcg_ctx.tb_ctx.nb_tbs : 0);
+                ctx->nb_tbs ? (direct_jmp2_count * 100) / ctx->nb_tbs : 0);
+    cpu_fprintf(f, "TB regions          %d of %zd bytes\n",
+                ctx->nb_regions, ctx->region_size);
+    for (j = 0; j < ctx->nb_regions; j++) {
+        r = &ctx->regions[j];
+        cpu_fprintf(f, "  region %d%s        %td bytes (%d%%) %d TBs\n",
+                    j, j == ctx->cur_region ? "*" : " ",
+                    tb_region_code_ptr(j) - r->code_start,
+                    (int)((tb_region_code_ptr(j) - r->code_start) * 100 /
+                          ctx->region_size),
+                    r->nb_tbs);
+    }
     cpu_fprintf(f, "\nStatistics:\n");
-    cpu_fprintf(f, "TB flush count      %d\n", tcg_ctx.tb_ctx.tb_flush_count);
+    cpu_fprintf(f, "TB flush count      %d\n", ctx->tb_flush_count);
+    cpu_fprintf(f, "TB evict count      %d regions, %d TBs\n",
+                ctx->tb_region_evict_count, ctx->tb_evicted_count);
+    cpu_fprintf(f, "TB retranslate count %d (%d%% of evicted)\n",
+                ctx->tb_retranslate_count,
+                ctx->tb_evicted_count ? (int)((int64_t)
+                        ctx->tb_retranslate_count * 100 /
+                        ctx->tb_evicted_count) : 0);
+    cpu_fprintf(f, "TB trace count      %d (threshold %u)\n",
+                ctx->tb_trace_count, tb_trace_threshold);
     cpu_fprintf(f, "TB invalidate count %d\n",
-            tcg_ctx.tb_ctx.tb_phys_invalidate_count);
+            ctx->tb_phys_invalidate_count);
     cpu_fprintf(f, "TLB flush count     %d\n", tlb_flush_count);
+    tb_cache_dump_info(f, cpu_fprintf);
     tcg_dump_info(f, cpu_fprintf);
 }
 
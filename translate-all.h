@@ -33,4 +33,14 @@ bool tcg_enabled(void);
 void tb_invalidate_phys_page_fast(tb_page_addr_t start, int len);
 void tb_check_watchpoint(CPUArchState *env);
 
+/* tb-cache.c */
+/* Copy the code of 'tb' from the persistent translation cache, and set
+   '*code_size'. Returns 0 on success, or -1 if it must be generated, in
+   which case tb_cache_store() must be called afterwards.  */
+int tb_cache_load(CPUArchState *env, TranslationBlock *tb,
+                  tb_page_addr_t phys_pc, int *code_size);
+void tb_cache_store(CPUArchState *env, TranslationBlock *tb,
+                    tb_page_addr_t phys_pc, int code_size);
+void tb_cache_dump_info(FILE *f, fprintf_function cpu_fprintf);
+
 #endif /* TRANSLATE_ALL_H */
@@ -0,0 +1,274 @@
+/*
+ * QEMU persistent file descriptor watches
+ *
+ * Copyright (c) 2015 The Android Open Source Project
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2 or later.
+ * See the COPYING file in the top-level directory.
+ */
+
+#include "config-host.h"
+#include "qemu-common.h"
+#include "qemu/io-watch.h"
+
+#ifdef CONFIG_EPOLL
+#include <fcntl.h>
+#include <sys/epoll.h>
+
+/* Maximum number of events returned by one qemu_io_watch_wait(). Others
+ * are reported by the next call, since watches are level-triggered. */
+#define IO_WATCH_MAX_EVENTS  256
+
+typedef struct IOWatch {
+    IOWatchHandler *handler;
+    void *opaque;
+    int events;         /* events of interest */
+    int revents;        /* events pending dispatch */
+    uint32_t gen;       /* bumped whenever the owner changes */
+    int registered;     /* 1 if in the epoll set */
+    int unwatchable;    /* 1 if epoll refused the descriptor */
+} IOWatch;
+
+static int io_watch_epfd = -1;
+static IOWatch *io_watches;
+static int io_watch_count;
+static struct epoll_event io_watch_events[IO_WATCH_MAX_EVENTS];
+static int io_watch_nevents;
+
+int qemu_io_watch_init(void)
+{
+    if (io_watch_epfd < 0) {
+        io_watch_epfd = epoll_create(IO_WATCH_MAX_EVENTS);
+        if (io_watch_epfd < 0) {
+            return -1;
+        }
+        fcntl(io_watch_epfd, F_SETFD, FD_CLOEXEC);
+    }
+    return 0;
+}
+
+int qemu_io_watch_enabled(void)
+{
+    return io_watch_epfd >= 0;
+}
+
+static IOWatch *io_watch_get(int fd)
+{
+    if (fd >= io_watch_count) {
+        int count = io_watch_count ? io_watch_count : 64;
+
+        while (count <= fd) {
+            count *= 2;
+        }
+        io_watches = g_realloc(io_watches, count * sizeof(IOWatch));
+        memset(io_watches + io_watch_count, 0,
+               (count - io_watch_count) * sizeof(IOWatch));
+        io_watch_count = count;
+    }
+    return &io_watches[fd];
+}
+
+/* Bring the epoll set in sync with the watch of 'fd'. */
+static int io_watch_update(int fd, IOWatch *w)
+{
+    struct epoll_event ev;
+    int op, ret;
+
+    if (!w->events) {
+        if (w->registered) {
+            epoll_ctl(io_watch_epfd, EPOLL_CTL_DEL, fd, NULL);
+            w->registered = 0;
+        }
+        return 0;
+    }
+
+    memset(&ev, 0, sizeof(ev));
+    if (w->events & IO_WATCH_READ) {
+        ev.events |= EPOLLIN;
+    }
+    if (w->events & IO_WATCH_WRITE) {
+        ev.events |= EPOLLOUT;
+    }
+    if (w->events & IO_WATCH_PRI) {
+        ev.events |= EPOLLPRI;
+    }
+    ev.data.u64 = (uint32_t)fd | ((uint64_t)w->gen << 32);
+
+    op = w->registered ? EPOLL_CTL_MOD : EPOLL_CTL_ADD;
+    ret = epoll_ctl(io_watch_epfd, op, fd, &ev);
+    if (ret < 0 && (errno == ENOENT || errno == EEXIST)) {
+        /* The descriptor was closed, or reused, without removing its
+         * watch first: the kernel set doesn't match ours. */
+        op = (errno == ENOENT) ? EPOLL_CTL_ADD : EPOLL_CTL_MOD;
+        ret = epoll_ctl(io_watch_epfd, op, fd, &ev);
+    }
+    if (ret < 0) {
+        /* e.g. EPERM for regular files: let the caller select() it. */
+        w->registered = 0;
+        w->unwatchable = 1;
+        return -1;
+    }
+    w->registered = 1;
+    return 0;
+}
+
+int qemu_io_watch_set(int fd, int events, IOWatchHandler *handler,
+                      void *opaque)
+{
+    IOWatch *w;
+
+    if (io_watch_epfd < 0 || fd < 0) {
+        return -1;
+    }
+    w = io_watch_get(fd);
+    if (w->handler != handler || w->opaque != opaque) {
+        w->handler = handler;
+        w->opaque = opaque;
+        w->gen++;
+        w->revents = 0;
+        w->unwatchable = 0;
+    } else if (w->unwatchable) {
+        return -1;
+    } else if (w->events == events && (w->registered || !events)) {
+        return 0;
+    }
+    w->events = events;
+    w->revents &= events;
+    return io_watch_update(fd, w);
+}
+
+void qemu_io_watch_remove(int fd, void *opaque)
+{
+    IOWatch *w;
+
+    if (fd < 0 || fd >= io_watch_count) {
+        return;
+    }
+    w = &io_watches[fd];
+    if (w->opaque != opaque || !w->handler) {
+        return;
+    }
+    w->events = 0;
+    io_watch_update(fd, w);
+    w->handler = NULL;
+    w->opaque = NULL;
+    w->gen++;
+    w->revents = 0;
+    w->unwatchable = 0;
+}
+
+void qemu_io_watch_cancel(int fd, int events)
+{
+    if (fd >= 0 && fd < io_watch_count) {
+        io_watches[fd].revents &= ~events;
+    }
+}
+
+int qemu_io_watch_fd(void)
+{
+    return io_watch_epfd;
+}
+
+int qemu_io_watch_wait(int timeout)
+{
+    int n, ret;
+
+    ret = epoll_wait(io_watch_epfd, io_watch_events, IO_WATCH_MAX_EVENTS,
+                     timeout);
+    io_watch_nevents = 0;
+    for (n = 0; n < ret; n++) {
+        uint64_t data = io_watch_events[n].data.u64;
+        uint32_t flags = io_watch_events[n].events;
+        int fd = (int)(uint32_t)data;
+        int events = 0;
+        IOWatch *w;
+
+        if (fd >= io_watch_count) {
+            continue;
+        }
+        w = &io_watches[fd];
+        if (w->gen != (uint32_t)(data >> 32) || !w->handler) {
+            continue;
+        }
+        if (flags & EPOLLIN) {
+            events |= IO_WATCH_READ;
+        }
+        if (flags & EPOLLOUT) {
+            events |= IO_WATCH_WRITE;
+        }
+        if (flags & EPOLLPRI) {
+            events |= IO_WATCH_PRI;
+        }
+        if (flags & (EPOLLERR | EPOLLHUP)) {
+            /* select() reports these as readable and writable. */
+            events |= IO_WATCH_READ | IO_WATCH_WRITE;
+        }
+        w->revents = events & w->events;
+        io_watch_events[io_watch_nevents++] = io_watch_events[n];
+    }
+    return ret;
+}
+
+void qemu_io_watch_dispatch(void)
+{
+    int n;
+
+    for (n = 0; n < io_watch_nevents; n++) {
+        uint64_t data = io_watch_events[n].data.u64;
+        int fd = (int)(uint32_t)data;
+        IOWatch *w = &io_watches[fd];
+        int events;
+
+        /* The watch may have been removed, or its events cancelled, by
+         * the handlers called before. */
+        if (w->gen != (uint32_t)(data >> 32) || !w->handler || !w->revents) {
+            continue;
+        }
+        events = w->revents;
+        w->revents = 0;
+        w->handler(w->opaque, fd, events);
+    }
+    io_watch_nevents = 0;
+}
+
+#else  /* !CONFIG_EPOLL */
+
+int qemu_io_watch_init(void)
+{
+    return -1;
+}
+
+int qemu_io_watch_enabled(void)
+{
+    return 0;
+}
+
+int qemu_io_watch_set(int fd, int events, IOWatchHandler *handler,
+                      void *opaque)
+{
+    return -1;
+}
+
+void qemu_io_watch_remove(int fd, void *opaque)
+{
+}
+
+void qemu_io_watch_cancel(int fd, int events)
+{
+}
+
+int qemu_io_watch_fd(void)
+{
+    return -1;
+}
+
+int qemu_io_watch_wait(int timeout)
+{
+    return -1;
+}
+
+void qemu_io_watch_dispatch(void)
+{
+}
+
+#endif  /* !CONFIG_EPOLL */
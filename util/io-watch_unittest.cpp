@@ -0,0 +1,354 @@
+// Copyright (C) 2015 The Android Open Source Project
+//
+// This software is licensed under the terms of the GNU General Public
+// License version 2, as published by the Free Software Foundation, and
+// may be copied, distributed, and modified under those terms.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+
+extern "C" {
+#include "qemu/io-watch.h"
+}
+
+#include <gtest/gtest.h>
+
+#ifndef _WIN32
+
+#include <stdio.h>
+#include <unistd.h>
+
+namespace {
+
+// Records the calls of its handler.
+struct Recorder {
+    Recorder() : calls(0), fd(-1), events(0) {}
+
+    int calls;
+    int fd;
+    int events;
+};
+
+void recordEvent(void* opaque, int fd, int events) {
+    Recorder* rec = static_cast<Recorder*>(opaque);
+    rec->calls++;
+    rec->fd = fd;
+    rec->events = events;
+}
+
+// A pipe, closed on destruction.
+struct Pipe {
+    Pipe() {
+        if (pipe(fds) < 0) {
+            fds[0] = fds[1] = -1;
+        }
+    }
+
+    ~Pipe() {
+        closeEnd(0);
+        closeEnd(1);
+    }
+
+    int readFd() const { return fds[0]; }
+    int writeFd() const { return fds[1]; }
+
+    void closeEnd(int n) {
+        if (fds[n] >= 0) {
+            close(fds[n]);
+            fds[n] = -1;
+        }
+    }
+
+    // Make the read end readable.
+    void fill() { EXPECT_EQ(1, write(fds[1], "x", 1)); }
+
+    // Move the read end to descriptor |fd|, which must be closed.
+    void moveReadEnd(int fd) {
+        if (fds[0] == fd) {
+            return;
+        }
+        ASSERT_EQ(fd, dup2(fds[0], fd));
+        close(fds[0]);
+        fds[0] = fd;
+    }
+
+    int fds[2];
+};
+
+// Waits for the watched descriptors and dispatches their events, like
+// main_loop_wait() does.
+int waitAndDispatch(int timeout) {
+    int ret = qemu_io_watch_wait(timeout);
+    qemu_io_watch_dispatch();
+    return ret;
+}
+
+class IoWatchTest : public ::testing::Test {
+protected:
+    virtual void SetUp() {
+        // Not available on all hosts, where main_loop_wait() uses select().
+        mEnabled = (qemu_io_watch_init() == 0);
+        if (mEnabled) {
+            // Drop the events left by other tests.
+            qemu_io_watch_wait(0);
+        }
+    }
+
+    bool mEnabled;
+};
+
+}  // namespace
+
+TEST_F(IoWatchTest, ReadDispatch) {
+    if (!mEnabled) {
+        return;
+    }
+    Pipe p;
+    Recorder rec;
+    ASSERT_EQ(0, qemu_io_watch_set(p.readFd(), IO_WATCH_READ,
+                                   recordEvent, &rec));
+    EXPECT_EQ(0, waitAndDispatch(0));
+    EXPECT_EQ(0, rec.calls);
+
+    p.fill();
+    EXPECT_EQ(1, waitAndDispatch(1000));
+    EXPECT_EQ(1, rec.calls);
+    EXPECT_EQ(p.readFd(), rec.fd);
+    EXPECT_EQ(IO_WATCH_READ, rec.events);
+
+    // Level-triggered, like select().
+    EXPECT_EQ(1, waitAndDispatch(1000));
+    EXPECT_EQ(2, rec.calls);
+
+    // Disabled, but still owned.
+    ASSERT_EQ(0, qemu_io_watch_set(p.readFd(), 0, recordEvent, &rec));
+    EXPECT_EQ(0, waitAndDispatch(0));
+    EXPECT_EQ(2, rec.calls);
+
+    qemu_io_watch_remove(p.readFd(), &rec);
+}
+
+TEST_F(IoWatchTest, WriteAndHangup) {
+    if (!mEnabled) {
+        return;
+    }
+    Pipe p;
+    Recorder writer, reader;
+    ASSERT_EQ(0, qemu_io_watch_set(p.writeFd(), IO_WATCH_WRITE,
+                                   recordEvent, &writer));
+    EXPECT_EQ(1, waitAndDispatch(1000));
+    EXPECT_EQ(1, writer.calls);
+    EXPECT_EQ(IO_WATCH_WRITE, writer.events);
+    qemu_io_watch_remove(p.writeFd(), &writer);
+
+    // A hangup is reported as readable, like select() does, so that the
+    // handler's read() sees the end of file.
+    ASSERT_EQ(0, qemu_io_watch_set(p.readFd(), IO_WATCH_READ,
+                                   recordEvent, &reader));
+    p.closeEnd(1);
+    EXPECT_EQ(1, waitAndDispatch(1000));
+    EXPECT_EQ(1, reader.calls);
+    EXPECT_EQ(IO_WATCH_READ, reader.events);
+    qemu_io_watch_remove(p.readFd(), &reader);
+}
+
+TEST_F(IoWatchTest, Cancel) {
+    if (!mEnabled) {
+        return;
+    }
+    Pipe p;
+    Recorder rec;
+    ASSERT_EQ(0, qemu_io_watch_set(p.readFd(), IO_WATCH_READ,
+                                   recordEvent, &rec));
+    p.fill();
+    EXPECT_EQ(1, qemu_io_watch_wait(1000));
+    qemu_io_watch_cancel(p.readFd(), IO_WATCH_READ);
+    qemu_io_watch_dispatch();
+    EXPECT_EQ(0, rec.calls);
+    qemu_io_watch_remove(p.readFd(), &rec);
+}
+
+TEST_F(IoWatchTest, RemoveOnlyByOwner) {
+    if (!mEnabled) {
+        return;
+    }
+    Pipe p;
+    Recorder owner, other;
+    ASSERT_EQ(0, qemu_io_watch_set(p.readFd(), IO_WATCH_READ,
+                                   recordEvent, &owner));
+    qemu_io_watch_remove(p.readFd(), &other);
+    p.fill();
+    EXPECT_EQ(1, waitAndDispatch(1000));
+    EXPECT_EQ(1, owner.calls);
+    EXPECT_EQ(0, other.calls);
+    qemu_io_watch_remove(p.readFd(), &owner);
+}
+
+TEST_F(IoWatchTest, RemoveAndCloseBeforeDispatch) {
+    if (!mEnabled) {
+        return;
+    }
+    Pipe first, second;
+    Recorder firstRec, secondRec;
+    ASSERT_EQ(0, qemu_io_watch_set(first.readFd(), IO_WATCH_READ,
+                                   recordEvent, &firstRec));
+    ASSERT_EQ(0, qemu_io_watch_set(second.readFd(), IO_WATCH_READ,
+                                   recordEvent, &secondRec));
+    first.fill();
+    second.fill();
+    EXPECT_EQ(2, qemu_io_watch_wait(1000));
+
+    // E.g. a handler called first closes the other socket: its pending
+    // event must be dropped.
+    qemu_io_watch_remove(second.readFd(), &secondRec);
+    second.closeEnd(0);
+    qemu_io_watch_dispatch();
+    EXPECT_EQ(1, firstRec.calls);
+    EXPECT_EQ(0, secondRec.calls);
+    qemu_io_watch_remove(first.readFd(), &firstRec);
+}
+
+TEST_F(IoWatchTest, ReusedBeforeDispatch) {
+    if (!mEnabled) {
+        return;
+    }
+    Pipe old;
+    Recorder oldRec, newRec;
+    const int fd = old.readFd();
+    ASSERT_EQ(0, qemu_io_watch_set(fd, IO_WATCH_READ, recordEvent, &oldRec));
+    old.fill();
+    EXPECT_EQ(1, qemu_io_watch_wait(1000));
+
+    // The descriptor is closed, then reused by a new owner, before the
+    // events are dispatched: the stale event must not reach the new owner,
+    // whose descriptor isn't readable.
+    qemu_io_watch_remove(fd, &oldRec);
+    old.closeEnd(0);
+    Pipe reused;
+    reused.moveReadEnd(fd);
+    ASSERT_EQ(0, qemu_io_watch_set(fd, IO_WATCH_READ, recordEvent, &newRec));
+    qemu_io_watch_dispatch();
+    EXPECT_EQ(0, oldRec.calls);
+    EXPECT_EQ(0, newRec.calls);
+
+    reused.fill();
+    EXPECT_EQ(1, waitAndDispatch(1000));
+    EXPECT_EQ(0, oldRec.calls);
+    EXPECT_EQ(1, newRec.calls);
+    qemu_io_watch_remove(fd, &newRec);
+}
+
+TEST_F(IoWatchTest, ReusedWithoutRemove) {
+    if (!mEnabled) {
+        return;
+    }
+    Pipe old;
+    Recorder oldRec, newRec;
+    const int fd = old.readFd();
+    ASSERT_EQ(0, qemu_io_watch_set(fd, IO_WATCH_READ, recordEvent, &oldRec));
+
+    // Closing the descriptor drops it from the kernel's set, but not from
+    // the table, which must recover when the new owner watches it.
+    old.closeEnd(0);
+    Pipe reused;
+    reused.moveReadEnd(fd);
+    ASSERT_EQ(0, qemu_io_watch_set(fd, IO_WATCH_READ, recordEvent, &newRec));
+    reused.fill();
+    EXPECT_EQ(1, waitAndDispatch(1000));
+    EXPECT_EQ(0, oldRec.calls);
+    EXPECT_EQ(1, newRec.calls);
+    qemu_io_watch_remove(fd, &newRec);
+}
+
+TEST_F(IoWatchTest, OwnerChange) {
+    if (!mEnabled) {
+        return;
+    }
+    Pipe p;
+    Recorder first, second;
+    ASSERT_EQ(0, qemu_io_watch_set(p.readFd(), IO_WATCH_READ,
+                                   recordEvent, &first));
+    p.fill();
+    EXPECT_EQ(1, qemu_io_watch_wait(1000));
+    ASSERT_EQ(0, qemu_io_watch_set(p.readFd(), IO_WATCH_READ,
+                                   recordEvent, &second));
+    qemu_io_watch_dispatch();
+    EXPECT_EQ(0, first.calls);
+    EXPECT_EQ(0, second.calls);
+
+    EXPECT_EQ(1, waitAndDispatch(1000));
+    EXPECT_EQ(0, first.calls);
+    EXPECT_EQ(1, second.calls);
+    qemu_io_watch_remove(p.readFd(), &second);
+}
+
+TEST_F(IoWatchTest, RegularFileFallsBackToSelect) {
+    if (!mEnabled) {
+        return;
+    }
+    FILE* file = tmpfile();
+    ASSERT_TRUE(file);
+    const int fd = fileno(file);
+    Recorder rec, other;
+    // epoll refuses regular files: the caller must select() them.
+    EXPECT_EQ(-1, qemu_io_watch_set(fd, IO_WATCH_READ, recordEvent, &rec));
+    EXPECT_EQ(-1, qemu_io_watch_set(fd, IO_WATCH_READ, recordEvent, &rec));
+    EXPECT_EQ(-1, qemu_io_watch_set(fd, IO_WATCH_READ, recordEvent, &other));
+    EXPECT_EQ(0, waitAndDispatch(0));
+    EXPECT_EQ(0, rec.calls);
+    qemu_io_watch_remove(fd, &other);
+    fclose(file);
+
+    // A pipe reusing the descriptor can be watched again.
+    Pipe p;
+    p.moveReadEnd(fd);
+    EXPECT_EQ(0, qemu_io_watch_set(fd, IO_WATCH_READ, recordEvent, &rec));
+    p.fill();
+    EXPECT_EQ(1, waitAndDispatch(1000));
+    EXPECT_EQ(1, rec.calls);
+    qemu_io_watch_remove(fd, &rec);
+}
+
+TEST_F(IoWatchTest, SelectWithWatchFd) {
+    if (!mEnabled) {
+        return;
+    }
+    // main_loop_wait() select()s the descriptors that can't be watched
+    // together with the watch set's own descriptor.
+    Pipe watched, selected;
+    Recorder rec;
+    ASSERT_EQ(0, qemu_io_watch_set(watched.readFd(), IO_WATCH_READ,
+                                   recordEvent, &rec));
+    watched.fill();
+    selected.fill();
+
+    fd_set rfds;
+    FD_ZERO(&rfds);
+    FD_SET(selected.readFd(), &rfds);
+    FD_SET(qemu_io_watch_fd(), &rfds);
+    struct timeval tv = { 1, 0 };
+    int nfds = selected.readFd() > qemu_io_watch_fd() ? selected.readFd()
+                                                      : qemu_io_watch_fd();
+    EXPECT_EQ(2, select(nfds + 1, &rfds, NULL, NULL, &tv));
+    EXPECT_TRUE(FD_ISSET(selected.readFd(), &rfds));
+    EXPECT_TRUE(FD_ISSET(qemu_io_watch_fd(), &rfds));
+    EXPECT_EQ(1, waitAndDispatch(0));
+    EXPECT_EQ(1, rec.calls);
+    qemu_io_watch_remove(watched.readFd(), &rec);
+}
+
+TEST_F(IoWatchTest, InvalidDescriptor) {
+    if (!mEnabled) {
+        return;
+    }
+    Recorder rec;
+    EXPECT_EQ(-1, qemu_io_watch_set(-1, IO_WATCH_READ, recordEvent, &rec));
+    // Never watched: ignored.
+    qemu_io_watch_remove(-1, &rec);
+    qemu_io_watch_remove(100000, &rec);
+    qemu_io_watch_cancel(100000, IO_WATCH_READ);
+}
+
+#endif  // !_WIN32
@@ -203,6 +203,7 @@ int qemu_main(int argc, char **argv, char **envp);
 #include "qemu/timer.h"
 #include "sysemu/char.h"
 #include "qemu/cache-utils.h"
+#include "qemu/error-report.h"
 #include "block/block.h"
 #include "sysemu/dma.h"
 #include "audio/audio.h"
@@ -1700,6 +1701,11 @@ void vm_state_notify(int running, int reason)
 
 void vm_start(void)
 {
+    if (ram_load_failed()) {
+        error_report("Guest RAM could not be restored from the snapshot, "
+                     "not resuming the VM");
+        return;
+    }
     if (!vm_running) {
         cpu_enable_ticks();
         vm_running = 1;
@@ -2579,6 +2585,7 @@ int main(int argc, char **argv, char **envp)
     const char *usb_devices[MAX_USB_CMDLINE];
     int usb_devices_index;
     int tb_size;
+    const char *tb_cache_path = NULL;
     const char *pid_file = NULL;
     const char *incoming = NULL;
     const char* log_mask = NULL;
@@ -3322,6 +3329,18 @@ int main(int argc, char **argv, char **envp)
                 if (tb_size < 0)
                     tb_size = 0;
                 break;
+            case QEMU_OPTION_tb_cache:
+                tb_cache_path = optarg;
+                break;
+            case QEMU_OPTION_tb_trace:
+                tb_set_trace_threshold(strtoul(optarg, NULL, 0));
+                break;
+            case QEMU_OPTION_tlb_size:
+                if (tlb_set_size(strtoul(optarg, NULL, 0)) < 0) {
+                    fprintf(stderr, "Invalid TLB size: %s\n", optarg);
+                    exit(1);
+                }
+                break;
             case QEMU_OPTION_icount:
                 icount_option = optarg;
                 break;
@@ -4202,7 +4221,7 @@ int main(int argc, char **argv, char **envp)
     register_savevm_live(NULL,
                          "ram",
                          0,
-                         3,
+                         5,
                          ops,
                          NULL);
 
@@ -4422,6 +4441,10 @@ int main(int argc, char **argv, char **envp)
         stralloc_reset(kernel_config);
     }
 
+    if (tb_cache_path) {
+        tb_cache_open(tb_cache_path, cpu_model);
+    }
+
     CPU_FOREACH(cpu) {
         for (i = 0; i < nb_numa_nodes; i++) {
             if (node_cpumask[i] & (1 << cpu->cpu_index)) {